@@ -1603,7 +1603,7 @@ static void vRTS_schedule_interval_slot(uchar ucTskIndex, //Tbl Idx of action to
 
 			uchar ucTaskListIndex, ucCompatibleTaskFound;
 			ucCompatibleTaskFound = FALSE;
-			for(ucTaskListIndex = 0; ucTaskListIndex < MAXNUMTASKS; ucTaskListIndex++)
+			for(ucTaskListIndex = 0; ucTaskListIndex < MAXNUM_TASKS_PERSLOT; ucTaskListIndex++)
 			{
 				// Is the slot occupied with a compatible task
 				if (ucTask_CheckComp(ucTskIndex, g_ucNextSlotTaskTable[ucNST_tblNum][ucFoundSlot][ucTaskListIndex])) {
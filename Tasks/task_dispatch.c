@@ -32,6 +32,7 @@
 #include "ucs.h"
 #include "scc.h"
 #include "flash_mcu.h"
+#include "crc.h"		// CRC for the SD read back check
 
 extern volatile uint8 ucaMSG_BUFF[MAX_RESERVED_MSG_SIZE];
 extern S_Task_Ctl p_saTaskList[MAXNUMTASKS];
@@ -132,33 +133,126 @@ void vTask_ModifyTCB(void)
 	}
 }
 
+//////////////////////////////////////////////////////////////////////////
+//! \fn vTask_LoadSDCardBlock
+//!
+//! \brief Builds the contents of one SD card block slot
+//!
+//! The last slot of every index group gets an index block made from the
+//! entries stored in FRAM, every other slot gets the next page of the FRAM
+//! buffer.  The index entry of a data block is stored as the block is built
+//! so an index block later in the same batch already lists it.  Building
+//! the block again on a retry just rewrites the same entry.
+//!
+//! \param ulAddress, SD card block
+//! \param ucpPage, next page offset in the FRAM buffer, advanced when a page is used
+//! \param ucpBlock, SD_CARD_BLOCKLEN byte buffer
+//! \return none
+//////////////////////////////////////////////////////////////////////////
+static void vTask_LoadSDCardBlock(ulong ulAddress, uchar *ucpPage, uchar *ucpBlock)
+{
+	uint uiCount;
+	uchar *ucpLast;
+
+	if (SD_LOG_IS_INDEX(ulAddress, SD_CARD_START_BLOCK))
+	{
+		for (uiCount = 0; uiCount < SD_CARD_BLOCKLEN; uiCount++)
+			ucpBlock[uiCount] = 0;
+
+		vL2FRAM_GetSDIndexEntries(&ucpBlock[SD_BLK_HDR_SZ]);
+		ucpLast = &ucpBlock[SD_BLK_HDR_SZ + ((SD_LOG_INDEX_ENTRIES - 1) * SD_IDX_ENT_SZ)];
+
+		// The header covers the whole group so a search can treat it like a data block
+		vMISC_copyUlongIntoBytes(ulMISC_buildUlongFromBytes(&ucpLast[SD_IDX_ENT_SEQ], NO_NOINT),
+				&ucpBlock[SD_BLK_IDX_SEQ], NO_NOINT);
+		vMISC_copyUlongIntoBytes(ulMISC_buildUlongFromBytes(&ucpBlock[SD_BLK_HDR_SZ + SD_IDX_ENT_FIRST_TIME], NO_NOINT),
+				&ucpBlock[SD_BLK_IDX_FIRST_TIME], NO_NOINT);
+		vMISC_copyUlongIntoBytes(ulMISC_buildUlongFromBytes(&ucpLast[SD_IDX_ENT_LAST_TIME], NO_NOINT),
+				&ucpBlock[SD_BLK_IDX_LAST_TIME], NO_NOINT);
+		vMISC_copyUintIntoBytes(SD_BLK_HDR_SZ + FRAM_SD_INDEX_SIZE, &ucpBlock[SD_BLK_IDX_END], NO_NOINT);
+
+		vSD_SealBlock(ucpBlock, SD_BLK_TYPE_INDEX, uiL2FRAM_GetSDVolume());
+	}
+	else
+	{
+		vL2FRAM_ReadSDCardBuffer(*ucpPage, ucpBlock);
+		(*ucpPage)++;
+
+		vL2FRAM_PutSDIndexEntry(SD_LOG_SLOT(ulAddress, SD_CARD_START_BLOCK), ucpBlock);
+		vSD_SealBlock(ucpBlock, SD_BLK_TYPE_DATA, uiL2FRAM_GetSDVolume());
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+//! \fn ucTask_WriteSDCardPages
+//!
+//! \brief Writes the oldest pages of the FRAM SD card buffer, and the index
+//! blocks that fall between them, to consecutive SD card blocks with a
+//! single multiple block write
+//!
+//! \param ulAddress, first SD card block
+//! \param ucBlocks, number of blocks
+//! \param ucpBlock, SD_CARD_BLOCKLEN byte scratch buffer
+//! \return SD_SUCCESS or SD_FAILED
+//////////////////////////////////////////////////////////////////////////
+static uchar ucTask_WriteSDCardPages(ulong ulAddress, uchar ucBlocks, uchar *ucpBlock)
+{
+	uchar ucBlk;
+	uchar ucPage;
+
+	if (SD_Write_MultipleBlocks_Start(ulAddress, ucBlocks) == SD_FAILED)
+		return SD_FAILED;
+
+	// Each block is built just before it goes out
+	ucPage = 0;
+	for (ucBlk = 0; ucBlk < ucBlocks; ucBlk++)
+	{
+		vTask_LoadSDCardBlock(ulAddress + ucBlk, &ucPage, ucpBlock);
+		if (SD_Write_MultipleBlocks_Next(ucpBlock) == SD_FAILED)
+			return SD_FAILED;
+	}
+
+	return SD_Write_MultipleBlocks_Stop();
+}
+
 //////////////////////////////////////////////////////////////////////////
 //! \fn vTask_FRAM_to_SDCard(void)
 //!
 //! \brief Writes the reports from the SD Card buffer in FRAM to the SD Card
 //!
+//! Every full page waiting in the buffer goes out in one multiple block
+//! write, so the card is powered and initialized once per batch instead of
+//! once per block.  If no page is full (emergency write on low battery) the
+//! page being filled is written on its own.  Index blocks are written in
+//! the same batch as the pages around them.
+//!
 //! \param none
 //! \return none
 //////////////////////////////////////////////////////////////////////////
 void vTask_FRAM_to_SDCard(void)
 {
 	uchar ucBlock[SD_CARD_BLOCKLEN] = {0};
-    uchar ucVerifyBlock[SD_CARD_BLOCKLEN] = {0};
 	uchar ucAttemptCount;
-	ulong ulAddress;
+	ulong ulAddress = 0;
+	ulong ulCapacity;
 	uint uiCount;
+	uchar ucPages;
+	uchar ucPage;
+	uchar ucBlocks = 0;
+	uchar ucBlk;
 	uchar ucErrorCode;
 	uchar ucErrorCodePriority;
 	uchar ucMsgIndex;
 	const uchar ucTimeout = 50;
-	uint i;
-	bool verified = true;
+	bool verified = false;
 
-	// Get the next free SD card address from FRAM
-	ulAddress = ulL2FRAM_GetSDCardBlockNum();
+	// Flush every full page, or the partial page if there are none
+	ucPages = ucL2FRAM_GetSDCardPagesReady();
+	if (ucPages == 0)
+		ucPages = 1;
 
-	// Read the contents of the buffer to the local block
-	vL2FRAM_ReadSDCardBuffer(ucBlock);
+	// Assume success
+	ucErrorCode = ucErrorCodePriority = 0;
 
 	// If at first you don't succeed.....
 	ucAttemptCount = 5;
@@ -169,17 +263,11 @@ void vTask_FRAM_to_SDCard(void)
 
 		// Assume success
 		ucErrorCode = ucErrorCodePriority = 0;
+		verified = true;
 
-		// Power up the SD card and run the initialization sequence
-		vSD_PowerOn();
-
-		// Try the initialization function a few times
-		for (uiCount = 0; uiCount < ucTimeout; uiCount++)
-		{
-			if (ucSD_Init() == SD_SUCCESS)
-				break;
-		}
-		if (uiCount == ucTimeout && ucAttemptCount == 0)
+		// Join the SD session, the card is only powered up and initialized if
+		// nothing else has it open.  It stays up while pages are read from FRAM.
+		if (ucSD_SessionOpen() == SD_FAILED)
 		{
 			ucErrorCode = SRC_ID_SDCARD_INIT_FAIL;
 			ucErrorCodePriority = RPT_PRTY_SDCARD_INIT_FAIL;
@@ -188,16 +276,47 @@ void vTask_FRAM_to_SDCard(void)
 #endif
 		}
 
+		// Size the batch once the card is up, the capacity is only known after
+		// it has been initialized
+		if (ucErrorCode == 0)
+		{
+			// Get the next free SD card address from FRAM
+			ulAddress = ulL2FRAM_GetSDCardBlockNum();
+
+			// The capacity is a block count, so block ulCapacity is already past
+			// the end.  Start over at the beginning like the block counter does.
+			ulCapacity = ulSD_GetCapacity();
+			if (ulCapacity != 0 && ulAddress >= ulCapacity)
+			{
+				ulAddress = SD_CARD_START_BLOCK;
+				vL2FRAM_SetSDCardBlockNum(ulAddress);
+			}
+
+			// Count the index slots between the pages, one right after the last
+			// page goes out with them so the group is indexed as soon as it is full
+			for (ucBlocks = 0, ucPage = 0; ucPage < ucPages; ucBlocks++)
+			{
+				if (!SD_LOG_IS_INDEX(ulAddress + ucBlocks, SD_CARD_START_BLOCK))
+					ucPage++;
+			}
+			if (SD_LOG_IS_INDEX(ulAddress + ucBlocks, SD_CARD_START_BLOCK))
+				ucBlocks++;
+
+			// Do not run off the end of the card, the rest goes in the next batch
+			if (ulCapacity != 0 && ulAddress + ucBlocks > ulCapacity)
+				ucBlocks = (uchar) (ulCapacity - ulAddress);
+		}
+
 		// Only proceed if initialization was successful
 		if (ucErrorCode == 0)
 		{
-			// Write the block to the SD card
+			// Write the batch to the SD card
 			for (uiCount = 0; uiCount < ucTimeout; uiCount++)
 			{
-				if (SD_Write_Block(ucBlock, ulAddress) == SD_SUCCESS)
+				if (ucTask_WriteSDCardPages(ulAddress, ucBlocks, ucBlock) == SD_SUCCESS)
 					break;
 			}
-			if (uiCount == ucTimeout && ucAttemptCount == 0)
+			if (uiCount == ucTimeout)
 			{
 				ucErrorCode = SRC_ID_SDCARD_WRITE_FAIL;
 				ucErrorCodePriority = RPT_PRTY_SDCARD_WRITE_FAIL;
@@ -205,53 +324,60 @@ void vTask_FRAM_to_SDCard(void)
 				vSERIAL_sout("SD write fail\r\n", 15);
 #endif
 			}
-
-			for(uint z = 0; z < SD_CARD_BLOCKLEN; ++z)
-			    vSERIAL_HB8out(ucBlock[z]);
 		}
 
-        if (ucErrorCode == 0)
-        {
-            // Read the block to the SD card
-            for (uiCount = 0; uiCount < ucTimeout; uiCount++)
-            {
-                if (SD_Read_Block(ucVerifyBlock, ulAddress) == SD_SUCCESS)
-                    break;
-            }
-
-            if (uiCount == ucTimeout && ucAttemptCount == 0 )
-            {
-                ucErrorCode = SRC_ID_SDCARD_READ_FAIL;
-                ucErrorCodePriority = RPT_PRTY_SDCARD_READ_FAIL;
+		// The data response token and CRC16 of every block already confirm the
+		// write.  Paranoid mode also reads each block back and compares CRCs so
+		// a single block buffer is still enough.
+#if SD_WRITE_READBACK
+		ucPage = 0;
+		for (ucBlk = 0; ucBlk < ucBlocks && ucErrorCode == 0 && verified; ucBlk++)
+		{
+			uint uiCRC;
+
+			vTask_LoadSDCardBlock(ulAddress + ucBlk, &ucPage, ucBlock);
+			uiCRC = uiCRC16_ComputeBlockCRC(ucBlock, SD_CARD_BLOCKLEN);
+
+			for (uiCount = 0; uiCount < ucTimeout; uiCount++)
+			{
+				if (SD_Read_Block(ucBlock, ulAddress + ucBlk) == SD_SUCCESS)
+					break;
+			}
+
+			if (uiCount == ucTimeout)
+			{
+				ucErrorCode = SRC_ID_SDCARD_READ_FAIL;
+				ucErrorCodePriority = RPT_PRTY_SDCARD_READ_FAIL;
 #if 0
-                vSERIAL_sout("SD read fail\r\n", 15);
+				vSERIAL_sout("SD read fail\r\n", 15);
+#endif
+			}
+			else if (uiCRC16_ComputeBlockCRC(ucBlock, SD_CARD_BLOCKLEN) != uiCRC)
+			{
+				verified = false;
+				vSERIAL_sout("SD Verify Fail\r\n", 16);
+			}
+		}
 #endif
-            }
-            else
-            {
-                for( i = 0; i < SD_CARD_BLOCKLEN; ++i )
-                {
-                    if( ucVerifyBlock[i] != ucBlock[i] )
-                    {
-                        verified = false;
-                        vSERIAL_sout("SD Verify Fail\r\n", 16);
-                        break;
-                    }
-                }
-
-                if( verified )
-                    break;
-            }
-        }
-
-		//Power down the SD card
-		vSD_PowerOff();
+
+		// Leave the card up for the rest of the slot if it all went well
+		if (ucErrorCode == 0 && verified)
+			break;
+
+		// Otherwise power cycle it before the next attempt
+		vSD_SessionClose();
 
 		// Allow time for the voltage to decay
 		vDELAY_LPMWait1us(5000, 1);
 
 	} // END: while(ucAttemptCount)
 
+	// A batch that never verified is a failed write
+	if (ucErrorCode == 0 && !verified)
+	{
+		ucErrorCode = SRC_ID_SDCARD_WRITE_FAIL;
+		ucErrorCodePriority = RPT_PRTY_SDCARD_WRITE_FAIL;
+	}
 
 	// If there was an error...
 	if (ucErrorCode != 0)
@@ -269,11 +395,14 @@ void vTask_FRAM_to_SDCard(void)
 	else
 	{
 
-		// Update the SD card address
-		vL2FRAM_IncrementSDCardBlockNum();
-
-		// Write the messages in the overflow area to the buffer
-		vL2FRAM_SDCardOvrflowToBuff();
+		// Move the SD card address and hand the pages back to the FRAM buffer,
+		// index blocks have no page behind them
+		for (ucBlk = 0; ucBlk < ucBlocks; ucBlk++)
+		{
+			vL2FRAM_IncrementSDCardBlockNum();
+			if (!SD_LOG_IS_INDEX(ulAddress + ucBlk, SD_CARD_START_BLOCK))
+				vL2FRAM_ReleaseSDCardPage();
+		}
 	}
 
 }
@@ -342,6 +471,7 @@ void vTask_Batt_Sense(void)
 
 		vReport_LogDataElement(RPT_PRTY_INPUT_VOLTAGE_LOW); // Store DE
 		vReport_BuildMsgsFromDEs(); // Build message
+		vL2SRAM_checkpointQ(); // Save the SRAM queue state
 		vTask_FRAM_to_SDCard(); // Emergency write to the SD card
 
 		// Set the byte that indicates that the shutdown was bad
@@ -1171,6 +1301,9 @@ void vTask_Dispatch(uchar ucNSTtblNum, //table num (0 or 1)
 	// Build messages from the DEs generated during the slot
 	vReport_BuildMsgsFromDEs();
 
+	// Checkpoint the SRAM queue pointers once per slot
+	vL2SRAM_checkpointQ();
+
 	/* SHOW THE ACTION HEADER LINE */
 	vRTS_showTaskHdrLine(YES_CRLF);
 
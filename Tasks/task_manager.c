@@ -908,6 +908,10 @@ uint uiTask_GetUniqueID(uint uiTempID)
 /////////////////////////////////////////////////////////////////////////
 uchar ucTask_CheckComp(uchar ucTaskID_1, uchar ucTaskID_2)
 {
+	// Empty sub-slots hold GENERIC_NST_NOT_USED_VAL, not a task index
+	if ((ucTaskID_1 >= MAXNUMTASKS) || (ucTaskID_2 >= MAXNUMTASKS))
+		return 0;
+
 	// Make sure processor is the same
 	if (p_saTaskList[ucTaskID_1].m_ucProcessorID != p_saTaskList[ucTaskID_2].m_ucProcessorID)
 		return 0;
@@ -1096,9 +1100,8 @@ uchar ucTask_GetField(uchar ucTskIndex, uchar ucField, ulong * ulRetPtr)
 	// Make sure task index is in range
 	if (ucTskIndex >= MAXNUMTASKS)
 		ucErrCode = 1;
-
-	// Make sure the TCB contains a valid task
-	if (p_saTaskList[ucTskIndex].m_uiTask_ID == INVALID_TASKID)
+	// Otherwise make sure the TCB contains a valid task
+	else if (p_saTaskList[ucTskIndex].m_uiTask_ID == INVALID_TASKID)
 		ucErrCode = 1;
 
 	// If there are no fundamental errors with the request then continue
@@ -1201,6 +1204,8 @@ uchar ucTask_SetField(uchar ucTskIndex, uint8 ucField, ulong ulValue)
 
 	uchar ucErrCode, ucTSBNum;
 	ulong ulTemp;
+	uchar ucaTSBIdx[2];
+	ulong ulaTSBVal[2];
 
 	// Assume success
 	ucErrCode = 0;
@@ -1209,9 +1214,8 @@ uchar ucTask_SetField(uchar ucTskIndex, uint8 ucField, ulong ulValue)
 	// Make sure task index is in range
 	if (ucTskIndex >= MAXNUMTASKS)
 		ucErrCode = 1;
-
-	// Make sure the TCB contains a valid task
-	if (p_saTaskList[ucTskIndex].m_uiTask_ID == INVALID_TASKID)
+	// Otherwise make sure the TCB contains a valid task
+	else if (p_saTaskList[ucTskIndex].m_uiTask_ID == INVALID_TASKID)
 		ucErrCode = 1;
 
 	// If there are no fundamental errors with the request then continue
@@ -1299,10 +1303,12 @@ uchar ucTask_SetField(uchar ucTskIndex, uint8 ucField, ulong ulValue)
 					// Update the FRAM TSB
 					ucTSBNum = ucL2FRAM_findTSB(p_saTaskList[ucTskIndex].m_uiTask_ID);
 					if (ucTSBNum != 255){
-						vL2FRAM_putTSBEntryVal(ucTSBNum, FRAM_ST_BLK_PARAM1, p_saTaskList[ucTskIndex].m_ulParameters[PARAM_IDX_INTERVAL]);
-
-						// Also update the load factor in FRAM
-						vL2FRAM_putTSBEntryVal(ucTSBNum, FRAM_ST_BLK_PARAM2, 3600/ulValue);
+						// The interval and the load factor go out in one journal record
+						ucaTSBIdx[0] = FRAM_ST_BLK_PARAM1;
+						ulaTSBVal[0] = p_saTaskList[ucTskIndex].m_ulParameters[PARAM_IDX_INTERVAL];
+						ucaTSBIdx[1] = FRAM_ST_BLK_PARAM2;
+						ulaTSBVal[1] = 3600/ulValue;
+						vL2FRAM_putTSBEntryVals(ucTSBNum, 2, ucaTSBIdx, ulaTSBVal);
 					}
 				}
 			break;
@@ -1386,9 +1392,8 @@ uchar ucTask_GetParam(uchar ucTskIndex, uchar ucIndex, ulong *ulRetPtr)
 	// Make sure task index is in range
 	if (ucTskIndex >= MAXNUMTASKS)
 		ucErrCode = 1;
-
-	// Make sure the TCB contains a valid task
-	if (p_saTaskList[ucTskIndex].m_uiTask_ID == INVALID_TASKID)
+	// Otherwise make sure the TCB contains a valid task
+	else if (p_saTaskList[ucTskIndex].m_uiTask_ID == INVALID_TASKID)
 		ucErrCode = 1;
 
 	if (ucErrCode == 0) {
@@ -1437,9 +1442,8 @@ uchar ucTask_SetCmdParam(uchar ucTskIndex, uchar * p_ucPtr)
 	// Make sure task index is in range
 	if (ucTskIndex >= MAXNUMTASKS)
 		ucErrCode = 1;
-
-	// Make sure the TCB contains a valid task
-	if (p_saTaskList[ucTskIndex].m_uiTask_ID == INVALID_TASKID)
+	// Otherwise make sure the TCB contains a valid task
+	else if (p_saTaskList[ucTskIndex].m_uiTask_ID == INVALID_TASKID)
 		ucErrCode = 1;
 
 	if (ucErrCode == 0) {
@@ -1470,9 +1474,8 @@ uchar ucTask_GetCmdParam(uchar ucTskIndex, uchar * p_ucPtr)
 	// Make sure task index is in range
 	if (ucTskIndex >= MAXNUMTASKS)
 		ucErrCode = 1;
-
-	// Make sure the TCB contains a valid task
-	if (p_saTaskList[ucTskIndex].m_uiTask_ID == INVALID_TASKID)
+	// Otherwise make sure the TCB contains a valid task
+	else if (p_saTaskList[ucTskIndex].m_uiTask_ID == INVALID_TASKID)
 		ucErrCode = 1;
 
 	// loop through the command parameters and load them into the passed pointer
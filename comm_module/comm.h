@@ -465,10 +465,61 @@ union SP_LabelMessage
 #define MAX_MSG_SIZE_MASK  (MAX_MSG_SIZE -1)
 #define MAX_MSG_SIZE_MASK_L ((long)MAX_MSG_SIZE_MASK)
 
+//! @defgroup Fragments Message Fragments
+//! A message longer than MAX_MSG_SIZE is sent as a run of fragments.  Each
+//! fragment is a normal message with MSG_FLG_SINGLE cleared, MSG_FLG_BEG on
+//! the first and MSG_FLG_END on the last.  Fragments carry consecutive
+//! message numbers starting at the number of the whole message and the first
+//! payload byte holds the fragment index and count, so the receiver can put
+//! them back together in any order.  The rest of the payload is the next
+//! FRAG_CHUNK_SZ bytes of the payload of the whole message.
+//! @{
+
+//! \def MAX_LOGICAL_MSG_SIZE
+//! \brief Largest message (NET_HDR + MSG_HDR + payload + CRC) sent as fragments
+#define MAX_LOGICAL_MSG_SIZE	255
+
+//! \def MSG_IDX_FRAG
+//! \brief Fragment index in the high nibble, fragment count in the low nibble
+#define MSG_IDX_FRAG			MSG_IDX_PAYLD
+
+//! \def FRAG_CHUNK_SZ
+//! \brief Payload bytes of the whole message carried by every fragment but the last
+#define FRAG_CHUNK_SZ			(MAX_MSG_SIZE - NET_HDR_SZ - MSG_HDR_SZ - 1 - CRC_SZ)
+
+//! \def FRAG_MAX_COUNT
+//! \brief Most fragments in a message
+#define FRAG_MAX_COUNT			((MAX_LOGICAL_MSG_SIZE - NET_HDR_SZ - MSG_HDR_SZ - CRC_SZ + FRAG_CHUNK_SZ - 1) / FRAG_CHUNK_SZ)
+
+//! \def FRAG_REASM_BUFFS
+//! \brief Messages that can be put back together at the same time
+#define FRAG_REASM_BUFFS		2
+
+#define FRAG_INFO(ucIdx, ucCount)	((uchar) (((ucIdx) << 4) | (ucCount)))
+#define FRAG_INFO_IDX(ucInfo)		((uchar) ((ucInfo) >> 4))
+#define FRAG_INFO_COUNT(ucInfo)		((uchar) ((ucInfo) & 0x0F))
+//! @}
+
 //! \def MAX_OM_MSGS
 //! \brief Maximum number of operational messages in a slot (actual value is higher, but we leave room for error)
 #define MAX_OM_MSGS			10
 
+//! \def COMM_WINDOW_MAX
+//! \brief Most data messages sent back to back before a block ACK (one bit each in a uchar)
+#define COMM_WINDOW_MAX		8
+
+//! \def COMM_WINDOW_TRIES
+//! \brief Transmissions of a data message before it is reported as undeliverable
+#define COMM_WINDOW_TRIES	6
+
+//! \def COMM_SEEN_COUNT
+//! \brief Data messages a parent remembers per child, repeats come from the last window
+#define COMM_SEEN_COUNT		COMM_WINDOW_MAX
+
+//! \def COMM_SEEN_CHILDREN
+//! \brief Children a parent remembers the last data messages of
+#define COMM_SEEN_CHILDREN	8
+
 /* CHECK_BYTE_BIT DEFINITIONS */
 #define CHKBIT_CRC			0x80	//10000000
 #define CHKBIT_MSG_TYPE		0x40	//01000000
@@ -682,6 +733,12 @@ union SP_LabelMessage
 //! \def OPMSG_IDX_TIME_SUBSEC
 //! \brief Transport layer operational message time in sub-seconds index (low byte)
 #define OPMSG_IDX_TIME_SUBSEC_LO 	16
+//! \def OPMSG_IDX_WINDOW
+//! \brief Block ACK window the parent offers in the RTR, absent from older parents
+#define OPMSG_IDX_WINDOW				17
+//! \def OPMSG_IDX_ROUTE
+//! \brief Routing flags the parent sends in the RTR (ROUTE_RTR_RESYNC)
+#define OPMSG_IDX_ROUTE					18
 //! @}
 
 
@@ -723,6 +780,15 @@ union SP_LabelMessage
 //! \brief Message is requesting an acknowledgment
 #define MSG_FLG_ACKRQST			0x08
 
+//! \def MSG_FLG_WINDOW
+//! \brief Set on the LRQ when the child takes the block ACK window offered in the RTR
+#define MSG_FLG_WINDOW			0x04
+
+//! \def MSG_FLG_ROUTE
+//! \brief Set on the LRQ when the routing updates use RouteUpdates.  LRQs are
+//! never stored so the bit is shared with the class bits of stored messages.
+#define MSG_FLG_ROUTE			0x01
+
 //! \def MSG_FLG_ACK
 //! \brief Message is an acknowledgment
 #define MSG_FLG_ACK					0x10
@@ -738,6 +804,25 @@ union SP_LabelMessage
 //! \def MSG_FLG_BEG
 //! \brief Message is the beginning of a sequence of messages
 #define MSG_FLG_BEG					0x80
+
+//! \def MSG_FLG_CLASS_MASK
+//! \brief Low flag bits hold the storage class of the message
+#define MSG_FLG_CLASS_MASK	0x03
+//! @}
+
+//! @defgroup Message Classes
+//! @{
+//! \def MSG_CLASS_DATA
+//! \brief Sensor data, also the class of messages that do not set one
+#define MSG_CLASS_DATA			0x00
+
+//! \def MSG_CLASS_CRISIS
+//! \brief Crisis reports, forwarded ahead of everything else
+#define MSG_CLASS_CRISIS		0x01
+
+//! \def MSG_CLASS_DIAG
+//! \brief Diagnostic and status reports, forwarded last
+#define MSG_CLASS_DIAG			0x02
 //! @}
 
 //! @defgroup Error Messages
@@ -796,6 +881,7 @@ void vComm_Child(void);
 void vComm_Parent(void);
 void vComm_Msg_buildOperational(uchar ucFlags, uint uiMsgNum, uint uiDest, uchar ucMsgID);
 
+uint uiComm_reserveMsgSeqNums(uchar ucCount);
 uint uiComm_incMsgSeqNum( //RET: Incremented Msg Seq Num (not 0 or 255)
     void);
 
@@ -854,6 +940,37 @@ uchar ucMSG_getLastFilledEntryInOM2( //RET: 0=none, ##=idx of last entry in OM2
 #define F_JOIN				0x02
 #define F_DROP				0x04
 
+//! @defgroup RouteUpdates Route Update Encoding
+//! The routing updates after the link request byte of the LRQ are
+//!
+//!		[len][epoch][seq][record]...
+//!
+//! len counts the bytes after itself.  epoch is picked at boot and seq goes
+//! up by one for each LRQ with updates the parent acknowledges.  An LRQ
+//! without updates carries the seq of the last one, so the parent can tell
+//! when it missed one and asks for a resync in the next RTR.  Node addresses are
+//! varints (7 bits per byte, low bits first) and all but the first address
+//! of a record are zig-zag coded differences from the address before.
+//!
+//!		JOIN	[0x00 | n][parent][child 1]...[child n]	edges parent->child
+//!		DROP	[0x40 | n][root 1]...[root n]				subtrees to unjoin
+//!		RESYNC	[0x80]	the records that follow are the whole subtree of the sender
+//!
+//! A child only uses this encoding when the RTR of its parent carries the
+//! OPMSG_IDX_ROUTE byte and says so with MSG_FLG_ROUTE on the LRQ.  Older
+//! parents get the join/drop encoding of ucRoute_GetLegacyUpdates().
+//! @{
+#define ROUTE_REC_JOIN			0x00
+#define ROUTE_REC_DROP			0x40
+#define ROUTE_REC_RESYNC		0x80
+#define ROUTE_REC_TYPE_MASK		0xC0
+#define ROUTE_REC_COUNT_MASK	0x3F
+
+//! \def ROUTE_RTR_RESYNC
+//! \brief Set in the RTR when the parent wants the whole subtree of the child
+#define ROUTE_RTR_RESYNC		0x01
+//! @}
+
 typedef struct
 {
 	uint m_uiSrc;
@@ -864,12 +981,20 @@ uchar ucRoute_Init(uint address);
 uint uiRoute_GetNextHop(uint dest);
 uchar ucRoute_NodeUnjoin(uint child);
 uchar ucRoute_NodeJoin(uint parent, uint child, S_Edge* edges, int iNumEdges);
-uchar ucRoute_GetUpdateCountBytes(uchar ucAddOrDrop);
-void vRoute_GetUpdates(volatile uchar *ucaBuff, uchar ucSpaceAvail);
-void vRoute_SetUpdates(volatile uchar *ucaBuff);
+uchar ucRoute_GetUpdates(volatile uchar *ucaBuff, uchar ucSpaceAvail);
+uchar ucRoute_GetLegacyUpdates(volatile uchar *ucaBuff, uchar ucSpaceAvail);
+uchar ucRoute_UpdatesLeft(void);
+void vRoute_SetUpdates(uint uiChild, volatile uchar *ucaBuff, uchar ucBuffLen);
+void vRoute_SetLegacyUpdates(uint uiChild, volatile uchar *ucaBuff, uchar ucBuffLen);
 void vRouteClrFlaggedUpdates(void);
+uchar ucRoute_NeedResync(uint uiChild);
+void vRoute_RequestResync(void);
 void vRoute_DisplayEdges(void);
 
+void vComm_Frag_StoreMsg(volatile uchar *p_ucaMsg);
+void vComm_Frag_LogReport(void);
+volatile uchar *p_ucComm_Frag_CollectMsg(uchar *p_ucCount);
+
 // remove
 void vComm_zroMissedMsgCnt(void);
 //! @}
@@ -338,8 +338,9 @@ static signed char cComm_WaitFor_RequesttoJoin(void)
 
 				uslRandNum = ulMISC_buildUlongFromBytes((uchar *) &ucaMSG_BUFF[MSG_IDX_RANDSEED_XI], NO_NOINT);
 
-				/* STASH THE LINKUP SN */
-				uiaLinkSN[ucLinkSNidx++] = uiOtherGuysSN;
+				/* STASH THE LINKUP SN (THE JOIN REPORT HAS ROOM FOR MAX_LINKS_PER_SLOT) */
+				if (ucLinkSNidx < MAX_LINKS_PER_SLOT)
+					uiaLinkSN[ucLinkSNidx++] = uiOtherGuysSN;
 
 				ucTotalEdges = ucaMSG_BUFF[MSG_IDX_NUM_EDGES];
 
@@ -493,6 +494,9 @@ void vComm_SendBeacon(void)
   if(ucResponseCount == 0)
   	return;
 
+  // Each reply count is the running total of stashed SNs, so report those
+  ucResponseCount = ucLinkSNidx;
+
   // The payload has two bytes for each serial number and one for the source ID
 	ucPayloadLength = ucResponseCount * 2 + 2;
 
@@ -0,0 +1,348 @@
+/////////////////////////////////////////////////////////////////////////////
+//! \file comm_frag.c
+//! \brief This file is part of the communications module and splits messages
+//!		longer than one radio packet into fragments and puts them back together.
+//! \addtogroup Communications
+//! @{
+//!
+//! The layout of a fragment is described with the fragment defines in comm.h.
+//! Messages are split when they are built so the SRAM queue, the windowed
+//! sender and the relays only ever see radio sized messages.  The hub puts
+//! the fragments back together before the message is logged to the SD card
+//! and before it is uploaded to the garden server.
+//!
+/////////////////////////////////////////////////////////////////////////////
+
+#include <msp430x54x.h>		//processor reg description */
+
+#include "comm.h"    			//event MSG module
+#include "crc.h"					//CRC calculation module
+#include "serial.h"				//serial IO port stuff
+#include "l2sram.h"  			//disk storage module
+#include "report.h"				//Logging module
+
+extern volatile uint8 ucaMSG_BUFF[MAX_RESERVED_MSG_SIZE];
+
+//! \struct S_FragBuf
+//! \brief A message being put back together from its fragments
+typedef struct
+{
+	uint m_uiSrcSN;				//!< Originating node of the message
+	uint m_uiFirstNum;		//!< Message number of the first fragment
+	uchar m_ucCount;			//!< Fragments in the message, 0 if the buffer is free
+	uchar m_ucHave;				//!< One bit per fragment received
+	uchar m_ucLastChunk;	//!< Payload bytes in the last fragment
+	uchar m_ucAge;				//!< Fragments received since this buffer was last used
+	uchar m_ucaMsg[MAX_LOGICAL_MSG_SIZE];
+} S_FragBuf;
+
+//! \var S_FragBuffs
+//! \brief Reassembly buffers, only used on the hub
+static S_FragBuf S_FragBuffs[FRAG_REASM_BUFFS];
+
+//! \var S_UploadBuf
+//! \brief Holds the message the hub is uploading to the garden server
+static S_FragBuf S_UploadBuf;
+
+/////////////////////////////////////////////////////////////////////////////
+//! \brief Stores a message to SRAM, split into fragments if it is too long
+//!
+//! The header of the message must be built except for the message number
+//! which is given here and written back to the message.  The CRC of the
+//! message is not needed, every fragment gets its own.  The message buffer
+//! holds the last fragment when this returns.
+//!
+//! \param p_ucaMsg, the message (LEN up to MAX_LOGICAL_MSG_SIZE - NET_HDR_SZ - CRC_SZ)
+//! \return none
+/////////////////////////////////////////////////////////////////////////////
+void vComm_Frag_StoreMsg(volatile uchar *p_ucaMsg)
+{
+	uint uiFirstNum;
+	uchar ucPayldLen;
+	uchar ucCount;
+	uchar ucIdx;
+	uchar ucChunk;
+	uchar ucii;
+	uchar ucFlags;
+	volatile uchar *p_ucChunk;
+
+	// A message that fits in one packet goes as it is
+	if ((p_ucaMsg[MSG_IDX_LEN] + NET_HDR_SZ + CRC_SZ) <= MAX_MSG_SIZE) {
+		for (ucii = 0; ucii < (p_ucaMsg[MSG_IDX_LEN] + NET_HDR_SZ); ucii++)
+			ucaMSG_BUFF[ucii] = p_ucaMsg[ucii];
+
+		ucaMSG_BUFF[MSG_IDX_FLG] |= MSG_FLG_SINGLE;
+		uiFirstNum = uiComm_incMsgSeqNum();
+		p_ucaMsg[MSG_IDX_NUM_HI] = (uchar) (uiFirstNum >> 8);
+		p_ucaMsg[MSG_IDX_NUM_LO] = (uchar) uiFirstNum;
+		ucaMSG_BUFF[MSG_IDX_NUM_HI] = (uchar) (uiFirstNum >> 8);
+		ucaMSG_BUFF[MSG_IDX_NUM_LO] = (uchar) uiFirstNum;
+
+		ucCRC16_compute_msg_CRC(CRC_FOR_MSG_TO_SEND, ucaMSG_BUFF, ucaMSG_BUFF[MSG_IDX_LEN] + NET_HDR_SZ + CRC_SZ); //lint !e534
+		vL2SRAM_storeMsgToSramIfAllowed();
+		return;
+	}
+
+	ucPayldLen = p_ucaMsg[MSG_IDX_LEN] - MSG_HDR_SZ;
+	ucCount = (ucPayldLen + FRAG_CHUNK_SZ - 1) / FRAG_CHUNK_SZ;
+	if (ucCount > FRAG_MAX_COUNT)
+		return;
+
+	uiFirstNum = uiComm_reserveMsgSeqNums(ucCount);
+	p_ucaMsg[MSG_IDX_NUM_HI] = (uchar) (uiFirstNum >> 8);
+	p_ucaMsg[MSG_IDX_NUM_LO] = (uchar) uiFirstNum;
+	ucFlags = p_ucaMsg[MSG_IDX_FLG] & ~(MSG_FLG_SINGLE | MSG_FLG_BEG | MSG_FLG_END | MSG_FLG_ACKRQST);
+	p_ucChunk = &p_ucaMsg[MSG_IDX_PAYLD];
+
+	for (ucIdx = 0; ucIdx < ucCount; ucIdx++) {
+		// Every fragment carries a copy of the headers
+		for (ucii = 0; ucii < MSG_IDX_PAYLD; ucii++)
+			ucaMSG_BUFF[ucii] = p_ucaMsg[ucii];
+
+		ucaMSG_BUFF[MSG_IDX_FLG] = ucFlags;
+		if (ucIdx == 0)
+			ucaMSG_BUFF[MSG_IDX_FLG] |= MSG_FLG_BEG;
+		if (ucIdx == (ucCount - 1))
+			ucaMSG_BUFF[MSG_IDX_FLG] |= MSG_FLG_END;
+
+		ucaMSG_BUFF[MSG_IDX_NUM_HI] = (uchar) ((uiFirstNum + ucIdx) >> 8);
+		ucaMSG_BUFF[MSG_IDX_NUM_LO] = (uchar) (uiFirstNum + ucIdx);
+		ucaMSG_BUFF[MSG_IDX_FRAG] = FRAG_INFO(ucIdx, ucCount);
+
+		ucChunk = FRAG_CHUNK_SZ;
+		if (ucPayldLen < ucChunk)
+			ucChunk = ucPayldLen;
+
+		for (ucii = 0; ucii < ucChunk; ucii++)
+			ucaMSG_BUFF[MSG_IDX_FRAG + 1 + ucii] = *p_ucChunk++;
+		ucPayldLen -= ucChunk;
+
+		ucaMSG_BUFF[MSG_IDX_LEN] = MSG_HDR_SZ + 1 + ucChunk;
+
+		ucCRC16_compute_msg_CRC(CRC_FOR_MSG_TO_SEND, ucaMSG_BUFF, ucaMSG_BUFF[MSG_IDX_LEN] + NET_HDR_SZ + CRC_SZ); //lint !e534
+		vL2SRAM_storeMsgToSramIfAllowed();
+	}
+
+#if 0
+	vSERIAL_sout("Frags: ", 7);
+	vSERIAL_UI8out(ucCount);
+	vSERIAL_crlf();
+#endif
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//! \brief Finds the reassembly buffer for a fragment
+//!
+//! A fragment of a new message takes a free buffer or, if there is none,
+//! the one that has waited longest.  The message that was in it is lost.
+//!
+//! \param uiSrcSN, uiFirstNum, ucCount
+//! \return the buffer
+/////////////////////////////////////////////////////////////////////////////
+static S_FragBuf *S_Comm_Frag_FindBuf(uint uiSrcSN, uint uiFirstNum, uchar ucCount)
+{
+	uchar ucii;
+	uchar ucOldest;
+	S_FragBuf *S_Buf;
+
+	ucOldest = 0;
+	for (ucii = 0; ucii < FRAG_REASM_BUFFS; ucii++) {
+		S_Buf = &S_FragBuffs[ucii];
+		if ((S_Buf->m_ucCount == ucCount) && (S_Buf->m_uiSrcSN == uiSrcSN) && (S_Buf->m_uiFirstNum == uiFirstNum))
+			return S_Buf;
+
+		// Free buffers are the oldest of all
+		if ((S_Buf->m_ucCount == 0) || ((S_FragBuffs[ucOldest].m_ucCount != 0) && (S_Buf->m_ucAge > S_FragBuffs[ucOldest].m_ucAge)))
+			ucOldest = ucii;
+	}
+
+	S_Buf = &S_FragBuffs[ucOldest];
+	if (S_Buf->m_ucCount != 0)
+		vSERIAL_sout("Frag: Dropped\r\n", 15);
+
+	S_Buf->m_uiSrcSN = uiSrcSN;
+	S_Buf->m_uiFirstNum = uiFirstNum;
+	S_Buf->m_ucCount = ucCount;
+	S_Buf->m_ucHave = 0;
+	S_Buf->m_ucLastChunk = 0;
+
+	return S_Buf;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//! \brief Range checks the fragment in the message buffer
+//!
+//! \param p_uiSrcSN, p_uiFirstNum, p_ucIdx, p_ucCount; set from the fragment
+//! \return 1 if the fragment is good, 0 otherwise
+/////////////////////////////////////////////////////////////////////////////
+static uchar ucComm_Frag_Check(uint *p_uiSrcSN, uint *p_uiFirstNum, uchar *p_ucIdx, uchar *p_ucCount)
+{
+	uchar ucInfo;
+	uchar ucIdx;
+	uchar ucCount;
+	uchar ucChunk;
+	uchar ucOffset;
+
+	if (ucaMSG_BUFF[MSG_IDX_LEN] < (MSG_HDR_SZ + 1))
+		return 0;
+	ucInfo = ucaMSG_BUFF[MSG_IDX_FRAG];
+	ucIdx = FRAG_INFO_IDX(ucInfo);
+	ucCount = FRAG_INFO_COUNT(ucInfo);
+	ucChunk = ucaMSG_BUFF[MSG_IDX_LEN] - MSG_HDR_SZ - 1;
+	if ((ucCount < 2) || (ucCount > FRAG_MAX_COUNT) || (ucIdx >= ucCount) || (ucChunk > FRAG_CHUNK_SZ))
+		return 0;
+	if ((ucIdx != (ucCount - 1)) && (ucChunk != FRAG_CHUNK_SZ))
+		return 0;
+	ucOffset = MSG_IDX_PAYLD + (ucIdx * FRAG_CHUNK_SZ);
+	if ((ucOffset + ucChunk) > (MAX_LOGICAL_MSG_SIZE - CRC_SZ))
+		return 0;
+
+	*p_uiSrcSN = ((ucaMSG_BUFF[MSG_IDX_ADDR_HI] << 8) | ucaMSG_BUFF[MSG_IDX_ADDR_LO]);
+	*p_uiFirstNum = ((ucaMSG_BUFF[MSG_IDX_NUM_HI] << 8) | ucaMSG_BUFF[MSG_IDX_NUM_LO]) - ucIdx;
+	*p_ucIdx = ucIdx;
+	*p_ucCount = ucCount;
+
+	return 1;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//! \brief Copies the checked fragment in the message buffer to its buffer
+//!
+//! When the last missing fragment is in the headers are put back the way
+//! they were before the message was split.  The ACK request of the first
+//! fragment belonged to its hop and is dropped with the fragment flags.
+//!
+//! \param S_Buf, reassembly buffer of the message
+//! \param ucIdx, index of the fragment
+//! \return 1 if the message is complete, 0 otherwise
+/////////////////////////////////////////////////////////////////////////////
+static uchar ucComm_Frag_AddToBuf(S_FragBuf *S_Buf, uchar ucIdx)
+{
+	uchar ucChunk;
+	uchar ucOffset;
+	uchar ucii;
+
+	ucChunk = ucaMSG_BUFF[MSG_IDX_LEN] - MSG_HDR_SZ - 1;
+	ucOffset = MSG_IDX_PAYLD + (ucIdx * FRAG_CHUNK_SZ);
+
+	// The first fragment has the headers of the whole message
+	if (ucIdx == 0) {
+		for (ucii = 0; ucii < MSG_IDX_PAYLD; ucii++)
+			S_Buf->m_ucaMsg[ucii] = ucaMSG_BUFF[ucii];
+	}
+	if (ucIdx == (S_Buf->m_ucCount - 1))
+		S_Buf->m_ucLastChunk = ucChunk;
+
+	for (ucii = 0; ucii < ucChunk; ucii++)
+		S_Buf->m_ucaMsg[ucOffset + ucii] = ucaMSG_BUFF[MSG_IDX_FRAG + 1 + ucii];
+
+	S_Buf->m_ucHave |= (1 << ucIdx);
+	if (S_Buf->m_ucHave != (uchar) ((1 << S_Buf->m_ucCount) - 1))
+		return 0;
+
+	// Put the headers back the way they were before the message was split
+	S_Buf->m_ucaMsg[MSG_IDX_FLG] &= ~(MSG_FLG_BEG | MSG_FLG_END | MSG_FLG_ACKRQST);
+	S_Buf->m_ucaMsg[MSG_IDX_FLG] |= MSG_FLG_SINGLE;
+	S_Buf->m_ucaMsg[MSG_IDX_NUM_HI] = (uchar) (S_Buf->m_uiFirstNum >> 8);
+	S_Buf->m_ucaMsg[MSG_IDX_NUM_LO] = (uchar) S_Buf->m_uiFirstNum;
+	S_Buf->m_ucaMsg[MSG_IDX_LEN] = MSG_HDR_SZ + ((S_Buf->m_ucCount - 1) * FRAG_CHUNK_SZ) + S_Buf->m_ucLastChunk;
+
+	return 1;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//! \brief Logs the message in the message buffer to the SD card
+//!
+//! Used by the hub for every message that comes up through the network.
+//! Messages that are not fragments are logged as they are.  A fragment is
+//! copied to its reassembly buffer and the whole message is logged once the
+//! last missing fragment arrives.  Repeated fragments are harmless.
+//!
+//! \param none
+//! \return none
+/////////////////////////////////////////////////////////////////////////////
+void vComm_Frag_LogReport(void)
+{
+	uint uiSrcSN;
+	uint uiFirstNum;
+	uchar ucIdx;
+	uchar ucCount;
+	uchar ucii;
+	S_FragBuf *S_Buf;
+
+	if (ucaMSG_BUFF[MSG_IDX_FLG] & MSG_FLG_SINGLE) {
+		vREPORT_LogReport();
+		return;
+	}
+
+	if (!ucComm_Frag_Check(&uiSrcSN, &uiFirstNum, &ucIdx, &ucCount))
+		return;
+
+	for (ucii = 0; ucii < FRAG_REASM_BUFFS; ucii++) {
+		if (S_FragBuffs[ucii].m_ucAge < 0xFF)
+			S_FragBuffs[ucii].m_ucAge++;
+	}
+
+	S_Buf = S_Comm_Frag_FindBuf(uiSrcSN, uiFirstNum, ucCount);
+	S_Buf->m_ucAge = 0;
+
+	if (!ucComm_Frag_AddToBuf(S_Buf, ucIdx))
+		return;
+
+	vREPORT_LogMsg(S_Buf->m_ucaMsg);
+
+	// Free the buffer
+	S_Buf->m_ucCount = 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//! \brief Puts the fragmented message at the head of the SRAM queue together
+//!
+//! The garden server only takes whole messages so the hub uploads fragments
+//! this way.  The fragments must be queued back to back starting at the
+//! current message, in any order.  Nothing is deleted, the caller deletes
+//! the fragments once the message is delivered.  Call after
+//! ucL2SRAM_getCopyOfCurMsg(), the message buffer is overwritten.
+//!
+//! \param p_ucCount, set to the number of fragments of the message
+//! \return the whole message, 0 if its fragments are not all there
+/////////////////////////////////////////////////////////////////////////////
+volatile uchar *p_ucComm_Frag_CollectMsg(uchar *p_ucCount)
+{
+	uint uiSrcSN;
+	uint uiFirstNum;
+	uint uiFragSN;
+	uint uiFragFirstNum;
+	uchar ucIdx;
+	uchar ucCount;
+	uchar ucFragCount;
+	uchar ucOffset;
+
+	*p_ucCount = 0;
+	if (!ucL2SRAM_getCopyOfCurMsgAt(0) || !ucComm_Frag_Check(&uiSrcSN, &uiFirstNum, &ucIdx, &ucCount))
+		return 0;
+
+	S_UploadBuf.m_uiSrcSN = uiSrcSN;
+	S_UploadBuf.m_uiFirstNum = uiFirstNum;
+	S_UploadBuf.m_ucCount = ucCount;
+	S_UploadBuf.m_ucHave = 0;
+	S_UploadBuf.m_ucLastChunk = 0;
+
+	for (ucOffset = 0; ucOffset < ucCount; ucOffset++) {
+		if (!ucL2SRAM_getCopyOfCurMsgAt(ucOffset) || (ucaMSG_BUFF[MSG_IDX_FLG] & MSG_FLG_SINGLE))
+			return 0;
+		if (!ucComm_Frag_Check(&uiFragSN, &uiFragFirstNum, &ucIdx, &ucFragCount))
+			return 0;
+		if ((uiFragSN != uiSrcSN) || (uiFragFirstNum != uiFirstNum) || (ucFragCount != ucCount))
+			return 0;
+
+		if (ucComm_Frag_AddToBuf(&S_UploadBuf, ucIdx)) {
+			*p_ucCount = ucCount;
+			return S_UploadBuf.m_ucaMsg;
+		}
+	}
+
+	return 0;
+}
+
+//! @}
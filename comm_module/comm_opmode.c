@@ -71,9 +71,55 @@ extern volatile union //ucFLAG0_BYTE
 
 ulong g_ulLastCommTime = 0;
 
+//! \var ucComm_Window
+//! \brief Data messages per block ACK on the current link, 1 is one ACK per message
+static uchar ucComm_Window = 1;
+
+//! \var ucComm_RouteRecs
+//! \brief Set when the parent takes routing updates coded as RouteUpdates (comm.h)
+static uchar ucComm_RouteRecs;
+
+//! \var uiaComm_HeldNum
+//! \brief Numbers of queued messages the parent already holds
+//!
+//! A window is deleted only up to its first gap, the acked messages behind
+//! the gap stay queued.  They are listed here so the next window counts them
+//! as acked without sending them again.
+static uint uiaComm_HeldNum[COMM_WINDOW_MAX];
+
+//! \var uiaComm_HeldSrc
+//! \brief Originating nodes of the messages in uiaComm_HeldNum
+static uint uiaComm_HeldSrc[COMM_WINDOW_MAX];
+
+//! \var ucComm_HeldCount
+//! \brief Messages listed in uiaComm_HeldNum, the oldest first
+static uchar ucComm_HeldCount;
+
+//! \struct S_CommSeen
+//! \brief The data messages last stored from one child
+//!
+//! A window whose block ACK is lost at the end of a slot comes again in the
+//! child's next slot.  The ring is kept across slots so those messages are
+//! acked again but not stored twice.
+typedef struct
+{
+	uint m_uiChildSN;							//!< Child the messages came from
+	uint m_uiaNum[COMM_SEEN_COUNT];	//!< Message numbers
+	uint m_uiaSrc[COMM_SEEN_COUNT];	//!< Originating nodes of the messages
+	uchar m_ucCount;							//!< Messages in the ring, 0 if the entry is free
+	uchar m_ucNext;								//!< Ring position of the next message
+	uchar m_ucAge;								//!< Slots with other children since this one was last used
+} S_CommSeen;
+
+//! \var S_CommSeenChildren
+//! \brief Messages last stored from each child, only used with block ACKs
+static S_CommSeen S_CommSeenChildren[COMM_SEEN_CHILDREN];
+
 // Internal function definitions for this module
 uchar ucComm_WaitForAck(uint uiMsgNumber);
 void vComm_SendAck(uint uiMsgNumber);
+static uchar ucComm_WaitForBlockAck(const uint *uipWinNum, uchar ucWinCount, uchar *ucpAcked);
+static void vComm_SendAckList(uint uiMsgNumber, const uint *uipNums, uchar ucNumCount);
 
 //TODO remove
 long ulRand = 0;
@@ -82,14 +128,17 @@ long ulRand = 0;
 //!
 //!	\brief Handles RF channel selection
 //!
+//! Data links hop over the channel table, the link block picks the channel
+//! from the link seed and the slot (ucLNKBLK_ComputeChannel()).
+//!
 //! \param none
 //! \return none
 /////////////////////////////////////////////////////////////////////////////
 static void vComm_SetChannel(uchar ucChannel)
 {
 	// Do not use channels 48 through 51.  The frequencies are close to integer multiples of the PFD (see adf7020 datasheet)
-	const uchar ucChannelTable[10] = { 8, 16, 24, 32, 40, 46, 56, 64, 72, 80 };
-	ulong ulRand, ulTime, ulSerialNumber;
+	const uchar ucChannelTable[LNK_DATA_CHANNELS] = { 8, 16, 24, 32, 40, 46, 56, 64, 72, 80, 88, 96, 104, 112, 120, 126 };
+	ulong ulTime, ulSerialNumber;
 	uchar ucChannelIndex;
 
 	if ((CURRENT_CHANNELS == RANDOM_CHANNEL) && (ucChannel == DATA_CHANNEL)) {
@@ -97,19 +146,14 @@ static void vComm_SetChannel(uchar ucChannel)
 		// Get the serial number
 		ucTask_GetField(g_ucaCurrentTskIndex, PARAM_SN, &ulSerialNumber);
 
-		// Get the random number
-		ucLNKBLK_ReadRand((uint) ulSerialNumber, &ulRand);
-
+		// Both ends of the link land on the same channel, fall back to the first without a link seed
 		ulTime = lTIME_getSysTimeAsLong();
-		ucChannelIndex = ((uchar) (ulTime ^ ulRand)) % 10;
+		if (ucLNKBLK_ComputeChannel((uint) ulSerialNumber, (long) ulTime, &ucChannelIndex) != LNKMNGR_OK)
+			ucChannelIndex = 0;
 		unADF7020_SetChannel(ucChannelTable[ucChannelIndex]);
 
 #if 0
 
-		vSERIAL_sout("RAND = ", 7);
-		vSERIAL_UI32out(ulRand);
-		vSERIAL_crlf();
-
 		vSERIAL_sout("TIME = ", 7);
 		vSERIAL_UI32out(ulTime);
 		vSERIAL_crlf();
@@ -223,15 +267,19 @@ uchar ucComm_incLnkBrkCntAndChkForDeadOM2(void)
 
 //////////////////////////////////////////////////////////////////////////////
 //!
-//! \brief returns a link byte value based on the system load
+//! \brief returns a link byte value based on the message backlog
 //!
 //! \return ucOM2LinkVal
 //////////////////////////////////////////////////////////////////////////////
 uchar ucComm_getOM2LinkByteVal(void)
 {
 	uchar ucOM2LinkVal;
+	ulong ulOtherGuysSN;
 
-	ucOM2LinkVal = ucLNKBLK_computeMultipleLnkReqFromSysLoad(iGLOB_completeSysLFactor);
+	// GET THE OTHER LINK'S SERIAL NUM
+	ucTask_GetField(g_ucaCurrentTskIndex, PARAM_SN, &ulOtherGuysSN);
+
+	ucOM2LinkVal = ucLNKBLK_computeLnkReqFromBacklog((uint) ulOtherGuysSN, uiL2SRAM_getMsgCount());
 
 	return ucOM2LinkVal;
 //	return LNKREQ_1FRAME_1LNK;
@@ -314,9 +362,185 @@ uchar ucComm_Send_Command(void)
 }
 
 /////////////////////////////////////////////////////////////////////////////
-//! \brief This function sends as much data from the memory as possible
+//! \brief Sends data in windows of messages with one block ACK per window
 //!
+//! Up to ucComm_Window messages of one class go out back to back and the last
+//! one asks for the ACK.  The parent answers with the numbers of the messages
+//! it holds and only the missing ones are sent again.  The window is deleted
+//! from SRAM once every message in it is acked or out of tries.  If the slot
+//! ends first the window is deleted up to its first gap and the acked
+//! messages behind the gap are remembered, they are not sent again.
 //!
+//! \param uiOtherGuysSN, serial number of the parent
+//! \return number of messages acked by the parent
+/////////////////////////////////////////////////////////////////////////////
+static uchar ucComm_SendDataWindow(uint uiOtherGuysSN)
+{
+	uint uiaWinNum[COMM_WINDOW_MAX];
+	uint uiaWinSrc[COMM_WINDOW_MAX];
+	uint uiMsgNumber;
+	uint uiSrcSN;
+	uchar ucWinCount;
+	uchar ucWinFull;
+	uchar ucWinHeld;
+	uchar ucWinAcked;
+	uchar ucjj;
+	uchar ucTries;
+	uchar ucPos;
+	uchar ucLast;
+	uchar ucii;
+	uchar ucMsgIndex;
+	uchar ucTXMsgCount;
+
+	ucTXMsgCount = 0;
+
+	// Loop while the sub-slot alarms aren't set
+	while (ucTimeCheckForAlarms(SUBSLOT_ALARMS) == 0) {
+		// Pick the class the window is taken from
+		if (!ucL2SRAM_getCopyOfCurMsg())
+			break;
+
+		// Fill the window, the block ACK names messages by number so a number may appear only once
+		ucWinHeld = 0;
+		for (ucWinCount = 0; ucWinCount < ucComm_Window; ucWinCount++) {
+			if (!ucL2SRAM_getCopyOfCurMsgAt(ucWinCount))
+				break;
+
+			uiMsgNumber = ((ucaMSG_BUFF[MSG_IDX_NUM_HI] << 8) | ucaMSG_BUFF[MSG_IDX_NUM_LO]);
+			for (ucii = 0; ucii < ucWinCount; ucii++) {
+				if (uiaWinNum[ucii] == uiMsgNumber)
+					break;
+			}
+			if (ucii < ucWinCount)
+				break;
+
+			uiaWinNum[ucWinCount] = uiMsgNumber;
+			uiSrcSN = ((ucaMSG_BUFF[MSG_IDX_ADDR_HI] << 8) | ucaMSG_BUFF[MSG_IDX_ADDR_LO]);
+			uiaWinSrc[ucWinCount] = uiSrcSN;
+
+			// Acked in an earlier slot, take it off the list
+			for (ucii = 0; ucii < ucComm_HeldCount; ucii++) {
+				if ((uiaComm_HeldNum[ucii] == uiMsgNumber) && (uiaComm_HeldSrc[ucii] == uiSrcSN))
+					break;
+			}
+			if (ucii < ucComm_HeldCount) {
+				ucWinHeld |= (uchar) (1 << ucWinCount);
+				for (ucComm_HeldCount--; ucii < ucComm_HeldCount; ucii++) {
+					uiaComm_HeldNum[ucii] = uiaComm_HeldNum[ucii + 1];
+					uiaComm_HeldSrc[ucii] = uiaComm_HeldSrc[ucii + 1];
+				}
+			}
+		}
+
+		if (ucWinCount == 0)
+			break;
+
+		ucWinFull = (uchar) ((1 << ucWinCount) - 1);
+		ucWinAcked = ucWinHeld;
+
+		for (ucTries = 0; (ucTries < COMM_WINDOW_TRIES) && (ucWinAcked != ucWinFull); ucTries++) {
+			if (ucTimeCheckForAlarms(SUBSLOT_ALARMS))
+				break;
+
+			// The last message still missing asks for the ACK
+			for (ucLast = ucWinCount - 1; ucWinAcked & (1 << ucLast); ucLast--)
+				;
+
+			for (ucPos = 0; ucPos <= ucLast; ucPos++) {
+				if (ucWinAcked & (1 << ucPos))
+					continue;
+
+				ucL2SRAM_getCopyOfCurMsgAt(ucPos); //lint !e534
+				vComm_NetPkg_buildHdr(uiOtherGuysSN);
+
+				ucaMSG_BUFF[MSG_IDX_FLG] &= ~MSG_FLG_ACKRQST;
+				if (ucPos == ucLast)
+					ucaMSG_BUFF[MSG_IDX_FLG] |= MSG_FLG_ACKRQST;
+
+				// If this is the last message then (END on a fragment marks its last fragment)
+				if (ucaMSG_BUFF[MSG_IDX_FLG] & MSG_FLG_SINGLE) {
+					ucaMSG_BUFF[MSG_IDX_FLG] &= ~MSG_FLG_END;
+					if ((ucPos == ucLast) && (uiL2SRAM_getMsgCount() == ucWinCount))
+						ucaMSG_BUFF[MSG_IDX_FLG] |= MSG_FLG_END;
+				}
+
+				// COMPUTE THE CRC
+				ucCRC16_compute_msg_CRC(CRC_FOR_MSG_TO_SEND, ucaMSG_BUFF, ucaMSG_BUFF[MSG_IDX_LEN] + NET_HDR_SZ + CRC_SZ); //lint !e534 //compute the CRC
+
+				// Load message into TX buffer and set the radio mode to TX.
+				vADF7020_SetPacketLength(ucaMSG_BUFF[MSG_IDX_LEN] + NET_HDR_SZ + CRC_SZ);
+				unADF7020_LoadTXBuffer((uint8*) &ucaMSG_BUFF);
+				vADF7020_TXRXSwitch(RADIO_TX_MODE);
+
+				// Send the Message
+				vADF7020_SendMsg();
+			}
+
+			// Set the radio into RX mode and collect the block ACK
+			vADF7020_TXRXSwitch(RADIO_RX_MODE);
+			ucComm_WaitForBlockAck(uiaWinNum, ucWinCount, &ucWinAcked); //lint !e534
+		}
+
+		for (ucPos = 0; ucPos < ucWinCount; ucPos++) {
+			if ((ucWinAcked & ~ucWinHeld) & (1 << ucPos))
+				ucTXMsgCount++;
+		}
+
+		// Out of tries, report the messages still missing and drop them with the window
+		if (ucTries == COMM_WINDOW_TRIES) {
+			for (ucPos = 0; ucPos < ucWinCount; ucPos++) {
+				if (ucWinAcked & (1 << ucPos))
+					continue;
+
+				// Build the report data element header
+				vComm_DE_BuildReportHdr(CP_ID, 2, ucMAIN_GetVersion());
+				ucMsgIndex = DE_IDX_RPT_PAYLOAD;
+
+				ucaMSG_BUFF[ucMsgIndex++] = SRC_ID_MSG_DELIVERY_FAIL;
+				ucaMSG_BUFF[ucMsgIndex] = 0; // data length
+
+				// Store DE
+				vReport_LogDataElement(RPT_PRTY_MSG_DELIVERY_FAIL);
+			}
+			ucWinAcked = ucWinFull;
+		}
+
+		// Delete the messages the parent holds, up to the first gap
+		for (ucPos = 0; (ucPos < ucWinCount) && (ucWinAcked & (1 << ucPos)); ucPos++)
+			;
+		if (ucPos != 0)
+			vL2SRAM_delCurMsgs(ucPos);
+
+		// List the acked ones behind the gap, the oldest entries make room
+		for (ucii = ucPos; ucii < ucWinCount; ucii++) {
+			if (!(ucWinAcked & (1 << ucii)))
+				continue;
+
+			if (ucComm_HeldCount == COMM_WINDOW_MAX) {
+				for (ucjj = 1; ucjj < COMM_WINDOW_MAX; ucjj++) {
+					uiaComm_HeldNum[ucjj - 1] = uiaComm_HeldNum[ucjj];
+					uiaComm_HeldSrc[ucjj - 1] = uiaComm_HeldSrc[ucjj];
+				}
+				ucComm_HeldCount--;
+			}
+			uiaComm_HeldNum[ucComm_HeldCount] = uiaWinNum[ucii];
+			uiaComm_HeldSrc[ucComm_HeldCount] = uiaWinSrc[ucii];
+			ucComm_HeldCount++;
+		}
+
+		// Ran out of time part way through the window
+		if (ucWinAcked != ucWinFull)
+			break;
+	}
+
+	return ucTXMsgCount;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//! \brief This function sends as much data from the memory as possible
+//!
+//! Uses block ACKs when the link agreed on a window in the RTR and LRQ,
+//! otherwise every message waits for its own ACK.
 //!
 //! \param none
 //! \return ucRetVal, 0 if there is no more data to send
@@ -335,25 +559,30 @@ void vComm_SendData(void)
 	ucAttemptCount = 0;
 	ucTXMsgCount = 0;
 
-	// Loop while the sub-slot alarms aren't set
-	while (ucTimeCheckForAlarms(SUBSLOT_ALARMS) == 0) {
+	// Get the other links serial number
+	ucTask_GetField(g_ucaCurrentTskIndex, PARAM_SN, &ulOtherGuysSN);
+	uiOtherGuysSN = (uint) ulOtherGuysSN;
+
+	// Block ACKs if the link agreed on a window in the RTR and LRQ
+	if (ucComm_Window > 1)
+		ucTXMsgCount = ucComm_SendDataWindow(uiOtherGuysSN);
+
+	// Otherwise every message waits for its own ACK
+	while ((ucComm_Window <= 1) && (ucTimeCheckForAlarms(SUBSLOT_ALARMS) == 0)) {
 		// Get the first message from memory
 		if (ucL2SRAM_getCopyOfCurMsg()) // if there is a message
 		{
 			// Get the number of messages in memory
 			uiMsgCount = uiL2SRAM_getMsgCount();
 
-			// Get the other links serial number and build the network header
-			ucTask_GetField(g_ucaCurrentTskIndex, PARAM_SN, &ulOtherGuysSN);
-			uiOtherGuysSN = (uint) ulOtherGuysSN;
-
+			// Build the network header
 			vComm_NetPkg_buildHdr(uiOtherGuysSN);
 
 			// Store a local copy of the message number
 			uiMsgNumber = ((ucaMSG_BUFF[MSG_IDX_NUM_HI] << 8) | ucaMSG_BUFF[MSG_IDX_NUM_LO]);
 
-			// If this is the last message then
-			if (uiMsgCount == 1)
+			// If this is the last message then (END on a fragment marks its last fragment)
+			if ((uiMsgCount == 1) && (ucaMSG_BUFF[MSG_IDX_FLG] & MSG_FLG_SINGLE))
 				ucaMSG_BUFF[MSG_IDX_FLG] |= MSG_FLG_END;
 
 			// COMPUTE THE CRC
@@ -418,6 +647,9 @@ void vComm_SendData(void)
 	vSERIAL_UI8out(ucTXMsgCount);
 	vSERIAL_crlf();
 
+	// Tell the link density controller how much this link moved
+	ucLNKBLK_WriteDrainCount(uiOtherGuysSN, ucTXMsgCount);
+
 	// Get the number of messages in memory
 	uiMsgCount = uiL2SRAM_getMsgCount();
 
@@ -437,9 +669,155 @@ void vComm_SendData(void)
 }
 
 /////////////////////////////////////////////////////////////////////////////
-//! \brief This function receives data from the child and sends the acks
+//! \brief Finds the ring of messages last stored from a child
+//!
+//! A child that has none takes a free entry or, if there is none, the one
+//! used longest ago.
+//!
+//! \param uiChildSN
+//! \return the entry
+/////////////////////////////////////////////////////////////////////////////
+static S_CommSeen *S_Comm_FindSeen(uint uiChildSN)
+{
+	uchar ucii;
+	uchar ucOldest;
+	S_CommSeen *S_Seen;
+
+	ucOldest = 0;
+	for (ucii = 0; ucii < COMM_SEEN_CHILDREN; ucii++) {
+		if (S_CommSeenChildren[ucii].m_ucAge < 0xFF)
+			S_CommSeenChildren[ucii].m_ucAge++;
+	}
+
+	for (ucii = 0; ucii < COMM_SEEN_CHILDREN; ucii++) {
+		S_Seen = &S_CommSeenChildren[ucii];
+		if ((S_Seen->m_ucCount != 0) && (S_Seen->m_uiChildSN == uiChildSN)) {
+			S_Seen->m_ucAge = 0;
+			return S_Seen;
+		}
+
+		// Free entries are the oldest of all
+		if ((S_Seen->m_ucCount == 0) || ((S_CommSeenChildren[ucOldest].m_ucCount != 0) && (S_Seen->m_ucAge > S_CommSeenChildren[ucOldest].m_ucAge)))
+			ucOldest = ucii;
+	}
+
+	S_Seen = &S_CommSeenChildren[ucOldest];
+	S_Seen->m_uiChildSN = uiChildSN;
+	S_Seen->m_ucCount = 0;
+	S_Seen->m_ucNext = 0;
+	S_Seen->m_ucAge = 0;
+
+	return S_Seen;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//! \brief Receives windows of data messages and answers each with a block ACK
+//!
+//! The block ACK lists the numbers of every message heard since the last one
+//! and goes out when a message asks for it.  A message sent again because its
+//! block ACK was lost, in this slot or the last one, is acked again but
+//! stored only once.
 //!
+//! \param none
+//! \return number of messages stored
+/////////////////////////////////////////////////////////////////////////////
+static uchar ucComm_Receive_DataWindow(void)
+{
+	uint uiaAckNum[COMM_WINDOW_MAX];
+	ulong ulChildSN;
+	uint uiMsgNumber;
+	uint uiSrcSN;
+	uchar ucAckCount;
+	uchar ucFlags;
+	uchar ucii;
+	uchar ucRXMsgCount;
+	S_CommSeen *S_Seen;
+
+	ucRXMsgCount = 0;
+	ucAckCount = 0;
+
+	// Messages already stored from this child
+	ucTask_GetField(g_ucaCurrentTskIndex, PARAM_SN, &ulChildSN);
+	S_Seen = S_Comm_FindSeen((uint) ulChildSN);
+
+	// Loop while the sub-slot alarms aren't set
+	while (ucTimeCheckForAlarms(SUBSLOT_ALARMS) == 0) {
+		// set the radio into RX mode
+		vADF7020_TXRXSwitch(RADIO_RX_MODE);
+
+		// Wait for a reply from the child node
+		if (!ucComm_waitForMsgOrTimeout(NO_RSSI))
+			continue;
+
+		/* GOT A MSG -- CHK FOR: CRC, MSGTYPE, GROUPID, DEST_SN */
+		if (ucComm_chkMsgIntegrity( //RET: Bit Err Mask, 0 if OK
+				CHKBIT_CRC + CHKBIT_MSG_TYPE, //chk flags
+				CHKBIT_CRC + CHKBIT_MSG_TYPE, //report flags
+				MSG_ID_OPERATIONAL, //msg type
+				0, //src SN
+				0 //Dst SN
+				))
+			continue;
+
+		uiMsgNumber = ((ucaMSG_BUFF[MSG_IDX_NUM_HI] << 8) | ucaMSG_BUFF[MSG_IDX_NUM_LO]);
+		ucFlags = ucaMSG_BUFF[MSG_IDX_FLG];
+
+		// If the message contains data then store it
+		if (ucaMSG_BUFF[MSG_IDX_LEN] != MSG_HDR_SZ) {
+			uiSrcSN = ((ucaMSG_BUFF[MSG_IDX_ADDR_HI] << 8) | ucaMSG_BUFF[MSG_IDX_ADDR_LO]);
+
+			// Messages are named by source and number, look for a repeat
+			for (ucii = 0; ucii < S_Seen->m_ucCount; ucii++) {
+				if ((S_Seen->m_uiaNum[ucii] == uiMsgNumber) && (S_Seen->m_uiaSrc[ucii] == uiSrcSN))
+					break;
+			}
+
+			if (ucii == S_Seen->m_ucCount) {
+				// The ACK request was for this link, the message is sent on with its own
+				ucaMSG_BUFF[MSG_IDX_FLG] &= ~MSG_FLG_ACKRQST;
+				ucCRC16_compute_msg_CRC(CRC_FOR_MSG_TO_SEND, ucaMSG_BUFF, ucaMSG_BUFF[MSG_IDX_LEN] + NET_HDR_SZ + CRC_SZ); //lint !e534 //compute the CRC
+				vL2SRAM_storeMsgToSram();
+
+				// The hub logs everything that comes up through the network to the SD card
+				if (ucL2FRAM_isHub())
+					vComm_Frag_LogReport();
+
+				ucRXMsgCount++;
+
+				S_Seen->m_uiaNum[S_Seen->m_ucNext] = uiMsgNumber;
+				S_Seen->m_uiaSrc[S_Seen->m_ucNext] = uiSrcSN;
+				S_Seen->m_ucNext = (S_Seen->m_ucNext + 1) % COMM_SEEN_COUNT;
+				if (S_Seen->m_ucCount < COMM_SEEN_COUNT)
+					S_Seen->m_ucCount++;
+			}
+
+			// Add it to the next block ACK
+			for (ucii = 0; ucii < ucAckCount; ucii++) {
+				if (uiaAckNum[ucii] == uiMsgNumber)
+					break;
+			}
+			if ((ucii == ucAckCount) && (ucAckCount < COMM_WINDOW_MAX))
+				uiaAckNum[ucAckCount++] = uiMsgNumber;
+		}
+
+		// The last message of a window asks for the ACK
+		if (ucFlags & MSG_FLG_ACKRQST) {
+			vComm_SendAckList(uiMsgNumber, uiaAckNum, ucAckCount);
+			ucAckCount = 0;
+
+			// If this was the child's last message then break out (END on a fragment marks its last fragment)
+			if ((ucFlags & (MSG_FLG_SINGLE | MSG_FLG_END)) == (MSG_FLG_SINGLE | MSG_FLG_END))
+				break;
+		}
+	}
+
+	return ucRXMsgCount;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//! \brief This function receives data from the child and sends the acks
 //!
+//! Uses block ACKs when the link agreed on a window in the RTR and LRQ.
 //!
 //! \param none
 //! \return none
@@ -451,8 +829,12 @@ void vComm_Receive_Data(void)
 
 	ucRXMsgCount = 0;
 
-	// Loop while the sub-slot alarms aren't set
-	while (ucTimeCheckForAlarms(SUBSLOT_ALARMS) == 0) {
+	// Block ACKs if the link agreed on a window in the RTR and LRQ
+	if (ucComm_Window > 1)
+		ucRXMsgCount = ucComm_Receive_DataWindow();
+
+	// Otherwise every message gets its own ACK
+	while ((ucComm_Window <= 1) && (ucTimeCheckForAlarms(SUBSLOT_ALARMS) == 0)) {
 		// set the radio into RX mode
 		vADF7020_TXRXSwitch(RADIO_RX_MODE);
 
@@ -477,8 +859,8 @@ void vComm_Receive_Data(void)
 					// be stored there
 					if (ucL2FRAM_isHub()) {
 
-						// Log to the SD card
-						vREPORT_LogReport();
+						// Log to the SD card, fragments once the whole message is in
+						vComm_Frag_LogReport();
 					}
 
 					// Increment the received message count
@@ -710,7 +1092,7 @@ void vComm_SendRTR(void)
 	vComm_Msg_buildOperational(MSG_FLG_SINGLE, 1, uiOtherGuysSN, MSG_ID_RTR);
 
 	//Stuff the message length
-	ucaMSG_BUFF[MSG_IDX_LEN] = 13;
+	ucaMSG_BUFF[MSG_IDX_LEN] = 15;
 
 	//Stuff the synch time in seconds
 	vMISC_copyUlongIntoBytes(lTIME_getSysTimeAsLong(), (uchar *) &ucaMSG_BUFF[OPMSG_IDX_TIME_SEC_XI], NO_NOINT);
@@ -720,6 +1102,14 @@ void vComm_SendRTR(void)
 	ucaMSG_BUFF[OPMSG_IDX_TIME_SUBSEC_HI] = (uchar) (uiSubSeconds >> 8);
 	ucaMSG_BUFF[OPMSG_IDX_TIME_SUBSEC_LO] = (uchar) uiSubSeconds;
 
+	// Offer block ACKs, the child takes them in the LRQ
+	ucaMSG_BUFF[OPMSG_IDX_WINDOW] = COMM_WINDOW_MAX;
+
+	// Ask for the whole subtree if the routing updates of the child can't be applied
+	ucaMSG_BUFF[OPMSG_IDX_ROUTE] = 0;
+	if (ucRoute_NeedResync(uiOtherGuysSN))
+		ucaMSG_BUFF[OPMSG_IDX_ROUTE] = ROUTE_RTR_RESYNC;
+
 	// COMPUTE THE CRC
 	ucCRC16_compute_msg_CRC(CRC_FOR_MSG_TO_SEND, ucaMSG_BUFF, ucaMSG_BUFF[MSG_IDX_LEN] + NET_HDR_SZ + CRC_SZ); //lint !e534 //compute the CRC
 
@@ -747,83 +1137,60 @@ void vComm_SendLRQ(uchar ucLinkByte)
 {
 	ulong ulOtherGuysSN;
 	uint uiOtherGuysSN;
-	uchar ucUpdateCount;
-	uchar ucSpaceLeft;
+	uchar ucUpdateLen;
+	uchar ucMore;
+	uchar ucWinFlag;
+	uchar ucRouteFlag;
 
 	// GET THE OTHER LINK'S SERIAL NUM
 	ucTask_GetField(g_ucaCurrentTskIndex, PARAM_SN, &ulOtherGuysSN);
 	uiOtherGuysSN = (uint) ulOtherGuysSN;
 
-	// Network Layer
-	vComm_NetPkg_buildHdr(uiOtherGuysSN);
-
-	// Single message
-	vComm_Msg_buildOperational(MSG_FLG_SINGLE, 1, uiOtherGuysSN, MSG_ID_LRQ);
-
-	// Add the message length as well as the link request and network update fields
-	ucaMSG_BUFF[MSG_IDX_LEN] = MSG_HDR_SZ + 3;
-	ucaMSG_BUFF[MSG_IDX_LRQ] = ucLinkByte;
+	// Take the block ACK window if the parent offered one
+	ucWinFlag = 0;
+	if (ucComm_Window > 1)
+		ucWinFlag = MSG_FLG_WINDOW;
 
-	// Get the total number of routing updates
-	ucUpdateCount = ucRoute_GetUpdateCountBytes(F_JOIN | F_DROP);
-
-	// If there are no updates then just send the link byte and exit
-	if (ucUpdateCount == 0) {
-		// Set the join and drop lengths to 0
-		ucaMSG_BUFF[(uchar) (MSG_IDX_LRQ + 1)] = 0;
-		ucaMSG_BUFF[(uchar) (MSG_IDX_LRQ + 2)] = 0;
-
-		// COMPUTE THE CRC
-		ucCRC16_compute_msg_CRC(CRC_FOR_MSG_TO_SEND, ucaMSG_BUFF, ucaMSG_BUFF[MSG_IDX_LEN] + NET_HDR_SZ + CRC_SZ); //lint !e534 //compute the CRC
+	// Older parents only read the join/drop encoding
+	ucRouteFlag = 0;
+	if (ucComm_RouteRecs)
+		ucRouteFlag = MSG_FLG_ROUTE;
 
-		// Load message into TX buffer and set the radio mode to TX
-		vADF7020_SetPacketLength(ucaMSG_BUFF[MSG_IDX_LEN] + NET_HDR_SZ + CRC_SZ);
-		unADF7020_LoadTXBuffer((uint8*) &ucaMSG_BUFF);
-		vADF7020_TXRXSwitch(RADIO_TX_MODE);
-
-		// Send the Message
-		vADF7020_SendMsg();
-
-		return;
-	}
-
-	// Get the available space in the message
-	ucSpaceLeft = MAX_MSG_SIZE - (ucaMSG_BUFF[MSG_IDX_LEN] + NET_HDR_SZ + CRC_SZ);
-
-	// If there is enough room in the current message to send all required updates
-	while (ucUpdateCount != 0) {
-		// Set the link request byte
-		ucaMSG_BUFF[MSG_IDX_LRQ] = ucLinkByte;
-
-		// Add the update count to the current message length
-		ucaMSG_BUFF[MSG_IDX_LEN] = ucUpdateCount + MSG_HDR_SZ + 4;
+	// Send the link request with as many routing updates as fit, ask for an ACK while more are left
+	while (1) {
+		// Network Layer
+		vComm_NetPkg_buildHdr(uiOtherGuysSN);
 
 		// Load the updates into the message buffer after the link request byte
-		vRoute_GetUpdates(&ucaMSG_BUFF[(uchar) (MSG_IDX_LRQ + 1)], ucSpaceLeft);
+		if (ucRouteFlag)
+			ucUpdateLen = ucRoute_GetUpdates(&ucaMSG_BUFF[(uchar) (MSG_IDX_LRQ + 1)], MAX_MSG_SIZE - (NET_HDR_SZ + MSG_HDR_SZ + 1 + CRC_SZ));
+		else
+			ucUpdateLen = ucRoute_GetLegacyUpdates(&ucaMSG_BUFF[(uchar) (MSG_IDX_LRQ + 1)], MAX_MSG_SIZE - (NET_HDR_SZ + MSG_HDR_SZ + 1 + CRC_SZ));
+		ucMore = ucRoute_UpdatesLeft();
 
 		// Build the header
-		if (ucUpdateCount > ucSpaceLeft) {
-			vComm_NetPkg_buildHdr(uiOtherGuysSN);
-			vComm_Msg_buildOperational(MSG_FLG_ACKRQST, 1, uiOtherGuysSN, MSG_ID_LRQ);
-			ucaMSG_BUFF[MSG_IDX_LEN] = ucSpaceLeft + MSG_HDR_SZ + 4;
-		}
-		else {
-			vComm_NetPkg_buildHdr(uiOtherGuysSN);
-			vComm_Msg_buildOperational(MSG_FLG_SINGLE, 1, uiOtherGuysSN, MSG_ID_LRQ);
-		}
+		if (ucMore)
+			vComm_Msg_buildOperational(MSG_FLG_ACKRQST | ucWinFlag | ucRouteFlag, 1, uiOtherGuysSN, MSG_ID_LRQ);
+		else
+			vComm_Msg_buildOperational(MSG_FLG_SINGLE | ucWinFlag | ucRouteFlag, 1, uiOtherGuysSN, MSG_ID_LRQ);
+
+		// Add the message length as well as the link request
+		ucaMSG_BUFF[MSG_IDX_LEN] = MSG_HDR_SZ + 1 + ucUpdateLen;
+		ucaMSG_BUFF[MSG_IDX_LRQ] = ucLinkByte;
 
 		// COMPUTE THE CRC
 		ucCRC16_compute_msg_CRC(CRC_FOR_MSG_TO_SEND, ucaMSG_BUFF, ucaMSG_BUFF[MSG_IDX_LEN] + NET_HDR_SZ + CRC_SZ); //lint !e534 //compute the CRC
 
-		// Load message into TX buffer
+		// Load message into TX buffer and set the radio mode to TX
 		vADF7020_SetPacketLength(ucaMSG_BUFF[MSG_IDX_LEN] + NET_HDR_SZ + CRC_SZ);
 		unADF7020_LoadTXBuffer((uint8*) &ucaMSG_BUFF);
+		vADF7020_TXRXSwitch(RADIO_TX_MODE);
 
 		// Send the Message
 		vADF7020_SendMsg();
 
 		// If we have sent all updates then exit the loop
-		if (ucUpdateCount < ucSpaceLeft)
+		if (!ucMore)
 			break;
 
 		// Wait for an ack
@@ -833,10 +1200,6 @@ void vComm_SendLRQ(uchar ucLinkByte)
 
 		// Since we have received an ACK we can remove the flagged updates
 		vRouteClrFlaggedUpdates();
-
-		// Get the total number of routing updates
-		ucUpdateCount = ucRoute_GetUpdateCountBytes(F_JOIN | F_DROP);
-
 	}
 
 }
@@ -849,10 +1212,11 @@ void vComm_SendLRQ(uchar ucLinkByte)
 //! flag set when the amount of network update data exceeds the maximum packet size.
 //! When this
 //!
-//! \param none
-//! \return 1 for success, 0 for failure
+//! \param uipMsgNumber, set to the number of the LRQ for the ACK, the
+//! RSSI report reuses the message buffer before the ACK goes out
+//! \return 1 for success, 2 if the child waits for an ACK, 0 for failure
 /////////////////////////////////////////////////////////////////////////////
-static uchar ucComm_WaitFor_LRQ(void)
+static uchar ucComm_WaitFor_LRQ(uint *uipMsgNumber)
 {
 	uchar ucLinkFailReason;
 	uchar ucLinkFailPriority;
@@ -899,13 +1263,25 @@ static uchar ucComm_WaitFor_LRQ(void)
 			vComm_zroMissedMsgCnt();
 
 			ucLinkRequest = ucaMSG_BUFF[MSG_IDX_LRQ];
+			*uipMsgNumber = ((ucaMSG_BUFF[MSG_IDX_NUM_HI] << 8) | ucaMSG_BUFF[MSG_IDX_NUM_LO]);
 
 			vSERIAL_sout("LnkByte: ", 9);
 			vLNKBLK_showLnkReq(ucLinkRequest);
 			vSERIAL_crlf();
 
-			// Update the edge list (routing data).
-			vRoute_SetUpdates(&ucaMSG_BUFF[(uchar) (MSG_IDX_LRQ + 1)]);
+			// Update the edge list (routing data), older children send the join/drop encoding
+			if ((ucaMSG_BUFF[MSG_IDX_LEN] + NET_HDR_SZ) > (MSG_IDX_LRQ + 1)) {
+				if (ucaMSG_BUFF[MSG_IDX_FLG] & MSG_FLG_ROUTE)
+					vRoute_SetUpdates(uiOtherGuysSN, &ucaMSG_BUFF[(uchar) (MSG_IDX_LRQ + 1)],
+							(uchar) (ucaMSG_BUFF[MSG_IDX_LEN] + NET_HDR_SZ - (MSG_IDX_LRQ + 1)));
+				else
+					vRoute_SetLegacyUpdates(uiOtherGuysSN, &ucaMSG_BUFF[(uchar) (MSG_IDX_LRQ + 1)],
+							(uchar) (ucaMSG_BUFF[MSG_IDX_LEN] + NET_HDR_SZ - (MSG_IDX_LRQ + 1)));
+			}
+
+			// The child took the block ACK window offered in the RTR
+			if (ucaMSG_BUFF[MSG_IDX_FLG] & MSG_FLG_WINDOW)
+				ucComm_Window = COMM_WINDOW_MAX;
 
 			// Stash the link request if allowed
 			ucLNKBLK_ReadFlags(uiOtherGuysSN, &ucLnkFlags);
@@ -1101,6 +1477,21 @@ uchar ucComm_WaitFor_RTR(void)
 			// Zero out the missed message count in the task status field
 			vComm_zroMissedMsgCnt();
 
+			// Older parents send no window and ACK every message
+			ucComm_Window = 1;
+			if ((ucaMSG_BUFF[MSG_IDX_LEN] + NET_HDR_SZ) > OPMSG_IDX_WINDOW) {
+				ucComm_Window = ucaMSG_BUFF[OPMSG_IDX_WINDOW];
+				if (ucComm_Window > COMM_WINDOW_MAX)
+					ucComm_Window = COMM_WINDOW_MAX;
+			}
+
+			// Older parents send no routing flags and take the join/drop encoding
+			ucComm_RouteRecs = ((ucaMSG_BUFF[MSG_IDX_LEN] + NET_HDR_SZ) > OPMSG_IDX_ROUTE);
+
+			// The parent can't apply our routing updates, send it the whole subtree
+			if (ucComm_RouteRecs && (ucaMSG_BUFF[OPMSG_IDX_ROUTE] & ROUTE_RTR_RESYNC))
+				vRoute_RequestResync();
+
 			// Set the return byte indicating success
 			ucRetVal = 1;
 		}
@@ -1207,6 +1598,55 @@ uchar ucComm_WaitForAck(uint uiMsgNumber)
 	return ucRetVal; // Return the status
 }
 
+/////////////////////////////////////////////////////////////////////////////
+//! \brief Waits for a block ACK and marks the window messages it names
+//!
+//! \param uipWinNum, message numbers of the window in send order
+//! \param ucWinCount, messages in the window
+//! \param ucpAcked, one bit per window message, bits are only ever set
+//! \return 1 for an ack, else 0
+/////////////////////////////////////////////////////////////////////////////
+static uchar ucComm_WaitForBlockAck(const uint *uipWinNum, uchar ucWinCount, uchar *ucpAcked)
+{
+	uchar ucRetVal;
+	uchar ucMsgEnd;
+	uchar ucIdx;
+	uchar ucPos;
+	uint uiMsgNumber;
+
+	// Assume failure
+	ucRetVal = 0;
+
+	// Wait for a reply from the parent node
+	if (ucComm_waitForMsgOrTimeout(NO_RSSI)) {
+		/* GOT A MSG -- CHK FOR: CRC, MSGTYPE, GROUPID, DEST_SN */
+		if (!(ucComm_chkMsgIntegrity( //RET: Bit Err Mask, 0 if OK
+				CHKBIT_CRC + CHKBIT_MSG_TYPE, //chk flags
+				CHKBIT_CRC + CHKBIT_MSG_TYPE, //report flags
+				MSG_ID_OPERATIONAL, //msg type
+				0, //src SN
+				0 //Dst SN
+				)) && (ucaMSG_BUFF[MSG_IDX_FLG] & MSG_FLG_ACK)) {
+			ucMsgEnd = ucaMSG_BUFF[MSG_IDX_LEN] + NET_HDR_SZ;
+			if (ucMsgEnd > MAX_MSG_SIZE)
+				ucMsgEnd = MAX_MSG_SIZE;
+
+			// The payload is the list of message numbers the parent holds
+			for (ucIdx = MSG_IDX_PAYLD; (ucIdx + 1) < ucMsgEnd; ucIdx += 2) {
+				uiMsgNumber = ((ucaMSG_BUFF[ucIdx] << 8) | ucaMSG_BUFF[ucIdx + 1]);
+				for (ucPos = 0; ucPos < ucWinCount; ucPos++) {
+					if (uipWinNum[ucPos] == uiMsgNumber)
+						*ucpAcked |= (uchar) (1 << ucPos);
+				}
+			}
+
+			// Set the return byte indicating success
+			ucRetVal = 1;
+		}
+	}
+	return ucRetVal; // Return the status
+}
+
 /////////////////////////////////////////////////////////////////////////////
 //! \brief Sends an ack message.  This function is intended to be sent
 //! immediately after receiving a message.  It is assumed that the message
@@ -1216,10 +1656,27 @@ uchar ucComm_WaitForAck(uint uiMsgNumber)
 //! \return none
 /////////////////////////////////////////////////////////////////////////////
 void vComm_SendAck(uint uiMsgNumber)
+{
+	vComm_SendAckList(uiMsgNumber, 0, 0);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//! \brief Sends an ack message carrying a list of message numbers
+//!
+//! With an empty list this is the plain ACK of one message.  A block ACK
+//! lists every message of the window the parent holds.
+//!
+//! \param uiMsgNumber, number of the message that asked for the ACK
+//! \param uipNums, message numbers to ACK
+//! \param ucNumCount, entries in uipNums, at most COMM_WINDOW_MAX
+//! \return none
+/////////////////////////////////////////////////////////////////////////////
+static void vComm_SendAckList(uint uiMsgNumber, const uint *uipNums, uchar ucNumCount)
 {
 	ulong ulOtherGuysSN;
 	uint uiOtherGuysSN;
-	uint8 ucaAckMessage[MSG_HDR_SZ + NET_HDR_SZ + CRC_SZ];
+	uchar ucIdx;
+	uint8 ucaAckMessage[MSG_HDR_SZ + NET_HDR_SZ + CRC_SZ + (2 * COMM_WINDOW_MAX)];
 
 	// GET THE OTHER LINK'S SERIAL NUM
 	ucTask_GetField(g_ucaCurrentTskIndex, PARAM_SN, &ulOtherGuysSN);
@@ -1246,7 +1703,13 @@ void vComm_SendAck(uint uiMsgNumber)
 	ucaAckMessage[MSG_IDX_ADDR_HI] = (uchar) (uiOtherGuysSN >> 8);
 	ucaAckMessage[MSG_IDX_ADDR_LO] = (uchar) uiOtherGuysSN;
 
-	ucaAckMessage[MSG_IDX_LEN] = MSG_HDR_SZ;
+	ucaAckMessage[MSG_IDX_LEN] = MSG_HDR_SZ + (2 * ucNumCount);
+
+	// Stuff the acked message numbers
+	for (ucIdx = 0; ucIdx < ucNumCount; ucIdx++) {
+		ucaAckMessage[MSG_IDX_PAYLD + (2 * ucIdx)] = (uchar) (uipNums[ucIdx] >> 8);
+		ucaAckMessage[MSG_IDX_PAYLD + (2 * ucIdx) + 1] = (uchar) uipNums[ucIdx];
+	}
 
 	// COMPUTE THE CRC
 	ucCRC16_compute_msg_CRC(CRC_FOR_MSG_TO_SEND, ucaAckMessage, ucaAckMessage[MSG_IDX_LEN] + NET_HDR_SZ + CRC_SZ); //lint !e534 //compute the CRC
@@ -1271,6 +1734,9 @@ void vComm_Parent(void)
 	uint uiMsgNumber; // used for both incoming and outgoing messages
 	uchar ucLRQRetVal;
 
+	// Block ACKs only once the child takes them in the LRQ
+	ucComm_Window = 1;
+
 	// Sleep in LPM 1 for 20 ms to allow the receiver to turn on and get ready for the RTR
 	// Waiting accounts for most clock drift cases as a result of crystal imperfections/temperatures
 	vDELAY_LPMWait1us(20000, SLEEPMODE_2);
@@ -1314,7 +1780,7 @@ void vComm_Parent(void)
 	vADF7020_StartReceiver();
 
 	// Wait for the link request packet
-	ucLRQRetVal = ucComm_WaitFor_LRQ();
+	ucLRQRetVal = ucComm_WaitFor_LRQ(&uiMsgNumber);
 
 	// If the LRQ return value equals 1 then it is either the only LRQ packet or the last one in the sequence
 	while (ucLRQRetVal != 1) {
@@ -1325,12 +1791,11 @@ void vComm_Parent(void)
 		}
 		else if (ucLRQRetVal == 2) // The LRQ is part of a sequence and the child is waiting for an ACK
 				{
-			uiMsgNumber = ((ucaMSG_BUFF[MSG_IDX_NUM_HI] << 8) | ucaMSG_BUFF[MSG_IDX_NUM_LO]);
 			vComm_SendAck(uiMsgNumber);
 
 			// set the radio state to RX mode
 			vADF7020_TXRXSwitch(RADIO_RX_MODE);
-			ucLRQRetVal = ucComm_WaitFor_LRQ();
+			ucLRQRetVal = ucComm_WaitFor_LRQ(&uiMsgNumber);
 		}
 	}
 
@@ -1397,6 +1862,10 @@ void vComm_Child(void)
 	vReport_LogDataElement(RPT_PRTY_WAIT_RTR);
 	/////////////////**************************////////////////////////
 
+	// Block ACKs and routing records only once the parent offers them in the RTR
+	ucComm_Window = 1;
+	ucComm_RouteRecs = 0;
+
 	//Configure the timer to measure latency
 	vTime_LatencyTimer(ON);
 
@@ -5,6 +5,7 @@
 
 #include "comm.h"
 #include "serial.h"
+#include "rand.h"
 
 
 //TODO: consider the situation where too many nodes are added to the network (may only be noticed by an ancestor node)!
@@ -36,6 +37,173 @@ struct {
 
 void vRouteClrAllUpdates(void);
 
+//! \struct S_RoutePeer
+//! \brief Update stream state of a child, kept beside the edge leading to it
+typedef struct
+{
+	uchar m_ucEpoch;			//!< Epoch of the last update applied
+	uchar m_ucSeq;				//!< Sequence number of the last update applied
+	uchar m_ucFlags;			//!< ROUTE_PEER_ flags
+} S_RoutePeer;
+
+//! \def ROUTE_PEER_SYNCED
+//! \brief The epoch and sequence number of the child are known
+#define ROUTE_PEER_SYNCED		0x01
+//! \def ROUTE_PEER_RESYNC
+//! \brief An update was missed, deltas are ignored until the child sends its whole subtree
+#define ROUTE_PEER_RESYNC		0x02
+
+//! \var S_RoutePeers
+//! \brief Update stream state of the destination of the edge with the same index
+static S_RoutePeer S_RoutePeers[MAX_EDGES];
+
+//! \def ROUTE_RESYNC_START
+//! \def ROUTE_RESYNC_SENDING
+//! \brief States of the subtree dump this node sends its parent, 0 is none
+#define ROUTE_RESYNC_START		1
+#define ROUTE_RESYNC_SENDING	2
+
+//! \var ucRoute_Epoch
+//! \brief Picked at boot so the parent can tell the updates of this boot from older ones
+static uchar ucRoute_Epoch;
+//! \var ucRoute_TxSeq
+//! \brief Sequence number of the next LRQ with updates
+static uchar ucRoute_TxSeq;
+//! \var ucRoute_TxPending
+//! \brief Set when the last LRQ carried updates that are not acknowledged yet
+static uchar ucRoute_TxPending;
+//! \var ucRoute_TxListCount
+//! \brief Entries of the update list in the LRQ waiting for an ACK
+static uchar ucRoute_TxListCount;
+//! \var ucRoute_ResyncState
+//! \brief State of the subtree dump
+static uchar ucRoute_ResyncState;
+//! \var uiRoute_ResyncNext
+//! \brief First edge of the dump the parent has not acknowledged
+static uint uiRoute_ResyncNext;
+//! \var uiRoute_ResyncSent
+//! \brief Edge after the last one in the LRQ waiting for an ACK
+static uint uiRoute_ResyncSent;
+//! \var ucRoute_TxLegacy
+//! \brief Set when the last LRQ used the join/drop encoding of older parents
+static uchar ucRoute_TxLegacy;
+
+//! \def ROUTE_HASH_SZ
+//! \brief Slots in the node table, a power of 2 at least twice MAX_EDGES
+#define ROUTE_HASH_SZ		256
+
+//! \def ROUTE_HASH_MASK
+#define ROUTE_HASH_MASK		(ROUTE_HASH_SZ - 1)
+
+// Every node below this one is the destination of exactly one edge, so the
+// edge list doubles as a parent pointer array.  The node table finds the edge
+// leading to a node and the next hop of each node is cached beside its edge.
+//! \var ucaRoute_NodeTbl
+//! \brief Open addressed (linear probing) table of node address to edge index + 1, 0 if empty
+static uchar ucaRoute_NodeTbl[ROUTE_HASH_SZ];
+//! \var uiaRoute_NextHop
+//! \brief Next hop for the destination of the edge with the same index, 0 until it is looked up
+static uint uiaRoute_NextHop[MAX_EDGES];
+
+/////////////////////////////////////////////////////////////////////////////////
+//!
+//! \brief Home slot of a node address in the node table
+//!
+//! \param uiNode
+//! \return slot
+////////////////////////////////////////////////////////////////////////////////
+static uchar ucRoute_HashOf(uint uiNode)
+{
+	return (uchar) (((uiNode * 0x9E37u) & 0xFFFF) >> 8);
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+//!
+//! \brief Finds the slot of a node in the node table
+//!
+//! \param uiNode
+//! \return the slot holding the node or the empty slot where it would go
+////////////////////////////////////////////////////////////////////////////////
+static uchar ucRoute_FindSlot(uint uiNode)
+{
+	uchar ucSlot;
+
+	ucSlot = ucRoute_HashOf(uiNode);
+	while (ucaRoute_NodeTbl[ucSlot] != 0)
+	{
+		if (S_edgeList[ucaRoute_NodeTbl[ucSlot] - 1].m_uiDest == uiNode)
+			break;
+		ucSlot = (ucSlot + 1) & ROUTE_HASH_MASK;
+	}
+
+	return ucSlot;
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+//!
+//! \brief Removes a node from the node table
+//!
+//! Entries after the hole are moved back into it when the hole is between
+//! their home slot and where they are, so lookups never stop early.
+//!
+//! \param uiNode
+//! \return none
+////////////////////////////////////////////////////////////////////////////////
+static void vRoute_NodeTblRemove(uint uiNode)
+{
+	uchar ucHole;
+	uchar ucSlot;
+	uchar ucHome;
+
+	ucHole = ucRoute_FindSlot(uiNode);
+	if (ucaRoute_NodeTbl[ucHole] == 0)
+		return;
+	ucaRoute_NodeTbl[ucHole] = 0;
+
+	ucSlot = (ucHole + 1) & ROUTE_HASH_MASK;
+	while (ucaRoute_NodeTbl[ucSlot] != 0)
+	{
+		ucHome = ucRoute_HashOf(S_edgeList[ucaRoute_NodeTbl[ucSlot] - 1].m_uiDest);
+		if (((ucSlot - ucHome) & ROUTE_HASH_MASK) >= ((ucSlot - ucHole) & ROUTE_HASH_MASK))
+		{
+			ucaRoute_NodeTbl[ucHole] = ucaRoute_NodeTbl[ucSlot];
+			ucaRoute_NodeTbl[ucSlot] = 0;
+			ucHole = ucSlot;
+		}
+		ucSlot = (ucSlot + 1) & ROUTE_HASH_MASK;
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+//!
+//! \brief Rebuilds the node table from the edge list
+//!
+//! \param none
+//! \return none
+////////////////////////////////////////////////////////////////////////////////
+static void vRoute_NodeTblRebuild(void)
+{
+	uint uiIndex;
+
+	for (uiIndex = 0; uiIndex < ROUTE_HASH_SZ; uiIndex++)
+		ucaRoute_NodeTbl[uiIndex] = 0;
+
+	for (uiIndex = 0; uiIndex < uiNumEdges; uiIndex++)
+		ucaRoute_NodeTbl[ucRoute_FindSlot(S_edgeList[uiIndex].m_uiDest)] = (uchar) (uiIndex + 1);
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+//!
+//! \brief Finds the edge leading to a node
+//!
+//! \param uiNode
+//! \return edge index + 1, 0 if the node is not in the edge list
+////////////////////////////////////////////////////////////////////////////////
+static uchar ucRoute_FindEdge(uint uiNode)
+{
+	return ucaRoute_NodeTbl[ucRoute_FindSlot(uiNode)];
+}
+
 /////////////////////////////////////////////////////////////////////////////////
 //!
 //! \brief Clears the edge list and sets the next edge pointers to the
@@ -54,43 +222,102 @@ uchar ucRoute_Init(uint uiAddress)
 	//Clear values and edge list
 	uiNumEdges = 0;
 	for (i = 0; i < MAX_EDGES; i++)
+	{
 		S_edgeList[i].m_uiSrc = S_edgeList[i].m_uiDest = 0;
+		uiaRoute_NextHop[i] = 0;
+		S_RoutePeers[i].m_ucFlags = 0;
+	}
+	for (i = 0; i < ROUTE_HASH_SZ; i++)
+		ucaRoute_NodeTbl[i] = 0;
 
 	// Clear the arrays holding updates to the edge list
 	vRouteClrAllUpdates();
 
+	// Start a new update stream
+	ucRoute_Epoch = ucRAND_getRolledMidSysSeed();
+	ucRoute_TxSeq = 0;
+	ucRoute_TxPending = 0;
+	ucRoute_ResyncState = 0;
+	ucRoute_TxLegacy = 0;
+
 	//Initialize non-zero values
 	S_nextEdge = S_edgeList;
 
 	return (0);
 }
 
+/////////////////////////////////////////////////////////////////////////////////
+//!
+//! \brief Adds a join or drop to the update list sent to the parent
+//!
+//! If the list is full the update is lost, so the whole subtree is sent
+//! to the parent instead.
+//!
+//! \param uiSrc, uiDest, ucFlag; the edge and F_JOIN or F_DROP
+//! \return none
+////////////////////////////////////////////////////////////////////////////////
+static void vRoute_PushUpdate(uint uiSrc, uint uiDest, uchar ucFlag)
+{
+	if (S_RtUpdate.ucIndex >= MAX_UPDATES)
+	{
+		vRoute_RequestResync();
+		return;
+	}
+
+	S_RtUpdate.m_ucaEdges[S_RtUpdate.ucIndex].m_uiSrc = uiSrc;
+	S_RtUpdate.m_ucaEdges[S_RtUpdate.ucIndex].m_uiDest = uiDest;
+	S_RtUpdate.m_ucaFlags[S_RtUpdate.ucIndex] = ucFlag;
+	S_RtUpdate.ucIndex++;
+}
+
 /////////////////////////////////////////////////////////////////////////////////
 //!
 //! \brief Adds addresses to the next available locations in the edge list
 //!
+//! A node that is already in the list has moved, its edge is given the new
+//! source and every cached next hop is dropped since the whole subtree moved.
 //!
 //! \param uiSrc, uiDest; source and destination node addresses
 //! \return 0 for success, else error code
 ////////////////////////////////////////////////////////////////////////////////
 uchar ucRoute_AddEdge(uint uiSrc, uint uiDest)
 {
-	if (uiNumEdges >= MAX_EDGES)
+	uchar ucSlot;
+	uchar ucEdge;
+	uint uiIndex;
+
+	ucSlot = ucRoute_FindSlot(uiDest);
+	ucEdge = ucaRoute_NodeTbl[ucSlot];
+
+	if (ucEdge == 0 && uiNumEdges >= MAX_EDGES)
 		return ROUTE_ERROR_TABLE_FULL;
 
-	//Save the edge nodes and increment the pointer.  Also add the edges to the update list.
-	S_nextEdge->m_uiSrc = S_RtUpdate.m_ucaEdges[S_RtUpdate.ucIndex].m_uiSrc = uiSrc;
-	S_nextEdge->m_uiDest = S_RtUpdate.m_ucaEdges[S_RtUpdate.ucIndex].m_uiDest = uiDest;
+	//Also add the edges to the update list.
+	vRoute_PushUpdate(uiSrc, uiDest, F_JOIN);
 
-	// Set the join flag in the update list
-	S_RtUpdate.m_ucaFlags[S_RtUpdate.ucIndex] = F_JOIN;
+	if (ucEdge != 0)
+	{
+		S_edgeList[ucEdge - 1].m_uiSrc = uiSrc;
+		S_RoutePeers[ucEdge - 1].m_ucFlags = 0;
+		for (uiIndex = 0; uiIndex < uiNumEdges; uiIndex++)
+			uiaRoute_NextHop[uiIndex] = 0;
+
+		// An edge changed under a subtree dump, start it over
+		if (ucRoute_ResyncState == ROUTE_RESYNC_SENDING)
+			ucRoute_ResyncState = ROUTE_RESYNC_START;
+		return (0);
+	}
+
+	//Save the edge nodes and increment the pointer.
+	S_nextEdge->m_uiSrc = uiSrc;
+	S_nextEdge->m_uiDest = uiDest;
+	uiaRoute_NextHop[uiNumEdges] = 0;
+	S_RoutePeers[uiNumEdges].m_ucFlags = 0;
 
 	S_nextEdge++;					// Increment edge list pointer
 	uiNumEdges++;					// Increment the total number of edges
 
-	// Increment update index, prevent overflow
-	if(S_RtUpdate.ucIndex<(MAX_UPDATES-1))
-		S_RtUpdate.ucIndex++;
+	ucaRoute_NodeTbl[ucSlot] = (uchar) uiNumEdges;
 
 	return (0);
 }
@@ -99,51 +326,52 @@ uchar ucRoute_AddEdge(uint uiSrc, uint uiDest)
 //!
 //! \brief Searches through the edge list and removes the specified edge
 //!
+//! The last edge is moved into the gap so nothing else is shifted.  The
+//! subtree below the edge is cut off, so every cached next hop is dropped.
 //!
-//! \param
-//! \return
+//! \param uiSrc, uiDest; source and destination node addresses
+//! \return 0 for success, else error code
 ////////////////////////////////////////////////////////////////////////////////
 uchar ucRoute_RemoveEdge(uint uiSrc, uint uiDest)
 {
-	int i, j, uiFoundEdge;
-	S_Edge *S_ptr;
+	uchar ucEdge;
+	uint uiEdge;
+	uint uiLast;
+	uint uiIndex;
 
 	//Fail if there are no edges to remove
 	if (uiNumEdges == 0)
 		return ROUTE_ERROR_TABLE_EMPTY;
 
-	// Assume we will not find the edge
-	uiFoundEdge = 0;
+	//Find the edge, fail if it isn't in the graph
+	ucEdge = ucRoute_FindEdge(uiDest);
+	if (ucEdge == 0 || S_edgeList[ucEdge - 1].m_uiSrc != uiSrc)
+		return ROUTE_ERROR_DOES_NOT_EXIST;
 
-	//Find the edge
-	for (i = 0, S_ptr = S_edgeList; i < uiNumEdges; i++, S_ptr++)
-	{
-		if (S_ptr->m_uiSrc == uiSrc && S_ptr->m_uiDest == uiDest)
-		{
-			//Remove the edge from the list and shift the proceeding edges over to fill in the gap
-			S_ptr->m_uiSrc = S_ptr->m_uiDest = 0;
-			uiFoundEdge = 1;
-			for (j = i + 1; j < uiNumEdges; j++)
-			{
-				//Bounds check the index before shifting
-				if(j > 0 && j < uiNumEdges)
-					S_edgeList[j - 1] = S_edgeList[j];
-				else
-					return ROUTE_ERROR_INVALID_EDGE;
-			}
-			uiNumEdges--;
-			S_nextEdge--;
-			S_edgeList[uiNumEdges].m_uiSrc = 0;
-			S_edgeList[uiNumEdges].m_uiDest = 0;
+	vRoute_NodeTblRemove(uiDest);
 
-			//We found the edge so exit the loop
-			break;
-		}
+	//Move the last edge into the gap
+	uiEdge = (uint) ucEdge - 1;
+	uiLast = uiNumEdges - 1;
+	if (uiEdge != uiLast)
+	{
+		S_edgeList[uiEdge] = S_edgeList[uiLast];
+		S_RoutePeers[uiEdge] = S_RoutePeers[uiLast];
+		ucaRoute_NodeTbl[ucRoute_FindSlot(S_edgeList[uiLast].m_uiDest)] = ucEdge;
 	}
 
-	//Fail if the specified edge wasn't found in the graph
-	if (uiFoundEdge == 0)
-		return ROUTE_ERROR_DOES_NOT_EXIST;
+	for (uiIndex = 0; uiIndex < uiNumEdges; uiIndex++)
+		uiaRoute_NextHop[uiIndex] = 0;
+
+	// The edges moved under a subtree dump, start it over
+	if (ucRoute_ResyncState == ROUTE_RESYNC_SENDING)
+		ucRoute_ResyncState = ROUTE_RESYNC_START;
+
+	uiNumEdges--;
+	S_nextEdge--;
+	S_edgeList[uiNumEdges].m_uiSrc = 0;
+	S_edgeList[uiNumEdges].m_uiDest = 0;
+	uiaRoute_NextHop[uiNumEdges] = 0;
 
 	return (0);
 }
@@ -155,63 +383,69 @@ uchar ucRoute_RemoveEdge(uint uiSrc, uint uiDest)
 //! In the event that the destination address is a child of self then the function returns
 //! the self address.
 //!
+//! The first lookup of a node follows the parent pointers up to a child of
+//! this node (or to a node whose next hop is already known) and caches the
+//! result for every node on the way, after that a lookup is one table probe.
+//!
 //! \param uiDest
 //! \return uiSrc
 ////////////////////////////////////////////////////////////////////////////////
 uint uiRoute_GetNextHop(uint uiDest)
 {
-	int i, j;
-	S_Edge *S_ptr, *S_ptr2;
-	uint uiSrc;
+	uchar ucEdge;
+	uchar ucDestEdge;
+	uint uiNode;
+	uint uiHop;
+	uint uiDepth;
 
 	//Search for edge with the matching destination (if it exists)
-	for (i = 0, S_ptr = S_edgeList; i < uiNumEdges; i++, S_ptr++)
-	{
-		if (S_ptr->m_uiDest == uiDest)
-		{
-			// If the child is a direct child of this node then return the destination address
-			if(S_ptr->m_uiSrc == uiSelf)
-				return uiDest;
-
-			//If the src is not the self then save the parent (source) of the edge
-			uiSrc = S_ptr->m_uiSrc;
-			break;
-		}
-	}
-
-	//Fail if there isn't an edge with a matching destination
-	if (i == uiNumEdges)
+	ucDestEdge = ucRoute_FindEdge(uiDest);
+	if (ucDestEdge == 0)
 		return 0; //Error - 0 is an invalid address
 
-//TODO: add in some logic to prevent infinite loops (circular graph connections) in the while loop below
+	if (uiaRoute_NextHop[ucDestEdge - 1] != 0)
+		return uiaRoute_NextHop[ucDestEdge - 1];
 
 	//Backtrack the src node address to one of the child nodes of this address
-	while (1)
+	uiNode = uiDest;
+	ucEdge = ucDestEdge;
+	for (uiDepth = 0; ; uiDepth++)
 	{
-		//Look through each edge
-		for (j = 0, S_ptr2 = S_edgeList; j < uiNumEdges; j++, S_ptr2++)
+		//Circular graph connections never reach this node
+		if (uiDepth >= uiNumEdges)
+			return 0;
+
+		//If the current edge leads from this node then its destination is the next hop
+		if (S_edgeList[ucEdge - 1].m_uiSrc == uiSelf)
 		{
-			//If the current edge leads to src then src is a child of this node (and therefore it is the next hop)
-			if (S_ptr2->m_uiDest == uiSrc && S_ptr2->m_uiSrc == uiSelf)
-			{
-				return uiSrc;
-			}
+			uiHop = uiNode;
+			break;
+		}
 
-			//Otherwise continue backtracking from src
-			else if (S_ptr2->m_uiDest == uiSrc)
-			{
-				uiSrc = S_ptr2->m_uiSrc;
-				break;
-			}
+		//Otherwise continue backtracking from src, fail if the src is unknown
+		uiNode = S_edgeList[ucEdge - 1].m_uiSrc;
+		ucEdge = ucRoute_FindEdge(uiNode);
+		if (ucEdge == 0)
+			return 0;
+
+		if (uiaRoute_NextHop[ucEdge - 1] != 0)
+		{
+			uiHop = uiaRoute_NextHop[ucEdge - 1];
+			break;
 		}
+	}
 
-		//If the backtracking failed then return fail
-		if (j == uiNumEdges)
+	//Cache the next hop of every node on the way up
+	ucEdge = ucDestEdge;
+	while (uiaRoute_NextHop[ucEdge - 1] == 0)
+	{
+		uiaRoute_NextHop[ucEdge - 1] = uiHop;
+		if (S_edgeList[ucEdge - 1].m_uiSrc == uiSelf)
 			break;
+		ucEdge = ucRoute_FindEdge(S_edgeList[ucEdge - 1].m_uiSrc);
 	}
 
-	//Fail because the next hop wasn't found
-	return 0; //Error - 0 is an invalid address
+	return uiHop;
 }
 
 /////////////////////////////////////////////////////////////////////////////////
@@ -242,293 +476,750 @@ uchar ucRoute_NodeJoin(uint uiParent, uint uiChild, S_Edge* S_edges, int iNumEdg
 }
 
 
+//! \def ROUTE_MARK_KEEP
+//! \def ROUTE_MARK_DROP
+//! \brief Marks used by vRoute_MarkEdges(), 0 is not marked yet
+#define ROUTE_MARK_KEEP		1
+#define ROUTE_MARK_DROP		2
+
 /////////////////////////////////////////////////////////////////////////////////
 //!
-//! \brief Unjoin the specified node (and therefore all of its descendants) from the edge list
+//! \brief Marks every edge with the mark of the first marked edge above it
 //!
+//! Each edge follows its parent pointers until they reach a marked edge,
+//! this node or leave the list, then every edge on the way gets the same
+//! mark.  Edges reaching this node are kept.
+//!
+//! \param ucaMark, one per edge, the marks set so far; ucLost, the mark of
+//! edges whose parent pointers leave the list
+//! \return none
+////////////////////////////////////////////////////////////////////////////////
+static void vRoute_MarkEdges(uchar *ucaMark, uchar ucLost)
+{
+	uchar ucEdge;
+	uchar ucMark;
+	uint uiIndex;
+	uint uiDepth;
+
+	for (uiIndex = 0; uiIndex < uiNumEdges; uiIndex++)
+	{
+		//Walk up until the answer is known
+		ucEdge = (uchar) (uiIndex + 1);
+		ucMark = ucLost;
+		for (uiDepth = 0; uiDepth < uiNumEdges; uiDepth++)
+		{
+			if (ucaMark[ucEdge - 1] != 0)
+			{
+				ucMark = ucaMark[ucEdge - 1];
+				break;
+			}
+			if (S_edgeList[ucEdge - 1].m_uiSrc == uiSelf)
+			{
+				ucMark = ROUTE_MARK_KEEP;
+				break;
+			}
+			ucEdge = ucRoute_FindEdge(S_edgeList[ucEdge - 1].m_uiSrc);
+			if (ucEdge == 0)
+				break;
+		}
+
+		//Walk up again and mark the edges on the way
+		ucEdge = (uchar) (uiIndex + 1);
+		for (uiDepth = 0; (uiDepth < uiNumEdges) && (ucEdge != 0) && (ucaMark[ucEdge - 1] == 0); uiDepth++)
+		{
+			ucaMark[ucEdge - 1] = ucMark;
+			ucEdge = ucRoute_FindEdge(S_edgeList[ucEdge - 1].m_uiSrc);
+		}
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+//!
+//! \brief Squeezes the edges marked ROUTE_MARK_DROP out of the list in one pass
+//!
+//! \param ucaMark, one per edge
+//! \return none
+////////////////////////////////////////////////////////////////////////////////
+static void vRoute_DropMarked(uchar *ucaMark)
+{
+	uint uiIndex;
+	uint uiKeep;
+
+	//The cached next hops move with their edges
+	uiKeep = 0;
+	for (uiIndex = 0; uiIndex < uiNumEdges; uiIndex++)
+	{
+		if (ucaMark[uiIndex] == ROUTE_MARK_DROP)
+			continue;
+
+		S_edgeList[uiKeep] = S_edgeList[uiIndex];
+		uiaRoute_NextHop[uiKeep] = uiaRoute_NextHop[uiIndex];
+		S_RoutePeers[uiKeep] = S_RoutePeers[uiIndex];
+		uiKeep++;
+	}
+
+	for (uiIndex = uiKeep; uiIndex < uiNumEdges; uiIndex++)
+	{
+		S_edgeList[uiIndex].m_uiSrc = 0;
+		S_edgeList[uiIndex].m_uiDest = 0;
+		uiaRoute_NextHop[uiIndex] = 0;
+	}
+
+	uiNumEdges = uiKeep;
+	S_nextEdge = &S_edgeList[uiNumEdges];
+	vRoute_NodeTblRebuild();
+
+	// The edges moved under a subtree dump, start it over
+	if (ucRoute_ResyncState == ROUTE_RESYNC_SENDING)
+		ucRoute_ResyncState = ROUTE_RESYNC_START;
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+//!
+//! \brief Unjoin the specified node (and therefore all of its descendants) from the edge list
 //!
 //! \param uiChild
 //! \return 0
 ////////////////////////////////////////////////////////////////////////////////
 uchar ucRoute_NodeUnjoin(uint uiChild)
 {
-	int i;
-	S_Edge *S_ptr;
-	uint uiTmp;
-	uchar ucRet;
-
-	//Allocate a remove stack on the system stack
-	uint removeStack[MAX_NODES];
-	int iStackSize = 0;
+	uchar ucaMark[MAX_EDGES];
+	uchar ucChildEdge;
+	uint uiIndex;
 
 	//Fail if there are no edges to remove
 	if (uiNumEdges == 0)
 		return ROUTE_ERROR_TABLE_EMPTY;
 
-	//Find the node that is being unjoined and then:
-	//   1 - remove the edge that connects the unjoining node
-	//   2 - add the node to the remove stack so that its descendants will also be removed below
-	for (i = 0, S_ptr = S_edgeList; i < uiNumEdges; i++, S_ptr++)
-	{
-		//Remove the edge that connects the unjoining node (return on any error)
-		if (S_ptr->m_uiDest == uiChild)
-		{
-			// Add the unjoining node to the edge list and set the drop flag
-			S_RtUpdate.m_ucaEdges[S_RtUpdate.ucIndex].m_uiSrc = S_ptr->m_uiSrc;
-			S_RtUpdate.m_ucaEdges[S_RtUpdate.ucIndex].m_uiDest = S_ptr->m_uiDest;
-			S_RtUpdate.m_ucaFlags[S_RtUpdate.ucIndex] = F_DROP;
-			if(S_RtUpdate.ucIndex<(MAX_UPDATES-1))
-				S_RtUpdate.ucIndex++;
-
-			ucRet = ucRoute_RemoveEdge(S_ptr->m_uiSrc, S_ptr->m_uiDest);
-			if(ucRet)
-				return ucRet;
-
-			//Add the unjoining node to the remove stack and exit the loop
-			removeStack[iStackSize++] = uiChild;
-			break;
-		}
-	}
-
-	//While there are nodes to remove from the edge list...
-	while (iStackSize > 0)
-	{
-		//Pop the next node to be removed off of the remove stack
-		uiTmp = removeStack[--iStackSize];
+	//Find the node that is being unjoined, nothing to do if it isn't there
+	ucChildEdge = ucRoute_FindEdge(uiChild);
+	if (ucChildEdge == 0)
+		return (0);
 
-		//Look through the edge list for the all edges originating at node that is being removed
-		for (i = 0, S_ptr = S_edgeList; i < uiNumEdges; )
-		{
-			//If this edge originates at the node being removed then...
-			if (S_ptr->m_uiSrc == uiTmp)
-			{
-				//Push the destination node of the edge to the remove stack so it will also be removed
-				removeStack[iStackSize++] = S_ptr->m_uiDest;
+	// Add the unjoining node to the edge list and set the drop flag
+	vRoute_PushUpdate(S_edgeList[ucChildEdge - 1].m_uiSrc, uiChild, F_DROP);
 
-				//Remove this edge from the edge list (return any error)
-				ucRet = ucRoute_RemoveEdge(S_ptr->m_uiSrc, S_ptr->m_uiDest);
-				if (ucRet)
-					return ucRet;
-			}
+	//Mark every edge as being in the subtree of the unjoining node or not
+	for (uiIndex = 0; uiIndex < uiNumEdges; uiIndex++)
+		ucaMark[uiIndex] = 0;
+	ucaMark[ucChildEdge - 1] = ROUTE_MARK_DROP;
+	vRoute_MarkEdges(ucaMark, ROUTE_MARK_KEEP);
 
-			//Only increment these variables on iterations where an edge wasn't removed, since
-			//that shifts the proceeding edge back to the current index and decrements uiNumEdges
-			else
-			{
-				 i++;
-				 S_ptr++;
-			}
-		}
-	}
+	vRoute_DropMarked(ucaMark);
 
 	return (0);
 }
 
 /////////////////////////////////////////////////////////////////////////////////
 //!
-//! \brief Returns either the number of added or dropped
+//! \brief Drops the edges that have no way up to this node
+//!
+//! Such edges are left behind when the edge above them never arrived, for
+//! instance when the first part of a subtree dump was applied and the dump
+//! started over.  The root of each dropped subtree goes in the update list.
 //!
-//! \param ucIndex
-//! \return ucCount, the number of update records
+//! \param none
+//! \return 1 if edges were dropped, 0 otherwise
 ////////////////////////////////////////////////////////////////////////////////
-uchar ucRoute_GetUpdateCount(uchar ucAddOrDrop)
+static uchar ucRoute_DropOrphans(void)
 {
-	uchar ucCount;
-	uchar ucIndex;
+	uchar ucaMark[MAX_EDGES];
+	uchar ucDropped;
+	uint uiIndex;
 
-	// Start at zero
-	ucCount = 0;
+	for (uiIndex = 0; uiIndex < uiNumEdges; uiIndex++)
+		ucaMark[uiIndex] = 0;
+	vRoute_MarkEdges(ucaMark, ROUTE_MARK_DROP);
 
-	for (ucIndex = 0; ucIndex < S_RtUpdate.ucIndex; ucIndex++)
+	ucDropped = 0;
+	for (uiIndex = 0; uiIndex < uiNumEdges; uiIndex++)
 	{
-		if (S_RtUpdate.m_ucaFlags[ucIndex] & ucAddOrDrop)
-			ucCount++;
+		if (ucaMark[uiIndex] != ROUTE_MARK_DROP)
+			continue;
+
+		if (ucRoute_FindEdge(S_edgeList[uiIndex].m_uiSrc) == 0)
+			vRoute_PushUpdate(S_edgeList[uiIndex].m_uiSrc, S_edgeList[uiIndex].m_uiDest, F_DROP);
+		ucDropped = 1;
 	}
 
-	// Return
-	return ucCount;
+	if (ucDropped)
+		vRoute_DropMarked(ucaMark);
+
+	return ucDropped;
 }
 
+//! \def ROUTE_VARINT_MAX
+//! \brief Most bytes a varint node address can take
+#define ROUTE_VARINT_MAX	3
+
+//! \def ROUTE_TX_UPDATES
+//! \def ROUTE_TX_RESYNC
+//! \brief What the LRQ waiting for an ACK carries, 0 is no updates
+#define ROUTE_TX_UPDATES	1
+#define ROUTE_TX_RESYNC		2
+
 /////////////////////////////////////////////////////////////////////////////////
 //!
-//! \brief Returns either the number of added or dropped
+//! \brief Writes a node address as a varint
 //!
-//! \param ucIndex
-//! \return S_edgeList[ucIndex].m_uiSrc
+//! \param ucaPut, where to write; uiVal, the address
+//! \return the byte after the varint
 ////////////////////////////////////////////////////////////////////////////////
-uchar ucRoute_GetUpdateCountBytes(uchar ucAddOrDrop)
+static volatile uchar *ucaRoute_PutVarint(volatile uchar *ucaPut, uint uiVal)
 {
-	uchar ucJoinVal;
-	uchar ucDropVal;
-	uchar ucRetVal;
-
-	ucRetVal = 0;
-
-	if (ucAddOrDrop & F_JOIN)
+	while (uiVal >= 0x80)
 	{
-		ucJoinVal = ucRoute_GetUpdateCount(F_JOIN);
-		ucJoinVal *= 4;
-		ucRetVal += ucJoinVal;
+		*ucaPut++ = (uchar) (uiVal | 0x80);
+		uiVal >>= 7;
 	}
-	if (ucAddOrDrop & F_DROP)
+	*ucaPut++ = (uchar) uiVal;
+
+	return ucaPut;
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+//!
+//! \brief Reads a varint node address
+//!
+//! \param ucaGet, read pointer which is advanced; ucaEnd, end of the updates; uiVal, the address
+//! \return 1 if read, 0 if the varint runs past the end
+////////////////////////////////////////////////////////////////////////////////
+static uchar ucRoute_GetVarint(volatile uchar **ucaGet, volatile uchar *ucaEnd, uint *uiVal)
+{
+	uint uiNode;
+	uchar ucShift;
+	uchar ucByte;
+
+	uiNode = 0;
+	ucShift = 0;
+	do
 	{
-		ucDropVal = ucRoute_GetUpdateCount(F_DROP);
-		ucDropVal *= 2;
-		ucRetVal += ucDropVal;
-	}
+		if (*ucaGet >= ucaEnd || ucShift > 14)
+			return 0;
+		ucByte = *(*ucaGet)++;
+		uiNode |= (uint) (ucByte & 0x7F) << ucShift;
+		ucShift += 7;
+	} while (ucByte & 0x80);
+
+	*uiVal = uiNode & 0xFFFF;
+	return 1;
+}
 
-	return ucRetVal;
+/////////////////////////////////////////////////////////////////////////////////
+//!
+//! \brief Zig-zag codes the difference between two addresses
+//!
+//! Small steps either way give small values, -1 is 1, 1 is 2 and so on.
+//!
+//! \param uiFrom, uiTo
+//! \return the coded difference
+////////////////////////////////////////////////////////////////////////////////
+static uint uiRoute_ZigZag(uint uiFrom, uint uiTo)
+{
+	uint uiDiff;
+
+	uiDiff = (uiTo - uiFrom) & 0xFFFF;
+	if (uiDiff & 0x8000)
+		return ((uiDiff << 1) ^ 0xFFFF) & 0xFFFF;
+	return (uiDiff << 1) & 0xFFFF;
 }
 
 /////////////////////////////////////////////////////////////////////////////////
 //!
-//! \brief Loads the update table into a buffer, typically the message buffer.
+//! \brief Undoes uiRoute_ZigZag()
 //!
-//! This function first loads the joins then the drops.  The joins and drops are
-//! preceded by a byte indicating the length of the join or drop section.
+//! \param uiFrom, uiCode
+//! \return the address
+////////////////////////////////////////////////////////////////////////////////
+static uint uiRoute_UnZigZag(uint uiFrom, uint uiCode)
+{
+	uint uiDiff;
+
+	uiDiff = uiCode >> 1;
+	if (uiCode & 1)
+		uiDiff ^= 0xFFFF;
+	return (uiFrom + uiDiff) & 0xFFFF;
+}
+
+/////////////////////////////////////////////////////////////////////////////////
 //!
+//! \brief Asks for the whole subtree to be sent to the parent
 //!
-//! \param *ucaBuff, the message buffer; ucSpaceAvail, space in bytes,
+//! Called when the parent sets ROUTE_RTR_RESYNC in the RTR or when the
+//! update list overflowed.
+//!
+//! \param none
 //! \return none
 ////////////////////////////////////////////////////////////////////////////////
-void vRoute_GetUpdates(volatile uchar *ucaBuff, uchar ucSpaceAvail)
+void vRoute_RequestResync(void)
 {
-	uchar ucRtCount;
-	uchar ucJoinCount;
-	uchar ucDropCount;
-	uint uiNewSrcNodeId;
-	uint uiNewDestNodeId;
-
-	// Get join count
-	ucJoinCount = ucRoute_GetUpdateCountBytes(F_JOIN);
-
-	// Fill join count field
-	if (ucJoinCount < ucSpaceAvail)
-		*ucaBuff++ = ucJoinCount;
-	else
-		*ucaBuff++ = ucSpaceAvail;
+	ucRoute_ResyncState = ROUTE_RESYNC_START;
+}
 
-	// If there are no joins then don't bother iterating through the list
-	if (ucJoinCount != 0)
+/////////////////////////////////////////////////////////////////////////////////
+//!
+//! \brief Loads the routing updates into a buffer, typically the message buffer.
+//!
+//! The format is described in comm.h (RouteUpdates).  A pending subtree dump
+//! goes first, one JOIN record per run of edges with the same parent, then
+//! the update list in order.  Consecutive joins under the same parent and
+//! consecutive drops share a record.  Everything written is flagged and
+//! removed by vRouteClrFlaggedUpdates() once the parent acknowledges it.
+//!
+//! Until then the same LRQ is sent again unchanged under the same sequence
+//! number, so the parent can skip a repeat and loses nothing if the child
+//! takes a message meant for someone else as the ACK.  A dump that started
+//! over goes out under a new sequence number.
+//!
+//! \param *ucaBuff, the message buffer; ucSpaceAvail, space in bytes,
+//! \return bytes written, at least 1
+////////////////////////////////////////////////////////////////////////////////
+uchar ucRoute_GetUpdates(volatile uchar *ucaBuff, uchar ucSpaceAvail)
+{
+	volatile uchar *ucaPut;
+	volatile uchar *ucaEnd;
+	volatile uchar *ucaHdr;
+	uchar ucIndex;
+	uchar ucListEnd;
+	uchar ucFlag;
+	uchar ucCount;
+	uchar ucMarker;
+	uint uiEdge;
+	uint uiDumpEnd;
+	uint uiParent;
+	uint uiPrev;
+
+	// Repeat the unacknowledged LRQ unless the dump started over
+	ucRoute_TxLegacy = 0;
+	ucMarker = 0;
+	ucListEnd = S_RtUpdate.ucIndex;
+	uiDumpEnd = uiNumEdges;
+	if (ucRoute_TxPending != 0)
 	{
-		// Fill join edge list
-		for (ucRtCount = 0; ucRtCount < S_RtUpdate.ucIndex; ucRtCount++)
+		if (ucRoute_ResyncState == ROUTE_RESYNC_START)
 		{
-			if (S_RtUpdate.m_ucaFlags[ucRtCount] & F_JOIN)
-			{
-				// Get the src and dest node addresses from the edge list
-				uiNewSrcNodeId = S_RtUpdate.m_ucaEdges[ucRtCount].m_uiSrc;
-				uiNewDestNodeId = S_RtUpdate.m_ucaEdges[ucRtCount].m_uiDest;
-
-				// Flag the element for deletion
-				S_RtUpdate.m_ucaFlags[ucRtCount] |= F_DELETE;
-
-				// Add the addresses to the message
-				*ucaBuff++ = (uchar) (uiNewSrcNodeId >> 8);
-				*ucaBuff++ = (uchar) uiNewSrcNodeId;
-				*ucaBuff++ = (uchar) (uiNewDestNodeId >> 8);
-				*ucaBuff++ = (uchar) uiNewDestNodeId;
-
-				// Decrement the available space by the length of 2 addresses
-				ucSpaceAvail -= 4;
-
-				// If there isn't enough room for the next join edge then break out
-				if (ucSpaceAvail < 4)
-					break;
-			} //END if(F_JOIN)
-		}//END: for(ucRtCount)
-	}//END: if(ucJoinCount)
-
-	// Get drop count
-	ucDropCount = ucRoute_GetUpdateCountBytes(F_DROP);
-
-	// Only append drops if there are any and if there is enough room for the length and one address
-	if (ucDropCount != 0 && ucSpaceAvail > 3)
-	{
-		// Fill drop count field
-		if (ucDropCount < ucSpaceAvail)
-			*ucaBuff++ = ucDropCount;
+			ucRoute_TxSeq++;
+		}
 		else
-			*ucaBuff++ = ucSpaceAvail;
+		{
+			if (ucRoute_TxPending == ROUTE_TX_RESYNC)
+				ucMarker = 1;
+			ucListEnd = ucRoute_TxListCount;
+			if (uiRoute_ResyncSent < uiDumpEnd)
+				uiDumpEnd = uiRoute_ResyncSent;
+		}
+	}
+	ucRoute_TxPending = 0;
+
+	// Nothing has been sent yet
+	for (ucIndex = 0; ucIndex < S_RtUpdate.ucIndex; ucIndex++)
+		S_RtUpdate.m_ucaFlags[ucIndex] &= ~F_DELETE;
+
+	ucaBuff[0] = 0;
+	if (ucSpaceAvail < 4)
+		return 1;
+
+	ucaEnd = ucaBuff + ucSpaceAvail;
+	ucaPut = ucaBuff + 1;
+	*ucaPut++ = ucRoute_Epoch;
+	*ucaPut++ = ucRoute_TxSeq;
+
+	if (ucRoute_ResyncState != 0)
+	{
+		// The dump holds everything in the update list
+		if (ucRoute_ResyncState == ROUTE_RESYNC_START || ucMarker)
+		{
+			for (ucIndex = 0; ucIndex < ucListEnd; ucIndex++)
+				S_RtUpdate.m_ucaFlags[ucIndex] |= F_DELETE;
+
+			*ucaPut++ = ROUTE_REC_RESYNC;
+			uiRoute_ResyncNext = 0;
+			ucRoute_ResyncState = ROUTE_RESYNC_SENDING;
+			ucRoute_TxPending = ROUTE_TX_RESYNC;
+		}
 
-		// Fill drop node addresses
-		for (ucRtCount = 0; ucRtCount < S_RtUpdate.ucIndex; ucRtCount++)
+		uiEdge = uiRoute_ResyncNext;
+		while (uiEdge < uiDumpEnd && (ucaEnd - ucaPut) >= (1 + 2 * ROUTE_VARINT_MAX))
 		{
-			// For drops we only load the source node.  No point in transmitting the destination
-			if (S_RtUpdate.m_ucaFlags[ucRtCount] & F_DROP)
+			ucaHdr = ucaPut++;
+			uiParent = S_edgeList[uiEdge].m_uiSrc;
+			ucaPut = ucaRoute_PutVarint(ucaPut, uiParent);
+			uiPrev = uiParent;
+
+			ucCount = 0;
+			while (uiEdge < uiDumpEnd && S_edgeList[uiEdge].m_uiSrc == uiParent && ucCount < ROUTE_REC_COUNT_MASK
+					&& (ucaEnd - ucaPut) >= ROUTE_VARINT_MAX)
 			{
-				// Get the src and dest node addresses from the edge list
-				uiNewDestNodeId = S_RtUpdate.m_ucaEdges[ucRtCount].m_uiDest;
+				ucaPut = ucaRoute_PutVarint(ucaPut, uiRoute_ZigZag(uiPrev, S_edgeList[uiEdge].m_uiDest));
+				uiPrev = S_edgeList[uiEdge].m_uiDest;
+				ucCount++;
+				uiEdge++;
+			}
+			*ucaHdr = ROUTE_REC_JOIN | ucCount;
+		}
+		uiRoute_ResyncSent = uiEdge;
+	}
 
-				// Flag the element for deletion
-				S_RtUpdate.m_ucaFlags[ucRtCount] |= F_DELETE;
+	// Skip the updates the dump already holds
+	ucIndex = 0;
+	while (ucIndex < ucListEnd && (S_RtUpdate.m_ucaFlags[ucIndex] & F_DELETE))
+		ucIndex++;
 
-				// Add the addresses to the message
-				*ucaBuff++ = (uchar) (uiNewDestNodeId >> 8);
-				*ucaBuff++ = (uchar) uiNewDestNodeId;
+	while (ucIndex < ucListEnd && (ucaEnd - ucaPut) >= (1 + 2 * ROUTE_VARINT_MAX))
+	{
+		ucaHdr = ucaPut++;
+		ucFlag = S_RtUpdate.m_ucaFlags[ucIndex] & (F_JOIN | F_DROP);
+		ucCount = 0;
+
+		if (ucFlag == F_JOIN)
+		{
+			// The parent, then its children
+			*ucaHdr = ROUTE_REC_JOIN;
+			uiParent = S_RtUpdate.m_ucaEdges[ucIndex].m_uiSrc;
+			ucaPut = ucaRoute_PutVarint(ucaPut, uiParent);
+			uiPrev = uiParent;
+		}
+		else
+		{
+			// Only the root of a dropped subtree is sent
+			*ucaHdr = ROUTE_REC_DROP;
+			uiParent = 0;
+			uiPrev = S_RtUpdate.m_ucaEdges[ucIndex].m_uiDest;
+			ucaPut = ucaRoute_PutVarint(ucaPut, uiPrev);
+			S_RtUpdate.m_ucaFlags[ucIndex] |= F_DELETE;
+			ucCount++;
+			ucIndex++;
+		}
 
-				ucSpaceAvail -= 2;
-			// If there isn't enough room for the drop edge then break out
-			if (ucSpaceAvail < 2)
+		while (ucIndex < ucListEnd && (S_RtUpdate.m_ucaFlags[ucIndex] & (F_JOIN | F_DROP)) == ucFlag
+				&& ucCount < ROUTE_REC_COUNT_MASK && (ucaEnd - ucaPut) >= ROUTE_VARINT_MAX)
+		{
+			if (ucFlag == F_JOIN && S_RtUpdate.m_ucaEdges[ucIndex].m_uiSrc != uiParent)
 				break;
 
-			} // END: if(F_DROP)
-		} // END: for(ucRtCount)
-	} // END: if( ucDropCount && ucSpaceAvail)
+			ucaPut = ucaRoute_PutVarint(ucaPut, uiRoute_ZigZag(uiPrev, S_RtUpdate.m_ucaEdges[ucIndex].m_uiDest));
+			uiPrev = S_RtUpdate.m_ucaEdges[ucIndex].m_uiDest;
+			S_RtUpdate.m_ucaFlags[ucIndex] |= F_DELETE;
+			ucCount++;
+			ucIndex++;
+		}
+		*ucaHdr |= ucCount;
+	}
+
+	// No updates, send the sequence number of the last one so the parent sees if it missed it
+	if ((ucaPut - ucaBuff) == 3)
+	{
+		ucaBuff[0] = 2;
+		ucaBuff[2] = (uchar) (ucRoute_TxSeq - 1);
+		return 3;
+	}
+
+	ucRoute_TxListCount = ucIndex;
+	if (ucRoute_TxPending == 0)
+		ucRoute_TxPending = ROUTE_TX_UPDATES;
+	ucaBuff[0] = (uchar) (ucaPut - ucaBuff - 1);
 
-}//END: vRoute_GetUpdates();
+	return (uchar) (ucaPut - ucaBuff);
 
+}//END: ucRoute_GetUpdates();
 
 /////////////////////////////////////////////////////////////////////////////////
 //!
-//! \brief Loads the update table into a buffer, typically the message buffer.
+//! \brief Loads the routing updates in the encoding of parents without RouteUpdates
 //!
-//! This function first loads the joins then the drops.  The joins and drops are
-//! preceded by a byte indicating the length of the join or drop section.
+//! Parents that send no OPMSG_IDX_ROUTE byte in the RTR read the updates as
 //!
+//!		[join bytes][src hi][src lo][dest hi][dest lo]...[drop bytes][dest hi][dest lo]...
+//!
+//! and apply the joins before the drops, so an LRQ takes the joins at the
+//! head of the update list and the drops right behind them.  There is no
+//! sequence number or subtree dump, updates lost to a full list stay lost
+//! for such a parent.  Everything written is flagged and removed by
+//! vRouteClrFlaggedUpdates() once the parent acknowledges it.
 //!
 //! \param *ucaBuff, the message buffer; ucSpaceAvail, space in bytes,
-//! \return none
+//! \return bytes written, at least 2
 ////////////////////////////////////////////////////////////////////////////////
-void vRoute_SetUpdates(volatile uchar *ucaBuff)
+uchar ucRoute_GetLegacyUpdates(volatile uchar *ucaBuff, uchar ucSpaceAvail)
 {
-	S_Edge S_EdgeLocal[MAX_UPDATES];
-	uchar ucJoins;
-	uchar ucDrops;
-	uint uiDropAddr;
-	uchar ucCount;
+	volatile uchar *ucaPut;
+	volatile uchar *ucaEnd;
+	volatile uchar *ucaDropLen;
+	uchar ucIndex;
+	uint uiNode;
+
+	// Nothing is waiting under a sequence number, a new parent resyncs anyway
+	ucRoute_TxLegacy = 1;
+	ucRoute_TxPending = 0;
 
-	// Convert the join field from length for the following loop
-	ucJoins = (*ucaBuff++)/4;
+	// Nothing has been sent yet
+	for (ucIndex = 0; ucIndex < S_RtUpdate.ucIndex; ucIndex++)
+		S_RtUpdate.m_ucaFlags[ucIndex] &= ~F_DELETE;
 
-	for(ucCount = 0; ucCount < ucJoins; ucCount++)
+	ucaBuff[0] = 0;
+	ucaBuff[1] = 0;
+	if (ucSpaceAvail < 2)
+		return 2;
+
+	ucaEnd = ucaBuff + ucSpaceAvail;
+	ucaPut = ucaBuff + 1;
+
+	// Joins first, leaving room for the drop length
+	ucIndex = 0;
+	while (ucIndex < S_RtUpdate.ucIndex && (S_RtUpdate.m_ucaFlags[ucIndex] & F_JOIN) && (ucaEnd - ucaPut) >= 5)
 	{
-		S_EdgeLocal[ucCount].m_uiSrc = (uint) (*ucaBuff++<<8);
-		S_EdgeLocal[ucCount].m_uiSrc |= (uint) (*ucaBuff++);
-		S_EdgeLocal[ucCount].m_uiDest = (uint) (*ucaBuff++<<8);
-		S_EdgeLocal[ucCount].m_uiDest |= (uint) (*ucaBuff++);
+		uiNode = S_RtUpdate.m_ucaEdges[ucIndex].m_uiSrc;
+		*ucaPut++ = (uchar) (uiNode >> 8);
+		*ucaPut++ = (uchar) uiNode;
+		uiNode = S_RtUpdate.m_ucaEdges[ucIndex].m_uiDest;
+		*ucaPut++ = (uchar) (uiNode >> 8);
+		*ucaPut++ = (uchar) uiNode;
+		S_RtUpdate.m_ucaFlags[ucIndex] |= F_DELETE;
+		ucIndex++;
+	}
+	ucaBuff[0] = (uchar) (ucaPut - ucaBuff - 1);
 
-		ucRoute_AddEdge(S_EdgeLocal[ucCount].m_uiSrc, S_EdgeLocal[ucCount].m_uiDest);
+	// Then the drops behind them, a join after a drop waits for the next LRQ
+	ucaDropLen = ucaPut++;
+	while (ucIndex < S_RtUpdate.ucIndex && (S_RtUpdate.m_ucaFlags[ucIndex] & F_DROP) && (ucaEnd - ucaPut) >= 2)
+	{
+		uiNode = S_RtUpdate.m_ucaEdges[ucIndex].m_uiDest;
+		*ucaPut++ = (uchar) (uiNode >> 8);
+		*ucaPut++ = (uchar) uiNode;
+		S_RtUpdate.m_ucaFlags[ucIndex] |= F_DELETE;
+		ucIndex++;
+	}
+	*ucaDropLen = (uchar) (ucaPut - ucaDropLen - 1);
 
+	return (uchar) (ucaPut - ucaBuff);
+
+}//END: ucRoute_GetLegacyUpdates();
+
+/////////////////////////////////////////////////////////////////////////////////
+//!
+//! \brief Tells if there are updates that did not fit in the last LRQ
+//!
+//! \param none
+//! \return 1 if there are more updates to send, 0 otherwise
+////////////////////////////////////////////////////////////////////////////////
+uchar ucRoute_UpdatesLeft(void)
+{
+	uchar ucIndex;
+
+	// Older parents take no subtree dump
+	if (!ucRoute_TxLegacy)
+	{
+		if (ucRoute_ResyncState == ROUTE_RESYNC_START)
+			return 1;
+		if (ucRoute_ResyncState == ROUTE_RESYNC_SENDING && uiRoute_ResyncSent < uiNumEdges)
+			return 1;
+	}
+
+	for (ucIndex = 0; ucIndex < S_RtUpdate.ucIndex; ucIndex++)
+	{
+		if (!(S_RtUpdate.m_ucaFlags[ucIndex] & F_DELETE))
+			return 1;
+	}
+
+	return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+//!
+//! \brief Applies the routing updates a child sent in its LRQ
+//!
+//! Updates from a child that is not synced or that missed one are ignored
+//! until it sends its whole subtree, ucRoute_NeedResync() tells the RTR to
+//! ask for it.  A repeated sequence number is an LRQ whose ACK the child
+//! missed and is skipped.
+//!
+//! \param uiChild, sender; *ucaBuff, the updates; ucBuffLen, bytes in the buffer
+//! \return none
+////////////////////////////////////////////////////////////////////////////////
+void vRoute_SetUpdates(uint uiChild, volatile uchar *ucaBuff, uchar ucBuffLen)
+{
+	volatile uchar *ucaGet;
+	volatile uchar *ucaEnd;
+	S_RoutePeer *S_Peer;
+	uchar ucEdge;
+	uchar ucEpoch;
+	uchar ucSeq;
+	uchar ucHdr;
+	uchar ucCount;
+	uint uiParent;
+	uint uiNode;
+	uint uiCode;
+	uint uiEdge;
+
+	// Check the length
+	if (ucBuffLen < 3 || ucaBuff[0] < 2 || ucaBuff[0] >= ucBuffLen)
+		return;
+
+	// Only direct children send updates
+	ucEdge = ucRoute_FindEdge(uiChild);
+	if (ucEdge == 0 || S_edgeList[ucEdge - 1].m_uiSrc != uiSelf)
+		return;
+
+	ucaEnd = ucaBuff + 1 + ucaBuff[0];
+	ucEpoch = ucaBuff[1];
+	ucSeq = ucaBuff[2];
+	ucaGet = ucaBuff + 3;
+
+	if (ucaGet < ucaEnd && *ucaGet == ROUTE_REC_RESYNC)
+	{
+		// Replace the subtree of the child with the one that follows
+		ucaGet++;
+		ucRoute_NodeUnjoin(uiChild);
+
+		// Edges left without a way up may have been in it, any child can own them so all send their subtree
+		if (ucRoute_DropOrphans())
+		{
+			for (uiEdge = 0; uiEdge < uiNumEdges; uiEdge++)
+			{
+				if (S_edgeList[uiEdge].m_uiSrc == uiSelf)
+					S_RoutePeers[uiEdge].m_ucFlags |= ROUTE_PEER_RESYNC;
+			}
+		}
+		ucRoute_AddEdge(uiSelf, uiChild);
+		ucEdge = ucRoute_FindEdge(uiChild);
+		if (ucEdge == 0)
+			return;
+		S_RoutePeers[ucEdge - 1].m_ucFlags = ROUTE_PEER_SYNCED;
 	}
+	else
+	{
+		S_Peer = &S_RoutePeers[ucEdge - 1];
+		if (S_Peer->m_ucFlags != ROUTE_PEER_SYNCED)
+			return;
 
+		// Already applied
+		if (ucEpoch == S_Peer->m_ucEpoch && ucSeq == S_Peer->m_ucSeq)
+			return;
 
-	// Get the number of drops in terms of nodes instead of bytes
-	ucDrops = (*ucaBuff++)/2;
+		// Updates come with the next sequence number, no updates with the last
+		if (ucEpoch != S_Peer->m_ucEpoch || ucaGet >= ucaEnd || ucSeq != (uchar) (S_Peer->m_ucSeq + 1))
+		{
+			S_Peer->m_ucFlags |= ROUTE_PEER_RESYNC;
+			vSERIAL_sout("Rt: Missed ", 11);
+			vSERIAL_HB16out(uiChild);
+			vSERIAL_crlf();
+			return;
+		}
+	}
+	S_RoutePeers[ucEdge - 1].m_ucEpoch = ucEpoch;
+	S_RoutePeers[ucEdge - 1].m_ucSeq = ucSeq;
 
-		for(ucCount = 0; ucCount < ucDrops; ucCount++)
+	while (ucaGet < ucaEnd)
+	{
+		ucHdr = *ucaGet++;
+		ucCount = ucHdr & ROUTE_REC_COUNT_MASK;
+		if (!ucRoute_GetVarint(&ucaGet, ucaEnd, &uiNode))
+			return;
+
+		switch (ucHdr & ROUTE_REC_TYPE_MASK)
 		{
-			uiDropAddr = (uint) (*ucaBuff++);
-			uiDropAddr = uiDropAddr << 8;
-			uiDropAddr |= (uint) (*ucaBuff++);
+			case ROUTE_REC_JOIN:
+				uiParent = uiNode;
+				while (ucCount-- > 0)
+				{
+					if (!ucRoute_GetVarint(&ucaGet, ucaEnd, &uiCode))
+						return;
+					uiNode = uiRoute_UnZigZag(uiNode, uiCode);
+					if (uiNode != uiSelf)
+						ucRoute_AddEdge(uiParent, uiNode);
+				}
+			break;
 
-			ucRoute_NodeUnjoin(uiDropAddr);
+			case ROUTE_REC_DROP:
+				if (ucCount == 0)
+					return;
+				ucRoute_NodeUnjoin(uiNode);
+				while (--ucCount > 0)
+				{
+					if (!ucRoute_GetVarint(&ucaGet, ucaEnd, &uiCode))
+						return;
+					uiNode = uiRoute_UnZigZag(uiNode, uiCode);
+					ucRoute_NodeUnjoin(uiNode);
+				}
+			break;
 
+			default:
+				return;
 		}
+	}
+
+}//END: vRoute_SetUpdates();
 
+/////////////////////////////////////////////////////////////////////////////////
+//!
+//! \brief Applies the routing updates of a child that does not use RouteUpdates
+//!
+//! The child sent the join/drop encoding described at
+//! ucRoute_GetLegacyUpdates(), the joins are applied before the drops.
+//!
+//! \param uiChild, sender; *ucaBuff, the updates; ucBuffLen, bytes in the buffer
+//! \return none
+////////////////////////////////////////////////////////////////////////////////
+void vRoute_SetLegacyUpdates(uint uiChild, volatile uchar *ucaBuff, uchar ucBuffLen)
+{
+	volatile uchar *ucaGet;
+	volatile uchar *ucaEnd;
+	uchar ucEdge;
+	uint uiSrc;
+	uint uiDest;
+
+	// Only direct children send updates
+	ucEdge = ucRoute_FindEdge(uiChild);
+	if (ucEdge == 0 || S_edgeList[ucEdge - 1].m_uiSrc != uiSelf)
+		return;
+
+	// Check the join length, the drop length follows the joins
+	if (ucBuffLen < 2 || (ucaBuff[0] + 2) > ucBuffLen)
+		return;
+
+	ucaGet = ucaBuff + 1;
+	ucaEnd = ucaGet + ucaBuff[0];
+	while ((ucaEnd - ucaGet) >= 4)
+	{
+		uiSrc = (uint) (ucaGet[0] << 8) | ucaGet[1];
+		uiDest = (uint) (ucaGet[2] << 8) | ucaGet[3];
+		ucaGet += 4;
+		if (uiDest != uiSelf)
+			ucRoute_AddEdge(uiSrc, uiDest);
+	}
+
+	ucaGet = ucaEnd + 1;
+	ucaEnd = ucaGet + *ucaEnd;
+	if (ucaEnd > (ucaBuff + ucBuffLen))
+		ucaEnd = ucaBuff + ucBuffLen;
+	while ((ucaEnd - ucaGet) >= 2)
+	{
+		uiDest = (uint) (ucaGet[0] << 8) | ucaGet[1];
+		ucaGet += 2;
+		ucRoute_NodeUnjoin(uiDest);
+	}
+
+}//END: vRoute_SetLegacyUpdates();
+
+/////////////////////////////////////////////////////////////////////////////////
+//!
+//! \brief Tells if the parent should ask a child for its whole subtree
+//!
+//! \param uiChild
+//! \return 1 if the child's updates can't be applied, 0 otherwise
+////////////////////////////////////////////////////////////////////////////////
+uchar ucRoute_NeedResync(uint uiChild)
+{
+	uchar ucEdge;
+
+	ucEdge = ucRoute_FindEdge(uiChild);
+	if (ucEdge == 0 || S_edgeList[ucEdge - 1].m_uiSrc != uiSelf)
+		return 1;
 
+	return (S_RoutePeers[ucEdge - 1].m_ucFlags != ROUTE_PEER_SYNCED);
 }
 
+
 ///////////////////////////////////////////////////////////////////////////////
 //!
 //! \brief Clears the joins update table
@@ -559,61 +1250,49 @@ void vRouteClrAllUpdates(void)
 //!
 //! \brief Clears flagged elements from the update table
 //!
+//! Called once the parent has the last LRQ.
+//!
 //! \param none
 //! \return none
 ///////////////////////////////////////////////////////////////////////////////
 void vRouteClrFlaggedUpdates(void)
 {
 	uchar ucIndex;
-	uchar ucTmpCount;
-	uchar ucTmpIndex;
-
-	ucTmpCount = 0;
+	uchar ucKeep;
 
-	// Iterate through the Join List
-	ucIndex = S_RtUpdate.ucIndex;
-
-	while(ucIndex > 0)
+	// Squeeze the flagged updates out of the list, keeping the order
+	ucKeep = 0;
+	for (ucIndex = 0; ucIndex < S_RtUpdate.ucIndex; ucIndex++)
 	{
-		ucIndex--;
-
-		// If the delete flag is set and the add or drop flag matches the passed parameter.
-	if((S_RtUpdate.m_ucaFlags[ucIndex] & F_DELETE))
-		{
-			// Clear flag and the contents of the element in question
-			S_RtUpdate.m_ucaFlags[ucIndex] = 0;
-			S_RtUpdate.m_ucaEdges[ucIndex].m_uiSrc = 0;
-			S_RtUpdate.m_ucaEdges[ucIndex].m_uiDest = 0;
-
-			// Decrement the update count
-			ucTmpCount++;
+		if (S_RtUpdate.m_ucaFlags[ucIndex] & F_DELETE)
+			continue;
 
-			// Store the empty location in a temp variable for the shifting algorithm
-			ucTmpIndex=ucIndex;
-		}
+		S_RtUpdate.m_ucaEdges[ucKeep] = S_RtUpdate.m_ucaEdges[ucIndex];
+		S_RtUpdate.m_ucaFlags[ucKeep] = S_RtUpdate.m_ucaFlags[ucIndex];
+		ucKeep++;
 	}
+	for (ucIndex = ucKeep; ucIndex < S_RtUpdate.ucIndex; ucIndex++)
+	{
+		S_RtUpdate.m_ucaEdges[ucIndex].m_uiSrc = 0;
+		S_RtUpdate.m_ucaEdges[ucIndex].m_uiDest = 0;
+		S_RtUpdate.m_ucaFlags[ucIndex] = 0;
+	}
+	S_RtUpdate.ucIndex = ucKeep;
 
-
-	if (ucTmpCount > 0)
+	// The parent has the last LRQ, move the sequence number and the dump on
+	if (ucRoute_TxPending != 0)
 	{
-		// Shift the contents of the array over
-		for (ucIndex = 0; ucIndex < S_RtUpdate.ucIndex; ucIndex++)
+		ucRoute_TxPending = 0;
+		ucRoute_TxSeq++;
+
+		if (ucRoute_ResyncState == ROUTE_RESYNC_SENDING)
 		{
-			if (S_RtUpdate.m_ucaEdges[ucIndex].m_uiDest != 0)
-			{
-				S_RtUpdate.m_ucaEdges[ucTmpIndex] = S_RtUpdate.m_ucaEdges[ucIndex];
-				S_RtUpdate.m_ucaFlags[ucTmpIndex] = S_RtUpdate.m_ucaFlags[ucIndex];
-				// Zero the last edge in the list to avoid duplicates
-				S_RtUpdate.m_ucaEdges[ucIndex].m_uiSrc = 0;
-				S_RtUpdate.m_ucaEdges[ucIndex].m_uiDest = 0;
-				S_RtUpdate.m_ucaFlags[ucIndex] = 0;
-				ucTmpIndex++;
-			}
+			uiRoute_ResyncNext = uiRoute_ResyncSent;
+			if (uiRoute_ResyncNext >= uiNumEdges)
+				ucRoute_ResyncState = 0;
 		}
 	}
 
-	S_RtUpdate.ucIndex -= ucTmpCount;
-
 }
 
 
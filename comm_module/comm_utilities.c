@@ -668,6 +668,31 @@ uchar ucComm_waitForMsgOrTimeout(unsigned char ucReadRSSI)
 
 }/* END: ucMSG_waitForMsgOrTimeout()*/
 
+/**********************  uiComm_reserveMsgSeqNums()  ***************************
+ *
+ * Take a run of consecutive message seq numbers for the fragments of a
+ * message.  The run never wraps so the first number can be found from any
+ * fragment by subtracting its index.
+ *
+ * RET: First Msg Seq Num of the run
+ *
+ ******************************************************************************/
+uint uiComm_reserveMsgSeqNums( //RET: First Msg Seq Num of the run
+    uchar ucCount)
+{
+	uint uiFirst;
+
+	/* START OVER IF THE RUN WOULD WRAP */
+	if (((ulong) uiGLOB_curMsgSeqNum + ucCount) >= 0xFFFF)
+		uiGLOB_curMsgSeqNum = 0;
+
+	uiFirst = uiGLOB_curMsgSeqNum + 1;
+	uiGLOB_curMsgSeqNum += ucCount;
+
+	return (uiFirst);
+
+}/* END: uiComm_reserveMsgSeqNums() */
+
 /************************  uiComm_incMsgSeqNum()  ******************************
  *
  * Increment the message seq number
@@ -2,7 +2,12 @@
 
 /**************************  CRC.C  ******************************************
 *
-* Example Table Driven CRC16 Routine using 4-bit message chunks
+* CRC16-CCITT (poly 0x1021, init 0xFFFF, MSB first) routines
+*
+* V1.02 10/19/2026 cp
+*		The nibble tables are replaced by the CRC16 hardware module on the
+*		MSP430 and a 256 entry byte table in host builds.  Both give the same
+*		results as the nibble tables did, tools/crc_test.c checks that.
 *
 * V1.01 10/07/2002 wzr
 *		Modified from the original form into a package for the wizard project.
@@ -10,10 +15,6 @@
 * V1.00  By Ashley Roll.  Digital Nemesis Pty Ltd
 * www.digitalnemesis.com, ash@digitalnemesis.com
 *
-* The following is an example of implementing a restricted size CRC16 tbl
-* lookup. No optimisation has been done so the code is clear & easy to
-* understand.
-*
 * Test Vector: "123456789" (char str, no quotes) = CRC: 0x29B1
 *
 ******************************************************************************/
@@ -31,94 +32,95 @@
 /*lint -e768 */		/* global struct member not referenced */
 
 
+#ifndef CRC_HOST_BUILD
 #include "diag.h"
 #include "std.h"				//standard defines
 #include "hal/config.h"		//system configuration definitions
 #include "crc.h"				//crc calculator
 #include "serial.h"				//comm port handlers
 #include "comm.h"				//msg definitions
+#else
+/* HOST TOOLS (SEE tools/) BUILD THIS FILE ON ITS OWN FOR THE CRC ROUTINES */
+#include "std.h"				//standard defines
+#include "crc.h"				//crc calculator
+#define MAX_OM_MSG_LENGTH 0x40	//same as comm.h
+#endif
 
-/* CRC16 "REGISTER" (IMPLEMENTED AS TWO 8BIT VALUES) */
-#define CRC16_HI 0					// index into ucaX1FLD[]
-#define CRC16_LO 1					// same
-
-
-
-/* CRC16 LOOKUP TABLES (HI & LO BYTES) FOR 4 BITS PER ITERATION. */
-const unsigned char ucCRC16_lookupHI[16] =
-		{
-        0x00, 0x10, 0x20, 0x30, 0x40, 0x50, 0x60, 0x70,
-        0x81, 0x91, 0xA1, 0xB1, 0xC1, 0xD1, 0xE1, 0xF1
-		};
-
-const unsigned char ucCRC16_lookupLO[16] =
+#ifdef CRC_HOST_BUILD
+/* CRC16 LOOKUP TABLE FOR 8 BITS PER ITERATION (HOST ONLY) */
+static const unsigned short usCRC16_lookup[256] =
 		{
-        0x00, 0x21, 0x42, 0x63, 0x84, 0xA5, 0xC6, 0xE7,
-        0x08, 0x29, 0x4A, 0x6B, 0x8C, 0xAD, 0xCE, 0xEF
+        0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+        0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF,
+        0x1231, 0x0210, 0x3273, 0x2252, 0x52B5, 0x4294, 0x72F7, 0x62D6,
+        0x9339, 0x8318, 0xB37B, 0xA35A, 0xD3BD, 0xC39C, 0xF3FF, 0xE3DE,
+        0x2462, 0x3443, 0x0420, 0x1401, 0x64E6, 0x74C7, 0x44A4, 0x5485,
+        0xA56A, 0xB54B, 0x8528, 0x9509, 0xE5EE, 0xF5CF, 0xC5AC, 0xD58D,
+        0x3653, 0x2672, 0x1611, 0x0630, 0x76D7, 0x66F6, 0x5695, 0x46B4,
+        0xB75B, 0xA77A, 0x9719, 0x8738, 0xF7DF, 0xE7FE, 0xD79D, 0xC7BC,
+        0x48C4, 0x58E5, 0x6886, 0x78A7, 0x0840, 0x1861, 0x2802, 0x3823,
+        0xC9CC, 0xD9ED, 0xE98E, 0xF9AF, 0x8948, 0x9969, 0xA90A, 0xB92B,
+        0x5AF5, 0x4AD4, 0x7AB7, 0x6A96, 0x1A71, 0x0A50, 0x3A33, 0x2A12,
+        0xDBFD, 0xCBDC, 0xFBBF, 0xEB9E, 0x9B79, 0x8B58, 0xBB3B, 0xAB1A,
+        0x6CA6, 0x7C87, 0x4CE4, 0x5CC5, 0x2C22, 0x3C03, 0x0C60, 0x1C41,
+        0xEDAE, 0xFD8F, 0xCDEC, 0xDDCD, 0xAD2A, 0xBD0B, 0x8D68, 0x9D49,
+        0x7E97, 0x6EB6, 0x5ED5, 0x4EF4, 0x3E13, 0x2E32, 0x1E51, 0x0E70,
+        0xFF9F, 0xEFBE, 0xDFDD, 0xCFFC, 0xBF1B, 0xAF3A, 0x9F59, 0x8F78,
+        0x9188, 0x81A9, 0xB1CA, 0xA1EB, 0xD10C, 0xC12D, 0xF14E, 0xE16F,
+        0x1080, 0x00A1, 0x30C2, 0x20E3, 0x5004, 0x4025, 0x7046, 0x6067,
+        0x83B9, 0x9398, 0xA3FB, 0xB3DA, 0xC33D, 0xD31C, 0xE37F, 0xF35E,
+        0x02B1, 0x1290, 0x22F3, 0x32D2, 0x4235, 0x5214, 0x6277, 0x7256,
+        0xB5EA, 0xA5CB, 0x95A8, 0x8589, 0xF56E, 0xE54F, 0xD52C, 0xC50D,
+        0x34E2, 0x24C3, 0x14A0, 0x0481, 0x7466, 0x6447, 0x5424, 0x4405,
+        0xA7DB, 0xB7FA, 0x8799, 0x97B8, 0xE75F, 0xF77E, 0xC71D, 0xD73C,
+        0x26D3, 0x36F2, 0x0691, 0x16B0, 0x6657, 0x7676, 0x4615, 0x5634,
+        0xD94C, 0xC96D, 0xF90E, 0xE92F, 0x99C8, 0x89E9, 0xB98A, 0xA9AB,
+        0x5844, 0x4865, 0x7806, 0x6827, 0x18C0, 0x08E1, 0x3882, 0x28A3,
+        0xCB7D, 0xDB5C, 0xEB3F, 0xFB1E, 0x8BF9, 0x9BD8, 0xABBB, 0xBB9A,
+        0x4A75, 0x5A54, 0x6A37, 0x7A16, 0x0AF1, 0x1AD0, 0x2AB3, 0x3A92,
+        0xFD2E, 0xED0F, 0xDD6C, 0xCD4D, 0xBDAA, 0xAD8B, 0x9DE8, 0x8DC9,
+        0x7C26, 0x6C07, 0x5C64, 0x4C45, 0x3CA2, 0x2C83, 0x1CE0, 0x0CC1,
+        0xEF1F, 0xFF3E, 0xCF5D, 0xDF7C, 0xAF9B, 0xBFBA, 0x8FD9, 0x9FF8,
+        0x6E17, 0x7E36, 0x4E55, 0x5E74, 0x2E93, 0x3EB2, 0x0ED1, 0x1EF0
 		};
+#endif
 
 
-
-
-/*********************  vCRC16_updateNibble()  *********************************
+/************************  uiCRC16_updateBlock()  ******************************
 *
-* Compute the CRC from a nibble of the msg. (Nibble is low order nibble).
+* Run a block of bytes through the CRC starting from uiCRC.
 *
-*******************************************************************************/
-
-void vCRC16_updateNibble(
-		unsigned char ucNibble,			//nibble to add to CRC
-		unsigned char ucCRCarray[2]		//CRC current value
-		)
-	{
-	unsigned char ucTmp;
-
-	/* EXTRACT THE MOST SIGNIFICANT 4 BITS OF THE CRC REG */
-	ucTmp = ucCRCarray[CRC16_HI] >> 4;
-
-	/* XOR IN THE MESSAGE DATA INTO THE EXTRACTED BITS */
-	ucTmp = ucTmp ^ ucNibble;
-
-	/* SHIFT THE CRC REG LEFT 4 BITS */
-	ucCRCarray[CRC16_HI] = (ucCRCarray[CRC16_HI] << 4) | (ucCRCarray[CRC16_LO] >> 4);	//lint !e564 !e734
-	ucCRCarray[CRC16_LO] =  ucCRCarray[CRC16_LO] << 4;	//lint !e734
-
-	/* DO THE TABLE LOOKUPS AND XOR THE RESULT INTO THE CRC TABLES */
-	ucCRCarray[CRC16_HI] = ucCRCarray[CRC16_HI] ^ ucCRC16_lookupHI[ucTmp];
-	ucCRCarray[CRC16_LO] = ucCRCarray[CRC16_LO] ^ ucCRC16_lookupLO[ucTmp];
-
-	return;
-
-	}/* END: vCRC16_updateNibble() */
-
-
-
-
-
-
-/***********************  vCRC16_updateByte()  *************************************
+* On the MSP430 the CRC16 hardware module does the work.  Bytes written to
+* CRCDIRB_L go in MSB first, which is the CCITT bit order, and CRCINIRES
+* holds the CRC.  The module has no other users and is not used from ISRs so
+* its state does not need to be saved.
 *
-* compute the crc for a full msg byte.
+* RET: CRC after the block
 *
 *******************************************************************************/
 
-void vCRC16_updateByte(
-		unsigned char ucByteVal,		//byte to add to CRC
-		unsigned char ucCRCarray[2]		//CRC current value
+static unsigned int uiCRC16_updateBlock(
+		unsigned int uiCRC,					//CRC current value
+		const volatile uchar *ucpBlock,		//bytes to add to the CRC
+		unsigned long ulLength				//number of bytes
 		)
 	{
+#ifndef CRC_HOST_BUILD
+	CRCINIRES = uiCRC;
+	while(ulLength--)
+		{
+		CRCDIRB_L = *ucpBlock++;
+		}
+	return(CRCINIRES);
+#else
+	while(ulLength--)
+		{
+		uiCRC = ((uiCRC << 8) ^ usCRC16_lookup[((uiCRC >> 8) ^ *ucpBlock++) & 0xFF]) & 0xFFFF;
+		}
+	return(uiCRC);
+#endif
 
-	vCRC16_updateNibble(ucByteVal >> 4, ucCRCarray );	// Hi nibble first
-	vCRC16_updateNibble(ucByteVal & 0x0F, ucCRCarray );	// LO nibble
-
-	return;
-
-	}/* END: vCRC16_updateByte() */
-
-
-
-
-
+	}/* END: uiCRC16_updateBlock() */
 
 
 
@@ -171,9 +173,8 @@ unsigned char ucCRC16_compute_msg_CRC(		/* RET:	1=CRC is OK, 0=CRC mismatch */
 		uchar ucLength						//length of the message
 		)
 	{
-	unsigned char uc;
 	unsigned char ucLimit;			//max counter limit
-	unsigned char ucCRCarray[2];	//CRC current value
+	unsigned int uiCRC;				//CRC current value
 
 	ucLimit = ucLength - 1;
 
@@ -183,29 +184,22 @@ unsigned char ucCRC16_compute_msg_CRC(		/* RET:	1=CRC is OK, 0=CRC mismatch */
 	if(ucLimit > MAX_OM_MSG_LENGTH)
 		return(0);	//bad return)
 
-	/* INIT THE CRC TO 0XFFFF AS PER CCITT SPEC */
-	ucCRCarray[CRC16_HI] = 0xFF;
-	ucCRCarray[CRC16_LO] = 0xFF;
-
 	/* BACKUP THE MSG SIZE IDX IF ITS A SEND MSG */
 	if(ucMsgFlag == CRC_FOR_MSG_TO_SEND) ucLimit -=2;
 
-	/* CALCULATE THE CRC */
-	for(uc=0; uc<=ucLimit;  uc++)
-		{
-		vCRC16_updateByte(*ucMSGBuff++, ucCRCarray);
-		}
+	/* CALCULATE THE CRC, INIT TO 0XFFFF AS PER CCITT SPEC */
+	uiCRC = uiCRC16_updateBlock(0xFFFF, ucMSGBuff, (unsigned long) ucLimit + 1);
 
-	/* IF THIS IS A SEND MSG THEN CALCULATE FOR 2 EXTRA BYTES & STUFF THE MSG */
+	/* IF THIS IS A SEND MSG THEN STUFF THE CRC ON THE END OF THE MSG */
 	if(ucMsgFlag == CRC_FOR_MSG_TO_SEND)
 		{
-		*ucMSGBuff++ = ucCRCarray[CRC16_HI];
-		*ucMSGBuff++ = ucCRCarray[CRC16_LO];
+		ucMSGBuff[ucLimit + 1] = (uchar) (uiCRC >> 8);
+		ucMSGBuff[ucLimit + 2] = (uchar) uiCRC;
 		return(1);	//good return
 		}
 
 	/* IF THIS IS A RECEIVE MSG DO THE COMPARE AND RET THE ERROR FLAG */
-	if((!ucCRCarray[CRC16_HI]) && (!ucCRCarray[CRC16_LO]))
+	if(uiCRC == 0)
 		{
 		return(1);	//good return
 		}
@@ -213,8 +207,7 @@ unsigned char ucCRC16_compute_msg_CRC(		/* RET:	1=CRC is OK, 0=CRC mismatch */
 	#if 0
 	/* IT WAS A BAD CRC COMPARE -- RETURN AN ERROR */
 	vSERIAL_sout("(BdCrc=", 7);
-	vSERIAL_HB8out(ucCRCarray[CRC16_HI]);
-	vSERIAL_HB8out(ucCRCarray[CRC16_LO]);
+	vSERIAL_HB16out(uiCRC);
 	vSERIAL_sout(")\r\n", 3);
 	#endif
 
@@ -230,23 +223,8 @@ unsigned char ucCRC16_compute_msg_CRC(		/* RET:	1=CRC is OK, 0=CRC mismatch */
 ////////////////////////////////////////////////////////////////////////
 unsigned int uiCRC16_ComputeBlockCRC(uchar *ucPointer, ulong ulLength)
 	{
-	unsigned long ulByteCount;
-	unsigned char ucCRCarray[2];	//CRC current value
-	uint uiCRC;
-
 	/* INIT THE CRC TO 0XFFFF AS PER CCITT SPEC */
-	ucCRCarray[CRC16_HI] = 0xFF;
-	ucCRCarray[CRC16_LO] = 0xFF;
-
-	/* CALCULATE THE CRC */
-	for(ulByteCount=0; ulByteCount < ulLength;  ulByteCount++)
-		{
-		vCRC16_updateByte(*ucPointer++, ucCRCarray);
-		}
-
-	uiCRC = (uint)(ucCRCarray[CRC16_HI] << 8) | (ucCRCarray[CRC16_LO]);
-
-	return(uiCRC);
+	return(uiCRC16_updateBlock(0xFFFF, ucPointer, ulLength));
 
 	}/* END:uiCRC16_CRC_on_memory() */
 
@@ -257,23 +235,7 @@ unsigned int uiCRC16_ComputeBlockCRC(uchar *ucPointer, ulong ulLength)
 ////////////////////////////////////////////////////////////////////////
 unsigned int uiCRC16_ComputeCRCwithInit(uchar *ucPointer, ulong ulLength, uint uiInitialCRC)
 	{
-	unsigned long ulByteCount;
-	unsigned char ucCRCarray[2];	//CRC current value
-	uint uiCRC;
-
-	// INIT THE CRC
-	ucCRCarray[CRC16_LO] = (uchar) uiInitialCRC;
-	ucCRCarray[CRC16_HI] = (uchar) (uiInitialCRC >> 8);
-
-	/* CALCULATE THE CRC */
-	for(ulByteCount=0; ulByteCount < ulLength;  ulByteCount++)
-		{
-		vCRC16_updateByte(*ucPointer++, ucCRCarray);
-		}
-
-	uiCRC = (uint)(ucCRCarray[CRC16_HI] << 8) | (ucCRCarray[CRC16_LO]);
-
-	return(uiCRC);
+	return(uiCRC16_updateBlock(uiInitialCRC, ucPointer, ulLength));
 
 	}/* END:uiCRC16_CRC_on_memory() */
 
@@ -283,21 +245,19 @@ unsigned int uiCRC16_ComputeCRCwithInit(uchar *ucPointer, ulong ulLength, uint u
 unsigned int uiCRC16_CRC_on_memory(ulong *ulPointer, ulong ulLength)
 	{
 	unsigned long ulByteCount;
-	unsigned char ucCRCarray[2];	//CRC current value
+	uchar ucByte;
 	uint uiReturn;
 
 	/* INIT THE CRC TO 0XFFFF AS PER CCITT SPEC */
-	ucCRCarray[CRC16_HI] = 0xFF;
-	ucCRCarray[CRC16_LO] = 0xFF;
+	uiReturn = 0xFFFF;
 
-	/* CALCULATE THE CRC */
+	/* CALCULATE THE CRC (LOW BYTE OF EACH LONG) */
 	for(ulByteCount=0; ulByteCount<=ulLength;  ulByteCount++)
 		{
-		vCRC16_updateByte(*ulPointer++, ucCRCarray);
+		ucByte = (uchar) *ulPointer++;
+		uiReturn = uiCRC16_updateBlock(uiReturn, &ucByte, 1);
 		}
 
-	uiReturn = (uint)(ucCRCarray[CRC16_HI] << 8) | (ucCRCarray[CRC16_LO]);
-
 	return(uiReturn);
 
 	}/* END:uiCRC16_CRC_on_memory() */
@@ -90,6 +90,77 @@ extern volatile union
 
 void vGS_SynchGardenServer(void);
 
+//! \var uiGS_SkipSN, uiGS_SkipNum, ucGS_Skipping
+//! \brief First fragment sent to the back of the queue since the last upload
+static uint uiGS_SkipSN;
+static uint uiGS_SkipNum;
+static uchar ucGS_Skipping;
+
+/////////////////////////////////////////////////////////////////////////
+//!
+//!	\brief Logs that a message could not be delivered to the garden server
+//!
+//! \param none
+//! \return none
+/////////////////////////////////////////////////////////////////////////
+static void vGS_LogDeliveryFail(void)
+{
+	uchar ucMsgIndex;
+
+	// Build the report data element header
+	vComm_DE_BuildReportHdr(CP_ID, 2, ucMAIN_GetVersion());
+	ucMsgIndex = DE_IDX_RPT_PAYLOAD;
+
+	ucaMSG_BUFF[ucMsgIndex++] = SRC_ID_MSG_DELIVERY_FAIL;
+	ucaMSG_BUFF[ucMsgIndex] = 0; // data length
+
+	// Store DE
+	vReport_LogDataElement(RPT_PRTY_MSG_DELIVERY_FAIL);
+}
+
+/////////////////////////////////////////////////////////////////////////
+//!
+//!	\brief Moves a fragment that cannot be uploaded yet out of the way
+//!
+//! The garden server only takes whole messages and the rest of the message
+//! is not queued right behind the fragment at the head of the queue.  The
+//! fragment goes to the back of its queue so the messages in between are
+//! uploaded and the fragments line up.  A fragment that comes back to the
+//! head with nothing uploaded in between will not line up and is dropped.
+//!
+//! \param none
+//! \return none
+/////////////////////////////////////////////////////////////////////////
+static void vGS_SkipFragment(void)
+{
+	uint uiSrcSN;
+	uint uiMsgNum;
+
+	// Get the fragment back, collecting it used the message buffer
+	if (!ucL2SRAM_getCopyOfCurMsgAt(0))
+		return;
+
+	uiSrcSN = (ucaMSG_BUFF[MSG_IDX_ADDR_HI] << 8) | ucaMSG_BUFF[MSG_IDX_ADDR_LO];
+	uiMsgNum = (ucaMSG_BUFF[MSG_IDX_NUM_HI] << 8) | ucaMSG_BUFF[MSG_IDX_NUM_LO];
+
+	vL2SRAM_delCurMsg();
+
+	// Been all the way around the queue
+	if (ucGS_Skipping && (uiSrcSN == uiGS_SkipSN) && (uiMsgNum == uiGS_SkipNum)) {
+		ucGS_Skipping = 0;
+		vGS_LogDeliveryFail();
+		return;
+	}
+
+	if (!ucGS_Skipping) {
+		ucGS_Skipping = 1;
+		uiGS_SkipSN = uiSrcSN;
+		uiGS_SkipNum = uiMsgNum;
+	}
+
+	vL2SRAM_storeMsgToSram();
+}
+
 
 /////////////////////////////////////////////////////////////////////////
 //!
@@ -306,8 +377,11 @@ void vGS_ReportToGardenServer(void)
 	uchar ucDEID;
 	uchar ucCount, ucCmdParamCount;
 	uint uiMySN;
+	uint uiCRC;
 	uchar ucMsgIndex;
 	uchar ucPacketSize;
+	uchar ucMsgCount;
+	volatile uchar *p_ucaPkt;
 	uchar ucAttemptCount;
 	long lExpTime;
 
@@ -330,42 +404,52 @@ void vGS_ReportToGardenServer(void)
 
 	// Set the attempt count to zero
 	ucAttemptCount = 0;
+	ucGS_Skipping = 0;
 
 	// Send data and receive commands while the subslot alarms are not set
 	while (ucTimeCheckForAlarms(SUBSLOT_ALARMS) == 0)
 	{
+		// Messages are deleted one at a time unless they were fragments
+		ucMsgCount = 1;
+
 		// If there is a message
 		if (ucL2SRAM_getCopyOfCurMsg())
 		{
+			// The garden server only takes whole messages, put fragments back together
+			p_ucaPkt = ucaMSG_BUFF;
+			if (!(ucaMSG_BUFF[MSG_IDX_FLG] & MSG_FLG_SINGLE)) {
+				p_ucaPkt = p_ucComm_Frag_CollectMsg(&ucMsgCount);
+				if (p_ucaPkt == 0) {
+					vGS_SkipFragment();
+					continue;
+				}
+				ucGS_Skipping = 0;
+			}
+
 			// Get the size of the packet
-		  ucPacketSize = NET_HDR_SZ + ucaMSG_BUFF[MSG_IDX_LEN] + CRC_SZ;
+		  ucPacketSize = NET_HDR_SZ + p_ucaPkt[MSG_IDX_LEN] + CRC_SZ;
 
 		  // Check the message before sending
-		  if(ucPacketSize > MAX_MSG_SIZE){
-
-		  	// Build the report data element header
-				vComm_DE_BuildReportHdr(CP_ID, 2, ucMAIN_GetVersion());
-				ucMsgIndex = DE_IDX_RPT_PAYLOAD;
-
-				ucaMSG_BUFF[ucMsgIndex++] = SRC_ID_MSG_DELIVERY_FAIL;
-				ucaMSG_BUFF[ucMsgIndex] = 0; // data length
-
-				// Store DE
-				vReport_LogDataElement(RPT_PRTY_MSG_DELIVERY_FAIL);
+		  if((ucMsgCount == 1) && (ucPacketSize > MAX_MSG_SIZE)){
 
 				// delete message
 				vL2SRAM_delCurMsg();
+				vGS_LogDeliveryFail();
 
 		  	continue;
 		  }
 
 			// Prepend the net layer and append the crc
 			vComm_NetPkg_buildHdr(0xFEFE);
-			ucCRC16_compute_msg_CRC(CRC_FOR_MSG_TO_SEND, ucaMSG_BUFF,ucPacketSize); //lint !e534 //compute the CRC
+			for (ucII = 0; ucII < NET_HDR_SZ; ucII++)
+				p_ucaPkt[ucII] = ucaMSG_BUFF[ucII];
+			uiCRC = uiCRC16_ComputeBlockCRC((uchar *) p_ucaPkt, ucPacketSize - CRC_SZ);
+			p_ucaPkt[ucPacketSize - CRC_SZ] = (uchar) (uiCRC >> 8);
+			p_ucaPkt[ucPacketSize - CRC_SZ + 1] = (uchar) uiCRC;
 
 			// Send bytes
 			for (ucII = 0; ucII < ucPacketSize; ucII++) {
-				vSERIAL_HB8out(ucaMSG_BUFF[ucII]);
+				vSERIAL_HB8out(p_ucaPkt[ucII]);
 			}
 			vSERIAL_crlf();
 		}
@@ -417,23 +501,15 @@ void vGS_ReportToGardenServer(void)
 
 			case ACK:
 				ucAttemptCount = 0;
-				vL2SRAM_delCurMsg();
+				ucGS_Skipping = 0;
+				vL2SRAM_delCurMsgs(ucMsgCount);
 			break;
 
 			case NACK: // Nack, try to send the message 5 time, if it fails then delete it.
 				if(ucAttemptCount == 5) {
-					// Build the report data element header
-					vComm_DE_BuildReportHdr(CP_ID, 2, ucMAIN_GetVersion());
-					ucMsgIndex = DE_IDX_RPT_PAYLOAD;
-
-					ucaMSG_BUFF[ucMsgIndex++] = SRC_ID_MSG_DELIVERY_FAIL;
-					ucaMSG_BUFF[ucMsgIndex] = 0; // data length
-
-					// Store DE
-					vReport_LogDataElement(RPT_PRTY_MSG_DELIVERY_FAIL);
-
 					// delete message
-					vL2SRAM_delCurMsg();
+					vL2SRAM_delCurMsgs(ucMsgCount);
+					vGS_LogDeliveryFail();
 
 					// Clear the attempt counter
 					ucAttemptCount = 0;
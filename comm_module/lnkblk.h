@@ -35,9 +35,32 @@
 #define MIN_LNK_DIST_IN_SEC_L (MIN_LNK_DIST_IN_MS / 1000)
 #define MIN_LNKREQ  ((1<<3) | (ENTRYS_PER_LNKBLK_BLK -1))
 
+//! \def LNK_DATA_CHANNELS
+//! \brief Number of data channels the links hop over, a power of 2
+#define LNK_DATA_CHANNELS		16
+
+//! \def LNK_CHANNEL_ROLLS
+//! \brief Seed rolls that feed the low bits of the seed into the channel bits
+#define LNK_CHANNEL_ROLLS		4
+
 #define LNK_MSG_TRANSFER_THRESHOLD    10		//number of msgs 
 #define LNK_MSG_TRANSFER_THRESHOLD_L ((long)LNK_MSG_TRANSFER_THRESHOLD)
 
+//! \defgroup Link Density Levels
+//! @{
+//! \def LNK_MAX_LINKS
+//! \brief Most links per frame the backlog controller asks for (3 bit link field)
+#define LNK_MAX_LINKS					((MAX_LINKS_PER_FRAME < 7) ? MAX_LINKS_PER_FRAME : 7)
+
+//! \def LNK_LEVEL_1FRAME_1LNK
+//! \brief Level of one link every frame, the levels below it skip frames
+#define LNK_LEVEL_1FRAME_1LNK	(MAX_LNK_DIST_IN_FRAMES - 1)
+
+//! \def LNK_LEVEL_MAX
+//! \brief Level of LNK_MAX_LINKS links every frame
+#define LNK_LEVEL_MAX					(LNK_LEVEL_1FRAME_1LNK + LNK_MAX_LINKS - 1)
+//! @}
+
 
 //! \defgroup Link Block Flags
 //! @{
@@ -94,6 +117,9 @@ uchar ucLNKBLK_fillLnkBlkFromMultipleLnkReq(uint uiSerialNumber, //Node ID
 uchar ucLNKBLK_computeMultipleLnkReqFromSysLoad(uint iSysLoad //system load in msgs/hr
     );
 
+uchar ucLNKBLK_computeLnkReqFromBacklog(uint uiSerialNumber, uint uiBacklog);
+uchar ucLNKBLK_WriteDrainCount(uint uiSerialNumber, uchar ucCount);
+
 void vLNKBLK_showLnkReq(uchar ucLnkReq);
 
 uchar ucLNKBLK_FetchNumofLinkTimes(uint uiSerialNumber, uchar * pucNumLinks);
@@ -112,6 +138,7 @@ uchar ucLNKBLK_ReadMsdMsgCount(uint uiSerialNumber, uchar *pucCount);
 uchar ucLNKBLK_WriteMsdMsgCount(uint uiSerialNumber, uchar ucCount);
 uchar ucLNKBLK_ReadRand(uint uiSerialNumber, ulong * pulRand);
 uchar ucLNKBLK_WriteRand(uint uiSerialNumber, ulong ulRand);
+uchar ucLNKBLK_ComputeChannel(uint uiSerialNumber, long lLinkTime, uchar *pucChannel);
 uchar ucLNKBLK_WriteLnkState(uint uiSerialNumber, uchar ucLnkBlkEntryNum, uchar ucLinkState);
 uchar ucLNKBLK_ReadLnkState(uint uiSerialNumber, uchar ucLnkBlkEntryNum, uchar *pucLinkState);
 void vLNKBLK_showLnkStats(void);
@@ -45,8 +45,8 @@
 #include "diag.h"		//diagnostic defines
 
 
-extern usl uslGLOB_sramQon_NFL;
-extern usl uslGLOB_sramQoff;
+extern usl uslGLOB_sramQon_NFL[];
+extern usl uslGLOB_sramQoff[];
 extern uint uiGLOB_sramQcnt;
 
 
@@ -680,9 +680,9 @@ void vDIAG_showSramVals(
 	vSERIAL_sout("  Qend=", 7);
 	vSERIAL_UIV24out((usl)L2SRAM_MSG_Q_END_UL);
 	vSERIAL_sout("  Qon=", 6);
-	vSERIAL_UIV24out(uslGLOB_sramQon_NFL);
+	vSERIAL_UIV24out(uslGLOB_sramQon_NFL[L2SRAM_MSG_CLASS_DATA]);
 	vSERIAL_sout("  Qoff=", 7);
-	vSERIAL_UIV24out(uslGLOB_sramQoff);
+	vSERIAL_UIV24out(uslGLOB_sramQoff[L2SRAM_MSG_CLASS_DATA]);
 	vSERIAL_sout("  Qcnt=", 7);
 	vSERIAL_UIV16out(uiGLOB_sramQcnt);
 	vSERIAL_sout("  Qvacancy=", 11);
@@ -710,13 +710,13 @@ void vDIAG_showSramVals(
 
 		vSERIAL_HB8out(ucSRAM_read_B8(ulii));
 
-		if(uslGLOB_sramQon_NFL == ulii)
+		if(uslGLOB_sramQon_NFL[L2SRAM_MSG_CLASS_DATA] == ulii)
 			{
 			vSERIAL_sout("ON(", 4);
 			vSERIAL_UIV16out(uiGLOB_sramQcnt);
 			vSERIAL_sout(")", 1);
 			}
-		if(uslGLOB_sramQoff == ulii)
+		if(uslGLOB_sramQoff[L2SRAM_MSG_CLASS_DATA] == ulii)
 			{
 			vSERIAL_sout("OFF", 4);
 			}
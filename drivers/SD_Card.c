@@ -26,6 +26,12 @@
 #include "SD_Card.h"
 #include "SD_Card_Testing.h"
 #include "delay.h"
+#include "crc.h"
+#include "misc.h"
+
+#if SD_LOG_SUPERBLOCK != SD_CARD_DATA_BLOCK
+#error "SD_LOG_SUPERBLOCK must match SD_CARD_DATA_BLOCK"
+#endif
 
 //Defines and Macros
 #define SD_Card_OUT	P3OUT
@@ -41,6 +47,11 @@
 #define SD_DUMMY_CHAR		0xFF
 #define SD_WRITE_TOKEN		0xE5
 #define SD_READ_TOKEN		0xFE
+#define SD_MULTI_WRITE_TOKEN	0xFC	//Start block token for each block of SD_CMD_WRITE_MULTIPLE_BLOCK
+#define SD_STOP_TRAN_TOKEN	0xFD	//Ends SD_CMD_WRITE_MULTIPLE_BLOCK
+#define SD_DATA_RESP_MASK	0x1F	//Status bits of the data response token
+#define SD_DATA_RESP_OK		0x05	//Data accepted
+#define SD_DATA_RESP_CRC	0x0B	//Data rejected due to a CRC error
 #define SD_IF_COND_TOKEN	0x01AA
 
 //SD Card Commands
@@ -55,6 +66,7 @@
 #define SD_CMD_READ_SINGLE_BLOCK		17	//Reads a block of size set by SD_CMD_SET_BLOCKLEN
 #define SD_CMD_READ_MULTIPLE_BLOCK	18	//Continuously transfers data blocks from card until interrupted by SD_CMD_STOP_TRANSMISSION
 #define SD_CMD_WRITE_BLOCK					24	//Writes a block of size 512 or that set by SD_CMD_SET_BLOCKLEN for SDSC cards
+#define SD_CMD_WRITE_MULTIPLE_BLOCK	25	//Continuously writes blocks until 'Stop Tran' token is sent (instead of 'Start Block' token)
 #define SD_CMD_PROGRAM_CSD					27	//Programming of the programmable bits of the CSD
 #define SD_CMD_ERASE_WR_BLK_START		32	//Sets address of first write block to be erased
 #define SD_CMD_ERASE_WR_BLK_END			33	//Sets address of the last write block to be erased
@@ -64,24 +76,26 @@
 #define SD_CMD_READ_OCR							58	//Reads OCR register
 
 #define SD_ACMD_OP_COND							41	//Sends host capacity support info and activates card init process - reserved bits shall be set to 0
+#define SD_ACMD_SET_WR_BLK_ERASE_COUNT 23	//Set # of write blocks to be pre-erased before writing (faster multiple block write) - default is 1
+#define SD_CMD_CRC_ON_OFF				59	//Turns CRC option on (1) or off (0) - default for SPI mode is off
 
 //#define SD_CMD_SWITCH_FUNC			6	//Checks switchable fn (mode 0) and switches fn (mode 1)
-//#define SD_CMD_WRITE_MULTIPLE_BLOCK	25	//Continuously writes blocks until 'Stop Tran' token is sent (instead of 'Start Block' token)
 //#define SD_CMD_SET_WRITE_PROT			28	//If card has write protection features this sets the wp bit of the addressed group (SDHC and SDXC cards not supported)
 //#define SD_CMD_CLR_WRITE_PROT			29	//If card has write protection features this clears the wp bit of the addressed group (SDHC and SDXC cards not supported)
 //#define SD_CMD_SEND_WRITE_PROT		30	//If card has write protection features this asks card to send status of the wp bits (SDHC and SDXC cards not supported)
 //#define SD_CMD_LOCK_UNLOCK			42	//Set/Reset the password or lock/unlock card
 //#define SD_CMD_GEN_CMD				56	//Either transfer data block to card or get from card for general purpose/app sepcific commands
-//#define SD_CMD_CRC_ON_OFF				59	//Turns CRC option on (1) or off (0) - default for SPI mode is off
 //#define SD_ACMD_STATUS				13	//Sends the SD status:
 //#define SD_ACMD_SEND_NUM_WR_BLOCKS	22	//Sends # of well written (no errors) blocks - responds with 32-bit CRC data block
-//#define SD_ACMD_SET_WR_BLK_ERASE_COUNT 23	//Set # of write blocks to be pre-erased before writing (faster multiple block write) - default is 1
 //#define SD_ACMD_SET_CLR_CARD_DETECT	42	//Connect/disconnect 50-KOhm pull-up resistor on CS
 
 //Internal function prototypes
 static void inline SD_Send_Dummy(unsigned char uiCount);
 static void inline SD_Send_Token(void);
 static unsigned char inline SD_Read_Byte(void);
+static unsigned char ucSD_CRC7(unsigned char *pucData, unsigned char ucLength);
+static void vSD_Send_DataCRC(unsigned char *pucData);
+static unsigned char ucSD_Check_DataCRC(unsigned char *pucData);
 unsigned char SD_Card_WaitBusy(void);
 void vSD_Card_GetR1(void);
 void vSD_Card_GetR1b(void);
@@ -97,6 +111,22 @@ SD_R2 g_rStatus;
 SD_OCR	g_rOCR;
 SD_INFO g_sdInfo;
 
+//! \var ucSD_PowerHeld
+//! \brief Set while the card must stay powered through FRAM accesses
+static unsigned char ucSD_PowerHeld = 0;
+
+//! \var ucSD_SessionUp
+//! \brief Set while the card is powered and initialized for a session
+static unsigned char ucSD_SessionUp = 0;
+
+//! \var ucSD_CRCOn
+//! \brief Set once the card has accepted CMD59, data blocks then carry a real CRC16
+static unsigned char ucSD_CRCOn = 0;
+
+//! \var ucSD_SessionIdle
+//! \brief Slots the open session has gone without being used
+static unsigned char ucSD_SessionIdle = 0;
+
 ///////////////////////////////////////////////////////////////////////
 //!
 //! \brief Turns off the power supply to the SD card.
@@ -104,11 +134,20 @@ SD_INFO g_sdInfo;
 //! It was found that the SD card has a high quiescent current so in
 //! order to extend battery life we completely cutoff power to the part.
 //!
+//! The FRAM driver also cycles the SD supply around every access.  While
+//! the power is held only the chip select is released so the card keeps its
+//! state.
+//!
 //! \param none
 //! \return none
 //////////////////////////////////////////////////////////////////////
 void vSD_PowerOff(void)
 {
+	if (ucSD_PowerHeld) {
+		SD_CS(HIGH);
+		return;
+	}
+
 	P3REN &= ~BIT2;
 	P3OUT &= ~BIT2;
 	P_SD_PWR_OUT &= ~SD_PWR_PIN;
@@ -134,6 +173,107 @@ void vSD_PowerOn(void)
 	SD_CS(HIGH);
 }
 
+///////////////////////////////////////////////////////////////////////
+//!
+//! \brief Keeps the SD card powered until released
+//!
+//! Needed when FRAM is read between the blocks of a multiple block
+//! transfer, otherwise the FRAM driver would power the card down mid write.
+//! The caller still powers the card on and off itself.
+//!
+//! \param ucHold, 1 to hold the power on, 0 to release
+//! \return none
+//////////////////////////////////////////////////////////////////////
+void vSD_HoldPower(unsigned char ucHold)
+{
+	ucSD_PowerHeld = ucHold;
+}
+
+///////////////////////////////////////////////////////////////////////
+//!
+//! \brief Opens an SD card session or joins the one already open
+//!
+//! The first caller powers the card and runs the init sequence, later
+//! callers (report flush, OTA, crisis reads) reuse the initialized card.
+//! The card stays powered through FRAM accesses until the session closes,
+//! either on an error or when it has been idle for SD_SESSION_IDLE_SLOTS
+//! slots (see vSD_SessionEndOfSlot()).
+//!
+//! \param none
+//! \return SD_SUCCESS if the card is ready, SD_FAILED otherwise
+//////////////////////////////////////////////////////////////////////
+unsigned char ucSD_SessionOpen(void)
+{
+	unsigned int uiCount;
+
+	ucSD_SessionIdle = 0;
+
+	if (ucSD_SessionUp)
+		return SD_SUCCESS;
+
+	// Power up the SD card and run the initialization sequence
+	vSD_PowerOn();
+	vSD_HoldPower(1);
+
+	// Try the initialization function a few times
+	for (uiCount = 0; uiCount < SD_SESSION_INIT_TRIES; uiCount++)
+	{
+		if (ucSD_Init() == SD_SUCCESS)
+			break;
+	}
+
+	if (uiCount == SD_SESSION_INIT_TRIES)
+	{
+		vSD_HoldPower(0);
+		vSD_PowerOff();
+#if 0
+		vSERIAL_sout("SD session init fail\r\n", 22);
+#endif
+		return SD_FAILED;
+	}
+
+	ucSD_SessionUp = 1;
+	return SD_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////
+//!
+//! \brief Closes the SD card session and powers the card down
+//!
+//! Called after a failed operation so the next open starts from a power
+//! cycle, and by vSD_SessionEndOfSlot() when the card has gone idle.
+//!
+//! \param none
+//! \return none
+//////////////////////////////////////////////////////////////////////
+void vSD_SessionClose(void)
+{
+	ucSD_SessionUp = 0;
+	ucSD_SessionIdle = 0;
+	vSD_HoldPower(0);
+	vSD_PowerOff();
+}
+
+///////////////////////////////////////////////////////////////////////
+//!
+//! \brief Powers the SD card down once its session has gone idle
+//!
+//! Called once at the end of every slot.
+//!
+//! \param none
+//! \return none
+//////////////////////////////////////////////////////////////////////
+void vSD_SessionEndOfSlot(void)
+{
+	if (!ucSD_SessionUp)
+		return;
+
+	if (ucSD_SessionIdle >= SD_SESSION_IDLE_SLOTS)
+		vSD_SessionClose();
+	else
+		ucSD_SessionIdle++;
+}
+
 /////////////////////////////////////////////////////////////////////////
 //! \fn ucSD_Send_Command(unsigned char ucCommand, unsigned long ulArgument)
 //!
@@ -158,10 +298,8 @@ unsigned char ucSD_Send_Command(unsigned char ucCommand, unsigned long ulArgumen
 	ucaSDTXBuffer[3] = (unsigned char)(ulArgument >> 8);
 	ucaSDTXBuffer[4] = (unsigned char)(ulArgument);
 
-	//CRC - required for GO_IDLE_STATE and SEND_IF_CMD, but ignored otherwise
-	ucaSDTXBuffer[0x05] = (ucCommand == SD_CMD_GO_IDLE_STATE) ? SD_IDLE_CRC   :
-						  (ucCommand == SD_CMD_SEND_IF_COND)  ? SD_IFCOND_CRC :
-						  SD_DEFAULT_CRC;
+	//CRC7 - always computed since the card checks it on every command once CRC mode is on
+	ucaSDTXBuffer[0x05] = ucSD_CRC7(ucaSDTXBuffer, 5);
 
 #if 0
 	vSERIAL_sout("SD Card: sending command ", 25);
@@ -407,6 +545,11 @@ unsigned char ucSD_Init(void)
 		}
 	}
 
+	//Protect data blocks with CRC16, carry on without it if the card refuses
+	ucSD_CRCOn = 0;
+	if (ucSD_Send_Command(SD_CMD_CRC_ON_OFF, 1) == SD_SUCCESS && g_r1Response.uiRaw == 0)
+		ucSD_CRCOn = 1;
+
 	//Card is initialized, increase the SPI clock to 4 MHz
 	vSPI_Init(SPI_MODE_2, RATE_1);
 	return SD_SUCCESS;
@@ -477,8 +620,8 @@ char SD_Write_Block(unsigned char *pucData_TXBuffer, unsigned long ulBlockNum)
 
 	vSPI_TXBytes(pucData_TXBuffer, SD_CARD_BLOCKLEN);
 
-	//16-bit CRC - disabled by default so values not predictable
-	SD_Send_Dummy(2);
+	//16-bit CRC, the data response token tells whether the card received the block intact
+	vSD_Send_DataCRC(pucData_TXBuffer);
 
 	//Wait for the write to finish
 	ucReturn = SD_Card_WaitBusy();
@@ -570,12 +713,16 @@ unsigned char SD_Read_Block(unsigned char *pucData_RXBuffer, unsigned long ulBlo
 
 	//Read the data block and 2-byte CRC
 	vSPI_RX_Bytes(pucData_RXBuffer, SD_CARD_BLOCKLEN);
-	SD_Read_Byte();
-	SD_Read_Byte();
+	ucByte = ucSD_Check_DataCRC(pucData_RXBuffer);
 
 	//De-assert CS
 	SD_CS(HIGH);
 
+	if (ucByte == SD_FAILED) {
+		vSPI_Quit();
+		return SD_FAILED;
+	}
+
 	// The data token following the write includes a CRC error and an unspecified error
 	// but is not comprehensive.  Therefore check the status register to verify the write.
 	ucSD_Send_Command(SD_CMD_SEND_STATUS, 0);
@@ -654,6 +801,135 @@ unsigned char SD_Read_MultipleBlocks(unsigned char *pucData_RXBuffer, unsigned l
 	return SD_SUCCESS;
 }
 
+//////////////////////////////////////////////////////////////////////////////////////
+//! \brief This function starts a multiple block write
+//!
+//! Tells the card how many blocks are coming so it can pre-erase them (ACMD23)
+//! and opens the write at the first block (CMD25).  The blocks follow with
+//! SD_Write_MultipleBlocks_Next() and the write is closed with
+//! SD_Write_MultipleBlocks_Stop().  The SPI port is released between calls
+//! so the caller can fetch each block from FRAM as it goes.
+//!
+//! \param ulStartBlock - The first block to write
+//! \param ucBlockCount - The number of blocks that will be written
+//! \return error code
+/////////////////////////////////////////////////////////////////////////////////////
+unsigned char SD_Write_MultipleBlocks_Start(unsigned long ulStartBlock, uchar ucBlockCount)
+{
+	vSPI_Init(SPI_MODE_2, RATE_1);
+
+	//Correct address for SDSC cards which use byte-addressing instead of block-addressing
+	if(g_sdInfo.ucType == SD_TYPE_SDSC) ulStartBlock *= SD_CARD_BLOCKLEN;
+
+	// Pre-erase is only a hint, carry on without it if the card refuses
+	if (ucSD_Send_Command(SD_CMD_APP_CMD, 0) == SD_SUCCESS)
+		ucSD_Send_Command(SD_ACMD_SET_WR_BLK_ERASE_COUNT, (unsigned long) ucBlockCount);
+
+	//Send the WRITE_MULTIPLE_BLOCK command
+	if (ucSD_Send_Command(SD_CMD_WRITE_MULTIPLE_BLOCK, ulStartBlock) == SD_FAILED || g_r1Response.uiRaw != 0)
+	{
+		vSPI_Quit();
+		return SD_FAILED;
+	}
+
+	vSPI_Quit();
+	return SD_SUCCESS;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////
+//! \brief This function writes the next block of a multiple block write
+//!
+//! \param pucData_TXBuffer - The buffer with the data to write
+//! \return error code, on failure the write is stopped and must be started over
+/////////////////////////////////////////////////////////////////////////////////////
+unsigned char SD_Write_MultipleBlocks_Next(unsigned char *pucData_TXBuffer)
+{
+	unsigned char ucReturn;
+	unsigned int i;
+
+	vSPI_Init(SPI_MODE_2, RATE_1);
+
+	SD_CS(LOW);
+
+	// Make sure the card is ready before proceeding
+	i=0;
+	while (SD_Read_Byte() != 0xFF && i++ < 100);
+
+	//Each block of a multiple block write starts with its own token
+	vSPI_bout(SD_MULTI_WRITE_TOKEN);
+
+	vSPI_TXBytes(pucData_TXBuffer, SD_CARD_BLOCKLEN);
+
+	//16-bit CRC, the data response token tells whether the card received the block intact
+	vSD_Send_DataCRC(pucData_TXBuffer);
+
+	//Wait for the card to program the block
+	ucReturn = SD_Card_WaitBusy();
+
+	if(ucReturn == SD_FAILED)
+	{
+		// A rejected block ends the write, a multiple block write is closed
+		// with the stop token rather than CMD12
+		vSPI_bout(SD_STOP_TRAN_TOKEN);
+		SD_Read_Byte();
+		i=0;
+		while (SD_Read_Byte() != 0xFF && i++ < 6500);
+
+		SD_CS(HIGH);
+		vSPI_Quit();
+		return SD_FAILED;
+	}
+
+	SD_CS(HIGH);
+
+	vSPI_Quit();
+	return SD_SUCCESS;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////
+//! \brief This function closes a multiple block write
+//!
+//! Sends the stop transmission token, waits for the last block to be
+//! programmed and then checks the status register as SD_Write_Block() does.
+//!
+//! \return error code
+/////////////////////////////////////////////////////////////////////////////////////
+unsigned char SD_Write_MultipleBlocks_Stop(void)
+{
+	unsigned int i;
+
+	vSPI_Init(SPI_MODE_2, RATE_1);
+
+	SD_CS(LOW);
+
+	// Make sure the card is ready before proceeding
+	i=0;
+	while (SD_Read_Byte() != 0xFF && i++ < 100);
+
+	vSPI_bout(SD_STOP_TRAN_TOKEN);
+
+	// One byte gap then the card holds the line low while it is busy
+	SD_Read_Byte();
+	i=0;
+	while (SD_Read_Byte() != 0xFF && i++ < 6500);
+
+	SD_CS(HIGH);
+
+	if (i >= 6500) {
+		vSPI_Quit();
+		return SD_FAILED;
+	}
+
+	ucSD_Send_Command(SD_CMD_SEND_STATUS, 0);
+	if (g_r1Response.uiRaw > 0 || g_rStatus.uiRaw > 0) {
+		vSPI_Quit();
+		return SD_FAILED;
+	}
+
+	vSPI_Quit();
+	return SD_SUCCESS;
+}
+
 //////////////////////////////////////////////////////////////////////////////////////
 //! \brief This function erases a block
 //!
@@ -696,17 +972,19 @@ char SD_Erase_Block(unsigned long ulBlockNum)
 //////////////////////////////////////////////////////////////////////////////////////
 //! \brief This function formats the SD card
 //!
-//! This function clocks out a specified number of dummy bytes over the SPI MOSI line
+//! Writes the superblock describing the data log.  The data blocks are not
+//! touched, anything left over from an earlier format carries a different
+//! volume id and is ignored by readers.
 //!
-//! \param uiCount - The number of dummy bytes to write
+//! \param uiVolume - Volume id the firmware stamps into every block from now on
 //! \return error code
 /////////////////////////////////////////////////////////////////////////////////////
-unsigned char SD_Format()
+unsigned char SD_Format(unsigned int uiVolume)
 {
 	int i;
 	unsigned char ucResult;
 	unsigned char ucaBuffer[SD_CARD_BLOCKLEN];
-	SD_DataBlock *pDataBlock = ucaBuffer;
+	SD_DataBlock *pDataBlock = (SD_DataBlock *) ucaBuffer;
 
 	//Zero out the data block buffer
 	for(i=0; i<SD_CARD_BLOCKLEN; i++) ucaBuffer[i] = 0xAA;
@@ -718,6 +996,10 @@ unsigned char SD_Format()
 	pDataBlock->magic_num[3] = 'A';
 	pDataBlock->start_block  = SD_CARD_START_BLOCK;
 	pDataBlock->version      = SD_DRIVER_VERSION;
+	pDataBlock->hdr_size       = SD_BLK_HDR_SZ;
+	pDataBlock->index_interval = SD_LOG_INDEX_INTERVAL;
+	pDataBlock->volume[0]      = (unsigned char) (uiVolume >> 8);
+	pDataBlock->volume[1]      = (unsigned char) uiVolume;
 
 	//Write the data block to the card
 	ucResult = SD_Write_Block(ucaBuffer, SD_CARD_DATA_BLOCK);
@@ -738,15 +1020,15 @@ unsigned char SD_Format()
 //! This function reads the SD_CARD_DATA_BLOCK and checks the magic value to verify
 //! if the card has been formatted.
 //!
-//! \param uiCount - The number of dummy bytes to write
+//! \param pucBlock - SD_CARD_BLOCKLEN byte scratch buffer, holds the superblock on return
 //! \return SD_SUCCESS if formatted, SD_FAILED otherwise
-unsigned char SD_CheckFormat()
+unsigned char SD_CheckFormat(unsigned char *pucBlock)
 {
 	unsigned char result;
-	SD_DataBlock *pDataBlock = ucaSDRXBuffer;
+	SD_DataBlock *pDataBlock = (SD_DataBlock *) pucBlock;
 
 	//Attempt to read the data block
-	result = SD_Read_Block(ucaSDRXBuffer, SD_CARD_DATA_BLOCK);
+	result = SD_Read_Block(pucBlock, SD_CARD_DATA_BLOCK);
 	if(result == SD_FAILED) return SD_FAILED;
 
 	//Check the magic value
@@ -756,6 +1038,132 @@ unsigned char SD_CheckFormat()
 		return SD_SUCCESS;
 }
 
+//////////////////////////////////////////////////////////////////////////////////////
+//! \brief Fills in the card side of a log block header and seals it with a CRC
+//!
+//! The sequence number, time range, carry and end offset are already in the
+//! header (they are kept up to date while the FRAM page fills).
+//!
+//! \param pucBlock - SD_CARD_BLOCKLEN bytes
+//! \param ucType - SD_BLK_TYPE_DATA or SD_BLK_TYPE_INDEX
+//! \param uiVolume - Volume id from the superblock
+//! \return none
+/////////////////////////////////////////////////////////////////////////////////////
+void vSD_SealBlock(unsigned char *pucBlock, unsigned char ucType, unsigned int uiVolume)
+{
+	unsigned int uiCRC;
+
+	pucBlock[SD_BLK_IDX_MAGIC] = (unsigned char) (SD_BLK_MAGIC >> 8);
+	pucBlock[SD_BLK_IDX_MAGIC + 1] = (unsigned char) SD_BLK_MAGIC;
+	pucBlock[SD_BLK_IDX_TYPE] = ucType;
+	pucBlock[SD_BLK_IDX_VOLUME] = (unsigned char) (uiVolume >> 8);
+	pucBlock[SD_BLK_IDX_VOLUME + 1] = (unsigned char) uiVolume;
+
+	pucBlock[SD_BLK_IDX_CRC] = 0;
+	pucBlock[SD_BLK_IDX_CRC + 1] = 0;
+	uiCRC = uiCRC16_ComputeBlockCRC(pucBlock, SD_CARD_BLOCKLEN);
+	pucBlock[SD_BLK_IDX_CRC] = (unsigned char) (uiCRC >> 8);
+	pucBlock[SD_BLK_IDX_CRC + 1] = (unsigned char) uiCRC;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////
+//! \brief Checks that a block read from the card is a log block of this volume
+//!
+//! The CRC field is zeroed for the check, the rest of the block is untouched.
+//!
+//! \param pucBlock - SD_CARD_BLOCKLEN bytes
+//! \param uiVolume - Volume id from the superblock
+//! \return SD_SUCCESS if the block is intact and belongs to the volume
+/////////////////////////////////////////////////////////////////////////////////////
+unsigned char ucSD_CheckBlock(unsigned char *pucBlock, unsigned int uiVolume)
+{
+	unsigned int uiCRC;
+
+	if (uiMISC_buildUintFromBytes(&pucBlock[SD_BLK_IDX_MAGIC], NO_NOINT) != SD_BLK_MAGIC)
+		return SD_FAILED;
+	if (uiMISC_buildUintFromBytes(&pucBlock[SD_BLK_IDX_VOLUME], NO_NOINT) != uiVolume)
+		return SD_FAILED;
+
+	uiCRC = uiMISC_buildUintFromBytes(&pucBlock[SD_BLK_IDX_CRC], NO_NOINT);
+	pucBlock[SD_BLK_IDX_CRC] = 0;
+	pucBlock[SD_BLK_IDX_CRC + 1] = 0;
+	if (uiCRC16_ComputeBlockCRC(pucBlock, SD_CARD_BLOCKLEN) != uiCRC)
+		return SD_FAILED;
+
+	vMISC_copyUintIntoBytes(uiCRC, &pucBlock[SD_BLK_IDX_CRC], NO_NOINT);
+	return SD_SUCCESS;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////
+//! \brief Reads the sequence number of a log block
+//!
+//! \param ulBlockNum - Block to read
+//! \param uiVolume - Volume id from the superblock
+//! \param pucBlock - SD_CARD_BLOCKLEN byte scratch buffer
+//! \param pulSeq - Sequence number on success
+//! \return SD_SUCCESS if the block was read and is a log block of the volume
+/////////////////////////////////////////////////////////////////////////////////////
+static unsigned char ucSD_ReadLogSeq(unsigned long ulBlockNum, unsigned int uiVolume, unsigned char *pucBlock, unsigned long *pulSeq)
+{
+	unsigned char ucTries;
+
+	for (ucTries = 0; ucTries < 3; ucTries++)
+	{
+		if (SD_Read_Block(pucBlock, ulBlockNum) == SD_SUCCESS)
+			break;
+	}
+	if (ucTries == 3 || ucSD_CheckBlock(pucBlock, uiVolume) == SD_FAILED)
+		return SD_FAILED;
+
+	*pulSeq = ulMISC_buildUlongFromBytes(&pucBlock[SD_BLK_IDX_SEQ], NO_NOINT);
+	return SD_SUCCESS;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////
+//! \brief Finds the newest block of the data log by binary search
+//!
+//! Blocks from the start of the log up to the newest one have sequence
+//! numbers at or above the first block, the blocks after it are either
+//! older (the log has wrapped) or not part of this volume.  That split is
+//! found in log2(capacity) block reads.  The card must be in a session.
+//!
+//! \param pucBlock - SD_CARD_BLOCKLEN byte scratch buffer
+//! \return Newest block (may be an index block), 0 if the log is empty or the card is not formatted
+/////////////////////////////////////////////////////////////////////////////////////
+unsigned long ulSD_FindNewestBlock(unsigned char *pucBlock)
+{
+	unsigned int uiVolume;
+	unsigned long ulFirstSeq, ulSeq;
+	unsigned long ulLo, ulHi, ulMid;
+
+	if (SD_CheckFormat(pucBlock) == SD_FAILED || pucBlock[SD_SB_IDX_VERSION] < SD_LOG_MIN_VERSION)
+		return 0;
+	uiVolume = uiMISC_buildUintFromBytes(&pucBlock[SD_SB_IDX_VOLUME], NO_NOINT);
+
+	if (ucSD_ReadLogSeq(SD_CARD_START_BLOCK, uiVolume, pucBlock, &ulFirstSeq) == SD_FAILED)
+		return 0;
+
+	// ulLo is always in the log, nothing past ulHi is
+	ulLo = SD_CARD_START_BLOCK;
+	ulHi = ulSD_GetCapacity() - 1;
+	while (ulLo < ulHi)
+	{
+		ulMid = ulLo + ((ulHi - ulLo + 1) >> 1);
+		if (ucSD_ReadLogSeq(ulMid, uiVolume, pucBlock, &ulSeq) == SD_SUCCESS && ulSeq >= ulFirstSeq)
+			ulLo = ulMid;
+		else
+			ulHi = ulMid - 1;
+	}
+
+#if 0
+	vSERIAL_sout("SD newest= ", 11);
+	vSERIAL_UI32out(ulLo);
+	vSERIAL_crlf();
+#endif
+
+	return ulLo;
+}
+
 //////////////////////////////////////////////////////////////////////////////////////
 //! \brief This inline function sends dummy bytes to the SD card
 //!
@@ -793,11 +1201,80 @@ static void inline SD_Send_Token() { vSPI_bout(0xFE); }
 /////////////////////////////////////////////////////////////////////////////////////
 static unsigned char inline SD_Read_Byte() { return ucSPI_bin(); }
 
+//////////////////////////////////////////////////////////////////////////////////////
+//! \brief Computes the CRC7 of a command frame
+//!
+//! \param pucData - The command index and argument bytes
+//! \param ucLength - Number of bytes (5 for a command)
+//! \return The CRC shifted into place with the end bit set
+/////////////////////////////////////////////////////////////////////////////////////
+static unsigned char ucSD_CRC7(unsigned char *pucData, unsigned char ucLength)
+{
+	unsigned char ucCRC = 0;
+	unsigned char ucByte;
+	unsigned char ucBit;
+
+	while (ucLength--) {
+		ucByte = *pucData++;
+		for (ucBit = 0; ucBit < 8; ucBit++) {
+			ucCRC <<= 1;
+			if ((ucByte ^ ucCRC) & 0x80)
+				ucCRC ^= 0x09;
+			ucByte <<= 1;
+		}
+	}
+
+	return (unsigned char) ((ucCRC << 1) | 0x01);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////
+//! \brief Sends the CRC16 that follows a data block
+//!
+//! The SD data CRC is CRC16-CCITT started at zero.  Dummy bytes are sent
+//! if the card is not in CRC mode.
+//!
+//! \param pucData - The SD_CARD_BLOCKLEN bytes just sent
+//! \return none
+/////////////////////////////////////////////////////////////////////////////////////
+static void vSD_Send_DataCRC(unsigned char *pucData)
+{
+	unsigned int uiCRC;
+
+	if (!ucSD_CRCOn) {
+		SD_Send_Dummy(2);
+		return;
+	}
+
+	uiCRC = uiCRC16_ComputeCRCwithInit(pucData, SD_CARD_BLOCKLEN, 0);
+	vSPI_bout((unsigned char) (uiCRC >> 8));
+	vSPI_bout((unsigned char) uiCRC);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////
+//! \brief Reads the CRC16 that follows a data block and checks it
+//!
+//! \param pucData - The SD_CARD_BLOCKLEN bytes just received
+//! \return SD_SUCCESS if the CRC matches or the card is not in CRC mode
+/////////////////////////////////////////////////////////////////////////////////////
+static unsigned char ucSD_Check_DataCRC(unsigned char *pucData)
+{
+	unsigned int uiCRC;
+
+	uiCRC = (unsigned int) SD_Read_Byte() << 8;
+	uiCRC |= SD_Read_Byte();
+
+	if (ucSD_CRCOn && uiCRC != uiCRC16_ComputeCRCwithInit(pucData, SD_CARD_BLOCKLEN, 0))
+		return SD_FAILED;
+
+	return SD_SUCCESS;
+}
+
 //////////////////////////////////////////////////////////////////////////////////////
 //! \brief This function waits for a write operation to finish
 //!
-//! This function reads in the result byte (0E5 = success) from a write operation and
-//! then polls the card until it has finished its operation (no more 0s returned)
+//! This function reads in the data response token (xxx00101 = accepted) from a write
+//! operation and then polls the card until it has finished its operation (no more 0s
+//! returned).  A block whose CRC did not match is rejected with xxx01011.
 //!
 //! \param none
 //! \return error code
@@ -818,7 +1295,12 @@ unsigned char SD_Card_WaitBusy(void)
 		rvalue = SD_Read_Byte();
 	}while (rvalue != 0xFF && i++ < uiTimeout);
 
-	if(response != 0xE5) return SD_FAILED;
+#if 0
+	if((response & SD_DATA_RESP_MASK) == SD_DATA_RESP_CRC)
+		vSERIAL_sout("SD data CRC err\r\n", 17);
+#endif
+
+	if((response & SD_DATA_RESP_MASK) != SD_DATA_RESP_OK) return SD_FAILED;
 	else if (i >= uiTimeout ) return SD_FAILED;
 	else return SD_SUCCESS;
 }
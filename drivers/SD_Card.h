@@ -19,6 +19,8 @@
 //
 // Edited by CP
 //*****************************************************************************
+#include "SD_Log.h"
+
 typedef struct tagSD_R1
 {
 	union
@@ -134,6 +136,9 @@ typedef struct tagSD_DataBlock
 	unsigned char magic_num[4];		//Should always be 'SEGA' for formatted SEGA card (0x53 0x45 0x47 0x41)
 	unsigned char version;			//Compatible SEGA SD driver version
 	unsigned char start_block;		//First block of actual data
+	unsigned char hdr_size;			//Size of the header at the start of every log block (SD_BLK_HDR_SZ)
+	unsigned char index_interval;	//Block slots per index group (SD_LOG_INDEX_INTERVAL)
+	unsigned char volume[2];		//Volume id stamped in every block written since the format
 } SD_DataBlock;
 
 //SD Information Defines
@@ -150,7 +155,7 @@ typedef struct tagSD_DataBlock
 #define SD_FAILED  0x01
 
 //Misc. Defines
-#define SD_DRIVER_VERSION	0x02																													// Version of the driver
+#define SD_DRIVER_VERSION	0x03																													// Version of the driver
 #define SD_CARD_CODE_METABLOCK		1																											// Block where metadata about program code is stored
 #define SD_CARD_CODE_STARTBLOCK		2																											// Block where program code is stored
 #define SD_CARD_CODE_ALLOCATION		40																										// Number of blocks allocated to program code
@@ -158,23 +163,47 @@ typedef struct tagSD_DataBlock
 #define SD_CARD_START_BLOCK (SD_CARD_DATA_BLOCK + 1)																		// First block of actual data
 #define SD_CARD_BLOCKLEN	512
 #define SD_CMD_TIMEOUT		300
+
+//! \def SD_WRITE_READBACK
+//! \brief Set to 1 to read every flushed block back and compare its CRC.  Writes are
+//! already checked by the data response token and CRC16, this is a paranoid extra.
+#ifndef SD_WRITE_READBACK
+#define SD_WRITE_READBACK	0
+#endif
 #define MSK_TOK_DATAERROR 	0xE0
-#define SD_IDLE_CRC			0x95
-#define SD_IFCOND_CRC		0x87
-#define SD_DEFAULT_CRC		0xFF
+
+//! \def SD_SESSION_INIT_TRIES
+//! \brief Init sequences tried when a session opens
+#define SD_SESSION_INIT_TRIES	50
+
+//! \def SD_SESSION_IDLE_SLOTS
+//! \brief Whole slots an unused session stays powered, 0 powers down at the end of the slot it was used in
+#ifndef SD_SESSION_IDLE_SLOTS
+#define SD_SESSION_IDLE_SLOTS	0
+#endif
 
 //Driver API Prototypes
 unsigned char ucSD_Init(void);
 void vSD_PowerOn(void);
 void vSD_PowerOff(void);
+void vSD_HoldPower(unsigned char ucHold);
+unsigned char ucSD_SessionOpen(void);
+void vSD_SessionClose(void);
+void vSD_SessionEndOfSlot(void);
 unsigned long ulSD_GetCapacity(void);
 unsigned char ucSD_GetType(void);
 char SD_Write_Block(uint8 *pucData_TXBuffer, unsigned long ulAddress);
 unsigned char SD_Read_Block(uint8 *pucData_RXBuffer, unsigned long ulAddress);
 char SD_Erase_Block(unsigned long ulBlockNum);
-unsigned char SD_Format();
-unsigned char SD_CheckFormat();
+unsigned char SD_Format(unsigned int uiVolume);
+unsigned char SD_CheckFormat(unsigned char *pucBlock);
+void vSD_SealBlock(unsigned char *pucBlock, unsigned char ucType, unsigned int uiVolume);
+unsigned char ucSD_CheckBlock(unsigned char *pucBlock, unsigned int uiVolume);
+unsigned long ulSD_FindNewestBlock(unsigned char *pucBlock);
 unsigned char SD_Read_MultipleBlocks(unsigned char *pucData_RXBuffer, unsigned long ulStartBlock, uchar ucBlockCount);
+unsigned char SD_Write_MultipleBlocks_Start(unsigned long ulStartBlock, uchar ucBlockCount);
+unsigned char SD_Write_MultipleBlocks_Next(unsigned char *pucData_TXBuffer);
+unsigned char SD_Write_MultipleBlocks_Stop(void);
 unsigned char ucSD_CheckForCard(void);
 
 #endif
@@ -0,0 +1,102 @@
+#ifndef SD_LOG_H
+#define SD_LOG_H
+///////////////////////////////////////////////////////////////////////////////
+//! \file SD_Log.h
+//! \brief On-card layout of the SD card data log
+//!
+//! Only defines live here so the host tools can read cards with the same
+//! header the firmware writes them with.  All multi-byte fields are big
+//! endian like the rest of the wire formats.
+//!
+//! The card is a circular log of 512 byte blocks starting at the block
+//! after the superblock.  Every block carries a header with a sequence
+//! number that increases by one for each new FRAM page, the time range of
+//! the messages in it and a CRC over the whole block.  Every
+//! SD_LOG_INDEX_INTERVAL-th block slot holds an index block listing the
+//! headers of the data blocks before it, so a reader can skim the card
+//! one group at a time.
+//!
+//! Sequence numbers only grow, so the newest block is the last one from
+//! the start of the log whose sequence is not below the sequence of the
+//! first block, and can be found by binary search.  Blocks left over from
+//! an earlier format carry a different volume id and are ignored.
+//!
+//! @addtogroup SD_Card
+//! @{
+///////////////////////////////////////////////////////////////////////////////
+
+//! \def SD_LOG_SUPERBLOCK
+//! \brief Block holding the superblock (same as SD_CARD_DATA_BLOCK)
+#define SD_LOG_SUPERBLOCK			43
+
+//! \def SD_LOG_MIN_VERSION
+//! \brief First driver version that writes this layout
+#define SD_LOG_MIN_VERSION			0x03
+
+/**
+ * Superblock: ['SEGA' 4][version 1][start block 1][header size 1]
+ * [index interval 1][volume 2]
+ **/
+#define SD_SB_IDX_MAGIC				0
+#define SD_SB_IDX_VERSION			4
+#define SD_SB_IDX_START_BLOCK		5
+#define SD_SB_IDX_HDR_SZ			6
+#define SD_SB_IDX_INDEX_INTERVAL	7
+#define SD_SB_IDX_VOLUME			8
+
+/**
+ * Block header: [magic 2][type 1][carry 1][volume 2][seq 4][first time 4]
+ * [last time 4][end 2][CRC 2]
+ *
+ * carry	bytes after the header that finish a message from the previous block
+ * end		offset one past the last byte written to the block
+ * CRC		uiCRC16_ComputeBlockCRC() of the whole block with the CRC field zeroed
+ **/
+#define SD_BLK_IDX_MAGIC			0
+#define SD_BLK_IDX_TYPE				2
+#define SD_BLK_IDX_CARRY			3
+#define SD_BLK_IDX_VOLUME			4
+#define SD_BLK_IDX_SEQ				6
+#define SD_BLK_IDX_FIRST_TIME		10
+#define SD_BLK_IDX_LAST_TIME		14
+#define SD_BLK_IDX_END				18
+#define SD_BLK_IDX_CRC				20
+
+//! \def SD_BLK_HDR_SZ
+//! \brief Size of the block header
+#define SD_BLK_HDR_SZ				22
+
+//! \def SD_BLK_MAGIC
+//! \brief Marks a log block ('LG')
+#define SD_BLK_MAGIC				0x4C47
+
+#define SD_BLK_TYPE_DATA			1
+#define SD_BLK_TYPE_INDEX			2
+
+//! \def SD_LOG_INDEX_INTERVAL
+//! \brief Block slots per index group, the last slot of each group is the index block
+#define SD_LOG_INDEX_INTERVAL		32
+
+//! \def SD_LOG_INDEX_ENTRIES
+//! \brief Data blocks listed in one index block
+#define SD_LOG_INDEX_ENTRIES		(SD_LOG_INDEX_INTERVAL - 1)
+
+/**
+ * Index entry: [seq 4][first time 4][last time 4], a copy of the same
+ * fields of the data block in that slot of the group.
+ **/
+#define SD_IDX_ENT_SEQ				0
+#define SD_IDX_ENT_FIRST_TIME		4
+#define SD_IDX_ENT_LAST_TIME		8
+#define SD_IDX_ENT_SZ				12
+
+//! \def SD_LOG_SLOT
+//! \brief Position of a block in its index group
+#define SD_LOG_SLOT(ulBlk, ulStart)			((unsigned char) (((ulBlk) - (ulStart)) % SD_LOG_INDEX_INTERVAL))
+
+//! \def SD_LOG_IS_INDEX
+//! \brief Non zero if the block slot holds an index block
+#define SD_LOG_IS_INDEX(ulBlk, ulStart)		(SD_LOG_SLOT(ulBlk, ulStart) == SD_LOG_INDEX_ENTRIES)
+
+//! @}
+#endif //SD_LOG_H
@@ -847,9 +847,10 @@ RadioRetCode_t unADF7020_LoadTXBuffer(uint8 * pBuffer)
 {
 	uint16 unLoopCount;
 
-	/* Do not allow this function to run if the state machine is in the
-	 * transmitting state. */
-	if ((ADF7020_Driver.eRadioState == TX_IDLE) || (ADF7020_Driver.eRadioState == TX_ACTIVE))
+	/* Do not allow this function to run while a packet is being clocked out.
+	 * TX_IDLE is fine: a window of packets is sent back to back without
+	 * leaving TX mode. */
+	if (ADF7020_Driver.eRadioState == TX_ACTIVE)
 	{
 		return ADF7020_BAD_STATE_FOR_ACTION;
 	}
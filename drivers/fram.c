@@ -65,6 +65,10 @@ unsigned int g_uiUnlockStart = 0xFFFF;
 //! \brief End address of unlocked memory
 unsigned int g_uiUnlockEnd = 0xFFFF;
 
+//! \var ucFRAM_TxnDepth
+//! \brief Number of open transactions, the SPI bus is left on while > 0
+static uchar ucFRAM_TxnDepth = 0;
+
 
 /******************  vFRAM_init()  *******************************************
 *
@@ -108,6 +112,70 @@ void vFRAM_quit(
 
 	}/* END: vFRAM_quit() */
 
+/******************  vFRAM_acquire()  ****************************************
+*
+* Turn on the bus for a single access unless a transaction already has it on
+*
+*******************************************************************************/
+static void vFRAM_acquire(
+		void
+		)
+	{
+
+	if(ucFRAM_TxnDepth == 0)
+		vFRAM_init();
+
+	}/* END: vFRAM_acquire() */
+
+/******************  vFRAM_release()  ****************************************
+*
+* Turn off the bus after a single access unless a transaction is open
+*
+*******************************************************************************/
+static void vFRAM_release(
+		void
+		)
+	{
+
+	if(ucFRAM_TxnDepth == 0)
+		vFRAM_quit();
+
+	}/* END: vFRAM_release() */
+
+/******************  vFRAM_BeginTxn()  ***************************************
+*
+* Open a transaction.  The SPI bus is brought up once and every read and
+* write until the matching vFRAM_EndTxn() reuses it.  Transactions nest.
+*
+*******************************************************************************/
+void vFRAM_BeginTxn(
+		void
+		)
+	{
+
+	if(ucFRAM_TxnDepth++ == 0)
+		vFRAM_init();
+
+	}/* END: vFRAM_BeginTxn() */
+
+/******************  vFRAM_EndTxn()  *****************************************
+*
+* Close a transaction, the bus is shut off when the outermost one closes
+*
+*******************************************************************************/
+void vFRAM_EndTxn(
+		void
+		)
+	{
+
+	if(ucFRAM_TxnDepth == 0)
+		return;
+
+	if(--ucFRAM_TxnDepth == 0)
+		vFRAM_quit();
+
+	}/* END: vFRAM_EndTxn() */
+
 ////////////////////////////////////////////////////////////////////////
 //! \fn vFRAM_Security
 //!
@@ -330,7 +398,8 @@ static uchar ucFRAM_bout(
 *
 * Return the data at a specified address
 *
-* NOTE: This routine turn on the SPI bus on entry and off on exit
+* NOTE: This routine turn on the SPI bus on entry and off on exit unless a
+*		transaction is open
 *
 ******************************************************************************/
 
@@ -344,12 +413,12 @@ uchar ucFRAM_read_B8(
 	// Why not be optimistic
 	ucRetVal = SUCCESS;
 
-	vFRAM_init();
+	vFRAM_acquire();
 
 	if(ucFRAM_bin(uiAddr, ucData) == ACCESS_VIOLATION)
 		ucRetVal = ACCESS_VIOLATION;
 
-	vFRAM_quit();
+	vFRAM_release();
 
 	// Report an access violation
 	if (ucRetVal == ACCESS_VIOLATION)
@@ -384,12 +453,12 @@ unsigned char ucFRAM_write_B8(
 	// Why not be optimistic
 	ucRetVal = SUCCESS;
 
-	vFRAM_init();
+	vFRAM_acquire();
 
 	if(ucFRAM_bout(uiAddr,ucData) == ACCESS_VIOLATION)
 		ucRetVal = ACCESS_VIOLATION;
 
-	vFRAM_quit();
+	vFRAM_release();
 
 	// Report an access violation
 	if (ucRetVal == ACCESS_VIOLATION)
@@ -405,215 +474,293 @@ unsigned char ucFRAM_write_B8(
 
 
 
-/***********************  ucFRAM_read_B16  ***********************************
+/****************** ucFRAM_range_ok()  ***************************************
 *
-* Read a Word from the FRAM
+* Check that a whole range of addresses lies in the unlocked window
 *
+* RET:	SUCCESS or ACCESS_VIOLATION
 *
-*****************************************************************************/
+******************************************************************************/
 
-uchar ucFRAM_read_B16(
+static uchar ucFRAM_range_ok(
 		uint uiAddr,
-		uint *uiData
+		uint uiCount
 		)
 	{
-	uchar ucHI_val;
-	uchar ucLO_val;
-	uint uiTmp;
-	uchar ucRetVal;
 
-	// Why not be optimistic
-	ucRetVal = SUCCESS;
+	if(uiCount == 0)
+		return SUCCESS;
 
-	vFRAM_init();
+	if(uiAddr < g_uiUnlockStart || uiAddr > g_uiUnlockEnd)
+		return ACCESS_VIOLATION;
 
-	/* GET THE HI BYTE VALUE */
-	if(ucFRAM_bin(uiAddr, &ucHI_val) == ACCESS_VIOLATION)
-		ucRetVal = ACCESS_VIOLATION;
+	if((uiCount - 1) > (g_uiUnlockEnd - uiAddr))
+		return ACCESS_VIOLATION;
 
-	/* GET THE LOW BYTE VALUE */
-	uiAddr++;
-	if(ucFRAM_bin(uiAddr, &ucLO_val) == ACCESS_VIOLATION)
-		ucRetVal = ACCESS_VIOLATION;
+	return SUCCESS;
 
-	vFRAM_quit();
+	}/* END: ucFRAM_range_ok() */
 
-	uiTmp = (uint) ucHI_val;
-	uiTmp =  uiTmp << 8;
-	uiTmp |= (uint) ucLO_val;
 
-	*uiData = uiTmp;
+/****************** vFRAM_burst_out()  ***************************************
+*
+* Write a run of bytes in one FRAM write cmd.  The FRAM increments the addr
+* on its own so only one cmd header is sent no matter how long the run is.
+* If ucpData is NULL the run is filled with ucFillVal.
+*
+* NOTE: This routine assumes that the SPI bus is already turned on and
+*		that the range has been checked.
+*
+******************************************************************************/
 
-	// Report an access violation
-	if (ucRetVal == ACCESS_VIOLATION)
+static void vFRAM_burst_out(
+		uint uiAddr,
+		const uchar *ucpData,
+		uchar ucFillVal,
+		uint uiCount
+		)
+	{
+
+	if(uiAddr <= 16 && (uiAddr + uiCount) > 16)
+		ucLastTaskIndextoWriteToFRAM = g_ucaCurrentTskIndex;
+
+	vFRAM_send_WE_cmd();				//turn on write enable
+
+	FRAM_SEL_OUT_PORT &= ~FRAM_SEL_BIT;					//select the chip
+
+	vSPI_bout(FRAM_WRITE_DATA_CMD);		//CMD with zro HI addr bit
+	vSPI_bout((uchar)((uiAddr & 0x1FFF)>>8));	//HI addr
+	vSPI_bout((uchar)(uiAddr & 0xFF));			//LO addr
+
+	// Long runs go out by DMA
+	if(ucpData != NULL)
+		vSPI_TXBytes((uchar *) ucpData, uiCount);
+	else
+		vSPI_FillBytes(ucFillVal, uiCount);
+
+	/* DROP FRAM CHIP SELECT FOR NEXT CMD */
+	FRAM_SEL_OUT_PORT |= FRAM_SEL_BIT;								//deselect chip
+
+	return;
+
+	}/* END: vFRAM_burst_out() */
+
+
+/****************** ucFRAM_read_block()  *************************************
+*
+* Read a run of bytes from the FRAM in a single read cmd.
+*
+* The access check is done once for the whole range.  Nothing is read if any
+* part of the range is locked.
+*
+* NOTE: This routine turn on the SPI bus on entry and off on exit unless a
+*		transaction is open
+*
+******************************************************************************/
+
+uchar ucFRAM_read_block(
+		uint uiAddr,
+		uchar *ucpData,
+		uint uiCount
+		)
+	{
+
+	if(ucFRAM_range_ok(uiAddr, uiCount) == ACCESS_VIOLATION)
+		{
 		vFRAM_ReportAccessViolation();
-	
-	return(ucRetVal);
+		return ACCESS_VIOLATION;
+		}
 
-	}/* END: uiFRAM_read_B16() */
+	if(uiCount == 0)
+		return SUCCESS;
 
+	vFRAM_acquire();
 
+	FRAM_SEL_OUT_PORT &= ~FRAM_SEL_BIT;							//select the chip
 
+	vSPI_bout(FRAM_READ_DATA_CMD);			//CMD
+	vSPI_bout((uchar)((uiAddr & 0x1FFF)>>8));	//HI addr
+	vSPI_bout((uchar)(uiAddr & 0xFF));			//LO addr
 
+	vSPI_RX_Bytes(ucpData, uiCount);			//Read the data, long runs come in by DMA
 
+	/* DROP FRAM CHIP SELECT FOR NEXT CMD */
+	FRAM_SEL_OUT_PORT |= FRAM_SEL_BIT;								//deselect chip
 
-/***********************  ucFRAM_write_B16  ***********************************
+	vFRAM_release();
+
+	return SUCCESS;
+
+	}/* END: ucFRAM_read_block() */
+
+
+/****************** ucFRAM_write_block()  ************************************
 *
-* Write a 16 bit value to the FRAM
+* Write a run of bytes to the FRAM in a single write cmd.
 *
-* NOTE: This routine assumes that the SPI bus is already turned on.
+* The access check is done once for the whole range.  Nothing is written if
+* any part of the range is locked.
 *
-*****************************************************************************/
+* NOTE: This routine turn on the SPI bus on entry and off on exit unless a
+*		transaction is open
+*
+******************************************************************************/
 
-uchar ucFRAM_write_B16(
+uchar ucFRAM_write_block(
 		uint uiAddr,
-		uint uiData
+		const uchar *ucpData,
+		uint uiCount
 		)
 	{
-	uchar ucVal;
-	uchar ucRetVal;
 
-	// Why not be optimistic
-	ucRetVal = SUCCESS;
+	if(ucFRAM_range_ok(uiAddr, uiCount) == ACCESS_VIOLATION)
+		{
+		vFRAM_ReportAccessViolation();
+		return ACCESS_VIOLATION;
+		}
 
-	vFRAM_init();
+	if(uiCount == 0)
+		return SUCCESS;
 
-	/* WRITE THE HI BYTE VALUE */
-	ucVal = ((uchar) (uiData >> 8));
-	if(ucFRAM_bout(uiAddr, ucVal) == ACCESS_VIOLATION)
-		ucRetVal = ACCESS_VIOLATION;
-	
-	/* INC THE ADDR PTR */
-	uiAddr++;
+	vFRAM_acquire();
+	vFRAM_burst_out(uiAddr, ucpData, 0, uiCount);
+	vFRAM_release();
 
-	/* WRITE THE LOW BYTE VALUE */
-	ucVal = ((uchar) uiData);
-	if(ucFRAM_bout(uiAddr, ucVal) == ACCESS_VIOLATION)
-		ucRetVal = ACCESS_VIOLATION;
+	return SUCCESS;
 
-	vFRAM_quit();
+	}/* END: ucFRAM_write_block() */
 
-	// Report an access violation
-	if (ucRetVal == ACCESS_VIOLATION)
+
+/****************** ucFRAM_fill_block()  *************************************
+*
+* Set a run of FRAM bytes to one value in a single write cmd.
+*
+* NOTE: This routine turn on the SPI bus on entry and off on exit unless a
+*		transaction is open
+*
+******************************************************************************/
+
+uchar ucFRAM_fill_block(
+		uint uiAddr,
+		uchar ucSetVal,
+		uint uiCount
+		)
+	{
+
+	if(ucFRAM_range_ok(uiAddr, uiCount) == ACCESS_VIOLATION)
+		{
 		vFRAM_ReportAccessViolation();
+		return ACCESS_VIOLATION;
+		}
 
-	return ucRetVal;
+	if(uiCount == 0)
+		return SUCCESS;
 
-	}/* END: ucFRAM_write_B16() */
+	vFRAM_acquire();
+	vFRAM_burst_out(uiAddr, NULL, ucSetVal, uiCount);
+	vFRAM_release();
+
+	return SUCCESS;
 
+	}/* END: ucFRAM_fill_block() */
 
 
-/***********************  ucFRAM_read_B32  **********************************
+/***********************  ucFRAM_read_B16  ***********************************
 *
-* Read a 32bit word from the FRAM
+* Read a Word from the FRAM
 *
-* NOTE: This routine assumes that the SPI bus is already turned on.
 *
 *****************************************************************************/
 
-uchar ucFRAM_read_B32(
+uchar ucFRAM_read_B16(
 		uint uiAddr,
-		ulong *ulData
+		uint *uiData
 		)
 	{
-	uchar ucXI_val;
-	uchar ucHI_val;
-	uchar ucMD_val;
-	uchar ucLO_val;
+	uchar ucaVal[2];
 	uchar ucRetVal;
 
-	// Why not be optimistic
-	ucRetVal = SUCCESS;
+	ucRetVal = ucFRAM_read_block(uiAddr, ucaVal, 2);
 
-	vFRAM_init();
+	*uiData = ((uint) ucaVal[0] << 8) | (uint) ucaVal[1];
 
-	// Get the XI byte val and increment address
-	if(ucFRAM_bin(uiAddr++, &ucXI_val) == ACCESS_VIOLATION)
-		ucRetVal = ACCESS_VIOLATION;
+	return(ucRetVal);
 
-	// Get the HI byte val and increment address
-	if(ucFRAM_bin(uiAddr++, &ucHI_val) == ACCESS_VIOLATION)
-			ucRetVal = ACCESS_VIOLATION;
-	
-	// Get the MD byte val and increment address
-	if(ucFRAM_bin(uiAddr++, &ucMD_val) == ACCESS_VIOLATION)
-			ucRetVal = ACCESS_VIOLATION;
+	}/* END: uiFRAM_read_B16() */
 
-	// Get the LO byte val and increment address
-	if(ucFRAM_bin(uiAddr, &ucLO_val) == ACCESS_VIOLATION)
-		ucRetVal = ACCESS_VIOLATION;
 
-	vFRAM_quit();
 
-	*ulData = ucXI_val;
-	*ulData <<= 8;
-	*ulData |= (ulong) ucHI_val;
-	*ulData <<= 8;
-	*ulData |= (ulong) ucMD_val;
-	*ulData <<= 8;
-	*ulData |= (ulong) ucLO_val;
 
-	// Report an access violation
-	if (ucRetVal == ACCESS_VIOLATION)
-		vFRAM_ReportAccessViolation();
 
-	return ucRetVal;
 
-	}/* END: ucFRAM_read_B32() */
+/***********************  ucFRAM_write_B16  ***********************************
+*
+* Write a 16 bit value to the FRAM
+*
+*****************************************************************************/
 
+uchar ucFRAM_write_B16(
+		uint uiAddr,
+		uint uiData
+		)
+	{
+	uchar ucaVal[2];
 
+	ucaVal[0] = (uchar) (uiData >> 8);
+	ucaVal[1] = (uchar) uiData;
 
+	return ucFRAM_write_block(uiAddr, ucaVal, 2);
 
+	}/* END: ucFRAM_write_B16() */
 
 
-/***********************  ucFRAM_write_B32  ***********************************
-*
-* Write a 32 bit value to the FRAM
+
+/***********************  ucFRAM_read_B32  **********************************
 *
-* NOTE: This routine assumes that the SPI bus is already turned on.
+* Read a 32bit word from the FRAM
 *
 *****************************************************************************/
 
-unsigned char ucFRAM_write_B32(
+uchar ucFRAM_read_B32(
 		uint uiAddr,
-		ulong ulData
+		ulong *ulData
 		)
 	{
-	uchar ucVal;
+	uchar ucaVal[4];
 	uchar ucRetVal;
 
-	// Why not be optimistic
-	ucRetVal = SUCCESS;
+	ucRetVal = ucFRAM_read_block(uiAddr, ucaVal, 4);
 
-	vFRAM_init();
+	*ulData = ((ulong) ucaVal[0] << 24) | ((ulong) ucaVal[1] << 16) | ((ulong) ucaVal[2] << 8) | (ulong) ucaVal[3];
 
-	/* WRITE THE XI BYTE VALUE */
-	ucVal = ((uchar) (ulData >> 24));
-	if(ucFRAM_bout(uiAddr++, ucVal) == ACCESS_VIOLATION)
-		ucRetVal = ACCESS_VIOLATION;
+	return ucRetVal;
 
-	/* WRITE THE HI BYTE VALUE */
-	ucVal = ((uchar) (ulData >> 16));
-	if(ucFRAM_bout(uiAddr++, ucVal) == ACCESS_VIOLATION)
-			ucRetVal = ACCESS_VIOLATION;
-	
-	/* WRITE THE MD BYTE VALUE */
-	ucVal = ((uchar) (ulData >> 8));
-	if(ucFRAM_bout(uiAddr++, ucVal) == ACCESS_VIOLATION)
-		ucRetVal = ACCESS_VIOLATION;
+	}/* END: ucFRAM_read_B32() */
 
-	/* WRITE THE LOW BYTE VALUE */
-	ucVal = ((uchar) ulData);
-	if(ucFRAM_bout(uiAddr, ucVal) == ACCESS_VIOLATION)
-			ucRetVal = ACCESS_VIOLATION;
 
-	vFRAM_quit();
 
-	// Report an access violation
-	if (ucRetVal == ACCESS_VIOLATION)
-		vFRAM_ReportAccessViolation();
 
-	return ucRetVal;
+
+
+/***********************  ucFRAM_write_B32  ***********************************
+*
+* Write a 32 bit value to the FRAM
+*
+*****************************************************************************/
+
+unsigned char ucFRAM_write_B32(
+		uint uiAddr,
+		ulong ulData
+		)
+	{
+	uchar ucaVal[4];
+
+	ucaVal[0] = (uchar) (ulData >> 24);
+	ucaVal[1] = (uchar) (ulData >> 16);
+	ucaVal[2] = (uchar) (ulData >> 8);
+	ucaVal[3] = (uchar) ulData;
+
+	return ucFRAM_write_block(uiAddr, ucaVal, 4);
 
 	}/* END: vFRAM_write_B32() */
 
@@ -634,14 +781,11 @@ void vFRAM_fillFramBlk(
 		uchar ucSetVal
 		)
 	{
-	uint uiCurAddr;
 
 	// Unlock the all FRAM for diagnostics
 	vFRAM_Security(0, FRAM_MAX_ADDRESS);
 
-	for (uiCurAddr = uiStartAddr; uiCurAddr < (uiStartAddr + uiCount); uiCurAddr++) {
-		ucFRAM_write_B8(uiCurAddr, ucSetVal);
-	}/* END: for(uiCurAddr) */
+	ucFRAM_fill_block(uiStartAddr, ucSetVal, uiCount);	//lint !e534
 
 	// Lock the all FRAM
 	vFRAM_Security(0xFFFF, 0xFFFF);
@@ -56,6 +56,24 @@
 		unsigned long ulData
 		);
 
+	unsigned char ucFRAM_read_block(
+		unsigned int uiAddr,
+		unsigned char *ucpData,
+		unsigned int uiCount
+		);
+
+	unsigned char ucFRAM_write_block(
+		unsigned int uiAddr,
+		const unsigned char *ucpData,
+		unsigned int uiCount
+		);
+
+	unsigned char ucFRAM_fill_block(
+		unsigned int uiAddr,
+		unsigned char ucSetVal,
+		unsigned int uiCount
+		);
+
 	void vFRAM_fillFramBlk(
 		unsigned int uiStartAddr,
 		unsigned int uiCount,
@@ -75,6 +93,10 @@
 
 	void vFRAM_Security(unsigned int uiStartAddr, unsigned int uiEndAddress);
 
+	void vFRAM_BeginTxn(void);
+
+	void vFRAM_EndTxn(void);
+
 #endif /* FRAM_H_INCLUDED */
 
 /* --------------------------  END of MODULE  ------------------------------- */
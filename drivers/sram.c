@@ -171,6 +171,193 @@ void vSRAM_write_B8(
 
 
 
+/************************  vSRAM_readBlock() *******************************
+*
+* Read a block of bytes from the RAM DISK.
+*
+* The XI address bits are latched once per 64K page, the bus is turned
+* around once and chip enable is held for the whole block.  Only the low
+* address word changes per byte so a block costs a single interrupt-masked
+* section instead of one per byte.
+*
+******************************************************************************/
+
+void vSRAM_readBlock(
+		USL uslAddr,
+		unsigned char *pucData,
+		unsigned int uiCount
+		)
+	{
+	unsigned char ucAddrXI;
+	unsigned int uiAddrTwoByte;
+
+	if(uiCount == 0)
+		return;
+
+	/* BREAK THE ADDRESS INTO BYTES */
+	uiAddrTwoByte = ((unsigned int) uslAddr);
+	ucAddrXI = ((unsigned char) (uslAddr >> 16)) & SRAM_ADDR_HI_2BIT;
+
+	__bic_SR_register(GIE);						// No interrupts
+
+	/* LATCH IN THE XI ADDR BYTE */
+	SRAM_ADDR_HI_PORT &= ~SRAM_ADDR_HI_2BIT;	//clr the bits
+	SRAM_ADDR_HI_PORT |= ucAddrXI;				//set the bits
+
+	/* TURN ON READ ENABLE */
+	SRAM_RW_PORT |= SRAM_READWRITE;			//Turn on read
+
+	/* SET BYTE REG TO INPUT */
+	SRAM_DATA_DIR_PORT = 0x00;		  			//convert latch to an input
+
+	/* TURN ON CHIP ENABLE */
+	SRAM_SEL_PORT |= SRAM_CHIP_SELECT;		//enable the data onto the bus
+
+	while(uiCount--)
+		{
+		// LATCH IN THE LOWER TWO ADDR BYTES
+		SRAM_ADDR_LO_PORT = uiAddrTwoByte;
+
+		/* READ THE DATA */
+		*pucData++ = SRAM_DATA_IN_PORT;
+
+		/* MOVE TO THE NEXT 64K PAGE IF WE ROLLED OVER */
+		if(++uiAddrTwoByte == 0)
+			{
+			ucAddrXI = (ucAddrXI + 1) & SRAM_ADDR_HI_2BIT;
+			SRAM_ADDR_HI_PORT &= ~SRAM_ADDR_HI_2BIT;
+			SRAM_ADDR_HI_PORT |= ucAddrXI;
+			}
+		}
+
+	/* TURN OFF CHIP ENABLE */
+	SRAM_SEL_PORT &= ~SRAM_CHIP_SELECT;  		//disable the data from the bus
+
+	__bis_SR_register(GIE);						// Yes interrupts
+
+	return;
+
+	}/* END: vSRAM_readBlock() */
+
+
+
+
+
+
+/************************  vSRAM_writeBlock() *******************************
+*
+* Write a block of bytes to the RAM DISK.
+*
+* Same idea as vSRAM_readBlock(). Write enable and the bus direction are set
+* once for the block.  The chip select is still flopped per byte because it
+* is what clocks the data into the part.
+*
+******************************************************************************/
+
+void vSRAM_writeBlock(
+		USL uslAddr,
+		const unsigned char *pucData,
+		unsigned int uiCount
+		)
+	{
+	unsigned char ucAddrXI;
+	unsigned int uiAddrTwoByte;
+
+	if(uiCount == 0)
+		return;
+
+	/* BREAK THE ADDRESS INTO BYTES */
+	uiAddrTwoByte = ((unsigned int) uslAddr);
+	ucAddrXI = ((unsigned char) (uslAddr >> 16)) & SRAM_ADDR_HI_2BIT;
+
+	__bic_SR_register(GIE);								// No interrupts
+
+	/* LATCH IN THE XI ADDR BYTE */
+	SRAM_ADDR_HI_PORT &= ~SRAM_ADDR_HI_2BIT;			//clr the bits
+	SRAM_ADDR_HI_PORT |= ucAddrXI;						//set the bits
+
+	/* TURN ON WRITE ENABLE */
+	SRAM_RW_PORT &= ~SRAM_READWRITE;					//Turn on write
+
+	/* MAKE SURE DATA IS POINTING IN RIGHT DIRECTION */
+	SRAM_DATA_DIR_PORT = 0xFF;					  		//restore the latch to an output
+
+	while(uiCount--)
+		{
+		// LATCH IN THE LOWER TWO ADDR BYTES
+		SRAM_ADDR_LO_PORT = uiAddrTwoByte;
+
+		/* FLOP THE CLK UP */
+		SRAM_SEL_PORT |= SRAM_CHIP_SELECT;				//clock in the data
+
+		/* WRITE THE DATA */
+		SRAM_DATA_OUT_PORT = *pucData++;				//stuff data
+
+		/* FLOP THE CLK DOWN */
+		SRAM_SEL_PORT &= ~SRAM_CHIP_SELECT;				//set select back to deselect
+
+		/* MOVE TO THE NEXT 64K PAGE IF WE ROLLED OVER */
+		if(++uiAddrTwoByte == 0)
+			{
+			ucAddrXI = (ucAddrXI + 1) & SRAM_ADDR_HI_2BIT;
+			SRAM_ADDR_HI_PORT &= ~SRAM_ADDR_HI_2BIT;
+			SRAM_ADDR_HI_PORT |= ucAddrXI;
+			}
+		}
+
+	/* TURN OFF WRITE ENABLE */
+	SRAM_RW_PORT |= SRAM_READWRITE;					//set Write ena back to read
+
+	/* SET DATA BUS BITS BACK TO INPUT */
+	SRAM_DATA_DIR_PORT = 0x00;					  		//restore the latch to an intput
+
+	__bis_SR_register(GIE);								// Yes interrupts
+
+	return;
+
+	}/* END: vSRAM_writeBlock() */
+
+
+
+
+
+
+/************************  vSRAM_fillBlock() *******************************
+*
+* Fill a block of the RAM DISK with a single value.
+*
+******************************************************************************/
+
+void vSRAM_fillBlock(
+		USL uslAddr,
+		unsigned char ucDataByte,
+		unsigned int uiCount
+		)
+	{
+	unsigned char ucaFill[16];
+	unsigned char ucii;
+	unsigned int uiChunk;
+
+	for(ucii = 0; ucii < sizeof(ucaFill); ucii++)
+		ucaFill[ucii] = ucDataByte;
+
+	while(uiCount != 0)
+		{
+		uiChunk = (uiCount > sizeof(ucaFill)) ? sizeof(ucaFill) : uiCount;
+		vSRAM_writeBlock(uslAddr, ucaFill, uiChunk);
+		uslAddr += uiChunk;
+		uiCount -= uiChunk;
+		}
+
+	return;
+
+	}/* END: vSRAM_fillBlock() */
+
+
+
+
+
+
 /***********************  uiSRAM_read_B16  ***********************************
 *
 * Read a Word from the SRAM
@@ -182,22 +369,14 @@ unsigned int uiSRAM_read_B16(
 		USL uslAddr		
 		)
 	{
-	unsigned char ucHI_val;
-	unsigned char ucLO_val;
+	unsigned char ucaVal[2];
 	unsigned int uiRetVal;
 
-	/* GET THE HI BYTE VALUE */
-	ucHI_val = ucSRAM_read_B8(uslAddr);
-	
-	/* INC THE ADDR PTR */
-	uslAddr++;
-
-	/* GET THE LOW BYTE VALUE */
-	ucLO_val = ucSRAM_read_B8(uslAddr);
+	vSRAM_readBlock(uslAddr, ucaVal, 2);
 
-	uiRetVal = (unsigned int)ucHI_val;
+	uiRetVal = (unsigned int)ucaVal[0];
 	uiRetVal =  uiRetVal << 8;
-	uiRetVal |= (unsigned int) ucLO_val;
+	uiRetVal |= (unsigned int) ucaVal[1];
 
 	return(uiRetVal);
 
@@ -220,18 +399,12 @@ void vSRAM_write_B16(
 		unsigned int uiData
 		)
 	{
-	unsigned char ucVal;
-
-	/* WRITE THE HI BYTE VALUE */
-	ucVal = ((unsigned char) (uiData >> 8));
-	vSRAM_write_B8(uslAddr, ucVal);
-	
-	/* INC THE ADDR PTR */
-	uslAddr++;
+	unsigned char ucaVal[2];
 
-	/* WRITE THE LOW BYTE VALUE */
-	ucVal = ((unsigned char) uiData);
-	vSRAM_write_B8(uslAddr, ucVal);
+	/* HI BYTE FIRST */
+	ucaVal[0] = ((unsigned char) (uiData >> 8));
+	ucaVal[1] = ((unsigned char) uiData);
+	vSRAM_writeBlock(uslAddr, ucaVal, 2);
 
 	return;
 
@@ -252,27 +425,16 @@ USL uslSRAM_read_B24(
 		USL uslAddr			
 		)		
 	{
-	unsigned char ucHI_val;
-	unsigned char ucMD_val;
-	unsigned char ucLO_val;
+	unsigned char ucaVal[3];
 	USL uslRetVal;	
 
-	// GET THE HI BYTE VALUE //
-	ucHI_val = ucSRAM_read_B8(uslAddr);
-	
-	// GET THE MID BYTE VALUE //
-	uslAddr++;
-	ucMD_val = ucSRAM_read_B8(uslAddr);
-
-	// GET THE LOW BYTE VALUE //
-	uslAddr++;
-	ucLO_val = ucSRAM_read_B8(uslAddr);
+	vSRAM_readBlock(uslAddr, ucaVal, 3);
 
-	uslRetVal = ucHI_val;
+	uslRetVal = ucaVal[0];
 	uslRetVal <<= 8;
-	uslRetVal |= (USL) ucMD_val; 
+	uslRetVal |= (USL) ucaVal[1]; 
 	uslRetVal <<= 8;
-	uslRetVal |= (USL) ucLO_val; 
+	uslRetVal |= (USL) ucaVal[2]; 
 
 	return(uslRetVal);
 
@@ -296,25 +458,13 @@ void vSRAM_write_B24(
 		USL uslData		
 		)
 	{
-	unsigned char ucVal;
-
-	// WRITE THE HI BYTE VALUE //
-	ucVal = ((unsigned char) (uslData >> 16));
-	vSRAM_write_B8(uslAddr, ucVal);
-	
-	// INC THE ADDR PTR //
-	uslAddr++;
+	unsigned char ucaVal[3];
 
-	// WRITE THE MD BYTE VALUE //
-	ucVal = ((unsigned char) (uslData >> 8));
-	vSRAM_write_B8(uslAddr, ucVal);
-
-	// INC THE ADDR PTR //
-	uslAddr++;
-
-	// WRITE THE LOW BYTE VALUE //
-	ucVal = ((unsigned char) uslData);
-	vSRAM_write_B8(uslAddr, ucVal);
+	// HI BYTE FIRST //
+	ucaVal[0] = ((unsigned char) (uslData >> 16));
+	ucaVal[1] = ((unsigned char) (uslData >> 8));
+	ucaVal[2] = ((unsigned char) uslData);
+	vSRAM_writeBlock(uslAddr, ucaVal, 3);
 
 	return;
 
@@ -334,34 +484,18 @@ unsigned long ulSRAM_read_B32(
 		USL uslAddr		
 		)		
 	{
-	unsigned char ucXI_val;
-	unsigned char ucHI_val;
-	unsigned char ucMD_val;
-	unsigned char ucLO_val;
+	unsigned char ucaVal[4];
 	unsigned long ulRetVal;	
 
-	/* GET THE XI BYTE VALUE */
-	ucXI_val = ucSRAM_read_B8(uslAddr);
-
-	/* GET THE HI BYTE VALUE */
-	uslAddr++;
-	ucHI_val = ucSRAM_read_B8(uslAddr);
-	
-	/* GET THE MID BYTE VALUE */
-	uslAddr++;
-	ucMD_val = ucSRAM_read_B8(uslAddr);
-
-	/* GET THE LOW BYTE VALUE */
-	uslAddr++;
-	ucLO_val = ucSRAM_read_B8(uslAddr);
+	vSRAM_readBlock(uslAddr, ucaVal, 4);
 
-	ulRetVal = ucXI_val;
+	ulRetVal = ucaVal[0];
 	ulRetVal <<= 8;
-	ulRetVal |= (unsigned long) ucHI_val; 
+	ulRetVal |= (unsigned long) ucaVal[1]; 
 	ulRetVal <<= 8;
-	ulRetVal |= (unsigned long) ucMD_val; 
+	ulRetVal |= (unsigned long) ucaVal[2]; 
 	ulRetVal <<= 8;
-	ulRetVal |= (unsigned long) ucLO_val; 
+	ulRetVal |= (unsigned long) ucaVal[3]; 
 
 	return(ulRetVal);
 
@@ -385,32 +519,14 @@ void vSRAM_write_B32(
 		unsigned long ulData
 		)
 	{
-	unsigned char ucVal;
-
-	/* WRITE THE XI BYTE VALUE */
-	ucVal = ((unsigned char) (ulData >> 24));
-	vSRAM_write_B8(uslAddr, ucVal);
-	
-	/* INC THE ADDR PTR */
-	uslAddr++;
-
-	/* WRITE THE HI BYTE VALUE */
-	ucVal = ((unsigned char) (ulData >> 16));
-	vSRAM_write_B8(uslAddr, ucVal);
-
-	/* INC THE ADDR PTR */
-	uslAddr++;
-
-	/* WRITE THE MD BYTE VALUE */
-	ucVal = ((unsigned char) (ulData >> 8));
-	vSRAM_write_B8(uslAddr, ucVal);
-
-	/* INC THE ADDR PTR */
-	uslAddr++;
-
-	/* WRITE THE LOW BYTE VALUE */
-	ucVal = ((unsigned char) ulData);
-	vSRAM_write_B8(uslAddr, ucVal);
+	unsigned char ucaVal[4];
+
+	/* XI BYTE FIRST */
+	ucaVal[0] = ((unsigned char) (ulData >> 24));
+	ucaVal[1] = ((unsigned char) (ulData >> 16));
+	ucaVal[2] = ((unsigned char) (ulData >> 8));
+	ucaVal[3] = ((unsigned char) ulData);
+	vSRAM_writeBlock(uslAddr, ucaVal, 4);
 
 	return;
 
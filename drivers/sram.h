@@ -49,6 +49,24 @@
 		ulong ulData
 		);
 
+	void vSRAM_readBlock(
+		USL uslAddr,
+		uchar *pucData,
+		uint uiCount
+		);
+
+	void vSRAM_writeBlock(
+		USL uslAddr,
+		const uchar *pucData,
+		uint uiCount
+		);
+
+	void vSRAM_fillBlock(
+		USL uslAddr,
+		uchar ucDataByte,
+		uint uiCount
+		);
+
 
 #endif /* SRAM_H_INCLUDED */
 
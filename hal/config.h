@@ -244,6 +244,9 @@
 #define SPI_INTFLAG_REG		(UCB0IFG)
 #define SPI_TX_BUF			(UCB0TXBUF)
 #define SPI_RX_BUF			(UCB0RXBUF)
+#define SPI_STAT_REG		(UCB0STAT)
+#define SPI_DMA_RX_TRIG		18				// DMA trigger UCB0RXIFG
+#define SPI_DMA_TX_TRIG		19				// DMA trigger UCB0TXIFG
 
 //Serial Comm. definitions
 #define UART1_REG_IE				(UCA1IE)
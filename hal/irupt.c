@@ -15,6 +15,7 @@
 #include "SP.h"			//Satellite Processor definitions
 #include "serial.h"
 #include "usci_A0_uart.h"
+#include "spi.h"
 /*********************************************************
  * 					Flags
  ********************************************************/
@@ -614,16 +615,34 @@ __interrupt void WDT_ISR(void)
 	WDTCTL = WDTPW + WDTSSEL_1 + WDTCNTCL + WDTIS_3;
 }
 
-
-
-
-//////////////////  Unused ISRs ////////////////////////
+/////////////////////////////////////////////////////////////////////////
+//! \brief DMA ISR
+//!
+//! Channel 0 is the SPI receive channel, when it has taken the last byte
+//! the transfer is done and the waiting routine is woken from LPM0.
+//!
+//! \param none
+//! \return none
+/////////////////////////////////////////////////////////////////////////
 #pragma vector=DMA_VECTOR
 __interrupt void DMA_ISR(void)
 {
-	__no_operation();
+	switch (__even_in_range(DMAIV, 16))
+	{
+		case DMAIV_DMA0IFG: // SPI transfer complete
+			g_ucSPI_DMADone = 1;
+			__bic_SR_register_on_exit(LPM0_bits);
+		break;
+
+		default:
+		break;
+	}
 }
 
+
+
+
+//////////////////  Unused ISRs ////////////////////////
 #pragma vector=RTC_VECTOR
 __interrupt void RTC_ISR(void)
 {
@@ -23,6 +23,19 @@
 #include "std.h"			//standard definitions
 #include "config.h"			//system configuration description file
 #include "serial.h"			//serial IO port stuff
+#include "spi.h"			//SPI definitions
+
+//! \var g_ucSPI_DMADone
+//! \brief Set by the DMA ISR when the receive channel has taken the last byte
+volatile uchar g_ucSPI_DMADone = 0;
+
+//! \var ucSPI_DMAFill
+//! \brief Byte clocked out when a DMA transfer has no TX data
+static uchar ucSPI_DMAFill;
+
+//! \var ucSPI_DMASink
+//! \brief Landing place for received bytes nobody wants
+static uchar ucSPI_DMASink;
 
 
 //////////////////////////////////////////////////////////////////////////////*
@@ -179,10 +192,90 @@ static unsigned char ucSPI_IO_Transaction(
 
 	}/* END: ucSPI_IO_Transaction() */
 
+//////////////////////////////////////////////////////////////////////////////
+//!
+//! \brief Moves a run of bytes over the SPI port with the DMA controller
+//!
+//! DMA channel 0 empties the RX buffer and channel 1 feeds the TX buffer,
+//! channel 0 has the higher priority so no received byte is overrun.  The
+//! CPU sleeps in LPM0 until channel 0 has taken the last byte and the DMA
+//! interrupt wakes it.
+//!
+//! \param p_ucTXData, bytes to send, NULL sends ucFill
+//! \param p_ucRXData, received bytes, NULL discards them
+//! \param uiByteCount
+//! \param ucFill, byte sent when p_ucTXData is NULL
+//! \return none
+//////////////////////////////////////////////////////////////////////////////
+static void vSPI_DMATransfer(const uchar *p_ucTXData, uchar *p_ucRXData, uint uiByteCount, uchar ucFill)
+{
+	uint16 gie = __get_SR_register() & GIE;               //Store current GIE state
+
+	ucSPI_DMAFill = ucFill;
+
+	// Both channels are triggered by the SPI flags, one byte per trigger
+	DMACTL0 = (SPI_DMA_TX_TRIG << 8) | SPI_DMA_RX_TRIG;
+
+	// Channel 0: RX buffer to memory (or the sink)
+	DMA0CTL = 0;
+	__data16_write_addr((unsigned short) &DMA0SA, (unsigned long) &SPI_RX_BUF);
+	if (p_ucRXData != NULL) {
+		__data16_write_addr((unsigned short) &DMA0DA, (unsigned long) p_ucRXData);
+		DMA0CTL = DMADT_0 | DMADSTINCR_3 | DMASRCINCR_0 | DMASBDB | DMAIE;
+	}
+	else {
+		__data16_write_addr((unsigned short) &DMA0DA, (unsigned long) &ucSPI_DMASink);
+		DMA0CTL = DMADT_0 | DMADSTINCR_0 | DMASRCINCR_0 | DMASBDB | DMAIE;
+	}
+	DMA0SZ = uiByteCount;
+
+	// Channel 1: memory (or the fill byte) to TX buffer
+	DMA1CTL = 0;
+	__data16_write_addr((unsigned short) &DMA1DA, (unsigned long) &SPI_TX_BUF);
+	if (p_ucTXData != NULL) {
+		__data16_write_addr((unsigned short) &DMA1SA, (unsigned long) p_ucTXData);
+		DMA1CTL = DMADT_0 | DMASRCINCR_3 | DMADSTINCR_0 | DMASBDB;
+	}
+	else {
+		__data16_write_addr((unsigned short) &DMA1SA, (unsigned long) &ucSPI_DMAFill);
+		DMA1CTL = DMADT_0 | DMASRCINCR_0 | DMADSTINCR_0 | DMASBDB;
+	}
+	DMA1SZ = uiByteCount;
+
+	__disable_interrupt();
+
+	g_ucSPI_DMADone = 0;
+
+	// Make sure the previous transmission is complete and the RX flag is clear,
+	// triggers are edge sensitive
+	while(SPI_STAT_REG & UCBUSY);
+	SPI_RX_BUF;
+
+	DMA0CTL |= DMAEN;
+	DMA1CTL |= DMAEN;
+
+	// TX flag is already set, toggle it to give channel 1 its first edge
+	SPI_INTFLAG_REG &= ~UCTXIFG;
+	SPI_INTFLAG_REG |= UCTXIFG;
+
+	// Sleep until the last byte is in, the flag is checked with interrupts off
+	// so the wake up cannot be missed
+	while (!g_ucSPI_DMADone) {
+		__bis_SR_register(LPM0_bits + GIE);
+		__disable_interrupt();
+	}
+
+	DMA0CTL &= ~DMAEN;
+	DMA1CTL &= ~DMAEN;
+
+	__bis_SR_register(gie);                                 //Restore original GIE state
+}
+
 ////////////////////////////////////////////////////////////////////////
 //!
 //! \brief Transmits the desired number of bytes
 //!
+//! Runs that are long enough go out by DMA with the CPU in LPM0.
 //!
 //! \param p_ucTXData, ucByteCount
 //! \return none
@@ -190,6 +283,13 @@ static unsigned char ucSPI_IO_Transaction(
 void vSPI_TXBytes(unsigned char * p_ucTXData, unsigned int ucByteCount)
 {
 
+#if SPI_USE_DMA
+	if (ucByteCount >= SPI_DMA_MIN_COUNT) {
+		vSPI_DMATransfer(p_ucTXData, NULL, ucByteCount, 0);
+		return;
+	}
+#endif
+
   uint16 gie = __get_SR_register() & GIE;               //Store current GIE state
 
   __disable_interrupt();                                  //Make this operation atomic
@@ -209,12 +309,21 @@ void vSPI_TXBytes(unsigned char * p_ucTXData, unsigned int ucByteCount)
 //! \brief Receives the desired number of bytes
 //!
 //!
+//! Runs that are long enough come in by DMA with the CPU in LPM0.
+//!
 //! \param p_ucRXData
 //! \param uiByteCount The number of bytes to be transmitted
 //! \return none
 ///////////////////////////////////////////////////////////////////////
 void vSPI_RX_Bytes(unsigned char * p_ucRXData, unsigned int uiByteCount)
 {
+#if SPI_USE_DMA
+	if (uiByteCount >= SPI_DMA_MIN_COUNT) {
+		vSPI_DMATransfer(NULL, p_ucRXData, uiByteCount, 0xFF);
+		return;
+	}
+#endif
+
   uint16 gie = __get_SR_register() & GIE;               //Store current GIE state
 
   __disable_interrupt();                                  //Make this operation atomic
@@ -239,6 +348,28 @@ unsigned char ucSPI_bin(void)
 
 }/* END: ucSPI_bin() */
 
+//////////////////////////////////////////////////////////////////////////////
+//!
+//! \brief Clocks out the same byte a number of times
+//!
+//! Used to fill a run of memory in a single write cmd.
+//!
+//! \param ucFill, uiByteCount
+//! \return none
+//////////////////////////////////////////////////////////////////////////////
+void vSPI_FillBytes(unsigned char ucFill, unsigned int uiByteCount)
+{
+#if SPI_USE_DMA
+	if (uiByteCount >= SPI_DMA_MIN_COUNT) {
+		vSPI_DMATransfer(NULL, NULL, uiByteCount, ucFill);
+		return;
+	}
+#endif
+
+	for (; uiByteCount > 0x00; --uiByteCount)
+		ucSPI_IO_Transaction(ucFill);
+}
+
 /*********************  vSPI_bout()  **********************************
  *
  * MASTER Outputs a single byte to the SPI pprt
@@ -22,6 +22,18 @@
 	#define RATE_0				0
 	#define RATE_1				1
 
+	//! \def SPI_USE_DMA
+	//! \brief Set to 0 to move every byte by polling
+	#ifndef SPI_USE_DMA
+	#define SPI_USE_DMA			1
+	#endif
+
+	//! \def SPI_DMA_MIN_COUNT
+	//! \brief Shorter runs are polled, the DMA setup costs more than it saves
+	#define SPI_DMA_MIN_COUNT	16
+
+	extern volatile unsigned char g_ucSPI_DMADone;
+
 
 	/* ROUTINE DEFINITIONS */
 
@@ -44,6 +56,7 @@
 void vSPI_CleanBuff(unsigned char * p_ucBuff, unsigned char ucLength);
 void vSPI_TXBytes(unsigned char * p_ucTXData, unsigned int ucByteCount);
 void vSPI_RX_Bytes(unsigned char * p_ucRXData, unsigned int ucByteCount);
+void vSPI_FillBytes(unsigned char ucFill, unsigned int uiByteCount);
 
 void vSPI_TXBytes_InterruptDriven(unsigned char * p_ucTXData, unsigned int ucByteCount);
 #endif /* SPI_H_INCLUDED */
@@ -498,7 +498,7 @@ void vKEY_ResetSDLogging(void)
 		vSERIAL_sout("Fmting SD\r\n", 11);
 		vSD_PowerOn();
 		ucSD_Init();
-		SD_Format();
+		SD_Format(uiL2FRAM_NewSDVolume());
 		vSD_PowerOff();
 
 		// reset SD pointer in FRAM
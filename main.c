@@ -284,8 +284,9 @@ long lGLOB_lastScheduledFrame; //last scheduled frame number
 
 long lGLOB_OpMode0_inSec; //Start of Opmode
 
-usl uslGLOB_sramQon_NFL;
-usl uslGLOB_sramQoff;
+usl uslGLOB_sramQon_NFL[L2SRAM_MSG_CLASS_COUNT];
+usl uslGLOB_sramQoff[L2SRAM_MSG_CLASS_COUNT];
+uint uiaGLOB_sramClassQcnt[L2SRAM_MSG_CLASS_COUNT];
 uint uiGLOB_sramQcnt;
 uint uiGLOB_curMsgSeqNum;
 
@@ -368,6 +369,8 @@ void vMain_LogRestart(void);
  *
  ******************************************************************************/
 void main(void){
+	uchar ucSramQResumed;
+
 	//Halt the dog while the system initializes
 	WDTCTL = WDTPW + WDTHOLD;
 
@@ -442,8 +445,13 @@ void main(void){
 	vL2FRAM_LockAllMemory();
 
 	if (uiL2FRAM_chk_for_fram_format())
+	{
 		// SETUP THE ucaGLOB_roleByte[]	ARRAY, read the role information from FRAM
 		vMODOPT_copyAllFramOptionsToRamOptions();
+
+		// Finish a task state block update that a reset cut off
+		ucL2FRAM_replayTSBJrnl();
+	}
 	else
 		// otherwise, just format fram
 		vL2FRAM_format_fram();
@@ -455,12 +463,16 @@ void main(void){
 
 	// Initialize the on-chip RAM queue
 	vReport_RAM_QueueInit();
-	vL2SRAM_init();
+
+	// Pick the SRAM message queue up where it was left if it survived the reset
+	ucSramQResumed = ucL2SRAM_resumeQ();
 
 	// Checks to see if the queue is already formatted
-	// If not then format, otherwise retain contents
+	// If not then format, otherwise retain contents and index them in RAM
 	if (!ucL2SRAM_IsCmdQueueFormatted())
 		vL2SRAM_FormatCmd_Q();
+	else
+		vL2SRAM_LoadCmdIndex();
 
 	// Check to see if there is a functioning SD card present
 	vSD_PowerOn();
@@ -652,7 +664,7 @@ void main(void){
 			vSERIAL_sout("Fmting SD\r\n", 11);
 			vSD_PowerOn();
 			ucSD_Init();
-			SD_Format();
+			SD_Format(uiL2FRAM_NewSDVolume());
 			vSD_PowerOff();
 
 		}
@@ -670,7 +682,9 @@ void main(void){
 	if (ucL2FRAM_GetStateOnShutdown())
 	{
 		// Load the last block from the SD card into the SRAM message buffer
-		vReport_LoadSRAMFromSDCard();
+		// unless the queue was resumed, in which case the block is already there
+		if (!ucSramQResumed)
+			vReport_LoadSRAMFromSDCard();
 		// Reset the state on shutdown byte
 		vL2FRAM_SetStateOnShutdown(0x00);
 	}
@@ -843,6 +857,9 @@ void main(void){
 			// Dispatch to task
 			vTask_Dispatch(ucGLOB_lastAwakeNSTtblNum, ucGLOB_lastAwakeSlot);
 
+			// Power the SD card down if nothing used it for a while
+			vSD_SessionEndOfSlot();
+
 			// Check to see if the SPs have data
 			vRTS_CheckSPDataPending();
 
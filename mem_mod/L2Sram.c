@@ -25,12 +25,21 @@
 #include "rts.h"			//real time sched
 #include "modopt.h"			//Modify Options routines
 #include "task.h"			// Definitions regarding tasks
+#include "L2fram.h"			//level 2 fram routines
+#include "crc.h"			//CRC calculator routine
+#include "misc.h"			//byte packing routines
+
+#if L2SRAM_CKPT_REC_SZ != FRAM_SRAMQ_CKPT_SIZE
+#error "FRAM_SRAMQ_CKPT_SIZE must match L2SRAM_CKPT_REC_SZ"
+#endif
+
 /**********************  EXTERNS  ********************************************/
 
 extern volatile uchar ucaMSG_BUFF[MAX_RESERVED_MSG_SIZE];
 
-extern usl uslGLOB_sramQon_NFL; //max. number of sched. entries
-extern usl uslGLOB_sramQoff;
+extern usl uslGLOB_sramQon_NFL[L2SRAM_MSG_CLASS_COUNT];
+extern usl uslGLOB_sramQoff[L2SRAM_MSG_CLASS_COUNT];
+extern uint uiaGLOB_sramClassQcnt[L2SRAM_MSG_CLASS_COUNT];
 extern uint uiGLOB_sramQcnt;
 
 extern int iGLOB_completeSysLFactor;
@@ -38,6 +47,60 @@ extern int iGLOB_completeSysLFactor;
 /*************************** Vars *******************************************/
 ulong ulCurrentAddr;
 uint uiCurrentNodeID;
+
+//! \var uiaL2SRAM_CmdNodeID
+//! \brief RAM copy of the node ID of each command metadata row
+static uint uiaL2SRAM_CmdNodeID[CMD_Q_NUM_ROWS];
+
+//! \var ucaL2SRAM_CmdNodeCnt
+//! \brief RAM copy of the number of commands pending in each row
+static uchar ucaL2SRAM_CmdNodeCnt[CMD_Q_NUM_ROWS];
+
+//! \var ucaL2SRAM_CmdNodeHead
+//! \brief RAM copy of the slot holding the oldest command of each row
+static uchar ucaL2SRAM_CmdNodeHead[CMD_Q_NUM_ROWS];
+
+//! \var ucaL2SRAM_CmdNodeHash
+//! \brief One bit per node ID hash, set when some node with that hash has commands
+static uchar ucaL2SRAM_CmdNodeHash[CMD_Q_NODE_HASH_BYTES];
+
+//! \var ucaL2SRAM_CmdSlotUsed
+//! \brief One bit per command slot in the command queue, set when in use
+static uchar ucaL2SRAM_CmdSlotUsed[CMD_Q_SLOT_MAP_BYTES];
+
+//! \var uiL2SRAM_CmdTotal
+//! \brief Total number of commands in the command queue
+static uint uiL2SRAM_CmdTotal;
+
+//! \var ucL2SRAM_CmdIndexValid
+//! \brief Set once the RAM index matches the SRAM metadata
+static uchar ucL2SRAM_CmdIndexValid;
+
+//! \var ucL2SRAM_curMsgClass
+//! \brief Class of the message last copied out by ucL2SRAM_getCopyOfCurMsg()
+static uchar ucL2SRAM_curMsgClass = L2SRAM_MSG_CLASS_COUNT;
+
+//! \var ucaL2SRAM_ClassSkipCnt
+//! \brief Number of deletes a waiting class has been passed over
+static uchar ucaL2SRAM_ClassSkipCnt[L2SRAM_MSG_CLASS_COUNT];
+
+//! \var ucL2SRAM_ckptDirty
+//! \brief Set when the queue has changed since the last FRAM checkpoint
+static uchar ucL2SRAM_ckptDirty;
+
+//! \var ulL2SRAM_ckptSeq
+//! \brief Sequence number of the last FRAM checkpoint
+static ulong ulL2SRAM_ckptSeq;
+
+//! \var uslaL2SRAM_MsgQBeg
+//! \brief First address of each message class region
+static const usl uslaL2SRAM_MsgQBeg[L2SRAM_MSG_CLASS_COUNT] =
+{ L2SRAM_MSG_CRISIS_Q_BEG_UL, L2SRAM_MSG_DATA_Q_BEG_UL, L2SRAM_MSG_DIAG_Q_BEG_UL };
+
+//! \var uslaL2SRAM_MsgQEnd
+//! \brief Address following the last byte of each message class region
+static const usl uslaL2SRAM_MsgQEnd[L2SRAM_MSG_CLASS_COUNT] =
+{ L2SRAM_MSG_CRISIS_Q_END_UL, L2SRAM_MSG_DATA_Q_END_UL, L2SRAM_MSG_DIAG_Q_END_UL };
 /**********************  TABLES  ********************************************/
 
 //! \addtogroup CmdQueue
@@ -54,8 +117,13 @@ uint uiCurrentNodeID;
 
 /************************  DECLARATIONS  *************************************/
 
-static void vL2SRAM_incQptr(uchar ucQ_ID //Q indicator L2SRAM_Q_ON_ID or L2SRAM_Q_OFF_ID
-    );
+static uchar ucL2SRAM_getMsgRecLen(void);
+static uchar ucL2SRAM_getMsgClass(void);
+static uchar ucL2SRAM_getCurMsgRecLen(uchar ucClass);
+static uchar ucL2SRAM_selectMsgClass(void);
+static void vL2SRAM_initClass(uchar ucClass);
+static void vL2SRAM_delMsgFromClass(uchar ucClass);
+static void vL2SRAM_revalidateClass(uchar ucClass, uint uiCkptCount);
 
 /************************  CODE  *********************************************/
 
@@ -72,15 +140,20 @@ void vL2SRAM_init(void)
 	vSERIAL_sout("E:L2SRAM_init\r\n", 15);
 #endif
 
-	uslGLOB_sramQon_NFL = L2SRAM_MSG_Q_BEG_UL;
-	uslGLOB_sramQoff = L2SRAM_MSG_Q_BEG_UL;
+	uchar ucClass;
+
 	uiGLOB_sramQcnt = 0;
+	for (ucClass = 0; ucClass < L2SRAM_MSG_CLASS_COUNT; ucClass++)
+	{
+		uiaGLOB_sramClassQcnt[ucClass] = 0;
+		vL2SRAM_initClass(ucClass);
+	}
 
 #if 1
 	vSERIAL_sout("L2SRM:Qon=", 10);
-	vSERIAL_HB24out(uslGLOB_sramQon_NFL);
+	vSERIAL_HB24out(uslGLOB_sramQon_NFL[L2SRAM_MSG_CLASS_DATA]);
 	vSERIAL_sout("  Qoff=", 7);
-	vSERIAL_HB24out(uslGLOB_sramQoff);
+	vSERIAL_HB24out(uslGLOB_sramQoff[L2SRAM_MSG_CLASS_DATA]);
 	vSERIAL_sout(" Qcnt=", 6);
 	vSERIAL_UI16out(uiGLOB_sramQcnt);
 	vSERIAL_crlf();
@@ -90,6 +163,26 @@ void vL2SRAM_init(void)
 
 }/* END: vL2SRAM_init() */
 
+/**********************  vL2SRAM_initClass() **********************************
+ *
+ * Empty the queue of a single message class
+ *
+ ******************************************************************************/
+
+static void vL2SRAM_initClass(uchar ucClass)
+{
+	uiGLOB_sramQcnt -= uiaGLOB_sramClassQcnt[ucClass];
+	uiaGLOB_sramClassQcnt[ucClass] = 0;
+
+	uslGLOB_sramQon_NFL[ucClass] = uslaL2SRAM_MsgQBeg[ucClass];
+	uslGLOB_sramQoff[ucClass] = uslaL2SRAM_MsgQBeg[ucClass];
+	ucaL2SRAM_ClassSkipCnt[ucClass] = 0;
+	ucL2SRAM_ckptDirty = 1;
+
+	return;
+
+}/* END: vL2SRAM_initClass() */
+
 
 
 /****************  ulL2SRAM_getGenericTblEntry()  ***************************
@@ -229,12 +322,37 @@ void vL2SRAM_putPickTblEntry(USL uslTblBaseAddr, //Tbl base addr
 
 }/* END: ulL2SRAM_putGenericTblEntry() */
 
+/***********************  vL2SRAM_fillPickTbl()  ******************************
+ *
+ * Fill a whole table with one value using a single SRAM burst
+ *
+ ******************************************************************************/
+void vL2SRAM_fillPickTbl(USL uslTblBaseAddr, //Tbl base addr
+    uint uiTblByteLen, //Tbl length in bytes
+    uchar ucFillVal //Value to fill with
+    )
+{
+	vSRAM_fillBlock(uslTblBaseAddr, ucFillVal, uiTblByteLen);
+
+}/* END: vL2SRAM_fillPickTbl() */
+
 
 
 /************************  vL2SRAM_storeMsgToSram() *****************************
  *
  * add a new message to the SRAM storage
  *
+ * The message area is split into one region per message class (see
+ * l2sram.h).  Each region is a log of length prefixed records:
+ *
+ *		[LEN][LEN bytes of msg][LEN][LEN bytes of msg]...
+ *
+ * LEN is the packet length (MSG_IDX_LEN + NET_HDR_SZ + CRC_SZ) so short
+ * messages only use the space they need.  When a record does not fit before
+ * the end of the region a zero length wrap marker is written and the record
+ * goes to the beginning.  Nothing is ever moved.  If the region is full the
+ * oldest records of that class are dropped until the new one fits.
+ *
  * NOTE: This routine does the actual function of stuffing the msg buffer into
  *		the SRAM, It does not check to see if its the right thing to do.
  *		do not put guards in this code.
@@ -243,26 +361,64 @@ void vL2SRAM_putPickTblEntry(USL uslTblBaseAddr, //Tbl base addr
 
 void vL2SRAM_storeMsgToSram(void)
 {
-	uchar ucii;
+	uchar ucMsgLen;
+	uchar ucClass;
+	usl uslRecLen;
+	usl uslQBeg;
+	usl uslQEnd;
 
-	/* COPY MSG TO SRAM */
-	for (ucii = 0; ucii < MAX_MSG_SIZE; ucii++)
-	{
-		vSRAM_write_B8(uslGLOB_sramQon_NFL + ucii, ucaMSG_BUFF[ucii]);
-	}/* END: for(ui) */
+	ucMsgLen = ucL2SRAM_getMsgRecLen();
+	uslRecLen = (usl) ucMsgLen + L2SRAM_MSG_REC_HDR_SZ;
+
+	ucClass = ucL2SRAM_getMsgClass();
+	uslQBeg = uslaL2SRAM_MsgQBeg[ucClass];
+	uslQEnd = uslaL2SRAM_MsgQEnd[ucClass];
 
-	/* CHECK TO SEE IF WE ARE PASSING THE OFF Q PTR -- IF SO INC IT ALSO */
-	if ((uiGLOB_sramQcnt != 0) && (uslGLOB_sramQon_NFL == uslGLOB_sramQoff))
+	/* MAKE ROOM FOR THE RECORD AT THE ON Q PTR */
+	while (1)
 	{
-		vL2SRAM_incQptr(L2SRAM_Q_OFF_ID);
-		vL2SRAM_incQptr(L2SRAM_Q_ON_ID);
-		/* DONT BUMP THE COUNT ITS A WASH */
-		return;
+		/* EMPTY -- START OVER AT THE BEGINNING */
+		if (uiaGLOB_sramClassQcnt[ucClass] == 0)
+		{
+			uslGLOB_sramQon_NFL[ucClass] = uslQBeg;
+			uslGLOB_sramQoff[ucClass] = uslQBeg;
+			break;
+		}
+
+		/* FREE SPACE RUNS FROM THE ON PTR TO THE END OF THE REGION */
+		if (uslGLOB_sramQon_NFL[ucClass] > uslGLOB_sramQoff[ucClass])
+		{
+			if ((uslGLOB_sramQon_NFL[ucClass] + uslRecLen) <= uslQEnd)
+				break;
+
+			/* MARK THE WRAP AND CONTINUE AT THE BEGINNING */
+			if (uslGLOB_sramQon_NFL[ucClass] < uslQEnd)
+				vSRAM_write_B8(uslGLOB_sramQon_NFL[ucClass], L2SRAM_MSG_WRAP_MARK);
+			uslGLOB_sramQon_NFL[ucClass] = uslQBeg;
+			continue;
+		}
+
+		/* FREE SPACE RUNS FROM THE ON PTR UP TO THE OFF PTR */
+		if (((uslGLOB_sramQon_NFL[ucClass] + uslRecLen) <= uslGLOB_sramQoff[ucClass])
+		    && (uslGLOB_sramQon_NFL[ucClass] != uslGLOB_sramQoff[ucClass]))
+			break;
+
+		/* NO ROOM -- DROP THE OLDEST MSG OF THIS CLASS */
+		vL2SRAM_delMsgFromClass(ucClass);
 	}
 
-	/* OTHERWISE ADD A DATA ITEM TO THE COUNT */
-	vL2SRAM_incQptr(L2SRAM_Q_ON_ID);
+	/* COPY MSG TO SRAM */
+	vSRAM_write_B8(uslGLOB_sramQon_NFL[ucClass], ucMsgLen);
+	vSRAM_writeBlock(uslGLOB_sramQon_NFL[ucClass] + L2SRAM_MSG_REC_HDR_SZ, (uchar *) ucaMSG_BUFF, ucMsgLen);
+
+	uslGLOB_sramQon_NFL[ucClass] += uslRecLen;
+	if (uslGLOB_sramQon_NFL[ucClass] >= uslQEnd)
+		uslGLOB_sramQon_NFL[ucClass] = uslQBeg;
+
+	/* ADD A DATA ITEM TO THE COUNT */
+	uiaGLOB_sramClassQcnt[ucClass]++;
 	uiGLOB_sramQcnt++;
+	ucL2SRAM_ckptDirty = 1;
 
 	iGLOB_completeSysLFactor++;
 	return;
@@ -289,21 +445,150 @@ void vL2SRAM_storeMsgToSramIfAllowed(void)
 
 }/* END: vL2SRAM_storeMsgToSramIfAllowed() */
 
+////////////////////////////////////////////////////////////////////////////////
+//!
+//! \brief Computes the number of bytes of the message buffer that get stored
+//!
+//! \param none
+//! \return Packet length of the message in the buffer, bounded by MAX_MSG_SIZE
+////////////////////////////////////////////////////////////////////////////////
+static uchar ucL2SRAM_getMsgRecLen(void)
+{
+	uint uiLen;
+
+	uiLen = (uint) ucaMSG_BUFF[MSG_IDX_LEN] + NET_HDR_SZ + CRC_SZ;
+	if (uiLen > MAX_MSG_SIZE)
+		uiLen = MAX_MSG_SIZE;
+
+	return (uchar) uiLen;
+
+}/* END: ucL2SRAM_getMsgRecLen() */
+
+////////////////////////////////////////////////////////////////////////////////
+//!
+//! \brief Maps the class bits in the message flags to an SRAM queue
+//!
+//! Messages from nodes that do not set the class bits land in the data queue.
+//!
+//! \param none
+//! \return L2SRAM_MSG_CLASS_xxx
+////////////////////////////////////////////////////////////////////////////////
+static uchar ucL2SRAM_getMsgClass(void)
+{
+	switch (ucaMSG_BUFF[MSG_IDX_FLG] & MSG_FLG_CLASS_MASK)
+	{
+		case MSG_CLASS_CRISIS:
+			return L2SRAM_MSG_CLASS_CRISIS;
+
+		case MSG_CLASS_DIAG:
+			return L2SRAM_MSG_CLASS_DIAG;
+
+		default:
+			return L2SRAM_MSG_CLASS_DATA;
+	}
+
+}/* END: ucL2SRAM_getMsgClass() */
+
+////////////////////////////////////////////////////////////////////////////////
+//!
+//! \brief Reads the length of the record at the off Q ptr of a class
+//!
+//! Skips over a wrap marker (or the end of the region) so the off Q ptr always
+//! points at a real record when we return.  A length that could not have been
+//! written by vL2SRAM_storeMsgToSram() means the region is trashed so that
+//! class is reset.
+//!
+//! \param ucClass, L2SRAM_MSG_CLASS_xxx
+//! \return Length of the current message, 0 if there is none
+////////////////////////////////////////////////////////////////////////////////
+static uchar ucL2SRAM_getCurMsgRecLen(uchar ucClass)
+{
+	uchar ucMsgLen;
+
+	if (uiaGLOB_sramClassQcnt[ucClass] == 0)
+		return 0;
+
+	ucMsgLen = L2SRAM_MSG_WRAP_MARK;
+	if (uslGLOB_sramQoff[ucClass] < uslaL2SRAM_MsgQEnd[ucClass])
+		ucMsgLen = ucSRAM_read_B8(uslGLOB_sramQoff[ucClass]);
+
+	if (ucMsgLen == L2SRAM_MSG_WRAP_MARK)
+	{
+		uslGLOB_sramQoff[ucClass] = uslaL2SRAM_MsgQBeg[ucClass];
+		ucMsgLen = ucSRAM_read_B8(uslGLOB_sramQoff[ucClass]);
+	}
+
+	if ((ucMsgLen == L2SRAM_MSG_WRAP_MARK) || (ucMsgLen > MAX_MSG_SIZE))
+	{
+#if 1
+		vSERIAL_sout("L2SRM:BdRecLen\r\n", 16);
+#endif
+		vL2SRAM_initClass(ucClass);
+		return 0;
+	}
+
+	return ucMsgLen;
+
+}/* END: ucL2SRAM_getCurMsgRecLen() */
+
+////////////////////////////////////////////////////////////////////////////////
+//!
+//! \brief Picks the class the next message is sent from
+//!
+//! Classes are served by strict priority.  A non-empty class that has been
+//! passed over L2SRAM_MSG_AGING_LIMIT times gets served once so diagnostics
+//! still trickle out during a long backlog of data.
+//!
+//! \param none
+//! \return L2SRAM_MSG_CLASS_xxx, L2SRAM_MSG_CLASS_COUNT if all are empty
+////////////////////////////////////////////////////////////////////////////////
+static uchar ucL2SRAM_selectMsgClass(void)
+{
+	uchar ucClass;
+	uchar ucSelected;
+
+	ucSelected = L2SRAM_MSG_CLASS_COUNT;
+
+	for (ucClass = 0; ucClass < L2SRAM_MSG_CLASS_COUNT; ucClass++)
+	{
+		if (uiaGLOB_sramClassQcnt[ucClass] == 0)
+			continue;
+
+		/* AGED CLASS WINS OUTRIGHT */
+		if (ucaL2SRAM_ClassSkipCnt[ucClass] >= L2SRAM_MSG_AGING_LIMIT)
+			return ucClass;
+
+		if (ucSelected == L2SRAM_MSG_CLASS_COUNT)
+			ucSelected = ucClass;
+	}
+
+	return ucSelected;
+
+}/* END: ucL2SRAM_selectMsgClass() */
+
 ////////////////////////////////////////////////////////////////////////////////
 //!
 //! \brief Fetches a copy of the current message from SRAM.
 //!
+//! The current message is the oldest message of the class picked by
+//! ucL2SRAM_selectMsgClass().  Only the stored bytes are read, the rest of
+//! the message buffer is cleared.
 //!
-//! 
 //! \param none		  
 //! \return 0, nothing to send (we are empty) 1, success
 ////////////////////////////////////////////////////////////////////////////////
 uchar ucL2SRAM_getCopyOfCurMsg(void)
 {
+	uchar ucMsgLen;
 	uchar ucii;
 
 	/* CHECK IF WE HAVE ANYTHING TO COPY */
-	if (uiGLOB_sramQcnt == 0)
+	ucMsgLen = 0;
+	ucL2SRAM_curMsgClass = ucL2SRAM_selectMsgClass();
+	if (ucL2SRAM_curMsgClass < L2SRAM_MSG_CLASS_COUNT)
+		ucMsgLen = ucL2SRAM_getCurMsgRecLen(ucL2SRAM_curMsgClass);
+
+	if (ucMsgLen == 0)
 	{
 #if 0
 		vSERIAL_sout("NoMsgToCopy\r\n", 13);
@@ -312,15 +597,71 @@ uchar ucL2SRAM_getCopyOfCurMsg(void)
 	}
 
 	/* COPY SRAM TO MSG BUFFER */
-	for (ucii = 0; ucii < MAX_MSG_SIZE; ucii++)
+	vSRAM_readBlock(uslGLOB_sramQoff[ucL2SRAM_curMsgClass] + L2SRAM_MSG_REC_HDR_SZ, (uchar *) ucaMSG_BUFF, ucMsgLen);
+	for (ucii = ucMsgLen; ucii < MAX_MSG_SIZE; ucii++)
+		ucaMSG_BUFF[ucii] = 0;
+
+	return 1;
+
+}/* END: ucL2SRAM_getCopyOfCurMsg() */
+
+////////////////////////////////////////////////////////////////////////////////
+//!
+//! \brief Fetches a copy of a message queued behind the current message
+//!
+//! Walks the records of the class picked by the last ucL2SRAM_getCopyOfCurMsg()
+//! so every message of a transfer window comes from the same class.  Offset 0
+//! is the current message.  Nothing is deleted.
+//!
+//! \param ucOffset, number of messages to skip from the current one
+//! \return 0, no such message 1, success
+////////////////////////////////////////////////////////////////////////////////
+uchar ucL2SRAM_getCopyOfCurMsgAt(uchar ucOffset)
+{
+	usl uslAddr;
+	uchar ucClass;
+	uchar ucMsgLen;
+	uchar ucii;
+
+	ucClass = ucL2SRAM_curMsgClass;
+	if ((ucClass >= L2SRAM_MSG_CLASS_COUNT) || ((uint) ucOffset >= uiaGLOB_sramClassQcnt[ucClass]))
+		return 0;
+
+	/* LINE UP THE OFF Q PTR ON A REAL RECORD */
+	if (ucL2SRAM_getCurMsgRecLen(ucClass) == 0)
+		return 0;
+
+	uslAddr = uslGLOB_sramQoff[ucClass];
+	while (1)
 	{
-		ucaMSG_BUFF[ucii] = ucSRAM_read_B8(uslGLOB_sramQoff + ucii);
+		ucMsgLen = L2SRAM_MSG_WRAP_MARK;
+		if (uslAddr < uslaL2SRAM_MsgQEnd[ucClass])
+			ucMsgLen = ucSRAM_read_B8(uslAddr);
 
-	}/* END: for(ui) */
+		if (ucMsgLen == L2SRAM_MSG_WRAP_MARK)
+		{
+			uslAddr = uslaL2SRAM_MsgQBeg[ucClass];
+			ucMsgLen = ucSRAM_read_B8(uslAddr);
+		}
+
+		if ((ucMsgLen == L2SRAM_MSG_WRAP_MARK) || (ucMsgLen > MAX_MSG_SIZE))
+			return 0;
+
+		if (ucOffset == 0)
+			break;
+
+		ucOffset--;
+		uslAddr += (usl) ucMsgLen + L2SRAM_MSG_REC_HDR_SZ;
+	}
+
+	/* COPY SRAM TO MSG BUFFER */
+	vSRAM_readBlock(uslAddr + L2SRAM_MSG_REC_HDR_SZ, (uchar *) ucaMSG_BUFF, ucMsgLen);
+	for (ucii = ucMsgLen; ucii < MAX_MSG_SIZE; ucii++)
+		ucaMSG_BUFF[ucii] = 0;
 
 	return 1;
 
-}/* END: ucL2SRAM_getCopyOfCurMsg() */
+}/* END: ucL2SRAM_getCopyOfCurMsgAt() */
 
 ////////////////////////////////////////////////////////////////////////////////
 //!
@@ -335,73 +676,128 @@ uint uiL2SRAM_getMsgCount(void)
 
 }/* END: uiL2SRAM_getMsgCount() */
 
+////////////////////////////////////////////////////////////////////////////////
+//!
+//! \brief Gets the number of messages stored in one class
+//!
+//! \param ucClass, L2SRAM_MSG_CLASS_xxx
+//! \return Number of messages
+////////////////////////////////////////////////////////////////////////////////
+uint uiL2SRAM_getClassMsgCount(uchar ucClass)
+{
+	if (ucClass >= L2SRAM_MSG_CLASS_COUNT)
+		return 0;
+
+	return (uiaGLOB_sramClassQcnt[ucClass]);
+
+}/* END: uiL2SRAM_getClassMsgCount() */
+
 ////////////////////////////////////////////////////////////////////////////////
 //!
 //! \brief Estimated number of vacant messages on chip.
 //!
+//! The estimate assumes full size messages so it is the number of messages
+//! that can be stored for sure before the oldest one gets dropped.
+//!
 //! \param none
 //! \return ulMsgVacancy, Vacancy count
 ////////////////////////////////////////////////////////////////////////////////
 
 uint uiL2SRAM_getVacantMsgCount(void)
 {
+	uchar ucClass;
+	ulong ulFreeBytes;
 	ulong ulMsgVacancy;
 
-	ulMsgVacancy = L2SRAM_MSG_BUFF_COUNT_UL - uiGLOB_sramQcnt;
+	ulMsgVacancy = 0;
+	for (ucClass = 0; ucClass < L2SRAM_MSG_CLASS_COUNT; ucClass++)
+	{
+		if (uiaGLOB_sramClassQcnt[ucClass] == 0)
+			ulFreeBytes = uslaL2SRAM_MsgQEnd[ucClass] - uslaL2SRAM_MsgQBeg[ucClass];
+		else if (uslGLOB_sramQon_NFL[ucClass] > uslGLOB_sramQoff[ucClass])
+			ulFreeBytes = (uslaL2SRAM_MsgQEnd[ucClass] - uslGLOB_sramQon_NFL[ucClass])
+			    + (uslGLOB_sramQoff[ucClass] - uslaL2SRAM_MsgQBeg[ucClass]);
+		else
+			ulFreeBytes = uslGLOB_sramQoff[ucClass] - uslGLOB_sramQon_NFL[ucClass];
+
+		ulMsgVacancy += ulFreeBytes / (MAX_MSG_SIZE_UL + L2SRAM_MSG_REC_HDR_SZ);
+	}
 
 	return ((uint) ulMsgVacancy);
 
 }/* END: uiL2SRAM_getVacantMsgCount() */
 
-/**********************  vL2SRAM_incQptr()  ***********************************
- *
- * Inc the Q pointer indicated
- *
- ******************************************************************************/
-
-static void vL2SRAM_incQptr(uchar ucQ_ID //Q indicator L2SRAM_Q_ON_ID or L2SRAM_Q_OFF_ID
-    )
+////////////////////////////////////////////////////////////////////////////////
+//!
+//! \brief removes the oldest message of a class from the SRAM storage
+//!
+//! \param ucClass, L2SRAM_MSG_CLASS_xxx
+//! \return none
+////////////////////////////////////////////////////////////////////////////////
+static void vL2SRAM_delMsgFromClass(uchar ucClass)
 {
-	usl uslGenericQptr;
-
-	/* ASSUME WHAT THE Q PTR VALUE IS */
-	uslGenericQptr = uslGLOB_sramQon_NFL;
-	/* CHANGE IT IF IT WAS A BAD ASSUMPTION */
-	if (ucQ_ID == L2SRAM_Q_OFF_ID)
-		uslGenericQptr = uslGLOB_sramQoff;
+	uchar ucMsgLen;
 
-	// Increment the queue pointer the length of a data element
-	uslGenericQptr += MAX_MSG_SIZE;
-
-	// If message storage in SRAM has been exceeded then point the queue to the beginning address of msg space
-	if (uslGenericQptr >= L2SRAM_MSG_Q_END_UL)
-		uslGenericQptr = L2SRAM_MSG_Q_BEG_UL;
-
-	/* UPDATE THE VALUE OF THE POINTER */
-	if (ucQ_ID == L2SRAM_Q_ON_ID)
+	/* CHECK IF WE HAVE ANYTHING TO DELETE */
+	ucMsgLen = ucL2SRAM_getCurMsgRecLen(ucClass);
+	if (ucMsgLen == 0)
 	{
-		uslGLOB_sramQon_NFL = uslGenericQptr;
+#if 0
+		vSERIAL_sout("L2SRM:NoMsgToDel\r\n", 18);
+#endif
 		return;
 	}
 
-	uslGLOB_sramQoff = uslGenericQptr;
-	return;
+	uslGLOB_sramQoff[ucClass] += (usl) ucMsgLen + L2SRAM_MSG_REC_HDR_SZ;
+	if (uslGLOB_sramQoff[ucClass] >= uslaL2SRAM_MsgQEnd[ucClass])
+		uslGLOB_sramQoff[ucClass] = uslaL2SRAM_MsgQBeg[ucClass];
 
-}/* END: vL2SRAM_incQptr() */
+	uiaGLOB_sramClassQcnt[ucClass]--;
+	uiGLOB_sramQcnt--;
+	ucL2SRAM_ckptDirty = 1;
 
+	return;
+
+}/* END: vL2SRAM_delMsgFromClass() */
 
 ////////////////////////////////////////////////////////////////////////////////
 //!
 //! \brief removes current message from the SRAM storage
 //!
+//! Deletes the message last returned by ucL2SRAM_getCopyOfCurMsg() and
+//! updates the aging counts of the classes that were passed over.
+//!
 //! \param none
 //! \return none
 ////////////////////////////////////////////////////////////////////////////////
 void vL2SRAM_delCurMsg(void)
 
 {
-	/* CHECK IF WE HAVE ANYTHING TO DELETE */
-	if (uiGLOB_sramQcnt == 0)
+	vL2SRAM_delCurMsgs(1);
+
+	return;
+
+}/* END: vL2SRAM_delCurMsg() */
+
+////////////////////////////////////////////////////////////////////////////////
+//!
+//! \brief removes the current message and the ones queued behind it
+//!
+//! Deletes a window of messages fetched with ucL2SRAM_getCopyOfCurMsgAt().
+//! The window counts as one turn of its class for the aging counts.
+//!
+//! \param ucCount, number of messages to delete
+//! \return none
+////////////////////////////////////////////////////////////////////////////////
+void vL2SRAM_delCurMsgs(uchar ucCount)
+{
+	uchar ucClass;
+
+	/* NO COPY WAS MADE SO PICK THE CLASS NOW */
+	if ((ucL2SRAM_curMsgClass >= L2SRAM_MSG_CLASS_COUNT) || (uiaGLOB_sramClassQcnt[ucL2SRAM_curMsgClass] == 0))
+		ucL2SRAM_curMsgClass = ucL2SRAM_selectMsgClass();
+
+	if (ucL2SRAM_curMsgClass >= L2SRAM_MSG_CLASS_COUNT)
 	{
 #if 0
 		vSERIAL_sout("L2SRM:NoMsgToDel\r\n", 18);
@@ -409,19 +805,369 @@ void vL2SRAM_delCurMsg(void)
 		return;
 	}
 
-	vL2SRAM_incQptr(L2SRAM_Q_OFF_ID);
+	while (ucCount != 0)
+	{
+		vL2SRAM_delMsgFromClass(ucL2SRAM_curMsgClass);
+		ucCount--;
+	}
 
-	uiGLOB_sramQcnt--;
+	/* AGE EVERY CLASS THAT STILL HAS MSGS WAITING */
+	for (ucClass = 0; ucClass < L2SRAM_MSG_CLASS_COUNT; ucClass++)
+	{
+		if ((ucClass == ucL2SRAM_curMsgClass) || (uiaGLOB_sramClassQcnt[ucClass] == 0))
+			ucaL2SRAM_ClassSkipCnt[ucClass] = 0;
+		else if (ucaL2SRAM_ClassSkipCnt[ucClass] < L2SRAM_MSG_AGING_LIMIT)
+			ucaL2SRAM_ClassSkipCnt[ucClass]++;
+	}
+
+	ucL2SRAM_curMsgClass = L2SRAM_MSG_CLASS_COUNT;
 
 	return;
 
-}/* END: vL2SRAM_delCurMsg() */
+}/* END: vL2SRAM_delCurMsgs() */
+
+////////////////////////////////////////////////////////////////////////////////
+//!
+//! \brief Checkpoints the SRAM message queue pointers to FRAM
+//!
+//! Called on slot boundaries.  Nothing is written if the queue has not changed
+//! since the last checkpoint.  The two FRAM records are written alternately
+//! and each carries a sequence number and a CRC so a reset part way through a
+//! write leaves the previous checkpoint usable.
+//!
+//! \param none
+//! \return none
+////////////////////////////////////////////////////////////////////////////////
+void vL2SRAM_checkpointQ(void)
+{
+	uchar ucaRec[L2SRAM_CKPT_REC_SZ];
+	uchar ucClass;
+	uchar ucIdx;
+
+	if (!ucL2SRAM_ckptDirty)
+		return;
+
+	ulL2SRAM_ckptSeq++;
+
+	vMISC_copyUintIntoBytes(L2SRAM_CKPT_MAGIC, &ucaRec[L2SRAM_CKPT_IDX_MAGIC], NO_NOINT);
+	vMISC_copyUlongIntoBytes(ulL2SRAM_ckptSeq, &ucaRec[L2SRAM_CKPT_IDX_SEQ], NO_NOINT);
 
+	ucIdx = L2SRAM_CKPT_IDX_CLASS;
+	for (ucClass = 0; ucClass < L2SRAM_MSG_CLASS_COUNT; ucClass++)
+	{
+		vMISC_copyUlongIntoBytes((ulong) uslGLOB_sramQon_NFL[ucClass], &ucaRec[ucIdx + L2SRAM_CKPT_CLASS_IDX_QON], NO_NOINT);
+		vMISC_copyUlongIntoBytes((ulong) uslGLOB_sramQoff[ucClass], &ucaRec[ucIdx + L2SRAM_CKPT_CLASS_IDX_QOFF], NO_NOINT);
+		vMISC_copyUintIntoBytes(uiaGLOB_sramClassQcnt[ucClass], &ucaRec[ucIdx + L2SRAM_CKPT_CLASS_IDX_QCNT], NO_NOINT);
+		ucIdx += L2SRAM_CKPT_CLASS_SZ;
+	}
+
+	vMISC_copyUintIntoBytes(uiCRC16_ComputeBlockCRC(ucaRec, L2SRAM_CKPT_IDX_CRC), &ucaRec[L2SRAM_CKPT_IDX_CRC], NO_NOINT);
+
+	vL2FRAM_putSramQCkpt((uchar) (ulL2SRAM_ckptSeq % FRAM_SRAMQ_CKPT_COUNT), ucaRec);
+
+	ucL2SRAM_ckptDirty = 0;
+
+	return;
+
+}/* END: vL2SRAM_checkpointQ() */
 
+////////////////////////////////////////////////////////////////////////////////
+//!
+//! \brief Walks the records of a class and keeps the good ones
+//!
+//! Every record between the off Q ptr and the checkpointed count is read back
+//! and its message CRC checked.  A record whose length byte is sane but whose
+//! message fails the check is dropped and the good records behind it are
+//! moved down over it.  The queue is only cut short where a length byte is
+//! bad, since the records after it can't be found.
+//!
+//! \param ucClass, L2SRAM_MSG_CLASS_xxx
+//! \param uiCkptCount, message count from the checkpoint
+//! \return none
+////////////////////////////////////////////////////////////////////////////////
+static void vL2SRAM_revalidateClass(uchar ucClass, uint uiCkptCount)
+{
+	usl uslAddr;
+	usl uslPut;
+	uint uiRec;
+	uint uiGood;
+	uchar ucMsgLen;
+
+	uslAddr = uslGLOB_sramQoff[ucClass];
+	uslPut = uslAddr;
+	uiGood = 0;
+	for (uiRec = 0; uiRec < uiCkptCount; uiRec++)
+	{
+		ucMsgLen = L2SRAM_MSG_WRAP_MARK;
+		if (uslAddr < uslaL2SRAM_MsgQEnd[ucClass])
+			ucMsgLen = ucSRAM_read_B8(uslAddr);
+
+		if (ucMsgLen == L2SRAM_MSG_WRAP_MARK)
+		{
+			uslAddr = uslaL2SRAM_MsgQBeg[ucClass];
+			ucMsgLen = ucSRAM_read_B8(uslAddr);
+		}
+
+		if ((ucMsgLen <= (NET_HDR_SZ + CRC_SZ)) || (ucMsgLen > MAX_MSG_SIZE))
+			break;
+		if ((uslAddr + L2SRAM_MSG_REC_HDR_SZ + ucMsgLen) > uslaL2SRAM_MsgQEnd[ucClass])
+			break;
+
+		vSRAM_readBlock(uslAddr + L2SRAM_MSG_REC_HDR_SZ, (uchar *) ucaMSG_BUFF, ucMsgLen);
+
+		uslAddr += (usl) ucMsgLen + L2SRAM_MSG_REC_HDR_SZ;
+		if (uslAddr >= uslaL2SRAM_MsgQEnd[ucClass])
+			uslAddr = uslaL2SRAM_MsgQBeg[ucClass];
+
+		/* DROP A DAMAGED MSG, THE NEXT RECORD STILL FOLLOWS IT */
+		if (((ucaMSG_BUFF[MSG_IDX_LEN] + NET_HDR_SZ + CRC_SZ) != ucMsgLen)
+		    || !ucCRC16_compute_msg_CRC(CRC_FOR_MSG_TO_REC, ucaMSG_BUFF, ucMsgLen))
+			continue;
+
+		/* MOVE THE MSG DOWN OVER THE DROPPED ONES, IT NEVER PASSES THE RECORD JUST READ */
+		if (uiGood != uiRec)
+		{
+			if ((uslPut + L2SRAM_MSG_REC_HDR_SZ + ucMsgLen) > uslaL2SRAM_MsgQEnd[ucClass])
+			{
+				if (uslPut < uslaL2SRAM_MsgQEnd[ucClass])
+					vSRAM_write_B8(uslPut, L2SRAM_MSG_WRAP_MARK);
+				uslPut = uslaL2SRAM_MsgQBeg[ucClass];
+			}
+			vSRAM_write_B8(uslPut, ucMsgLen);
+			vSRAM_writeBlock(uslPut + L2SRAM_MSG_REC_HDR_SZ, (uchar *) ucaMSG_BUFF, ucMsgLen);
+			uslPut += (usl) ucMsgLen + L2SRAM_MSG_REC_HDR_SZ;
+			if (uslPut >= uslaL2SRAM_MsgQEnd[ucClass])
+				uslPut = uslaL2SRAM_MsgQBeg[ucClass];
+		}
+		else
+		{
+			uslPut = uslAddr;
+		}
+		uiGood++;
+	}
+
+#if 1
+	if (uiGood != uiCkptCount)
+	{
+		vSERIAL_sout("L2SRM:Cls", 9);
+		vSERIAL_UI8out(ucClass);
+		vSERIAL_sout(" kept ", 6);
+		vSERIAL_UI16out(uiGood);
+		vSERIAL_sout(" of ", 4);
+		vSERIAL_UI16out(uiCkptCount);
+		vSERIAL_crlf();
+	}
+#endif
+
+	if (uiGood == 0)
+	{
+		vL2SRAM_initClass(ucClass);
+		return;
+	}
+
+	uslGLOB_sramQon_NFL[ucClass] = uslPut;
+	uiaGLOB_sramClassQcnt[ucClass] = uiGood;
+	uiGLOB_sramQcnt += uiGood;
+
+	return;
+
+}/* END: vL2SRAM_revalidateClass() */
+
+////////////////////////////////////////////////////////////////////////////////
+//!
+//! \brief Resumes the SRAM message queue from the FRAM checkpoint
+//!
+//! Used at startup in place of vL2SRAM_init().  The newest checkpoint with a
+//! good CRC is loaded and every class is revalidated against the message CRCs
+//! in SRAM.  If the SRAM lost power its contents will not pass the CRCs and
+//! the queue starts empty just as it would after vL2SRAM_init().
+//!
+//! \param none
+//! \return 1 if any messages were resumed, else 0
+////////////////////////////////////////////////////////////////////////////////
+uchar ucL2SRAM_resumeQ(void)
+{
+	uchar ucaRec[L2SRAM_CKPT_REC_SZ];
+	uchar ucCkptNum;
+	uchar ucBestCkpt;
+	uchar ucClass;
+	uchar ucIdx;
+	ulong ulSeq;
+	ulong ulBestSeq;
+	usl uslQon;
+	usl uslQoff;
+	uint uiCount;
+
+	vL2SRAM_init();
+
+	/* FIND THE NEWEST VALID CHECKPOINT */
+	ucBestCkpt = FRAM_SRAMQ_CKPT_COUNT;
+	ulBestSeq = 0;
+	for (ucCkptNum = 0; ucCkptNum < FRAM_SRAMQ_CKPT_COUNT; ucCkptNum++)
+	{
+		vL2FRAM_getSramQCkpt(ucCkptNum, ucaRec);
+
+		if (uiMISC_buildUintFromBytes(&ucaRec[L2SRAM_CKPT_IDX_MAGIC], NO_NOINT) != L2SRAM_CKPT_MAGIC)
+			continue;
+		if (uiMISC_buildUintFromBytes(&ucaRec[L2SRAM_CKPT_IDX_CRC], NO_NOINT) != uiCRC16_ComputeBlockCRC(ucaRec, L2SRAM_CKPT_IDX_CRC))
+			continue;
+
+		ulSeq = ulMISC_buildUlongFromBytes(&ucaRec[L2SRAM_CKPT_IDX_SEQ], NO_NOINT);
+		if ((ucBestCkpt == FRAM_SRAMQ_CKPT_COUNT) || (ulSeq > ulBestSeq))
+		{
+			ucBestCkpt = ucCkptNum;
+			ulBestSeq = ulSeq;
+		}
+	}
+
+	if (ucBestCkpt == FRAM_SRAMQ_CKPT_COUNT)
+	{
+#if 1
+		vSERIAL_sout("L2SRM:NoCkpt\r\n", 14);
+#endif
+		return 0;
+	}
+
+	/* RELOAD AND REVALIDATE EACH CLASS */
+	vL2FRAM_getSramQCkpt(ucBestCkpt, ucaRec);
+	ulL2SRAM_ckptSeq = ulBestSeq;
+
+	ucIdx = L2SRAM_CKPT_IDX_CLASS;
+	for (ucClass = 0; ucClass < L2SRAM_MSG_CLASS_COUNT; ucClass++)
+	{
+		uslQon = (usl) ulMISC_buildUlongFromBytes(&ucaRec[ucIdx + L2SRAM_CKPT_CLASS_IDX_QON], NO_NOINT);
+		uslQoff = (usl) ulMISC_buildUlongFromBytes(&ucaRec[ucIdx + L2SRAM_CKPT_CLASS_IDX_QOFF], NO_NOINT);
+		uiCount = uiMISC_buildUintFromBytes(&ucaRec[ucIdx + L2SRAM_CKPT_CLASS_IDX_QCNT], NO_NOINT);
+		ucIdx += L2SRAM_CKPT_CLASS_SZ;
+
+		if ((uiCount == 0)
+		    || (uslQon < uslaL2SRAM_MsgQBeg[ucClass]) || (uslQon >= uslaL2SRAM_MsgQEnd[ucClass])
+		    || (uslQoff < uslaL2SRAM_MsgQBeg[ucClass]) || (uslQoff >= uslaL2SRAM_MsgQEnd[ucClass]))
+			continue;
+
+		uslGLOB_sramQoff[ucClass] = uslQoff;
+		vL2SRAM_revalidateClass(ucClass, uiCount);
+	}
+
+	/* THE RESUMED STATE BECOMES THE NEXT CHECKPOINT */
+	ucL2SRAM_ckptDirty = 1;
+
+#if 1
+	vSERIAL_sout("L2SRM:Resumed ", 14);
+	vSERIAL_UI16out(uiGLOB_sramQcnt);
+	vSERIAL_crlf();
+#endif
+
+	return (uiGLOB_sramQcnt != 0);
+
+}/* END: ucL2SRAM_resumeQ() */
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+//!
+//! \brief Hashes a node ID into the pending command bitmap
+//!
+//! \param uiNodeID
+//! \return bit number in ucaL2SRAM_CmdNodeHash[]
+////////////////////////////////////////////////////////////////////////////////
+static uint uiL2SRAM_CmdNodeHashBit(uint uiNodeID)
+{
+	return ((uiNodeID ^ (uiNodeID >> 7)) & (CMD_Q_NODE_HASH_BITS - 1));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//!
+//! \brief Rebuilds the pending command bitmap from the RAM row table
+//!
+//! Bits are shared by nodes that hash alike so they can only be cleared by
+//! rebuilding.  This is only done when a node leaves the table.
+//!
+//! \param none
+//! \return none
+////////////////////////////////////////////////////////////////////////////////
+static void vL2SRAM_RebuildCmdNodeHash(void)
+{
+	uint uiRow;
+	uint uiBit;
+
+	for (uiBit = 0; uiBit < CMD_Q_NODE_HASH_BYTES; uiBit++)
+		ucaL2SRAM_CmdNodeHash[uiBit] = 0;
+
+	for (uiRow = 0; uiRow < CMD_Q_NUM_ROWS; uiRow++)
+	{
+		if (ucaL2SRAM_CmdNodeCnt[uiRow] == 0)
+			continue;
+
+		uiBit = uiL2SRAM_CmdNodeHashBit(uiaL2SRAM_CmdNodeID[uiRow]);
+		ucaL2SRAM_CmdNodeHash[uiBit >> 3] |= (uchar) (1 << (uiBit & 7));
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//!
+//! \brief Marks a command slot in the command queue as used or free
+//!
+//! \param ulCmdAddr, address of the command in SRAM
+//! \param ucUsed, 1 used, 0 free
+//! \return none
+////////////////////////////////////////////////////////////////////////////////
+static void vL2SRAM_MarkCmdSlot(ulong ulCmdAddr, uchar ucUsed)
+{
+	uint uiSlot;
+
+	if ((ulCmdAddr < CMD_QUEUE_START_ADDR) || (ulCmdAddr >= CMD_QUEUE_END_ADDR))
+		return;
+
+	uiSlot = (uint) ((ulCmdAddr - CMD_QUEUE_START_ADDR) / MAX_MSG_SIZE_UL);
+	if (uiSlot >= MAX_NUM_CMDS)
+		return;
+
+	if (ucUsed)
+		ucaL2SRAM_CmdSlotUsed[uiSlot >> 3] |= (uchar) (1 << (uiSlot & 7));
+	else
+		ucaL2SRAM_CmdSlotUsed[uiSlot >> 3] &= (uchar) ~(1 << (uiSlot & 7));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//!
+//! \brief Finds a free command slot in the command queue
+//!
+//! \param none
+//! \return address of the free slot, 0 if the queue is full
+////////////////////////////////////////////////////////////////////////////////
+static ulong ulL2SRAM_FindFreeCmdSlot(void)
+{
+	uint uiSlot;
+
+	for (uiSlot = 0; uiSlot < MAX_NUM_CMDS; uiSlot++)
+	{
+		if (!(ucaL2SRAM_CmdSlotUsed[uiSlot >> 3] & (1 << (uiSlot & 7))))
+			return (CMD_QUEUE_START_ADDR + ((ulong) uiSlot * MAX_MSG_SIZE_UL));
+	}
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//!
+//! \brief Writes the count and head of a row back to the SRAM metadata
+//!
+//! \param uiRow
+//! \return none
+////////////////////////////////////////////////////////////////////////////////
+static void vL2SRAM_StoreCmdRowState(uint uiRow)
+{
+	uchar ucaState[NUM_CMDS_PER_NODE_LEN + NODE_CMD_HEAD_LEN];
+
+	ucaState[0] = ucaL2SRAM_CmdNodeCnt[uiRow];
+	ucaState[1] = ucaL2SRAM_CmdNodeHead[uiRow];
+	vSRAM_writeBlock(CMD_Q_ROW_ADDR(uiRow) + NODE_ID_LEN, ucaState, NUM_CMDS_PER_NODE_LEN + NODE_CMD_HEAD_LEN);
+}
 
 ///////////////////////////////////////////////////////////////////////////////
 //!
-//! \brief Formats the command queue format section by writing "SRAM" to a reserved
+//! \brief Formats the command queue format section by writing "SRA2" to a reserved
 //! memory location.  This way,in the event of a reset,  the device can check
 //! if this area is formatted before overwriting a queue that is holding commands.
 //!
@@ -430,13 +1176,12 @@ void vL2SRAM_delCurMsg(void)
 ///////////////////////////////////////////////////////////////////////////////
 void vL2SRAM_FormatCmd_Q(void)
 {
-	ulong ulAddr;
+	const uchar ucaFormat[CMD_Q_FORMAT_LEN] =
+	{ CMD_Q_FORMAT_XI, CMD_Q_FORMAT_HI, CMD_Q_FORMAT_MD, CMD_Q_FORMAT_LO };
+	uint uiIndex;
 
 	// Write the data to SRAM
-	vSRAM_write_B8(CMD_Q_FORMAT_ADDR, CMD_Q_FORMAT_XI);
-	vSRAM_write_B8(CMD_Q_FORMAT_ADDR + 1, CMD_Q_FORMAT_HI);
-	vSRAM_write_B8(CMD_Q_FORMAT_ADDR + 2, CMD_Q_FORMAT_MD);
-	vSRAM_write_B8(CMD_Q_FORMAT_ADDR + 3, CMD_Q_FORMAT_LO);
+	vSRAM_writeBlock(CMD_Q_FORMAT_ADDR, ucaFormat, CMD_Q_FORMAT_LEN);
 
 	// Set the total number of commands to 0
 	vSRAM_write_B8(NUM_CMDS_VAR_ADDR, 0);
@@ -445,10 +1190,21 @@ void vL2SRAM_FormatCmd_Q(void)
 	vSRAM_write_B32(CMD_Q_NFL_ADDR, CMD_QUEUE_START_ADDR);
 
 	// Clears the table from the node on
-	for (ulAddr = CMD_Q_FIRST_ROW_ADDR; ulAddr <= CMD_METADATA_END_ADDR; ulAddr += 4)
+	vSRAM_fillBlock(CMD_Q_FIRST_ROW_ADDR, 0x00, (uint) (CMD_METADATA_END_ADDR + 4 - CMD_Q_FIRST_ROW_ADDR));
+
+	// Clear the RAM index to match
+	for (uiIndex = 0; uiIndex < CMD_Q_NUM_ROWS; uiIndex++)
 	{
-		vSRAM_write_B32(ulAddr, 0x00);
+		uiaL2SRAM_CmdNodeID[uiIndex] = 0;
+		ucaL2SRAM_CmdNodeCnt[uiIndex] = 0;
+		ucaL2SRAM_CmdNodeHead[uiIndex] = 0;
 	}
+	for (uiIndex = 0; uiIndex < CMD_Q_NODE_HASH_BYTES; uiIndex++)
+		ucaL2SRAM_CmdNodeHash[uiIndex] = 0;
+	for (uiIndex = 0; uiIndex < CMD_Q_SLOT_MAP_BYTES; uiIndex++)
+		ucaL2SRAM_CmdSlotUsed[uiIndex] = 0;
+	uiL2SRAM_CmdTotal = 0;
+	ucL2SRAM_CmdIndexValid = 1;
 
 #if 0
 	vL2SRAM_Display_CmdQueueMetadata();
@@ -456,6 +1212,73 @@ void vL2SRAM_FormatCmd_Q(void)
 
 }
 
+///////////////////////////////////////////////////////////////////////////////
+//!
+//! \brief Builds the RAM index of the command queue from the SRAM metadata
+//!
+//! Called at startup when the command queue survived the reset.  Rows that
+//! do not make sense are dropped.
+//!
+//!	\param none
+//! \return none
+///////////////////////////////////////////////////////////////////////////////
+void vL2SRAM_LoadCmdIndex(void)
+{
+	uchar ucaRow[CMD_METADATA_ROW_LEN];
+	uint uiRow;
+	uint uiIndex;
+	uchar ucSlot;
+	uchar ucCount;
+	ulong ulCmdAddr;
+
+	for (uiIndex = 0; uiIndex < CMD_Q_SLOT_MAP_BYTES; uiIndex++)
+		ucaL2SRAM_CmdSlotUsed[uiIndex] = 0;
+	uiL2SRAM_CmdTotal = 0;
+
+	for (uiRow = 0; uiRow < CMD_Q_NUM_ROWS; uiRow++)
+	{
+		// One burst per row
+		vSRAM_readBlock(CMD_Q_ROW_ADDR(uiRow), ucaRow, CMD_METADATA_ROW_LEN);
+
+		uiaL2SRAM_CmdNodeID[uiRow] = ((uint) ucaRow[0] << 8) | ucaRow[1];
+		ucaL2SRAM_CmdNodeCnt[uiRow] = ucaRow[NODE_ID_LEN];
+		ucaL2SRAM_CmdNodeHead[uiRow] = ucaRow[NODE_ID_LEN + NUM_CMDS_PER_NODE_LEN];
+
+		if ((uiaL2SRAM_CmdNodeID[uiRow] == 0) || (ucaL2SRAM_CmdNodeCnt[uiRow] > NUM_CMDS_PER_NODE)
+		    || (ucaL2SRAM_CmdNodeHead[uiRow] >= NUM_CMDS_PER_NODE))
+		{
+			ucaL2SRAM_CmdNodeCnt[uiRow] = 0;
+			ucaL2SRAM_CmdNodeHead[uiRow] = 0;
+		}
+
+		if (ucaL2SRAM_CmdNodeCnt[uiRow] == 0)
+		{
+			uiaL2SRAM_CmdNodeID[uiRow] = 0;
+			continue;
+		}
+
+		// Claim the command slots used by this node
+		ucSlot = ucaL2SRAM_CmdNodeHead[uiRow];
+		for (ucCount = 0; ucCount < ucaL2SRAM_CmdNodeCnt[uiRow]; ucCount++)
+		{
+			uiIndex = CMD_ROW_IDX_ADDRS + (ucSlot * CMD_ADDR_LEN);
+			ulCmdAddr = ((ulong) ucaRow[uiIndex] << 24) | ((ulong) ucaRow[uiIndex + 1] << 16) | ((ulong) ucaRow[uiIndex + 2] << 8)
+			    | (ulong) ucaRow[uiIndex + 3];
+			vL2SRAM_MarkCmdSlot(ulCmdAddr, 1);
+
+			ucSlot++;
+			if (ucSlot >= NUM_CMDS_PER_NODE)
+				ucSlot = 0;
+		}
+
+		uiL2SRAM_CmdTotal += ucaL2SRAM_CmdNodeCnt[uiRow];
+	}
+
+	vL2SRAM_RebuildCmdNodeHash();
+	ucL2SRAM_CmdIndexValid = 1;
+
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 //!
 //! \brief checks to see if the command queue has been previously formatted
@@ -465,13 +1288,17 @@ void vL2SRAM_FormatCmd_Q(void)
 ///////////////////////////////////////////////////////////////////////////////
 uchar ucL2SRAM_IsCmdQueueFormatted(void)
 {
-	if (ucSRAM_read_B8(CMD_Q_FORMAT_ADDR) != CMD_Q_FORMAT_XI)
+	uchar ucaFormat[CMD_Q_FORMAT_LEN];
+
+	vSRAM_readBlock(CMD_Q_FORMAT_ADDR, ucaFormat, CMD_Q_FORMAT_LEN);
+
+	if (ucaFormat[0] != CMD_Q_FORMAT_XI)
 		return 0;
-	if (ucSRAM_read_B8(CMD_Q_FORMAT_ADDR + 1) != CMD_Q_FORMAT_HI)
+	if (ucaFormat[1] != CMD_Q_FORMAT_HI)
 		return 0;
-	if (ucSRAM_read_B8(CMD_Q_FORMAT_ADDR + 2) != CMD_Q_FORMAT_MD)
+	if (ucaFormat[2] != CMD_Q_FORMAT_MD)
 		return 0;
-	if (ucSRAM_read_B8(CMD_Q_FORMAT_ADDR + 3) != CMD_Q_FORMAT_LO)
+	if (ucaFormat[3] != CMD_Q_FORMAT_LO)
 		return 0;
 
 	return 1;
@@ -482,32 +1309,42 @@ uchar ucL2SRAM_IsCmdQueueFormatted(void)
 //! \brief Gets the total number of commands stored in the command queue
 //!
 //!	\param none
-//! \return none
+//! \return number of commands
 ///////////////////////////////////////////////////////////////////////////////
-uchar ucL2SRAM_GetTotalCmds(void)
+uint uiL2SRAM_GetTotalCmds(void)
 {
-	return ucSRAM_read_B8(NUM_CMDS_VAR_ADDR);
+	return uiL2SRAM_CmdTotal;
 }
 
-///////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
 //!
-//! \brief Updates the total number of commands stored in the command queue
+//! \brief Finds the row of a node in the command metadata
 //!
-//!	\param ucNumCmds; Number of additional commands being stored
-//! \return none
+//! Only the RAM index is searched.  The bitmap answers the common case of a
+//! node with no pending commands without looking at the rows at all.
+//!
+//!	\param uiNodeID; ID of the node in question
+//! \return row number, CMD_Q_NUM_ROWS if the node has no row
 ///////////////////////////////////////////////////////////////////////////////
-void vL2SRAM_UpdateTotalCmds(signed char cNumCmds)
+static uint uiL2SRAM_FindCmdRow(uint uiNodeID)
 {
-	uchar ucOldCmdCount;
-	uchar ucNewCmdCount;
+	uint uiRow;
+	uint uiBit;
 
-	// Get the number of commands currently stored in the queue
-	ucOldCmdCount = ucSRAM_read_B8(NUM_CMDS_VAR_ADDR);
+	if (uiNodeID == 0)
+		return CMD_Q_NUM_ROWS;
 
-	ucNewCmdCount = ucOldCmdCount + cNumCmds;
+	uiBit = uiL2SRAM_CmdNodeHashBit(uiNodeID);
+	if (!(ucaL2SRAM_CmdNodeHash[uiBit >> 3] & (1 << (uiBit & 7))))
+		return CMD_Q_NUM_ROWS;
 
-	// Write the updated value back to the queue
-	vSRAM_write_B8(NUM_CMDS_VAR_ADDR, ucNewCmdCount);
+	for (uiRow = 0; uiRow < CMD_Q_NUM_ROWS; uiRow++)
+	{
+		if ((uiaL2SRAM_CmdNodeID[uiRow] == uiNodeID) && (ucaL2SRAM_CmdNodeCnt[uiRow] != 0))
+			return uiRow;
+	}
+
+	return CMD_Q_NUM_ROWS;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -515,164 +1352,196 @@ void vL2SRAM_UpdateTotalCmds(signed char cNumCmds)
 //! \brief Checks if there is a command pending for a node
 //!
 //!	\param uiNodeID; ID of the node in question
-//! \return ulMetaAddr; Address of the node in the meta data
+//! \return ulMetaAddr; Address of the node in the meta data, 0 if none
 ///////////////////////////////////////////////////////////////////////////////
 ulong ulL2SRAM_CheckForNode(uint uiNodeID)
 {
-	ulong ulMetaAddr;
+	uint uiRow;
 
-	// start at the start increment address by the length of a row and read until max number of cmds
-	for (ulMetaAddr = CMD_Q_FIRST_ROW_ADDR; ulMetaAddr < CMD_METADATA_END_ADDR; ulMetaAddr += CMD_METADATA_ROW_LEN)
-	{
-		if (uiSRAM_read_B16(ulMetaAddr) == uiNodeID)
-			return ulMetaAddr;
-	}
+	uiRow = uiL2SRAM_FindCmdRow(uiNodeID);
+	if (uiRow >= CMD_Q_NUM_ROWS)
+		return 0;
 
-	return 0;
+	return CMD_Q_ROW_ADDR(uiRow);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 //!
 //! \brief Gets the addresses of all commands for a particular node
 //!
+//! The addresses are returned oldest first, unused entries are 0.
 //!
-//!	\param uiNodeID, The node identification; p_ulAddr, addresses of all commands
+//!	\param uiNodeID, The node identification; p_ulAddr, NUM_CMDS_PER_NODE addresses
 //!	\return none
 ///////////////////////////////////////////////////////////////////////////////
 void vL2SRAM_GetCmdAddrs(uint uiNodeID, ulong *p_ulAddr)
 {
-	ulong ulNodeIDAddr;
-	ulong ulCmdIndex;
+	uint uiRow;
 	ulong ulCmdAddr;
+	uchar ucaAddrs[NUM_CMDS_PER_NODE * CMD_ADDR_LEN];
 	uchar ucCount;
+	uchar ucSlot;
+	uchar ucByte;
 
-	ulNodeIDAddr = ulL2SRAM_CheckForNode(uiNodeID);
-
-	if (ulNodeIDAddr == 0)
+	uiRow = uiL2SRAM_FindCmdRow(uiNodeID);
+	if (uiRow >= CMD_Q_NUM_ROWS)
 		return;
 
-	// Set the command index to the first location for the node of interest
-	ulCmdIndex = ulNodeIDAddr + NODE_ID_LEN + NUM_CMDS_PER_NODE_LEN;
+	// Read all of the command addresses for the node of interest in one pass
+	vSRAM_readBlock(CMD_Q_ROW_ADDR(uiRow) + CMD_ROW_IDX_ADDRS, ucaAddrs, NUM_CMDS_PER_NODE * CMD_ADDR_LEN);
 
-	// Look for an empty location for this node in the metadata table
+	ucSlot = ucaL2SRAM_CmdNodeHead[uiRow];
 	for (ucCount = 0; ucCount < NUM_CMDS_PER_NODE; ucCount++)
 	{
-		// Read out the address
-		ulCmdAddr = ulSRAM_read_B32(ulCmdIndex);
+		// Addresses are stored MSB first
+		ulCmdAddr = 0;
+		if (ucCount < ucaL2SRAM_CmdNodeCnt[uiRow])
+		{
+			for (ucByte = 0; ucByte < CMD_ADDR_LEN; ucByte++)
+			{
+				ulCmdAddr <<= 8;
+				ulCmdAddr |= (ulong) ucaAddrs[ucSlot * CMD_ADDR_LEN + ucByte];
+			}
+		}
 
-		*p_ulAddr = ulCmdAddr; //ulSRAM_read_B32(ulCmdIndex);
+		*p_ulAddr = ulCmdAddr;
 		p_ulAddr += 1;
 
-		// Update the command index
-		ulCmdIndex += CMD_ADDR_LEN;
+		ucSlot++;
+		if (ucSlot >= NUM_CMDS_PER_NODE)
+			ucSlot = 0;
 	}
 
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 //!
-//! \brief Writes a command into the command queue from the message buffer
+//! \brief Drops every command of a row and frees the row
 //!
-//!	\return ulong ulNodeIDAddr Address of the node ID in the metadata
+//!	\param uiRow
+//!	\return none
+//////////////////////////////////////////////////////////////////////////////
+static void vL2SRAM_DropCmdRow(uint uiRow)
+{
+	ulong ulaCmdAddr[NUM_CMDS_PER_NODE];
+	uchar ucCount;
+
+	vL2SRAM_GetCmdAddrs(uiaL2SRAM_CmdNodeID[uiRow], ulaCmdAddr);
+	for (ucCount = 0; ucCount < ucaL2SRAM_CmdNodeCnt[uiRow]; ucCount++)
+		vL2SRAM_MarkCmdSlot(ulaCmdAddr[ucCount], 0);
+
+	uiL2SRAM_CmdTotal -= ucaL2SRAM_CmdNodeCnt[uiRow];
+	uiaL2SRAM_CmdNodeID[uiRow] = 0;
+	ucaL2SRAM_CmdNodeCnt[uiRow] = 0;
+	ucaL2SRAM_CmdNodeHead[uiRow] = 0;
+
+	vSRAM_fillBlock(CMD_Q_ROW_ADDR(uiRow), 0x00, CMD_METADATA_ROW_LEN);
+	vL2SRAM_RebuildCmdNodeHash();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//!
+//! \brief Adds a node to the command metadata
+//!
+//! If the table is full the commands of the node in the first row are dropped
+//! to make room.
+//!
+//!	\return row of the node
 //!	\param uiNodeID
 //////////////////////////////////////////////////////////////////////////////
-ulong ulL2SRAM_AddNode_toQueue(uint uiNodeID)
+static uint uiL2SRAM_AddNode_toQueue(uint uiNodeID)
 {
-	ulong ulNodeIDAddr;
+	uint uiRow;
+	uint uiBit;
 
-	// start at the start increment address by the length of a row and read until max number of cmds
-	for (ulNodeIDAddr = CMD_Q_FIRST_ROW_ADDR; ulNodeIDAddr < CMD_METADATA_END_ADDR; ulNodeIDAddr += CMD_METADATA_ROW_LEN)
+	for (uiRow = 0; uiRow < CMD_Q_NUM_ROWS; uiRow++)
 	{
-		if (uiSRAM_read_B16(ulNodeIDAddr) == 0x00)
-		{
-			vSRAM_write_B16(ulNodeIDAddr, uiNodeID);
-			return ulNodeIDAddr;
-		}
+		if (ucaL2SRAM_CmdNodeCnt[uiRow] == 0)
+			break;
 	}
 
 	// Meta is full so overwrite the data in the beginning of the table
-	vSRAM_write_B16(CMD_Q_FIRST_ROW_ADDR, uiNodeID);
-	return CMD_Q_FIRST_ROW_ADDR;
+	if (uiRow >= CMD_Q_NUM_ROWS)
+	{
+		uiRow = 0;
+		vL2SRAM_DropCmdRow(uiRow);
+	}
+
+	uiaL2SRAM_CmdNodeID[uiRow] = uiNodeID;
+	ucaL2SRAM_CmdNodeCnt[uiRow] = 0;
+	ucaL2SRAM_CmdNodeHead[uiRow] = 0;
+	vSRAM_write_B16(CMD_Q_ROW_ADDR(uiRow), uiNodeID);
+
+	uiBit = uiL2SRAM_CmdNodeHashBit(uiNodeID);
+	ucaL2SRAM_CmdNodeHash[uiBit >> 3] |= (uchar) (1 << (uiBit & 7));
+
+	return uiRow;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 //!
 //! \brief Writes a command into the command queue from the message buffer
 //!
+//! If the node already has NUM_CMDS_PER_NODE commands pending its oldest
+//! command is overwritten.
+//!
 //!	\return 0 success, 1 fail
 //!	\param uiNodeID
 //////////////////////////////////////////////////////////////////////////////
 uchar ucL2SRAM_PutCMD_inQueue(uint uiNodeID)
 {
-	uchar ucCount;
-	ulong ulNodeCmdCntAddr;
+	uint uiRow;
+	uchar ucSlot;
 	ulong ulCmdIndex;
 	ulong ulCmdAddr;
-	ulong ulNFL; //Next free location (NFL)
-	ulong ulNodeIndex;
-
-	// Get the next free memory location to write the command to
-	ulNFL = ulSRAM_read_B32(CMD_Q_NFL_ADDR);
-
-	// Find the Node in the metadata
-	ulNodeIndex = ulL2SRAM_CheckForNode(uiNodeID);
-
-	// If the node is not in the metadata table then add it
-	if (ulNodeIndex == 0)
-	{
-		ulNodeIndex = ulL2SRAM_AddNode_toQueue(uiNodeID);
-	}
 
-	// Set the address for the number of commands per node byte
-	ulNodeCmdCntAddr = ulNodeIndex + NODE_ID_LEN;
+	if (!ucL2SRAM_CmdIndexValid || (uiNodeID == 0))
+		return 1;
 
-	// Set the command index to the first location for the node of interest
-	ulCmdIndex = ulNodeCmdCntAddr + NUM_CMDS_PER_NODE_LEN;
+	// Find the Node in the metadata, if the node is not in the metadata table then add it
+	uiRow = uiL2SRAM_FindCmdRow(uiNodeID);
+	if (uiRow >= CMD_Q_NUM_ROWS)
+		uiRow = uiL2SRAM_AddNode_toQueue(uiNodeID);
 
-	// Look for an empty location for this node in the metadata table
-	for (ucCount = 0; ucCount < NUM_CMDS_PER_NODE; ucCount++)
+	if (ucaL2SRAM_CmdNodeCnt[uiRow] < NUM_CMDS_PER_NODE)
 	{
-		// Read out the address
-		ulCmdAddr = ulSRAM_read_B32(ulCmdIndex);
+		// Append behind the newest command
+		ucSlot = (uchar) ((ucaL2SRAM_CmdNodeHead[uiRow] + ucaL2SRAM_CmdNodeCnt[uiRow]) % NUM_CMDS_PER_NODE);
+		ulCmdIndex = CMD_Q_ROW_ADDR(uiRow) + CMD_ROW_IDX_ADDRS + ((ulong) ucSlot * CMD_ADDR_LEN);
 
-		// The command index is empty so break out
+		ulCmdAddr = ulL2SRAM_FindFreeCmdSlot();
 		if (ulCmdAddr == 0)
-			break;
-
-		// Update the command index
-		ulCmdIndex += CMD_ADDR_LEN;
-	}
+		{
+#if 1
+			vSERIAL_sout("CmdQ full\r\n", 11);
+#endif
+			if (ucaL2SRAM_CmdNodeCnt[uiRow] == 0)
+				vL2SRAM_DropCmdRow(uiRow);
+			return 1;
+		}
 
-	// If there is no open location overwrite the oldest command
-	if (ulCmdAddr != 0)
-	{
-		ulCmdIndex = (ulNodeCmdCntAddr + NUM_CMDS_PER_NODE_LEN) + (ucSRAM_read_B8(ulNodeCmdCntAddr) % NUM_CMDS_PER_NODE) * CMD_ADDR_LEN;
+		ucaL2SRAM_CmdNodeCnt[uiRow]++;
+		uiL2SRAM_CmdTotal++;
+		vL2SRAM_MarkCmdSlot(ulCmdAddr, 1);
+		vSRAM_write_B32(ulCmdIndex, ulCmdAddr);
 	}
-	else // only increment the total number of commands if it is a new addition to the queue, not if it is an overwrite
+	else
 	{
-		// Increment the command count for the node
-		vSRAM_write_B8(ulNodeCmdCntAddr, ucSRAM_read_B8(ulNodeCmdCntAddr) + 1);
+		// Overwrite the oldest command in place
+		ucSlot = ucaL2SRAM_CmdNodeHead[uiRow];
+		ulCmdIndex = CMD_Q_ROW_ADDR(uiRow) + CMD_ROW_IDX_ADDRS + ((ulong) ucSlot * CMD_ADDR_LEN);
+		ulCmdAddr = ulSRAM_read_B32(ulCmdIndex);
 
-		// Increment the total number of commands
-		vL2SRAM_UpdateTotalCmds(1);
+		ucSlot++;
+		if (ucSlot >= NUM_CMDS_PER_NODE)
+			ucSlot = 0;
+		ucaL2SRAM_CmdNodeHead[uiRow] = ucSlot;
 	}
 
-	// Update the metadata table with the address of the command
-	vSRAM_write_B32(ulCmdIndex, ulNFL);
+	vL2SRAM_StoreCmdRowState(uiRow);
 
 	// Write the command to the queue
-	for (ucCount = 0; ucCount < MAX_MSG_SIZE; ucCount++)
-	{
-		vSRAM_write_B8(ulNFL + ucCount, ucaMSG_BUFF[ucCount]);
-	}/* END: for(ucCount) */
-
-	// Update the pointer to the NFL
-	ulNFL += MAX_MSG_SIZE;
-	// If the NFL is at the end of the queue start over at the beginning (simple ring buffer)
-	if (ulNFL >= CMD_QUEUE_END_ADDR)
-		ulNFL = CMD_QUEUE_START_ADDR;
-	// Update the NFL in SRAM
-	vSRAM_write_B32(CMD_Q_NFL_ADDR, ulNFL);
+	vSRAM_writeBlock(ulCmdAddr, (uchar *) ucaMSG_BUFF, MAX_MSG_SIZE);
 
 	return 0;
 }
@@ -686,63 +1555,69 @@ uchar ucL2SRAM_PutCMD_inQueue(uint uiNodeID)
 //////////////////////////////////////////////////////////////////////////////
 void ucL2SRAM_Delete_CMD(uint uiNodeID, ulong ulAddress)
 {
+	uint uiRow;
+	ulong ulaCmdAddr[NUM_CMDS_PER_NODE];
+	uchar ucaAddrs[NUM_CMDS_PER_NODE * CMD_ADDR_LEN];
 	uchar ucCount;
-	ulong ulAddrTemp;
-	ulong ulNodeIndex;
-	uchar ucNodeCmdCnt;
-	ulong ulCmdIndex;
-	ulong ulNodeCmdCntAddr;
+	uchar ucFound;
+	uchar ucSlot;
+	uchar ucByte;
 
 	// Find the Node in the metadata
-	ulNodeIndex = ulL2SRAM_CheckForNode(uiNodeID);
-	if (ulNodeIndex == 0)
+	uiRow = uiL2SRAM_FindCmdRow(uiNodeID);
+	if ((uiRow >= CMD_Q_NUM_ROWS) || (ulAddress == 0))
 		return;
 
-	// Set the command index to the first location for the node of interest
-	ulCmdIndex = ulNodeIndex + NODE_ID_LEN + NUM_CMDS_PER_NODE_LEN;
-
-	// Look for an matching address for this node in the metadata table
-	for (ucCount = 0; ucCount < NUM_CMDS_PER_NODE; ucCount++)
+	// Get the commands oldest first and look for a matching address
+	vL2SRAM_GetCmdAddrs(uiNodeID, ulaCmdAddr);
+	for (ucFound = 0; ucFound < ucaL2SRAM_CmdNodeCnt[uiRow]; ucFound++)
 	{
-
-		// Read out the address
-		ulAddrTemp = ulSRAM_read_B32(ulCmdIndex);
-
-		if (ulAddrTemp == ulAddress)
+		if (ulaCmdAddr[ucFound] == ulAddress)
 			break;
-
-		// Update the command index
-		ulCmdIndex = ulCmdIndex + CMD_ADDR_LEN;
 	}
+	if (ucFound >= ucaL2SRAM_CmdNodeCnt[uiRow])
+		return;
 
-	// We have found a matching command
-	if (ulAddrTemp == ulAddress)
-	{
-		// Set the address for the number of commands per node byte
-		ulNodeCmdCntAddr = ulNodeIndex + NODE_ID_LEN;
-
-		// Get the command count for this node
-		ucNodeCmdCnt = ucSRAM_read_B8(ulNodeCmdCntAddr);
+	// Close the gap so the remaining commands stay in order from the head
+	for (ucCount = ucFound; ucCount + 1 < ucaL2SRAM_CmdNodeCnt[uiRow]; ucCount++)
+		ulaCmdAddr[ucCount] = ulaCmdAddr[ucCount + 1];
+	ucaL2SRAM_CmdNodeCnt[uiRow]--;
+	uiL2SRAM_CmdTotal--;
+	vL2SRAM_MarkCmdSlot(ulAddress, 0);
 
-		// Decrement the command count for the node
-		vSRAM_write_B8(ulNodeCmdCntAddr, ucNodeCmdCnt - 1);
+	// Clear the command from the queue
+	vSRAM_fillBlock(ulAddress, 0x00, MAX_MSG_SIZE);
 
-		// If we have just deleted the last command from the table then delete the NodeID
-		if(ucNodeCmdCnt == 1)
-			vSRAM_write_B16(ulNodeIndex, 0x00);
+	// If we have just deleted the last command from the table then delete the NodeID
+	if (ucaL2SRAM_CmdNodeCnt[uiRow] == 0)
+	{
+		vL2SRAM_DropCmdRow(uiRow);
+		return;
+	}
 
-		// Clear the address in the metadata
-		vSRAM_write_B32(ulCmdIndex, 0x00);
+	// Deleting the oldest is the normal case and only moves the head
+	if (ucFound == 0)
+	{
+		ucSlot = (uchar) ((ucaL2SRAM_CmdNodeHead[uiRow] + 1) % NUM_CMDS_PER_NODE);
+		ucaL2SRAM_CmdNodeHead[uiRow] = ucSlot;
+		vSRAM_write_B32(CMD_Q_ROW_ADDR(uiRow) + CMD_ROW_IDX_ADDRS + ((ulong) ((ucSlot + NUM_CMDS_PER_NODE - 1) % NUM_CMDS_PER_NODE) * CMD_ADDR_LEN), 0);
+		vL2SRAM_StoreCmdRowState(uiRow);
+		return;
+	}
 
-		// Clear the command from the queue
-		for (ucCount = 0; ucCount < MAX_MSG_SIZE; ucCount++)
+	// Otherwise rewrite the row from slot 0
+	for (ucCount = 0; ucCount < NUM_CMDS_PER_NODE; ucCount++)
+	{
+		for (ucByte = 0; ucByte < CMD_ADDR_LEN; ucByte++)
 		{
-			vSRAM_write_B32(ulAddress + ucCount, 0x00);
-		}/* END: for(ucCount) */
-
-		// Decrement the total command count
-		vL2SRAM_UpdateTotalCmds(-1);
+			ucaAddrs[ucCount * CMD_ADDR_LEN + ucByte] = 0;
+			if (ucCount < ucaL2SRAM_CmdNodeCnt[uiRow])
+				ucaAddrs[ucCount * CMD_ADDR_LEN + ucByte] = (uchar) (ulaCmdAddr[ucCount] >> (8 * (CMD_ADDR_LEN - 1 - ucByte)));
+		}
 	}
+	vSRAM_writeBlock(CMD_Q_ROW_ADDR(uiRow) + CMD_ROW_IDX_ADDRS, ucaAddrs, NUM_CMDS_PER_NODE * CMD_ADDR_LEN);
+	ucaL2SRAM_CmdNodeHead[uiRow] = 0;
+	vL2SRAM_StoreCmdRowState(uiRow);
 
 }
 
@@ -769,14 +1644,9 @@ void ucL2SRAM_Del_current_CMD(void)
 //////////////////////////////////////////////////////////////////////////////
 void vL2SRAM_FetchCommand(ulong ulAddr)
 {
-	uchar ucCount;
-	for (ucCount = 0; ucCount < MAX_MSG_SIZE; ucCount++)
-	{
-		// Fetch the entire command, but note that the network layer must be appended afterwards to ensure
-		// proper routing.
-		ucaMSG_BUFF[ucCount] = ucSRAM_read_B8(ulAddr);
-		ulAddr++;
-	}
+	// Fetch the entire command, but note that the network layer must be appended afterwards to ensure
+	// proper routing.
+	vSRAM_readBlock(ulAddr, (uchar *) ucaMSG_BUFF, MAX_MSG_SIZE);
 
 }
 
@@ -789,21 +1659,15 @@ void vL2SRAM_FetchCommand(ulong ulAddr)
 //////////////////////////////////////////////////////////////////////////////
 void vL2SRAM_Display_CmdQueueMetadata(void)
 {
-	ulong ulRowCnt;
+	uint uiRow;
 	ulong ulColCnt;
 	ulong ulCmdAddr;
-	uchar ucCmdCnt;
 	ulong ulNodeIDAddr;
 	uint uiNodeID;
 
 	// Display the number of commands
 	vSERIAL_sout("Total number of commands = ", 27);
-	vSERIAL_UI8out(ucL2SRAM_GetTotalCmds());
-	vSERIAL_crlf();
-
-	// Display next free location
-	vSERIAL_sout("Next free location in memory = ", 31);
-	vSERIAL_HB32out(ulSRAM_read_B32(CMD_Q_NFL_ADDR));
+	vSERIAL_UI16out(uiL2SRAM_GetTotalCmds());
 	vSERIAL_crlf();
 
 	// Display the format value
@@ -814,14 +1678,13 @@ void vL2SRAM_Display_CmdQueueMetadata(void)
 	vSERIAL_bout(ucSRAM_read_B8(CMD_Q_FORMAT_ADDR + 3));
 	vSERIAL_crlf();
 
-	vSERIAL_sout("NodeID  NUM   Address 1   Address 2   Address 3   Address 4   Address 5", 71);
+	vSERIAL_sout("NodeID  NUM  HEAD  Addresses", 28);
 	vSERIAL_crlf();
 
 	// Search through the table row by row
-	for (ulRowCnt = CMD_Q_FIRST_ROW_ADDR; ulRowCnt < CMD_METADATA_END_ADDR; ulRowCnt += CMD_METADATA_ROW_LEN)
+	for (uiRow = 0; uiRow < CMD_Q_NUM_ROWS; uiRow++)
 	{
-
-		ulNodeIDAddr = ulRowCnt;
+		ulNodeIDAddr = CMD_Q_ROW_ADDR(uiRow);
 
 		// Get the node ID and display it
 		uiNodeID = uiSRAM_read_B16(ulNodeIDAddr);
@@ -835,12 +1698,13 @@ void vL2SRAM_Display_CmdQueueMetadata(void)
 		vSERIAL_sout("   ", 3);
 
 		// Get the number of commands pending for a particular node and display it
-		ucCmdCnt = ucSRAM_read_B8(ulRowCnt + NODE_ID_LEN);
-		vSERIAL_UI8out(ucCmdCnt);
+		vSERIAL_UI8out(ucSRAM_read_B8(ulNodeIDAddr + NODE_ID_LEN));
+		vSERIAL_sout("   ", 3);
+		vSERIAL_UI8out(ucSRAM_read_B8(ulNodeIDAddr + NODE_ID_LEN + NUM_CMDS_PER_NODE_LEN));
 		vSERIAL_sout("   ", 3);
 		for (ulColCnt = 0; ulColCnt < NUM_CMDS_PER_NODE; ulColCnt++)
 		{
-			ulCmdAddr = ulSRAM_read_B32(ulNodeIDAddr + NODE_ID_LEN + NUM_CMDS_PER_NODE_LEN + ulColCnt * CMD_ADDR_LEN);
+			ulCmdAddr = ulSRAM_read_B32(ulNodeIDAddr + CMD_ROW_IDX_ADDRS + ulColCnt * CMD_ADDR_LEN);
 
 			vSERIAL_HB32out(ulCmdAddr);
 			vSERIAL_sout("    ", 4);
@@ -853,62 +1717,32 @@ void vL2SRAM_Display_CmdQueueMetadata(void)
 //!
 //! \brief Get a command if it exists
 //!
+//! This runs for every link slot and nearly always finds nothing, so the
+//! no-command case is answered from RAM without touching SRAM.
+//!
 //! \param ucNodeID
-//! \return none
+//! \return 1 if a command was loaded into the message buffer, else 0
 //////////////////////////////////////////////////////////////////////////////
 uchar ucL2SRAM_LoadCmdIfExists(uint uiNodeID)
 {
-	ulong ulaCmdArrd[5];
-	ulong ulNodeIndex;
-	ulong ulNodeCmdCntAddr;
-	uchar ucPendingCmds;
-	uchar ucOldstCmdIndex;
-	uchar ucIndex;
-
-	//Init the command array
-	for(ucIndex = 0; ucIndex < 5; ucIndex++){
-		ulaCmdArrd[ucIndex] = 0L;
-	}
-
-	// Make sure the queue has been formatted before continuing
-	if (!ucL2SRAM_IsCmdQueueFormatted())
-		return 0;
+	uint uiRow;
 
 	// See if there are any commands pending; if not return
-	if (!ucL2SRAM_GetTotalCmds())
+	if (!ucL2SRAM_CmdIndexValid || (uiL2SRAM_CmdTotal == 0))
 		return 0;
 
-	// Find the Node in the metadata
-	ulNodeIndex = ulL2SRAM_CheckForNode(uiNodeID);
-
-	// If the node isn't in the table then exit
-	if (ulNodeIndex == 0)
-		return 0;
-
-	// Set the address for the number of commands per node byte
-	ulNodeCmdCntAddr = ulNodeIndex + NODE_ID_LEN;
-
-	// Check how many commands are pending for this node; if none then exit
-	ucPendingCmds = ucSRAM_read_B8(ulNodeCmdCntAddr);
-	if (ucPendingCmds == 0)
+	// Find the Node in the metadata, if the node isn't in the table then exit
+	uiRow = uiL2SRAM_FindCmdRow(uiNodeID);
+	if (uiRow >= CMD_Q_NUM_ROWS)
 		return 0;
 
-	// Get the addresses of the command from the queue
-	vL2SRAM_GetCmdAddrs(uiNodeID, ulaCmdArrd);
-
-	// Get the index of the oldest command in the array.
-	ucOldstCmdIndex = ucPendingCmds % NUM_CMDS_PER_NODE - 1;
-
-	if(ucOldstCmdIndex == 0xFF)
-		ucOldstCmdIndex = 4;
-
 	// Set the last loaded command address and node ID variables.  This is done so that the
-	// proper command can be deleted if needed
-	ulCurrentAddr = ulaCmdArrd[ucOldstCmdIndex];
+	// proper command can be deleted if needed.  The oldest command is at the head.
+	ulCurrentAddr = ulSRAM_read_B32(CMD_Q_ROW_ADDR(uiRow) + CMD_ROW_IDX_ADDRS + ((ulong) ucaL2SRAM_CmdNodeHead[uiRow] * CMD_ADDR_LEN));
 	uiCurrentNodeID = uiNodeID;
 
 	// Load the command in the message buffer
-	vL2SRAM_FetchCommand(ulaCmdArrd[ucOldstCmdIndex]);
+	vL2SRAM_FetchCommand(ulCurrentAddr);
 
 #if 1
 	vSERIAL_sout("Cmd ld\r\n", 8);
@@ -928,7 +1762,7 @@ uchar ucL2SRAM_LoadCmdIfExists(uint uiNodeID)
 void vL2SRAM_TestCmdQueue(void)
 {
 	uchar ucCount;
-	const ulong ulaCmdArrd[5] =
+	const ulong ulaCmdArrd[NUM_CMDS_PER_NODE] =
 	{ 0 };
 
 	vL2SRAM_FormatCmd_Q();
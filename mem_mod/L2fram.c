@@ -35,6 +35,9 @@
 #include "config.h" 	//configuration parameters
 #include "report.h"
 #include "main.h"
+#include "crc.h"			//CRC calculator routine
+#include "misc.h"			//byte packing routines
+#include "rand.h"			//random seed for the SD volume id
 /**********************  DEFINES  *******************************************/
 
 #define FRAM_ID_ADDR_XI						0	//4 bytes
@@ -66,14 +69,26 @@
 #define	TASK_STATE_BLOCKS		11
 #define SD_CARD_BUFFER			12
 #define	Y_TRIGGER						13
+#define SRAMQ_CKPT					14
+#define TSB_JRNL						15
+#define CFG_STORE						16
+#define SD_INDEX						17
+#define L2FRAM_SECTION_COUNT		18
 
 
 /**********************  DECLARATIONS  ***************************************/
 
 static void vL2FRAM_Init_SDCardPtrs(void);
 static void vL2FRAM_CleanSDCardBuff(void);
-static void vL2FRAM_setTSBTblCount(uchar ucBlkCount);
 void vL2FRAM_WriteNFL_SDCardBuff(unsigned int uiAddress);
+void vL2FRAM_BeginWrite(uchar ucSection);
+void vL2FRAM_CommitWrite(void);
+static uchar ucL2FRAM_chk_for_fram_id(void);
+
+// The configuration store sits at a fixed address above everything else
+#if (FRAM_SD_INDEX_END_ADDR >= FRAM_CFG_BEG_ADDR) || (FRAM_CFG_END_ADDR > FRAM_MAX_ADDRESS)
+#error "The FRAM regions run into the configuration store"
+#endif
 /////////////////////////////////////////////////////////////////////////////
 //! \fn vFRAM_SecureAllMemory
 //!
@@ -85,109 +100,131 @@ void vL2FRAM_LockAllMemory(void){
 	vFRAM_Security(0xFFFF, 0xFFFF);
 }
 
+/////////////////////////////////////////////////////////////////////////////
+//! \var uiaL2FRAM_SectionRange
+//!
+//! \brief First and last unlocked address of each section, indexed by the
+//! section ids above.  Entry 0 (and anything out of range) is locked.
+/////////////////////////////////////////////////////////////////////////////
+static const uint uiaL2FRAM_SectionRange[L2FRAM_SECTION_COUNT][2] =
+{
+	{ 0xFFFF, 0xFFFF },	// locked
+	{ FRAM_ID_ADDR_XI, FRAM_ID_ADDR_LO },	// FRAM_ID
+	{ FRAM_VER_ADDR_HI, FRAM_VER_ADDR_LO },	// VERSION
+	{ FRAM_TEST_ADDR_XI, FRAM_TEST_ADDR_LO },	// TEST_ADDRESS
+	{ FRAM_SDCARD_BLOCK_NUM_ADDR, FRAM_SDCARD_BUFF_END_PTR_ADDR + 1 },	// SD_CARD_PTRS
+	{ FRAM_TIME_SAVE_AREA_ADDR, FRAM_TIME_SAVE_AREA_ADDR + 3 },	// TIME
+	{ FRAM_REBOOT_COUNT_ADDR, FRAM_REBOOT_COUNT_ADDR + 1 },	// REBOOT_COUNT
+	{ FRAM_USER_ID_ADDR, FRAM_USER_ID_ADDR + 1 },	// NETWORK_ID
+	{ FRAM_OPTION_BYTE_0_ADDR, FRAM_OPTION_IDX_ADDR },	// OPTION_BYTES
+	{ FRAM_STATE_ON_SHUTDOWN_ADDR, FRAM_STATE_ON_SHUTDOWN_ADDR },	// SHUTDOWN_STATE
+	{ FRAM_RPT_PRTY_ADDR, FRAM_RPT_PRTY_ADDR },	// REPORTINGPRIORITY
+	{ FRAM_ST_BLK_COUNT_ADDR, FRAM_LAST_ST_BLK_ADDR },	// TASK_STATE_BLOCKS
+	{ FRAM_SD_CARD_BUFF_BEG_ADDR, FRAM_SD_CARD_BUFF_END_ADDR },	// SD_CARD_BUFFER
+	{ FRAM_Y_TRIG_AREA_BEG_ADDR, FRAM_Y_TRIG_AREA_END_ADDR },	// Y_TRIGGER
+	{ FRAM_SRAMQ_CKPT_BEG_ADDR, FRAM_SRAMQ_CKPT_END_ADDR },	// SRAMQ_CKPT
+	{ FRAM_TSB_JRNL_BEG_ADDR, FRAM_TSB_JRNL_END_ADDR },	// TSB_JRNL
+	{ FRAM_CFG_BEG_ADDR, FRAM_CFG_END_ADDR },	// CFG_STORE
+	{ FRAM_SD_INDEX_BEG_ADDR, FRAM_SD_INDEX_END_ADDR }	// SD_INDEX
+};
+
+//! \def L2FRAM_TXN_MAX_DEPTH
+//! \brief Number of write transactions that can be open inside each other
+#define L2FRAM_TXN_MAX_DEPTH		4
+
+//! \var ucL2FRAM_TxnSection
+//! \brief Section of the innermost open write transaction, 0 if none
+static uchar ucL2FRAM_TxnSection = 0;
+
+//! \var ucL2FRAM_TxnDepth
+//! \brief Number of open write transactions
+static uchar ucL2FRAM_TxnDepth = 0;
+
+//! \var ucaL2FRAM_TxnOuter
+//! \brief Section of the enclosing transaction at each depth
+static uchar ucaL2FRAM_TxnOuter[L2FRAM_TXN_MAX_DEPTH];
+
+//! \var uiL2FRAM_TSBJrnlSeq
+//! \brief Sequence number of the last TSB journal record
+static uint uiL2FRAM_TSBJrnlSeq = 0;
+
+//! \var ucaL2FRAM_TSBJrnlLive
+//! \brief Copy of the newest TSB journal record
+static uchar ucaL2FRAM_TSBJrnlLive[FRAM_TSB_JRNL_SIZE];
+
+//! \var ucL2FRAM_TSBJrnlLive
+//! \brief 1 while the table has not caught up with ucaL2FRAM_TSBJrnlLive
+static uchar ucL2FRAM_TSBJrnlLive = 0;
+
 /////////////////////////////////////////////////////////////////////////////
 //! \fn vL2FRAM_SetSecurity
 //!
-//! \brief Secures all memory locations in FRAM
+//! \brief Unlocks a section of FRAM or locks all of it
+//!
+//! While a write transaction is open a lock falls back to the section of
+//! the transaction instead of locking everything, so the pointer and table
+//! helpers can still be used inside a transaction.
 /////////////////////////////////////////////////////////////////////////////
 void vL2FRAM_SetSecurity(uchar ucSection, uchar ucState){
 
-	uint uiStartAddress;
-	uint uiEndAddress;
-
-	// If state is lock then set addresses to the locked state
-	if (ucState == FRAM_LOCK) {
-		uiStartAddress = 0xFFFF;
-		uiEndAddress = 0xFFFF;
-
-		// Set the security at the driver level
-		vFRAM_Security(uiStartAddress, uiEndAddress);
-
-		return;
-	}
-
-	// Set unlock bit and unlock section of memory at the driver level
-	switch (ucSection)
-	{
-		case FRAM_ID:
-			uiStartAddress = FRAM_ID_ADDR_XI;
-			uiEndAddress = FRAM_ID_ADDR_LO;
-		break;
-
-		case VERSION:
-			uiStartAddress = FRAM_VER_ADDR_HI;
-			uiEndAddress = FRAM_VER_ADDR_LO;
-		break;
-
-		case TEST_ADDRESS:
-			uiStartAddress = FRAM_TEST_ADDR_XI;
-			uiEndAddress = FRAM_TEST_ADDR_LO;
-		break;
-
-		case SD_CARD_PTRS:
-			uiStartAddress = FRAM_SDCARD_BLOCK_NUM_ADDR;
-			uiEndAddress = FRAM_SDCARD_BUFF_END_PTR_ADDR + 1;
-		break;
+	// If state is lock then go back to the transaction window (locked if none)
+	if (ucState == FRAM_LOCK)
+		ucSection = ucL2FRAM_TxnSection;
 
-		case TIME:
-			uiStartAddress = FRAM_TIME_SAVE_AREA_ADDR;
-			uiEndAddress = FRAM_TIME_SAVE_AREA_ADDR + 3;
-		break;
-
-		case REBOOT_COUNT:
-			uiStartAddress = FRAM_REBOOT_COUNT_ADDR;
-			uiEndAddress = FRAM_REBOOT_COUNT_ADDR + 1;
-		break;
-
-		case NETWORK_ID:
-			uiStartAddress = FRAM_USER_ID_ADDR;
-			uiEndAddress = FRAM_USER_ID_ADDR + 1;
-		break;
-
-		case OPTION_BYTES:
-			uiStartAddress = FRAM_OPTION_BYTE_0_ADDR;
-			uiEndAddress = FRAM_OPTION_IDX_ADDR;
-		break;
+	if (ucSection >= L2FRAM_SECTION_COUNT)
+		ucSection = 0;
 
-		case SHUTDOWN_STATE:
-			uiStartAddress = FRAM_STATE_ON_SHUTDOWN_ADDR;
-			uiEndAddress = FRAM_STATE_ON_SHUTDOWN_ADDR;
-		break;
+	// Set the security at the driver level
+	vFRAM_Security(uiaL2FRAM_SectionRange[ucSection][0], uiaL2FRAM_SectionRange[ucSection][1]);
+}
 
-		case REPORTINGPRIORITY:
-			uiStartAddress = FRAM_RPT_PRTY_ADDR;
-			uiEndAddress = FRAM_RPT_PRTY_ADDR;
-		break;
+/////////////////////////////////////////////////////////////////////////////
+//! \fn vL2FRAM_BeginWrite
+//!
+//! \brief Opens a write transaction on one section
+//!
+//! The section is unlocked and the FRAM bus brought up once.  Any number of
+//! reads and writes to the section can follow without touching the security
+//! or bus state again until vL2FRAM_CommitWrite() relocks.  Transactions
+//! nest: the enclosing section is saved and unlocked again when the inner
+//! transaction commits.
+//!
+//! \param ucSection
+/////////////////////////////////////////////////////////////////////////////
+void vL2FRAM_BeginWrite(uchar ucSection){
 
-		case TASK_STATE_BLOCKS:
-			uiStartAddress = FRAM_ST_BLK_COUNT_ADDR;
-			uiEndAddress = FRAM_LAST_ST_BLK_ADDR;
-		break;
+	// Save the enclosing section so the commit can return to it
+	if (ucL2FRAM_TxnDepth < L2FRAM_TXN_MAX_DEPTH)
+		ucaL2FRAM_TxnOuter[ucL2FRAM_TxnDepth] = ucL2FRAM_TxnSection;
+	else
+		vSERIAL_sout("L2FRM:TxnDepth\r\n", 16);
+	ucL2FRAM_TxnDepth++;
 
-		case SD_CARD_BUFFER:
-			uiStartAddress = FRAM_SD_CARD_BUFF_BEG_ADDR;
-			uiEndAddress = FRAM_SD_CARD_OVRFLO_END_ADDR;
-		break;
+	ucL2FRAM_TxnSection = ucSection;
+	vL2FRAM_SetSecurity(ucSection, FRAM_UNLOCK);
+	vFRAM_BeginTxn();
+}
 
-		case Y_TRIGGER:
-			uiStartAddress = FRAM_Y_TRIG_AREA_BEG_ADDR;
-			uiEndAddress = FRAM_Y_TRIG_AREA_END_ADDR;
-		break;
+/////////////////////////////////////////////////////////////////////////////
+//! \fn vL2FRAM_CommitWrite
+//!
+//! \brief Closes the innermost write transaction
+//!
+//! FRAM is locked again, or left unlocked for the enclosing transaction's
+//! section if there is one.
+/////////////////////////////////////////////////////////////////////////////
+void vL2FRAM_CommitWrite(void){
 
-		default:
-			uiStartAddress = 0xFFFF;
-			uiEndAddress = 0xFFFF;
-		break;
-	}
+	if (ucL2FRAM_TxnDepth == 0)
+		return;
 
-	// If state is lock then set addresses to the locked state
-	if (ucState == FRAM_LOCK) {
-		uiStartAddress = 0xFFFF;
-		uiEndAddress = 0xFFFF;
-	}
+	vFRAM_EndTxn();
+	ucL2FRAM_TxnDepth--;
+	if (ucL2FRAM_TxnDepth < L2FRAM_TXN_MAX_DEPTH)
+		ucL2FRAM_TxnSection = ucaL2FRAM_TxnOuter[ucL2FRAM_TxnDepth];
 
-	// Set the security at the driver level
-	vFRAM_Security(uiStartAddress, uiEndAddress);
+	// Lock falls back to the enclosing section (everything if none)
+	vL2FRAM_SetSecurity(0, FRAM_LOCK);
 }
 
 /**********************  ucL2FRAM_chk_for_fram()  *****************************
@@ -271,7 +308,11 @@ uchar ucL2FRAM_chk_for_fram(uchar ucReportMode //FRAM_CHK_SILENT_MODE, FRAM_CHK_
  *****************************************************************************/
 void vL2FRAM_format_fram(void)
 {
-	uchar ucii, ucTSBCount;
+	uchar ucii;
+	uchar ucHadID;
+
+	// A part that was formatted before, by any layout version, keeps its configuration
+	ucHadID = ucL2FRAM_chk_for_fram_id();
 
 	// Unlock the ID section
 	vL2FRAM_SetSecurity(FRAM_ID, FRAM_UNLOCK);
@@ -303,31 +344,48 @@ void vL2FRAM_format_fram(void)
 	vL2FRAM_SetSecurity(REBOOT_COUNT, FRAM_UNLOCK);
 	ucFRAM_write_B16(FRAM_REBOOT_COUNT_ADDR, 0);
 
+	// Keep the configuration store (values from the old fixed addresses are
+	// migrated on load) or start it over on a part that was never formatted
+	if (ucHadID)
+		vL2FRAM_CfgLoad();
+	else
+		vL2FRAM_CfgReset();
+
 	/* WRITE THE FRAM WIZARD ID AREA */
-	vL2FRAM_SetSecurity(NETWORK_ID, FRAM_UNLOCK);
-	ucFRAM_write_B16(FRAM_USER_ID_ADDR, uiROM_getRomConfigSnumAsUint());
+	if (!ucL2FRAM_CfgIsStored(FRAM_CFG_KEY_SYS_ID))
+		vL2FRAM_setSysID(uiROM_getRomConfigSnumAsUint());
 
 	// Write the shutdown state area to indicate a successful shutdown
-	vL2FRAM_SetSecurity(SHUTDOWN_STATE, FRAM_UNLOCK);
-	ucFRAM_write_B8(FRAM_STATE_ON_SHUTDOWN_ADDR, 0x00);
+	vL2FRAM_SetStateOnShutdown(0x00);
+
+	// The SD card pointers were reset above, the volume goes with them
+	vL2FRAM_CfgSetU16(FRAM_CFG_KEY_SD_VOLUME, 0);
 
 	// Set the systems reporting priority to the default
-	vL2FRAM_SetReportingPriority(DEFAULTREPORTINGPRIORITY);
+	if (!ucL2FRAM_CfgIsStored(FRAM_CFG_KEY_RPT_PRTY))
+		vL2FRAM_SetReportingPriority(DEFAULTREPORTINGPRIORITY);
 
 	/* WRITE THE DEFAULT OPTION ARRAY INTO THE FRAM ARRAY */
-	vMODOPT_copyAllRomOptionsToFramOptions(DEFAULT_ROLE_IDX);
+	if (!ucL2FRAM_CfgIsStored(FRAM_CFG_KEY_OPTIONS))
+		vMODOPT_copyAllRomOptionsToFramOptions(DEFAULT_ROLE_IDX);
 	vMODOPT_copyAllFramOptionsToRamOptions(); //copy to RAM
 
-	// Set the task state block number to 0 and clear all TSBs
-	vL2FRAM_setTSBTblCount(0);
-	for(ucTSBCount = 0; ucTSBCount<FRAM_MAX_TSB_COUNT; ucTSBCount++)
-		vL2FRAM_deleteTSB(ucTSBCount);
+	// Set the task state block number to 0, clear all TSBs and drop any journal record
+	vFRAM_fillFramBlk(FRAM_ST_BLK_COUNT_ADDR, FRAM_LAST_ST_BLK_ADDR - FRAM_ST_BLK_COUNT_ADDR, 0);
+	vFRAM_fillFramBlk(FRAM_TSB_JRNL_BEG_ADDR, FRAM_TSB_JRNL_SIZE * FRAM_TSB_JRNL_COUNT, 0);
+	ucL2FRAM_TSBJrnlLive = 0;
 
 	/*----------------  NOW INIT Y TRIGGER TABLE  --------------------------*/
 	for (ucii = 0; ucii < SENSOR_MAX_VALUE; ucii++){
 		vL2FRAM_putYtriggerVal(ucii, 0);
 	}
 
+	// Invalidate the SRAM queue checkpoints
+	vFRAM_fillFramBlk(FRAM_SRAMQ_CKPT_BEG_ADDR, FRAM_SRAMQ_CKPT_SIZE * FRAM_SRAMQ_CKPT_COUNT, 0);
+
+	// Clear the SD log index entries
+	vFRAM_fillFramBlk(FRAM_SD_INDEX_BEG_ADDR, FRAM_SD_INDEX_SIZE, 0);
+
 	// Lock FRAM
 	vL2FRAM_SetSecurity(0, FRAM_LOCK);
 
@@ -349,8 +407,6 @@ void vL2FRAM_format_fram(void)
 uint uiL2FRAM_chk_for_fram_format(void)
 {
 	uint uiRetVal;
-	uchar ucTemp;
-
 
 	// Unlock FRAM and read the version
 	vL2FRAM_SetSecurity(VERSION, FRAM_UNLOCK);
@@ -368,31 +424,54 @@ uint uiL2FRAM_chk_for_fram_format(void)
 		uiRetVal = 0;
 	}
 
+	if (!ucL2FRAM_chk_for_fram_id())
+		uiRetVal = 0;
+
+	// Lock FRAM
+	vL2FRAM_SetSecurity(0, FRAM_LOCK);
+
+	return (uiRetVal);
+
+}/* END: uiL2FRAM_chk_for_fram_format() */
+
+/////////////////////////////////////////////////////////////////////////////
+//! \fn ucL2FRAM_chk_for_fram_id
+//!
+//! \brief Checks for the FRAM logo in bytes 0-3, whatever the layout version
+//!
+//! \return 1 if the part was formatted at some point, 0 otherwise
+/////////////////////////////////////////////////////////////////////////////
+static uchar ucL2FRAM_chk_for_fram_id(void)
+{
+	uchar ucRetVal;
+	uchar ucTemp;
+
+	ucRetVal = 1;
+
 	// Unlock the FRAM ID section
 	vL2FRAM_SetSecurity(FRAM_ID, FRAM_UNLOCK);
 
 	ucFRAM_read_B8(FRAM_ID_ADDR_XI, &ucTemp);
 	if (ucTemp != FRAM_ID_VAL_XI)
-		uiRetVal = 0;
+		ucRetVal = 0;
 
 	ucFRAM_read_B8(FRAM_ID_ADDR_HI, &ucTemp);
 	if (ucTemp != FRAM_ID_VAL_HI)
-		uiRetVal = 0;
+		ucRetVal = 0;
 
 	ucFRAM_read_B8(FRAM_ID_ADDR_MD, &ucTemp);
 	if (ucTemp != FRAM_ID_VAL_MD)
-		uiRetVal = 0;
+		ucRetVal = 0;
 
 	ucFRAM_read_B8(FRAM_ID_ADDR_LO, &ucTemp);
 	if (ucTemp != FRAM_ID_VAL_LO)
-		uiRetVal = 0;
+		ucRetVal = 0;
 
-	// Lock FRAM
 	vL2FRAM_SetSecurity(0, FRAM_LOCK);
 
-	return (uiRetVal);
+	return (ucRetVal);
 
-}/* END: uiL2FRAM_chk_for_fram_format() */
+}/* END: ucL2FRAM_chk_for_fram_id() */
 
 
 /////////////////////////////////////////////////////////////////////////////////////
@@ -412,25 +491,355 @@ void vL2FRAM_force_fram_unformat(void)
 }/* END: vL2FRAM_force_fram_unformat() */
 
 
+//////////////////////////////////////////////////////////////////////////////
+//! \fn ucL2FRAM_setTSBImageField
+//!
+//! \brief Packs one field into a RAM image of a task state block
+//!
+//! \param ucpImg, FRAM_ST_BLK_SIZE bytes
+//! \param ucTSBEntryIdx, ulVal
+//! \return 0 if ok, 1 if the index is not a field
+//////////////////////////////////////////////////////////////////////////////
+static uchar ucL2FRAM_setTSBImageField(uchar *ucpImg, uchar ucTSBEntryIdx, ulong ulVal)
+{
+	switch (ucTSBEntryIdx)
+	{
+		case FRAM_ST_BLK_TASK_IDX: //byte
+		case FRAM_ST_BLK_TASK_STATE:
+			ucpImg[ucTSBEntryIdx] = (uchar) ulVal;
+		break;
+
+		case FRAM_ST_BLK_TASK_ID: // Integers
+		case FRAM_ST_BLK_FLAGS:
+			vMISC_copyUintIntoBytes((uint) ulVal, &ucpImg[ucTSBEntryIdx], NO_NOINT);
+		break;
+
+		case FRAM_ST_BLK_PARAM1: // Longs
+		case FRAM_ST_BLK_PARAM2:
+		case FRAM_ST_BLK_PARAM3:
+		case FRAM_ST_BLK_PARAM4:
+			vMISC_copyUlongIntoBytes(ulVal, &ucpImg[ucTSBEntryIdx], NO_NOINT);
+		break;
+
+		default:
+			return 1;
+
+	}/* END: switch() */
+
+	return 0;
+
+}/* END: ucL2FRAM_setTSBImageField() */
+
+//////////////////////////////////////////////////////////////////////////////
+//! \fn vL2FRAM_buildTSBImage
+//!
+//! \brief Fills a journal image slot with a complete task state block
+//!
+//! \param ucpSlot, journal image slot (TSB number followed by the block)
+//! \param ucTSBNum, ucTskIndex, uiTaskID, uiFlagVal, ucState, ulParam1, ulParam2, ulParam3, ulParam4
+//////////////////////////////////////////////////////////////////////////////
+static void vL2FRAM_buildTSBImage(uchar *ucpSlot, uchar ucTSBNum, uchar ucTskIndex, uint uiTaskID,
+		uint uiFlagVal, uchar ucState, ulong ulParam1, ulong ulParam2, ulong ulParam3, ulong ulParam4)
+{
+	uchar *ucpImg;
+
+	ucpSlot[0] = ucTSBNum;
+	ucpImg = &ucpSlot[1];
+
+	ucL2FRAM_setTSBImageField(ucpImg, FRAM_ST_BLK_TASK_IDX, (ulong) ucTskIndex);
+	ucL2FRAM_setTSBImageField(ucpImg, FRAM_ST_BLK_TASK_ID, (ulong) uiTaskID);
+	ucL2FRAM_setTSBImageField(ucpImg, FRAM_ST_BLK_FLAGS, (ulong) uiFlagVal);
+	ucL2FRAM_setTSBImageField(ucpImg, FRAM_ST_BLK_TASK_STATE, (ulong) ucState);
+	ucL2FRAM_setTSBImageField(ucpImg, FRAM_ST_BLK_PARAM1, ulParam1);
+	ucL2FRAM_setTSBImageField(ucpImg, FRAM_ST_BLK_PARAM2, ulParam2);
+	ucL2FRAM_setTSBImageField(ucpImg, FRAM_ST_BLK_PARAM3, ulParam3);
+	ucL2FRAM_setTSBImageField(ucpImg, FRAM_ST_BLK_PARAM4, ulParam4);
+
+}/* END: vL2FRAM_buildTSBImage() */
+
+//////////////////////////////////////////////////////////////////////////////
+//! \fn ulL2FRAM_getTSBImageField
+//!
+//! \brief Unpacks one field from a RAM image of a task state block
+//!
+//! \param ucpImg, FRAM_ST_BLK_SIZE bytes
+//! \param ucTSBEntryIdx
+//! \return the field, 0 if the index is not a field
+//////////////////////////////////////////////////////////////////////////////
+static ulong ulL2FRAM_getTSBImageField(const uchar *ucpImg, uchar ucTSBEntryIdx)
+{
+	switch (ucTSBEntryIdx)
+	{
+		case FRAM_ST_BLK_TASK_IDX: //byte
+		case FRAM_ST_BLK_TASK_STATE:
+			return (ulong) ucpImg[ucTSBEntryIdx];
+
+		case FRAM_ST_BLK_TASK_ID: // Integers
+		case FRAM_ST_BLK_FLAGS:
+			return (ulong) uiMISC_buildUintFromBytes((uchar *) &ucpImg[ucTSBEntryIdx], NO_NOINT);
+
+		case FRAM_ST_BLK_PARAM1: // Longs
+		case FRAM_ST_BLK_PARAM2:
+		case FRAM_ST_BLK_PARAM3:
+		case FRAM_ST_BLK_PARAM4:
+			return ulMISC_buildUlongFromBytes((uchar *) &ucpImg[ucTSBEntryIdx], NO_NOINT);
+
+		default:
+			return 0;
+
+	}/* END: switch() */
+
+}/* END: ulL2FRAM_getTSBImageField() */
+
+//////////////////////////////////////////////////////////////////////////////
+//! \fn ucpL2FRAM_findLiveTSBImage
+//!
+//! \brief Finds a block in the journal record the table has not caught up with
+//!
+//! \param ucTSBNum
+//! \return the block image, 0 if the table copy of the block is current
+//////////////////////////////////////////////////////////////////////////////
+static const uchar *ucpL2FRAM_findLiveTSBImage(uchar ucTSBNum)
+{
+	uchar ucImg;
+	const uchar *ucpSlot;
+
+	if (ucL2FRAM_TSBJrnlLive == 0)
+		return 0;
+
+	for (ucImg = 0; ucImg < ucaL2FRAM_TSBJrnlLive[FRAM_TSB_JRNL_IDX_NUM_IMGS]; ucImg++)
+	{
+		ucpSlot = &ucaL2FRAM_TSBJrnlLive[FRAM_TSB_JRNL_IDX_IMG + ((uint) ucImg * FRAM_TSB_JRNL_IMG_SZ)];
+		if (ucpSlot[0] == ucTSBNum)
+			return &ucpSlot[1];
+	}
+
+	return 0;
+
+}/* END: ucpL2FRAM_findLiveTSBImage() */
+
+//////////////////////////////////////////////////////////////////////////////
+//! \fn vL2FRAM_readTSBImage
+//!
+//! \brief Reads a task state block into a journal image slot
+//!
+//! \param ucpSlot, journal image slot
+//! \param ucTSBNum
+//////////////////////////////////////////////////////////////////////////////
+static void vL2FRAM_readTSBImage(uchar *ucpSlot, uchar ucTSBNum)
+{
+	const uchar *ucpImg;
+	uchar ucii;
+
+	ucpSlot[0] = ucTSBNum;
+
+	// The newest record is ahead of the table for its blocks
+	ucpImg = ucpL2FRAM_findLiveTSBImage(ucTSBNum);
+	if (ucpImg != 0)
+	{
+		for (ucii = 0; ucii < FRAM_ST_BLK_SIZE; ucii++)
+			ucpSlot[1 + ucii] = ucpImg[ucii];
+		return;
+	}
+
+	vL2FRAM_SetSecurity(TASK_STATE_BLOCKS, FRAM_UNLOCK);
+	ucFRAM_read_block(FRAM_ST_BLK_0_ADDR + ((uint) ucTSBNum * FRAM_ST_BLK_SIZE), &ucpSlot[1], FRAM_ST_BLK_SIZE);
+	vL2FRAM_SetSecurity(0, FRAM_LOCK);
+
+}/* END: vL2FRAM_readTSBImage() */
+
+//////////////////////////////////////////////////////////////////////////////
+//! \fn vL2FRAM_applyTSBJrnl
+//!
+//! \brief Copies the images and table count of a journal record into the
+//! task state block table
+//!
+//! Writing the same record twice leaves the same result, so this is safe to
+//! repeat after a reset.
+//!
+//! \param ucpRec, FRAM_TSB_JRNL_SIZE bytes
+//////////////////////////////////////////////////////////////////////////////
+static void vL2FRAM_applyTSBJrnl(const uchar *ucpRec)
+{
+	uchar ucImg;
+	const uchar *ucpSlot;
+
+	vL2FRAM_BeginWrite(TASK_STATE_BLOCKS);
+
+	for (ucImg = 0; ucImg < ucpRec[FRAM_TSB_JRNL_IDX_NUM_IMGS]; ucImg++)
+	{
+		ucpSlot = &ucpRec[FRAM_TSB_JRNL_IDX_IMG + ((uint) ucImg * FRAM_TSB_JRNL_IMG_SZ)];
+		if (ucpSlot[0] < FRAM_MAX_TSB_COUNT)
+			ucFRAM_write_block(FRAM_ST_BLK_0_ADDR + ((uint) ucpSlot[0] * FRAM_ST_BLK_SIZE), &ucpSlot[1], FRAM_ST_BLK_SIZE);
+	}
+
+	ucFRAM_write_B8(FRAM_ST_BLK_COUNT_ADDR, ucpRec[FRAM_TSB_JRNL_IDX_COUNT]);
+
+	vL2FRAM_CommitWrite();
+
+}/* END: vL2FRAM_applyTSBJrnl() */
+
+//////////////////////////////////////////////////////////////////////////////
+//! \fn ucL2FRAM_TSBJrnlCovers
+//!
+//! \brief Tells whether a record rewrites every block of another record
+//!
+//! \param ucpNew, ucpOld, FRAM_TSB_JRNL_SIZE bytes each
+//! \return 1 if each block of ucpOld is also in ucpNew
+//////////////////////////////////////////////////////////////////////////////
+static uchar ucL2FRAM_TSBJrnlCovers(const uchar *ucpNew, const uchar *ucpOld)
+{
+	uchar ucOld, ucNew;
+	uchar ucTSBNum;
+
+	for (ucOld = 0; ucOld < ucpOld[FRAM_TSB_JRNL_IDX_NUM_IMGS]; ucOld++)
+	{
+		ucTSBNum = ucpOld[FRAM_TSB_JRNL_IDX_IMG + ((uint) ucOld * FRAM_TSB_JRNL_IMG_SZ)];
+
+		for (ucNew = 0; ucNew < ucpNew[FRAM_TSB_JRNL_IDX_NUM_IMGS]; ucNew++)
+		{
+			if (ucpNew[FRAM_TSB_JRNL_IDX_IMG + ((uint) ucNew * FRAM_TSB_JRNL_IMG_SZ)] == ucTSBNum)
+				break;
+		}
+
+		if (ucNew == ucpNew[FRAM_TSB_JRNL_IDX_NUM_IMGS])
+			return 0;
+	}
+
+	return 1;
+
+}/* END: ucL2FRAM_TSBJrnlCovers() */
+
+//////////////////////////////////////////////////////////////////////////////
+//! \fn vL2FRAM_commitTSBJrnl
+//!
+//! \brief Seals a journal record and writes it to FRAM
+//!
+//! The caller fills the image slots.  The record goes out in one burst to
+//! the slot of the older record, so a reset leaves either the previous
+//! record (torn record, CRC fails) or this one to roll forward at boot.
+//! The previous record stops counting once this one lands, so the table is
+//! brought up to it first unless this record rewrites all of its blocks.
+//!
+//! \param ucpRec, FRAM_TSB_JRNL_SIZE bytes with the image slots filled
+//! \param ucCount, TSB table count after the change
+//! \param ucNumImgs, number of image slots used
+//////////////////////////////////////////////////////////////////////////////
+static void vL2FRAM_commitTSBJrnl(uchar *ucpRec, uchar ucCount, uchar ucNumImgs)
+{
+	uint uiCRC;
+	uint uiIdx;
+
+	uiL2FRAM_TSBJrnlSeq++;
+
+	vMISC_copyUintIntoBytes(FRAM_TSB_JRNL_MAGIC, &ucpRec[FRAM_TSB_JRNL_IDX_MAGIC], NO_NOINT);
+	vMISC_copyUintIntoBytes(uiL2FRAM_TSBJrnlSeq, &ucpRec[FRAM_TSB_JRNL_IDX_SEQ], NO_NOINT);
+	ucpRec[FRAM_TSB_JRNL_IDX_COUNT] = ucCount;
+	ucpRec[FRAM_TSB_JRNL_IDX_NUM_IMGS] = ucNumImgs;
+
+	uiCRC = uiCRC16_ComputeBlockCRC(ucpRec, FRAM_TSB_JRNL_IDX_CRC);
+	vMISC_copyUintIntoBytes(uiCRC, &ucpRec[FRAM_TSB_JRNL_IDX_CRC], NO_NOINT);
+
+	if (ucL2FRAM_TSBJrnlLive && !ucL2FRAM_TSBJrnlCovers(ucpRec, ucaL2FRAM_TSBJrnlLive))
+		vL2FRAM_applyTSBJrnl(ucaL2FRAM_TSBJrnlLive);
+
+	vL2FRAM_SetSecurity(TSB_JRNL, FRAM_UNLOCK);
+	ucFRAM_write_block(FRAM_TSB_JRNL_BEG_ADDR + ((uiL2FRAM_TSBJrnlSeq % FRAM_TSB_JRNL_COUNT) * FRAM_TSB_JRNL_SIZE),
+			ucpRec, FRAM_TSB_JRNL_SIZE);
+	vL2FRAM_SetSecurity(0, FRAM_LOCK);
+
+	for (uiIdx = 0; uiIdx < FRAM_TSB_JRNL_SIZE; uiIdx++)
+		ucaL2FRAM_TSBJrnlLive[uiIdx] = ucpRec[uiIdx];
+	ucL2FRAM_TSBJrnlLive = 1;
+
+}/* END: vL2FRAM_commitTSBJrnl() */
+
+//////////////////////////////////////////////////////////////////////////////
+//! \fn ucL2FRAM_replayTSBJrnl
+//!
+//! \brief Rolls the newest task state block journal record forward
+//!
+//! Must run at boot before any task is loaded from its TSB.  A record with a
+//! bad magic or CRC was cut off while being written, so the record in the
+//! other slot is the newest one that counts.
+//!
+//! \return 1 if a record was applied, 0 otherwise
+//////////////////////////////////////////////////////////////////////////////
+uchar ucL2FRAM_replayTSBJrnl(void)
+{
+	uchar ucaRec[FRAM_TSB_JRNL_SIZE];
+	uchar ucSlot;
+	uchar ucBestSlot;
+	uint uiSeq;
+	uint uiIdx;
+
+	ucL2FRAM_TSBJrnlLive = 0;
+	ucBestSlot = FRAM_TSB_JRNL_COUNT;
+
+	for (ucSlot = 0; ucSlot < FRAM_TSB_JRNL_COUNT; ucSlot++)
+	{
+		vL2FRAM_SetSecurity(TSB_JRNL, FRAM_UNLOCK);
+		ucFRAM_read_block(FRAM_TSB_JRNL_BEG_ADDR + ((uint) ucSlot * FRAM_TSB_JRNL_SIZE), ucaRec, FRAM_TSB_JRNL_SIZE);
+		vL2FRAM_SetSecurity(0, FRAM_LOCK);
+
+		if (uiMISC_buildUintFromBytes(&ucaRec[FRAM_TSB_JRNL_IDX_MAGIC], NO_NOINT) != FRAM_TSB_JRNL_MAGIC)
+			continue;
+
+		if (uiCRC16_ComputeBlockCRC(ucaRec, FRAM_TSB_JRNL_IDX_CRC)
+				!= uiMISC_buildUintFromBytes(&ucaRec[FRAM_TSB_JRNL_IDX_CRC], NO_NOINT))
+		{
+			vSERIAL_sout("L2FRM:TSBJrnlTorn\r\n", 19);
+			continue;
+		}
+
+		if (ucaRec[FRAM_TSB_JRNL_IDX_NUM_IMGS] > FRAM_TSB_JRNL_MAX_IMGS || ucaRec[FRAM_TSB_JRNL_IDX_COUNT] > FRAM_MAX_TSB_COUNT)
+			continue;
+
+		// Keep the newer of the two (sequence numbers wrap)
+		uiSeq = uiMISC_buildUintFromBytes(&ucaRec[FRAM_TSB_JRNL_IDX_SEQ], NO_NOINT);
+		if ((ucBestSlot == FRAM_TSB_JRNL_COUNT) || ((int) (uiSeq - uiL2FRAM_TSBJrnlSeq) > 0))
+		{
+			ucBestSlot = ucSlot;
+			uiL2FRAM_TSBJrnlSeq = uiSeq;
+			for (uiIdx = 0; uiIdx < FRAM_TSB_JRNL_SIZE; uiIdx++)
+				ucaL2FRAM_TSBJrnlLive[uiIdx] = ucaRec[uiIdx];
+		}
+	}
+
+	if (ucBestSlot == FRAM_TSB_JRNL_COUNT)
+		return 0;
+
+	// Numbering carries on from the newest record, which the table now matches
+	vL2FRAM_applyTSBJrnl(ucaL2FRAM_TSBJrnlLive);
+
+#if 0
+	vSERIAL_sout("TSB jrnl replayed, seq= ", 24);
+	vSERIAL_UIV16out(uiL2FRAM_TSBJrnlSeq);
+	vSERIAL_crlf();
+#endif
+
+	return 1;
+
+}/* END: ucL2FRAM_replayTSBJrnl() */
+
 //////////////////////////////////////////////////////////////////////////////
 //! \fn vL2FRAM_stuffTSB
 //!
 //! \brief stuff a single task state blk with the data.
 //!
+//! The whole block goes through the journal as one record.
+//!
 //! \param ucTSBNum, ucTskIndex, uiTaskID, uiFlagVal, ucState, ulParam1, ulParam2, ulParam3, ulParam4
 //////////////////////////////////////////////////////////////////////////////
 void vL2FRAM_stuffTSB(uchar ucTSBNum, uchar ucTskIndex, uint uiTaskID, uint uiFlagVal,
 		uchar ucState, ulong ulParam1, ulong ulParam2, ulong ulParam3, ulong ulParam4)
 {
+	uchar ucaRec[FRAM_TSB_JRNL_SIZE];
+
+	vL2FRAM_buildTSBImage(&ucaRec[FRAM_TSB_JRNL_IDX_IMG], ucTSBNum, ucTskIndex, uiTaskID, uiFlagVal,
+			ucState, ulParam1, ulParam2, ulParam3, ulParam4);
 
-	vL2FRAM_putTSBEntryVal(ucTSBNum, FRAM_ST_BLK_TASK_IDX, (ulong) ucTskIndex);
-	vL2FRAM_putTSBEntryVal(ucTSBNum, FRAM_ST_BLK_TASK_ID, (ulong) uiTaskID);
-	vL2FRAM_putTSBEntryVal(ucTSBNum, FRAM_ST_BLK_FLAGS, (ulong) uiFlagVal);
-	vL2FRAM_putTSBEntryVal(ucTSBNum, FRAM_ST_BLK_TASK_STATE, (ulong) ucState);
-	vL2FRAM_putTSBEntryVal(ucTSBNum, FRAM_ST_BLK_PARAM1, ulParam1);
-	vL2FRAM_putTSBEntryVal(ucTSBNum, FRAM_ST_BLK_PARAM2, ulParam2);
-	vL2FRAM_putTSBEntryVal(ucTSBNum, FRAM_ST_BLK_PARAM3, ulParam3);
-	vL2FRAM_putTSBEntryVal(ucTSBNum, FRAM_ST_BLK_PARAM4, ulParam4);
+	vL2FRAM_commitTSBJrnl(ucaRec, ucL2FRAM_getTSBTblCount(), 1);
 
 	return;
 
@@ -456,7 +865,7 @@ void vL2FRAM_showTSBTbl(void)
 	vL2FRAM_SetSecurity(TASK_STATE_BLOCKS, FRAM_UNLOCK);
 
 	// Read the number of task state blocks
-	ucFRAM_read_B8(FRAM_ST_BLK_COUNT_ADDR, &ucTSBCount);
+	ucTSBCount = ucL2FRAM_getTSBTblCount();
 
 	/* SHOW THE TABLE HEADER */
 	vSERIAL_sout("\r\n\r\n----  FRAM TSB TBL ----\r\n   (size=", 38);
@@ -544,13 +953,7 @@ uint uiL2FRAM_get_version_num(void)
 /////////////////////////////////////////////////////////////////////////////
 uchar ucL2FRAM_GetStateOnShutdown(void)
 {
-	uchar ucShutdownState;
-
-	vL2FRAM_SetSecurity(SHUTDOWN_STATE, FRAM_UNLOCK);
-	ucFRAM_read_B8(FRAM_STATE_ON_SHUTDOWN_ADDR, &ucShutdownState);
-	vL2FRAM_SetSecurity(0, FRAM_LOCK);
-
-	return ucShutdownState;
+	return ucL2FRAM_CfgGetU8(FRAM_CFG_KEY_SHUTDOWN_STATE);
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -567,9 +970,350 @@ uchar ucL2FRAM_GetStateOnShutdown(void)
 /////////////////////////////////////////////////////////////////////////////
 void vL2FRAM_SetStateOnShutdown(uchar ucState)
 {
-	vL2FRAM_SetSecurity(SHUTDOWN_STATE, FRAM_UNLOCK);
-	ucFRAM_write_B8(FRAM_STATE_ON_SHUTDOWN_ADDR, ucState);
+	vL2FRAM_CfgSetU8(FRAM_CFG_KEY_SHUTDOWN_STATE, ucState);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//! \struct S_CfgKey
+//!
+//! \brief Describes one key of the configuration store
+/////////////////////////////////////////////////////////////////////////////
+typedef struct
+{
+		uchar m_ucLen; //!< Value length in bytes (<= FRAM_CFG_VAL_MAX)
+		uchar m_ucLegacySection; //!< Security section of the old fixed location, 0 if none
+		uint m_uiLegacyAddr; //!< Old fixed location the value is migrated from
+		ulong m_ulDefault; //!< Value used when there is no record (big endian in m_ucLen bytes)
+} S_CfgKey;
+
+//! \var saL2FRAM_CfgKeys
+//! \brief Key table, indexed by the FRAM_CFG_KEY_xxx ids in L2fram.h
+static const S_CfgKey saL2FRAM_CfgKeys[FRAM_CFG_KEY_COUNT] =
+{
+	{ OPTION_BYTE_COUNT + 1, OPTION_BYTES, FRAM_OPTION_BYTE_0_ADDR, 0 },		// FRAM_CFG_KEY_OPTIONS
+	{ 1, SHUTDOWN_STATE, FRAM_STATE_ON_SHUTDOWN_ADDR, 0 },						// FRAM_CFG_KEY_SHUTDOWN_STATE
+	{ 1, REPORTINGPRIORITY, FRAM_RPT_PRTY_ADDR, DEFAULTREPORTINGPRIORITY },		// FRAM_CFG_KEY_RPT_PRTY
+	{ 2, NETWORK_ID, FRAM_USER_ID_ADDR, 0 },									// FRAM_CFG_KEY_SYS_ID
+	{ 2, 0, 0, 0 }																// FRAM_CFG_KEY_SD_VOLUME
+};
+
+//! \var ucaL2FRAM_CfgCache
+//! \brief RAM copy of every value, reads never touch FRAM
+static uchar ucaL2FRAM_CfgCache[FRAM_CFG_KEY_COUNT][FRAM_CFG_VAL_MAX];
+
+//! \var ucaL2FRAM_CfgVer
+//! \brief Version of the newest record of each key
+static uchar ucaL2FRAM_CfgVer[FRAM_CFG_KEY_COUNT];
+
+//! \var ucaL2FRAM_CfgSlot
+//! \brief Which of the two slots holds the newest record, 0xFF if none
+static uchar ucaL2FRAM_CfgSlot[FRAM_CFG_KEY_COUNT];
+
+//! \var ucL2FRAM_CfgLoaded
+//! \brief Set once the cache has been filled from FRAM
+static uchar ucL2FRAM_CfgLoaded = 0;
+
+/////////////////////////////////////////////////////////////////////////////
+//! \fn uiL2FRAM_CfgSlotAddr
+//!
+//! \brief FRAM address of one of the two record slots of a key
+/////////////////////////////////////////////////////////////////////////////
+static uint uiL2FRAM_CfgSlotAddr(uchar ucKey, uchar ucSlot)
+{
+	return (FRAM_CFG_BEG_ADDR + (((uint) ucKey * 2) + ucSlot) * FRAM_CFG_REC_SZ);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//! \fn ucL2FRAM_CfgRecValid
+//!
+//! \brief Checks a record read from a slot belongs to the key and is whole
+//!
+//! \return 1 if valid, 0 otherwise
+/////////////////////////////////////////////////////////////////////////////
+static uchar ucL2FRAM_CfgRecValid(const uchar *ucpRec, uchar ucKey)
+{
+	if (ucpRec[FRAM_CFG_IDX_KEY] != ucKey || ucpRec[FRAM_CFG_IDX_LEN] != saL2FRAM_CfgKeys[ucKey].m_ucLen)
+		return 0;
+
+	if (uiCRC16_ComputeBlockCRC((uchar *) ucpRec, FRAM_CFG_IDX_CRC)
+			!= uiMISC_buildUintFromBytes((uchar *) &ucpRec[FRAM_CFG_IDX_CRC], NO_NOINT))
+		return 0;
+
+	return 1;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//! \fn vL2FRAM_CfgWriteRec
+//!
+//! \brief Writes a new version of a value into the older of the key's two
+//! slots and updates the cache.  A torn write leaves the previous record.
+/////////////////////////////////////////////////////////////////////////////
+static void vL2FRAM_CfgWriteRec(uchar ucKey, const uchar *ucpVal)
+{
+	uchar ucaRec[FRAM_CFG_REC_SZ];
+	uchar ucLen;
+	uchar ucSlot;
+	uchar ucii;
+
+	ucLen = saL2FRAM_CfgKeys[ucKey].m_ucLen;
+	ucSlot = (ucaL2FRAM_CfgSlot[ucKey] == 0) ? 1 : 0;
+
+	for (ucii = 0; ucii < FRAM_CFG_VAL_MAX; ucii++)
+		ucaRec[FRAM_CFG_IDX_VAL + ucii] = (ucii < ucLen) ? ucpVal[ucii] : 0;
+
+	ucaRec[FRAM_CFG_IDX_KEY] = ucKey;
+	ucaRec[FRAM_CFG_IDX_LEN] = ucLen;
+	ucaRec[FRAM_CFG_IDX_VER] = ucaL2FRAM_CfgVer[ucKey] + 1;
+	vMISC_copyUintIntoBytes(uiCRC16_ComputeBlockCRC(ucaRec, FRAM_CFG_IDX_CRC), &ucaRec[FRAM_CFG_IDX_CRC], NO_NOINT);
+
+	vL2FRAM_SetSecurity(CFG_STORE, FRAM_UNLOCK);
+	ucFRAM_write_block(uiL2FRAM_CfgSlotAddr(ucKey, ucSlot), ucaRec, FRAM_CFG_REC_SZ);
 	vL2FRAM_SetSecurity(0, FRAM_LOCK);
+
+	for (ucii = 0; ucii < ucLen; ucii++)
+		ucaL2FRAM_CfgCache[ucKey][ucii] = ucpVal[ucii];
+	ucaL2FRAM_CfgVer[ucKey] = ucaRec[FRAM_CFG_IDX_VER];
+	ucaL2FRAM_CfgSlot[ucKey] = ucSlot;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//! \fn vL2FRAM_CfgSetDefault
+//!
+//! \brief Loads the default value of a key into the cache
+/////////////////////////////////////////////////////////////////////////////
+static void vL2FRAM_CfgSetDefault(uchar ucKey)
+{
+	uchar ucii;
+	uchar ucLen;
+	ulong ulVal;
+
+	ucLen = saL2FRAM_CfgKeys[ucKey].m_ucLen;
+	ulVal = saL2FRAM_CfgKeys[ucKey].m_ulDefault;
+
+	for (ucii = 0; ucii < FRAM_CFG_VAL_MAX; ucii++)
+		ucaL2FRAM_CfgCache[ucKey][ucii] = 0;
+
+	// Right align the default in the value bytes
+	for (ucii = ucLen; ucii > 0 && (ucLen - ucii) < 4; ucii--)
+	{
+		ucaL2FRAM_CfgCache[ucKey][ucii - 1] = (uchar) ulVal;
+		ulVal >>= 8;
+	}
+
+	ucaL2FRAM_CfgVer[ucKey] = 0;
+	ucaL2FRAM_CfgSlot[ucKey] = 0xFF;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//! \fn vL2FRAM_CfgLoad
+//!
+//! \brief Fills the configuration cache from FRAM
+//!
+//! For each key the newer of the two valid records wins.  A key with no
+//! record is migrated from its old fixed location if it had one, so parts
+//! formatted by older code keep their settings without a reformat.  Keys
+//! added later simply start at their default.
+/////////////////////////////////////////////////////////////////////////////
+void vL2FRAM_CfgLoad(void)
+{
+	uchar ucKey;
+	uchar ucaRecs[2 * FRAM_CFG_REC_SZ];
+	uchar ucaVal[FRAM_CFG_VAL_MAX];
+	uchar ucValidA, ucValidB;
+	uchar ucSlot;
+	uchar ucii;
+	const uchar *ucpRec;
+
+	for (ucKey = 0; ucKey < FRAM_CFG_KEY_COUNT; ucKey++)
+	{
+		vL2FRAM_CfgSetDefault(ucKey);
+
+		// Both slots of a key come out in one read
+		vL2FRAM_SetSecurity(CFG_STORE, FRAM_UNLOCK);
+		ucFRAM_read_block(uiL2FRAM_CfgSlotAddr(ucKey, 0), ucaRecs, 2 * FRAM_CFG_REC_SZ);
+		vL2FRAM_SetSecurity(0, FRAM_LOCK);
+
+		ucValidA = ucL2FRAM_CfgRecValid(&ucaRecs[0], ucKey);
+		ucValidB = ucL2FRAM_CfgRecValid(&ucaRecs[FRAM_CFG_REC_SZ], ucKey);
+
+		if (ucValidA || ucValidB)
+		{
+			// Versions wrap so newer means less than half way round ahead
+			if (ucValidA && ucValidB)
+				ucSlot = ((uchar) (ucaRecs[FRAM_CFG_REC_SZ + FRAM_CFG_IDX_VER] - ucaRecs[FRAM_CFG_IDX_VER]) < 0x80) ? 1 : 0;
+			else
+				ucSlot = ucValidB ? 1 : 0;
+
+			ucpRec = &ucaRecs[(uint) ucSlot * FRAM_CFG_REC_SZ];
+			for (ucii = 0; ucii < saL2FRAM_CfgKeys[ucKey].m_ucLen; ucii++)
+				ucaL2FRAM_CfgCache[ucKey][ucii] = ucpRec[FRAM_CFG_IDX_VAL + ucii];
+			ucaL2FRAM_CfgVer[ucKey] = ucpRec[FRAM_CFG_IDX_VER];
+			ucaL2FRAM_CfgSlot[ucKey] = ucSlot;
+		}
+		else if (saL2FRAM_CfgKeys[ucKey].m_ucLegacySection != 0)
+		{
+			// Migrate the value from the old layout
+			vL2FRAM_SetSecurity(saL2FRAM_CfgKeys[ucKey].m_ucLegacySection, FRAM_UNLOCK);
+			ucFRAM_read_block(saL2FRAM_CfgKeys[ucKey].m_uiLegacyAddr, ucaVal, saL2FRAM_CfgKeys[ucKey].m_ucLen);
+			vL2FRAM_SetSecurity(0, FRAM_LOCK);
+
+			vL2FRAM_CfgWriteRec(ucKey, ucaVal);
+
+#if 0
+			vSERIAL_sout("Cfg key migrated ", 17);
+			vSERIAL_UIV8out(ucKey);
+			vSERIAL_crlf();
+#endif
+		}
+	}
+
+	ucL2FRAM_CfgLoaded = 1;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//! \fn vL2FRAM_CfgReset
+//!
+//! \brief Erases the configuration store and sets every key to its default
+//!
+//! Used when formatting a part that was never formatted, so there is
+//! nothing to migrate from the old layout.
+/////////////////////////////////////////////////////////////////////////////
+void vL2FRAM_CfgReset(void)
+{
+	uchar ucKey;
+
+	vFRAM_fillFramBlk(FRAM_CFG_BEG_ADDR, FRAM_CFG_SIZE, 0);
+
+	for (ucKey = 0; ucKey < FRAM_CFG_KEY_COUNT; ucKey++)
+		vL2FRAM_CfgSetDefault(ucKey);
+
+	ucL2FRAM_CfgLoaded = 1;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//! \fn ucL2FRAM_CfgIsStored
+//!
+//! \brief Tells whether a key has a record in FRAM or is still at its default
+//!
+//! \param ucKey, FRAM_CFG_KEY_xxx
+//! \return 1 if the key has a record
+/////////////////////////////////////////////////////////////////////////////
+uchar ucL2FRAM_CfgIsStored(uchar ucKey)
+{
+	if (ucKey >= FRAM_CFG_KEY_COUNT)
+		return 0;
+
+	if (!ucL2FRAM_CfgLoaded)
+		vL2FRAM_CfgLoad();
+
+	return (ucaL2FRAM_CfgSlot[ucKey] != 0xFF);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//! \fn ucL2FRAM_CfgGet
+//!
+//! \brief Copies a configuration value out of the RAM cache
+//!
+//! \param ucKey, FRAM_CFG_KEY_xxx
+//! \param ucpVal, receives the value (length from the key table)
+//! \return Value length, 0 if the key is unknown
+/////////////////////////////////////////////////////////////////////////////
+uchar ucL2FRAM_CfgGet(uchar ucKey, uchar *ucpVal)
+{
+	uchar ucii;
+
+	if (ucKey >= FRAM_CFG_KEY_COUNT)
+		return 0;
+
+	if (!ucL2FRAM_CfgLoaded)
+		vL2FRAM_CfgLoad();
+
+	for (ucii = 0; ucii < saL2FRAM_CfgKeys[ucKey].m_ucLen; ucii++)
+		ucpVal[ucii] = ucaL2FRAM_CfgCache[ucKey][ucii];
+
+	return saL2FRAM_CfgKeys[ucKey].m_ucLen;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//! \fn vL2FRAM_CfgSet
+//!
+//! \brief Writes a configuration value through the cache to FRAM
+//!
+//! Nothing is written if the value did not change.
+//!
+//! \param ucKey, FRAM_CFG_KEY_xxx
+//! \param ucpVal, value (length from the key table)
+/////////////////////////////////////////////////////////////////////////////
+void vL2FRAM_CfgSet(uchar ucKey, const uchar *ucpVal)
+{
+	uchar ucii;
+
+	if (ucKey >= FRAM_CFG_KEY_COUNT)
+		return;
+
+	if (!ucL2FRAM_CfgLoaded)
+		vL2FRAM_CfgLoad();
+
+	// Skip the write if the record already holds this value
+	if (ucaL2FRAM_CfgSlot[ucKey] != 0xFF)
+	{
+		for (ucii = 0; ucii < saL2FRAM_CfgKeys[ucKey].m_ucLen; ucii++)
+			if (ucaL2FRAM_CfgCache[ucKey][ucii] != ucpVal[ucii])
+				break;
+		if (ucii == saL2FRAM_CfgKeys[ucKey].m_ucLen)
+			return;
+	}
+
+	vL2FRAM_CfgWriteRec(ucKey, ucpVal);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//! \fn ucL2FRAM_CfgGetU8
+//! \brief Reads a one byte configuration value
+/////////////////////////////////////////////////////////////////////////////
+uchar ucL2FRAM_CfgGetU8(uchar ucKey)
+{
+	uchar ucaVal[FRAM_CFG_VAL_MAX];
+
+	if (ucL2FRAM_CfgGet(ucKey, ucaVal) == 0)
+		return 0;
+
+	return ucaVal[0];
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//! \fn uiL2FRAM_CfgGetU16
+//! \brief Reads a two byte configuration value
+/////////////////////////////////////////////////////////////////////////////
+uint uiL2FRAM_CfgGetU16(uchar ucKey)
+{
+	uchar ucaVal[FRAM_CFG_VAL_MAX];
+
+	if (ucL2FRAM_CfgGet(ucKey, ucaVal) < 2)
+		return 0;
+
+	return uiMISC_buildUintFromBytes(ucaVal, NO_NOINT);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//! \fn vL2FRAM_CfgSetU8
+//! \brief Writes a one byte configuration value
+/////////////////////////////////////////////////////////////////////////////
+void vL2FRAM_CfgSetU8(uchar ucKey, uchar ucVal)
+{
+	vL2FRAM_CfgSet(ucKey, &ucVal);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//! \fn vL2FRAM_CfgSetU16
+//! \brief Writes a two byte configuration value
+/////////////////////////////////////////////////////////////////////////////
+void vL2FRAM_CfgSetU16(uchar ucKey, uint uiVal)
+{
+	uchar ucaVal[2];
+
+	vMISC_copyUintIntoBytes(uiVal, ucaVal, NO_NOINT);
+	vL2FRAM_CfgSet(ucKey, ucaVal);
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -623,40 +1367,119 @@ void vL2FRAM_IncrementSDCardBlockNum(void)
 	// Get the current address
 	ulAddress = ulL2FRAM_GetSDCardBlockNum();
 
-	//Increment the block address
-	ulAddress += 1;
+	//Increment the block address
+	ulAddress += 1;
+
+	// The capacity is a block count, the last block is one below it
+	if(ulAddress >= ulSD_GetCapacity())
+		ulAddress = SD_CARD_START_BLOCK;
+
+	// Store the new address
+	vL2FRAM_SetSDCardBlockNum(ulAddress);
+
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//!
+//! \brief Returns the previous SD card address
+//!
+//!
+//! \param none
+//! \return ulAddress
+//////////////////////////////////////////////////////////////////////////////
+ulong ulL2FRAM_GetLastSDCardBlockNum(void)
+{
+	ulong ulAddress;
+
+	// Get the current address
+	ulAddress = ulL2FRAM_GetSDCardBlockNum();
+
+	// If we have used the entire SD card and are starting again from the beginning then the previous block is the last block
+	if(ulAddress == SD_CARD_START_BLOCK)
+		ulAddress = ulSD_GetCapacity() - 1;
+	else
+		ulAddress -= 1; // Otherwise decrement by one
+
+	return(ulAddress);
+
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//!
+//! \brief Returns the FRAM address of a page in the SD card buffer
+//!
+//! \param ucPage, page index
+//! \return Address of the first byte (the block header) of the page
+//////////////////////////////////////////////////////////////////////////////
+static uint uiL2FRAM_SDCardPageAddr(uchar ucPage)
+{
+	return (FRAM_SD_CARD_BUFF_BEG_ADDR + ((uint) ucPage * FRAM_SD_CARD_PAGE_SIZE));
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//!
+//! \brief Returns the index of the page holding an SD card buffer address
+//!
+//! \param uiAddress
+//! \return Page index
+//////////////////////////////////////////////////////////////////////////////
+static uchar ucL2FRAM_SDCardPageOf(uint uiAddress)
+{
+	return ((uchar) ((uiAddress - FRAM_SD_CARD_BUFF_BEG_ADDR) / FRAM_SD_CARD_PAGE_SIZE));
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//!
+//! \brief Writes a fresh SD log block header at the start of a page
+//!
+//! The magic, volume and CRC are left zero, they are added when the page
+//! is flushed.  Must be called with the SD card buffer unlocked.
+//!
+//! \param ucPage, page index
+//! \param ulSeq, sequence number of the page
+//! \param ucCarry, bytes that finish a message from the previous page
+//! \return none
+//////////////////////////////////////////////////////////////////////////////
+static void vL2FRAM_OpenSDCardPage(uchar ucPage, ulong ulSeq, uchar ucCarry)
+{
+	uchar ucaHdr[FRAM_SD_CARD_PAGE_HDR_SZ];
+	ulong ulTime;
+	uchar ucii;
+
+	for (ucii = 0; ucii < FRAM_SD_CARD_PAGE_HDR_SZ; ucii++)
+		ucaHdr[ucii] = 0;
 
-	if(ulAddress > ulSD_GetCapacity())
-		ulAddress = SD_CARD_START_BLOCK;
+	ulTime = (ulong) lTIME_getSysTimeAsLong();
 
-	// Store the new address
-	vL2FRAM_SetSDCardBlockNum(ulAddress);
+	ucaHdr[SD_BLK_IDX_CARRY] = ucCarry;
+	vMISC_copyUlongIntoBytes(ulSeq, &ucaHdr[SD_BLK_IDX_SEQ], NO_NOINT);
+	vMISC_copyUlongIntoBytes(ulTime, &ucaHdr[SD_BLK_IDX_FIRST_TIME], NO_NOINT);
+	vMISC_copyUlongIntoBytes(ulTime, &ucaHdr[SD_BLK_IDX_LAST_TIME], NO_NOINT);
+	vMISC_copyUintIntoBytes(FRAM_SD_CARD_PAGE_HDR_SZ, &ucaHdr[SD_BLK_IDX_END], NO_NOINT);
 
+	ucFRAM_write_block(uiL2FRAM_SDCardPageAddr(ucPage), ucaHdr, FRAM_SD_CARD_PAGE_HDR_SZ);
 }
 
 //////////////////////////////////////////////////////////////////////////////
 //!
-//! \brief Returns the previous SD card address
+//! \brief Stamps the current time as the last time of a page and moves its
+//! end offset
 //!
+//! The last time and end fields sit next to each other in the header so
+//! both go out in one burst.  Must be called with the SD card buffer unlocked.
 //!
-//! \param none
-//! \return ulAddress
+//! \param ucPage, page index
+//! \param uiEnd, offset one past the last byte written to the page
+//! \return none
 //////////////////////////////////////////////////////////////////////////////
-ulong ulL2FRAM_GetLastSDCardBlockNum(void)
+static void vL2FRAM_MarkSDCardPage(uchar ucPage, uint uiEnd)
 {
-	ulong ulAddress;
-
-	// Get the current address
-	ulAddress = ulL2FRAM_GetSDCardBlockNum();
-
-	// If we have used the entire SD card and are starting again from the beginning then the previous block is the last block
-	if(ulAddress == SD_CARD_START_BLOCK)
-		ulAddress = ulSD_GetCapacity();
-	else
-		ulAddress -= 1; // Otherwise decrement by one
+	uchar ucaMark[6];
 
-	return(ulAddress);
+	vMISC_copyUlongIntoBytes((ulong) lTIME_getSysTimeAsLong(), &ucaMark[0], NO_NOINT);
+	vMISC_copyUintIntoBytes(uiEnd, &ucaMark[SD_BLK_IDX_END - SD_BLK_IDX_LAST_TIME], NO_NOINT);
 
+	ucFRAM_write_block(uiL2FRAM_SDCardPageAddr(ucPage) + SD_BLK_IDX_LAST_TIME, ucaMark, sizeof(ucaMark));
 }
 
 //////////////////////////////////////////////////////////////////////////////
@@ -675,9 +1498,10 @@ uint uiL2FRAM_ReadNFL_SDCardBuff(void)
 	ucFRAM_read_B16(FRAM_SDCARD_BUFF_END_PTR_ADDR, &uiNFL);
 	vL2FRAM_SetSecurity(0, FRAM_LOCK);
 
-// If the NFL is out of range then set to the start address
-	if(uiNFL > FRAM_SD_CARD_OVRFLO_END_ADDR || uiNFL < FRAM_SD_CARD_BUFF_BEG_ADDR){
-		uiNFL = FRAM_SD_CARD_BUFF_BEG_ADDR;
+// If the NFL is out of range or on a page header then set to the start address
+	if(uiNFL >= FRAM_SD_CARD_BUFF_END_ADDR || uiNFL < FRAM_SD_CARD_BUFF_BEG_ADDR ||
+		((uiNFL - FRAM_SD_CARD_BUFF_BEG_ADDR) % FRAM_SD_CARD_PAGE_SIZE) < FRAM_SD_CARD_PAGE_HDR_SZ){
+		uiNFL = FRAM_SD_CARD_BUFF_BEG_ADDR + FRAM_SD_CARD_PAGE_HDR_SZ;
 		vSERIAL_sout("SD buff NFL out of range\r\n", 26);
 	}
 
@@ -694,7 +1518,7 @@ uint uiL2FRAM_ReadNFL_SDCardBuff(void)
 //! \brief Writes the next free location (NFL) of the SD card buffer stored in
 //! FRAM.
 //!
-//! \param none
+//! \param uiAddress
 //! \return none
 //////////////////////////////////////////////////////////////////////////////
 void vL2FRAM_WriteNFL_SDCardBuff(uint uiAddress)
@@ -702,19 +1526,12 @@ void vL2FRAM_WriteNFL_SDCardBuff(uint uiAddress)
 
 	vL2FRAM_SetSecurity(SD_CARD_PTRS, FRAM_UNLOCK);
 
-	if(uiAddress > FRAM_SD_CARD_OVRFLO_END_ADDR || uiAddress < FRAM_SD_CARD_BUFF_BEG_ADDR){
-		uiAddress = FRAM_SD_CARD_BUFF_BEG_ADDR;
+	if(uiAddress >= FRAM_SD_CARD_BUFF_END_ADDR || uiAddress < FRAM_SD_CARD_BUFF_BEG_ADDR){
+		uiAddress = FRAM_SD_CARD_BUFF_BEG_ADDR + FRAM_SD_CARD_PAGE_HDR_SZ;
 		vSERIAL_sout("SD buff NFL out of range\r\n", 26);
 	}
 
-	// If there is not enough room in the overflow buffer for the next message
-	// then start overwriting the buffer.  This could happen if the SD card is dead.
-	if (uiAddress >= (FRAM_SD_CARD_OVRFLO_END_ADDR - MAX_MSG_SIZE)) {
-		ucFRAM_write_B16(FRAM_SDCARD_BUFF_END_PTR_ADDR, FRAM_SD_CARD_BUFF_BEG_ADDR);
-	}
-	else {
-		ucFRAM_write_B16(FRAM_SDCARD_BUFF_END_PTR_ADDR, uiAddress);
-	}
+	ucFRAM_write_B16(FRAM_SDCARD_BUFF_END_PTR_ADDR, uiAddress);
 
 	vL2FRAM_SetSecurity(0, FRAM_LOCK);
 
@@ -725,6 +1542,62 @@ void vL2FRAM_WriteNFL_SDCardBuff(uint uiAddress)
 #endif
 }
 
+//////////////////////////////////////////////////////////////////////////////
+//!
+//! \brief Get the index of the oldest page in the SD card buffer that has
+//! not been written to the SD card.
+//!
+//! \param none
+//! \return Page index
+//////////////////////////////////////////////////////////////////////////////
+static uchar ucL2FRAM_ReadFlushPage_SDCardBuff(void)
+{
+	uint uiPage;
+
+	vL2FRAM_SetSecurity(SD_CARD_PTRS, FRAM_UNLOCK);
+	ucFRAM_read_B16(FRAM_SDCARD_FLUSH_PAGE_ADDR, &uiPage);
+	vL2FRAM_SetSecurity(0, FRAM_LOCK);
+
+	if(uiPage >= FRAM_SD_CARD_PAGE_COUNT){
+		uiPage = 0;
+		vSERIAL_sout("SD buff page out of range\r\n", 27);
+	}
+
+	return ((uchar) uiPage);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//!
+//! \brief Writes the index of the oldest unflushed page in the SD card buffer
+//!
+//! \param ucPage
+//! \return none
+//////////////////////////////////////////////////////////////////////////////
+static void vL2FRAM_WriteFlushPage_SDCardBuff(uchar ucPage)
+{
+	vL2FRAM_SetSecurity(SD_CARD_PTRS, FRAM_UNLOCK);
+	ucFRAM_write_B16(FRAM_SDCARD_FLUSH_PAGE_ADDR, (uint) ucPage);
+	vL2FRAM_SetSecurity(0, FRAM_LOCK);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//!
+//! \brief Returns the number of full pages waiting to go to the SD card
+//!
+//! \param none
+//! \return Page count
+//////////////////////////////////////////////////////////////////////////////
+uchar ucL2FRAM_GetSDCardPagesReady(void)
+{
+	uchar ucFlushPage;
+	uchar ucFillPage;
+
+	ucFlushPage = ucL2FRAM_ReadFlushPage_SDCardBuff();
+	ucFillPage = ucL2FRAM_SDCardPageOf(uiL2FRAM_ReadNFL_SDCardBuff());
+
+	return ((uchar) ((ucFillPage + FRAM_SD_CARD_PAGE_COUNT - ucFlushPage) % FRAM_SD_CARD_PAGE_COUNT));
+}
+
 ////////////////////////////////////////////////////////////////////////////
 //!
 //! \brief Initializes the pointers used to manage the SD Card
@@ -744,12 +1617,11 @@ void vL2FRAM_Init_SDCardPtrs(void)
 
 	// Start the SD Card block count at two to leave room for metadata
 	ucFRAM_write_B32(FRAM_SDCARD_BLOCK_NUM_ADDR, SD_CARD_START_BLOCK);
-
-	// Set the SD Card message buffer addresses to the start of the buffer
-	ucFRAM_write_B16(FRAM_SDCARD_BUFF_START_PTR_ADDR, FRAM_SD_CARD_BUFF_BEG_ADDR);
 	vL2FRAM_SetSecurity(0, FRAM_LOCK);
 
-	vL2FRAM_WriteNFL_SDCardBuff(FRAM_SD_CARD_BUFF_BEG_ADDR);
+	// Start filling and flushing at the first page
+	vL2FRAM_WriteFlushPage_SDCardBuff(0);
+	vL2FRAM_WriteNFL_SDCardBuff(FRAM_SD_CARD_BUFF_BEG_ADDR + FRAM_SD_CARD_PAGE_HDR_SZ);
 
 }/* END: vL2FRAM_initFramSDCardPtrs() */
 
@@ -757,18 +1629,17 @@ void vL2FRAM_Init_SDCardPtrs(void)
 //!
 //! \brief Zeros the SD card buffer in FRAM
 //!
-//!
+//! Only needed at format time, pages are always completely rewritten
+//! before they are flushed again.
 //!
 ///////////////////////////////////////////////////////////////////////////////
 void vL2FRAM_CleanSDCardBuff(void)
 {
-	uint uiIndex;
-
 	vL2FRAM_SetSecurity(SD_CARD_BUFFER, FRAM_UNLOCK);
+	ucFRAM_fill_block(FRAM_SD_CARD_BUFF_BEG_ADDR, 0, FRAM_SD_CARD_BUFF_SIZE);
 
-	for(uiIndex = FRAM_SD_CARD_BUFF_BEG_ADDR; uiIndex < FRAM_SD_CARD_BUFF_END_ADDR; uiIndex++)
-		ucFRAM_write_B8(uiIndex, 0);
-
+	// The log starts over at sequence number 1
+	vL2FRAM_OpenSDCardPage(0, 1, 0);
 	vL2FRAM_SetSecurity(0, FRAM_LOCK);
 
 }
@@ -782,23 +1653,32 @@ void vL2FRAM_CleanSDCardBuff(void)
 //! to in blocks.  So instead of reading a block from the SD card, adding the
 //! new message to the block, and then writing the entire block back to the
 //! SD card, we create a block here in FRAM and then write it to the SD card
-//! once it is larger than the block size.
+//! once it is full.
+//!
+//! A message that does not fit in the current page is split and the rest is
+//! written after the header of the next page.  If every page is full (the SD
+//! card is dead or missing) the oldest page is dropped and overwritten.
 //!
 //! \param p_ucReport, ucLength
-//! \return ucRetVal
+//! \return ucRetVal, 1 if a page was filled and is ready for the SD card
 ////////////////////////////////////////////////////////////////////////////////
 uchar ucL2FRAM_WriteReportToSDCardBuff(volatile uchar * p_ucReport, uchar ucLength)
 {
 
 	uint uiSDCardBuffNFL; // next free location in the SD card buffer
+	uint uiPageEnd;
+	uint uiChunk;
+	uchar ucPage;
+	uchar ucFlushPage;
 	uchar ucRetVal;
-	uchar ucIndex;
+	ulong ulSeq;
 
-	// Assume that there is enough room in the buffer for two or more messages
+	// Assume that the current page does not fill up
 	ucRetVal = 0;
 
 	// Get the next free location in the SD card buffer
 	uiSDCardBuffNFL = uiL2FRAM_ReadNFL_SDCardBuff();
+	ucPage = ucL2FRAM_SDCardPageOf(uiSDCardBuffNFL);
 
 #if 0
 	vSERIAL_sout("SD card buffer address = ", 25);
@@ -806,25 +1686,58 @@ uchar ucL2FRAM_WriteReportToSDCardBuff(volatile uchar * p_ucReport, uchar ucLeng
 	vSERIAL_crlf();
 #endif
 
-	vL2FRAM_SetSecurity(SD_CARD_BUFFER, FRAM_UNLOCK);
+	// Hold the buffer open for the whole report, pointer updates nest inside
+	vL2FRAM_BeginWrite(SD_CARD_BUFFER);
 
-	// Write the report to FRAM
-	for (ucIndex = 0; ucIndex < ucLength; ucIndex++)
-		ucFRAM_write_B8(uiSDCardBuffNFL++, *p_ucReport++);
+	while (ucLength > 0)
+	{
+		// Write as much of the report as fits in this page in one burst
+		uiPageEnd = uiL2FRAM_SDCardPageAddr(ucPage) + FRAM_SD_CARD_PAGE_SIZE;
+		uiChunk = uiPageEnd - uiSDCardBuffNFL;
+		if (uiChunk > ucLength)
+			uiChunk = ucLength;
 
-	vL2FRAM_SetSecurity(0, FRAM_LOCK);
+		ucFRAM_write_block(uiSDCardBuffNFL, (const uchar *) p_ucReport, uiChunk);
 
-	// Check the pointer and see if the next report can exceed the SD card block size
-	if ((uiSDCardBuffNFL < FRAM_SD_CARD_BUFF_END_ADDR) && ((FRAM_SD_CARD_BUFF_END_ADDR - uiSDCardBuffNFL) < MAX_MSG_SIZE))
-	{
-		// Set the return value to indicate the buffer is full
-		ucRetVal = 1;
+		p_ucReport += uiChunk;
+		ucLength -= (uchar) uiChunk;
+		uiSDCardBuffNFL += uiChunk;
 
-		// set the pointer at the overflow so all messages get written there until the block is moved to the SD card
-		vL2FRAM_WriteNFL_SDCardBuff(FRAM_SD_CARD_OVRFLO_BEG_ADDR);
+		// Page is full, move on to the next one in the ring
+		if (uiSDCardBuffNFL == uiPageEnd)
+		{
+			ucRetVal = 1;
+
+			// Close the full page and carry its sequence on to the next one
+			vL2FRAM_MarkSDCardPage(ucPage, FRAM_SD_CARD_PAGE_SIZE);
+			ucFRAM_read_B32(uiL2FRAM_SDCardPageAddr(ucPage) + SD_BLK_IDX_SEQ, &ulSeq);
+
+			if (++ucPage >= FRAM_SD_CARD_PAGE_COUNT)
+				ucPage = 0;
+
+			// If the ring has come around to the unflushed pages drop the oldest
+			ucFlushPage = ucL2FRAM_ReadFlushPage_SDCardBuff();
+			if (ucPage == ucFlushPage)
+			{
+				if (++ucFlushPage >= FRAM_SD_CARD_PAGE_COUNT)
+					ucFlushPage = 0;
+				vL2FRAM_WriteFlushPage_SDCardBuff(ucFlushPage);
+				vSERIAL_sout("SD buff full, page dropped\r\n", 28);
+			}
+
+			// The page header records how much of the report carries over
+			vL2FRAM_OpenSDCardPage(ucPage, ulSeq + 1, ucLength);
+			uiSDCardBuffNFL = uiL2FRAM_SDCardPageAddr(ucPage) + FRAM_SD_CARD_PAGE_HDR_SZ;
+		}
 	}
-	else
-		vL2FRAM_WriteNFL_SDCardBuff(uiSDCardBuffNFL); // Set the pointer at the next free location in the buffer
+
+	// Bring the time range and end of the page being filled up to date
+	vL2FRAM_MarkSDCardPage(ucPage, uiSDCardBuffNFL - uiL2FRAM_SDCardPageAddr(ucPage));
+
+	// Set the pointer at the next free location in the buffer
+	vL2FRAM_WriteNFL_SDCardBuff(uiSDCardBuffNFL);
+
+	vL2FRAM_CommitWrite();
 
 	return ucRetVal;
 }
@@ -832,68 +1745,166 @@ uchar ucL2FRAM_WriteReportToSDCardBuff(volatile uchar * p_ucReport, uchar ucLeng
 
 ////////////////////////////////////////////////////////////////////////////////
 //!
-//! \brief Writes the contents in the overflow area to the SD card buffer
+//! \brief Releases the oldest full page after it was written to the SD card
+//!
+//! The page is simply handed back to the writer by advancing the flush page
+//! index, nothing in the buffer is moved or cleared.
 //!
 //! \param none
 //! \return none
 ////////////////////////////////////////////////////////////////////////////////
-void vL2FRAM_SDCardOvrflowToBuff(void)
+void vL2FRAM_ReleaseSDCardPage(void)
 {
-	uint uiSDCardBuffNFL; // next free location in the SD card buffer
-	uint uiSrcAddress;
-	uint uiDestAddress;
-	uchar ucData;
+	uchar ucFlushPage;
 
-	// Get the next free location in the SD card buffer
-	uiSDCardBuffNFL = uiL2FRAM_ReadNFL_SDCardBuff();
+	// Never release the page that is still being filled
+	if (ucL2FRAM_GetSDCardPagesReady() == 0)
+		return;
 
-	// If the next free location is in the overflow area then rewrite the contents to the buffer
-	if(uiSDCardBuffNFL >= FRAM_SD_CARD_BUFF_END_ADDR)
-	{
+	ucFlushPage = ucL2FRAM_ReadFlushPage_SDCardBuff();
+	if (++ucFlushPage >= FRAM_SD_CARD_PAGE_COUNT)
+		ucFlushPage = 0;
+	vL2FRAM_WriteFlushPage_SDCardBuff(ucFlushPage);
+}
 
-		// Zero all entries in the buffer
-		vL2FRAM_CleanSDCardBuff();
+////////////////////////////////////////////////////////////////////////////////
+//!
+//! \brief Reads one of the unflushed pages of the SD card buffer into
+//! addresses given by the pointer
+//!
+//! Pages are counted from the oldest, so a batch of ready pages is read with
+//! offsets 0 to ucL2FRAM_GetSDCardPagesReady() - 1.
+//!
+//! \param ucPageOffset, pages past the oldest unflushed page
+//! \param p_ucBlock, SD_CARD_BLOCKLEN bytes
+//! \return none
+////////////////////////////////////////////////////////////////////////////////
+void vL2FRAM_ReadSDCardBuffer(uchar ucPageOffset, uchar * p_ucBlock)
+{
+	uint uiPageAddr;
+	uchar ucPage;
 
-		// Start the destination at the beginning of the buffer
-		uiDestAddress = FRAM_SD_CARD_BUFF_BEG_ADDR;
+	ucPage = (uchar) ((ucL2FRAM_ReadFlushPage_SDCardBuff() + ucPageOffset) % FRAM_SD_CARD_PAGE_COUNT);
+	uiPageAddr = uiL2FRAM_SDCardPageAddr(ucPage);
 
-		vL2FRAM_SetSecurity(SD_CARD_BUFFER, FRAM_UNLOCK);
+	// The whole page comes out under a single SPI cmd header
+	vL2FRAM_SetSecurity(SD_CARD_BUFFER, FRAM_UNLOCK);
+	ucFRAM_read_block(uiPageAddr, p_ucBlock, FRAM_SD_CARD_PAGE_SIZE);
+	vL2FRAM_SetSecurity(0, FRAM_LOCK);
+}
 
-		// Starting at the overflow area, read out each byte and write it to the start of the buffer
-		for (uiSrcAddress = FRAM_SD_CARD_OVRFLO_BEG_ADDR; uiSrcAddress < uiSDCardBuffNFL; uiSrcAddress++){
-			ucFRAM_read_B8(uiSrcAddress, &ucData);
-			ucFRAM_write_B8(uiDestAddress++, ucData);
-		}
+////////////////////////////////////////////////////////////////////////////////
+//!
+//! \brief Returns the volume id of the SD card log
+//!
+//! \param none
+//! \return uiVolume, 0 if the card was never formatted with a volume
+////////////////////////////////////////////////////////////////////////////////
+uint uiL2FRAM_GetSDVolume(void)
+{
+	return uiL2FRAM_CfgGetU16(FRAM_CFG_KEY_SD_VOLUME);
+}
 
-		vL2FRAM_SetSecurity(0, FRAM_LOCK);
+////////////////////////////////////////////////////////////////////////////////
+//!
+//! \brief Picks and stores a new volume id for an SD card about to be formatted
+//!
+//! The random seed is mixed in so a card formatted again after the FRAM was
+//! wiped still gets an id that differs from the one on the card.
+//!
+//! \param none
+//! \return uiVolume, never 0
+////////////////////////////////////////////////////////////////////////////////
+uint uiL2FRAM_NewSDVolume(void)
+{
+	uint uiVolume;
 
-		// Set the next free location
-		vL2FRAM_WriteNFL_SDCardBuff(uiDestAddress);
-	}
+	uiVolume = uiL2FRAM_GetSDVolume() + 1 + (uint) uslRAND_getRolledFullSysSeed();
+	if (uiVolume == 0)
+		uiVolume = 1;
+
+	vL2FRAM_CfgSetU16(FRAM_CFG_KEY_SD_VOLUME, uiVolume);
+
+	return uiVolume;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 //!
-//! \brief Reads the SD card buffer into addresses given by the pointer
+//! \brief Stores the index entry of a data block that is going to the SD card
 //!
+//! The sequence number and time range are copied straight out of the block
+//! header, they are laid out the same way as an index entry.
 //!
-//! \param p_ucBlock
+//! \param ucSlot, position of the block in its index group
+//! \param p_ucHdr, block header
 //! \return none
 ////////////////////////////////////////////////////////////////////////////////
-void vL2FRAM_ReadSDCardBuffer(uchar * p_ucBlock)
+void vL2FRAM_PutSDIndexEntry(uchar ucSlot, const uchar * p_ucHdr)
 {
-	uint uiIndex;
-	uint uiSrcAddr;
-
-	vL2FRAM_SetSecurity(SD_CARD_BUFFER, FRAM_UNLOCK);
+	if (ucSlot >= SD_LOG_INDEX_ENTRIES)
+		return;
 
-	uiSrcAddr = FRAM_SD_CARD_BUFF_BEG_ADDR;
-	for (uiIndex = 0; uiIndex < FRAM_SD_CARD_BUFF_SIZE; uiIndex++)
-		ucFRAM_read_B8(uiSrcAddr++, p_ucBlock++);
+	vL2FRAM_SetSecurity(SD_INDEX, FRAM_UNLOCK);
+	ucFRAM_write_block(FRAM_SD_INDEX_BEG_ADDR + ((uint) ucSlot * SD_IDX_ENT_SZ), &p_ucHdr[SD_BLK_IDX_SEQ], SD_IDX_ENT_SZ);
+	vL2FRAM_SetSecurity(0, FRAM_LOCK);
+}
 
+////////////////////////////////////////////////////////////////////////////////
+//!
+//! \brief Reads all index entries of the current group
+//!
+//! \param p_ucEntries, FRAM_SD_INDEX_SIZE bytes
+//! \return none
+////////////////////////////////////////////////////////////////////////////////
+void vL2FRAM_GetSDIndexEntries(uchar * p_ucEntries)
+{
+	vL2FRAM_SetSecurity(SD_INDEX, FRAM_UNLOCK);
+	ucFRAM_read_block(FRAM_SD_INDEX_BEG_ADDR, p_ucEntries, FRAM_SD_INDEX_SIZE);
 	vL2FRAM_SetSecurity(0, FRAM_LOCK);
 }
 
+////////////////////////////////////////////////////////////////////////////////
+//!
+//! \brief Writes an SRAM queue checkpoint record to FRAM
+//!
+//! The record is opaque here, L2SRAM builds and validates it.
+//!
+//! \param ucCkptNum, which of the FRAM_SRAMQ_CKPT_COUNT records to write
+//! \param p_ucRec, FRAM_SRAMQ_CKPT_SIZE bytes to write
+//! \return none
+////////////////////////////////////////////////////////////////////////////////
+void vL2FRAM_putSramQCkpt(uchar ucCkptNum, const uchar *p_ucRec)
+{
+	if (ucCkptNum >= FRAM_SRAMQ_CKPT_COUNT)
+		return;
+
+	vL2FRAM_SetSecurity(SRAMQ_CKPT, FRAM_UNLOCK);
+	ucFRAM_write_block(FRAM_SRAMQ_CKPT_BEG_ADDR + ((uint) ucCkptNum * FRAM_SRAMQ_CKPT_SIZE), p_ucRec, FRAM_SRAMQ_CKPT_SIZE);
+
+	vL2FRAM_SetSecurity(0, FRAM_LOCK);
+
+}/* END: vL2FRAM_putSramQCkpt() */
+
+////////////////////////////////////////////////////////////////////////////////
+//!
+//! \brief Reads an SRAM queue checkpoint record from FRAM
+//!
+//! \param ucCkptNum, which of the FRAM_SRAMQ_CKPT_COUNT records to read
+//! \param p_ucRec, buffer of FRAM_SRAMQ_CKPT_SIZE bytes
+//! \return none
+////////////////////////////////////////////////////////////////////////////////
+void vL2FRAM_getSramQCkpt(uchar ucCkptNum, uchar *p_ucRec)
+{
+	if (ucCkptNum >= FRAM_SRAMQ_CKPT_COUNT)
+		return;
+
+	vL2FRAM_SetSecurity(SRAMQ_CKPT, FRAM_UNLOCK);
+	ucFRAM_read_block(FRAM_SRAMQ_CKPT_BEG_ADDR + ((uint) ucCkptNum * FRAM_SRAMQ_CKPT_SIZE), p_ucRec, FRAM_SRAMQ_CKPT_SIZE);
+
+	vL2FRAM_SetSecurity(0, FRAM_LOCK);
+
+}/* END: vL2FRAM_getSramQCkpt() */
+
 /******************** vL2FRAM_stuffSavedTime()  ******************************
  *
  *
@@ -1055,19 +2066,15 @@ uchar ucL2FRAM_isReceiver(void)
 /////////////////////////////////////////////////////////////////////////////////
 uchar ucL2FRAM_GetOptionByte(uchar ucOptionByteIdx, uchar *ucByteVal){
 
-	uchar ucRetVal;
-
-	// Assume success
-	ucRetVal = 0;
-
-	vL2FRAM_SetSecurity(OPTION_BYTES, FRAM_UNLOCK);
+	uchar ucaOptions[FRAM_CFG_VAL_MAX];
 
-	if(ucFRAM_read_B8((uint)FRAM_OPTION_BYTE_0_ADDR + ucOptionByteIdx, ucByteVal) != 0)
-		ucRetVal = 1;
+	if(ucOptionByteIdx > OPTION_BYTE_COUNT)
+		return 1;
 
-	vL2FRAM_SetSecurity(0, FRAM_LOCK);
+	ucL2FRAM_CfgGet(FRAM_CFG_KEY_OPTIONS, ucaOptions);
+	*ucByteVal = ucaOptions[ucOptionByteIdx];
 
-	return ucRetVal;
+	return 0;
 }
 
 /////////////////////////////////////////////////////////////////////////////////
@@ -1078,19 +2085,17 @@ uchar ucL2FRAM_GetOptionByte(uchar ucOptionByteIdx, uchar *ucByteVal){
 /////////////////////////////////////////////////////////////////////////////////
 uchar ucL2FRAM_SetOptionByte(uchar ucOptionByteIdx, uchar ucByteVal){
 
-	uchar ucRetVal;
-
-	// Assume success
-	ucRetVal = 0;
-
-	vL2FRAM_SetSecurity(OPTION_BYTES, FRAM_UNLOCK);
+	uchar ucaOptions[FRAM_CFG_VAL_MAX];
 
-	if(ucFRAM_write_B8((uint)FRAM_OPTION_BYTE_0_ADDR + ucOptionByteIdx, ucByteVal) != 0)
-		ucRetVal = 1;
+	if(ucOptionByteIdx > OPTION_BYTE_COUNT)
+		return 1;
 
-	vL2FRAM_SetSecurity(0, FRAM_LOCK);
+	// The whole array is one value, change the byte and write it back
+	ucL2FRAM_CfgGet(FRAM_CFG_KEY_OPTIONS, ucaOptions);
+	ucaOptions[ucOptionByteIdx] = ucByteVal;
+	vL2FRAM_CfgSet(FRAM_CFG_KEY_OPTIONS, ucaOptions);
 
-	return ucRetVal;
+	return 0;
 }
 
 /**********************  uiL2FRAM_getSnumLo16AsUint()  ************************************
@@ -1102,13 +2107,7 @@ uchar ucL2FRAM_SetOptionByte(uchar ucOptionByteIdx, uchar ucByteVal){
 
 uint uiL2FRAM_getSnumLo16AsUint(void)
 {
-	uint uiSN;
-
-	vL2FRAM_SetSecurity(NETWORK_ID, FRAM_UNLOCK);
-	ucFRAM_read_B16(FRAM_USER_ID_ADDR, &uiSN);
-	vL2FRAM_SetSecurity(0, FRAM_LOCK);
-
-	return uiSN;
+	return uiL2FRAM_CfgGetU16(FRAM_CFG_KEY_SYS_ID);
 
 }/* END: uiL2FRAM_getSnumLo16AsUint() */
 
@@ -1138,9 +2137,7 @@ void vL2FRAM_copySnumLo16ToBytes(uchar *ucpToPtr)
 void vL2FRAM_setSysID(uint uiSysID)
 {
 
-	vL2FRAM_SetSecurity(NETWORK_ID, FRAM_UNLOCK);
-	ucFRAM_write_B16(FRAM_USER_ID_ADDR, uiSysID);
-	vL2FRAM_SetSecurity(0, FRAM_LOCK);
+	vL2FRAM_CfgSetU16(FRAM_CFG_KEY_SYS_ID, uiSysID);
 
 	return;
 
@@ -1171,12 +2168,17 @@ uchar ucL2FRAM_getTSBTblCount(void)
 {
 	uchar ucTSBCount;
 
-	vL2FRAM_SetSecurity(TASK_STATE_BLOCKS, FRAM_UNLOCK);
+	// The newest journal record is ahead of the table
+	if (ucL2FRAM_TSBJrnlLive)
+		ucTSBCount = ucaL2FRAM_TSBJrnlLive[FRAM_TSB_JRNL_IDX_COUNT];
+	else {
+		vL2FRAM_SetSecurity(TASK_STATE_BLOCKS, FRAM_UNLOCK);
 
-	// Read the value from FRAM
-	ucFRAM_read_B8(FRAM_ST_BLK_COUNT_ADDR, &ucTSBCount);
+		// Read the value from FRAM
+		ucFRAM_read_B8(FRAM_ST_BLK_COUNT_ADDR, &ucTSBCount);
 
-	vL2FRAM_SetSecurity(0, FRAM_LOCK);
+		vL2FRAM_SetSecurity(0, FRAM_LOCK);
+	}
 
 	// Keep the count within range
 	if (ucTSBCount > MAXNUMTASKS)
@@ -1185,49 +2187,6 @@ uchar ucL2FRAM_getTSBTblCount(void)
 	return ucTSBCount;
 }/* END: ucL2FRAM_getTSBTblCount() */
 
-/**********************  vL2FRAM_setTSBTblCount()  **************************
- *
- * Return Start Blk Table Entry Count
- *
- ******************************************************************************/
-void vL2FRAM_setTSBTblCount(uchar ucBlkCount)
-{
-	vL2FRAM_SetSecurity(TASK_STATE_BLOCKS, FRAM_UNLOCK);
-	ucFRAM_write_B8(FRAM_ST_BLK_COUNT_ADDR, ucBlkCount);
-	vL2FRAM_SetSecurity(0, FRAM_LOCK);
-	return;
-
-}/* END: ucL2FRAM_setTSBTblCount() */
-
-//////////////////////////////////////////////////////////////////////////////
-//! \fn ucL2FRAM_getNextFreeTSB
-//!
-//! \brief Gets the location of the next available task state-block
-//!
-//!	The state blocks are added sequentially so there are no empty locations in
-//! the list.  If a state block is deleted then the deleted location is filled
-//! with the last state block in the list.
-//!
-//! \return ucTSBCount
-//////////////////////////////////////////////////////////////////////////////
-static uchar ucL2FRAM_getNextFreeTSB( uchar *ucTSBNum)
-{
-	uchar ucTSBCount;
-
-	// Get the state-block count
-	ucTSBCount = ucL2FRAM_getTSBTblCount();
-	*ucTSBNum = ucTSBCount;
-
-	if (ucTSBCount >= FRAM_MAX_TSB_COUNT)
-		return 1; // No state-blocks available
-	else
-		vL2FRAM_setTSBTblCount(ucTSBCount + 1); // Write the next one
-
-	return 0;
-
-}/* END: ucL2FRAM_getNextFreeTSB() */
-
-
 ////////////////////////////////////////////////////////////////////////////////
 //! \fn ulL2FRAM_getTSBEntryVal
 //! \brief Return TSB entry value
@@ -1245,6 +2204,12 @@ ulong ulL2FRAM_getTSBEntryVal( //RET: TSB Entry Val
 	ulong ulRetVal;
 	uint uiRetVal;
 	uchar ucRetVal;
+	const uchar *ucpImg;
+
+	// The newest journal record is ahead of the table for its blocks
+	ucpImg = ucpL2FRAM_findLiveTSBImage(ucTSBNum);
+	if ((ucpImg != 0) && (ucTSBEntryIdx < FRAM_ST_BLK_SIZE))
+		return ulL2FRAM_getTSBImageField(ucpImg, ucTSBEntryIdx);
 
 	uiOffset = ((uint) ucTSBNum) * FRAM_ST_BLK_SIZE;
 	uiAddr = FRAM_ST_BLK_0_ADDR + uiOffset + ucTSBEntryIdx;
@@ -1289,7 +2254,7 @@ ulong ulL2FRAM_getTSBEntryVal( //RET: TSB Entry Val
 ////////////////////////////////////////////////////////////////////////////////
 //! \fn vL2FRAM_putTSBEntryVal
 //!
-//! \brief Return state-block entry value
+//! \brief Stuff one state-block entry value
 //!
 //! \param ucTSBNum, ucTSBEntryIdx, ulVal
 ////////////////////////////////////////////////////////////////////////////////
@@ -1299,60 +2264,71 @@ void vL2FRAM_putTSBEntryVal( //Stuff the Value int the TSB
     ulong ulVal //value to put
     )
 {
-	uint uiOffset;
-	uint uiAddr;
-
-	uiOffset = ((uint) ucTSBNum) * FRAM_ST_BLK_SIZE;
-	uiAddr = FRAM_ST_BLK_0_ADDR + uiOffset + ucTSBEntryIdx;
-	vL2FRAM_SetSecurity(TASK_STATE_BLOCKS, FRAM_UNLOCK);
+	vL2FRAM_putTSBEntryVals(ucTSBNum, 1, &ucTSBEntryIdx, &ulVal);
 
-	switch (ucTSBEntryIdx)
-	{
-		case FRAM_ST_BLK_TASK_IDX: //byte
-		case FRAM_ST_BLK_TASK_STATE:
-			ucFRAM_write_B8(uiAddr, (uchar) ulVal);
-		break;
+}/* END: vL2FRAM_putTSBEntryVal() */
 
-		case FRAM_ST_BLK_TASK_ID: // Integers
-		case FRAM_ST_BLK_FLAGS:
-			ucFRAM_write_B16(uiAddr, (uint) ulVal);
-		break;
+////////////////////////////////////////////////////////////////////////////////
+//! \fn vL2FRAM_putTSBEntryVals
+//!
+//! \brief Stuff several state-block entry values at once
+//!
+//! The block is read, the fields changed in RAM and the whole block written
+//! back through the journal as one record, so either all of the fields
+//! change or none do.
+//!
+//! \param ucTSBNum, ucNumVals
+//! \param ucpTSBEntryIdx, index of each field
+//! \param ulpVal, value of each field
+////////////////////////////////////////////////////////////////////////////////
+void vL2FRAM_putTSBEntryVals( //Stuff several values into the TSB at once
+    uchar ucTSBNum, //blk number
+    uchar ucNumVals, //number of fields
+    const uchar *ucpTSBEntryIdx, //index of each field into the blk
+    const ulong *ulpVal //value of each field
+    )
+{
+	uchar ucaRec[FRAM_TSB_JRNL_SIZE];
+	uchar *ucpSlot;
+	uchar ucVal;
 
-		case FRAM_ST_BLK_PARAM1: // Longs
-		case FRAM_ST_BLK_PARAM2:
-		case FRAM_ST_BLK_PARAM3:
-		case FRAM_ST_BLK_PARAM4:
-			ucFRAM_write_B32(uiAddr, ulVal);
-		break;
+	ucpSlot = &ucaRec[FRAM_TSB_JRNL_IDX_IMG];
 
-#if 0
-			vSERIAL_sout("SenseActBlk=", 12);
-			vSERIAL_UIV8out(ucTSBNum);
-			vSERIAL_sout(",  Idx=", 7);
-			vSERIAL_UIV8out(ucTSBEntryIdx);
-			vSERIAL_sout(", Val=", 6);
-			vSERIAL_HB32out(ulVal);
-			vSERIAL_crlf();
-#endif
+	// Start from the current contents of the block
+	if (ucTSBNum < FRAM_MAX_TSB_COUNT)
+		vL2FRAM_readTSBImage(ucpSlot, ucTSBNum);
 
-		default:
+	for (ucVal = 0; ucVal < ucNumVals; ucVal++)
+	{
+		if (ucTSBNum >= FRAM_MAX_TSB_COUNT || ucL2FRAM_setTSBImageField(&ucpSlot[1], ucpTSBEntryIdx[ucVal], ulpVal[ucVal]) != 0)
+		{
 			vSERIAL_sout("L2FRM:WriteBdTSBAddr= ", 22);
-			vSERIAL_UIV16out(uiAddr);
+			vSERIAL_UIV16out(FRAM_ST_BLK_0_ADDR + ((uint) ucTSBNum * FRAM_ST_BLK_SIZE) + ucpTSBEntryIdx[ucVal]);
 			vSERIAL_crlf();
 			vSERIAL_sout("Blk=", 4);
 			vSERIAL_UIV8out(ucTSBNum);
 			vSERIAL_sout(",  Idx=", 7);
-			vSERIAL_UIV8out(ucTSBEntryIdx);
+			vSERIAL_UIV8out(ucpTSBEntryIdx[ucVal]);
 			vSERIAL_crlf();
-		break;
+			return;
+		}
+	}
 
-	}/* END: switch() */
+#if 0
+	vSERIAL_sout("SenseActBlk=", 12);
+	vSERIAL_UIV8out(ucTSBNum);
+	vSERIAL_sout(",  Idx=", 7);
+	vSERIAL_UIV8out(ucpTSBEntryIdx[0]);
+	vSERIAL_sout(", Val=", 6);
+	vSERIAL_HB32out(ulpVal[0]);
+	vSERIAL_crlf();
+#endif
 
-	vL2FRAM_SetSecurity(0, FRAM_LOCK);
+	vL2FRAM_commitTSBJrnl(ucaRec, ucL2FRAM_getTSBTblCount(), 1);
 
 	return;
 
-}/* END: vL2FRAM_putTSBEntryVal() */
+}/* END: vL2FRAM_putTSBEntryVals() */
 
 ///////////////////////////////////////////////////////////////////////////////
 //! \fn ucL2FRAM_findTSBTask
@@ -1435,6 +2411,9 @@ uchar ucL2FRAM_findTSB_SN( //Ret: TSB num,  255 if none
 //!
 //! \brief Adds a task state control block to the list
 //!
+//!	The state blocks are added sequentially so there are no empty locations in
+//! the list.  The new block and the new count go out in one journal record.
+//!
 //!	\param ucTskIndex
 //!	\return
 //////////////////////////////////////////////////////////////////////////////
@@ -1443,12 +2422,14 @@ signed char cL2FRAM_addTSB( //RET: TSB num of new entry
 		)
 {
 	uchar ucNewTSBNum;
+	uchar ucaRec[FRAM_TSB_JRNL_SIZE];
 	ulong ulParam1, ulParam2, ulParam3, ulParam4;
 	ulong ulTaskID, ulState, ulFlags;
 
 	/* GET A NEW TSB NUMBER */
-	if(ucL2FRAM_getNextFreeTSB(&ucNewTSBNum) != 0)
-		return -1;
+	ucNewTSBNum = ucL2FRAM_getTSBTblCount();
+	if (ucNewTSBNum >= FRAM_MAX_TSB_COUNT)
+		return -1; // No state-blocks available
 
 	// If there is an error reading the task ID then exit with an error
 	if (ucTask_GetField(ucTskIndex, TSK_ID, &ulTaskID) != TASKMNGR_OK) //Task ID
@@ -1464,7 +2445,8 @@ signed char cL2FRAM_addTSB( //RET: TSB num of new entry
 	ucTask_GetParam(ucTskIndex, 3, &ulParam4); // Parameter 4
 
 	/* ADD THIS ACTION TO THE LIST OF START BLKS */
-	vL2FRAM_stuffTSB(ucNewTSBNum, //start blk index
+	vL2FRAM_buildTSBImage(&ucaRec[FRAM_TSB_JRNL_IDX_IMG],
+			ucNewTSBNum, //start blk index
 			ucTskIndex, //Task index
 			(uint)ulTaskID, 	//Task ID
 			(uint)ulFlags, 	//Start flag value
@@ -1475,6 +2457,8 @@ signed char cL2FRAM_addTSB( //RET: TSB num of new entry
 			ulParam4 	//Parameter 4
 			);
 
+	vL2FRAM_commitTSBJrnl(ucaRec, ucNewTSBNum + 1, 1);
+
 
 #if 0
 	vL2FRAM_showTSBTbl();
@@ -1493,49 +2477,35 @@ signed char cL2FRAM_addTSB( //RET: TSB num of new entry
  *		method used	is to look for a zero action (SLEEP) blk that is not in
  *		the block 0 position.
  *
+ * The last TSB is moved into the hole, the last slot cleared and the count
+ * dropped in one journal record.
+ *
  ******************************************************************************/
 void vL2FRAM_deleteTSB(uchar ucTSBNum //Task State Block Num
     )
 {
 
 	uchar ucLastTSB;
-	uchar ucTaskIndex, ucState;
-	uint uiTaskID, uiFlags;
-	ulong ulParam1, ulParam2, ulParam3, ulParam4;
+	uchar ucNumImgs;
+	uchar ucaRec[FRAM_TSB_JRNL_SIZE];
 
 	// Get the location of the last TSB in the list
 	ucLastTSB = ucL2FRAM_getTSBTblCount();
 	if(ucLastTSB > 0)
 		ucLastTSB--;
 
-	// If we are not deleting the last TSB then get a local copy of the last TSB and overwright the TSB to be deleted
-	if (ucLastTSB != ucTSBNum) {
+	ucNumImgs = 0;
 
-		// Get a local copy of the last TSB in the list
-		ucTaskIndex = (uchar) ulL2FRAM_getTSBEntryVal(ucLastTSB, FRAM_ST_BLK_TASK_IDX);
-		uiTaskID = (uint) ulL2FRAM_getTSBEntryVal(ucLastTSB, FRAM_ST_BLK_TASK_ID);
-		uiFlags = (uint) ulL2FRAM_getTSBEntryVal(ucLastTSB, FRAM_ST_BLK_FLAGS);
-		ucState = (uchar) ulL2FRAM_getTSBEntryVal(ucLastTSB, FRAM_ST_BLK_TASK_STATE);
-		ulParam1 = ulL2FRAM_getTSBEntryVal(ucLastTSB, FRAM_ST_BLK_PARAM1);
-		ulParam2 = ulL2FRAM_getTSBEntryVal(ucLastTSB, FRAM_ST_BLK_PARAM2);
-		ulParam3 = ulL2FRAM_getTSBEntryVal(ucLastTSB, FRAM_ST_BLK_PARAM3);
-		ulParam4 = ulL2FRAM_getTSBEntryVal(ucLastTSB, FRAM_ST_BLK_PARAM4);
-
-		// Overwrite the task state block
-		vL2FRAM_stuffTSB(ucTSBNum, //St blk Idx
-				ucTaskIndex, //Task index
-				uiTaskID, 	//Task ID
-				uiFlags, 	//Start flag value
-				ucState, 	// Task state
-				ulParam1, 	//Parameter 1
-				ulParam2, 	//Parameter 2
-				ulParam3, 	//Parameter 3
-				ulParam4 	//Parameter 4
-				);
+	// If we are not deleting the last TSB then the last TSB overwrites the TSB to be deleted
+	if (ucLastTSB != ucTSBNum) {
+		vL2FRAM_readTSBImage(&ucaRec[FRAM_TSB_JRNL_IDX_IMG], ucLastTSB);
+		ucaRec[FRAM_TSB_JRNL_IDX_IMG] = ucTSBNum;
+		ucNumImgs++;
 	}
 
 	// Clear the last task state block.
-	vL2FRAM_stuffTSB(ucLastTSB, //St blk Idx
+	vL2FRAM_buildTSBImage(&ucaRec[FRAM_TSB_JRNL_IDX_IMG + ((uint) ucNumImgs * FRAM_TSB_JRNL_IMG_SZ)],
+			ucLastTSB, //St blk Idx
 			0,  // Task index
 			0, 	// Task ID
 			0, 	// Start flag value
@@ -1545,9 +2515,10 @@ void vL2FRAM_deleteTSB(uchar ucTSBNum //Task State Block Num
 			0, 	// Parameter 3
 			0 	// Parameter 4
 			);
+	ucNumImgs++;
 
-	// Set the new task state block count
-	vL2FRAM_setTSBTblCount(ucLastTSB);
+	// Set the new task state block count along with the blocks
+	vL2FRAM_commitTSBJrnl(ucaRec, ucLastTSB, ucNumImgs);
 
 #if 0
 	vL2FRAM_showTSBTbl();
@@ -1639,9 +2610,7 @@ void vL2FRAM_showYtriggerTbl(void)
 /////////////////////////////////////////////////////////////////////////////////
 void vL2FRAM_SetReportingPriority(uchar ucReportingPriority){
 
-	vL2FRAM_SetSecurity(REPORTINGPRIORITY, FRAM_UNLOCK);
-	ucFRAM_write_B8(FRAM_RPT_PRTY_ADDR, ucReportingPriority);
-	vL2FRAM_SetSecurity(0, FRAM_LOCK);
+	vL2FRAM_CfgSetU8(FRAM_CFG_KEY_RPT_PRTY, ucReportingPriority);
 
 }
 
@@ -1654,13 +2623,7 @@ void vL2FRAM_SetReportingPriority(uchar ucReportingPriority){
 /////////////////////////////////////////////////////////////////////////////////
 uchar ucL2FRAM_GetReportingPriority(void){
 
-	uchar ucReportingPriority = 0xFF;
-
-	vL2FRAM_SetSecurity(REPORTINGPRIORITY, FRAM_UNLOCK);
-	ucFRAM_read_B8(FRAM_RPT_PRTY_ADDR, &ucReportingPriority);
-	vL2FRAM_SetSecurity(0, FRAM_LOCK);
-
-	return ucReportingPriority;
+	return ucL2FRAM_CfgGetU8(FRAM_CFG_KEY_RPT_PRTY);
 }
 
 
@@ -27,7 +27,7 @@
 #include "SD_Card.h"
 
 #define FRAM_VERSION_HI		0x02
-#define FRAM_VERSION_LO		0x09
+#define FRAM_VERSION_LO		0x0E
 #define FRAM_VERSION (((uint)FRAM_VERSION_HI<<8) | ((uint)FRAM_VERSION_LO))
 
 #define FRAM_TEST_ADDR 			6	//4 bytes
@@ -37,7 +37,7 @@
 #define FRAM_TEST_ADDR_LO		9
 
 #define FRAM_SDCARD_BLOCK_NUM_ADDR			10	//4 bytes
-#define FRAM_SDCARD_BUFF_START_PTR_ADDR		14	//2 bytes
+#define FRAM_SDCARD_FLUSH_PAGE_ADDR			14	//2 bytes
 #define FRAM_SDCARD_BUFF_END_PTR_ADDR		16	//2 bytes
 #define FRAM_TIME_SAVE_AREA_ADDR			18	//4 bytes
 #define FRAM_REBOOT_COUNT_ADDR				22	//2 bytes
@@ -89,31 +89,188 @@
  * written to the SD card.  This is required since minimal block
  * lengths of SD cards are typically 512 bytes.
  *
+ * The buffer is a ring of SD block sized pages.  Messages are written
+ * back to back and one that runs off the end of a page continues in the
+ * next page.  Every page starts with the SD log block header (see
+ * SD_Log.h).  The sequence number, time range, carry over count and end
+ * offset are kept up to date here as the page fills, the magic, volume and
+ * CRC are added when the page is flushed.  A block read back from the SD
+ * card can therefore be parsed on its own.  Flushing a page only moves the
+ * flush page index, nothing is copied.
+ *
  **/
 
+//!	\def FRAM_SD_CARD_PAGE_SIZE
+//! \brief Size of one page of the SD card buffer
+#define FRAM_SD_CARD_PAGE_SIZE				SD_CARD_BLOCKLEN
+
+//!	\def FRAM_SD_CARD_PAGE_COUNT
+//! \brief Number of pages in the SD card buffer
+#ifndef FRAM_SD_CARD_PAGE_COUNT
+#define FRAM_SD_CARD_PAGE_COUNT				4
+#endif
+
+//!	\def FRAM_SD_CARD_FLUSH_PAGES
+//! \brief Full pages to collect before they go to the SD card in one
+//! multiple block write.  Leaves one page to fill while the flush is pending.
+#ifndef FRAM_SD_CARD_FLUSH_PAGES
+#define FRAM_SD_CARD_FLUSH_PAGES			(FRAM_SD_CARD_PAGE_COUNT - 1)
+#endif
+
+//!	\def FRAM_SD_CARD_PAGE_HDR_SZ
+//! \brief Size of the SD log block header at the start of each page
+#define FRAM_SD_CARD_PAGE_HDR_SZ			SD_BLK_HDR_SZ
+
 //!	\def FRAM_SD_CARD_BUFF_SIZE
 //! \brief Size of SD card buffer
-#define FRAM_SD_CARD_BUFF_SIZE				SD_CARD_BLOCKLEN
+#define FRAM_SD_CARD_BUFF_SIZE				(FRAM_SD_CARD_PAGE_SIZE * FRAM_SD_CARD_PAGE_COUNT)
 
 //!	\def FRAM_SD_CARD_BUFF_BEG_ADDR
 //! \brief Starting address of the SD card buffer
 #define	FRAM_SD_CARD_BUFF_BEG_ADDR		(FRAM_Y_TRIG_AREA_END_ADDR	+ 1)//1737
 
 //!	\def FRAM_SD_CARD_BUFF_END_ADDR
-//! \brief Ending address of the SD card buffer
-#define FRAM_SD_CARD_BUFF_END_ADDR		(FRAM_SD_CARD_BUFF_BEG_ADDR + FRAM_SD_CARD_BUFF_SIZE)//2249
+//! \brief Ending address of the SD card buffer (one past the last page)
+#define FRAM_SD_CARD_BUFF_END_ADDR		(FRAM_SD_CARD_BUFF_BEG_ADDR + FRAM_SD_CARD_BUFF_SIZE)//3785
+
+/**
+ * The SRAM message queue pointers are checkpointed here so the queue can be
+ * resumed after a reset.  Two copies are kept and written alternately so a
+ * reset in the middle of a checkpoint still leaves the previous one intact.
+ * The record layout is owned by L2SRAM (see l2sram.h).
+ *
+ **/
 
-//!	\def FRAM_SD_CARD_OVRFLO_SIZE
-//! \brief Size of the overflow buffer
-#define FRAM_SD_CARD_OVRFLO_SIZE 			448
+//!	\def FRAM_SRAMQ_CKPT_SIZE
+//! \brief Size of one checkpoint record (checked against L2SRAM_CKPT_REC_SZ in L2Sram.c)
+#define FRAM_SRAMQ_CKPT_SIZE					38
 
-//!	\def FRAM_SD_CARD_OVRFLO_END_ADDR
-//! \brief Starting address of the overflow buffer
-#define FRAM_SD_CARD_OVRFLO_BEG_ADDR 	(FRAM_SD_CARD_BUFF_END_ADDR + 1) //2250
+//!	\def FRAM_SRAMQ_CKPT_COUNT
+//! \brief Number of checkpoint records
+#define FRAM_SRAMQ_CKPT_COUNT					2
 
-//!	\def FRAM_SD_CARD_BUFF_END_ADDR
-//! \brief Ending address of the overflow buffer
-#define FRAM_SD_CARD_OVRFLO_END_ADDR	(FRAM_SD_CARD_OVRFLO_BEG_ADDR +	FRAM_SD_CARD_OVRFLO_SIZE)//2762
+//!	\def FRAM_SRAMQ_CKPT_BEG_ADDR
+//! \brief Starting address of the checkpoint records
+#define FRAM_SRAMQ_CKPT_BEG_ADDR			(FRAM_SD_CARD_BUFF_END_ADDR + 1) //3786
+
+//!	\def FRAM_SRAMQ_CKPT_END_ADDR
+//! \brief Ending address of the checkpoint records
+#define FRAM_SRAMQ_CKPT_END_ADDR			(FRAM_SRAMQ_CKPT_BEG_ADDR + (FRAM_SRAMQ_CKPT_SIZE * FRAM_SRAMQ_CKPT_COUNT) - 1) //3861
+
+/**
+ * Task state block changes are written here as a single record (whole
+ * blocks plus the new table count) before the table itself is touched.
+ * Two record slots are written alternately.  The newest record holds the
+ * truth for its blocks and the table only catches up when a later record
+ * does not rewrite the same blocks, so repeated updates of one block cost
+ * one burst each.  The newest valid record is rolled forward at boot, a
+ * torn record fails its CRC and the one before it is used instead.
+ *
+ * Record: [magic 2][seq 2][count 1][num imgs 1][imgs][CRC 2]
+ * Image:  [TSB num 1][block FRAM_ST_BLK_SIZE]
+ *
+ **/
+
+//!	\def FRAM_TSB_JRNL_MAGIC
+//! \brief Marks a journal record ('TJ')
+#define FRAM_TSB_JRNL_MAGIC					0x544A
+
+#define FRAM_TSB_JRNL_IDX_MAGIC				0
+#define FRAM_TSB_JRNL_IDX_SEQ				2
+#define FRAM_TSB_JRNL_IDX_COUNT				4
+#define FRAM_TSB_JRNL_IDX_NUM_IMGS			5
+#define FRAM_TSB_JRNL_IDX_IMG				6
+
+//!	\def FRAM_TSB_JRNL_IMG_SZ
+//! \brief Size of one block image in the record
+#define FRAM_TSB_JRNL_IMG_SZ				(1 + FRAM_ST_BLK_SIZE)
+
+//!	\def FRAM_TSB_JRNL_MAX_IMGS
+//! \brief A delete moves one block and clears another
+#define FRAM_TSB_JRNL_MAX_IMGS				2
+
+#define FRAM_TSB_JRNL_IDX_CRC				(FRAM_TSB_JRNL_IDX_IMG + (FRAM_TSB_JRNL_IMG_SZ * FRAM_TSB_JRNL_MAX_IMGS))
+
+//!	\def FRAM_TSB_JRNL_SIZE
+//! \brief Size of one journal record
+#define FRAM_TSB_JRNL_SIZE					(FRAM_TSB_JRNL_IDX_CRC + 2) //54
+
+//!	\def FRAM_TSB_JRNL_COUNT
+//! \brief Number of journal record slots
+#define FRAM_TSB_JRNL_COUNT					2
+
+//!	\def FRAM_TSB_JRNL_BEG_ADDR
+//! \brief Starting address of the journal records
+#define FRAM_TSB_JRNL_BEG_ADDR				(FRAM_SRAMQ_CKPT_END_ADDR + 1) //3862
+
+//!	\def FRAM_TSB_JRNL_END_ADDR
+//! \brief Ending address of the journal records
+#define FRAM_TSB_JRNL_END_ADDR				(FRAM_TSB_JRNL_BEG_ADDR + (FRAM_TSB_JRNL_SIZE * FRAM_TSB_JRNL_COUNT) - 1) //3969
+
+//!	\def FRAM_CFG_VAL_MAX
+//! \brief Largest value held by one key of the configuration store
+#define FRAM_CFG_VAL_MAX					8
+
+//! Configuration record: [key 1][len 1][ver 1][value FRAM_CFG_VAL_MAX][CRC 2]
+#define FRAM_CFG_IDX_KEY					0
+#define FRAM_CFG_IDX_LEN					1
+#define FRAM_CFG_IDX_VER					2
+#define FRAM_CFG_IDX_VAL					3
+#define FRAM_CFG_IDX_CRC					(FRAM_CFG_IDX_VAL + FRAM_CFG_VAL_MAX)
+
+//!	\def FRAM_CFG_REC_SZ
+//! \brief Size of one configuration record
+#define FRAM_CFG_REC_SZ						(FRAM_CFG_IDX_CRC + 2) //13
+
+//!	\def FRAM_CFG_MAX_KEYS
+//! \brief Keys reserved in FRAM, new keys up to this count need no reformat
+#define FRAM_CFG_MAX_KEYS					16
+
+//!	\def FRAM_CFG_SIZE
+//! \brief Two ping-pong record slots per key
+#define FRAM_CFG_SIZE						(FRAM_CFG_MAX_KEYS * 2 * FRAM_CFG_REC_SZ) //416
+
+//!	\def FRAM_CFG_BEG_ADDR
+//! \brief Starting address of the configuration store
+//!
+//! Fixed near the top of the part and not derived from the regions above,
+//! so growing a region or bumping FRAM_VERSION never moves the store.  The
+//! format keeps its records (see vL2FRAM_format_fram()).
+#define FRAM_CFG_BEG_ADDR					0x1D00 //7424
+
+//!	\def FRAM_CFG_END_ADDR
+//! \brief Ending address of the configuration store
+#define FRAM_CFG_END_ADDR					(FRAM_CFG_BEG_ADDR + FRAM_CFG_SIZE - 1) //7839
+
+/**
+ * Entries of the SD log index block for the group being written.  The entry
+ * of a data block is stored here when the block goes out and the index
+ * block is built from this area when the last slot of the group comes up.
+ *
+ **/
+
+//!	\def FRAM_SD_INDEX_SIZE
+//! \brief One entry for each data block of an index group
+#define FRAM_SD_INDEX_SIZE					(SD_LOG_INDEX_ENTRIES * SD_IDX_ENT_SZ) //372
+
+//!	\def FRAM_SD_INDEX_BEG_ADDR
+//! \brief Starting address of the index entries
+#define FRAM_SD_INDEX_BEG_ADDR				(FRAM_TSB_JRNL_END_ADDR + 1) //3970
+
+//!	\def FRAM_SD_INDEX_END_ADDR
+//! \brief Ending address of the index entries
+#define FRAM_SD_INDEX_END_ADDR				(FRAM_SD_INDEX_BEG_ADDR + FRAM_SD_INDEX_SIZE - 1) //4341
+
+//! \name Configuration keys
+//! \brief Ids of the values in the configuration store
+//! @{
+#define FRAM_CFG_KEY_OPTIONS				0	//!< Option byte array (OPTION_BYTE_COUNT + 1 bytes)
+#define FRAM_CFG_KEY_SHUTDOWN_STATE			1	//!< State on shutdown (1 byte)
+#define FRAM_CFG_KEY_RPT_PRTY				2	//!< Reporting priority (1 byte)
+#define FRAM_CFG_KEY_SYS_ID					3	//!< System ID (2 bytes)
+#define FRAM_CFG_KEY_SD_VOLUME				4	//!< Volume id of the SD card log (2 bytes)
+#define FRAM_CFG_KEY_COUNT					5
+//! @}
 
 #define FRAM_CHK_REPORT_MODE	1
 #define FRAM_CHK_SILENT_MODE	0
@@ -143,6 +300,18 @@ void vL2FRAM_writeDefaultStartBlkList(void);
 uchar ucL2FRAM_GetStateOnShutdown(void);
 void vL2FRAM_SetStateOnShutdown(uchar ucState);
 
+/*----------------- Configuration store ------------------*/
+
+void vL2FRAM_CfgLoad(void);
+void vL2FRAM_CfgReset(void);
+uchar ucL2FRAM_CfgIsStored(uchar ucKey);
+uchar ucL2FRAM_CfgGet(uchar ucKey, uchar *ucpVal);
+void vL2FRAM_CfgSet(uchar ucKey, const uchar *ucpVal);
+uchar ucL2FRAM_CfgGetU8(uchar ucKey);
+uint uiL2FRAM_CfgGetU16(uchar ucKey);
+void vL2FRAM_CfgSetU8(uchar ucKey, uchar ucVal);
+void vL2FRAM_CfgSetU16(uchar ucKey, uint uiVal);
+
 /*--------------------------------*/
 
 uint uiL2FRAM_get_version_num(void);
@@ -150,12 +319,22 @@ uint uiL2FRAM_get_version_num(void);
 /*--------------------------------*/
 
 uchar ucL2FRAM_WriteReportToSDCardBuff(volatile uchar * p_ucReport, uchar ucLength);
-void vL2FRAM_ReadSDCardBuffer(uchar * p_ucBlock);
+void vL2FRAM_ReadSDCardBuffer(uchar ucPageOffset, uchar * p_ucBlock);
 ulong ulL2FRAM_GetSDCardBlockNum(void);
 void vL2FRAM_SetSDCardBlockNum(ulong ulBlockNum);
-void vL2FRAM_SDCardOvrflowToBuff(void);
+void vL2FRAM_ReleaseSDCardPage(void);
+uchar ucL2FRAM_GetSDCardPagesReady(void);
 void vL2FRAM_IncrementSDCardBlockNum(void);
 ulong ulL2FRAM_GetLastSDCardBlockNum(void);
+uint uiL2FRAM_GetSDVolume(void);
+uint uiL2FRAM_NewSDVolume(void);
+void vL2FRAM_PutSDIndexEntry(uchar ucSlot, const uchar * p_ucHdr);
+void vL2FRAM_GetSDIndexEntries(uchar * p_ucEntries);
+
+/*--------------------------------*/
+
+void vL2FRAM_putSramQCkpt(uchar ucCkptNum, const uchar *p_ucRec);
+void vL2FRAM_getSramQCkpt(uchar ucCkptNum, uchar *p_ucRec);
 
 /*--------------------------------*/
 
@@ -212,6 +391,13 @@ void vL2FRAM_putTSBEntryVal( //Stuff the Value int the TSB
     ulong ulVal //value to put
     );
 
+void vL2FRAM_putTSBEntryVals( //Stuff several values into the TSB at once
+    uchar ucTSBNum, //blk number
+    uchar ucNumVals, //number of fields
+    const uchar *ucpTSBEntryIdx, //index of each field into the blk
+    const ulong *ulpVal //value of each field
+    );
+
 uchar ucL2FRAM_findTSB( //Ret: TSB num,  255 if none
 		uint uiTaskID);
 
@@ -228,6 +414,8 @@ signed char cL2FRAM_addTSB( //RET: TSB num of new entry
 
 void vL2FRAM_showTSBTbl(void);
 
+uchar ucL2FRAM_replayTSBJrnl(void);
+
 /*--------------------------------*/
 
 void vL2FRAM_putYtriggerVal( //Stuff Val into FRAM trigger Area
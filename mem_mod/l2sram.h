@@ -63,17 +63,17 @@
 
 // This is what the metadata table looks like.
 // It holds the total number of commands
-//-------------------------------------------------------------------
-// Num_cmds  |   NFL   |    S    |   R    |   A    |    M   |       |
-//-------------------------------------------------------------------
-// Node ID   |Cmds/Node| ADDR_1 | ADDR_2 | ADDR_3 | ADDR_4 | ADDR_5 |
-// 2-bytes	  1-byte	   4-bytes  4-bytes  4-bytes  4-bytes  4-bytes
-//-------------------------------------------------------------------
+//-----------------------------------------------------------------------
+// Num_cmds  |   NFL   |    S    |   R    |   A    |    2   |       |
+//-----------------------------------------------------------------------
+// Node ID   |Cmds/Node|  Head  | ADDR_1 | ADDR_2 |  ....  | ADDR_N |
+// 2-bytes	  1-byte	  1-byte   4-bytes  4-bytes           4-bytes
+//-----------------------------------------------------------------------
 //   :			 |		:		 |	 :		|		: 	 |		:	 	|		:	 	 |		:		|
 //   :			 |		:		 |	 :		|		: 	 |		:	 	|		:	 	 |		:		|
-//   :			 |		:		 |	 :		|		: 	 |		:	 	|		:	 	 |		:		|
-//   :			 |		:		 |	 :		|		: 	 |		:	 	|		:	 	 |		:		|
-//-------------------------------------------------------------------
+//-----------------------------------------------------------------------
+// The addresses of a node are a ring, Head is the slot of the oldest command.
+// The table is mirrored in RAM so only changes touch the SRAM.
 
 // Address of metadata regarding command queue
 #define CMD_METADATA_START_ADDR			 	L2SRAM_BASE_ADDR	// Starting address of the command queue metadata
@@ -88,16 +88,32 @@
 #define CMD_Q_FORMAT_XI								'S'
 #define CMD_Q_FORMAT_HI								'R'
 #define CMD_Q_FORMAT_MD								'A'
-#define CMD_Q_FORMAT_LO								'M'
+#define CMD_Q_FORMAT_LO								'2'	// bumped when the head byte was added to the rows
 
 #define CMD_Q_FIRST_ROW_ADDR					(CMD_Q_FORMAT_ADDR + CMD_Q_FORMAT_LEN) 	// Starting address of the node IDs
 #define NODE_ID_LEN									 	2		// Length of the ID of a node
 #define NUM_CMDS_PER_NODE_LEN				 	1		// Length of the area holding the number of commands pending for a single node
+#define NODE_CMD_HEAD_LEN							1		// Length of the area holding the slot of the oldest command of a node
 #define CMD_ADDR_LEN								 	4		// Then length of the address where the command is stored
-#define NUM_CMDS_PER_NODE						 	5		// Maximum number of commands pending for a single node
+
+// The limits may be raised from the build for large networks
+#ifndef NUM_CMDS_PER_NODE
+#define NUM_CMDS_PER_NODE						 	5		// Maximum number of commands pending for a single node (max 255)
+#endif
+#ifndef MAX_NUM_CMDS
 #define MAX_NUM_CMDS								 	25	// Maximum number of commands
-#define CMD_METADATA_ROW_LEN			    (NUM_CMDS_PER_NODE_LEN + NODE_ID_LEN + (CMD_ADDR_LEN * NUM_CMDS_PER_NODE)) // Length of a row in the table
-#define SIZE_OF_METADATA						 	(NUM_CMDS_VAR_LEN	+ CMD_Q_FORMAT_LEN + (MAX_NUM_CMDS * CMD_METADATA_ROW_LEN) + 4)	// Size of all of the metadata section
+#endif
+#ifndef CMD_Q_NODE_HASH_BITS
+#define CMD_Q_NODE_HASH_BITS					64	// Size of the pending node bitmap, must be a power of 2
+#endif
+
+#define CMD_Q_NUM_ROWS								MAX_NUM_CMDS	// Rows in the metadata table, a row holds at least one command
+#define CMD_Q_NODE_HASH_BYTES					(CMD_Q_NODE_HASH_BITS / 8)
+#define CMD_Q_SLOT_MAP_BYTES					((MAX_NUM_CMDS + 7) / 8)
+#define CMD_ROW_IDX_ADDRS							(NODE_ID_LEN + NUM_CMDS_PER_NODE_LEN + NODE_CMD_HEAD_LEN)	// Offset of the addresses in a row
+#define CMD_METADATA_ROW_LEN			    (CMD_ROW_IDX_ADDRS + (CMD_ADDR_LEN * NUM_CMDS_PER_NODE)) // Length of a row in the table
+#define CMD_Q_ROW_ADDR(row)						(CMD_Q_FIRST_ROW_ADDR + ((ulong) (row) * CMD_METADATA_ROW_LEN))
+#define SIZE_OF_METADATA						 	(NUM_CMDS_VAR_LEN	+ CMD_Q_FORMAT_LEN + (CMD_Q_NUM_ROWS * CMD_METADATA_ROW_LEN) + 4)	// Size of all of the metadata section
 #define CMD_METADATA_END_ADDR				 	(CMD_METADATA_START_ADDR + SIZE_OF_METADATA) // End address of the metadata
 #define CMD_METADATA_END_ADDR_PLUS_1 	(CMD_METADATA_END_ADDR+1)
 
@@ -115,7 +131,44 @@
 //#define L2SRAM_MSG_Q_END_UL	(L2SRAM_MSG_Q_BEG_UL + SRAM_TEST_MSG_BUFF_SIZE)
 /* run length */
 #define L2SRAM_MSG_Q_END_UL	MAX_SRAM_ADDR_UL    //0x3FFFF  256k
-#define L2SRAM_MSG_BUFF_COUNT_UL ((L2SRAM_MSG_Q_END_UL - L2SRAM_MSG_Q_BEG_UL)/MAX_MSG_SIZE_UL)
+// Messages are stored as length prefixed records, a zero length marks a wrap
+#define L2SRAM_MSG_REC_HDR_SZ	1
+#define L2SRAM_MSG_WRAP_MARK	0
+
+// Worst case count (all messages full size)
+#define L2SRAM_MSG_BUFF_COUNT_UL ((L2SRAM_MSG_Q_END_UL - L2SRAM_MSG_Q_BEG_UL)/(MAX_MSG_SIZE_UL + L2SRAM_MSG_REC_HDR_SZ))
+
+// Message classes in the order they are served
+#define L2SRAM_MSG_CLASS_CRISIS	0
+#define L2SRAM_MSG_CLASS_DATA		1
+#define L2SRAM_MSG_CLASS_DIAG		2
+#define L2SRAM_MSG_CLASS_COUNT	3
+
+// Each class has its own region so a flood of one class cannot push out another
+#define L2SRAM_MSG_CRISIS_Q_SIZE_UL	0x04000UL		//16k
+#define L2SRAM_MSG_DIAG_Q_SIZE_UL		0x10000UL		//64k
+
+#define L2SRAM_MSG_CRISIS_Q_BEG_UL	L2SRAM_MSG_Q_BEG_UL
+#define L2SRAM_MSG_CRISIS_Q_END_UL	(L2SRAM_MSG_CRISIS_Q_BEG_UL + L2SRAM_MSG_CRISIS_Q_SIZE_UL)
+#define L2SRAM_MSG_DIAG_Q_BEG_UL		L2SRAM_MSG_CRISIS_Q_END_UL
+#define L2SRAM_MSG_DIAG_Q_END_UL		(L2SRAM_MSG_DIAG_Q_BEG_UL + L2SRAM_MSG_DIAG_Q_SIZE_UL)
+#define L2SRAM_MSG_DATA_Q_BEG_UL		L2SRAM_MSG_DIAG_Q_END_UL
+#define L2SRAM_MSG_DATA_Q_END_UL		L2SRAM_MSG_Q_END_UL
+
+// A waiting class is served once after being passed over this many times
+#define L2SRAM_MSG_AGING_LIMIT	8
+
+// Layout of the queue checkpoint record kept in FRAM (FRAM_SRAMQ_CKPT_SIZE)
+#define L2SRAM_CKPT_MAGIC						0x5351	//'SQ'
+#define L2SRAM_CKPT_IDX_MAGIC				0		//2 bytes
+#define L2SRAM_CKPT_IDX_SEQ					2		//4 bytes
+#define L2SRAM_CKPT_IDX_CLASS				6		//one entry per class
+#define L2SRAM_CKPT_CLASS_IDX_QON		0		//4 bytes
+#define L2SRAM_CKPT_CLASS_IDX_QOFF	4		//4 bytes
+#define L2SRAM_CKPT_CLASS_IDX_QCNT	8		//2 bytes
+#define L2SRAM_CKPT_CLASS_SZ				10
+#define L2SRAM_CKPT_IDX_CRC					(L2SRAM_CKPT_IDX_CLASS + (L2SRAM_MSG_CLASS_COUNT * L2SRAM_CKPT_CLASS_SZ)) //2 bytes
+#define L2SRAM_CKPT_REC_SZ					(L2SRAM_CKPT_IDX_CRC + 2)
 
 #define L2SRAM_Q_ON_ID			1
 #define L2SRAM_Q_OFF_ID			2
@@ -143,6 +196,11 @@ void vL2SRAM_putPickTblEntry(USL uslTblBaseAddr, //Tbl base addr
     ulong ulEntryVal //Tbl entry value
     );
 
+void vL2SRAM_fillPickTbl(USL uslTblBaseAddr, //Tbl base addr
+    uint uiTblByteLen, //Tbl length in bytes
+    uchar ucFillVal //Value to fill with
+    );
+
 ulong ulL2SRAM_getStblEntry(uchar ucTblNum, //Tbl Number
     uchar ucTblIdx //Tbl index
     );
@@ -154,6 +212,8 @@ void vL2SRAM_putStblEntry(uchar ucTblNum, //Tbl Number
 
 uint uiL2SRAM_getMsgCount(void);
 
+uint uiL2SRAM_getClassMsgCount(uchar ucClass);
+
 uint uiL2SRAM_getVacantMsgCount(void);
 
 void vL2SRAM_storeMsgToSram(void);
@@ -162,9 +222,16 @@ void vL2SRAM_storeMsgToSramIfAllowed(void);
 
 uchar ucL2SRAM_getCopyOfCurMsg(void);
 
+uchar ucL2SRAM_getCopyOfCurMsgAt(uchar ucOffset);
+
+void vL2SRAM_delCurMsgs(uchar ucCount);
 
 void vL2SRAM_delCurMsg(void);
 
+void vL2SRAM_checkpointQ(void);
+
+uchar ucL2SRAM_resumeQ(void);
+
 void vL2SRAM_showTblName( //locate an SRAM addr in an SRAM table & show it
     ulong ulAddr);
 
@@ -181,6 +248,8 @@ void vL2SRAM_FormatCmd_Q(void);
 void vL2SRAM_TestCmdQueue(void);
 uchar ucL2SRAM_LoadCmdIfExists(uint uiNodeID);
 uchar ucL2SRAM_IsCmdQueueFormatted(void);
+void vL2SRAM_LoadCmdIndex(void);
+uint uiL2SRAM_GetTotalCmds(void);
 uchar ucL2SRAM_PutCMD_inQueue(uint uiNodeID);
 void ucL2SRAM_Del_current_CMD(void);
 
@@ -248,15 +248,8 @@ uchar ucOTA_WriteToSDCard(ulong ulAddress)
 		}
 	}
 
-	// Power up the SD card and run the initialization sequence
-	vSD_PowerOn();
-
-	// Try the initialization function a few times
-	for (uiCount = 0; uiCount < ucTimeout; uiCount++) {
-		if (ucSD_Init() == SD_SUCCESS)
-			break;
-	}
-	if (uiCount == ucTimeout) {
+	// Power up and initialize the SD card unless a session already has it
+	if (ucSD_SessionOpen() == SD_FAILED) {
 		ucRetVal = 1;
 #if 1
 		vSERIAL_sout("OTA SD Init Fail\r\n", 18);
@@ -264,7 +257,7 @@ uchar ucOTA_WriteToSDCard(ulong ulAddress)
 	}
 
 	// Only proceed if initialization was successful
-	if (uiCount != ucTimeout) {
+	if (ucRetVal == 0) {
 
 		for (ucBlockCount = 0; ucBlockCount < 2; ucBlockCount++) {
 			// Write the block to the SD card
@@ -283,8 +276,10 @@ uchar ucOTA_WriteToSDCard(ulong ulAddress)
 		}
 	}
 
-	//Power down the SD card
-	vSD_PowerOff();
+	// Power cycle the card on the next open after a failure, otherwise the
+	// session powers it down at the end of the slot
+	if (ucRetVal != 0)
+		vSD_SessionClose();
 
 	return ucRetVal;
 }
@@ -315,15 +310,8 @@ uchar ucOTA_ReadFromSDCard(ulong ulAddress, uchar *ucReturnBlock)
 		}
 	}
 
-	// Power up the SD card and run the initialization sequence
-	vSD_PowerOn();
-
-	// Try the initialization function a few times
-	for (uiCount = 0; uiCount < ucTimeout; uiCount++) {
-		if (ucSD_Init() == SD_SUCCESS)
-			break;
-	}
-	if (uiCount == ucTimeout) {
+	// Power up and initialize the SD card unless a session already has it
+	if (ucSD_SessionOpen() == SD_FAILED) {
 		ucRetVal = 1;
 #if 1
 		vSERIAL_sout("OTA SD Init Fail\r\n", 18);
@@ -331,7 +319,7 @@ uchar ucOTA_ReadFromSDCard(ulong ulAddress, uchar *ucReturnBlock)
 	}
 
 	// Only proceed if initialization was successful
-	if (uiCount != ucTimeout) {
+	if (ucRetVal == 0) {
 
 		for (ucBlockCount = 0; ucBlockCount < 2; ucBlockCount++) {
 			// Write the block to the SD card
@@ -350,8 +338,9 @@ uchar ucOTA_ReadFromSDCard(ulong ulAddress, uchar *ucReturnBlock)
 		}
 	}
 
-	//Power down the SD card
-	vSD_PowerOff();
+	// Power cycle the card on the next open after a failure
+	if (ucRetVal != 0)
+		vSD_SessionClose();
 
 	// Clear the local block
 	for (ucBlockCount = 0; ucBlockCount < 2; ucBlockCount++) {
@@ -579,17 +568,8 @@ uchar ucOTA_write_programheader(union DE_Code * ProgramCode)
 	// Try 5 times or until the subslot ends, whichever comes first
 	while (ucAttemptCount-- > 0 && (ucTimeCheckForAlarms(SUBSLOT_WARNING_ALARM_BIT) == 0)) {
 
-		// Power up the SD card and run the initialization sequence
-		vSD_PowerOn();
-
-		// Try the initialization function a few times
-		for (uiCount = 0; uiCount < ucTimeout; uiCount++) {
-			if (ucSD_Init() == SD_SUCCESS)
-				break;
-		}
-
-		// Set the return code to indicate a failure
-		if (uiCount == ucTimeout) {
+		// Power up and initialize the SD card unless a session already has it
+		if (ucSD_SessionOpen() == SD_FAILED) {
 			ucErrorCode = SRC_ID_SDCARD_INIT_FAIL;
 			ucErrorCodePriority = RPT_PRTY_SDCARD_INIT_FAIL;
 //			vSERIAL_sout("SD Init Fail\r\n", 14);
@@ -640,14 +620,13 @@ uchar ucOTA_write_programheader(union DE_Code * ProgramCode)
 //				vSERIAL_sout("SD write fail\r\n", 15);
 			}
 			else {
-				//Power down the SD card and exit
-				vSD_PowerOff();
+				// Leave the card to the session and exit
 				break;
 			}
 		}
 
-		//Power down the SD card
-		vSD_PowerOff();
+		// Power cycle the SD card before the next attempt
+		vSD_SessionClose();
 
 		// Allow time for the voltage to decay
 		vDELAY_LPMWait1us(5000, 1);
@@ -672,8 +651,8 @@ uchar ucOTA_write_programheader(union DE_Code * ProgramCode)
 // Update the SD card address
 		vL2FRAM_IncrementSDCardBlockNum();
 
-// Write the messages in the overflow area to the buffer
-		vL2FRAM_SDCardOvrflowToBuff();
+// Hand the page back to the FRAM buffer
+		vL2FRAM_ReleaseSDCardPage();
 	}
 }
 
@@ -199,6 +199,13 @@ void vPICK_initSSPtbls(
 	}
 	#endif	//End: Debug
 
+	/* ZRO THE Y-BASE & T-BASE TBLS (THEY ARE CONTIGUOUS) IN ONE BURST */
+	vL2SRAM_fillPickTbl(
+				SSP_Y_TBL_BASE_ADDR,
+				(uint)(SSP_T_TBL_END_ADDR_PLUS_1 - SSP_Y_TBL_BASE_ADDR),
+				0
+				);
+
 	for(ucSensorNum=0; ucSensorNum<SENSOR_MAX_VALUE;  ucSensorNum++)
 		{
 		/* GRAB THE Y-TRIGGER DATA FROM FRAM */
@@ -210,11 +217,6 @@ void vPICK_initSSPtbls(
 		uiTrigVal = 7200;				//1800 * 4 = every 2 hours
 		vPICK_putSSP_tblEntry(SSP_DELTA_T_TRIG_TBL_NUM, ucSensorNum, (ulong)uiTrigVal);
 
-
-		/* ZRO THE Y-BASE & T-BASE VALUES */
-		vPICK_putSSP_tblEntry(SSP_Y_TBL_NUM, ucSensorNum, 0UL);
-		vPICK_putSSP_tblEntry(SSP_T_TBL_NUM, ucSensorNum, 0UL);
-
 		}/* END: for(ucSensorNum) */
 
 	#if 0
@@ -27,6 +27,7 @@
 #include "report.h"			//report generator routines
 #include "modopt.h"			//Modify Options routines
 #include "SD_Card.h"
+#include "misc.h"			//byte packing routines
 #include "mem_mod.h"		// Memory module
 #include "task.h"
 #include "comm.h"			// Communications module
@@ -68,6 +69,10 @@ long g_lMessageCount;
 
 struct S_Queue S_RAM_Queue;
 
+//! \var ucaReport_MsgBuff
+//! \brief Reports are built here, they are split into fragments if they do not fit in one packet
+static uchar ucaReport_MsgBuff[MAX_LOGICAL_MSG_SIZE];
+
 /*****************************  CODE STARTS HERE  ****************************/
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -86,6 +91,11 @@ void vReport_RAM_QueueInit(void)
 		S_RAM_Queue.m_ucaQueue[uiCounter] = 0x00;
 	}
 
+	for (uiCounter = 0; uiCounter < QUEUE_SLOTS; uiCounter++)
+	{
+		S_RAM_Queue.m_ucaPriority[uiCounter] = 0x00;
+	}
+
 	// Set message count and pointers to 0
 	S_RAM_Queue.m_uiQueueCount = 0x00;
 	S_RAM_Queue.m_uiQueueHead = 0x00;
@@ -143,6 +153,7 @@ void vReport_LogDataElement(uchar ucPriority)
 	{
 		S_RAM_Queue.m_ucaQueue[S_RAM_Queue.m_uiQueueTail + ucIndex] = ucaMSG_BUFF[ucIndex];
 	}
+	S_RAM_Queue.m_ucaPriority[S_RAM_Queue.m_uiQueueTail / MAX_DE_LEN] = ucPriority;
 
 	// Increment the tail to point to the next free location
 	S_RAM_Queue.m_uiQueueTail = S_RAM_Queue.m_uiQueueTail + MAX_DE_LEN;
@@ -152,11 +163,11 @@ void vReport_LogDataElement(uchar ucPriority)
 		S_RAM_Queue.m_uiQueueCount = (S_RAM_Queue.m_uiQueueTail - S_RAM_Queue.m_uiQueueHead) / MAX_DE_LEN;
 	}
 	else {
-		S_RAM_Queue.m_uiQueueCount = ((QUEUE_SIZE - S_RAM_Queue.m_uiQueueHead) + S_RAM_Queue.m_uiQueueTail) / MAX_DE_LEN;
+		S_RAM_Queue.m_uiQueueCount = ((QUEUE_USED_SIZE - S_RAM_Queue.m_uiQueueHead) + S_RAM_Queue.m_uiQueueTail) / MAX_DE_LEN;
 	}
 
-	//If the RAM queue is too close to the max then reset to the start
-	if (S_RAM_Queue.m_uiQueueTail == QUEUE_SIZE)
+	//If there is no room for another whole slot then reset to the start
+	if (S_RAM_Queue.m_uiQueueTail >= QUEUE_USED_SIZE)
 		S_RAM_Queue.m_uiQueueTail = 0x00;
 
 	// Log in flash if the report is critical
@@ -213,10 +224,54 @@ void vReport_RemoveDEFromRAM(void)
 	// Increment the head to point at the next message
 	S_RAM_Queue.m_uiQueueHead = S_RAM_Queue.m_uiQueueHead + MAX_DE_LEN;
 
-	if (S_RAM_Queue.m_uiQueueHead == QUEUE_SIZE)
+	if (S_RAM_Queue.m_uiQueueHead >= QUEUE_USED_SIZE)
 		S_RAM_Queue.m_uiQueueHead = 0x00;
 
 }
+////////////////////////////////////////////////////////////////////////////////
+//!
+//! \brief Finishes the message sitting in the report buffer
+//!
+//! Every locally built message goes through each stage exactly once: the
+//! header is built, the message is enqueued in SRAM (as fragments if it is
+//! longer than one packet, each with its own CRC) and finally staged in the
+//! FRAM SD card buffer as one record.  The SD card stage rewrites the network
+//! header so it must remain last.
+//!
+//! The message is classed by the highest priority DE it carries so crisis
+//! reports are forwarded ahead of data and data ahead of diagnostics.
+//!
+//! \param ucMsgLength, length of the message from MSG_IDX_ID to the payload end
+//! \param ucMaxPriority, highest priority of the DEs in the message
+//! \return none
+////////////////////////////////////////////////////////////////////////////////
+static void vReport_FinishMsg(uchar ucMsgLength, uchar ucMaxPriority)
+{
+	uint uiMySN;
+	uchar ucMsgFlags;
+
+	ucaReport_MsgBuff[MSG_IDX_LEN] = ucMsgLength; //write the message length
+
+	// Build the operational message header
+	ucMsgFlags = MSG_FLG_SINGLE | MSG_CLASS_DIAG;
+	if (ucMaxPriority >= MAXREPORTPRIORITY)
+		ucMsgFlags = MSG_FLG_SINGLE | MSG_CLASS_CRISIS;
+	else if (ucMaxPriority >= RPT_PRTY_MIN_DATA_CLASS)
+		ucMsgFlags = MSG_FLG_SINGLE | MSG_CLASS_DATA;
+
+	uiMySN = uiL2FRAM_getSnumLo16AsUint();
+	ucaReport_MsgBuff[MSG_IDX_ID] = MSG_ID_OPERATIONAL;
+	ucaReport_MsgBuff[MSG_IDX_FLG] = ucMsgFlags;
+	ucaReport_MsgBuff[MSG_IDX_ADDR_HI] = (uchar) (uiMySN >> 8);
+	ucaReport_MsgBuff[MSG_IDX_ADDR_LO] = (uchar) uiMySN;
+
+	//store the message in SRAM, this numbers the message
+	vComm_Frag_StoreMsg(ucaReport_MsgBuff);
+
+	// Log it on SD card
+	vREPORT_LogMsg(ucaReport_MsgBuff);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 //!
 //! \brief Builds messages from the data elements generated during the slot
@@ -224,6 +279,10 @@ void vReport_RemoveDEFromRAM(void)
 //!				 correctly positioned in memory so when the message is pulled out
 //!				 formatting of DEs is taken care of.
 //!
+//! The DEs are read straight from the RAM queue into the report buffer.  A
+//! message holds as many DEs as fit in MAX_LOGICAL_MSG_SIZE, the link layer
+//! splits it into packets.
+//!
 //! \param none
 //! \return none
 ////////////////////////////////////////////////////////////////////////////////
@@ -231,15 +290,11 @@ void vReport_BuildMsgsFromDEs(void)
 {
 	uint uiNumOfDE;
 	uint uiDECount;
-	uint uiMsgNumber;
-	uchar ucCount;
 	uchar ucDELength;
 	uchar ucMsgLength;
 	uchar ucMsgPtr;
-	uchar ucaTemp[MAX_DE_LEN]; // temporary buffer for storing the DE
-
-	// Clean out the message buffer
-	vSERIAL_CleanBuffer((uchar *)ucaMSG_BUFF);
+	uchar ucDEPriority;
+	uchar ucMaxPriority;
 
 	// Get the number of DEs in RAM  if there are none then exit
 	uiNumOfDE = uiReport_RAM_QueueCount();
@@ -249,70 +304,48 @@ void vReport_BuildMsgsFromDEs(void)
 	// Start the message length at the start of the payload
 	ucMsgLength = MSG_HDR_SZ;
 	ucMsgPtr = MSG_IDX_PAYLD;
+	ucMaxPriority = 0;
 	for(uiDECount=0; uiDECount<uiNumOfDE; uiDECount++)
 	{
-	
-		// if the message is bad
-		if (ucReport_ReadDEFromRAM(ucaTemp) == 0) {
-			// Get the length of the DE and update the message length
-			ucDELength = ucaTemp[0x01];
-			
-			// If the remaining space is less than the length of the DE then store the message
-			if((MAX_MSG_SIZE - (ucMsgLength + NET_HDR_SZ + CRC_SZ)) < ucDELength)
-			{
-				ucaMSG_BUFF[MSG_IDX_LEN] = ucMsgLength; //write the message length
-
-				// Build the operational message header
-				uiMsgNumber = uiComm_incMsgSeqNum();
-				vComm_Msg_buildOperational(MSG_FLG_SINGLE, uiMsgNumber, uiL2FRAM_getSnumLo16AsUint(), MSG_ID_OPERATIONAL);
-
-				ucMsgLength = MSG_HDR_SZ; //reset the message length
-				ucMsgPtr = MSG_IDX_PAYLD;
-
-				// log the report
-				vREPORT_LogReport();
+		// Get the length of the DE at the head of the RAM queue
+		ucDELength = S_RAM_Queue.m_ucaQueue[S_RAM_Queue.m_uiQueueHead + 1];
+		ucDEPriority = S_RAM_Queue.m_ucaPriority[S_RAM_Queue.m_uiQueueHead / MAX_DE_LEN];
 
-				//store the message in SRAM
-				vL2SRAM_storeMsgToSramIfAllowed();
+		// A length past MAX_DE_LEN is a corrupt DE, drop it before it can finish the message
+		if (ucDELength > MAX_DE_LEN)
+		{
+			vReport_RemoveDEFromRAM();
+			continue;
+		}
 
-				// Log it on SD card
-				vREPORT_LogReport();
+		// If the remaining space is less than the length of the DE then finish the current message
+		if(((MAX_LOGICAL_MSG_SIZE - (ucMsgLength + NET_HDR_SZ + CRC_SZ)) < ucDELength) && (ucMsgLength > MSG_HDR_SZ))
+		{
+			vReport_FinishMsg(ucMsgLength, ucMaxPriority);
 
-				// Clean out the message buffer
-				vSERIAL_CleanBuffer((uchar *) ucaMSG_BUFF);
-			}
+			ucMsgLength = MSG_HDR_SZ; //reset the message length
+			ucMsgPtr = MSG_IDX_PAYLD;
+			ucMaxPriority = 0;
+		}
 
-			// Write the DE to the message buffer
-			for(ucCount=0; ucCount<ucDELength; ucCount++)
-				ucaMSG_BUFF[ucMsgPtr + ucCount] = ucaTemp[ucCount];
-			
+		// Write the DE directly into the message buffer, bad DEs are dropped
+		if (ucReport_ReadDEFromRAM(&ucaReport_MsgBuff[ucMsgPtr]) == 0)
+		{
 			// Add the length of the DE to the length of the message
 			ucMsgLength += ucDELength;
 			ucMsgPtr += ucDELength;
+			if (ucDEPriority > ucMaxPriority)
+				ucMaxPriority = ucDEPriority;
+		}
 
-			// Once the DE is written to the MSG_BUFF then remove it from RAM 
-			vReport_RemoveDEFromRAM();
-
-			// If there are no more messages in the Queue then write what we have to SRAM
-			if(uiReport_RAM_QueueCount() == 0)
-			{
-				ucaMSG_BUFF[MSG_IDX_LEN] = ucMsgLength; //write the message length
-
-				// Build the operational message header
-				uiMsgNumber = uiComm_incMsgSeqNum();
-				vComm_Msg_buildOperational(MSG_FLG_SINGLE, uiMsgNumber, uiL2FRAM_getSnumLo16AsUint(), MSG_ID_OPERATIONAL);
-
-				//store the message in SRAM
-				vL2SRAM_storeMsgToSramIfAllowed();
+		// Once the DE is written to the MSG_BUFF then remove it from RAM
+		vReport_RemoveDEFromRAM();
+	}
 
-				// Log to SD card
-				vREPORT_LogReport();
+	// Write what is left to SRAM
+	if(ucMsgLength > MSG_HDR_SZ)
+		vReport_FinishMsg(ucMsgLength, ucMaxPriority);
 
-				// Clean out the message buffer
-				vSERIAL_CleanBuffer((uchar *)ucaMSG_BUFF);
-			}
-		}
-	}
 	// Reset the queue for the next slot
 	vReport_RAM_QueueInit();
 }
@@ -329,17 +362,31 @@ void vReport_BuildMsgsFromDEs(void)
 //! \return none
 ////////////////////////////////////////////////////////////////////////////////
 void vREPORT_LogReport(void)
+{
+	vREPORT_LogMsg(ucaMSG_BUFF);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//!	\fn vREPORT_LogMsg
+//!
+//! \brief Stores a message from any buffer in the FRAM buffers.  Messages put
+//! back together from fragments can be longer than MAX_MSG_SIZE.
+//!
+//! \param p_ucaMsg, the message
+//! \return none
+////////////////////////////////////////////////////////////////////////////////
+void vREPORT_LogMsg(volatile uchar *p_ucaMsg)
 {
 	uchar ucRepLength;
 	S_Task_Ctl S_Task;
 	uchar ucTaskIndex;
 	long lTime;
 
-	ucRepLength = ucaMSG_BUFF[MSG_IDX_LEN] + NET_HDR_SZ;
-
 	// Gaurd in case of message length error
-	if(ucRepLength > MAX_MSG_SIZE)
-		ucRepLength = MAX_MSG_SIZE;
+	if(p_ucaMsg[MSG_IDX_LEN] > (MAX_LOGICAL_MSG_SIZE - NET_HDR_SZ - CRC_SZ))
+		ucRepLength = MAX_LOGICAL_MSG_SIZE - CRC_SZ;
+	else
+		ucRepLength = p_ucaMsg[MSG_IDX_LEN] + NET_HDR_SZ;
 
 	// Get the current time
 	lTime = lTIME_getSysTimeAsLong();
@@ -365,10 +412,14 @@ void vREPORT_LogReport(void)
 	g_lMessageCount++;
 
 	// Write in the SD card address at the network layer
-	vComm_NetPkg_buildHdr(0xFFF0);
-
-	// If writing the report returns 1 then the FRAM buffer is full
-	if (ucL2FRAM_WriteReportToSDCardBuff(ucaMSG_BUFF, ucRepLength) == 1)
+	p_ucaMsg[NET_IDX_DEST_HI] = 0xFF;
+	p_ucaMsg[NET_IDX_DEST_LO] = 0xF0;
+	vL2FRAM_copySnumLo16ToBytes((uchar *) &p_ucaMsg[NET_IDX_SRC_HI]);
+
+	// If writing the report filled a page and enough pages are waiting then
+	// flush them to the SD card as one batch
+	if (ucL2FRAM_WriteReportToSDCardBuff(p_ucaMsg, ucRepLength) == 1
+			&& ucL2FRAM_GetSDCardPagesReady() >= FRAM_SD_CARD_FLUSH_PAGES)
 	{
 		// Get the task index
 		ucTaskIndex = ucTask_FetchTaskIndex(TASK_ID_FRAM_TO_SDCARD);
@@ -413,6 +464,10 @@ void vREPORT_LogReport(void)
 //! not yet reached the database.  In this case we read the most recent block
 //! from the SD card and put it in the message queue.
 //!
+//! If the block the FRAM counter points at is not a log block of the card
+//! (the counter was lost or the card swapped) the newest block is found by
+//! binary search over the block headers instead.
+//!
 //! \param none
 //! \return none
 ////////////////////////////////////////////////////////////////////////////////
@@ -420,21 +475,23 @@ void vReport_LoadSRAMFromSDCard(void)
 {
 	ulong ulAddress;
 	uchar ucMsgIndex;
-	uchar ucBlockIndex;
+	uint uiBlockIndex;
+	uint uiBlockEnd;
 	uchar ucBlock[SD_CARD_BLOCKLEN];
 	uchar ucErrorCode;
 	uchar ucErrorCodePriority;
 	uint uiCount;
 
-	// Get the address of the last block written to
+	// Get the address of the last block written to, skipping an index block
 	ulAddress = ulL2FRAM_GetLastSDCardBlockNum();
+	if (SD_LOG_IS_INDEX(ulAddress, SD_CARD_START_BLOCK))
+		ulAddress--;
 
 	// Assume no errors
 	ucErrorCode = ucErrorCodePriority = 0;
 
-	// Power up the SD card and run the initialization sequence
-	vSD_PowerOn();
-	if (ucSD_Init())
+	// Power up and initialize the SD card unless a session already has it
+	if (ucSD_SessionOpen() == SD_FAILED)
 	{
 		ucErrorCode = SRC_ID_SDCARD_INIT_FAIL;
 		ucErrorCodePriority = RPT_PRTY_SDCARD_INIT_FAIL;
@@ -460,10 +517,23 @@ void vReport_LoadSRAMFromSDCard(void)
 #if 0
 				vSERIAL_sout("SD read fail\r\n", 14);
 #endif
+				vSD_SessionClose();
+			}
+			else if (ucSD_CheckBlock(ucBlock, uiL2FRAM_GetSDVolume()) == SD_FAILED)
+			{
+				// Fall back to searching the card for its newest block
+				ulAddress = ulSD_FindNewestBlock(ucBlock);
+				if (ulAddress != 0 && SD_LOG_IS_INDEX(ulAddress, SD_CARD_START_BLOCK))
+					ulAddress--;
+
+				if (ulAddress < SD_CARD_START_BLOCK || SD_Read_Block(ucBlock, ulAddress) == SD_FAILED)
+				{
+					ucErrorCode = SRC_ID_SDCARD_READ_FAIL;
+					ucErrorCodePriority = RPT_PRTY_SDCARD_READ_FAIL;
+					vSD_SessionClose();
+				}
 			}
 		}
-		//Power down the SD card
-		vSD_PowerOff();
 	}
 
 	// If there was a failure report it
@@ -483,26 +553,52 @@ void vReport_LoadSRAMFromSDCard(void)
 	}
 	else
 	{
-		// Loop through the block and parse out the messages
-		for (ucBlockIndex = 0; ucBlockIndex < SD_CARD_BLOCKLEN;)
+		// Skip the block header and the tail of a message carried over from the previous block
+		uiBlockIndex = SD_BLK_HDR_SZ + ucBlock[SD_BLK_IDX_CARRY];
+
+		// Only the part of the block that was written holds messages
+		uiBlockEnd = uiMISC_buildUintFromBytes(&ucBlock[SD_BLK_IDX_END], NO_NOINT);
+		if (uiBlockEnd > SD_CARD_BLOCKLEN)
+			uiBlockEnd = SD_CARD_BLOCKLEN;
+
+		// Loop through the block and parse out the messages, the report buffer
+		// is free here and holds the messages that were put back together
+		while ((uiBlockIndex + MSG_IDX_PAYLD) <= uiBlockEnd)
 		{
 			// Load the message header
 			for (ucMsgIndex = 0; ucMsgIndex < MSG_IDX_PAYLD;)
 			{
-				ucaMSG_BUFF[ucMsgIndex++] = ucBlock[ucBlockIndex++];
+				ucaReport_MsgBuff[ucMsgIndex++] = ucBlock[uiBlockIndex++];
 			}
 
 			// Exit once all the messages are retrieved or we reach a corrupted message
-			if(ucaMSG_BUFF[MSG_IDX_LEN] == 0 || ucaMSG_BUFF[MSG_IDX_LEN] > MAX_MSG_SIZE)
+			if(ucaReport_MsgBuff[MSG_IDX_LEN] < MSG_HDR_SZ || ucaReport_MsgBuff[MSG_IDX_LEN] > (MAX_LOGICAL_MSG_SIZE - NET_HDR_SZ - CRC_SZ))
+				return;
+
+			// A message that continues in the next block cannot be recovered from this one
+			if ((uiBlockIndex + ucaReport_MsgBuff[MSG_IDX_LEN] + NET_HDR_SZ - MSG_IDX_PAYLD) > uiBlockEnd)
 				return;
 
-			// once the header is acquired we know the message size so read the rest of the message
-			while (ucMsgIndex < ucaMSG_BUFF[MSG_IDX_LEN])
+			// once the header is acquired we know the message size so read the rest of the
+			// message, the length field does not count the network header
+			while (ucMsgIndex < (ucaReport_MsgBuff[MSG_IDX_LEN] + NET_HDR_SZ))
+			{
+				ucaReport_MsgBuff[ucMsgIndex++] = ucBlock[uiBlockIndex++];
+			}
+
+			// Messages too long for one packet are split into fragments again
+			if ((ucaReport_MsgBuff[MSG_IDX_LEN] + NET_HDR_SZ + CRC_SZ) > MAX_MSG_SIZE)
 			{
-				ucaMSG_BUFF[ucMsgIndex++] = ucBlock[ucBlockIndex++];
+				vComm_Frag_StoreMsg(ucaReport_MsgBuff);
+				continue;
 			}
 
-			// Write the message to SRAM
+			// Write the message to SRAM, the card holds no CRC so it is computed again
+			for (ucMsgIndex = 0; ucMsgIndex < (ucaReport_MsgBuff[MSG_IDX_LEN] + NET_HDR_SZ); ucMsgIndex++)
+			{
+				ucaMSG_BUFF[ucMsgIndex] = ucaReport_MsgBuff[ucMsgIndex];
+			}
+			ucCRC16_compute_msg_CRC(CRC_FOR_MSG_TO_SEND, ucaMSG_BUFF, ucaMSG_BUFF[MSG_IDX_LEN] + NET_HDR_SZ + CRC_SZ); //lint !e534 //compute the CRC
 			vL2SRAM_storeMsgToSram();
 		}
 	}
@@ -12,6 +12,8 @@
 #ifndef REPORT_H_INCLUDED
  #define REPORT_H_INCLUDED
 
+#include "task.h"			//MAX_DE_LEN
+
 /* COPY TO SRAM FLAGS */
 #define YES_COPY_TO_SRAM 1
 #define  NO_COPY_TO_SRAM 0
@@ -24,11 +26,20 @@
 //! \brief The maximum number of messages in the queue
 #define	MAX_NUM_MSGS 	QUEUE_SIZE/MAX_MSG_SIZE
 
+//! \def QUEUE_SLOTS
+//! \brief The number of data element slots in the queue
+#define	QUEUE_SLOTS		(QUEUE_SIZE/MAX_DE_LEN)
+
+//! \def QUEUE_USED_SIZE
+//! \brief The part of the queue covered by whole slots, the queue wraps here
+#define	QUEUE_USED_SIZE	(QUEUE_SLOTS * MAX_DE_LEN)
+
 //! \struct S_Queue
 //! \brief Structure holds all information about a queue
 struct S_Queue
 {
 		uchar m_ucaQueue[QUEUE_SIZE];		//!< The queue
+		uchar m_ucaPriority[QUEUE_SLOTS];	//!< The priority of the DE in each slot
 		uint	m_uiQueueHead;						//!< The starting location in the queue
 		uint 	m_uiQueueTail;						//!< The ending location in the queue
 		uint	m_uiQueueCount;						//!< The number of messages in the queue
@@ -175,6 +186,9 @@ struct S_Queue
 //! \def DEFAULTREPORTINGPRIORITY
 //! \brief The default setting for reporting priority
 #define DEFAULTREPORTINGPRIORITY	0
+//! \def RPT_PRTY_MIN_DATA_CLASS
+//! \brief Lowest priority stored and forwarded as data, lower priorities are diagnostics
+#define RPT_PRTY_MIN_DATA_CLASS		4
 //! \def RPT_PRTY_INPUT_VOLTAGE_LOW
 //! \brief Priorirty of data element that indicates the source voltage is too low
 #define RPT_PRTY_INPUT_VOLTAGE_LOW		5
@@ -309,6 +323,7 @@ uchar ucReport_ReadDEFromRAM(uchar *p_ucaBuff);
 void vReport_RemoveDEFromRAM(void);
 uint uiReport_RAM_QueueCount(void);
 void vREPORT_LogReport(void);
+void vREPORT_LogMsg(volatile uchar *p_ucaMsg);
 void vReport_LogDataElement(unsigned char ucPriority);
 void vReport_BuildMsgsFromDEs(void);
 
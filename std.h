@@ -14,7 +14,9 @@
 
 #define DEBUG
 
-	#define NULL			0
+	#ifndef NULL
+	  #define NULL			0
+	#endif
 	
 	#define TRUE 			1
 	#define FALSE 			0
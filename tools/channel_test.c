@@ -0,0 +1,301 @@
+///////////////////////////////////////////////////////////////////////////////
+//! \file channel_test.c
+//! \brief Host test of the data channel a link is run on
+//!
+//! comm_module/LNKBLK.C is included below so the link block table of each
+//! end of a link can be saved and loaded around each call, rand.c is linked
+//! as it is.  Every run gives the ends A and B the same link seed, as the
+//! join does, among a random number of links to other nodes.  Each frame
+//! both ends roll the seed as vRTS_scheduleLinkSlot() does and compute a
+//! random link with ucLNKBLK_computeTimeForSingleLnk() and
+//! ucLNKBLK_ComputeChannel(), the way vComm_SetChannel() does at that time.
+//!
+//! Both ends must get the same link time and the same channel, and a link
+//! the table does not hold must get no channel.  Over all runs every channel
+//! must be used about as often as the others, and links of different runs
+//! in the same slot, which stand for neighbouring pairs, may only share a
+//! channel about 1 time in LNK_DATA_CHANNELS.
+//!
+//! Build and run (from the repository root):
+//!
+//!     cc -std=gnu99 -O2 -Wall -Wextra -Itools/commsim/host -I. -Ihal -Idrivers -Imem_mod -Icomm_module -ITasks -o channel_test tools/channel_test.c rand.c
+//!     ./channel_test [seed]
+//!
+//! The exit status is 1 if a check failed.
+///////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "LNKBLK.C"
+
+//! \def TEST_RUNS
+//! \def TEST_FRAMES
+//! \brief Runs from a new link and frames per run
+#define TEST_RUNS			4000
+#define TEST_FRAMES			20
+
+//! \def TEST_SPREAD_PCT
+//! \brief How far in percent a channel may be from its share of the links
+#define TEST_SPREAD_PCT		15
+
+//! \def TEST_SHARE_PCT
+//! \brief Most links in percent that may share the channel of a neighbour
+//! in the same slot, 1 in LNK_DATA_CHANNELS is about 6
+#define TEST_SHARE_PCT		9
+
+//! \def TEST_SEED_MASK
+//! \brief Link seeds are 24 bits
+#define TEST_SEED_MASK		0x00FFFFFFUL
+
+volatile uint8 ucRAND_NUM[RAND_NUM_SIZE];
+
+uint uiGLOB_lostROM2connections;
+uint uiGLOB_lostSOM2connections;
+uint uiGLOB_ROM2attempts;
+uint uiGLOB_SOM2attempts;
+uint uiGLOB_TotalSDC4trys;
+uint uiGLOB_TotalRTJ_attempts;
+
+// The link block table of each end
+static unsigned char ucaTest_LinkA[sizeof(S_Link)];
+static unsigned char ucaTest_LinkB[sizeof(S_Link)];
+
+static unsigned int uiFailCount;
+static unsigned long ulRandState;
+
+static unsigned long ulTest_Random(void)
+{
+	ulRandState ^= ulRandState << 13;
+	ulRandState ^= ulRandState >> 17;
+	ulRandState ^= ulRandState << 5;
+	ulRandState &= 0xFFFFFFFFUL;
+	return ulRandState;
+}
+
+static void vTest_Check(int iOk, const char *cpWhat, unsigned int uiRun, unsigned int uiFrame)
+{
+	if (iOk)
+		return;
+
+	if (uiFailCount < 10)
+		printf("FAIL %s run %u frame %u\n", cpWhat, uiRun, uiFrame);
+	uiFailCount++;
+}
+
+/*****************************  FIRMWARE STUBS  ******************************/
+
+// As time.c computes them
+long lTIME_getFrameNumFromTime(long lTime)
+{
+	return (lTime / SECS_PER_SLOT_L) / SLOTS_PER_FRAME_I;
+}
+
+long lTIME_getSlotNumFromTime(long lTime)
+{
+	return (lTime / SECS_PER_SLOT_L) % SLOTS_PER_FRAME_I;
+}
+
+uchar ucMODOPT_readSingleRamOptionBit(uchar ucOptionIdxPair)
+{
+	(void) ucOptionIdxPair;
+	return 0;
+}
+
+uint uiL2FRAM_getSnumLo16AsUint(void) { return 0; }
+uint uiL2SRAM_getMsgCount(void) { return 0; }
+uint32 uslADF7020_GetRandomNoise(void) { return 0; }
+void vADF7020_Quit(void) { }
+void vADF7020_WakeUp(void) { }
+void vBUZ_raspberry(void) { }
+void vDELAY_wait100usTic(unsigned int uiCount) { (void) uiCount; }
+void vSIM_LowPowerMode(void) { }
+void vSERIAL_HB8out(uchar ucByte) { (void) ucByte; }
+void vSERIAL_I16out(int iVal) { (void) iVal; }
+void vSERIAL_UI16out(uint16 uiInt) { (void) uiInt; }
+void vSERIAL_UI32out(unsigned long ulVal) { (void) ulVal; }
+void vSERIAL_UI8out(uchar ucVal) { (void) ucVal; }
+void vSERIAL_UIV8out(uchar ucVal) { (void) ucVal; }
+void vSERIAL_bout(uchar ucChar) { (void) ucChar; }
+void vSERIAL_crlf(void) { }
+void vSERIAL_sout(char *cStrPtr, uint uiLength) { (void) cStrPtr; (void) uiLength; }
+void vTIME_showTime(long lTime, uchar ucTimeFormFlag, uchar ucCRLF_flag)
+{
+	(void) lTime;
+	(void) ucTimeFormFlag;
+	(void) ucCRLF_flag;
+}
+
+/*****************************  TEST HARNESS  ********************************/
+
+static uint uiTest_SerialNum(void)
+{
+	uint uiSn;
+
+	do
+		uiSn = (uint) (ulTest_Random() & 0xFFFF);
+	while (uiSn == 0 || uiSn == 0xFFFF);
+	return uiSn;
+}
+
+static ulong ulTest_Seed(void)
+{
+	ulong ulSeed;
+
+	do
+		ulSeed = ulTest_Random() & TEST_SEED_MASK;
+	while (ulSeed == 0 || ulSeed == TEST_SEED_MASK);
+	return ulSeed;
+}
+
+// A table with the link to uiPeer and links to a few other nodes around it
+static void vTest_NewTable(unsigned char *ucpTbl, uint uiPeer, ulong ulSeed)
+{
+	uchar ucOthers;
+	uchar ucPeerAt;
+	uchar ucii;
+	uchar ucIdx;
+	uint uiSn;
+
+	vLNKBLK_zeroEntireLnkBlkTbl();
+	ucOthers = (uchar) (ulTest_Random() % MAX_LINKS);
+	ucPeerAt = (uchar) (ulTest_Random() % (ucOthers + 1));
+	for (ucii = 0; ucii <= ucOthers; ucii++)
+	{
+		if (ucii == ucPeerAt)
+		{
+			ucLNKBLK_AddLink(uiPeer);
+			ucLNKBLK_WriteRand(uiPeer, ulSeed);
+			continue;
+		}
+
+		do
+			uiSn = uiTest_SerialNum();
+		while (uiSn == uiPeer || ucLNKBLK_GetLinkIndex(uiSn, &ucIdx) == LNKMNGR_OK);
+		ucLNKBLK_AddLink(uiSn);
+		ucLNKBLK_WriteRand(uiSn, ulTest_Seed());
+	}
+	memcpy(ucpTbl, S_Link, sizeof(S_Link));
+}
+
+// One end rolls the link seed for the frame and computes the link, 0 if it failed
+static int iTest_Link(unsigned char *ucpTbl, uint uiPeer, uchar ucLnkReq, long lBaseTime, ulong *ulpTime,
+		uchar *ucpChannel)
+{
+	ulong ulSeed;
+	int iOk;
+
+	memcpy(S_Link, ucpTbl, sizeof(S_Link));
+
+	ulSeed = 0;
+	iOk = ucLNKBLK_ReadRand(uiPeer, &ulSeed) == LNKMNGR_OK;
+	ucLNKBLK_WriteRand(uiPeer, uslRAND_getRolledFullForeignSeed(ulSeed));
+	iOk = iOk && ucLNKBLK_computeTimeForSingleLnk(uiPeer, ucLnkReq, lBaseTime, ulpTime) == LNKMNGR_OK;
+	iOk = iOk && ucLNKBLK_ComputeChannel(uiPeer, (long) *ulpTime, ucpChannel) == LNKMNGR_OK;
+
+	memcpy(ucpTbl, S_Link, sizeof(S_Link));
+	return iOk;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int uiRun;
+	unsigned int uiFrame;
+	unsigned int uiLinks;
+	unsigned int uiPairs;
+	unsigned int uiShared;
+	unsigned int uiaChanCount[LNK_DATA_CHANNELS];
+	int iaSlotChannel[SLOTS_PER_FRAME_I];
+	uint uiSnA;
+	uint uiSnB;
+	uint uiSlot;
+	ulong ulSeed;
+	ulong ulTimeA;
+	ulong ulTimeB;
+	uchar ucChanA;
+	uchar ucChanB;
+	uchar ucLnkReq;
+	long lBaseTime;
+	int iOkA;
+	int iOkB;
+
+	ulRandState = 0x2545F491UL;
+	if (argc > 1)
+		ulRandState = strtoul(argv[1], NULL, 0) | 1;
+
+	uiLinks = 0;
+	uiPairs = 0;
+	uiShared = 0;
+	memset(uiaChanCount, 0, sizeof(uiaChanCount));
+	memset(iaSlotChannel, -1, sizeof(iaSlotChannel));
+
+	for (uiRun = 0; uiRun < TEST_RUNS; uiRun++)
+	{
+		uiSnA = uiTest_SerialNum();
+		do
+			uiSnB = uiTest_SerialNum();
+		while (uiSnB == uiSnA);
+
+		ulSeed = ulTest_Seed();
+		vTest_NewTable(ucaTest_LinkA, uiSnB, ulSeed);
+		vTest_NewTable(ucaTest_LinkB, uiSnA, ulSeed);
+
+		lBaseTime = (long) (ulTest_Random() % 100000UL) * SECS_PER_FRAME_L;
+		for (uiFrame = 0; uiFrame < TEST_FRAMES; uiFrame++)
+		{
+			lBaseTime += SECS_PER_FRAME_L;
+			ucLnkReq = (uchar) (((1 + ulTest_Random() % MAX_LNK_DIST_IN_FRAMES) << 3) | (1 + ulTest_Random() % LNK_MAX_LINKS));
+
+			ucChanA = LNK_DATA_CHANNELS;
+			ucChanB = LNK_DATA_CHANNELS;
+			ulTimeA = 0;
+			ulTimeB = 0;
+			iOkA = iTest_Link(ucaTest_LinkA, uiSnB, ucLnkReq, lBaseTime, &ulTimeA, &ucChanA);
+			iOkB = iTest_Link(ucaTest_LinkB, uiSnA, ucLnkReq, lBaseTime, &ulTimeB, &ucChanB);
+			vTest_Check(iOkA && iOkB, "link", uiRun, uiFrame);
+			vTest_Check(ulTimeA == ulTimeB, "time", uiRun, uiFrame);
+			vTest_Check(ucChanA == ucChanB, "channel", uiRun, uiFrame);
+			if (ucChanA >= LNK_DATA_CHANNELS)
+			{
+				vTest_Check(0, "channel range", uiRun, uiFrame);
+				continue;
+			}
+
+			uiLinks++;
+			uiaChanCount[ucChanA]++;
+
+			// The link of the run before in the same slot is a neighbouring pair
+			uiSlot = (uint) lTIME_getSlotNumFromTime((long) ulTimeA);
+			if (iaSlotChannel[uiSlot] >= 0)
+			{
+				uiPairs++;
+				if (iaSlotChannel[uiSlot] == ucChanA)
+					uiShared++;
+			}
+			iaSlotChannel[uiSlot] = ucChanA;
+		}
+
+		// No channel for a node the table does not hold
+		memcpy(S_Link, ucaTest_LinkA, sizeof(S_Link));
+		do
+			uiSnB = uiTest_SerialNum();
+		while (ucLNKBLK_GetLinkIndex(uiSnB, &ucChanB) == LNKMNGR_OK);
+		vTest_Check(ucLNKBLK_ComputeChannel(uiSnB, lBaseTime, &ucChanA) == LNKMNGR_ERR, "no link", uiRun, 0);
+	}
+
+	for (ucChanA = 0; ucChanA < LNK_DATA_CHANNELS; ucChanA++)
+	{
+		vTest_Check(uiaChanCount[ucChanA] * LNK_DATA_CHANNELS * 100 > uiLinks * (100 - TEST_SPREAD_PCT)
+				&& uiaChanCount[ucChanA] * LNK_DATA_CHANNELS * 100 < uiLinks * (100 + TEST_SPREAD_PCT), "spread",
+				ucChanA, 0);
+	}
+	vTest_Check(uiPairs != 0 && uiShared * 100 < uiPairs * TEST_SHARE_PCT, "shared", uiShared, uiPairs);
+
+	if (uiFailCount != 0) {
+		printf("%u checks failed\n", uiFailCount);
+		return 1;
+	}
+
+	printf("all checks passed\n");
+	return 0;
+}
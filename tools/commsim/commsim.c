@@ -0,0 +1,1070 @@
+///////////////////////////////////////////////////////////////////////////////
+//! \file commsim.c
+//! \brief Discrete-event simulator of a network of nodes running the comm stack
+//!
+//! Every node is a process that runs the firmware's comm, routing, link
+//! block, scheduler, task and memory modules unchanged on top of the shims
+//! in this directory.  This file is the coordinator: it places the nodes,
+//! starts them, always resumes the node with the earliest wake time and
+//! plays the shared radio channel between them.  A node runs on its own up
+//! to its horizon, the next time another node can do anything, so a quiet
+//! network costs a few context switches per node and slot.
+//!
+//! The channel is the ADF7020 at 19200 baud.  Received power is log-distance
+//! path loss with fixed shadowing per link and fading per packet.  A
+//! receiver locks onto the first packet on its channel that is above the
+//! sensitivity and still in its preamble when it is armed or the packet
+//! starts.  A second packet on the channel that is not at least the capture
+//! ratio weaker destroys it (the CRC fails).  Node clocks run fast or slow
+//! by a fixed error and the nodes power up at random times.
+//!
+//! At the end the node table is printed: level, parent, join time, the
+//! messages each node generated and the hub logged, their latency, radio
+//! duty cycle and the SRAM backlog.
+//!
+//! Build (from the repository root):
+//!
+//!     cc -std=gnu99 -O2 -Wall -Wextra -DCRC_HOST_BUILD -Itools/commsim/host
+//!        -Itools/commsim -I. -Ihal -Idrivers -Imem_mod -Icomm_module -ITasks
+//!        -o commsim -x c tools/commsim/*.c comm_module/comm_discovery.c
+//!        comm_module/comm_opmode.c comm_module/LNKBLK.C comm_module/comm_routing.c
+//!        comm_module/comm_utilities.c comm_module/comm_frag.c comm_module/crc.c
+//!        Tasks/rts.c Tasks/task_manager.c mem_mod/L2Sram.c mem_mod/L2fram.c
+//!        rand.c gid.c misc.c daytime.c time.c delay.c bigsub.c -x none -lm
+//!
+//! (all on one line; "-x c" because LNKBLK.C would be taken for C++)
+//!
+//! The shims in this directory build without warnings.  The ones left come
+//! from the firmware modules, which the simulator runs unchanged.
+//!
+//! Usage:
+//!
+//!     commsim [-n NODES] [-t SECONDS] [-s SEED] [-r MSG_PER_MIN] [-p BYTES]
+//!             [-a METERS] [-f TOPOLOGY] [-d PPM] [-b SECONDS] [-l LOSS]
+//!             [-w DB] [-F DB] [-T SN] [-v]
+//!
+//!     -n  nodes including the hub (10)
+//!     -t  simulated seconds (3600)
+//!     -s  seed of the topology, clocks and channel (1)
+//!     -r  messages generated per minute by every node but the hub (1)
+//!     -p  payload bytes of a generated message, 14 to 200 (20)
+//!     -a  side of the square the nodes are placed in (300 m * sqrt(NODES / 10))
+//!     -f  topology file, one "X Y" in meters per line, the hub first
+//!     -d  largest crystal error, each node gets a random one within +-PPM (20)
+//!     -b  the nodes but the hub power up within this many seconds (10)
+//!     -l  chance that a packet is lost on any link regardless of its power (0)
+//!     -w  shadowing sigma per link (4 dB)
+//!     -F  fading sigma per packet (2 dB)
+//!     -T  print the serial output of node SN, may be repeated
+//!     -v  print progress every simulated minute
+///////////////////////////////////////////////////////////////////////////////
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <math.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "commsim.h"
+
+/* RADIO */
+#define SIM_BAUD				19200LL
+#define SIM_PREAMBLE_BYTES		7		//!< ADF7020_PREAMBLE_BYTE_COUNT
+#define SIM_TX_DBM				10.0
+#define SIM_PL0_DB				40.0	//!< Path loss at 1 m, 900 MHz
+#define SIM_PL_EXP				3.0
+#define SIM_SENSITIVITY_DBM		-105.0
+#define SIM_CAPTURE_DB			6.0
+
+/* ROLES (OPTION BYTE 0) */
+#define SIM_ROLE_HUB			2		//!< Receive only
+#define SIM_ROLE_RELAY			3		//!< Send and receive
+
+//! \def SIM_WATCHDOG_SEC
+//! \brief Wall clock seconds a node may run without answering
+#define SIM_WATCHDOG_SEC		60
+
+//! Time a packet of iLen bytes after the preamble spends on the air
+#define SIM_AIRTIME(iLen)		((((simtime_t) SIM_PREAMBLE_BYTES + (iLen)) * 8 * SIM_NS_PER_SEC) / SIM_BAUD)
+
+//! \struct S_SimTx
+//! \brief A packet on the air
+typedef struct
+{
+	int iSrc;
+	int iChannel;
+	simtime_t tStart;
+	simtime_t tSync;
+	simtime_t tEnd;
+	int iLen;
+	unsigned char ucaData[SIM_MAX_PKT];
+} S_SimTx;
+
+//! \struct S_SimNode
+//! \brief The coordinator's view of a node
+typedef struct
+{
+	S_SimNodeCfg Cfg;
+	pid_t iPid;
+	int iFd;
+	double dX;
+	double dY;
+
+	simtime_t tUntil;			//!< Wake time of its WAIT
+
+	/* RECEIVER */
+	int iRxState;					//!< SIM_RX_OFF or SIM_RX_ARMED
+	int iRxChannel;
+	int iLocked;					//!< On a packet that has not ended
+	int iSyncSent;
+	int iCorrupt;
+	int iLockSrc;
+	double dLockDBm;
+	simtime_t tSync;
+	simtime_t tDone;
+	int iLockLen;
+	unsigned char ucaLockData[SIM_MAX_PKT];
+
+	/* WHAT THE HUB LOGGED FROM THIS NODE */
+	unsigned long ulDelivered;
+	unsigned long ulDuplicates;
+	double *p_dLatency;
+	unsigned long ulLatencyCap;
+	unsigned char *p_ucSeen;
+	unsigned long ulSeenCap;
+
+	S_SimStats Stats;
+	int iHaveStats;
+} S_SimNode;
+
+static S_SimNode *S_pNodes;
+static int iNodes;
+static double *p_dLinkDBm;		//!< Mean received power, iNodes x iNodes
+static S_SimTx *S_pTx;				//!< Packets that have not ended
+static int iTxCount;
+static int iTxCap;
+
+/* PARAMETERS */
+static simtime_t tSimEnd;
+static double dLossProb;
+static double dFadeSigma;
+
+/* COUNTERS */
+static unsigned long ulAirPkts;
+static unsigned long ulLocks;
+static unsigned long ulCollisions;
+static unsigned long ulFaded;
+static unsigned long long ullSwitches;
+
+static unsigned long long ullRand;
+
+/****************************  HELPERS  **************************************/
+
+static void vDie(const char *p_cMsg)
+{
+	int i;
+
+	fprintf(stderr, "commsim: %s\n", p_cMsg);
+	for (i = 0; i < iNodes; i++)
+		if (S_pNodes[i].iPid > 0)
+			kill(S_pNodes[i].iPid, SIGKILL);
+	exit(1);
+}
+
+static void vWatchdog(int iSig)
+{
+	static const char cMsg[] = "commsim: a node stopped answering, giving up\n";
+	int i;
+
+	(void) iSig;
+	if (write(2, cMsg, sizeof(cMsg) - 1) < 0)
+		iSig = 0;
+	for (i = 0; i < iNodes; i++)
+		if (S_pNodes[i].iPid > 0)
+			kill(S_pNodes[i].iPid, SIGKILL);
+	_exit(1);
+}
+
+static void *p_vAlloc(size_t uiSize)
+{
+	void *p_v;
+
+	p_v = calloc(1, uiSize);
+	if (p_v == NULL)
+		vDie("out of memory");
+	return p_v;
+}
+
+//! xorshift64*, the coordinator's own random numbers
+static unsigned long long ullRandom(void)
+{
+	ullRand ^= ullRand >> 12;
+	ullRand ^= ullRand << 25;
+	ullRand ^= ullRand >> 27;
+	return ullRand * 2685821657736338717ULL;
+}
+
+//! Uniform in [0, 1)
+static double dUniform(void)
+{
+	return (double) (ullRandom() >> 11) / 9007199254740992.0;
+}
+
+//! Standard normal (Box-Muller)
+static double dGauss(void)
+{
+	double dU1;
+
+	dU1 = dUniform();
+	if (dU1 < 1e-300)
+		dU1 = 1e-300;
+	return sqrt(-2.0 * log(dU1)) * cos(2.0 * M_PI * dUniform());
+}
+
+static double dSeconds(simtime_t t)
+{
+	return (double) t / (double) SIM_NS_PER_SEC;
+}
+
+/******************************  IPC  ****************************************/
+
+//! A node closed its socket, says how it ended
+static void vNodeDied(S_SimNode *p_Node)
+{
+	char cMsg[64];
+	int iStatus;
+
+	iStatus = 0;
+	waitpid(p_Node->iPid, &iStatus, 0);
+	p_Node->iPid = 0;
+	if (WIFSIGNALED(iStatus))
+		snprintf(cMsg, sizeof(cMsg), "node %u died of signal %d", p_Node->Cfg.uiSN, WTERMSIG(iStatus));
+	else
+		snprintf(cMsg, sizeof(cMsg), "node %u exited with %d", p_Node->Cfg.uiSN, WEXITSTATUS(iStatus));
+	vDie(cMsg);
+}
+
+static void vRead(S_SimNode *p_Node, void *p_vBuf, size_t uiLen)
+{
+	char *p_cBuf = p_vBuf;
+	ssize_t iDone;
+
+	while (uiLen) {
+		iDone = read(p_Node->iFd, p_cBuf, uiLen);
+		if (iDone < 0 && errno == EINTR)
+			continue;
+		if (iDone <= 0)
+			vNodeDied(p_Node);
+		p_cBuf += iDone;
+		uiLen -= (size_t) iDone;
+	}
+}
+
+static void vWrite(S_SimNode *p_Node, const void *p_vBuf, size_t uiLen)
+{
+	const char *p_cBuf = p_vBuf;
+	ssize_t iDone;
+
+	while (uiLen) {
+		iDone = write(p_Node->iFd, p_cBuf, uiLen);
+		if (iDone < 0 && errno == EINTR)
+			continue;
+		if (iDone <= 0)
+			vNodeDied(p_Node);
+		p_cBuf += iDone;
+		uiLen -= (size_t) iDone;
+	}
+}
+
+//! Reads one request, the data only comes with a transmission
+static void vReadReq(S_SimNode *p_Node, S_SimReq *p_Req)
+{
+	vRead(p_Node, p_Req, offsetof(S_SimReq, ucaData));
+	if (p_Req->iType == SIM_REQ_TX)
+		vRead(p_Node, p_Req->ucaData, sizeof(p_Req->ucaData));
+}
+
+/***************************  TOPOLOGY  **************************************/
+
+static void vLoadTopology(const char *p_cPath)
+{
+	FILE *p_File;
+	char cLine[256];
+	double dX;
+	double dY;
+	int iCap;
+
+	p_File = fopen(p_cPath, "r");
+	if (p_File == NULL) {
+		perror(p_cPath);
+		exit(1);
+	}
+
+	iCap = 0;
+	iNodes = 0;
+	while (fgets(cLine, sizeof(cLine), p_File) != NULL) {
+		if (cLine[0] == '#' || sscanf(cLine, "%lf %lf", &dX, &dY) != 2)
+			continue;
+		if (iNodes == iCap) {
+			iCap = iCap ? iCap * 2 : 64;
+			S_pNodes = realloc(S_pNodes, (size_t) iCap * sizeof(S_SimNode));
+			if (S_pNodes == NULL)
+				vDie("out of memory");
+		}
+		memset(&S_pNodes[iNodes], 0, sizeof(S_SimNode));
+		S_pNodes[iNodes].dX = dX;
+		S_pNodes[iNodes].dY = dY;
+		iNodes++;
+	}
+	fclose(p_File);
+
+	if (iNodes < 2 || iNodes > SIM_MAX_NODES)
+		vDie("the topology needs 2 to SIM_MAX_NODES nodes");
+}
+
+//! The hub in the middle of the square, the others anywhere in it
+static void vPlaceNodes(double dSide)
+{
+	int i;
+
+	S_pNodes = p_vAlloc((size_t) iNodes * sizeof(S_SimNode));
+	for (i = 1; i < iNodes; i++) {
+		S_pNodes[i].dX = dUniform() * dSide;
+		S_pNodes[i].dY = dUniform() * dSide;
+	}
+	S_pNodes[0].dX = dSide / 2.0;
+	S_pNodes[0].dY = dSide / 2.0;
+}
+
+//! Mean received power of every link, symmetric
+static void vComputeLinks(double dShadowSigma)
+{
+	double dDist;
+	double dDBm;
+	int i;
+	int j;
+
+	p_dLinkDBm = p_vAlloc((size_t) iNodes * (size_t) iNodes * sizeof(double));
+	for (i = 0; i < iNodes; i++) {
+		for (j = i + 1; j < iNodes; j++) {
+			dDist = hypot(S_pNodes[i].dX - S_pNodes[j].dX, S_pNodes[i].dY - S_pNodes[j].dY);
+			if (dDist < 1.0)
+				dDist = 1.0;
+			dDBm = SIM_TX_DBM - SIM_PL0_DB - 10.0 * SIM_PL_EXP * log10(dDist) + dShadowSigma * dGauss();
+			p_dLinkDBm[i * iNodes + j] = dDBm;
+			p_dLinkDBm[j * iNodes + i] = dDBm;
+		}
+		p_dLinkDBm[i * iNodes + i] = -1000.0;
+	}
+}
+
+/*****************************  CHANNEL  *************************************/
+
+//! Drops the packets that have ended before t
+static void vExpireTx(simtime_t t)
+{
+	int i;
+	int j;
+
+	for (i = 0, j = 0; i < iTxCount; i++)
+		if (S_pTx[i].tEnd > t)
+			S_pTx[j++] = S_pTx[i];
+	iTxCount = j;
+}
+
+//! Is another packet on the air strong enough to destroy one at dDBm
+static int iInterfered(int iRx, int iChannel, int iExclude, double dDBm, simtime_t t)
+{
+	int i;
+
+	for (i = 0; i < iTxCount; i++) {
+		if (S_pTx[i].iSrc == iExclude || S_pTx[i].iSrc == iRx || S_pTx[i].iChannel != iChannel)
+			continue;
+		if (S_pTx[i].tStart > t || S_pTx[i].tEnd <= t)
+			continue;
+		if (p_dLinkDBm[S_pTx[i].iSrc * iNodes + iRx] > dDBm - SIM_CAPTURE_DB)
+			return 1;
+	}
+	return 0;
+}
+
+//! Tries to lock receiver iRx onto a packet from iSrc
+static int iTryLock(int iRx, const S_SimTx *p_Tx, simtime_t t)
+{
+	S_SimNode *p_Node = &S_pNodes[iRx];
+	double dDBm;
+
+	dDBm = p_dLinkDBm[p_Tx->iSrc * iNodes + iRx];
+	if (dDBm < SIM_SENSITIVITY_DBM - 4.0 * dFadeSigma)
+		return 0;
+	dDBm += dFadeSigma * dGauss();
+	if (dDBm < SIM_SENSITIVITY_DBM) {
+		ulFaded++;
+		return 0;
+	}
+	if (dLossProb > 0.0 && dUniform() < dLossProb) {
+		ulFaded++;
+		return 0;
+	}
+
+	p_Node->iLocked = 1;
+	p_Node->iSyncSent = 0;
+	p_Node->iLockSrc = p_Tx->iSrc;
+	p_Node->dLockDBm = dDBm;
+	p_Node->tSync = p_Tx->tSync;
+	p_Node->tDone = p_Tx->tEnd;
+	p_Node->iLockLen = p_Tx->iLen;
+	memcpy(p_Node->ucaLockData, p_Tx->ucaData, (size_t) p_Tx->iLen);
+	p_Node->iCorrupt = iInterfered(iRx, p_Tx->iChannel, p_Tx->iSrc, dDBm, t);
+	ulLocks++;
+	return 1;
+}
+
+//! A packet goes on the air
+static void vStartTx(int iSrc, const S_SimReq *p_Req)
+{
+	S_SimTx *p_Tx;
+	S_SimNode *p_Node;
+	int iLen;
+	int i;
+
+	iLen = p_Req->iLen;
+	if (iLen < 0)
+		iLen = 0;
+	if (iLen > SIM_MAX_PKT)
+		iLen = SIM_MAX_PKT;
+
+	vExpireTx(p_Req->tNow);
+	if (iTxCount == iTxCap) {
+		iTxCap = iTxCap ? iTxCap * 2 : 64;
+		S_pTx = realloc(S_pTx, (size_t) iTxCap * sizeof(S_SimTx));
+		if (S_pTx == NULL)
+			vDie("out of memory");
+	}
+	p_Tx = &S_pTx[iTxCount++];
+	p_Tx->iSrc = iSrc;
+	p_Tx->iChannel = p_Req->iChannel;
+	p_Tx->tStart = p_Req->tNow;
+	p_Tx->tSync = p_Req->tNow + SIM_AIRTIME(0);
+	p_Tx->tEnd = p_Req->tNow + SIM_AIRTIME(iLen);
+	p_Tx->iLen = iLen;
+	memcpy(p_Tx->ucaData, p_Req->ucaData, (size_t) iLen);
+	ulAirPkts++;
+
+	/* THE TRANSMITTER CAN'T HEAR */
+	S_pNodes[iSrc].iRxState = SIM_RX_OFF;
+	S_pNodes[iSrc].iLocked = 0;
+
+	for (i = 0; i < iNodes; i++) {
+		if (i == iSrc)
+			continue;
+		p_Node = &S_pNodes[i];
+
+		/* A PACKET IN PROGRESS MAY BE DESTROYED */
+		if (p_Node->iLocked && p_Node->iRxChannel == p_Tx->iChannel) {
+			if (!p_Node->iCorrupt && p_dLinkDBm[iSrc * iNodes + i] > p_Node->dLockDBm - SIM_CAPTURE_DB) {
+				p_Node->iCorrupt = 1;
+				ulCollisions++;
+			}
+			continue;
+		}
+
+		if (p_Node->iRxState == SIM_RX_ARMED && !p_Node->iLocked && p_Node->iRxChannel == p_Tx->iChannel)
+			iTryLock(i, p_Tx, p_Tx->tStart);
+	}
+}
+
+//! An armed receiver looks for a packet still in its preamble
+static void vArm(int iRx, int iChannel, simtime_t t)
+{
+	S_SimNode *p_Node = &S_pNodes[iRx];
+	int i;
+
+	p_Node->iRxState = SIM_RX_ARMED;
+	p_Node->iRxChannel = iChannel;
+	if (p_Node->iLocked)
+		return;
+
+	/* THE FIRST PACKET STILL IN ITS PREAMBLE */
+	vExpireTx(t);
+	for (i = 0; i < iTxCount; i++) {
+		if (S_pTx[i].iChannel != iChannel || S_pTx[i].iSrc == iRx || S_pTx[i].tSync <= t)
+			continue;
+		if (iTryLock(iRx, &S_pTx[i], t))
+			return;
+	}
+}
+
+//! Receiver state from a node
+static void vRadio(int iRx, const S_SimReq *p_Req)
+{
+	S_SimNode *p_Node = &S_pNodes[iRx];
+
+	switch (p_Req->iState)
+	{
+		case SIM_RX_ARMED:
+			p_Node->iLocked = 0;
+			vArm(iRx, p_Req->iChannel, p_Req->tNow);
+		break;
+
+		case SIM_RX_KEEP:
+			if (p_Node->iLocked && (p_Node->iSyncSent || p_Node->iRxChannel != p_Req->iChannel))
+				p_Node->iLocked = 0;
+			vArm(iRx, p_Req->iChannel, p_Req->tNow);
+		break;
+
+		default:
+			p_Node->iRxState = SIM_RX_OFF;
+			p_Node->iLocked = 0;
+		break;
+	}
+}
+
+/****************************  SCHEDULER  ************************************/
+
+//! The next radio event of a node, SIM_TIME_NEVER if none
+static simtime_t tRadioEvent(const S_SimNode *p_Node)
+{
+	if (!p_Node->iLocked)
+		return SIM_TIME_NEVER;
+	return p_Node->iSyncSent ? p_Node->tDone : p_Node->tSync;
+}
+
+//! When a waiting node has to run next
+static simtime_t tWake(const S_SimNode *p_Node)
+{
+	simtime_t t;
+
+	t = tRadioEvent(p_Node);
+	if (p_Node->tUntil < t)
+		t = p_Node->tUntil;
+	return t;
+}
+
+//! Logs a message the hub received, once per source and sequence number
+static void vDeliver(const S_SimReq *p_Req)
+{
+	S_SimNode *p_Src;
+	unsigned long ulCap;
+	double dLatency;
+
+	if (p_Req->uiSrcSN < 1 || p_Req->uiSrcSN > (unsigned int) iNodes)
+		return;
+	p_Src = &S_pNodes[p_Req->uiSrcSN - 1];
+
+	if (p_Req->ulSeq >= p_Src->ulSeenCap) {
+		ulCap = p_Src->ulSeenCap ? p_Src->ulSeenCap : 256;
+		while (ulCap <= p_Req->ulSeq)
+			ulCap *= 2;
+		p_Src->p_ucSeen = realloc(p_Src->p_ucSeen, ulCap);
+		if (p_Src->p_ucSeen == NULL)
+			vDie("out of memory");
+		memset(&p_Src->p_ucSeen[p_Src->ulSeenCap], 0, ulCap - p_Src->ulSeenCap);
+		p_Src->ulSeenCap = ulCap;
+	}
+	if (p_Src->p_ucSeen[p_Req->ulSeq]) {
+		p_Src->ulDuplicates++;
+		return;
+	}
+	p_Src->p_ucSeen[p_Req->ulSeq] = 1;
+
+	if (p_Src->ulDelivered == p_Src->ulLatencyCap) {
+		p_Src->ulLatencyCap = p_Src->ulLatencyCap ? p_Src->ulLatencyCap * 2 : 64;
+		p_Src->p_dLatency = realloc(p_Src->p_dLatency, p_Src->ulLatencyCap * sizeof(double));
+		if (p_Src->p_dLatency == NULL)
+			vDie("out of memory");
+	}
+	dLatency = dSeconds(p_Req->tNow - p_Req->tGenerated);
+	p_Src->p_dLatency[p_Src->ulDelivered++] = dLatency;
+}
+
+//! Resumes node iNode at its wake time and plays what it does until it waits again
+static void vResume(int iNode)
+{
+	S_SimNode *p_Node = &S_pNodes[iNode];
+	S_SimRsp S_Rsp;
+	S_SimReq S_Req;
+	simtime_t tNow;
+	simtime_t tHorizon;
+	simtime_t t;
+	char cMsg[128];
+	int i;
+
+	tNow = tWake(p_Node);
+	memset(&S_Rsp, 0, offsetof(S_SimRsp, ucaData));
+	S_Rsp.iEvent = SIM_EV_NONE;
+
+	/* A RADIO EVENT WINS A TIE WITH THE WAKE TIME */
+	if (tRadioEvent(p_Node) == tNow) {
+		S_Rsp.iRSSI = (int) lround(p_Node->dLockDBm);
+		if (!p_Node->iSyncSent) {
+			S_Rsp.iEvent = SIM_EV_SYNC;
+			p_Node->iSyncSent = 1;
+		}
+		else {
+			S_Rsp.iEvent = SIM_EV_DONE;
+			S_Rsp.iLen = p_Node->iLockLen;
+			memcpy(S_Rsp.ucaData, p_Node->ucaLockData, sizeof(S_Rsp.ucaData));
+			if (p_Node->iCorrupt && p_Node->iLockLen > 0)
+				S_Rsp.ucaData[p_Node->iLockLen - 1] ^= 0x5A;
+			p_Node->iLocked = 0;
+			p_Node->iRxState = SIM_RX_OFF;
+		}
+	}
+
+	/* NOTHING CAN HAPPEN TO THE NODE BEFORE ANOTHER ONE RUNS OR ITS OWN PACKET MOVES ON */
+	tHorizon = tRadioEvent(p_Node);
+	for (i = 0; i < iNodes; i++) {
+		if (i == iNode)
+			continue;
+		t = tWake(&S_pNodes[i]);
+		if (t < tHorizon)
+			tHorizon = t;
+	}
+
+	S_Rsp.tNow = tNow;
+	S_Rsp.tHorizon = tHorizon;
+	vWrite(p_Node, &S_Rsp, offsetof(S_SimRsp, ucaData));
+	if (S_Rsp.iEvent == SIM_EV_DONE)
+		vWrite(p_Node, S_Rsp.ucaData, sizeof(S_Rsp.ucaData));
+	ullSwitches++;
+
+	alarm(SIM_WATCHDOG_SEC);
+	while (1) {
+		vReadReq(p_Node, &S_Req);
+		if (S_Req.tNow < tNow || S_Req.tNow > tHorizon) {
+			snprintf(cMsg, sizeof(cMsg), "node %u sent request %d at %.9f s, outside %.9f to %.9f s",
+					p_Node->Cfg.uiSN, S_Req.iType, dSeconds(S_Req.tNow), dSeconds(tNow), dSeconds(tHorizon));
+			vDie(cMsg);
+		}
+		tNow = S_Req.tNow;
+
+		switch (S_Req.iType)
+		{
+			case SIM_REQ_WAIT:
+				p_Node->tUntil = S_Req.tUntil;
+				alarm(0);
+				return;
+
+			case SIM_REQ_RADIO:
+				vRadio(iNode, &S_Req);
+				/* AN ARMED RECEIVER MAY HAVE PICKED UP A PACKET, THE NODE WAITS NEXT */
+				if (S_Req.iState != SIM_RX_OFF)
+					tHorizon = tNow;
+			break;
+
+			case SIM_REQ_TX:
+				vStartTx(iNode, &S_Req);
+				tHorizon = tNow;
+			break;
+
+			case SIM_REQ_DELIVER:
+				vDeliver(&S_Req);
+			break;
+
+			default:
+				snprintf(cMsg, sizeof(cMsg), "node %u sent request %d", p_Node->Cfg.uiSN, S_Req.iType);
+				vDie(cMsg);
+			break;
+		}
+	}
+}
+
+//! Ends every node and collects its counters
+static void vEndAll(void)
+{
+	S_SimRsp S_Rsp;
+	S_SimReq S_Req;
+	int i;
+
+	for (i = 0; i < iNodes; i++) {
+		memset(&S_Rsp, 0, offsetof(S_SimRsp, ucaData));
+		S_Rsp.iEvent = SIM_EV_END;
+		S_Rsp.tNow = tSimEnd;
+		S_Rsp.tHorizon = tSimEnd;
+		alarm(SIM_WATCHDOG_SEC);
+		vWrite(&S_pNodes[i], &S_Rsp, offsetof(S_SimRsp, ucaData));
+
+		/* THE LAST REQUESTS BEFORE THE STATS ARE ALL AT THE END TIME */
+		do {
+			vReadReq(&S_pNodes[i], &S_Req);
+			if (S_Req.iType == SIM_REQ_DELIVER)
+				vDeliver(&S_Req);
+		} while (S_Req.iType != SIM_REQ_STATS);
+		vRead(&S_pNodes[i], &S_pNodes[i].Stats, sizeof(S_SimStats));
+		S_pNodes[i].iHaveStats = 1;
+		alarm(0);
+
+		close(S_pNodes[i].iFd);
+		waitpid(S_pNodes[i].iPid, NULL, 0);
+		S_pNodes[i].iPid = 0;
+	}
+}
+
+//! Forks the node processes, each one waits for its power up
+static void vStartNodes(void)
+{
+	struct rlimit S_Lim;
+	S_SimReq S_Req;
+	int iaFd[2];
+	pid_t iPid;
+	int i;
+	int j;
+
+	/* TWO DESCRIPTORS A NODE WHILE STARTING */
+	if (getrlimit(RLIMIT_NOFILE, &S_Lim) == 0 && S_Lim.rlim_cur < S_Lim.rlim_max) {
+		S_Lim.rlim_cur = S_Lim.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &S_Lim);
+	}
+
+	for (i = 0; i < iNodes; i++) {
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, iaFd) != 0)
+			vDie("socketpair failed, too many nodes for the descriptor limit?");
+		fflush(stdout);
+		fflush(stderr);
+
+		iPid = fork();
+		if (iPid < 0)
+			vDie("fork failed");
+		if (iPid == 0) {
+			signal(SIGALRM, SIG_DFL);
+			for (j = 0; j < i; j++)
+				close(S_pNodes[j].iFd);
+			close(iaFd[0]);
+			vSIM_NodeMain(&S_pNodes[i].Cfg, iaFd[1]);
+			_exit(0);
+		}
+
+		close(iaFd[1]);
+		S_pNodes[i].iPid = iPid;
+		S_pNodes[i].iFd = iaFd[0];
+
+		vReadReq(&S_pNodes[i], &S_Req);
+		if (S_Req.iType != SIM_REQ_WAIT)
+			vDie("a node did not start with a wait");
+		S_pNodes[i].tUntil = S_Req.tUntil;
+	}
+}
+
+/*****************************  REPORT  **************************************/
+
+static int iCompareDouble(const void *p_v1, const void *p_v2)
+{
+	double d1 = *(const double *) p_v1;
+	double d2 = *(const double *) p_v2;
+
+	return (d1 > d2) - (d1 < d2);
+}
+
+//! Sorts the latencies and returns the one at fraction dQ
+static double dPercentile(double *p_dVal, unsigned long ulCount, double dQ)
+{
+	unsigned long ulIdx;
+
+	if (ulCount == 0)
+		return 0.0;
+	qsort(p_dVal, ulCount, sizeof(double), iCompareDouble);
+	ulIdx = (unsigned long) ceil(dQ * (double) ulCount);
+	if (ulIdx > 0)
+		ulIdx--;
+	return p_dVal[ulIdx];
+}
+
+static double dMean(const double *p_dVal, unsigned long ulCount)
+{
+	double dSum = 0.0;
+	unsigned long ul;
+
+	if (ulCount == 0)
+		return 0.0;
+	for (ul = 0; ul < ulCount; ul++)
+		dSum += p_dVal[ul];
+	return dSum / (double) ulCount;
+}
+
+static void vReport(double dWallSec, unsigned int uiPayload)
+{
+	S_SimNode *p_Node;
+	S_SimStats *p_S;
+	double *p_dAll;
+	unsigned long ulAll = 0;
+	unsigned long ulGenerated = 0;
+	unsigned long ulDuplicates = 0;
+	unsigned long ulBacklog = 0;
+	double dUp;
+	double dDuty;
+	double dDutySum = 0.0;
+	double dDutyMax = 0.0;
+	double dJoinSum = 0.0;
+	double dJoinMax = 0.0;
+	int iJoined = 0;
+	int i;
+	char cJoined[16];
+	char cParent[16];
+
+	printf("\n%5s %4s %3s %6s %4s %8s %6s %6s %5s %8s %8s %6s %6s %6s %6s %6s %7s\n",
+			"SN", "role", "lvl", "parent", "kids", "joined_s", "gen", "logged", "pct",
+			"lat_avg", "lat_p95", "tx", "rx", "duty%", "rx%", "tx%", "backlog");
+
+	for (i = 0; i < iNodes; i++) {
+		p_Node = &S_pNodes[i];
+		p_S = &p_Node->Stats;
+
+		dUp = dSeconds(tSimEnd - p_Node->Cfg.tBoot);
+		dDuty = dUp > 0.0 ? 100.0 * dSeconds(p_S->tRadioOn) / dUp : 0.0;
+
+		if (p_S->tJoined >= 0)
+			snprintf(cJoined, sizeof(cJoined), "%.0f", dSeconds(p_S->tJoined));
+		else
+			snprintf(cJoined, sizeof(cJoined), "-");
+		if (p_S->uiParentSN)
+			snprintf(cParent, sizeof(cParent), "%u", p_S->uiParentSN);
+		else
+			snprintf(cParent, sizeof(cParent), "-");
+
+		printf("%5u %4s %3u %6s %4u %8s %6lu %6lu %5.1f %8.1f %8.1f %6lu %6lu %6.2f %6.2f %6.2f %3u/%-3u\n",
+				p_Node->Cfg.uiSN, p_Node->Cfg.ucRole == SIM_ROLE_HUB ? "hub" : "node",
+				p_S->uiLevel, cParent, p_S->uiChildren, cJoined,
+				p_S->ulGenerated, p_Node->ulDelivered,
+				p_S->ulGenerated ? 100.0 * (double) p_Node->ulDelivered / (double) p_S->ulGenerated : 0.0,
+				dMean(p_Node->p_dLatency, p_Node->ulDelivered),
+				dPercentile(p_Node->p_dLatency, p_Node->ulDelivered, 0.95),
+				p_S->ulTxPkts, p_S->ulRxPkts, dDuty,
+				dUp > 0.0 ? 100.0 * dSeconds(p_S->tRadioRx) / dUp : 0.0,
+				dUp > 0.0 ? 100.0 * dSeconds(p_S->tRadioTx) / dUp : 0.0,
+				p_S->uiBacklog, p_S->uiMaxBacklog);
+
+		ulAll += p_Node->ulDelivered;
+		ulGenerated += p_S->ulGenerated;
+		ulDuplicates += p_Node->ulDuplicates;
+		ulBacklog += p_S->uiBacklog;
+		if (p_Node->Cfg.ucRole != SIM_ROLE_HUB) {
+			dDutySum += dDuty;
+			if (dDuty > dDutyMax)
+				dDutyMax = dDuty;
+			if (p_S->tJoined >= 0) {
+				iJoined++;
+				dJoinSum += dSeconds(p_S->tJoined - p_Node->Cfg.tBoot);
+				if (dSeconds(p_S->tJoined - p_Node->Cfg.tBoot) > dJoinMax)
+					dJoinMax = dSeconds(p_S->tJoined - p_Node->Cfg.tBoot);
+			}
+		}
+	}
+
+	p_dAll = p_vAlloc((ulAll ? ulAll : 1) * sizeof(double));
+	ulAll = 0;
+	for (i = 0; i < iNodes; i++) {
+		if (S_pNodes[i].ulDelivered == 0)
+			continue;
+		memcpy(&p_dAll[ulAll], S_pNodes[i].p_dLatency, S_pNodes[i].ulDelivered * sizeof(double));
+		ulAll += S_pNodes[i].ulDelivered;
+	}
+
+	printf("\nnetwork\n");
+	printf("  joined          %d of %d, %.0f s after power up on average, %.0f s at most\n",
+			iJoined, iNodes - 1, iJoined ? dJoinSum / iJoined : 0.0, dJoinMax);
+	printf("  messages        %lu generated, %lu logged by the hub (%.1f%%), %lu duplicates, %lu queued\n",
+			ulGenerated, ulAll, ulGenerated ? 100.0 * (double) ulAll / (double) ulGenerated : 0.0,
+			ulDuplicates, ulBacklog);
+	printf("  throughput      %.2f msg/min, %.1f payload bytes/s at the hub\n",
+			(double) ulAll * 60.0 / dSeconds(tSimEnd), (double) ulAll * uiPayload / dSeconds(tSimEnd));
+	printf("  latency         %.1f s mean, %.1f s median, %.1f s p95, %.1f s max\n",
+			dMean(p_dAll, ulAll), dPercentile(p_dAll, ulAll, 0.5), dPercentile(p_dAll, ulAll, 0.95),
+			dPercentile(p_dAll, ulAll, 1.0));
+	printf("  radio duty      %.2f%% mean, %.2f%% max (nodes but the hub)\n",
+			iNodes > 1 ? dDutySum / (iNodes - 1) : 0.0, dDutyMax);
+	printf("  channel         %lu packets, %lu receptions, %lu collided, %lu faded or lost\n",
+			ulAirPkts, ulLocks, ulCollisions, ulFaded);
+	printf("  run             %.0f simulated s in %.1f wall s (%.0fx), %llu resumes\n",
+			dSeconds(tSimEnd), dWallSec, dWallSec > 0.0 ? dSeconds(tSimEnd) / dWallSec : 0.0, ullSwitches);
+	free(p_dAll);
+}
+
+/******************************  MAIN  ***************************************/
+
+static void vUsage(const char *p_cName)
+{
+	fprintf(stderr, "usage: %s [-n NODES] [-t SECONDS] [-s SEED] [-r MSG_PER_MIN] [-p BYTES]\n"
+			"       [-a METERS] [-f TOPOLOGY] [-d PPM] [-b SECONDS] [-l LOSS] [-w DB] [-F DB]\n"
+			"       [-T SN] [-v]\n", p_cName);
+	exit(2);
+}
+
+//! Neighbours above the sensitivity and hops from the hub over them
+static void vPrintTopology(double dSide)
+{
+	int *p_iHops;
+	int *p_iQueue;
+	int iHead = 0;
+	int iTail = 0;
+	int iReached = 0;
+	int iMaxHops = 0;
+	long lLinks = 0;
+	int i;
+	int j;
+
+	p_iHops = p_vAlloc((size_t) iNodes * sizeof(int));
+	p_iQueue = p_vAlloc((size_t) iNodes * sizeof(int));
+	for (i = 0; i < iNodes; i++)
+		p_iHops[i] = -1;
+	p_iHops[0] = 0;
+	p_iQueue[iTail++] = 0;
+	while (iHead < iTail) {
+		i = p_iQueue[iHead++];
+		iReached++;
+		if (p_iHops[i] > iMaxHops)
+			iMaxHops = p_iHops[i];
+		for (j = 0; j < iNodes; j++) {
+			if (p_dLinkDBm[i * iNodes + j] < SIM_SENSITIVITY_DBM || p_iHops[j] >= 0)
+				continue;
+			p_iHops[j] = p_iHops[i] + 1;
+			p_iQueue[iTail++] = j;
+		}
+	}
+	for (i = 0; i < iNodes * iNodes; i++)
+		if (p_dLinkDBm[i] >= SIM_SENSITIVITY_DBM)
+			lLinks++;
+
+	if (dSide > 0.0)
+		printf("commsim: %d nodes in %.0f x %.0f m", iNodes, dSide, dSide);
+	else
+		printf("commsim: %d nodes", iNodes);
+	printf(", %.1f neighbours each, %d can reach the hub, %d hops at most\n",
+			(double) lLinks / iNodes, iReached - 1, iMaxHops);
+	free(p_iHops);
+	free(p_iQueue);
+}
+
+int main(int argc, char **argv)
+{
+	struct timespec S_Start;
+	struct timespec S_Stop;
+	unsigned int uiaTrace[16];
+	int iTraceCount = 0;
+	int iVerbose = 0;
+	double dSimSec = 3600.0;
+	double dMsgPerMin = 1.0;
+	double dSide = 0.0;
+	double dPPM = 20.0;
+	double dBootSec = 10.0;
+	double dShadowSigma = 4.0;
+	unsigned long ulSeed = 1;
+	unsigned int uiPayload = 20;
+	const char *p_cTopology = NULL;
+	simtime_t tNextReport;
+	simtime_t tMin;
+	simtime_t t;
+	int iNext;
+	int iOpt;
+	int i;
+	int j;
+
+	iNodes = 10;
+	dFadeSigma = 2.0;
+	while ((iOpt = getopt(argc, argv, "n:t:s:r:p:a:f:d:b:l:w:F:T:v")) != -1) {
+		switch (iOpt)
+		{
+			case 'n': iNodes = atoi(optarg); break;
+			case 't': dSimSec = atof(optarg); break;
+			case 's': ulSeed = strtoul(optarg, NULL, 0); break;
+			case 'r': dMsgPerMin = atof(optarg); break;
+			case 'p': uiPayload = (unsigned int) atoi(optarg); break;
+			case 'a': dSide = atof(optarg); break;
+			case 'f': p_cTopology = optarg; break;
+			case 'd': dPPM = atof(optarg); break;
+			case 'b': dBootSec = atof(optarg); break;
+			case 'l': dLossProb = atof(optarg); break;
+			case 'w': dShadowSigma = atof(optarg); break;
+			case 'F': dFadeSigma = atof(optarg); break;
+			case 'T':
+				if (iTraceCount < 16)
+					uiaTrace[iTraceCount++] = (unsigned int) atoi(optarg);
+			break;
+			case 'v': iVerbose = 1; break;
+			default: vUsage(argv[0]);
+		}
+	}
+	if (optind != argc || dSimSec <= 0.0 || uiPayload < 14 || uiPayload > 200)
+		vUsage(argv[0]);
+
+	ullRand = ((unsigned long long) ulSeed * 0x9E3779B97F4A7C15ULL) | 1;
+	tSimEnd = (simtime_t) (dSimSec * SIM_NS_PER_SEC);
+
+	/* WHERE THE NODES ARE AND HOW WELL THEY HEAR EACH OTHER */
+	if (p_cTopology != NULL) {
+		vLoadTopology(p_cTopology);
+		dSide = 0.0;
+	}
+	else {
+		if (iNodes < 2 || iNodes > SIM_MAX_NODES)
+			vUsage(argv[0]);
+		if (dSide <= 0.0)
+			dSide = 300.0 * sqrt(iNodes / 10.0);
+		vPlaceNodes(dSide);
+	}
+	vComputeLinks(dShadowSigma);
+	vPrintTopology(dSide);
+
+	/* WHAT EACH NODE STARTS WITH */
+	for (i = 0; i < iNodes; i++) {
+		S_SimNodeCfg *p_Cfg = &S_pNodes[i].Cfg;
+
+		p_Cfg->iIndex = i;
+		p_Cfg->uiSN = (unsigned int) i + 1;
+		p_Cfg->ucRole = i ? SIM_ROLE_RELAY : SIM_ROLE_HUB;
+		p_Cfg->dPPM = (2.0 * dUniform() - 1.0) * dPPM;
+		p_Cfg->tBoot = i ? (simtime_t) (dUniform() * dBootSec * SIM_NS_PER_SEC) : 0;
+		p_Cfg->tAclkPhase = (simtime_t) (dUniform() * SIM_NS_PER_SEC / 32768.0);
+		p_Cfg->dMsgPerMin = i ? dMsgPerMin : 0.0;
+		p_Cfg->uiPayload = uiPayload;
+		p_Cfg->ulSeed = (unsigned long) ullRandom();
+		for (j = 0; j < iTraceCount; j++)
+			if (uiaTrace[j] == p_Cfg->uiSN)
+				p_Cfg->iTrace = 1;
+		S_pNodes[i].tUntil = SIM_TIME_NEVER;
+	}
+
+	signal(SIGPIPE, SIG_IGN);
+	signal(SIGALRM, vWatchdog);
+	clock_gettime(CLOCK_MONOTONIC, &S_Start);
+	vStartNodes();
+
+	/* ALWAYS THE EARLIEST NODE NEXT, THE LOWER INDEX ON A TIE */
+	tNextReport = 60 * SIM_NS_PER_SEC;
+	while (1) {
+		iNext = -1;
+		tMin = SIM_TIME_NEVER;
+		for (i = 0; i < iNodes; i++) {
+			t = tWake(&S_pNodes[i]);
+			if (t < tMin) {
+				tMin = t;
+				iNext = i;
+			}
+		}
+		if (iNext < 0 || tMin > tSimEnd)
+			break;
+
+		if (iVerbose && tMin >= tNextReport) {
+			clock_gettime(CLOCK_MONOTONIC, &S_Stop);
+			fprintf(stderr, "commsim: %6.0f s, %llu resumes, %.1f wall s\n", dSeconds(tMin), ullSwitches,
+					(double) (S_Stop.tv_sec - S_Start.tv_sec) + (S_Stop.tv_nsec - S_Start.tv_nsec) * 1e-9);
+			tNextReport += 60 * SIM_NS_PER_SEC;
+		}
+
+		vResume(iNext);
+	}
+
+	vEndAll();
+	clock_gettime(CLOCK_MONOTONIC, &S_Stop);
+	vReport((double) (S_Stop.tv_sec - S_Start.tv_sec) + (S_Stop.tv_nsec - S_Start.tv_nsec) * 1e-9, uiPayload);
+	return 0;
+}
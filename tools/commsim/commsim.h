@@ -0,0 +1,119 @@
+#ifndef COMMSIM_H
+#define COMMSIM_H
+///////////////////////////////////////////////////////////////////////////////
+//! \file commsim.h
+//! \brief Messages between the commsim coordinator and its node processes
+//!
+//! Every node runs the firmware in its own process and only one node runs
+//! at a time.  A node owns the processor until it has to wait past its
+//! horizon, then it sends a blocking request and sleeps in read() until the
+//! coordinator resumes it.  Radio state changes, transmissions and hub
+//! deliveries are sent as they happen and do not block.
+//!
+//! Time is virtual and kept in nanoseconds from the start of the run.
+///////////////////////////////////////////////////////////////////////////////
+
+//! \typedef simtime_t
+//! \brief Virtual time in nanoseconds
+typedef long long simtime_t;
+
+#define SIM_NS_PER_SEC			1000000000LL
+#define SIM_NS_PER_MS			1000000LL
+#define SIM_NS_PER_US			1000LL
+
+//! \def SIM_TIME_NEVER
+//! \brief A wake time that is never reached
+#define SIM_TIME_NEVER			0x7FFFFFFFFFFFFFFFLL
+
+//! \def SIM_MAX_NODES
+//! \brief Largest network the coordinator will build
+#define SIM_MAX_NODES			1024
+
+//! \def SIM_MAX_PKT
+//! \brief Largest packet on the air (the radio buffer size)
+#define SIM_MAX_PKT				256
+
+/* NODE -> COORDINATOR */
+#define SIM_REQ_WAIT			1	//!< Block until tUntil or a radio event
+#define SIM_REQ_RADIO			2	//!< Receiver armed or disarmed
+#define SIM_REQ_TX				3	//!< A packet goes on the air at tNow
+#define SIM_REQ_DELIVER			4	//!< The hub logged a generated message
+#define SIM_REQ_STATS			5	//!< Final counters, sent after SIM_EV_END
+
+/* RECEIVER STATES IN SIM_REQ_RADIO */
+#define SIM_RX_OFF				0	//!< Off or transmitting
+#define SIM_RX_ARMED			1	//!< Waiting for a sync word
+#define SIM_RX_KEEP				2	//!< Re-armed without losing a packet before its sync word
+
+/* COORDINATOR -> NODE */
+#define SIM_EV_NONE				0	//!< The wake time was reached
+#define SIM_EV_SYNC				1	//!< A sync word was detected
+#define SIM_EV_DONE				2	//!< The last byte of a packet arrived
+#define SIM_EV_END				3	//!< The run is over, send the stats and exit
+
+//! \struct S_SimReq
+//! \brief A request from a node
+typedef struct
+{
+	int iType;					//!< SIM_REQ_*
+	int iChannel;				//!< SIM_REQ_RADIO and SIM_REQ_TX
+	int iState;					//!< SIM_REQ_RADIO
+	int iLen;						//!< SIM_REQ_TX, bytes after the preamble
+	simtime_t tNow;			//!< Node time of the request
+	simtime_t tUntil;		//!< SIM_REQ_WAIT
+	unsigned int uiSrcSN;				//!< SIM_REQ_DELIVER
+	unsigned long ulSeq;				//!< SIM_REQ_DELIVER
+	simtime_t tGenerated;				//!< SIM_REQ_DELIVER
+	unsigned char ucaData[SIM_MAX_PKT];	//!< SIM_REQ_TX, as the radio sends it
+} S_SimReq;
+
+//! \struct S_SimRsp
+//! \brief The answer to a blocking request
+typedef struct
+{
+	int iEvent;					//!< SIM_EV_*
+	int iRSSI;					//!< SIM_EV_SYNC and SIM_EV_DONE, dBm
+	int iLen;						//!< SIM_EV_DONE
+	simtime_t tNow;			//!< Node time on return
+	simtime_t tHorizon;	//!< The node may run on its own up to here
+	unsigned char ucaData[SIM_MAX_PKT];	//!< SIM_EV_DONE
+} S_SimRsp;
+
+//! \struct S_SimStats
+//! \brief Counters a node reports at the end of the run
+typedef struct
+{
+	simtime_t tRadioRx;			//!< Time with the receiver on
+	simtime_t tRadioTx;			//!< Time with the transmitter on
+	simtime_t tRadioOn;			//!< Time the radio was powered in any state
+	unsigned long ulTxPkts;		//!< Packets sent
+	unsigned long ulRxPkts;		//!< Packets received (good or bad)
+	unsigned long ulGenerated;	//!< Messages the traffic generator built
+	unsigned int uiBacklog;		//!< Messages in the SRAM queue at the end
+	unsigned int uiMaxBacklog;	//!< Largest queue seen at a slot boundary
+	unsigned int uiLevel;			//!< Hops from the hub (LEVEL_MAX_VAL if never joined)
+	unsigned int uiParentSN;	//!< 0 if not linked to a parent
+	unsigned int uiChildren;	//!< Links to children at the end
+	simtime_t tJoined;				//!< First time the node had a parent, -1 if never
+} S_SimStats;
+
+//! \struct S_SimNodeCfg
+//! \brief What a node process is started with
+typedef struct
+{
+	int iIndex;						//!< Position in the node table
+	unsigned int uiSN;		//!< Serial number
+	unsigned char ucRole;	//!< Option byte 0 role bits
+	double dPPM;					//!< Clock error of the 32768 Hz crystal
+	simtime_t tBoot;			//!< Power up time
+	simtime_t tAclkPhase;	//!< Offset of the first ACLK edge
+	double dMsgPerMin;		//!< Generated messages per minute (0 = none)
+	unsigned int uiPayload;	//!< Payload bytes of a generated message
+	unsigned long ulSeed;	//!< Seed of the node's own random numbers
+	int iTrace;						//!< Print the node's serial output
+} S_SimNodeCfg;
+
+/* NODE ENTRY POINT, RUNS IN THE CHILD PROCESS AND NEVER RETURNS */
+void vSIM_NodeMain(const S_SimNodeCfg *p_Cfg, int iFd);
+
+#endif /* COMMSIM_H */
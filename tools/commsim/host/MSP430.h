@@ -0,0 +1,3 @@
+//! \file MSP430.h
+//! \brief Other spelling of msp430.h used by the firmware
+#include "msp430.h"
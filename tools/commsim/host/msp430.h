@@ -0,0 +1,109 @@
+///////////////////////////////////////////////////////////////////////////////
+//! \file msp430.h
+//! \brief Host stand-in for the MSP430 register header, used by commsim
+//!
+//! The firmware is compiled for the host with this directory first on the
+//! include path.  Registers the comm stack only writes are plain variables.
+//! The timer counters and the clock counters the firmware spins on are read
+//! through the simulator so every read lets virtual time move on.  The low
+//! power modes hand the node to the simulator until an interrupt wakes it.
+//!
+//! The other spellings of this header in this directory include it, the
+//! firmware uses more than one and the host file system is case sensitive.
+///////////////////////////////////////////////////////////////////////////////
+#ifndef SIM_MSP430_H
+#define SIM_MSP430_H
+
+/* REGISTERS THAT ARE ONLY WRITTEN OR SAMPLED BY THE SIMULATOR */
+#define SIM_REG(r) extern volatile unsigned int r;
+#include "regs.h"
+#undef SIM_REG
+
+/* COUNTERS THAT MOVE WITH VIRTUAL TIME */
+volatile unsigned int *puiSIM_TA1R(void);
+volatile unsigned int *puiSIM_TB0R(void);
+volatile unsigned long *pulSIM_ClkTime(void);
+volatile unsigned long *pulSIM_Clk2Time(void);
+void vSIM_LowPowerMode(void);
+void vSIM_DelayCycles(unsigned long ulCycles);
+
+#define TA1R			(*puiSIM_TA1R())
+#define TB0R			(*puiSIM_TB0R())
+#define uslCLK_TIME		(*pulSIM_ClkTime())
+#define uslCLK2_TIME	(*pulSIM_Clk2Time())
+
+/* INTRINSICS */
+#define __no_operation()
+#define __bic_SR_register(x)
+#define __bis_SR_register(x)
+#define __bic_SR_register_on_exit(x)
+#define __even_in_range(a,b)		(a)
+#define __data16_write_addr(a,b)
+#define __get_SR_register()		0
+#define __disable_interrupt()
+#define __enable_interrupt()
+#define __delay_cycles(x)			vSIM_DelayCycles(x)
+
+#define LPM0	vSIM_LowPowerMode()
+#define LPM1	vSIM_LowPowerMode()
+#define LPM2	vSIM_LowPowerMode()
+#define LPM3	vSIM_LowPowerMode()
+#define LPM4	vSIM_LowPowerMode()
+
+/* BITS */
+#define BIT0	0x0001
+#define BIT1	0x0002
+#define BIT2	0x0004
+#define BIT3	0x0008
+#define BIT4	0x0010
+#define BIT5	0x0020
+#define BIT6	0x0040
+#define BIT7	0x0080
+#define BIT8	0x0100
+#define BIT9	0x0200
+#define BITA	0x0400
+#define BITB	0x0800
+#define BITC	0x1000
+#define BITD	0x2000
+#define BITE	0x4000
+#define BITF	0x8000
+
+#define GIE				0x0008
+#define LPM4_bits		0x00F0
+
+#define WDTPW			0x5A00
+#define WDTHOLD			0x0080
+#define WDTSSEL_1		0x0020
+#define WDTCNTCL		0x0008
+#define WDTIS_1			0x0001
+#define WDTIS_3			0x0003
+
+#define UCSWRST			0x0001
+#define MPYFRAC			0x0004
+#define ADC12ENC_L		0x0002
+#define ADC12ON_L		0x0010
+
+/* TIMER_A / TIMER_B CONTROL */
+#define MC_0			0x0000
+#define MC_1			0x0010
+#define MC_2			0x0020
+#define MC_3			0x0030
+#define MC0				0x0010
+#define MC1				0x0020
+#define MC__UPDOWN		MC_3
+#define ID__1			0x0000
+#define ID__2			0x0040
+#define ID__4			0x0080
+#define ID__8			0x00C0
+#define TASSEL_1		0x0100
+#define TASSEL_2		0x0200
+#define TACLR			0x0004
+#define TAIFG			0x0001
+#define TBSSEL__ACLK	0x0100
+#define TBSSEL__SMCLK	0x0200
+#define TBCLR			0x0004
+#define TBIFG			0x0001
+#define CCIE			0x0010
+#define CCIFG			0x0001
+
+#endif /* SIM_MSP430_H */
@@ -0,0 +1,32 @@
+///////////////////////////////////////////////////////////////////////////////
+//! \file regs.h
+//! \brief Registers of the host stand-in, one SIM_REG() per register
+//!
+//! Included twice: by msp430.h for the declarations and by sim_hal.c for
+//! the storage.
+///////////////////////////////////////////////////////////////////////////////
+
+/* TIMERS, SAMPLED BY THE SIMULATOR */
+SIM_REG(TA1CTL)
+SIM_REG(TA1CCR0)
+SIM_REG(TA1CCR1)
+SIM_REG(TA1CCR2)
+SIM_REG(TA1CCTL0)
+SIM_REG(TA1CCTL1)
+SIM_REG(TA1CCTL2)
+SIM_REG(TB0CTL)
+SIM_REG(TB0CCR1)
+SIM_REG(TB0CCR2)
+SIM_REG(TB0CCTL1)
+SIM_REG(TB0CCTL2)
+
+/* WRITE ONLY AS FAR AS THE COMM STACK GOES */
+SIM_REG(WDTCTL)
+SIM_REG(UCA1CTL1)
+SIM_REG(P7OUT)
+SIM_REG(MPY32CTL0)
+SIM_REG(MPY)
+SIM_REG(OP2)
+SIM_REG(RESHI)
+SIM_REG(RESLO)
+SIM_REG(ADC12CTL0_L)
@@ -0,0 +1,728 @@
+///////////////////////////////////////////////////////////////////////////////
+//! \file sim_hal.c
+//! \brief Globals, memories and stubs of a commsim node
+//!
+//! The firmware modules of the node link against this file in place of
+//! main.c, MODOPT.C, the FRAM, SRAM, serial and SD card drivers and the
+//! tasks in Tasks/task_dispatch.c.
+//!
+//! - The FRAM and SRAM chips are byte arrays, big endian like the parts.
+//! - The option bytes only hold the role, radio seeding is on so every node
+//!   draws its own random seed.
+//! - The serial port prints to stderr, prefixed with the node's serial
+//!   number, when the node is traced.
+//! - The hub's report log picks the generated messages out of what reaches
+//!   it and tells the coordinator.  Everything else the reports, sensors,
+//!   buzzer and SP boards would do is dropped.
+///////////////////////////////////////////////////////////////////////////////
+
+#include <msp430.h>
+#include <stdio.h>
+#include <string.h>
+#include "std.h"
+#include "comm.h"
+#include "modopt.h"
+#include "rand.h"
+#include "l2sram.h"
+#include "fram.h"
+#include "task.h"
+#include <time_wisard.h>
+#include "sim_node.h"
+
+/* REGISTERS */
+#define SIM_REG(r) volatile unsigned int r;
+#include "regs.h"
+#undef SIM_REG
+
+/*********************  GLOBALS OF MAIN.C  ***********************************/
+
+//! \var ucaMSG_BUFF
+//! \brief The message buffer, with room behind it for what
+//! unADF7020_ReadRXBuffer() copies past MAX_RESERVED_MSG_SIZE on a long
+//! packet so it does not land on the next global
+volatile uchar ucaMSG_BUFF[MAX_RESERVED_MSG_SIZE + SIM_MAX_PKT];
+
+volatile ulong uslALARM_TIME;
+
+volatile uint8 ucaBigMinuend[6];
+volatile uint8 ucaBigSubtrahend[6];
+volatile uint8 ucaBigDiff[6];
+
+volatile uint8 ucRAND_NUM[RAND_NUM_SIZE];
+
+/* THE FLAG BYTES, LAID OUT IN SIM_NODE.H */
+volatile U_SimFlag0 ucFLAG0_BYTE;
+volatile U_SimFlag1 ucFLAG1_BYTE;
+volatile U_SimFlag2 ucFLAG2_BYTE;
+volatile U_SimFlag3 ucFLAG3_BYTE;
+
+union
+{
+	uint8 byte;
+	struct
+	{
+		unsigned DBG_MaxIdxWriteToNST :1;
+		unsigned DBG_MaxIdxReadFromNST :1;
+		unsigned DBG_notUsed2 :1;
+		unsigned DBG_notUsed3 :1;
+		unsigned DBG_notUsed4 :1;
+		unsigned DBG_notUsed5 :1;
+		unsigned DBG_notUsed6 :1;
+		unsigned DBG_notUsed7 :1;
+	} debugBits1_STRUCT;
+} ucGLOB_debugBits1;
+
+uint8 ucGLOB_myLevel;
+long lGLOB_initialStartupTime;
+long lGLOB_lastAwakeTime;
+long lGLOB_opUpTimeInSec;
+long lGLOB_lastAwakeLinearSlot;
+long lGLOB_lastAwakeFrame;
+uint8 ucGLOB_lastAwakeSlot;
+uint8 ucGLOB_lastAwakeNSTtblNum;
+uchar g_ucaCurrentTskIndex;
+long lGLOB_lastScheduledFrame;
+long lGLOB_OpMode0_inSec;
+usl uslGLOB_sramQon_NFL[L2SRAM_MSG_CLASS_COUNT];
+usl uslGLOB_sramQoff[L2SRAM_MSG_CLASS_COUNT];
+uint uiaGLOB_sramClassQcnt[L2SRAM_MSG_CLASS_COUNT];
+uint uiGLOB_sramQcnt;
+uint uiGLOB_curMsgSeqNum;
+int iGLOB_Hr0_to_SysTim0_inSec;
+uint uiGLOB_grpID;
+int iGLOB_completeSysLFactor;
+ulong ulGLOB_msgSysLFactor;
+uchar ucGLOB_radioChannel;
+uint uiGLOB_lostROM2connections;
+uint uiGLOB_lostSOM2connections;
+uint uiGLOB_ROM2attempts;
+uint uiGLOB_SOM2attempts;
+uint uiGLOB_TotalSDC4trys;
+uint uiGLOB_TotalRTJ_attempts;
+
+uint8 ucaGLOB_optionBytes[OPTION_BYTE_COUNT];
+unsigned char g_ucSP1Ready;
+unsigned char g_ucSP2Ready;
+unsigned char g_ucSP3Ready;
+unsigned char g_ucSP4Ready;
+
+//! \var ucaBitMask
+//! \brief From MODOPT.C
+const uchar ucaBitMask[8] =
+{ 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80 };
+
+/*****************************  MEMORIES  ************************************/
+
+/* RETURN CODES OF DRIVERS/FRAM.C */
+#define SUCCESS					0
+#define ACCESS_VIOLATION		1
+
+//! \def SIM_SRAM_SIZE
+//! \brief The SRAM part holds 2 Mbit
+#define SIM_SRAM_SIZE			0x40000UL
+
+static uchar ucaSimFram[FRAM_MAX_ADDRESS + 1];
+static uchar ucaSimSram[SIM_SRAM_SIZE];
+
+//! Clears the RAM globals as a power up does
+void vSIM_HalInit(void)
+{
+	ucGLOB_debugBits1.byte = 0;
+	uiGLOB_lostROM2connections = 0;
+	uiGLOB_lostSOM2connections = 0;
+	uiGLOB_ROM2attempts = 0;
+	uiGLOB_SOM2attempts = 0;
+	uiGLOB_TotalSDC4trys = 0;
+	uiGLOB_TotalRTJ_attempts = 0;
+	iGLOB_completeSysLFactor = 0;
+	g_ucSP1Ready = 0;
+	g_ucSP2Ready = 0;
+	g_ucSP3Ready = 0;
+	g_ucSP4Ready = 0;
+
+	/* THE ROLE AND A SEED FROM RADIO NOISE */
+	memset(ucaGLOB_optionBytes, 0, sizeof(ucaGLOB_optionBytes));
+	ucaGLOB_optionBytes[0] = (uint8) (g_SIM_Cfg.ucRole & 0x07);
+	ucaGLOB_optionBytes[OPTPAIR_USE_RDIO_FOR_RAND_SEED >> 3] |= ucaBitMask[OPTPAIR_USE_RDIO_FOR_RAND_SEED & 7];
+
+	/* UNPROGRAMMED PARTS */
+	memset(ucaSimFram, 0xFF, sizeof(ucaSimFram));
+	memset(ucaSimSram, 0, sizeof(ucaSimSram));
+}
+
+/* FRAM */
+
+static uchar ucSIM_FramRange(uint uiAddr, uint uiCount)
+{
+	if (((ulong) uiAddr + uiCount) > sizeof(ucaSimFram))
+		return 0;
+	return 1;
+}
+
+uchar ucFRAM_read_B8(uint uiAddr, uchar *ucData)
+{
+	if (!ucSIM_FramRange(uiAddr, 1))
+		return ACCESS_VIOLATION;
+	*ucData = ucaSimFram[uiAddr];
+	return SUCCESS;
+}
+
+uchar ucFRAM_write_B8(uint uiAddr, uchar ucData)
+{
+	if (!ucSIM_FramRange(uiAddr, 1))
+		return ACCESS_VIOLATION;
+	ucaSimFram[uiAddr] = ucData;
+	return SUCCESS;
+}
+
+uchar ucFRAM_read_block(uint uiAddr, uchar *ucpData, uint uiCount)
+{
+	if (!ucSIM_FramRange(uiAddr, uiCount))
+		return ACCESS_VIOLATION;
+	memcpy(ucpData, &ucaSimFram[uiAddr], uiCount);
+	return SUCCESS;
+}
+
+uchar ucFRAM_write_block(uint uiAddr, const uchar *ucpData, uint uiCount)
+{
+	if (!ucSIM_FramRange(uiAddr, uiCount))
+		return ACCESS_VIOLATION;
+	memcpy(&ucaSimFram[uiAddr], ucpData, uiCount);
+	return SUCCESS;
+}
+
+uchar ucFRAM_fill_block(uint uiAddr, uchar ucSetVal, uint uiCount)
+{
+	if (!ucSIM_FramRange(uiAddr, uiCount))
+		return ACCESS_VIOLATION;
+	memset(&ucaSimFram[uiAddr], ucSetVal, uiCount);
+	return SUCCESS;
+}
+
+uchar ucFRAM_read_B16(uint uiAddr, uint *uiData)
+{
+	uchar ucaVal[2];
+	uchar ucRetVal;
+
+	ucRetVal = ucFRAM_read_block(uiAddr, ucaVal, 2);
+	*uiData = ((uint) ucaVal[0] << 8) | (uint) ucaVal[1];
+	return ucRetVal;
+}
+
+uchar ucFRAM_write_B16(uint uiAddr, uint uiData)
+{
+	uchar ucaVal[2];
+
+	ucaVal[0] = (uchar) (uiData >> 8);
+	ucaVal[1] = (uchar) uiData;
+	return ucFRAM_write_block(uiAddr, ucaVal, 2);
+}
+
+uchar ucFRAM_read_B32(uint uiAddr, ulong *ulData)
+{
+	uchar ucaVal[4];
+	uchar ucRetVal;
+
+	ucRetVal = ucFRAM_read_block(uiAddr, ucaVal, 4);
+	*ulData = ((ulong) ucaVal[0] << 24) | ((ulong) ucaVal[1] << 16) | ((ulong) ucaVal[2] << 8) | (ulong) ucaVal[3];
+	return ucRetVal;
+}
+
+uchar ucFRAM_write_B32(uint uiAddr, ulong ulData)
+{
+	uchar ucaVal[4];
+
+	ucaVal[0] = (uchar) (ulData >> 24);
+	ucaVal[1] = (uchar) (ulData >> 16);
+	ucaVal[2] = (uchar) (ulData >> 8);
+	ucaVal[3] = (uchar) ulData;
+	return ucFRAM_write_block(uiAddr, ucaVal, 4);
+}
+
+void vFRAM_fillFramBlk(uint uiStartAddr, uint uiCount, uchar ucSetVal)
+{
+	ucFRAM_fill_block(uiStartAddr, ucSetVal, uiCount);
+}
+
+void vFRAM_show_fram(uint uiStartAddr, uint uiCount)
+{
+	(void) uiStartAddr;
+	(void) uiCount;
+}
+
+void vFRAM_Security(uint uiStartAddr, uint uiEndAddress)
+{
+	(void) uiStartAddr;
+	(void) uiEndAddress;
+}
+
+void vFRAM_BeginTxn(void)
+{
+}
+
+void vFRAM_EndTxn(void)
+{
+}
+
+/* SRAM */
+
+static ulong ulSIM_SramAddr(USL uslAddr)
+{
+	return (ulong) (uslAddr % SIM_SRAM_SIZE);
+}
+
+uchar ucSRAM_read_B8(USL uslAddr)
+{
+	return ucaSimSram[ulSIM_SramAddr(uslAddr)];
+}
+
+void vSRAM_write_B8(USL uslAddr, uchar ucDataByte)
+{
+	ucaSimSram[ulSIM_SramAddr(uslAddr)] = ucDataByte;
+}
+
+uint uiSRAM_read_B16(USL uslAddr)
+{
+	return ((uint) ucSRAM_read_B8(uslAddr) << 8) | ucSRAM_read_B8(uslAddr + 1);
+}
+
+void vSRAM_write_B16(USL uslAddr, uint uiData)
+{
+	vSRAM_write_B8(uslAddr, (uchar) (uiData >> 8));
+	vSRAM_write_B8(uslAddr + 1, (uchar) uiData);
+}
+
+ulong ulSRAM_read_B32(USL uslAddr)
+{
+	return ((ulong) uiSRAM_read_B16(uslAddr) << 16) | uiSRAM_read_B16(uslAddr + 2);
+}
+
+void vSRAM_write_B32(USL uslAddr, ulong ulData)
+{
+	vSRAM_write_B16(uslAddr, (uint) (ulData >> 16));
+	vSRAM_write_B16(uslAddr + 2, (uint) (ulData & 0xFFFF));
+}
+
+void vSRAM_readBlock(USL uslAddr, uchar *pucData, uint uiCount)
+{
+	while (uiCount--)
+		*pucData++ = ucSRAM_read_B8(uslAddr++);
+}
+
+void vSRAM_writeBlock(USL uslAddr, const uchar *pucData, uint uiCount)
+{
+	while (uiCount--)
+		vSRAM_write_B8(uslAddr++, *pucData++);
+}
+
+void vSRAM_fillBlock(USL uslAddr, uchar ucDataByte, uint uiCount)
+{
+	while (uiCount--)
+		vSRAM_write_B8(uslAddr++, ucDataByte);
+}
+
+/* SD CARD, NOT FITTED */
+
+unsigned long ulSD_GetCapacity(void)
+{
+	return 0;
+}
+
+/*****************************  OPTIONS  *************************************/
+
+/* FROM MODOPT.C */
+
+uchar ucMODOPT_getCurRole(void)
+{
+	return (ucaGLOB_optionBytes[0] & 0x7);
+}
+
+uchar ucMODOPT_isRelay(void)
+{
+	if ((ucMODOPT_getCurRole() & ROLE_RELAY_MSK) == 3)
+		return 1;
+	return 0;
+}
+
+uchar ucMODOPT_readSingleRamOptionBit(uchar ucOptionIdxPair)
+{
+	if (ucaGLOB_optionBytes[ucOptionIdxPair >> 3] & ucaBitMask[ucOptionIdxPair & 0x7])
+		return 1;
+	return 0;
+}
+
+void vMODOPT_copyAllFramOptionsToRamOptions(void)
+{
+}
+
+void vMODOPT_copyAllRomOptionsToFramOptions(uchar ucRomOptionTblNum)
+{
+	(void) ucRomOptionTblNum;
+}
+
+void vMODOPT_showCurRole(void)
+{
+}
+
+uint uiROM_getRomConfigSnumAsUint(void)
+{
+	return g_SIM_Cfg.uiSN;
+}
+
+uchar ucMAIN_GetVersion(void)
+{
+	return 0;
+}
+
+void vMAIN_showVersionNum(void)
+{
+}
+
+/******************************  SERIAL  *************************************/
+
+static uchar ucSimLineStart = 1;
+
+//! Every character the firmware prints goes through here
+void vSERIAL_bout(uchar ucChar)
+{
+	if (!g_SIM_Cfg.iTrace)
+		return;
+	if (ucSimLineStart)
+		fprintf(stderr, "%5u %10.6f ", g_SIM_Cfg.uiSN, (double) g_tSIM_Now / SIM_NS_PER_SEC);
+	ucSimLineStart = 0;
+	if (ucChar == '\r')
+		return;
+	fputc(ucChar, stderr);
+	if (ucChar == '\n')
+		ucSimLineStart = 1;
+}
+
+static void vSIM_Print(const char *p_cStr)
+{
+	while (*p_cStr)
+		vSERIAL_bout((uchar) *p_cStr++);
+}
+
+static void vSIM_PrintHex(ulong ulVal, int iDigits)
+{
+	char caBuf[12];
+
+	snprintf(caBuf, sizeof(caBuf), "%0*lX", iDigits, ulVal);
+	vSIM_Print(caBuf);
+}
+
+static void vSIM_PrintNum(const char *p_cFmt, long lVal)
+{
+	char caBuf[24];
+
+	snprintf(caBuf, sizeof(caBuf), p_cFmt, lVal);
+	vSIM_Print(caBuf);
+}
+
+void vSERIAL_init(void)
+{
+}
+
+void vSERIAL_quit(void)
+{
+}
+
+void vSERIAL_sout(char *cStrPtr, uint uiLength)
+{
+	while (uiLength--)
+		vSERIAL_bout((uchar) *cStrPtr++);
+}
+
+void vSERIAL_crlf(void)
+{
+	vSERIAL_bout('\n');
+}
+
+void vSERIAL_dash(char cCount)
+{
+	while (cCount-- > 0)
+		vSERIAL_bout('-');
+}
+
+void vSERIAL_colTab(uchar ucColNum)
+{
+	(void) ucColNum;
+	vSERIAL_bout(' ');
+}
+
+void vSERIAL_HB8out(uchar ucByte)
+{
+	vSIM_PrintHex(ucByte, 2);
+}
+
+void vSERIAL_HB16out(uint16 uiInt)
+{
+	vSIM_PrintHex(uiInt & 0xFFFF, 4);
+}
+
+void vSERIAL_HB24out(unsigned long uslB24)
+{
+	vSIM_PrintHex(uslB24 & 0xFFFFFF, 6);
+}
+
+void vSERIAL_HB32out(unsigned long ulLong)
+{
+	vSIM_PrintHex(ulLong & 0xFFFFFFFF, 8);
+}
+
+void vSERIAL_HBV32out(unsigned long ulLong)
+{
+	vSIM_PrintHex(ulLong & 0xFFFFFFFF, 1);
+}
+
+void vSERIAL_HB32Fout(unsigned long ulLong)
+{
+	vSIM_Print("0x");
+	vSERIAL_HB32out(ulLong);
+}
+
+void vSERIAL_UI8out(uchar ucVal)
+{
+	vSIM_PrintNum("%3ld", ucVal);
+}
+
+void vSERIAL_UIV8out(uchar ucVal)
+{
+	vSIM_PrintNum("%ld", ucVal);
+}
+
+void vSERIAL_UI8_2char_out(uchar ucVal, uchar ucLeadFillChar)
+{
+	if (ucVal < 10)
+		vSERIAL_bout(ucLeadFillChar);
+	vSIM_PrintNum("%ld", ucVal);
+}
+
+void vSERIAL_UI16out(uint16 uiInt)
+{
+	vSIM_PrintNum("%5ld", uiInt & 0xFFFF);
+}
+
+void vSERIAL_UIV16out(uint uiVal)
+{
+	vSIM_PrintNum("%ld", uiVal & 0xFFFF);
+}
+
+void vSERIAL_I16out(int iVal)
+{
+	vSIM_PrintNum("%6ld", (short) iVal);
+}
+
+void vSERIAL_IV16out(int iInt)
+{
+	vSIM_PrintNum("%ld", (short) iInt);
+}
+
+void vSERIAL_UI32out(unsigned long ulVal)
+{
+	vSIM_PrintNum("%10ld", (long) (ulVal & 0xFFFFFFFF));
+}
+
+void vSERIAL_UIV32out(unsigned long ulVal)
+{
+	vSIM_PrintNum("%ld", (long) (ulVal & 0xFFFFFFFF));
+}
+
+void vSERIAL_IV32out(long lVal)
+{
+	vSIM_PrintNum("%ld", (int) lVal);
+}
+
+void vSERIAL_UI32MicroDecOut(long lVal)
+{
+	vSIM_PrintNum("%ld", lVal / 1000000L);
+	vSIM_PrintNum(".%06ld", lVal % 1000000L);
+}
+
+uchar ucSERIAL_isnum(uchar ucChar)
+{
+	return ((ucChar >= '0') && (ucChar <= '9'));
+}
+
+long lSERIAL_AsciiToNum(uchar ucStr[], uchar ucSignFlag, uchar ucRadix)
+{
+	(void) ucStr;
+	(void) ucSignFlag;
+	(void) ucRadix;
+	return 0;
+}
+
+/******************************  REPORTS  ************************************/
+
+//! Tells the coordinator about a generated message the hub logged
+static void vSIM_LogMsg(volatile uchar *p_ucaMsg)
+{
+	volatile uchar *p_ucPayld;
+	ulong ulSeq;
+	unsigned long long ullGen;
+	uint uiSrcSN;
+	uchar ucc;
+
+	if (p_ucaMsg[MSG_IDX_ID] != MSG_ID_OPERATIONAL)
+		return;
+	if (p_ucaMsg[MSG_IDX_LEN] < (MSG_HDR_SZ + 14))
+		return;
+	p_ucPayld = &p_ucaMsg[MSG_IDX_PAYLD];
+	if ((p_ucPayld[0] != 'S') || (p_ucPayld[1] != 'M'))
+		return;
+
+	ulSeq = 0;
+	for (ucc = 2; ucc < 6; ucc++)
+		ulSeq = (ulSeq << 8) | p_ucPayld[ucc];
+	ullGen = 0;
+	for (ucc = 6; ucc < 14; ucc++)
+		ullGen = (ullGen << 8) | p_ucPayld[ucc];
+	uiSrcSN = ((uint) p_ucaMsg[MSG_IDX_ADDR_HI] << 8) | p_ucaMsg[MSG_IDX_ADDR_LO];
+
+	vSIM_SendDeliver(uiSrcSN, ulSeq, (simtime_t) ullGen);
+}
+
+void vREPORT_LogReport(void)
+{
+	vSIM_LogMsg(ucaMSG_BUFF);
+}
+
+void vREPORT_LogMsg(volatile uchar *p_ucaMsg)
+{
+	vSIM_LogMsg(p_ucaMsg);
+}
+
+void vReport_LogDataElement(unsigned char ucPriority)
+{
+	(void) ucPriority;
+}
+
+void vGS_ReportToGardenServer(void)
+{
+}
+
+void vOTA_ReceiveCodePacket(union DE_Code* ProgramCode)
+{
+	(void) ProgramCode;
+}
+
+/*************************  HARDWARE LEFT OUT  *******************************/
+
+unsigned int uiAD_full_init_setup_read_and_shutdown(unsigned char ucChanNum)
+{
+	(void) ucChanNum;
+	return 0;
+}
+
+uchar ucBUTTON_isButtonFlgSet(void)
+{
+	return 0;
+}
+
+void vBUTTON_init(void)
+{
+}
+
+void vBUZ_raspberry(void)
+{
+}
+
+void vBUZ_tune_Blip(void)
+{
+}
+
+uchar ucSCC_IsAttached(void)
+{
+	return FALSE;
+}
+
+uchar ucSCC_GetSampleDuration(void)
+{
+	return 0;
+}
+
+uint8 ucSP_IsAttached(uchar ucSPNumber)
+{
+	(void) ucSPNumber;
+	return FALSE;
+}
+
+uchar ucSP_FetchNumTransducers(uchar ucSP_Number)
+{
+	(void) ucSP_Number;
+	return 0;
+}
+
+uchar ucSP_FetchTransType(uchar ucSPNumber, uchar ucTransNumber)
+{
+	(void) ucSPNumber;
+	(void) ucTransNumber;
+	return 0;
+}
+
+uchar ucSP_FetchTransSmplDur(uchar ucSPNumber, uchar ucTransNumber)
+{
+	(void) ucSPNumber;
+	(void) ucTransNumber;
+	return 0;
+}
+
+/*******************************  TASKS  *************************************/
+
+/* FROM TASKS/TASK_DISPATCH.C */
+
+void vTask_Sleep(void)
+{
+	while (ucTimeCheckForAlarms(SUBSLOT_WARNING_ALARM_BIT) == 0)
+		LPM3;
+}
+
+/* NO COMMANDS, SENSORS OR RESETS IN THE SIMULATION */
+
+void vTask_ModifyTCB(void)
+{
+}
+
+void vTask_Batt_Sense(void)
+{
+}
+
+void vTask_MCUTemp(void)
+{
+}
+
+void vTask_RSSI(void)
+{
+}
+
+void vTask_ReportHID(void)
+{
+}
+
+void vTask_Reset(void)
+{
+}
+
+void vTask_RuntimeRadioDiag(void)
+{
+}
+
+void vTask_SCC_StartSlot(void)
+{
+}
+
+void vTask_SCC_EndSlot(void)
+{
+}
+
+void vTask_SP_CheckBoards(void)
+{
+}
+
+void vTask_SP_StartSlot(void)
+{
+}
+
+void vTask_SP_EndSlot(void)
+{
+}
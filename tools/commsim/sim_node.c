@@ -0,0 +1,965 @@
+///////////////////////////////////////////////////////////////////////////////
+//! \file sim_node.c
+//! \brief One commsim node: virtual time, timers, main loop and traffic
+//!
+//! The node runs the firmware modules unchanged.  What main.c, irupt.c and
+//! the timer hardware do for them is done here:
+//!
+//! - Time only moves when the firmware enters the simulator: the low power
+//!   modes, reads of the timer and clock counters (a short poll each), the
+//!   cycle delays and the radio.  Code in between takes no time.
+//! - TA1 and TB0 are modelled from their control and compare registers,
+//!   which are sampled every time the firmware enters the simulator.  The
+//!   32768 Hz crystal and the DCO run fast or slow by the node's clock error.
+//!   TA1 always counts once vTIME_init() has started it, the short halts
+//!   around reads of TA1R are ignored.
+//! - The timer interrupts are copies of the ISRs in hal/irupt.c.
+//! - The main loop, vTask_Dispatch() and vMAIN_computeDispatchTiming() are
+//!   copies of the ones in main.c and Tasks/task_dispatch.c without the SD
+//!   card, SP board, button and diagnostic parts.
+//!
+//! The node may run on its own until its horizon, the earliest time another
+//! node could make something happen to it.  Past that it asks the
+//! coordinator to wait and is resumed at that time or at a radio event.
+///////////////////////////////////////////////////////////////////////////////
+
+#include <msp430.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include "std.h"
+#include "comm.h"
+#include "rts.h"
+#include "task.h"
+#include "lnkblk.h"
+#include "l2sram.h"
+#include "L2fram.h"
+#include "rand.h"
+#include "gid.h"
+#include "misc.h"
+#include "main.h"
+#include "adf7020.h"
+#include <time_wisard.h>
+#include "sim_node.h"
+
+/* FIRMWARE GLOBALS USED HERE */
+extern volatile uint8 ucaMSG_BUFF[MAX_RESERVED_MSG_SIZE];
+extern uchar volatile g_ucLatencyTimerState;
+extern uint8 ucGLOB_myLevel;
+extern uchar ucGLOB_radioChannel;
+extern uint uiGLOB_curMsgSeqNum;
+extern long lGLOB_lastAwakeTime;
+extern long lGLOB_opUpTimeInSec;
+extern long lGLOB_lastAwakeLinearSlot;
+extern long lGLOB_lastAwakeFrame;
+extern uint8 ucGLOB_lastAwakeSlot;
+extern uint8 ucGLOB_lastAwakeNSTtblNum;
+extern long lGLOB_lastScheduledFrame;
+extern long lGLOB_OpMode0_inSec;
+extern uchar g_ucaCurrentTskIndex;
+extern S_Task_Ctl p_saTaskList[MAXNUMTASKS];
+
+//! \def SIM_POLL_NS
+//! \brief Time a read of a counter takes, short of one ACLK tick
+#define SIM_POLL_NS				4000LL
+
+//! \def SIM_MCLK_HZ
+//! \brief MCLK, for __delay_cycles()
+#define SIM_MCLK_HZ				16000000.0L
+
+//! \def SIM_ACLK_HZ
+//! \brief Nominal ACLK
+#define SIM_ACLK_HZ				32768.0L
+
+//! \def SIM_SMCLK_HZ
+//! \brief Nominal SMCLK
+#define SIM_SMCLK_HZ			4000000.0L
+
+#define SIM_CLK_ACLK			0
+#define SIM_CLK_SMCLK			1
+
+S_SimNodeCfg g_SIM_Cfg;
+S_SimStats g_SIM_Stats;
+
+//! \var g_tSIM_Now
+//! \brief Node time, never behind the global virtual time when it runs
+simtime_t g_tSIM_Now;
+
+static int iSimFd;
+static simtime_t tSimHorizon;
+static unsigned long long ullSimRand;
+
+/* INTERRUPT RESULTS SINCE THE LAST SLEEP */
+static uchar ucSimWake;
+static uchar ucSimAnyIrq;
+static uchar ucSimSecondTick;
+
+/* END OF THE PACKET ON THE AIR, THE RADIO'S TIMER0_A1 INTERRUPT */
+static simtime_t tSimRadioTimer = SIM_TIME_NEVER;
+
+/* CLOCK SOURCES, COUNT n IS THE nTH EDGE AFTER THE PHASE OFFSET */
+static long double ldaSimClkHz[2];
+
+/* SYSTEM CLOCK COUNTERS (uslCLK_TIME, uslCLK2_TIME) */
+static volatile unsigned long ulSimClk;
+static volatile unsigned long ulSimClk2;
+
+/* TA1: UP MODE ON ACLK, TA1R = (ACLK - llTA1Base) % (TA1CCR0 + 1) */
+static uchar ucTA1Run;
+static long long llTA1Base;
+static long long llTA1Done;
+static unsigned int uiTA1Period;
+static volatile unsigned int uiTA1RShadow;
+static unsigned int uiTA1RLast;
+
+/* TB0: CONTINUOUS MODE, COUNT IS KEPT UNWRAPPED */
+static uchar ucTB0Run;
+static int iTB0Src;
+static int iTB0Div;
+static long long llTB0SrcStart;
+static long long llTB0CntStart;
+static long long llTB0Frozen;
+static long long llTB0Done;
+static unsigned int uiTB0CtlSeen;
+static volatile unsigned int uiTB0RShadow;
+static unsigned int uiTB0RLast;
+
+/* TRAFFIC */
+static simtime_t tSimNextMsg;
+static unsigned long ulSimMsgSeq;
+
+static void vSIM_Exit(void);
+
+/******************************  IPC  ****************************************/
+
+static void vSIM_Write(const void *p_vBuf, size_t uiLen)
+{
+	const char *p_cBuf = p_vBuf;
+	ssize_t iDone;
+
+	while (uiLen) {
+		iDone = write(iSimFd, p_cBuf, uiLen);
+		if (iDone <= 0)
+			_exit(2);
+		p_cBuf += iDone;
+		uiLen -= (size_t) iDone;
+	}
+}
+
+static void vSIM_Read(void *p_vBuf, size_t uiLen)
+{
+	char *p_cBuf = p_vBuf;
+	ssize_t iDone;
+
+	while (uiLen) {
+		iDone = read(iSimFd, p_cBuf, uiLen);
+		if (iDone <= 0)
+			_exit(2);
+		p_cBuf += iDone;
+		uiLen -= (size_t) iDone;
+	}
+}
+
+static void vSIM_InitReq(S_SimReq *p_Req, int iType)
+{
+	p_Req->iType = iType;
+	p_Req->iChannel = 0;
+	p_Req->iState = 0;
+	p_Req->iLen = 0;
+	p_Req->tNow = g_tSIM_Now;
+	p_Req->tUntil = 0;
+}
+
+//! Sends the receiver state, does not block
+//!
+//! An armed receiver can pick up a packet that is already in its preamble,
+//! so the horizon is dropped and the coordinator decides how far to go next.
+void vSIM_SendRadio(int iState, int iChannel)
+{
+	S_SimReq S_Req;
+
+	vSIM_InitReq(&S_Req, SIM_REQ_RADIO);
+	S_Req.iState = iState;
+	S_Req.iChannel = iChannel;
+	vSIM_Write(&S_Req, offsetof(S_SimReq, ucaData));
+	if (iState != SIM_RX_OFF)
+		tSimHorizon = g_tSIM_Now;
+}
+
+//! Puts a packet on the air at the current time, does not block
+void vSIM_SendTx(int iChannel, const unsigned char *p_ucaData, int iLen)
+{
+	S_SimReq S_Req;
+
+	vSIM_InitReq(&S_Req, SIM_REQ_TX);
+	S_Req.iChannel = iChannel;
+	S_Req.iLen = iLen;
+	memcpy(S_Req.ucaData, p_ucaData, (size_t) iLen);
+	vSIM_Write(&S_Req, sizeof(S_Req));
+
+	/* THE PACKET MAY WAKE OTHER NODES BEFORE THE OLD HORIZON */
+	tSimHorizon = g_tSIM_Now;
+}
+
+//! Tells the coordinator the hub logged a generated message
+void vSIM_SendDeliver(unsigned int uiSrcSN, unsigned long ulSeq, simtime_t tGenerated)
+{
+	S_SimReq S_Req;
+
+	vSIM_InitReq(&S_Req, SIM_REQ_DELIVER);
+	S_Req.uiSrcSN = uiSrcSN;
+	S_Req.ulSeq = ulSeq;
+	S_Req.tGenerated = tGenerated;
+	vSIM_Write(&S_Req, offsetof(S_SimReq, ucaData));
+}
+
+//! Blocks until tUntil or an earlier radio event
+static void vSIM_Wait(simtime_t tUntil, S_SimRsp *p_Rsp)
+{
+	S_SimReq S_Req;
+
+	vSIM_InitReq(&S_Req, SIM_REQ_WAIT);
+	S_Req.tUntil = tUntil;
+	vSIM_Write(&S_Req, offsetof(S_SimReq, ucaData));
+
+	vSIM_Read(p_Rsp, offsetof(S_SimRsp, ucaData));
+	if (p_Rsp->iEvent == SIM_EV_DONE)
+		vSIM_Read(p_Rsp->ucaData, sizeof(p_Rsp->ucaData));
+
+	if (p_Rsp->tNow > g_tSIM_Now)
+		g_tSIM_Now = p_Rsp->tNow;
+	tSimHorizon = p_Rsp->tHorizon;
+
+	if (p_Rsp->iEvent == SIM_EV_END)
+		vSIM_Exit();
+}
+
+/***************************  CLOCKS  ****************************************/
+
+//! Edges of a clock source up to and including time t
+static long long llSIM_ClkCount(int iSrc, simtime_t t)
+{
+	long double ldT;
+
+	ldT = (long double) (t - g_SIM_Cfg.tAclkPhase);
+	if (ldT < 0)
+		return -1;
+	return (long long) floorl(ldT * ldaSimClkHz[iSrc] / (long double) SIM_NS_PER_SEC);
+}
+
+//! Time of edge n of a clock source
+static simtime_t tSIM_ClkTime(int iSrc, long long llCount)
+{
+	long double ldT;
+
+	ldT = ceill((long double) llCount * (long double) SIM_NS_PER_SEC / ldaSimClkHz[iSrc]);
+	return g_SIM_Cfg.tAclkPhase + (simtime_t) ldT;
+}
+
+/* TA1 */
+
+static unsigned int uiSIM_TA1Value(simtime_t t)
+{
+	long long llCount;
+
+	llCount = llSIM_ClkCount(SIM_CLK_ACLK, t) - llTA1Base;
+	llCount %= uiTA1Period;
+	if (llCount < 0)
+		llCount += uiTA1Period;
+	return (unsigned int) llCount;
+}
+
+//! Next ACLK count after llDone at which TA1R equals uiCompare
+static long long llSIM_TA1Next(unsigned int uiCompare)
+{
+	long long llPos;
+	long long llStep;
+
+	if (uiCompare >= uiTA1Period)
+		return -1;
+	llPos = (llTA1Done + 1 - llTA1Base) % uiTA1Period;
+	if (llPos < 0)
+		llPos += uiTA1Period;
+	llStep = ((long long) uiCompare - llPos) % uiTA1Period;
+	if (llStep < 0)
+		llStep += uiTA1Period;
+	return llTA1Done + 1 + llStep;
+}
+
+/* TB0 */
+
+static long long llSIM_TB0Value(simtime_t t)
+{
+	if (!ucTB0Run)
+		return llTB0Frozen;
+	return llTB0CntStart + ((llSIM_ClkCount(iTB0Src, t) - llTB0SrcStart) / iTB0Div);
+}
+
+//! Next TB0 count after llDone at which TB0R equals uiCompare
+static long long llSIM_TB0Next(unsigned int uiCompare)
+{
+	long long llNext;
+
+	llNext = ((llTB0Done + 1) & ~0xFFFFLL) | (uiCompare & 0xFFFF);
+	if (llNext <= llTB0Done)
+		llNext += 0x10000;
+	return llNext;
+}
+
+static simtime_t tSIM_TB0Time(long long llCount)
+{
+	return tSIM_ClkTime(iTB0Src, llTB0SrcStart + ((llCount - llTB0CntStart) * iTB0Div));
+}
+
+//! Picks up what the firmware wrote to the timers since the last entry
+static void vSIM_SyncRegs(void)
+{
+	unsigned int uiCtl;
+	long long llCur;
+
+	/* TA1 */
+	if (TA1CTL & TACLR) {
+		TA1CTL &= ~TACLR;
+		uiTA1Period = TA1CCR0 + 1;
+		llTA1Base = llSIM_ClkCount(SIM_CLK_ACLK, g_tSIM_Now);
+		llTA1Done = llTA1Base;
+		ucTA1Run = 1;
+		uiTA1RShadow = uiTA1RLast = 0;
+	}
+	if (ucTA1Run) {
+		if (uiTA1RShadow != uiTA1RLast) {
+			/* TA1R WAS WRITTEN */
+			llTA1Base = llSIM_ClkCount(SIM_CLK_ACLK, g_tSIM_Now) - uiTA1RShadow;
+		}
+		if ((TA1CCR0 + 1) != uiTA1Period) {
+			/* NEW PERIOD, KEEP THE COUNT */
+			llCur = uiSIM_TA1Value(g_tSIM_Now);
+			uiTA1Period = TA1CCR0 + 1;
+			llTA1Base = llSIM_ClkCount(SIM_CLK_ACLK, g_tSIM_Now) - llCur;
+		}
+		uiTA1RShadow = uiTA1RLast = uiSIM_TA1Value(g_tSIM_Now);
+	}
+
+	/* TB0 */
+	uiCtl = TB0CTL;
+	if ((uiCtl != uiTB0CtlSeen) || (uiTB0RShadow != uiTB0RLast)) {
+		llCur = llSIM_TB0Value(g_tSIM_Now);
+		if (uiTB0RShadow != uiTB0RLast)
+			llCur = uiTB0RShadow;
+		if (uiCtl & TBCLR) {
+			uiCtl &= ~TBCLR;
+			TB0CTL = uiCtl;
+			llCur = 0;
+		}
+		if (llCur < llTB0Done)
+			llTB0Done = llCur;
+
+		iTB0Src = ((uiCtl & 0x0300) == TBSSEL__SMCLK) ? SIM_CLK_SMCLK : SIM_CLK_ACLK;
+		iTB0Div = 1 << ((uiCtl >> 6) & 3);
+		if (uiCtl & MC_3) {
+			ucTB0Run = 1;
+			llTB0SrcStart = llSIM_ClkCount(iTB0Src, g_tSIM_Now);
+			llTB0CntStart = llCur;
+		}
+		else {
+			ucTB0Run = 0;
+			llTB0Frozen = llCur;
+		}
+		llTB0Done = llCur;
+		uiTB0CtlSeen = uiCtl;
+	}
+	uiTB0RShadow = uiTB0RLast = (unsigned int) (llSIM_TB0Value(g_tSIM_Now) & 0xFFFF);
+}
+
+/*************************  TIMER INTERRUPTS  ********************************/
+
+/* COPIES OF THE ISRS IN HAL/IRUPT.C */
+
+static void vSIM_TIMER1_A0_ISR(void)
+{
+	ulSimClk++;
+	ulSimClk2++;
+	ucFLAG2_BYTE.FLAG2_STRUCT.FLG2_T1_ALARM_MCH_BIT = 1;
+	ucSimSecondTick = 1;
+	vSIM_WakeFromISR();
+}
+
+static void vSIM_TIMER1_A1_ISR(uchar ucCCR)
+{
+	if (ucCCR == 1) {
+		TA1CCTL1 &= ~(CCIE | CCIFG);
+		ucFLAG2_BYTE.FLAG2_STRUCT.FLG2_T2_ALARM_MCH_BIT = 1;
+	}
+	else {
+		TA1CCTL2 &= ~(CCIE | CCIFG);
+		ucFLAG2_BYTE.FLAG2_STRUCT.FLG2_T3_ALARM_MCH_BIT = 1;
+	}
+	vSIM_WakeFromISR();
+}
+
+static void vSIM_TIMER0_B1_ISR(uchar ucCCR)
+{
+	if (ucCCR == 1)
+		ucFLAG3_BYTE.FLAG3_STRUCT.FLG3_LINKSLOT_ALARM = 1;
+	else
+		ucFLAG3_BYTE.FLAG3_STRUCT.FLG3_LPM_DELAY_ALARM = 1;
+	vSIM_WakeFromISR();
+}
+
+//! Wakes the node from a low power mode (__bic_SR_register_on_exit)
+void vSIM_WakeFromISR(void)
+{
+	ucSimWake = 1;
+	ucSimAnyIrq = 1;
+}
+
+//! Time of the next timer interrupt, SIM_TIME_NEVER if none is armed
+static simtime_t tSIM_NextTimerEvent(void)
+{
+	simtime_t tNext;
+	simtime_t t;
+	long long llCount;
+
+	tNext = tSimRadioTimer;
+	if (ucTA1Run) {
+		if (TA1CCTL0 & CCIE) {
+			llCount = llSIM_TA1Next(TA1CCR0);
+			if (llCount >= 0 && (t = tSIM_ClkTime(SIM_CLK_ACLK, llCount)) < tNext)
+				tNext = t;
+		}
+		if (TA1CCTL1 & CCIE) {
+			llCount = llSIM_TA1Next(TA1CCR1);
+			if (llCount >= 0 && (t = tSIM_ClkTime(SIM_CLK_ACLK, llCount)) < tNext)
+				tNext = t;
+		}
+		if (TA1CCTL2 & CCIE) {
+			llCount = llSIM_TA1Next(TA1CCR2);
+			if (llCount >= 0 && (t = tSIM_ClkTime(SIM_CLK_ACLK, llCount)) < tNext)
+				tNext = t;
+		}
+	}
+	if (ucTB0Run) {
+		if (TB0CCTL1 & CCIE) {
+			t = tSIM_TB0Time(llSIM_TB0Next(TB0CCR1));
+			if (t < tNext)
+				tNext = t;
+		}
+		if (TB0CCTL2 & CCIE) {
+			t = tSIM_TB0Time(llSIM_TB0Next(TB0CCR2));
+			if (t < tNext)
+				tNext = t;
+		}
+	}
+	return tNext;
+}
+
+//! Runs the timer interrupts that are due, in time order
+static void vSIM_FireTimers(void)
+{
+	long long llA;
+	long long llB;
+	long long llNext;
+	simtime_t tA;
+	simtime_t tB;
+
+	while (1) {
+		/* EARLIEST TA1 MATCH */
+		llA = -1;
+		tA = SIM_TIME_NEVER;
+		if (ucTA1Run) {
+			if (TA1CCTL0 & CCIE)
+				llA = llSIM_TA1Next(TA1CCR0);
+			if ((TA1CCTL1 & CCIE) && (llNext = llSIM_TA1Next(TA1CCR1)) >= 0 && (llA < 0 || llNext < llA))
+				llA = llNext;
+			if ((TA1CCTL2 & CCIE) && (llNext = llSIM_TA1Next(TA1CCR2)) >= 0 && (llA < 0 || llNext < llA))
+				llA = llNext;
+			if (llA >= 0)
+				tA = tSIM_ClkTime(SIM_CLK_ACLK, llA);
+		}
+
+		/* EARLIEST TB0 MATCH */
+		llB = -1;
+		tB = SIM_TIME_NEVER;
+		if (ucTB0Run) {
+			if (TB0CCTL1 & CCIE)
+				llB = llSIM_TB0Next(TB0CCR1);
+			if ((TB0CCTL2 & CCIE) && (llNext = llSIM_TB0Next(TB0CCR2)) >= 0 && (llB < 0 || llNext < llB))
+				llB = llNext;
+			if (llB >= 0)
+				tB = tSIM_TB0Time(llB);
+		}
+
+		if (tA > g_tSIM_Now && tB > g_tSIM_Now && tSimRadioTimer > g_tSIM_Now)
+			break;
+
+		if (tSimRadioTimer <= tA && tSimRadioTimer <= tB) {
+			tSimRadioTimer = SIM_TIME_NEVER;
+			ucSimAnyIrq = 1;
+			vSIM_RadioTimerISR();
+		}
+		else if (tA <= tB) {
+			/* CCR0 HAS ITS OWN VECTOR AND GOES FIRST */
+			if ((TA1CCTL0 & CCIE) && llSIM_TA1Next(TA1CCR0) == llA)
+				vSIM_TIMER1_A0_ISR();
+			if ((TA1CCTL1 & CCIE) && llSIM_TA1Next(TA1CCR1) == llA)
+				vSIM_TIMER1_A1_ISR(1);
+			if ((TA1CCTL2 & CCIE) && llSIM_TA1Next(TA1CCR2) == llA)
+				vSIM_TIMER1_A1_ISR(2);
+			llTA1Done = llA;
+		}
+		else {
+			if ((TB0CCTL1 & CCIE) && llSIM_TB0Next(TB0CCR1) == llB)
+				vSIM_TIMER0_B1_ISR(1);
+			if ((TB0CCTL2 & CCIE) && llSIM_TB0Next(TB0CCR2) == llB)
+				vSIM_TIMER0_B1_ISR(2);
+			llTB0Done = llB;
+		}
+	}
+
+	/* NOTHING ELSE IS DUE, EVERY COUNT UP TO NOW HAS BEEN SEEN */
+	if (ucTA1Run)
+		llTA1Done = llSIM_ClkCount(SIM_CLK_ACLK, g_tSIM_Now);
+	if (ucTB0Run)
+		llTB0Done = llSIM_TB0Value(g_tSIM_Now);
+}
+
+//! Starts or stops the radio's bit timer, the ISR runs at time t
+void vSIM_SetRadioTimer(simtime_t t)
+{
+	tSimRadioTimer = t;
+}
+
+//! Runs the radio interrupt that came with a coordinator answer
+static void vSIM_ApplyEvent(const S_SimRsp *p_Rsp)
+{
+	if (p_Rsp->iEvent == SIM_EV_NONE)
+		return;
+	ucSimAnyIrq = 1;
+	vSIM_RadioEvent(p_Rsp);
+	vSIM_SyncRegs();
+}
+
+/************************  ENTRY POINTS  *************************************/
+
+//! Moves the node to time t, running interrupts on the way
+static void vSIM_RunTo(simtime_t t)
+{
+	S_SimRsp S_Rsp;
+
+	while (g_tSIM_Now < t) {
+		if (t <= tSimHorizon) {
+			g_tSIM_Now = t;
+			break;
+		}
+		vSIM_Wait(t, &S_Rsp);
+		vSIM_FireTimers();
+		vSIM_ApplyEvent(&S_Rsp);
+	}
+	vSIM_FireTimers();
+}
+
+//! Lets tCost pass, used by every counter read
+void vSIM_Poll(simtime_t tCost)
+{
+	vSIM_SyncRegs();
+	vSIM_RunTo(g_tSIM_Now + tCost);
+	vSIM_SyncRegs();
+}
+
+//! Sleeps until an interrupt, ucAny = 0 only for those that leave LPM
+static void vSIM_Sleep(uchar ucAny)
+{
+	S_SimRsp S_Rsp;
+	simtime_t tNext;
+
+	ucSimWake = 0;
+	ucSimAnyIrq = 0;
+	vSIM_SyncRegs();
+	vSIM_FireTimers();
+
+	ucSimSecondTick = 0;
+	while (!(ucAny ? ucSimAnyIrq : ucSimWake)) {
+		tNext = tSIM_NextTimerEvent();
+		if (tNext <= tSimHorizon) {
+			if (tNext > g_tSIM_Now)
+				g_tSIM_Now = tNext;
+			vSIM_FireTimers();
+			continue;
+		}
+		vSIM_Wait(tNext, &S_Rsp);
+		vSIM_FireTimers();
+		vSIM_ApplyEvent(&S_Rsp);
+	}
+
+	/* CCR0 MATCHES ON THE LAST COUNT OF THE SECOND.  ON THE HARDWARE THE
+	 * WAKE UP AND THE SLOT CODE TAKE LONGER THAN THAT COUNT, SO THE FIRST
+	 * READ OF TA1R SEES THE NEW SECOND.  HERE CODE TAKES NO TIME. */
+	if (ucSimSecondTick && ucTA1Run)
+		vSIM_RunTo(tSIM_ClkTime(SIM_CLK_ACLK, llSIM_ClkCount(SIM_CLK_ACLK, g_tSIM_Now) + 1));
+	vSIM_SyncRegs();
+}
+
+//! LPM0 to LPM4
+void vSIM_LowPowerMode(void)
+{
+	vSIM_Sleep(0);
+}
+
+//! Busy loops that only watch interrupt results sleep until the next one
+void vSIM_WaitForInterrupt(void)
+{
+	vSIM_Sleep(1);
+}
+
+//! __delay_cycles()
+void vSIM_DelayCycles(unsigned long ulCycles)
+{
+	vSIM_Poll((simtime_t) ((long double) ulCycles * SIM_NS_PER_SEC / SIM_MCLK_HZ));
+}
+
+volatile unsigned int *puiSIM_TA1R(void)
+{
+	vSIM_Poll(SIM_POLL_NS);
+	return &uiTA1RShadow;
+}
+
+volatile unsigned int *puiSIM_TB0R(void)
+{
+	vSIM_Poll(SIM_POLL_NS);
+	return &uiTB0RShadow;
+}
+
+volatile unsigned long *pulSIM_ClkTime(void)
+{
+	vSIM_Poll(SIM_POLL_NS);
+	return &ulSimClk;
+}
+
+volatile unsigned long *pulSIM_Clk2Time(void)
+{
+	vSIM_Poll(SIM_POLL_NS);
+	return &ulSimClk2;
+}
+
+//! The node's own random numbers (xorshift64*)
+unsigned long ulSIM_Random(void)
+{
+	ullSimRand ^= ullSimRand >> 12;
+	ullSimRand ^= ullSimRand << 25;
+	ullSimRand ^= ullSimRand >> 27;
+	return (unsigned long) ((ullSimRand * 2685821657736338717ULL) >> 32);
+}
+
+/****************************  TRAFFIC  **************************************/
+
+//! Time to the next generated message, exponentially distributed
+static simtime_t tSIM_NextMsgGap(void)
+{
+	double dU;
+
+	dU = ((double) ulSIM_Random() + 1.0) / 4294967297.0;
+	return (simtime_t) (-log(dU) * 60.0 * SIM_NS_PER_SEC / g_SIM_Cfg.dMsgPerMin);
+}
+
+//! Builds the due messages the way vReport_FinishMsg() does
+static void vSIM_GenerateTraffic(void)
+{
+	uchar ucaMsg[MAX_LOGICAL_MSG_SIZE];
+	uint uiMySN;
+	uint uiPayload;
+	uint uiIdx;
+
+	if (g_SIM_Cfg.dMsgPerMin <= 0.0)
+		return;
+
+	while (tSimNextMsg <= g_tSIM_Now) {
+		ulSimMsgSeq++;
+		g_SIM_Stats.ulGenerated++;
+
+		/* PAYLOAD: 'S' 'M' SEQ(4) GENERATION TIME IN NS(8) FILL */
+		uiPayload = g_SIM_Cfg.uiPayload;
+		uiIdx = MSG_IDX_PAYLD;
+		ucaMsg[uiIdx++] = 'S';
+		ucaMsg[uiIdx++] = 'M';
+		vMISC_copyUlongIntoBytes(ulSimMsgSeq, &ucaMsg[uiIdx], NO_NOINT);
+		uiIdx += 4;
+		vMISC_copyUlongIntoBytes((ulong) ((unsigned long long) tSimNextMsg >> 32), &ucaMsg[uiIdx], NO_NOINT);
+		vMISC_copyUlongIntoBytes((ulong) (tSimNextMsg & 0xFFFFFFFFLL), &ucaMsg[uiIdx + 4], NO_NOINT);
+		uiIdx += 8;
+		for (; uiIdx < MSG_IDX_PAYLD + uiPayload; uiIdx++)
+			ucaMsg[uiIdx] = (uchar) uiIdx;
+
+		uiMySN = uiL2FRAM_getSnumLo16AsUint();
+		ucaMsg[MSG_IDX_LEN] = (uchar) (MSG_HDR_SZ + uiPayload);
+		ucaMsg[MSG_IDX_ID] = MSG_ID_OPERATIONAL;
+		ucaMsg[MSG_IDX_FLG] = MSG_FLG_SINGLE | MSG_CLASS_DATA;
+		ucaMsg[MSG_IDX_ADDR_HI] = (uchar) (uiMySN >> 8);
+		ucaMsg[MSG_IDX_ADDR_LO] = (uchar) uiMySN;
+
+		vComm_Frag_StoreMsg(ucaMsg);
+
+		tSimNextMsg += tSIM_NextMsgGap();
+	}
+}
+
+/*****************************  STATS  ***************************************/
+
+static void vSIM_SlotStats(void)
+{
+	ulong ulTaskID;
+	ulong ulSN;
+	uchar ucc;
+	uint uiBacklog;
+
+	uiBacklog = uiL2SRAM_getMsgCount();
+	if (uiBacklog > g_SIM_Stats.uiMaxBacklog)
+		g_SIM_Stats.uiMaxBacklog = uiBacklog;
+	g_SIM_Stats.uiBacklog = uiBacklog;
+	g_SIM_Stats.uiLevel = ucGLOB_myLevel;
+
+	g_SIM_Stats.uiParentSN = 0;
+	g_SIM_Stats.uiChildren = 0;
+	for (ucc = 0; ucc < MAXNUMTASKS; ucc++) {
+		if (ucTask_GetField(ucc, TSK_ID, &ulTaskID) != TASKMNGR_OK)
+			continue;
+		if (ulTaskID == TASK_ID_SOM) {
+			ucTask_GetField(ucc, PARAM_SN, &ulSN);
+			g_SIM_Stats.uiParentSN = (uint) ulSN;
+		}
+		if (ulTaskID == TASK_ID_ROM)
+			g_SIM_Stats.uiChildren++;
+	}
+
+	if (g_SIM_Stats.tJoined < 0 && (g_SIM_Stats.uiParentSN != 0 || ucL2FRAM_isHub()))
+		g_SIM_Stats.tJoined = g_tSIM_Now;
+}
+
+//! Sends the counters and leaves, the answer to SIM_EV_END
+static void vSIM_Exit(void)
+{
+	S_SimReq S_Req;
+
+	vSIM_RadioFinish();
+	vSIM_InitReq(&S_Req, SIM_REQ_STATS);
+	vSIM_Write(&S_Req, offsetof(S_SimReq, ucaData));
+	vSIM_Write(&g_SIM_Stats, sizeof(g_SIM_Stats));
+	_exit(0);
+}
+
+/*************************  DISPATCHER  **************************************/
+
+//! vTask_Dispatch() from Tasks/task_dispatch.c
+static void vSIM_Dispatch(uchar ucNSTtblNum, uchar ucNSTslotNum)
+{
+	uchar ucaSlotArray[MAXNUM_TASKS_PERSLOT];
+	uint uiaFlagArray[MAXNUM_TASKS_PERSLOT];
+	uchar ucTaskCounter;
+	ulong ulFlags;
+	signed char cUseFullSlotIdx;
+
+	cUseFullSlotIdx = -1;
+	vRTS_getNSTentry(ucNSTtblNum, ucNSTslotNum, ucaSlotArray);
+
+	for (ucTaskCounter = 0; ucTaskCounter < MAXNUM_TASKS_PERSLOT; ucTaskCounter++) {
+		if (ucTask_GetField(ucaSlotArray[ucTaskCounter], TSK_FLAGS, &ulFlags) == TASKMNGR_OK) {
+			uiaFlagArray[ucTaskCounter] = (uint) ulFlags;
+			if ((uiaFlagArray[ucTaskCounter] & F_USE_FULL_SLOT))
+				cUseFullSlotIdx = ucTaskCounter;
+		}
+		else {
+			uiaFlagArray[ucTaskCounter] = 0;
+		}
+	}
+
+	if (cUseFullSlotIdx != -1) {
+		if (ucTime_SetSubslotAlarm(SUBSLOT_THREE_END, SUBSLOT_THREE_BUFFER_SIZE) == 0) {
+			g_ucaCurrentTskIndex = ucaSlotArray[(uchar) cUseFullSlotIdx];
+			p_saTaskList[g_ucaCurrentTskIndex].ptrTaskHandler();
+		}
+		while (ucTimeCheckForAlarms(SUBSLOT_END_ALARM_BIT) == 0)
+			LPM0;
+	}
+	else {
+		if (ucTime_SetSubslotAlarm(SUBSLOT_ONE_END, SUBSLOT_ONE_BUFFER_SIZE) == 0) {
+			for (ucTaskCounter = 0; ucTaskCounter < MAXNUM_TASKS_PERSLOT; ucTaskCounter++) {
+				if (uiaFlagArray[ucTaskCounter] & F_USE_START_OF_SLOT) {
+					g_ucaCurrentTskIndex = ucaSlotArray[ucTaskCounter];
+					p_saTaskList[ucaSlotArray[ucTaskCounter]].ptrTaskHandler();
+				}
+			}
+			while (ucTimeCheckForAlarms(SUBSLOT_END_ALARM_BIT) == 0)
+				LPM0;
+		}
+
+		if (ucTime_SetSubslotAlarm(SUBSLOT_TWO_END, SUBSLOT_TWO_BUFFER_SIZE) == 0) {
+			for (ucTaskCounter = 0; ucTaskCounter < MAXNUM_TASKS_PERSLOT; ucTaskCounter++) {
+				if (uiaFlagArray[ucTaskCounter] & F_USE_MIDDLE_OF_SLOT) {
+					g_ucaCurrentTskIndex = ucaSlotArray[ucTaskCounter];
+					p_saTaskList[ucaSlotArray[ucTaskCounter]].ptrTaskHandler();
+				}
+			}
+			while (ucTimeCheckForAlarms(SUBSLOT_END_ALARM_BIT) == 0)
+				LPM0;
+		}
+
+		if (ucTime_SetSubslotAlarm(SUBSLOT_THREE_END, SUBSLOT_THREE_BUFFER_SIZE) == 0) {
+			for (ucTaskCounter = 0; ucTaskCounter < MAXNUM_TASKS_PERSLOT; ucTaskCounter++) {
+				if (uiaFlagArray[ucTaskCounter] & F_USE_END_OF_SLOT) {
+					g_ucaCurrentTskIndex = ucaSlotArray[ucTaskCounter];
+					p_saTaskList[ucaSlotArray[ucTaskCounter]].ptrTaskHandler();
+				}
+			}
+		}
+	}
+
+	/* THE GENERATOR STANDS IN FOR vReport_BuildMsgsFromDEs() */
+	vSIM_GenerateTraffic();
+
+	vL2SRAM_checkpointQ();
+
+	for (ucTaskCounter = 0; ucTaskCounter < MAXNUM_TASKS_PERSLOT; ucTaskCounter++) {
+		if (uiaFlagArray[ucTaskCounter] & F_SUICIDE)
+			ucTask_DestroyTask(ucaSlotArray[ucTaskCounter]);
+		if (uiaFlagArray[ucTaskCounter] & F_SUSPEND)
+			ucTask_SetField(ucaSlotArray[ucTaskCounter], TSK_STATE, (ulong) TASK_STATE_IDLE);
+	}
+}
+
+//! vMAIN_computeDispatchTiming() from main.c
+static void vSIM_ComputeDispatchTiming(void)
+{
+	long lThisTime;
+	long lThisSlotEndTime;
+	long lOpUpTimeInSec;
+	long lThisLinearSlot;
+	long lThisFrameNum;
+
+	if (ucFLAG0_BYTE.FLAG0_STRUCT.FLG0_RESET_ALL_TIME_BIT) {
+		vTIME_setSysTimeFromClk2();
+
+		lGLOB_lastAwakeTime = lTIME_getSysTimeAsLong();
+		lOpUpTimeInSec = lGLOB_lastAwakeTime - lGLOB_OpMode0_inSec;
+		lGLOB_lastAwakeLinearSlot = lOpUpTimeInSec / SECS_PER_SLOT_L;
+		lGLOB_lastAwakeFrame = lGLOB_lastAwakeLinearSlot / SLOTS_PER_FRAME_I;
+		ucGLOB_lastAwakeSlot = (uint8) (lGLOB_lastAwakeLinearSlot % SLOTS_PER_FRAME_I);
+		ucGLOB_lastAwakeNSTtblNum = (uint8) (lGLOB_lastAwakeFrame % 2);
+		lGLOB_lastScheduledFrame = lGLOB_lastAwakeFrame;
+
+		if (ucRTS_getNSTSubSlotentry(ucGLOB_lastAwakeNSTtblNum, 59, 4) != ucTask_FetchTaskIndex(TASK_ID_SCHED))
+			vRTS_schedule_Scheduler_slot(ucTask_FetchTaskIndex(TASK_ID_SCHED), lGLOB_lastAwakeFrame);
+
+		ucFLAG0_BYTE.FLAG0_STRUCT.FLG0_RESET_ALL_TIME_BIT = 0;
+	}
+
+	while (lGLOB_lastAwakeTime > lTIME_getSysTimeAsLong())
+		;
+
+	lThisTime = lTIME_getSysTimeAsLong();
+	lOpUpTimeInSec = lThisTime - lGLOB_OpMode0_inSec;
+	lThisLinearSlot = lOpUpTimeInSec / SECS_PER_SLOT_L;
+	lThisFrameNum = lThisLinearSlot / SLOTS_PER_FRAME_I;
+
+	if (lThisLinearSlot != lGLOB_lastAwakeLinearSlot + 1L) {
+		if (lThisFrameNum > lGLOB_lastScheduledFrame)
+			vRTS_scheduleNSTtbl(lThisFrameNum);
+	}
+
+	lGLOB_lastAwakeTime = lTIME_getSysTimeAsLong();
+	lOpUpTimeInSec = lGLOB_lastAwakeTime - lGLOB_OpMode0_inSec;
+	lGLOB_lastAwakeLinearSlot = lOpUpTimeInSec / SECS_PER_SLOT_L;
+	lThisSlotEndTime = ((lGLOB_lastAwakeLinearSlot + 1) * SECS_PER_SLOT_L) + lGLOB_OpMode0_inSec;
+	lGLOB_lastAwakeFrame = lGLOB_lastAwakeLinearSlot / SLOTS_PER_FRAME_I;
+	ucGLOB_lastAwakeSlot = (uint8) (lGLOB_lastAwakeLinearSlot % SLOTS_PER_FRAME_I);
+	ucGLOB_lastAwakeNSTtblNum = (uint8) (lGLOB_lastAwakeFrame % 2);
+
+	while (ucTimeCheckForAlarms(GENERAL_ALARM_BIT) == 0)
+		LPM1;
+
+	vTIME_setAlarmFromLong(lThisSlotEndTime);
+}
+
+/***************************  NODE MAIN  *************************************/
+
+//! The node process, main() without the hardware checks
+void vSIM_NodeMain(const S_SimNodeCfg *p_Cfg, int iFd)
+{
+	S_SimRsp S_Rsp;
+
+	g_SIM_Cfg = *p_Cfg;
+	iSimFd = iFd;
+	memset(&g_SIM_Stats, 0, sizeof(g_SIM_Stats));
+	g_SIM_Stats.tJoined = -1;
+	ullSimRand = (g_SIM_Cfg.ulSeed * 0x9E3779B97F4A7C15ULL) | 1;
+
+	ldaSimClkHz[SIM_CLK_ACLK] = SIM_ACLK_HZ * (1.0L + (long double) g_SIM_Cfg.dPPM * 1e-6L);
+	ldaSimClkHz[SIM_CLK_SMCLK] = SIM_SMCLK_HZ * (1.0L + (long double) g_SIM_Cfg.dPPM * 1e-6L);
+	uiTA1Period = 0x10000;
+
+	/* NOTHING RUNS BEFORE POWER UP */
+	g_tSIM_Now = 0;
+	tSimHorizon = 0;
+	vSIM_Wait(g_SIM_Cfg.tBoot, &S_Rsp);
+
+	/* RAM INIT */
+	vSIM_HalInit();
+	ucFLAG0_BYTE.byte = 0;
+	ucFLAG1_BYTE.byte = 0;
+	ucFLAG2_BYTE.byte = 0;
+	ucFLAG3_BYTE.byte = 0;
+	uiGLOB_curMsgSeqNum = 1;
+	ucGLOB_radioChannel = ILLEGAL_CHANNEL;
+
+	/* A NEW NODE, THE FRAM AND SRAM ARE BLANK */
+	vL2FRAM_format_fram();
+	ucL2SRAM_resumeQ();
+	if (!ucL2SRAM_IsCmdQueueFormatted())
+		vL2SRAM_FormatCmd_Q();
+	else
+		vL2SRAM_LoadCmdIndex();
+
+	vTIME_init();
+
+	ucGLOB_myLevel = LEVEL_MAX_VAL;
+	if (ucL2FRAM_isHub()) {
+		ucGLOB_myLevel = 0;
+		vGID_init();
+	}
+
+	ucTask_Init();
+
+	ucRoute_Init(uiL2FRAM_getSnumLo16AsUint());
+	unADF7020_Initialize(NULL);
+	uslRAND_getNewSeed();
+
+	vLNKBLK_zeroEntireLnkBlkTbl();
+	vRTS_clrNSTtbl(0);
+	vRTS_clrNSTtbl(1);
+
+	lGLOB_OpMode0_inSec = 0;
+	lGLOB_lastAwakeTime = lTIME_getSysTimeAsLong();
+	lGLOB_opUpTimeInSec = lGLOB_lastAwakeTime - lGLOB_OpMode0_inSec;
+	lGLOB_lastAwakeLinearSlot = lGLOB_opUpTimeInSec / SECS_PER_SLOT_L;
+	lGLOB_lastAwakeFrame = lGLOB_lastAwakeLinearSlot / SLOTS_PER_FRAME_I;
+	ucGLOB_lastAwakeSlot = (uint8) (lGLOB_lastAwakeLinearSlot % SLOTS_PER_FRAME_I);
+	ucGLOB_lastAwakeNSTtblNum = (uint8) (lGLOB_lastAwakeFrame % 2);
+
+	vRTS_scheduleNSTtbl(lGLOB_lastAwakeFrame);
+
+	ucFLAG2_BYTE.FLAG2_STRUCT.FLG2_T1_ALARM_MCH_BIT = 0;
+	while (ucTimeCheckForAlarms(GENERAL_ALARM_BIT) == 0)
+		LPM1;
+	ucFLAG2_BYTE.FLAG2_STRUCT.FLG2_T1_ALARM_MCH_BIT = 0;
+
+	tSimNextMsg = g_tSIM_Now;
+	if (g_SIM_Cfg.dMsgPerMin > 0.0)
+		tSimNextMsg += tSIM_NextMsgGap();
+
+	while (1) {
+		vSIM_Dispatch(ucGLOB_lastAwakeNSTtblNum, ucGLOB_lastAwakeSlot);
+		vSIM_SlotStats();
+		vSIM_ComputeDispatchTiming();
+	}
+}
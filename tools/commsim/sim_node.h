@@ -0,0 +1,107 @@
+#ifndef SIM_NODE_H
+#define SIM_NODE_H
+///////////////////////////////////////////////////////////////////////////////
+//! \file sim_node.h
+//! \brief What the parts of a commsim node process share
+//!
+//! sim_node.c keeps the node's virtual time and timers and talks to the
+//! coordinator, sim_radio.c stands in for the ADF7020 driver and sim_hal.c
+//! holds the globals and stubs the firmware expects from the modules that
+//! are not linked.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "commsim.h"
+
+/* THE FLAG BYTES, LAID OUT AS IN MAIN.C */
+typedef union
+{
+	unsigned char byte;
+	struct
+	{
+		unsigned FLG0_BIGSUB_CARRY_BIT :1;
+		unsigned FLG0_BIGSUB_6_BYTE_Z_BIT :1;
+		unsigned FLG0_BIGSUB_TOP_4_BYTE_Z_BIT :1;
+		unsigned FLG0_REDIRECT_COMM_TO_ESPORT_BIT :1;
+		unsigned FLG0_RESET_ALL_TIME_BIT :1;
+		unsigned FLG0_SERIAL_BINARY_MODE_BIT :1;
+		unsigned FLG0_HAVE_WIZ_GROUP_TIME_BIT :1;
+		unsigned FLG0_ECLK_OFFLINE_BIT :1;
+	} FLAG0_STRUCT;
+} U_SimFlag0;
+
+typedef union
+{
+	unsigned char byte;
+	struct
+	{
+		unsigned FLG1_X_DONE_BIT :1;
+		unsigned FLG1_X_LAST_BIT_BIT :1;
+		unsigned FLG1_X_FLAG_BIT :1;
+		unsigned FLG1_R_HAVE_MSG_BIT :1;
+		unsigned FLG1_R_CODE_PHASE_BIT :1;
+		unsigned FLG1_R_ABORT_BIT :1;
+		unsigned FLG1_X_NXT_LEVEL_BIT :1;
+		unsigned FLG1_R_SAMPLE_BIT :1;
+	} FLAG1_STRUCT;
+} U_SimFlag1;
+
+typedef union
+{
+	unsigned char byte;
+	struct
+	{
+		unsigned FLG2_T3_ALARM_MCH_BIT :1;
+		unsigned FLG2_T1_ALARM_MCH_BIT :1;
+		unsigned FLG2_T2_ALARM_MCH_BIT :1;
+		unsigned FLG2_CLK_INT_BIT :1;
+		unsigned FLG2_X_FROM_MSG_BUFF_BIT :1;
+		unsigned FLG2_R_BUSY_BIT :1;
+		unsigned FLG2_R_BARKER_ODD_EVEN_BIT :1;
+		unsigned FLG2_R_BITVAL_BIT :1;
+	} FLAG2_STRUCT;
+} U_SimFlag2;
+
+typedef union
+{
+	unsigned char byte;
+	struct
+	{
+		unsigned FLG3_RADIO_ON_BIT :1;
+		unsigned FLG3_RADIO_MODE_BIT :1;
+		unsigned FLG3_RADIO_PROGRAMMED :1;
+		unsigned FLG2_BUTTON_INT_BIT :1;
+		unsigned FLG3_LINKSLOT_ALARM :1;
+		unsigned FLG3_LPM_DELAY_ALARM :1;
+		unsigned FLG3_KEY_PRESSED :1;
+		unsigned FLG3_GSV_COM_BIT :1;
+	} FLAG3_STRUCT;
+} U_SimFlag3;
+
+extern volatile U_SimFlag0 ucFLAG0_BYTE;
+extern volatile U_SimFlag1 ucFLAG1_BYTE;
+extern volatile U_SimFlag2 ucFLAG2_BYTE;
+extern volatile U_SimFlag3 ucFLAG3_BYTE;
+
+/* SIM_NODE.C */
+extern S_SimNodeCfg g_SIM_Cfg;
+extern S_SimStats g_SIM_Stats;
+extern simtime_t g_tSIM_Now;
+
+void vSIM_Poll(simtime_t tCost);
+void vSIM_WaitForInterrupt(void);
+void vSIM_WakeFromISR(void);
+void vSIM_SendRadio(int iState, int iChannel);
+void vSIM_SendTx(int iChannel, const unsigned char *p_ucaData, int iLen);
+void vSIM_SendDeliver(unsigned int uiSrcSN, unsigned long ulSeq, simtime_t tGenerated);
+void vSIM_SetRadioTimer(simtime_t t);
+unsigned long ulSIM_Random(void);
+
+/* SIM_RADIO.C */
+void vSIM_RadioEvent(const S_SimRsp *p_Rsp);
+void vSIM_RadioTimerISR(void);
+void vSIM_RadioFinish(void);
+
+/* SIM_HAL.C */
+void vSIM_HalInit(void);
+
+#endif /* SIM_NODE_H */
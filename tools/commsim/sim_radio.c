@@ -0,0 +1,426 @@
+///////////////////////////////////////////////////////////////////////////////
+//! \file sim_radio.c
+//! \brief The ADF7020 driver of a commsim node
+//!
+//! Replaces drivers/adf7020.c and the radio parts of hal/irupt.c.  The
+//! functions keep the driver's states, delays, buffers and whitening.  The
+//! bits are not clocked: a transmission is handed to the coordinator whole
+//! and the packet end interrupt fires after its airtime, a reception arrives
+//! as a sync word event followed by a packet end event.
+//!
+//! unADF7020_GetRadioState() is only polled by ucComm_waitForMsgOrTimeout()
+//! while it waits for a packet, so it sleeps until the next interrupt
+//! before it answers.
+///////////////////////////////////////////////////////////////////////////////
+
+#include <msp430.h>
+#include <string.h>
+#include "std.h"
+#include "comm.h"
+#include "adf7020.h"
+#include <time_wisard.h>
+#include "sim_node.h"
+
+extern uchar ucGLOB_radioChannel;
+extern uchar volatile g_ucLatencyTimerState;
+
+//! \def SIM_RADIO_BAUD
+//! \brief Bits per second on the air
+#define SIM_RADIO_BAUD			19200LL
+
+//! \def SIM_RSSI_SAMPLES
+//! \brief Size of the driver's RSSI array
+#define SIM_RSSI_SAMPLES		0x20
+
+/* POWER STATES FOR THE DUTY CYCLE */
+#define SIM_PWR_OFF				0
+#define SIM_PWR_RX				1
+#define SIM_PWR_TX				2
+
+static DriverState_t eSimDriverState = SHUTDOWN;
+static RadioState_t eSimRadioState = RADIO_OFF;
+static ulong ulSimPacketSize;
+static uchar ucaSimTxBuffer[ADF7020_TX_BUFFER_SIZE];
+static uchar ucaSimRxBuffer[ADF7020_RX_BUFFER_SIZE];
+static uchar ucSimChannel;
+
+//! \var ucSimArmed
+//! \brief The INT/LOCK interrupt is on, the receiver can take a sync word
+static uchar ucSimArmed;
+
+/* RSSI OF THE PACKET BEING RECEIVED AND THE DRIVER'S SAMPLES */
+static int iSimRxRSSI;
+static uchar ucSimRSSI_Idx;
+static int iaSimRSSI_Arr[SIM_RSSI_SAMPLES];
+
+/* DUTY CYCLE ACCOUNTING */
+static int iSimPower;
+static simtime_t tSimPowerSince;
+
+//! Books the time spent in the last power state and enters a new one
+static void vSIM_SetPower(int iPower)
+{
+	simtime_t tSpent;
+
+	tSpent = g_tSIM_Now - tSimPowerSince;
+	if (iSimPower == SIM_PWR_RX)
+		g_SIM_Stats.tRadioRx += tSpent;
+	if (iSimPower == SIM_PWR_TX)
+		g_SIM_Stats.tRadioTx += tSpent;
+	if (iSimPower != SIM_PWR_OFF)
+		g_SIM_Stats.tRadioOn += tSpent;
+
+	iSimPower = iPower;
+	tSimPowerSince = g_tSIM_Now;
+}
+
+//! Turns the INT/LOCK interrupt off
+static void vSIM_Disarm(void)
+{
+	if (ucSimArmed) {
+		ucSimArmed = 0;
+		vSIM_SendRadio(SIM_RX_OFF, ucSimChannel);
+	}
+}
+
+//! Turns the INT/LOCK interrupt on, a packet before its sync word survives
+static void vSIM_Arm(void)
+{
+	if (ucSimArmed && eSimRadioState == RX_IDLE) {
+		vSIM_SendRadio(SIM_RX_KEEP, ucSimChannel);
+		return;
+	}
+	ucSimArmed = 1;
+	vSIM_SendRadio(SIM_RX_ARMED, ucSimChannel);
+}
+
+//! Books the radio time up to the end of the run
+void vSIM_RadioFinish(void)
+{
+	vSIM_SetPower(iSimPower);
+}
+
+/*****************************  INTERRUPTS  **********************************/
+
+//! The coordinator's sync word and packet end events (PORT1_ISR)
+void vSIM_RadioEvent(const S_SimRsp *p_Rsp)
+{
+	int iLen;
+
+	switch (p_Rsp->iEvent)
+	{
+		case SIM_EV_SYNC:
+			if (!ucSimArmed || eSimRadioState != RX_IDLE)
+				break;
+
+			/* TO MEASURE RX AND DECODING TIME START THE TIMER (LATENCY_TIMER_CTL) */
+			TB0CTL |= g_ucLatencyTimerState;
+
+			iSimRxRSSI = p_Rsp->iRSSI;
+			eSimRadioState = RX_ACTIVE;
+		break;
+
+		case SIM_EV_DONE:
+			if (eSimRadioState != RX_ACTIVE)
+				break;
+
+			/* THE COORDINATOR HAS ALREADY DROPPED THE RECEIVER */
+			ucSimArmed = 0;
+
+			iLen = p_Rsp->iLen;
+			if (iLen > ADF7020_RX_BUFFER_SIZE)
+				iLen = ADF7020_RX_BUFFER_SIZE;
+			memcpy(ucaSimRxBuffer, p_Rsp->ucaData, (size_t) iLen);
+			if (iLen > 11)
+				ulSimPacketSize = (ulong) ((ucaSimRxBuffer[10] ^ 0x0A) + 6);
+
+			g_SIM_Stats.ulRxPkts++;
+			eSimRadioState = RX_IDLE;
+			ucFLAG1_BYTE.FLAG1_STRUCT.FLG1_R_HAVE_MSG_BIT = 1;
+			vSIM_WakeFromISR();
+		break;
+
+		default:
+		break;
+	}
+}
+
+//! The last bit has gone out (TIMER0_A1_ISR)
+void vSIM_RadioTimerISR(void)
+{
+	if (eSimRadioState != TX_ACTIVE)
+		return;
+	eSimRadioState = TX_IDLE;
+	vSIM_WakeFromISR();
+}
+
+/*******************************  DRIVER  ************************************/
+
+RadioRetCode_t unADF7020_Initialize(ADF7020_Configuration_t * pConfig)
+{
+	(void) pConfig;
+	if (eSimDriverState != SHUTDOWN)
+		return ADF7020_BAD_STATE_FOR_ACTION;
+
+	eSimRadioState = RADIO_OFF;
+	ulSimPacketSize = ADF7020_PACKETSIZE_DEFAULT;
+	memset(ucaSimRxBuffer, 0, sizeof(ucaSimRxBuffer));
+	memset(ucaSimTxBuffer, 0, sizeof(ucaSimTxBuffer));
+	vSIM_Disarm();
+	eSimDriverState = ACTIVE;
+
+	return ADF7020_OK;
+}
+
+RadioState_t unADF7020_GetRadioState(void)
+{
+	vSIM_WaitForInterrupt();
+	return eSimRadioState;
+}
+
+RadioRetCode_t unADF7020_SetChannel(uint8 ucChannel)
+{
+	if (ucChannel >= ADF7020_MAX_CHANNEL)
+		return ADF7020_CHANNEL_OUT_OF_RANGE;
+
+	ucGLOB_radioChannel = ucChannel;
+	ucSimChannel = ucChannel;
+
+	return ADF7020_OK;
+}
+
+RadioRetCode_t unADF7020_LoadTXBuffer(uint8 * pBuffer)
+{
+	uint16 unLoopCount;
+
+	if (eSimRadioState == TX_ACTIVE)
+		return ADF7020_BAD_STATE_FOR_ACTION;
+
+	/* WHITEN THE DATA, EACH BYTE IS XORED WITH ITS POSITION */
+	for (unLoopCount = 0; unLoopCount < ulSimPacketSize; unLoopCount++)
+		ucaSimTxBuffer[unLoopCount] = (uchar) (*pBuffer++ ^ unLoopCount);
+
+	return ADF7020_OK;
+}
+
+RadioRetCode_t unADF7020_ReadRXBuffer(volatile uint8 * pRXData)
+{
+	uint16 unLoopCount;
+
+	if (eSimRadioState == RX_ACTIVE)
+		return ADF7020_BAD_STATE_FOR_ACTION;
+
+	/* THE + 6 IS FOR THE NETWORK LAYER AND CRC, UNDO THE WHITENING */
+	for (unLoopCount = 0; unLoopCount < ulSimPacketSize + NET_HDR_SZ + CRC_SZ; unLoopCount++) {
+		ucaSimRxBuffer[unLoopCount] ^= unLoopCount;
+		*pRXData++ = ucaSimRxBuffer[unLoopCount];
+	}
+
+	return ADF7020_OK;
+}
+
+RadioRetCode_t unADF7020_SetRadioState(RadioState_t eState)
+{
+	if (eSimDriverState == SHUTDOWN)
+		return ADF7020_BAD_STATE_FOR_ACTION;
+
+	switch (eState)
+	{
+		case RADIO_OFF:
+			vSIM_Disarm();
+			vSIM_SetRadioTimer(SIM_TIME_NEVER);
+			eSimRadioState = RADIO_OFF;
+			vSIM_SetPower(SIM_PWR_OFF);
+		break;
+
+		case RX_IDLE:
+		case RX_ACTIVE:
+			vSIM_Disarm();
+			vSIM_SetPower(SIM_PWR_RX);
+			__delay_cycles(160);
+
+			/* OSCILLATOR, THEN IF FILTER CALIBRATION */
+			vTime_SetLPM_DelayAlarm(ON, 2000);
+			LPM1;
+			vTime_SetLPM_DelayAlarm(OFF, 0);
+			vTime_SetLPM_DelayAlarm(ON, 200);
+			LPM0;
+			vTime_SetLPM_DelayAlarm(OFF, 0);
+
+			ucSimRSSI_Idx = 0x00;
+			ulSimPacketSize = ADF7020_PACKETSIZE_DEFAULT;
+			eSimRadioState = RX_IDLE;
+			vSIM_Arm();
+		break;
+
+		case TX_IDLE:
+		case TX_ACTIVE:
+			vSIM_Disarm();
+			vSIM_SetPower(SIM_PWR_TX);
+			__delay_cycles(160);
+
+			vTime_SetLPM_DelayAlarm(ON, 2000);
+			LPM1;
+			vTime_SetLPM_DelayAlarm(OFF, 0);
+
+			eSimRadioState = TX_IDLE;
+		break;
+
+		default:
+			return ADF7020_UNKNOWN_STATE;
+	}
+
+	return ADF7020_OK;
+}
+
+void vADF7020_TXRXSwitch(uchar ucMode)
+{
+	if (ucMode == RADIO_TX_MODE) {
+		vSIM_Disarm();
+		vSIM_SetPower(SIM_PWR_TX);
+		eSimRadioState = TX_IDLE;
+	}
+	else if (ucMode == RADIO_RX_MODE) {
+		vSIM_SetPower(SIM_PWR_RX);
+		ulSimPacketSize = ADF7020_PACKETSIZE_DEFAULT;
+		ucSimRSSI_Idx = 0x00;
+		vSIM_Arm();
+		eSimRadioState = RX_IDLE;
+	}
+}
+
+void vADF7020_SetPacketLength(ulong ulLength)
+{
+	ulSimPacketSize = ulLength;
+}
+
+RadioRetCode_t unADF7020_StartTransmission(void)
+{
+	simtime_t tAirtime;
+	int iLen;
+
+	if (eSimRadioState != TX_IDLE)
+		return ADF7020_BAD_STATE_FOR_ACTION;
+
+	iLen = (int) ulSimPacketSize;
+	if (iLen > SIM_MAX_PKT)
+		iLen = SIM_MAX_PKT;
+
+	/* PREAMBLE, SYNC WORD AND PACKET, ONE BIT PER DATA CLOCK */
+	tAirtime = ((ADF7020_PREAMBLE_BYTE_COUNT + iLen) * 8 * SIM_NS_PER_SEC) / SIM_RADIO_BAUD;
+
+	vSIM_SendTx(ucSimChannel, ucaSimTxBuffer, iLen);
+	vSIM_SetRadioTimer(g_tSIM_Now + tAirtime);
+	g_SIM_Stats.ulTxPkts++;
+
+	eSimRadioState = TX_ACTIVE;
+	return ADF7020_OK;
+}
+
+void vADF7020_WakeUp(void)
+{
+	if (eSimDriverState != ACTIVE)
+		unADF7020_Initialize(NULL);
+
+	ucGLOB_radioChannel = 0x00;
+
+	unADF7020_SetRadioState(RX_IDLE);
+
+	ucFLAG3_BYTE.FLAG3_STRUCT.FLG3_RADIO_ON_BIT = 1;
+	ucFLAG3_BYTE.FLAG3_STRUCT.FLG3_RADIO_PROGRAMMED = 1;
+}
+
+void vADF7020_Quit(void)
+{
+	unADF7020_SetRadioState(RADIO_OFF);
+
+	ucFLAG1_BYTE.FLAG1_STRUCT.FLG1_R_ABORT_BIT = 1;
+	ucFLAG1_BYTE.FLAG1_STRUCT.FLG1_R_HAVE_MSG_BIT = 0;
+	ucFLAG3_BYTE.FLAG3_STRUCT.FLG3_RADIO_ON_BIT = 0;
+}
+
+usl uslADF7020_GetRandomNoise(void)
+{
+	usl uslRetVal;
+	uint uiIdx;
+
+	vADF7020_StartReceiver();
+
+	/* FORCE A PACKET, THE RECEIVER CLOCKS IN A DEFAULT SIZED PACKET OF NOISE */
+	vSIM_Disarm();
+	eSimRadioState = RX_ACTIVE;
+	for (uiIdx = 0; uiIdx < ADF7020_PACKETSIZE_DEFAULT; uiIdx++)
+		ucaSimRxBuffer[uiIdx] = (uchar) ulSIM_Random();
+	vSIM_Poll((ADF7020_PACKETSIZE_DEFAULT * 8 * SIM_NS_PER_SEC) / SIM_RADIO_BAUD);
+	eSimRadioState = RX_IDLE;
+
+	uslRetVal = ucaSimRxBuffer[4];
+	uslRetVal <<= 8;
+	uslRetVal |= ucaSimRxBuffer[5];
+	uslRetVal <<= 8;
+	uslRetVal |= ucaSimRxBuffer[6];
+	uslRetVal <<= 8;
+	uslRetVal |= ucaSimRxBuffer[7];
+
+	vADF7020_Quit();
+
+	return uslRetVal;
+}
+
+void vADF7020_SendMsg(void)
+{
+	if (eSimDriverState != ACTIVE)
+		vADF7020_WakeUp();
+
+	if (eSimRadioState != TX_IDLE)
+		unADF7020_SetRadioState(TX_IDLE);
+
+	unADF7020_StartTransmission();
+	LPM0;
+}
+
+void vADF7020_StartReceiver(void)
+{
+	if (eSimDriverState != ACTIVE)
+		vADF7020_WakeUp();
+	if (eSimRadioState != RX_IDLE)
+		unADF7020_SetRadioState(RX_IDLE);
+}
+
+void vADF7020_abort_receiver(void)
+{
+	ucFLAG1_BYTE.FLAG1_STRUCT.FLG1_R_ABORT_BIT = 1;
+	ucFLAG1_BYTE.FLAG1_STRUCT.FLG1_R_HAVE_MSG_BIT = 0;
+}
+
+//! One reading of the readback register, the level of the packet being received
+uint8 ucADF7020_SampleRSSI(void)
+{
+	if (ucSimRSSI_Idx >= SIM_RSSI_SAMPLES)
+		return 1;
+
+	iaSimRSSI_Arr[ucSimRSSI_Idx] = iSimRxRSSI;
+	ucSimRSSI_Idx++;
+
+	return 0;
+}
+
+//! Average of the samples, the level of the last packet if none were taken
+int16 iADF7020_RequestRSSI(void)
+{
+	long lRSSI_Temp;
+	int16 iRSSI_Ave;
+	uint8 ucCounter;
+
+	if (ucSimRSSI_Idx == 0)
+		return (int16) iSimRxRSSI;
+
+	lRSSI_Temp = 0;
+	for (ucCounter = 0; ucCounter < ucSimRSSI_Idx; ucCounter++)
+		lRSSI_Temp += iaSimRSSI_Arr[ucCounter];
+
+	iRSSI_Ave = (int16) (lRSSI_Temp / ucSimRSSI_Idx);
+	ucSimRSSI_Idx = 0;
+
+	return iRSSI_Ave;
+}
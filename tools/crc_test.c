@@ -0,0 +1,299 @@
+///////////////////////////////////////////////////////////////////////////////
+//! \file crc_test.c
+//! \brief Host test of the CRC routines in comm_module/crc.c
+//!
+//! comm_module/crc.c is built with CRC_HOST_BUILD, which runs the same byte
+//! loop as the CRC16 module on the part but from a 256 entry table.  Every
+//! routine of crc.c is compared against the nibble table code it replaced
+//! (copied below from the V1.01 crc.c) over random buffers, lengths and
+//! initial values, and both must give 0x29B1 for the "123456789" check
+//! vector.
+//!
+//! Build and run (from the repository root):
+//!
+//!     cc -std=c99 -O2 -Wall -Wextra -DCRC_HOST_BUILD -I. -Idrivers -o crc_test tools/crc_test.c comm_module/crc.c
+//!     ./crc_test [seed]
+//!
+//! The exit status is 1 if a check failed.
+///////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// comm_module/crc.c
+unsigned char ucCRC16_compute_msg_CRC(unsigned char ucMsgFlag, volatile unsigned char *ucMSGBuff, unsigned char ucLength);
+unsigned int uiCRC16_ComputeBlockCRC(unsigned char *ucPointer, unsigned long ulLength);
+unsigned int uiCRC16_CRC_on_memory(unsigned long *ulPointer, unsigned long ulLength);
+unsigned int uiCRC16_ComputeCRCwithInit(unsigned char *ucPointer, unsigned long ulLength, unsigned int uiInitialCRC);
+
+#define CRC_FOR_MSG_TO_SEND 1
+#define CRC_FOR_MSG_TO_REC  0
+
+//! \def MAX_OM_MSG_LENGTH
+//! \brief Longest message ucCRC16_compute_msg_CRC() takes, same as comm.h
+#define MAX_OM_MSG_LENGTH	0x40
+
+//! \def TEST_ROUNDS
+//! \brief Random buffers per routine
+#define TEST_ROUNDS			20000
+
+//! \def TEST_BUF_LEN
+//! \brief Longest random buffer, a bit over one SD card block
+#define TEST_BUF_LEN		600
+
+static unsigned int uiFailCount;
+static unsigned long ulRandState;
+
+/*************************  OLD NIBBLE TABLE CRC  ****************************/
+
+#define CRC16_HI 0
+#define CRC16_LO 1
+
+static const unsigned char ucCRC16_lookupHI[16] =
+		{
+        0x00, 0x10, 0x20, 0x30, 0x40, 0x50, 0x60, 0x70,
+        0x81, 0x91, 0xA1, 0xB1, 0xC1, 0xD1, 0xE1, 0xF1
+		};
+
+static const unsigned char ucCRC16_lookupLO[16] =
+		{
+        0x00, 0x21, 0x42, 0x63, 0x84, 0xA5, 0xC6, 0xE7,
+        0x08, 0x29, 0x4A, 0x6B, 0x8C, 0xAD, 0xCE, 0xEF
+		};
+
+static void vOld_updateNibble(unsigned char ucNibble, unsigned char ucCRCarray[2])
+{
+	unsigned char ucTmp;
+
+	ucTmp = ucCRCarray[CRC16_HI] >> 4;
+	ucTmp = ucTmp ^ ucNibble;
+
+	ucCRCarray[CRC16_HI] = (ucCRCarray[CRC16_HI] << 4) | (ucCRCarray[CRC16_LO] >> 4);
+	ucCRCarray[CRC16_LO] = ucCRCarray[CRC16_LO] << 4;
+
+	ucCRCarray[CRC16_HI] = ucCRCarray[CRC16_HI] ^ ucCRC16_lookupHI[ucTmp];
+	ucCRCarray[CRC16_LO] = ucCRCarray[CRC16_LO] ^ ucCRC16_lookupLO[ucTmp];
+}
+
+static void vOld_updateByte(unsigned char ucByteVal, unsigned char ucCRCarray[2])
+{
+	vOld_updateNibble(ucByteVal >> 4, ucCRCarray);
+	vOld_updateNibble(ucByteVal & 0x0F, ucCRCarray);
+}
+
+static unsigned char ucOld_compute_msg_CRC(unsigned char ucMsgFlag, volatile unsigned char *ucMSGBuff, unsigned char ucLength)
+{
+	unsigned char uc;
+	unsigned char ucLimit;
+	unsigned char ucCRCarray[2];
+
+	ucLimit = ucLength - 1;
+
+	if (ucLimit < 2)
+		return 0;
+	if (ucLimit > MAX_OM_MSG_LENGTH)
+		return 0;
+
+	ucCRCarray[CRC16_HI] = 0xFF;
+	ucCRCarray[CRC16_LO] = 0xFF;
+
+	if (ucMsgFlag == CRC_FOR_MSG_TO_SEND)
+		ucLimit -= 2;
+
+	for (uc = 0; uc <= ucLimit; uc++)
+		vOld_updateByte(*ucMSGBuff++, ucCRCarray);
+
+	if (ucMsgFlag == CRC_FOR_MSG_TO_SEND) {
+		*ucMSGBuff++ = ucCRCarray[CRC16_HI];
+		*ucMSGBuff++ = ucCRCarray[CRC16_LO];
+		return 1;
+	}
+
+	if ((!ucCRCarray[CRC16_HI]) && (!ucCRCarray[CRC16_LO]))
+		return 1;
+
+	return 0;
+}
+
+static unsigned int uiOld_ComputeCRCwithInit(unsigned char *ucPointer, unsigned long ulLength, unsigned int uiInitialCRC)
+{
+	unsigned long ulByteCount;
+	unsigned char ucCRCarray[2];
+
+	ucCRCarray[CRC16_LO] = (unsigned char) uiInitialCRC;
+	ucCRCarray[CRC16_HI] = (unsigned char) (uiInitialCRC >> 8);
+
+	for (ulByteCount = 0; ulByteCount < ulLength; ulByteCount++)
+		vOld_updateByte(*ucPointer++, ucCRCarray);
+
+	return (unsigned int) (ucCRCarray[CRC16_HI] << 8) | (ucCRCarray[CRC16_LO]);
+}
+
+static unsigned int uiOld_ComputeBlockCRC(unsigned char *ucPointer, unsigned long ulLength)
+{
+	return uiOld_ComputeCRCwithInit(ucPointer, ulLength, 0xFFFF);
+}
+
+static unsigned int uiOld_CRC_on_memory(unsigned long *ulPointer, unsigned long ulLength)
+{
+	unsigned long ulByteCount;
+	unsigned char ucCRCarray[2];
+
+	ucCRCarray[CRC16_HI] = 0xFF;
+	ucCRCarray[CRC16_LO] = 0xFF;
+
+	for (ulByteCount = 0; ulByteCount <= ulLength; ulByteCount++)
+		vOld_updateByte((unsigned char) *ulPointer++, ucCRCarray);
+
+	return (unsigned int) (ucCRCarray[CRC16_HI] << 8) | (ucCRCarray[CRC16_LO]);
+}
+
+/*****************************  TEST HELPERS  *******************************/
+
+///////////////////////////////////////////////////////////////////////////////
+//! \brief xorshift32, the same seed gives the same buffers on every host
+///////////////////////////////////////////////////////////////////////////////
+static unsigned long ulTest_Random(void)
+{
+	ulRandState ^= (ulRandState << 13) & 0xFFFFFFFFUL;
+	ulRandState ^= ulRandState >> 17;
+	ulRandState ^= (ulRandState << 5) & 0xFFFFFFFFUL;
+	return ulRandState;
+}
+
+static void vTest_Fill(unsigned char *ucpBuf, unsigned int uiLen)
+{
+	unsigned int uiii;
+
+	for (uiii = 0; uiii < uiLen; uiii++)
+		ucpBuf[uiii] = (unsigned char) ulTest_Random();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//! \brief Counts and reports a mismatch, only the first few are printed
+//!
+//! \return 1 if the values differ
+///////////////////////////////////////////////////////////////////////////////
+static int iTest_Compare(const char *cpWhat, unsigned long ulNew, unsigned long ulOld, unsigned int uiLen)
+{
+	if (ulNew == ulOld)
+		return 0;
+
+	if (uiFailCount < 10)
+		printf("FAIL %s len %u: new 0x%04lX old 0x%04lX\n", cpWhat, uiLen, ulNew, ulOld);
+	uiFailCount++;
+	return 1;
+}
+
+/********************************  TESTS  ***********************************/
+
+static void vTest_CheckVector(void)
+{
+	unsigned char ucaVector[] = "123456789";
+	unsigned char ucaMsg[11];
+
+	iTest_Compare("check vector", uiCRC16_ComputeBlockCRC(ucaVector, 9), 0x29B1, 9);
+	iTest_Compare("check vector (old)", uiOld_ComputeBlockCRC(ucaVector, 9), 0x29B1, 9);
+
+	// The message routine stuffs the same CRC behind the message
+	memcpy(ucaMsg, ucaVector, 9);
+	ucCRC16_compute_msg_CRC(CRC_FOR_MSG_TO_SEND, ucaMsg, sizeof(ucaMsg));
+	iTest_Compare("check vector msg", (unsigned long) (ucaMsg[9] << 8) | ucaMsg[10], 0x29B1, 11);
+	iTest_Compare("check vector msg rec", ucCRC16_compute_msg_CRC(CRC_FOR_MSG_TO_REC, ucaMsg, sizeof(ucaMsg)), 1, 11);
+}
+
+static void vTest_Blocks(void)
+{
+	static unsigned char ucaBuf[TEST_BUF_LEN];
+	unsigned int uiRound;
+	unsigned int uiLen;
+	unsigned int uiInit;
+
+	for (uiRound = 0; uiRound < TEST_ROUNDS; uiRound++) {
+		uiLen = (unsigned int) (ulTest_Random() % (TEST_BUF_LEN + 1));
+		uiInit = (unsigned int) (ulTest_Random() & 0xFFFF);
+		vTest_Fill(ucaBuf, uiLen);
+
+		iTest_Compare("ComputeBlockCRC", uiCRC16_ComputeBlockCRC(ucaBuf, uiLen), uiOld_ComputeBlockCRC(ucaBuf, uiLen), uiLen);
+		iTest_Compare("ComputeCRCwithInit", uiCRC16_ComputeCRCwithInit(ucaBuf, uiLen, uiInit),
+		    uiOld_ComputeCRCwithInit(ucaBuf, uiLen, uiInit), uiLen);
+	}
+}
+
+static void vTest_Memory(void)
+{
+	static unsigned long ulaBuf[TEST_BUF_LEN / 4 + 1];
+	unsigned int uiRound;
+	unsigned int uiLen;
+	unsigned int uiii;
+
+	for (uiRound = 0; uiRound < TEST_ROUNDS / 10; uiRound++) {
+		// The routine reads ulLength + 1 longs
+		uiLen = (unsigned int) (ulTest_Random() % (TEST_BUF_LEN / 4));
+		for (uiii = 0; uiii <= uiLen; uiii++)
+			ulaBuf[uiii] = ulTest_Random();
+
+		iTest_Compare("CRC_on_memory", uiCRC16_CRC_on_memory(ulaBuf, uiLen), uiOld_CRC_on_memory(ulaBuf, uiLen), uiLen);
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//! \brief Message CRCs, every length including the ones that are refused
+///////////////////////////////////////////////////////////////////////////////
+static void vTest_Messages(void)
+{
+	unsigned char ucaNew[MAX_OM_MSG_LENGTH + 8];
+	unsigned char ucaOld[MAX_OM_MSG_LENGTH + 8];
+	unsigned int uiRound;
+	unsigned int uiLen;
+	unsigned char ucRetNew;
+	unsigned char ucRetOld;
+
+	for (uiRound = 0; uiRound < TEST_ROUNDS; uiRound++) {
+		uiLen = uiRound % sizeof(ucaNew);
+		vTest_Fill(ucaNew, sizeof(ucaNew));
+		memcpy(ucaOld, ucaNew, sizeof(ucaOld));
+
+		// Send, the CRC is stuffed at the end
+		ucRetNew = ucCRC16_compute_msg_CRC(CRC_FOR_MSG_TO_SEND, ucaNew, (unsigned char) uiLen);
+		ucRetOld = ucOld_compute_msg_CRC(CRC_FOR_MSG_TO_SEND, ucaOld, (unsigned char) uiLen);
+		iTest_Compare("msg send ret", ucRetNew, ucRetOld, uiLen);
+		if (memcmp(ucaNew, ucaOld, sizeof(ucaNew)) != 0)
+			iTest_Compare("msg send bytes", 1, 0, uiLen);
+
+		// Receive the good message
+		ucRetNew = ucCRC16_compute_msg_CRC(CRC_FOR_MSG_TO_REC, ucaNew, (unsigned char) uiLen);
+		ucRetOld = ucOld_compute_msg_CRC(CRC_FOR_MSG_TO_REC, ucaOld, (unsigned char) uiLen);
+		iTest_Compare("msg rec good", ucRetNew, ucRetOld, uiLen);
+
+		// Receive it with a flipped bit
+		if (uiLen != 0) {
+			ucaNew[uiRound % uiLen] ^= (unsigned char) (1 << (uiRound % 8));
+			ucaOld[uiRound % uiLen] ^= (unsigned char) (1 << (uiRound % 8));
+		}
+		ucRetNew = ucCRC16_compute_msg_CRC(CRC_FOR_MSG_TO_REC, ucaNew, (unsigned char) uiLen);
+		ucRetOld = ucOld_compute_msg_CRC(CRC_FOR_MSG_TO_REC, ucaOld, (unsigned char) uiLen);
+		iTest_Compare("msg rec bad", ucRetNew, ucRetOld, uiLen);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	ulRandState = 0x2545F491UL;
+	if (argc > 1)
+		ulRandState = strtoul(argv[1], NULL, 0) | 1;
+
+	vTest_CheckVector();
+	vTest_Blocks();
+	vTest_Memory();
+	vTest_Messages();
+
+	if (uiFailCount != 0) {
+		printf("%u checks failed\n", uiFailCount);
+		return 1;
+	}
+
+	printf("all checks passed\n");
+	return 0;
+}
@@ -0,0 +1,431 @@
+///////////////////////////////////////////////////////////////////////////////
+//! \file frag_test.c
+//! \brief Host test of the message fragments in comm_module/comm_frag.c
+//!
+//! comm_module/comm_frag.c is compiled for the host against the register
+//! stubs of the simulator.  The SRAM queue, the message numbers and the SD
+//! log it calls are modelled here:
+//!
+//!     SRAM queue  vL2SRAM_storeMsgToSramIfAllowed() appends the message
+//!                 buffer, ucL2SRAM_getCopyOfCurMsgAt() reads it back
+//!     numbers     the same wrap rules as comm_utilities.c
+//!     SD log      vREPORT_LogReport() and vREPORT_LogMsg() keep a copy of
+//!                 what would have been logged
+//!
+//! Random messages of every length up to MAX_LOGICAL_MSG_SIZE are split and
+//! every packet is checked for its size, CRC, flags, number and fragment
+//! info.  The fragments are then put back together both ways the hub does
+//! it: from the radio in a shuffled order with repeats and with the ACK
+//! request a hop sets (vComm_Frag_LogReport()), and from the head of the
+//! SRAM queue (p_ucComm_Frag_CollectMsg()).  Either way the message must
+//! come back as it was before it was split, without the ACK request.
+//!
+//! Build and run (from the repository root):
+//!
+//!     cc -std=gnu99 -O2 -Wall -Wextra -DCRC_HOST_BUILD -Itools/commsim/host -I. -Ihal -Idrivers -Imem_mod -Icomm_module -ITasks -o frag_test tools/frag_test.c comm_module/comm_frag.c comm_module/crc.c
+//!     ./frag_test [seed]
+//!
+//! The exit status is 1 if a check failed.
+///////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "std.h"
+#include "comm.h"
+#include "crc.h"
+
+//! \def TEST_ROUNDS
+//! \brief Random messages split and put back together
+#define TEST_ROUNDS			20000
+
+//! \def TEST_Q_LEN
+//! \brief Packets the fake SRAM queue holds, two fragmented messages and some
+#define TEST_Q_LEN			(FRAG_MAX_COUNT * 4)
+
+volatile uint8 ucaMSG_BUFF[MAX_RESERVED_MSG_SIZE];
+
+static unsigned int uiFailCount;
+static unsigned long ulRandState;
+
+//! \var ucaTestQ
+//! \brief The fake SRAM queue, one packet per row
+static uchar ucaTestQ[TEST_Q_LEN][MAX_MSG_SIZE];
+static uint uiTestQHead;
+static uint uiTestQCount;
+
+//! \var ucaTestLog
+//! \brief Last message logged to the fake SD card
+static uchar ucaTestLog[MAX_LOGICAL_MSG_SIZE];
+static uint uiTestLogCount;
+
+static uint uiTestSeqNum;
+
+/*****************************  FIRMWARE STUBS  ******************************/
+
+void vL2SRAM_storeMsgToSramIfAllowed(void)
+{
+	uint uiLen;
+
+	uiLen = ucaMSG_BUFF[MSG_IDX_LEN] + NET_HDR_SZ + CRC_SZ;
+	if ((uiLen > MAX_MSG_SIZE) || (uiTestQCount >= TEST_Q_LEN)) {
+		printf("FAIL store len %u count %u\n", uiLen, uiTestQCount);
+		uiFailCount++;
+		return;
+	}
+
+	memcpy(ucaTestQ[(uiTestQHead + uiTestQCount) % TEST_Q_LEN], (const void *) ucaMSG_BUFF, uiLen);
+	uiTestQCount++;
+}
+
+uchar ucL2SRAM_getCopyOfCurMsgAt(uchar ucOffset)
+{
+	uchar *ucpMsg;
+
+	if (ucOffset >= uiTestQCount)
+		return 0;
+
+	ucpMsg = ucaTestQ[(uiTestQHead + ucOffset) % TEST_Q_LEN];
+	memcpy((void *) ucaMSG_BUFF, ucpMsg, ucpMsg[MSG_IDX_LEN] + NET_HDR_SZ + CRC_SZ);
+	return 1;
+}
+
+uint uiComm_incMsgSeqNum(void)
+{
+	uiTestSeqNum++;
+	if (uiTestSeqNum >= 0xFFFF)
+		uiTestSeqNum = 1;
+	return uiTestSeqNum;
+}
+
+uint uiComm_reserveMsgSeqNums(uchar ucCount)
+{
+	uint uiFirst;
+
+	if (((ulong) uiTestSeqNum + ucCount) >= 0xFFFF)
+		uiTestSeqNum = 0;
+	uiFirst = uiTestSeqNum + 1;
+	uiTestSeqNum += ucCount;
+	return uiFirst;
+}
+
+void vREPORT_LogReport(void)
+{
+	memcpy(ucaTestLog, (const void *) ucaMSG_BUFF, ucaMSG_BUFF[MSG_IDX_LEN] + NET_HDR_SZ);
+	uiTestLogCount++;
+}
+
+void vREPORT_LogMsg(volatile uchar *p_ucaMsg)
+{
+	memcpy(ucaTestLog, (const void *) p_ucaMsg, p_ucaMsg[MSG_IDX_LEN] + NET_HDR_SZ);
+	uiTestLogCount++;
+}
+
+void vSERIAL_sout(char *cpStr, uchar ucCount)
+{
+	(void) cpStr;
+	(void) ucCount;
+}
+
+/*****************************  TEST HELPERS  *******************************/
+
+///////////////////////////////////////////////////////////////////////////////
+//! \brief xorshift32, the same seed gives the same messages on every host
+///////////////////////////////////////////////////////////////////////////////
+static unsigned long ulTest_Random(void)
+{
+	ulRandState ^= (ulRandState << 13) & 0xFFFFFFFFUL;
+	ulRandState ^= ulRandState >> 17;
+	ulRandState ^= (ulRandState << 5) & 0xFFFFFFFFUL;
+	return ulRandState;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//! \brief Counts and reports a failed check, only the first few are printed
+///////////////////////////////////////////////////////////////////////////////
+static void vTest_Check(int iOk, const char *cpWhat, unsigned int uiRound)
+{
+	if (iOk)
+		return;
+
+	if (uiFailCount < 10)
+		printf("FAIL %s round %u\n", cpWhat, uiRound);
+	uiFailCount++;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//! \brief Builds a random message as report.c does, number and CRC left out
+//!
+//! \param ucpMsg, MAX_LOGICAL_MSG_SIZE byte buffer
+//! \param uiSrcSN, originating node
+//! \param ucLen, MSG_IDX_LEN of the message
+///////////////////////////////////////////////////////////////////////////////
+static void vTest_BuildMsg(uchar *ucpMsg, uint uiSrcSN, uchar ucLen)
+{
+	uint uiii;
+
+	memset(ucpMsg, 0, MAX_LOGICAL_MSG_SIZE);
+	for (uiii = 0; uiii < NET_HDR_SZ; uiii++)
+		ucpMsg[uiii] = (uchar) ulTest_Random();
+
+	// Any class and an ACK request left over from the last hop
+	ucpMsg[MSG_IDX_ID] = MSG_ID_OPERATIONAL;
+	ucpMsg[MSG_IDX_FLG] = (uchar) (ulTest_Random() & (MSG_FLG_CLASS_MASK | MSG_FLG_ACKRQST));
+	ucpMsg[MSG_IDX_ADDR_HI] = (uchar) (uiSrcSN >> 8);
+	ucpMsg[MSG_IDX_ADDR_LO] = (uchar) uiSrcSN;
+	ucpMsg[MSG_IDX_LEN] = ucLen;
+	for (uiii = MSG_IDX_PAYLD; uiii < (uint) (ucLen + NET_HDR_SZ); uiii++)
+		ucpMsg[uiii] = (uchar) ulTest_Random();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//! \brief Compares a message that was put back together with the original
+//!
+//! The fragment flags and the ACK request are gone and MSG_FLG_SINGLE is
+//! set, everything else including the message number is as it was.
+///////////////////////////////////////////////////////////////////////////////
+static void vTest_CheckWhole(const uchar *ucpGot, const uchar *ucpMsg, const char *cpWhat, unsigned int uiRound)
+{
+	uchar ucaWant[MAX_LOGICAL_MSG_SIZE];
+
+	memcpy(ucaWant, ucpMsg, MAX_LOGICAL_MSG_SIZE);
+	ucaWant[MSG_IDX_FLG] &= ~(MSG_FLG_BEG | MSG_FLG_END | MSG_FLG_ACKRQST);
+	ucaWant[MSG_IDX_FLG] |= MSG_FLG_SINGLE;
+
+	vTest_Check(memcmp(ucpGot, ucaWant, ucaWant[MSG_IDX_LEN] + NET_HDR_SZ) == 0, cpWhat, uiRound);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//! \brief Random MSG_IDX_LEN of a message too long for one packet
+///////////////////////////////////////////////////////////////////////////////
+static uchar ucTest_SplitLen(void)
+{
+	return (uchar) ((MAX_MSG_SIZE - NET_HDR_SZ - CRC_SZ + 1) + (ulTest_Random() % (MAX_LOGICAL_MSG_SIZE - MAX_MSG_SIZE)));
+}
+
+/********************************  TESTS  ***********************************/
+
+///////////////////////////////////////////////////////////////////////////////
+//! \brief Checks the packets vComm_Frag_StoreMsg() put in the queue
+//!
+//! \return fragments in the message, 0 if it went as one packet
+///////////////////////////////////////////////////////////////////////////////
+static uchar ucTest_CheckSplit(const uchar *ucpMsg, unsigned int uiRound)
+{
+	uint uiFirstNum;
+	uint uiPayld;
+	uint uiHave;
+	uchar ucCount;
+	uchar ucIdx;
+	uchar ucChunk;
+	uchar *ucpPkt;
+
+	uiFirstNum = (ucpMsg[MSG_IDX_NUM_HI] << 8) | ucpMsg[MSG_IDX_NUM_LO];
+	uiPayld = ucpMsg[MSG_IDX_LEN] - MSG_HDR_SZ;
+
+	if ((ucpMsg[MSG_IDX_LEN] + NET_HDR_SZ + CRC_SZ) <= MAX_MSG_SIZE) {
+		ucpPkt = ucaTestQ[uiTestQHead];
+		vTest_Check(uiTestQCount == 1, "single count", uiRound);
+		vTest_Check(ucCRC16_compute_msg_CRC(CRC_FOR_MSG_TO_REC, ucpPkt, ucpPkt[MSG_IDX_LEN] + NET_HDR_SZ + CRC_SZ), "single CRC", uiRound);
+		vTest_Check(ucpPkt[MSG_IDX_FLG] == (ucpMsg[MSG_IDX_FLG] | MSG_FLG_SINGLE), "single flags", uiRound);
+		vTest_Check(((ucpPkt[MSG_IDX_NUM_HI] << 8) | ucpPkt[MSG_IDX_NUM_LO]) == (int) uiFirstNum, "single number", uiRound);
+		vTest_Check(memcmp(&ucpPkt[MSG_IDX_PAYLD], &ucpMsg[MSG_IDX_PAYLD], uiPayld) == 0, "single payload", uiRound);
+		return 0;
+	}
+
+	ucCount = (uchar) ((uiPayld + FRAG_CHUNK_SZ - 1) / FRAG_CHUNK_SZ);
+	vTest_Check(uiTestQCount == ucCount, "fragment count", uiRound);
+
+	uiHave = 0;
+	for (ucIdx = 0; (ucIdx < ucCount) && (ucIdx < uiTestQCount); ucIdx++) {
+		ucpPkt = ucaTestQ[(uiTestQHead + ucIdx) % TEST_Q_LEN];
+		ucChunk = ucpPkt[MSG_IDX_LEN] - MSG_HDR_SZ - 1;
+
+		vTest_Check((ucpPkt[MSG_IDX_LEN] + NET_HDR_SZ + CRC_SZ) <= MAX_MSG_SIZE, "fragment size", uiRound);
+		vTest_Check(ucCRC16_compute_msg_CRC(CRC_FOR_MSG_TO_REC, ucpPkt, ucpPkt[MSG_IDX_LEN] + NET_HDR_SZ + CRC_SZ), "fragment CRC", uiRound);
+		vTest_Check(((ucpPkt[MSG_IDX_NUM_HI] << 8) | ucpPkt[MSG_IDX_NUM_LO]) == (int) (uiFirstNum + ucIdx), "fragment number", uiRound);
+		vTest_Check(ucpPkt[MSG_IDX_FRAG] == FRAG_INFO(ucIdx, ucCount), "fragment info", uiRound);
+		vTest_Check(!(ucpPkt[MSG_IDX_FLG] & (MSG_FLG_SINGLE | MSG_FLG_ACKRQST)), "fragment single or ACK request", uiRound);
+		vTest_Check(((ucpPkt[MSG_IDX_FLG] & MSG_FLG_BEG) != 0) == (ucIdx == 0), "fragment BEG", uiRound);
+		vTest_Check(((ucpPkt[MSG_IDX_FLG] & MSG_FLG_END) != 0) == (ucIdx == (ucCount - 1)), "fragment END", uiRound);
+		vTest_Check((ucpPkt[MSG_IDX_FLG] & MSG_FLG_CLASS_MASK) == (ucpMsg[MSG_IDX_FLG] & MSG_FLG_CLASS_MASK), "fragment class", uiRound);
+		vTest_Check((ucChunk == FRAG_CHUNK_SZ) || (ucIdx == (ucCount - 1)), "fragment chunk", uiRound);
+		vTest_Check(memcmp(&ucpPkt[MSG_IDX_FRAG + 1], &ucpMsg[MSG_IDX_PAYLD + uiHave], ucChunk) == 0, "fragment payload", uiRound);
+		uiHave += ucChunk;
+	}
+	vTest_Check(uiHave == uiPayld, "fragment payload length", uiRound);
+
+	return ucCount;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//! \brief Hands the queued fragments to the hub as if they came over the radio
+//!
+//! They arrive shuffled, some twice, and each with the ACK request of its
+//! hop.  The message is logged once, when the last missing fragment is in.
+///////////////////////////////////////////////////////////////////////////////
+static void vTest_LogReport(const uchar *ucpMsg, uchar ucCount, unsigned int uiRound)
+{
+	uchar ucaOrder[FRAG_MAX_COUNT * 2];
+	uchar ucSends;
+	uchar ucHave;
+	uchar ucii;
+	uchar ucjj;
+	uchar ucTmp;
+	uint uiLogged;
+
+	ucSends = 0;
+	for (ucii = 0; ucii < ucCount; ucii++) {
+		ucaOrder[ucSends++] = ucii;
+		if (ulTest_Random() & 3)
+			continue;
+		ucaOrder[ucSends++] = ucii;
+	}
+	for (ucii = ucSends - 1; ucii > 0; ucii--) {
+		ucjj = (uchar) (ulTest_Random() % (ucii + 1));
+		ucTmp = ucaOrder[ucii];
+		ucaOrder[ucii] = ucaOrder[ucjj];
+		ucaOrder[ucjj] = ucTmp;
+	}
+
+	ucHave = 0;
+	uiLogged = uiTestLogCount;
+	for (ucii = 0; ucii < ucSends; ucii++) {
+		ucL2SRAM_getCopyOfCurMsgAt(ucaOrder[ucii]);
+		ucaMSG_BUFF[MSG_IDX_FLG] |= MSG_FLG_ACKRQST;
+		vComm_Frag_LogReport();
+
+		ucHave |= (uchar) (1 << ucaOrder[ucii]);
+		vTest_Check((uiTestLogCount - uiLogged) == (ucHave == (uchar) ((1 << ucCount) - 1)), "log count", uiRound);
+		if (uiTestLogCount != uiLogged) {
+			vTest_CheckWhole(ucaTestLog, ucpMsg, "log message", uiRound);
+			uiLogged = uiTestLogCount;
+			ucHave = 0;
+		}
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//! \brief Puts the queued fragments together as the hub does for the upload
+//!
+//! The fragments are shuffled in the queue first, they may be queued in any
+//! order.  With one of them missing nothing comes back.
+///////////////////////////////////////////////////////////////////////////////
+static void vTest_CollectMsg(const uchar *ucpMsg, uchar ucCount, unsigned int uiRound)
+{
+	uchar ucaTmp[MAX_MSG_SIZE];
+	uchar ucFrags;
+	uchar ucii;
+	uchar ucjj;
+	volatile uchar *p_ucWhole;
+
+	for (ucii = ucCount - 1; ucii > 0; ucii--) {
+		ucjj = (uchar) (ulTest_Random() % (ucii + 1));
+		memcpy(ucaTmp, ucaTestQ[(uiTestQHead + ucii) % TEST_Q_LEN], MAX_MSG_SIZE);
+		memcpy(ucaTestQ[(uiTestQHead + ucii) % TEST_Q_LEN], ucaTestQ[(uiTestQHead + ucjj) % TEST_Q_LEN], MAX_MSG_SIZE);
+		memcpy(ucaTestQ[(uiTestQHead + ucjj) % TEST_Q_LEN], ucaTmp, MAX_MSG_SIZE);
+	}
+
+	p_ucWhole = p_ucComm_Frag_CollectMsg(&ucFrags);
+	vTest_Check(p_ucWhole != 0, "collect", uiRound);
+	vTest_Check(ucFrags == ucCount, "collect count", uiRound);
+	if (p_ucWhole != 0)
+		vTest_CheckWhole((const uchar *) p_ucWhole, ucpMsg, "collect message", uiRound);
+
+	// The last fragment has not been queued yet
+	uiTestQCount--;
+	p_ucWhole = p_ucComm_Frag_CollectMsg(&ucFrags);
+	vTest_Check((p_ucWhole == 0) && (ucFrags == 0), "collect with one missing", uiRound);
+	uiTestQCount++;
+}
+
+static void vTest_Messages(void)
+{
+	static uchar ucaMsg[MAX_LOGICAL_MSG_SIZE];
+	unsigned int uiRound;
+	uchar ucLen;
+	uchar ucCount;
+
+	for (uiRound = 0; uiRound < TEST_ROUNDS; uiRound++) {
+		uiTestQHead = (uint) (ulTest_Random() % TEST_Q_LEN);
+		uiTestQCount = 0;
+
+		ucLen = (uchar) (MSG_HDR_SZ + (ulTest_Random() % (MAX_LOGICAL_MSG_SIZE - NET_HDR_SZ - CRC_SZ - MSG_HDR_SZ + 1)));
+		vTest_BuildMsg(ucaMsg, (uint) (ulTest_Random() & 0xFFFF), ucLen);
+
+		vComm_Frag_StoreMsg(ucaMsg);
+		ucCount = ucTest_CheckSplit(ucaMsg, uiRound);
+		if (ucCount == 0)
+			continue;
+
+		vTest_LogReport(ucaMsg, ucCount, uiRound);
+		vTest_CollectMsg(ucaMsg, ucCount, uiRound);
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//! \brief Two nodes' fragments arriving interleaved, each is logged whole
+///////////////////////////////////////////////////////////////////////////////
+static void vTest_Interleaved(void)
+{
+	static uchar ucaMsgA[MAX_LOGICAL_MSG_SIZE];
+	static uchar ucaMsgB[MAX_LOGICAL_MSG_SIZE];
+	unsigned int uiRound;
+	uint uiStart;
+	uint uiLogged;
+	uchar ucCountA;
+	uchar ucCountB;
+	uchar ucii;
+
+	for (uiRound = 0; uiRound < TEST_ROUNDS / 10; uiRound++) {
+		uiTestQHead = 0;
+		uiTestQCount = 0;
+
+		vTest_BuildMsg(ucaMsgA, 0x1234, ucTest_SplitLen());
+		vComm_Frag_StoreMsg(ucaMsgA);
+		ucCountA = (uchar) uiTestQCount;
+		vTest_BuildMsg(ucaMsgB, 0x5678, ucTest_SplitLen());
+		vComm_Frag_StoreMsg(ucaMsgB);
+		ucCountB = (uchar) (uiTestQCount - ucCountA);
+
+		// A0 B0 A1 B1 ... then what is left of the longer one
+		uiStart = uiTestLogCount;
+		uiLogged = uiTestLogCount;
+		for (ucii = 0; ucii < (FRAG_MAX_COUNT * 2); ucii++) {
+			if ((ucii & 1) == 0) {
+				if ((ucii / 2) >= ucCountA)
+					continue;
+				ucL2SRAM_getCopyOfCurMsgAt(ucii / 2);
+			}
+			else {
+				if ((ucii / 2) >= ucCountB)
+					continue;
+				ucL2SRAM_getCopyOfCurMsgAt(ucCountA + (ucii / 2));
+			}
+			vComm_Frag_LogReport();
+
+			if (uiTestLogCount != uiLogged)
+				vTest_CheckWhole(ucaTestLog, (ucaTestLog[MSG_IDX_ADDR_LO] == 0x34) ? ucaMsgA : ucaMsgB, "interleaved message", uiRound);
+			uiLogged = uiTestLogCount;
+		}
+		vTest_Check((uiTestLogCount - uiStart) == 2, "interleaved count", uiRound);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	ulRandState = 0x2545F491UL;
+	if (argc > 1)
+		ulRandState = strtoul(argv[1], NULL, 0) | 1;
+
+	vTest_Messages();
+	vTest_Interleaved();
+
+	if (uiFailCount != 0) {
+		printf("%u checks failed\n", uiFailCount);
+		return 1;
+	}
+
+	printf("all checks passed\n");
+	return 0;
+}
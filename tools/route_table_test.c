@@ -0,0 +1,444 @@
+///////////////////////////////////////////////////////////////////////////////
+//! \file route_table_test.c
+//! \brief Host test of the node table and next hop cache in comm_routing.c
+//!
+//! comm_module/comm_routing.c is compiled for the host and run side by side
+//! with the linear search edge list it replaced (copied below from the
+//! V1.01 comm_routing.c without the update list, which is not compared).
+//! Each run starts both from an empty table and plays the same random
+//! sequence of operations on them:
+//!
+//!     join        a new node under this node or under any node already in
+//!                 the table, with a small subtree of new nodes, as
+//!                 ucRoute_NodeJoin() is called from discovery
+//!     unjoin      a node in the table or one that is not
+//!     remove      a single edge, right or with the wrong source
+//!     lookup      uiRoute_GetNextHop() of every node of the run
+//!
+//! After every operation the return codes, the edge count and the set of
+//! edges must match, and after every lookup operation every next hop must.
+//! New nodes are never added twice, since the old table kept a duplicate
+//! edge where the new one moves the node.  Runs go past MAX_EDGES so the
+//! table full error is covered.
+//!
+//! Build and run (from the repository root):
+//!
+//!     cc -std=gnu99 -O2 -Wall -Wextra -Itools/commsim/host -I. -Ihal -Idrivers -Imem_mod -Icomm_module -ITasks -o route_table_test tools/route_table_test.c comm_module/comm_routing.c
+//!     ./route_table_test [seed]
+//!
+//! The exit status is 1 if a check failed.
+///////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "std.h"
+#include "comm.h"
+
+//! \def TEST_RUNS
+//! \def TEST_OPS
+//! \brief Runs from an empty table and operations per run
+#define TEST_RUNS			3000
+#define TEST_OPS			400
+
+//! \def TEST_POOL
+//! \brief Node addresses a run draws from, more than MAX_EDGES
+#define TEST_POOL			(MAX_EDGES + 40)
+
+//! \def TEST_SUBTREE_MAX
+//! \brief Most edges in the subtree of a joining node
+#define TEST_SUBTREE_MAX	4
+
+extern uint uiNumEdges;
+extern S_Edge S_edgeList[MAX_EDGES];
+
+// comm_module/comm_routing.c, not in comm.h
+uchar ucRoute_RemoveEdge(uint uiSrc, uint uiDest);
+
+static unsigned int uiFailCount;
+static unsigned long ulRandState;
+
+/*****************************  FIRMWARE STUBS  ******************************/
+
+uchar ucRAND_getRolledMidSysSeed(void)
+{
+	return 0x5A;
+}
+
+void vSERIAL_sout(char *cpStr, uchar ucCount)
+{
+	(void) cpStr;
+	(void) ucCount;
+}
+
+void vSERIAL_HB16out(uint uiVal)
+{
+	(void) uiVal;
+}
+
+void vSERIAL_crlf(void)
+{
+}
+
+/****************************  OLD EDGE LIST  *******************************/
+
+static uint uiOld_NumEdges;
+static S_Edge S_Old_edgeList[MAX_EDGES];
+static S_Edge *S_Old_nextEdge;
+static uint uiOld_Self;
+
+static void vOld_Init(uint uiAddress)
+{
+	uint i;
+
+	uiOld_Self = uiAddress;
+	uiOld_NumEdges = 0;
+	for (i = 0; i < MAX_EDGES; i++)
+		S_Old_edgeList[i].m_uiSrc = S_Old_edgeList[i].m_uiDest = 0;
+	S_Old_nextEdge = S_Old_edgeList;
+}
+
+static uchar ucOld_AddEdge(uint uiSrc, uint uiDest)
+{
+	if (uiOld_NumEdges >= MAX_EDGES)
+		return ROUTE_ERROR_TABLE_FULL;
+
+	S_Old_nextEdge->m_uiSrc = uiSrc;
+	S_Old_nextEdge->m_uiDest = uiDest;
+
+	S_Old_nextEdge++;
+	uiOld_NumEdges++;
+
+	return (0);
+}
+
+static uchar ucOld_RemoveEdge(uint uiSrc, uint uiDest)
+{
+	uint i, j, uiFoundEdge;
+	S_Edge *S_ptr;
+
+	if (uiOld_NumEdges == 0)
+		return ROUTE_ERROR_TABLE_EMPTY;
+
+	uiFoundEdge = 0;
+
+	for (i = 0, S_ptr = S_Old_edgeList; i < uiOld_NumEdges; i++, S_ptr++)
+	{
+		if (S_ptr->m_uiSrc == uiSrc && S_ptr->m_uiDest == uiDest)
+		{
+			S_ptr->m_uiSrc = S_ptr->m_uiDest = 0;
+			uiFoundEdge = 1;
+			for (j = i + 1; j < uiOld_NumEdges; j++)
+				S_Old_edgeList[j - 1] = S_Old_edgeList[j];
+			uiOld_NumEdges--;
+			S_Old_nextEdge--;
+			S_Old_edgeList[uiOld_NumEdges].m_uiSrc = 0;
+			S_Old_edgeList[uiOld_NumEdges].m_uiDest = 0;
+			break;
+		}
+	}
+
+	if (uiFoundEdge == 0)
+		return ROUTE_ERROR_DOES_NOT_EXIST;
+
+	return (0);
+}
+
+static uint uiOld_GetNextHop(uint uiDest)
+{
+	uint i, j;
+	S_Edge *S_ptr, *S_ptr2;
+	uint uiSrc;
+
+	uiSrc = 0;
+	for (i = 0, S_ptr = S_Old_edgeList; i < uiOld_NumEdges; i++, S_ptr++)
+	{
+		if (S_ptr->m_uiDest == uiDest)
+		{
+			if (S_ptr->m_uiSrc == uiOld_Self)
+				return uiDest;
+
+			uiSrc = S_ptr->m_uiSrc;
+			break;
+		}
+	}
+
+	if (i == uiOld_NumEdges)
+		return 0;
+
+	while (1)
+	{
+		for (j = 0, S_ptr2 = S_Old_edgeList; j < uiOld_NumEdges; j++, S_ptr2++)
+		{
+			if (S_ptr2->m_uiDest == uiSrc && S_ptr2->m_uiSrc == uiOld_Self)
+				return uiSrc;
+			else if (S_ptr2->m_uiDest == uiSrc)
+			{
+				uiSrc = S_ptr2->m_uiSrc;
+				break;
+			}
+		}
+
+		if (j == uiOld_NumEdges)
+			break;
+	}
+
+	return 0;
+}
+
+static uchar ucOld_NodeJoin(uint uiParent, uint uiChild, S_Edge *S_edges, int iNumEdges)
+{
+	int i;
+	uchar ucReturnValue;
+	S_Edge *S_ptr;
+
+	for (i = 0, S_ptr = S_edges; i < iNumEdges; i++, S_ptr++)
+	{
+		ucReturnValue = ucOld_AddEdge(S_ptr->m_uiSrc, S_ptr->m_uiDest);
+		if (ucReturnValue != 0)
+			return ucReturnValue;
+	}
+
+	if (uiParent == 0)
+		return ucOld_AddEdge(uiOld_Self, uiChild);
+	else
+		return ucOld_AddEdge(uiParent, uiChild);
+}
+
+static uchar ucOld_NodeUnjoin(uint uiChild)
+{
+	uint i;
+	S_Edge *S_ptr;
+	uint uiTmp;
+	uchar ucRet;
+	uint removeStack[MAX_NODES];
+	int iStackSize = 0;
+
+	if (uiOld_NumEdges == 0)
+		return ROUTE_ERROR_TABLE_EMPTY;
+
+	for (i = 0, S_ptr = S_Old_edgeList; i < uiOld_NumEdges; i++, S_ptr++)
+	{
+		if (S_ptr->m_uiDest == uiChild)
+		{
+			ucRet = ucOld_RemoveEdge(S_ptr->m_uiSrc, S_ptr->m_uiDest);
+			if (ucRet)
+				return ucRet;
+
+			removeStack[iStackSize++] = uiChild;
+			break;
+		}
+	}
+
+	while (iStackSize > 0)
+	{
+		uiTmp = removeStack[--iStackSize];
+
+		for (i = 0, S_ptr = S_Old_edgeList; i < uiOld_NumEdges; )
+		{
+			if (S_ptr->m_uiSrc == uiTmp)
+			{
+				removeStack[iStackSize++] = S_ptr->m_uiDest;
+
+				ucRet = ucOld_RemoveEdge(S_ptr->m_uiSrc, S_ptr->m_uiDest);
+				if (ucRet)
+					return ucRet;
+			}
+			else
+			{
+				i++;
+				S_ptr++;
+			}
+		}
+	}
+
+	return (0);
+}
+
+/*****************************  TEST HELPERS  *******************************/
+
+///////////////////////////////////////////////////////////////////////////////
+//! \brief xorshift32, the same seed gives the same runs on every host
+///////////////////////////////////////////////////////////////////////////////
+static unsigned long ulTest_Random(void)
+{
+	ulRandState ^= (ulRandState << 13) & 0xFFFFFFFFUL;
+	ulRandState ^= ulRandState >> 17;
+	ulRandState ^= (ulRandState << 5) & 0xFFFFFFFFUL;
+	return ulRandState;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//! \brief Counts and reports a mismatch, only the first few are printed
+///////////////////////////////////////////////////////////////////////////////
+static void vTest_Compare(const char *cpWhat, unsigned long ulNew, unsigned long ulOld, unsigned int uiRun, unsigned int uiOp)
+{
+	if (ulNew == ulOld)
+		return;
+
+	if (uiFailCount < 10)
+		printf("FAIL %s run %u op %u: new 0x%04lX old 0x%04lX\n", cpWhat, uiRun, uiOp, ulNew, ulOld);
+	uiFailCount++;
+}
+
+static int iTest_EdgeOrder(const void *vpA, const void *vpB)
+{
+	const S_Edge *S_A = vpA;
+	const S_Edge *S_B = vpB;
+
+	if (S_A->m_uiDest != S_B->m_uiDest)
+		return (S_A->m_uiDest < S_B->m_uiDest) ? -1 : 1;
+	if (S_A->m_uiSrc != S_B->m_uiSrc)
+		return (S_A->m_uiSrc < S_B->m_uiSrc) ? -1 : 1;
+	return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//! \brief The two tables hold the same edges, in any order
+///////////////////////////////////////////////////////////////////////////////
+static void vTest_CompareEdges(unsigned int uiRun, unsigned int uiOp)
+{
+	static S_Edge S_aNew[MAX_EDGES];
+	static S_Edge S_aOld[MAX_EDGES];
+
+	vTest_Compare("edge count", uiNumEdges, uiOld_NumEdges, uiRun, uiOp);
+	if (uiNumEdges != uiOld_NumEdges)
+		return;
+
+	memcpy(S_aNew, S_edgeList, uiNumEdges * sizeof(S_Edge));
+	memcpy(S_aOld, S_Old_edgeList, uiNumEdges * sizeof(S_Edge));
+	qsort(S_aNew, uiNumEdges, sizeof(S_Edge), iTest_EdgeOrder);
+	qsort(S_aOld, uiNumEdges, sizeof(S_Edge), iTest_EdgeOrder);
+	vTest_Compare("edges", memcmp(S_aNew, S_aOld, uiNumEdges * sizeof(S_Edge)) != 0, 0, uiRun, uiOp);
+}
+
+/********************************  TESTS  ***********************************/
+
+static void vTest_Run(unsigned int uiRun)
+{
+	uint uiaPool[TEST_POOL];
+	uchar ucaUsed[TEST_POOL];
+	S_Edge S_aSub[TEST_SUBTREE_MAX];
+	uint uiSelf;
+	uint uiNext;
+	uint uiParent;
+	uint uiChild;
+	uint uiNode;
+	uint uiOp;
+	uint uiii;
+	uint uiSub;
+	uint uiSubCount;
+	unsigned long ulDice;
+
+	// Random distinct addresses, close together in some runs as on a real
+	// network.  The steps add up to less than 0x10000 so none repeats.
+	uiSelf = (uint) (1 + (ulTest_Random() % 0xFFFE));
+	uiNext = (uint) (ulTest_Random() & 0xFFFF);
+	for (uiii = 0; uiii < TEST_POOL; uiii++)
+	{
+		if (uiRun & 1)
+			uiNext = (uiNext + 1 + (ulTest_Random() % 3)) & 0xFFFF;
+		else
+			uiNext = (uiNext + 1 + (ulTest_Random() % (0xFFF0 / TEST_POOL - 3))) & 0xFFFF;
+		if (uiNext == 0 || uiNext == uiSelf)
+			uiNext = (uiNext + 1) & 0xFFFF;
+		if (uiNext == 0 || uiNext == uiSelf)
+			uiNext = (uiNext + 1) & 0xFFFF;
+		uiaPool[uiii] = uiNext;
+		ucaUsed[uiii] = 0;
+	}
+
+	ucRoute_Init(uiSelf);
+	vOld_Init(uiSelf);
+
+	for (uiOp = 0; uiOp < TEST_OPS; uiOp++)
+	{
+		ulDice = ulTest_Random() % 100;
+
+		if (ulDice < 45)
+		{
+			// Join a new node and its subtree, each node only ever joins once
+			for (uiii = 0; uiii < TEST_POOL && ucaUsed[uiii]; uiii++)
+				;
+			if (uiii == TEST_POOL)
+				continue;
+			uiChild = uiaPool[uiii];
+			ucaUsed[uiii] = 1;
+
+			uiParent = 0;
+			if (uiOld_NumEdges != 0 && (ulTest_Random() & 1))
+				uiParent = S_Old_edgeList[ulTest_Random() % uiOld_NumEdges].m_uiDest;
+
+			uiSubCount = 0;
+			uiSub = (uint) (ulTest_Random() % (TEST_SUBTREE_MAX + 1));
+			for (uiii = 0; uiii < TEST_POOL && uiSubCount < uiSub; uiii++)
+			{
+				if (ucaUsed[uiii])
+					continue;
+				ucaUsed[uiii] = 1;
+				S_aSub[uiSubCount].m_uiDest = uiaPool[uiii];
+				S_aSub[uiSubCount].m_uiSrc = (uiSubCount == 0) ? uiChild : S_aSub[ulTest_Random() % uiSubCount].m_uiDest;
+				if (ulTest_Random() & 1)
+					S_aSub[uiSubCount].m_uiSrc = uiChild;
+				uiSubCount++;
+			}
+
+			vTest_Compare("join", ucRoute_NodeJoin(uiParent, uiChild, S_aSub, (int) uiSubCount),
+			    ucOld_NodeJoin(uiParent, uiChild, S_aSub, (int) uiSubCount), uiRun, uiOp);
+		}
+		else if (ulDice < 65)
+		{
+			// Unjoin, mostly nodes in the table
+			uiNode = uiaPool[ulTest_Random() % TEST_POOL];
+			if (uiOld_NumEdges != 0 && (ulTest_Random() % 4) != 0)
+				uiNode = S_Old_edgeList[ulTest_Random() % uiOld_NumEdges].m_uiDest;
+
+			vTest_Compare("unjoin", ucRoute_NodeUnjoin(uiNode), ucOld_NodeUnjoin(uiNode), uiRun, uiOp);
+		}
+		else if (ulDice < 70)
+		{
+			// Remove one edge, its subtree is left without a way up
+			uiParent = uiSelf;
+			uiNode = uiaPool[ulTest_Random() % TEST_POOL];
+			if (uiOld_NumEdges != 0)
+			{
+				uiii = (uint) (ulTest_Random() % uiOld_NumEdges);
+				uiParent = S_Old_edgeList[uiii].m_uiSrc;
+				uiNode = S_Old_edgeList[uiii].m_uiDest;
+				if ((ulTest_Random() % 4) == 0)
+					uiParent ^= 1;
+			}
+
+			vTest_Compare("remove", ucRoute_RemoveEdge(uiParent, uiNode), ucOld_RemoveEdge(uiParent, uiNode), uiRun, uiOp);
+		}
+		else
+		{
+			// Look up every node of the run, in the table or not
+			for (uiii = 0; uiii < TEST_POOL; uiii++)
+				vTest_Compare("next hop", uiRoute_GetNextHop(uiaPool[uiii]), uiOld_GetNextHop(uiaPool[uiii]), uiRun, uiOp);
+			vTest_Compare("next hop self", uiRoute_GetNextHop(uiSelf), uiOld_GetNextHop(uiSelf), uiRun, uiOp);
+		}
+
+		vTest_CompareEdges(uiRun, uiOp);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int uiRun;
+
+	ulRandState = 0x2545F491UL;
+	if (argc > 1)
+		ulRandState = strtoul(argv[1], NULL, 0) | 1;
+
+	for (uiRun = 0; uiRun < TEST_RUNS; uiRun++)
+		vTest_Run(uiRun);
+
+	if (uiFailCount != 0) {
+		printf("%u checks failed\n", uiFailCount);
+		return 1;
+	}
+
+	printf("all checks passed\n");
+	return 0;
+}
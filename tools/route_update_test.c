@@ -0,0 +1,574 @@
+///////////////////////////////////////////////////////////////////////////////
+//! \file route_update_test.c
+//! \brief Host test of the routing updates a child sends its parent in the LRQ
+//!
+//! comm_module/comm_routing.c is included below so the state of both ends of
+//! a link, static variables too, can be saved and loaded around each call.
+//! The parent P has the single child C, C has a subtree that changes between
+//! slots.  Each slot is played as vComm_SendRTR(), vComm_SendLRQ() and
+//! ucComm_WaitForLRQ() do it:
+//!
+//!     RTR         P asks for a resync if ucRoute_NeedResync(C), the child
+//!                 takes RouteUpdates if the RTR carries OPMSG_IDX_ROUTE
+//!     LRQ         C sends ucRoute_GetUpdates() or ucRoute_GetLegacyUpdates()
+//!                 with MSG_FLG_ROUTE set for the first, P applies it with
+//!                 vRoute_SetUpdates() or vRoute_SetLegacyUpdates()
+//!     ACK         C clears the updates it sent with vRouteClrFlaggedUpdates()
+//!                 and sends the rest, the last LRQ is cleared when the
+//!                 parent's next message arrives
+//!
+//! Runs with the RTR of this firmware lose RTRs, LRQs, ACKs and the parent's
+//! next message, let C take a message that was not meant for it as the ACK,
+//! overflow the update list of C and reboot C, which P sees as an unjoin
+//! and a new join from discovery.  After every slot without a loss in which
+//! P does not want a resync, and after a few quiet slots at the end of the
+//! run, P must hold the subtree of C.
+//!
+//! Runs with the RTR of V1.01 (no OPMSG_IDX_ROUTE byte) must bring the child
+//! down to the join/drop encoding.  The LRQs go to the V1.01 parser, copied
+//! below, and to vRoute_SetLegacyUpdates() standing in for a parent of this
+//! firmware with a V1.01 child.  That encoding has no sequence number, a
+//! repeated LRQ can join a node under one it already dropped, so only RTRs
+//! and LRQs are lost and the update list is never overflowed.  Both parents
+//! must hold the subtree of C after the same slots.
+//!
+//! Build and run (from the repository root):
+//!
+//!     cc -std=gnu99 -O2 -Wall -Wextra -Itools/commsim/host -I. -Ihal -Idrivers -Imem_mod -Icomm_module -ITasks -o route_update_test tools/route_update_test.c
+//!     ./route_update_test [seed]
+//!
+//! The exit status is 1 if a check failed.
+///////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "comm_routing.c"
+
+//! \def TEST_RUNS
+//! \def TEST_SLOTS
+//! \brief Runs from an empty network and slots per run
+#define TEST_RUNS			2000
+#define TEST_SLOTS			200
+
+//! \def TEST_QUIET_SLOTS
+//! \brief Slots without changes or losses at the end of a run
+#define TEST_QUIET_SLOTS	4
+
+//! \def TEST_POOL
+//! \brief Node addresses the subtree of the child draws from
+#define TEST_POOL			60
+
+//! \def TEST_PARENT
+//! \def TEST_CHILD
+//! \brief Addresses of the two ends of the link
+#define TEST_PARENT			0x0100
+#define TEST_CHILD			0x0200
+
+//! \def TEST_RTR_LEN_V101
+//! \def TEST_RTR_LEN_WINDOW
+//! \def TEST_RTR_LEN
+//! \brief MSG_IDX_LEN of the RTR of V1.01, of the firmware with block ACKs
+//! only and of vComm_SendRTR() now
+#define TEST_RTR_LEN_V101	13
+#define TEST_RTR_LEN_WINDOW	14
+#define TEST_RTR_LEN		15
+
+//! \def TEST_UPDATE_SPACE
+//! \brief Space vComm_SendLRQ() gives the updates
+#define TEST_UPDATE_SPACE	(MAX_MSG_SIZE - (NET_HDR_SZ + MSG_HDR_SZ + 1 + CRC_SZ))
+
+//! \def TEST_LOSS
+//! \def TEST_MISACK
+//! \brief Chance in percent that a message is lost and that a lost LRQ is
+//! acknowledged anyway
+#define TEST_LOSS			15
+#define TEST_MISACK			3
+
+//! \struct S_TestNode
+//! \brief Saved state of comm_routing.c for one end of the link
+typedef struct
+{
+	uint m_uiNumEdges;
+	S_Edge m_S_edgeList[MAX_EDGES];
+	uint m_uiSelf;
+	uchar m_ucaRtUpdate[sizeof(S_RtUpdate)];
+	S_RoutePeer m_S_Peers[MAX_EDGES];
+	uchar m_ucEpoch;
+	uchar m_ucTxSeq;
+	uchar m_ucTxPending;
+	uchar m_ucTxListCount;
+	uchar m_ucResyncState;
+	uint m_uiResyncNext;
+	uint m_uiResyncSent;
+	uchar m_ucTxLegacy;
+	uchar m_ucaNodeTbl[ROUTE_HASH_SZ];
+	uint m_uiaNextHop[MAX_EDGES];
+} S_TestNode;
+
+static S_TestNode S_Parent;
+static S_TestNode S_OldParent;
+static S_TestNode S_Child;
+
+static uint uiaPool[TEST_POOL];
+static volatile uchar ucaTest_Updates[MAX_MSG_SIZE];
+
+static unsigned int uiFailCount;
+static unsigned long ulRandState;
+
+static unsigned long ulTest_Random(void)
+{
+	ulRandState ^= ulRandState << 13;
+	ulRandState ^= ulRandState >> 17;
+	ulRandState ^= ulRandState << 5;
+	ulRandState &= 0xFFFFFFFFUL;
+	return ulRandState;
+}
+
+/*****************************  FIRMWARE STUBS  ******************************/
+
+uchar ucRAND_getRolledMidSysSeed(void)
+{
+	return (uchar) ulTest_Random();
+}
+
+void vSERIAL_sout(char *cpStr, uint uiCount)
+{
+	(void) cpStr;
+	(void) uiCount;
+}
+
+void vSERIAL_HB16out(uint uiVal)
+{
+	(void) uiVal;
+}
+
+void vSERIAL_crlf(void)
+{
+}
+
+/*****************************  V1.01 PARSER  *******************************/
+
+// vRoute_SetUpdates() of V1.01, what a parent without RouteUpdates runs
+static void vOld_SetUpdates(volatile uchar *ucaBuff)
+{
+	uchar ucJoins;
+	uchar ucDrops;
+	uint uiSrc;
+	uint uiDest;
+	uchar ucCount;
+
+	ucJoins = (*ucaBuff++) / 4;
+	for (ucCount = 0; ucCount < ucJoins; ucCount++)
+	{
+		uiSrc = (uint) (*ucaBuff++ << 8);
+		uiSrc |= (uint) (*ucaBuff++);
+		uiDest = (uint) (*ucaBuff++ << 8);
+		uiDest |= (uint) (*ucaBuff++);
+
+		ucRoute_AddEdge(uiSrc, uiDest);
+	}
+
+	ucDrops = (*ucaBuff++) / 2;
+	for (ucCount = 0; ucCount < ucDrops; ucCount++)
+	{
+		uiDest = (uint) (*ucaBuff++ << 8);
+		uiDest |= (uint) (*ucaBuff++);
+
+		ucRoute_NodeUnjoin(uiDest);
+	}
+}
+
+/*****************************  TEST HARNESS  *******************************/
+
+static void vTest_Save(S_TestNode *S_Node)
+{
+	S_Node->m_uiNumEdges = uiNumEdges;
+	memcpy(S_Node->m_S_edgeList, S_edgeList, sizeof(S_edgeList));
+	S_Node->m_uiSelf = uiSelf;
+	memcpy(S_Node->m_ucaRtUpdate, &S_RtUpdate, sizeof(S_RtUpdate));
+	memcpy(S_Node->m_S_Peers, S_RoutePeers, sizeof(S_RoutePeers));
+	S_Node->m_ucEpoch = ucRoute_Epoch;
+	S_Node->m_ucTxSeq = ucRoute_TxSeq;
+	S_Node->m_ucTxPending = ucRoute_TxPending;
+	S_Node->m_ucTxListCount = ucRoute_TxListCount;
+	S_Node->m_ucResyncState = ucRoute_ResyncState;
+	S_Node->m_uiResyncNext = uiRoute_ResyncNext;
+	S_Node->m_uiResyncSent = uiRoute_ResyncSent;
+	S_Node->m_ucTxLegacy = ucRoute_TxLegacy;
+	memcpy(S_Node->m_ucaNodeTbl, ucaRoute_NodeTbl, sizeof(ucaRoute_NodeTbl));
+	memcpy(S_Node->m_uiaNextHop, uiaRoute_NextHop, sizeof(uiaRoute_NextHop));
+}
+
+static void vTest_Load(const S_TestNode *S_Node)
+{
+	uiNumEdges = S_Node->m_uiNumEdges;
+	memcpy(S_edgeList, S_Node->m_S_edgeList, sizeof(S_edgeList));
+	S_nextEdge = &S_edgeList[uiNumEdges];
+	uiSelf = S_Node->m_uiSelf;
+	memcpy(&S_RtUpdate, S_Node->m_ucaRtUpdate, sizeof(S_RtUpdate));
+	memcpy(S_RoutePeers, S_Node->m_S_Peers, sizeof(S_RoutePeers));
+	ucRoute_Epoch = S_Node->m_ucEpoch;
+	ucRoute_TxSeq = S_Node->m_ucTxSeq;
+	ucRoute_TxPending = S_Node->m_ucTxPending;
+	ucRoute_TxListCount = S_Node->m_ucTxListCount;
+	ucRoute_ResyncState = S_Node->m_ucResyncState;
+	uiRoute_ResyncNext = S_Node->m_uiResyncNext;
+	uiRoute_ResyncSent = S_Node->m_uiResyncSent;
+	ucRoute_TxLegacy = S_Node->m_ucTxLegacy;
+	memcpy(ucaRoute_NodeTbl, S_Node->m_ucaNodeTbl, sizeof(ucaRoute_NodeTbl));
+	memcpy(uiaRoute_NextHop, S_Node->m_uiaNextHop, sizeof(uiaRoute_NextHop));
+}
+
+static void vTest_Check(int iOk, const char *cpWhat, unsigned int uiRun, unsigned int uiSlot)
+{
+	if (iOk)
+		return;
+
+	if (uiFailCount < 10)
+		printf("FAIL %s run %u slot %u\n", cpWhat, uiRun, uiSlot);
+	uiFailCount++;
+}
+
+// A lost message, out of 100
+static int iTest_Lost(unsigned int uiChance)
+{
+	return (unsigned int) (ulTest_Random() % 100) < uiChance;
+}
+
+static int iTest_EdgeCmp(const void *vpA, const void *vpB)
+{
+	const S_Edge *S_A = vpA;
+	const S_Edge *S_B = vpB;
+
+	if (S_A->m_uiDest != S_B->m_uiDest)
+		return (S_A->m_uiDest < S_B->m_uiDest) ? -1 : 1;
+	if (S_A->m_uiSrc != S_B->m_uiSrc)
+		return (S_A->m_uiSrc < S_B->m_uiSrc) ? -1 : 1;
+	return 0;
+}
+
+// The parent must hold the edge to the child and the subtree of the child, nothing else
+static int iTest_ParentMatches(const S_TestNode *S_Node)
+{
+	S_Edge S_aTheirs[MAX_EDGES];
+	S_Edge S_aOurs[MAX_EDGES];
+	uint uiCount;
+	uint uiii;
+
+	if (S_Node->m_uiNumEdges != S_Child.m_uiNumEdges + 1)
+		return 0;
+
+	uiCount = 0;
+	for (uiii = 0; uiii < S_Node->m_uiNumEdges; uiii++)
+	{
+		if (S_Node->m_S_edgeList[uiii].m_uiSrc == TEST_PARENT && S_Node->m_S_edgeList[uiii].m_uiDest == TEST_CHILD)
+			continue;
+		if (uiCount >= S_Child.m_uiNumEdges)
+			return 0;
+		S_aTheirs[uiCount++] = S_Node->m_S_edgeList[uiii];
+	}
+	if (uiCount != S_Child.m_uiNumEdges)
+		return 0;
+
+	memcpy(S_aOurs, S_Child.m_S_edgeList, uiCount * sizeof(S_Edge));
+	qsort(S_aTheirs, uiCount, sizeof(S_Edge), iTest_EdgeCmp);
+	qsort(S_aOurs, uiCount, sizeof(S_Edge), iTest_EdgeCmp);
+
+	return memcmp(S_aTheirs, S_aOurs, uiCount * sizeof(S_Edge)) == 0;
+}
+
+static int iTest_InChild(uint uiNode)
+{
+	uint uiii;
+
+	for (uiii = 0; uiii < S_Child.m_uiNumEdges; uiii++)
+	{
+		if (S_Child.m_S_edgeList[uiii].m_uiDest == uiNode)
+			return 1;
+	}
+	return 0;
+}
+
+static int iTest_InPool(uint uiNode, uint uiCount)
+{
+	uint uiii;
+
+	for (uiii = 0; uiii < uiCount; uiii++)
+	{
+		if (uiaPool[uiii] == uiNode)
+			return 1;
+	}
+	return 0;
+}
+
+// Joins a node that is not in the subtree of the child, with up to 2 more under it
+static void vTest_ChildJoin(void)
+{
+	S_Edge S_aSub[2];
+	uint uiChild;
+	uint uiParent;
+	uint uiSubCount;
+	uint uiii;
+
+	uiChild = uiaPool[ulTest_Random() % TEST_POOL];
+	if (iTest_InChild(uiChild))
+		return;
+
+	uiParent = 0;
+	if (S_Child.m_uiNumEdges != 0 && (ulTest_Random() % 3) != 0)
+		uiParent = S_Child.m_S_edgeList[ulTest_Random() % S_Child.m_uiNumEdges].m_uiDest;
+
+	uiSubCount = 0;
+	for (uiii = (uint) (ulTest_Random() % 3); uiii > 0; uiii--)
+	{
+		S_aSub[uiSubCount].m_uiDest = uiaPool[ulTest_Random() % TEST_POOL];
+		S_aSub[uiSubCount].m_uiSrc = (uiSubCount == 0) ? uiChild : S_aSub[0].m_uiDest;
+		if (S_aSub[uiSubCount].m_uiDest == uiChild || iTest_InChild(S_aSub[uiSubCount].m_uiDest)
+				|| (uiSubCount == 1 && S_aSub[1].m_uiDest == S_aSub[0].m_uiDest))
+			break;
+		uiSubCount++;
+	}
+
+	vTest_Load(&S_Child);
+	ucRoute_NodeJoin(uiParent, uiChild, S_aSub, (int) uiSubCount);
+	vTest_Save(&S_Child);
+}
+
+static void vTest_ChildUnjoin(void)
+{
+	if (S_Child.m_uiNumEdges == 0)
+		return;
+
+	vTest_Load(&S_Child);
+	ucRoute_NodeUnjoin(S_edgeList[ulTest_Random() % uiNumEdges].m_uiDest);
+	vTest_Save(&S_Child);
+}
+
+// The child boots again, the parent loses the link and sees it join again with nothing below it
+static void vTest_ChildReboot(void)
+{
+	vTest_Load(&S_Child);
+	ucRoute_Init(TEST_CHILD);
+	vTest_Save(&S_Child);
+
+	vTest_Load(&S_Parent);
+	ucRoute_NodeUnjoin(TEST_CHILD);
+	ucRoute_NodeJoin(0, TEST_CHILD, NULL, 0);
+	vTest_Save(&S_Parent);
+}
+
+// One slot of the link, returns 1 if nothing was lost
+static int iTest_Slot(uchar ucRtrLen, unsigned int uiLoss, unsigned int uiAckLoss, unsigned int uiMisAck)
+{
+	uchar ucRouteRecs;
+	uchar ucRtrRoute;
+	uchar ucUpdateLen;
+	uchar ucMore;
+	uchar ucFlags;
+	int iDelivered;
+	int iClean;
+
+	// vComm_SendRTR()
+	vTest_Load(&S_Parent);
+	ucRtrRoute = 0;
+	if (ucRoute_NeedResync(TEST_CHILD))
+		ucRtrRoute = ROUTE_RTR_RESYNC;
+	if (iTest_Lost(uiLoss))
+		return 0;
+
+	// The child reads the RTR
+	ucRouteRecs = ((ucRtrLen + NET_HDR_SZ) > OPMSG_IDX_ROUTE);
+	vTest_Load(&S_Child);
+	if (ucRouteRecs && (ucRtrRoute & ROUTE_RTR_RESYNC))
+		vRoute_RequestResync();
+
+	// vComm_SendLRQ()
+	iClean = 1;
+	while (1)
+	{
+		if (ucRouteRecs)
+			ucUpdateLen = ucRoute_GetUpdates(ucaTest_Updates, TEST_UPDATE_SPACE);
+		else
+			ucUpdateLen = ucRoute_GetLegacyUpdates(ucaTest_Updates, TEST_UPDATE_SPACE);
+		ucMore = ucRoute_UpdatesLeft();
+		ucFlags = ucMore ? MSG_FLG_ACKRQST : MSG_FLG_SINGLE;
+		if (ucRouteRecs)
+			ucFlags |= MSG_FLG_ROUTE;
+		vTest_Save(&S_Child);
+
+		// ucComm_WaitForLRQ() on the parent
+		iDelivered = !iTest_Lost(uiLoss);
+		if (iDelivered)
+		{
+			vTest_Load(&S_Parent);
+			if (ucFlags & MSG_FLG_ROUTE)
+			{
+				vRoute_SetUpdates(TEST_CHILD, ucaTest_Updates, ucUpdateLen);
+			}
+			else
+			{
+				vRoute_SetLegacyUpdates(TEST_CHILD, ucaTest_Updates, ucUpdateLen);
+				vTest_Save(&S_Parent);
+				vTest_Load(&S_OldParent);
+				vOld_SetUpdates(ucaTest_Updates);
+				vTest_Save(&S_OldParent);
+				vTest_Load(&S_Parent);
+			}
+			vTest_Save(&S_Parent);
+		}
+
+		// The ACK, or the parent's next message after the last LRQ
+		vTest_Load(&S_Child);
+		if (iDelivered ? iTest_Lost(uiAckLoss) : !iTest_Lost(uiMisAck))
+		{
+			iClean = 0;
+			break;
+		}
+		vRouteClrFlaggedUpdates();
+		if (!iDelivered)
+			iClean = 0;
+		if (!ucMore)
+			break;
+	}
+	vTest_Save(&S_Child);
+
+	return iClean;
+}
+
+static void vTest_CheckParents(uchar ucRtrLen, const char *cpWhen, unsigned int uiRun, unsigned int uiSlot)
+{
+	char caWhat[64];
+
+	snprintf(caWhat, sizeof(caWhat), "%s subtree", cpWhen);
+	vTest_Check(iTest_ParentMatches(&S_Parent), caWhat, uiRun, uiSlot);
+	if (ucRtrLen == TEST_RTR_LEN_V101)
+	{
+		snprintf(caWhat, sizeof(caWhat), "%s V1.01 subtree", cpWhen);
+		vTest_Check(iTest_ParentMatches(&S_OldParent), caWhat, uiRun, uiSlot);
+	}
+}
+
+static void vTest_Run(unsigned int uiRun)
+{
+	uchar ucRtrLen;
+	unsigned int uiSlot;
+	unsigned int uiOps;
+	unsigned int uiLoss;
+	unsigned int uiAckLoss;
+	unsigned int uiMisAck;
+	unsigned long ulDice;
+	uint uiii;
+	uint uiNode;
+
+	// Addresses all over the 16 bit range so varints of every length are sent
+	uiii = 0;
+	while (uiii < TEST_POOL)
+	{
+		uiNode = (uint) (ulTest_Random() & 0xFFFF);
+		if ((ulTest_Random() & 3) == 0)
+			uiNode &= 0x7F;
+		if (uiNode == 0 || uiNode == TEST_PARENT || uiNode == TEST_CHILD || iTest_InPool(uiNode, uiii))
+			continue;
+		uiaPool[uiii++] = uiNode;
+	}
+
+	// Every third run has a V1.01 parent
+	ucRtrLen = (uiRun % 3) == 2 ? TEST_RTR_LEN_V101 : TEST_RTR_LEN;
+	uiLoss = TEST_LOSS;
+	uiAckLoss = (ucRtrLen == TEST_RTR_LEN) ? TEST_LOSS : 0;
+	uiMisAck = (ucRtrLen == TEST_RTR_LEN) ? TEST_MISACK : 0;
+
+	ucRoute_Init(TEST_CHILD);
+	vTest_Save(&S_Child);
+	ucRoute_Init(TEST_PARENT);
+	ucRoute_NodeJoin(0, TEST_CHILD, NULL, 0);
+	vTest_Save(&S_Parent);
+	vTest_Save(&S_OldParent);
+
+	for (uiSlot = 0; uiSlot < TEST_SLOTS + TEST_QUIET_SLOTS; uiSlot++)
+	{
+		if (uiSlot >= TEST_SLOTS)
+		{
+			uiLoss = 0;
+			uiAckLoss = 0;
+			uiMisAck = 0;
+		}
+
+		// The subtree changes between slots
+		for (uiOps = (uiSlot < TEST_SLOTS) ? (unsigned int) (ulTest_Random() % 4) : 0; uiOps > 0; uiOps--)
+		{
+			// The join/drop encoding loses what does not fit in the update list
+			vTest_Load(&S_Child);
+			if (ucRtrLen == TEST_RTR_LEN_V101 && S_RtUpdate.ucIndex + 3 > MAX_UPDATES)
+				break;
+
+			ulDice = ulTest_Random() % 100;
+			if (ulDice < 55)
+			{
+				vTest_ChildJoin();
+			}
+			else if (ulDice < 95)
+			{
+				vTest_ChildUnjoin();
+			}
+			else if (ucRtrLen == TEST_RTR_LEN && ulDice < 97)
+			{
+				vTest_ChildReboot();
+			}
+			else if (ucRtrLen == TEST_RTR_LEN)
+			{
+				// A burst that overflows the update list
+				for (uiii = 0; uiii < MAX_UPDATES; uiii++)
+					vTest_ChildJoin();
+			}
+		}
+
+		if (iTest_Slot(ucRtrLen, uiLoss, uiAckLoss, uiMisAck))
+		{
+			vTest_Load(&S_Parent);
+			if (ucRtrLen == TEST_RTR_LEN_V101 || !ucRoute_NeedResync(TEST_CHILD))
+				vTest_CheckParents(ucRtrLen, "clean slot", uiRun, uiSlot);
+		}
+	}
+
+	// Quiet slots bring the parent back in sync
+	vTest_CheckParents(ucRtrLen, "end of run", uiRun, uiSlot);
+	vTest_Load(&S_Parent);
+	vTest_Check(ucRtrLen != TEST_RTR_LEN || !ucRoute_NeedResync(TEST_CHILD), "resync left", uiRun, uiSlot);
+	vTest_Load(&S_Child);
+	vTest_Check(!ucRoute_UpdatesLeft(), "updates left", uiRun, uiSlot);
+}
+
+// The child takes RouteUpdates only from a parent whose RTR carries the routing flags
+static void vTest_Negotiation(void)
+{
+	vTest_Check(!((TEST_RTR_LEN_V101 + NET_HDR_SZ) > OPMSG_IDX_ROUTE), "V1.01 RTR takes RouteUpdates", 0, 0);
+	vTest_Check(!((TEST_RTR_LEN_WINDOW + NET_HDR_SZ) > OPMSG_IDX_ROUTE), "window RTR takes RouteUpdates", 0, 0);
+	vTest_Check(((TEST_RTR_LEN + NET_HDR_SZ) > OPMSG_IDX_ROUTE), "RTR without RouteUpdates", 0, 0);
+	vTest_Check(((TEST_RTR_LEN + NET_HDR_SZ) > OPMSG_IDX_WINDOW), "RTR without window", 0, 0);
+
+	// The LRQ flags must not overlap
+	vTest_Check(!(MSG_FLG_ROUTE & (MSG_FLG_ACKRQST | MSG_FLG_SINGLE | MSG_FLG_WINDOW)), "MSG_FLG_ROUTE overlaps", 0, 0);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int uiRun;
+
+	ulRandState = 0x2545F491UL;
+	if (argc > 1)
+		ulRandState = strtoul(argv[1], NULL, 0) | 1;
+
+	vTest_Negotiation();
+	for (uiRun = 0; uiRun < TEST_RUNS; uiRun++)
+		vTest_Run(uiRun);
+
+	if (uiFailCount != 0) {
+		printf("%u checks failed\n", uiFailCount);
+		return 1;
+	}
+
+	printf("all checks passed\n");
+	return 0;
+}
@@ -0,0 +1,498 @@
+///////////////////////////////////////////////////////////////////////////////
+//! \file sdimage_decode.cpp
+//! \brief Host tool that extracts every data element from an SD card image
+//!
+//! The image is memory mapped and every block of the data log (see
+//! drivers/SD_Log.h) is checked with the firmware CRC routines from
+//! comm_module/crc.c.  Blocks are scanned in parallel, ordered by sequence
+//! number, split into messages with the NET_HDR / MSG_IDX_LEN framing of
+//! comm.h (joining messages cut at a block end) and the data elements of
+//! each message are decoded into columns.
+//!
+//! Build (from the repository root):
+//!
+//!     cc -c -O2 -DCRC_HOST_BUILD -I. comm_module/crc.c -o crc_host.o
+//!     c++ -std=c++17 -O2 -pthread -Idrivers tools/sdimage_decode.cpp crc_host.o -o sdimage_decode
+//!
+//! Usage:
+//!
+//!     sdimage_decode [-t THREADS] [-o DIR] [-B [ITERS]] card.img
+//!
+//!     (default)   one CSV row per data element on stdout
+//!     -o DIR      one raw little endian file per column in DIR (numpy.fromfile
+//!                 friendly), the DE payloads go in payload.bin indexed by
+//!                 payload_off.u32
+//!     -B ITERS    decode the image ITERS times (default 3) without output and
+//!                 report the throughput in GB/s
+//!     -t THREADS  worker threads, default is one per core
+///////////////////////////////////////////////////////////////////////////////
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "SD_Log.h"
+
+extern "C"
+{
+// comm_module/crc.c
+unsigned int uiCRC16_ComputeBlockCRC(unsigned char *ucPointer, unsigned long ulLength);
+unsigned int uiCRC16_ComputeCRCwithInit(unsigned char *ucPointer, unsigned long ulLength, unsigned int uiInitialCRC);
+}
+
+namespace
+{
+
+const unsigned BLOCKLEN = 512;
+
+// Message framing, from comm.h
+const unsigned NET_HDR_SZ = 4;
+const unsigned MSG_IDX_ID = 4;
+const unsigned MSG_IDX_FLG = 5;
+const unsigned MSG_IDX_NUM_HI = 6;
+const unsigned MSG_IDX_LEN = 10;
+const unsigned MSG_IDX_PAYLD = 11;
+const unsigned MAX_LOGICAL_MSG_SIZE = 255;
+
+// Data element layout, from comm.h
+const unsigned DE_IDX_ID = 0;
+const unsigned DE_IDX_LENGTH = 1;
+const unsigned DE_IDX_VERSION = 2;
+const unsigned DE_IDX_RPT_PROCID = 3;
+const unsigned DE_IDX_TIME_SEC_XI = 4;
+const unsigned DE_IDX_RPT_PAYLOAD = 8;
+
+inline unsigned get16(const uint8_t *p) { return (unsigned(p[0]) << 8) | p[1]; }
+inline uint32_t get32(const uint8_t *p)
+{
+	return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+}
+
+//! A data block of the log
+struct BlkRef
+{
+	uint32_t seq;
+	uint32_t block;
+	uint16_t end;
+	uint8_t carry;
+};
+
+//! Scan counters
+struct Stats
+{
+	uint64_t blocks = 0, data = 0, index = 0, badCRC = 0, dupes = 0;
+	uint64_t msgs = 0, joined = 0, des = 0, badDEs = 0;
+
+	void add(const Stats &o)
+	{
+		blocks += o.blocks; data += o.data; index += o.index; badCRC += o.badCRC; dupes += o.dupes;
+		msgs += o.msgs; joined += o.joined; des += o.des; badDEs += o.badDEs;
+	}
+};
+
+//! Decoded data elements, one entry per DE in every column
+struct Columns
+{
+	std::vector<uint32_t> block, seq, deTime, payOff;
+	std::vector<uint16_t> src, msgNum;
+	std::vector<uint8_t> msgFlags, deIdx, deId, deLen, deVer, deProc;
+	std::vector<uint8_t> payload;
+
+	size_t size() const { return deId.size(); }
+
+	void append(const Columns &o)
+	{
+		uint32_t base = uint32_t(payload.size());
+
+		block.insert(block.end(), o.block.begin(), o.block.end());
+		seq.insert(seq.end(), o.seq.begin(), o.seq.end());
+		deTime.insert(deTime.end(), o.deTime.begin(), o.deTime.end());
+		for (uint32_t off : o.payOff)
+			payOff.push_back(base + off);
+		src.insert(src.end(), o.src.begin(), o.src.end());
+		msgNum.insert(msgNum.end(), o.msgNum.begin(), o.msgNum.end());
+		msgFlags.insert(msgFlags.end(), o.msgFlags.begin(), o.msgFlags.end());
+		deIdx.insert(deIdx.end(), o.deIdx.begin(), o.deIdx.end());
+		deId.insert(deId.end(), o.deId.begin(), o.deId.end());
+		deLen.insert(deLen.end(), o.deLen.begin(), o.deLen.end());
+		deVer.insert(deVer.end(), o.deVer.begin(), o.deVer.end());
+		deProc.insert(deProc.end(), o.deProc.begin(), o.deProc.end());
+		payload.insert(payload.end(), o.payload.begin(), o.payload.end());
+	}
+
+	//! Offset one past the payload of DE i
+	uint32_t payEnd(size_t i) const { return (i + 1 < size()) ? payOff[i + 1] : uint32_t(payload.size()); }
+};
+
+class Decoder
+{
+public:
+	Decoder(const uint8_t *pImg, uint64_t ullBlocks, unsigned uiThreads)
+		: m_pImg(pImg), m_ullBlocks(ullBlocks), m_uiThreads(uiThreads) {}
+
+	bool readSuperblock()
+	{
+		const uint8_t *sb;
+
+		if (m_ullBlocks <= SD_LOG_SUPERBLOCK)
+			return false;
+		sb = blk(SD_LOG_SUPERBLOCK);
+		if (memcmp(&sb[SD_SB_IDX_MAGIC], "SEGA", 4) != 0 || sb[SD_SB_IDX_VERSION] < SD_LOG_MIN_VERSION
+				|| sb[SD_SB_IDX_HDR_SZ] != SD_BLK_HDR_SZ || sb[SD_SB_IDX_INDEX_INTERVAL] != SD_LOG_INDEX_INTERVAL)
+			return false;
+		m_ulStart = sb[SD_SB_IDX_START_BLOCK];
+		m_uiVolume = get16(&sb[SD_SB_IDX_VOLUME]);
+		return m_ulStart < m_ullBlocks;
+	}
+
+	//! Scans the whole image, fills out and returns the counters
+	Stats run(Columns &out)
+	{
+		Stats st;
+		std::vector<BlkRef> log;
+
+		scan(log, st);
+		decode(log, out, st);
+		return st;
+	}
+
+	unsigned volume() const { return m_uiVolume; }
+
+private:
+	const uint8_t *blk(uint64_t ullBlock) const { return m_pImg + ullBlock * BLOCKLEN; }
+
+	//! Checks a block the same way as ucSD_CheckBlock(), the CRC field counts as zero
+	bool checkBlock(const uint8_t *p) const
+	{
+		static const uint8_t ucaZero[2] = { 0, 0 };
+		unsigned uiCRC;
+
+		uiCRC = uiCRC16_ComputeBlockCRC(const_cast<uint8_t *>(p), SD_BLK_IDX_CRC);
+		uiCRC = uiCRC16_ComputeCRCwithInit(const_cast<uint8_t *>(ucaZero), 2, uiCRC);
+		uiCRC = uiCRC16_ComputeCRCwithInit(const_cast<uint8_t *>(p) + SD_BLK_IDX_CRC + 2, BLOCKLEN - SD_BLK_IDX_CRC - 2, uiCRC);
+		return uiCRC == get16(&p[SD_BLK_IDX_CRC]);
+	}
+
+	//! Runs fn(thread, first, last) over [0, n) split evenly across the workers
+	template <typename F>
+	void parallel(uint64_t n, F fn) const
+	{
+		std::vector<std::thread> workers;
+		uint64_t ullPer = (n + m_uiThreads - 1) / m_uiThreads;
+
+		for (unsigned t = 0; t < m_uiThreads; t++)
+		{
+			uint64_t ullBeg = std::min<uint64_t>(n, t * ullPer);
+			uint64_t ullEnd = std::min<uint64_t>(n, ullBeg + ullPer);
+			workers.emplace_back(fn, t, ullBeg, ullEnd);
+		}
+		for (std::thread &w : workers)
+			w.join();
+	}
+
+	//! Pass 1: find the intact data blocks of the volume and put them in log order
+	void scan(std::vector<BlkRef> &log, Stats &st) const
+	{
+		std::vector<std::vector<BlkRef>> parts(m_uiThreads);
+		std::vector<Stats> stats(m_uiThreads);
+		uint64_t ullCount = m_ullBlocks - m_ulStart;
+
+		parallel(ullCount, [&](unsigned t, uint64_t ullBeg, uint64_t ullEnd)
+		{
+			for (uint64_t i = ullBeg; i < ullEnd; i++)
+			{
+				const uint8_t *p = blk(m_ulStart + i);
+
+				stats[t].blocks++;
+				if (get16(&p[SD_BLK_IDX_MAGIC]) != SD_BLK_MAGIC || get16(&p[SD_BLK_IDX_VOLUME]) != m_uiVolume)
+					continue;
+				if (!checkBlock(p))
+				{
+					stats[t].badCRC++;
+					continue;
+				}
+				if (p[SD_BLK_IDX_TYPE] != SD_BLK_TYPE_DATA)
+				{
+					stats[t].index++;
+					continue;
+				}
+
+				stats[t].data++;
+				parts[t].push_back(BlkRef { get32(&p[SD_BLK_IDX_SEQ]), uint32_t(m_ulStart + i),
+						uint16_t(std::min<unsigned>(get16(&p[SD_BLK_IDX_END]), BLOCKLEN)), p[SD_BLK_IDX_CARRY] });
+			}
+		});
+
+		for (unsigned t = 0; t < m_uiThreads; t++)
+		{
+			log.insert(log.end(), parts[t].begin(), parts[t].end());
+			st.add(stats[t]);
+		}
+
+		// A page flushed early is written again once full, keep the fullest copy
+		std::sort(log.begin(), log.end(), [](const BlkRef &a, const BlkRef &b)
+		{
+			return (a.seq != b.seq) ? (a.seq < b.seq) : (a.end > b.end);
+		});
+		size_t n = log.size();
+		log.erase(std::unique(log.begin(), log.end(), [](const BlkRef &a, const BlkRef &b) { return a.seq == b.seq; }), log.end());
+		st.dupes += n - log.size();
+	}
+
+	//! Splits a message record into its data elements
+	void decodeMsg(const uint8_t *rec, unsigned uiLen, const BlkRef &b, Columns &c, Stats &st) const
+	{
+		unsigned uiOff = MSG_IDX_PAYLD;
+		uint8_t ucIdx = 0;
+
+		st.msgs++;
+		while (uiOff + 2 <= uiLen)
+		{
+			const uint8_t *de = &rec[uiOff];
+			unsigned uiDeLen = de[DE_IDX_LENGTH];
+			unsigned uiPay;
+
+			if (uiDeLen < 2 || uiOff + uiDeLen > uiLen)
+			{
+				st.badDEs++;
+				return;
+			}
+
+			uiPay = (uiDeLen >= DE_IDX_RPT_PAYLOAD) ? DE_IDX_RPT_PAYLOAD : uiDeLen;
+			c.block.push_back(b.block);
+			c.seq.push_back(b.seq);
+			c.src.push_back(uint16_t(get16(&rec[2])));
+			c.msgNum.push_back(uint16_t(get16(&rec[MSG_IDX_NUM_HI])));
+			c.msgFlags.push_back(rec[MSG_IDX_FLG]);
+			c.deIdx.push_back(ucIdx++);
+			c.deId.push_back(de[DE_IDX_ID]);
+			c.deLen.push_back(uint8_t(uiDeLen));
+			c.deVer.push_back(uiDeLen > DE_IDX_VERSION ? de[DE_IDX_VERSION] : 0);
+			c.deProc.push_back(uiDeLen > DE_IDX_RPT_PROCID ? de[DE_IDX_RPT_PROCID] : 0);
+			c.deTime.push_back(uiDeLen >= DE_IDX_RPT_PAYLOAD ? get32(&de[DE_IDX_TIME_SEC_XI]) : 0);
+			c.payOff.push_back(uint32_t(c.payload.size()));
+			c.payload.insert(c.payload.end(), de + uiPay, de + uiDeLen);
+			st.des++;
+
+			uiOff += uiDeLen;
+		}
+	}
+
+	//! Pass 2: split the blocks into messages, a message cut at the end of a
+	//! block is finished from the carry of the next block in sequence
+	void decode(const std::vector<BlkRef> &log, Columns &out, Stats &st) const
+	{
+		std::vector<Columns> cols(m_uiThreads);
+		std::vector<Stats> stats(m_uiThreads);
+
+		parallel(log.size(), [&](unsigned t, uint64_t ullBeg, uint64_t ullEnd)
+		{
+			uint8_t ucaJoin[MAX_LOGICAL_MSG_SIZE];
+
+			for (uint64_t i = ullBeg; i < ullEnd; i++)
+			{
+				const BlkRef &b = log[i];
+				const uint8_t *p = blk(b.block);
+				unsigned ui = SD_BLK_HDR_SZ + b.carry;
+
+				while (ui < b.end)
+				{
+					unsigned uiRec = (ui + MSG_IDX_PAYLD <= b.end) ? p[ui + MSG_IDX_LEN] + NET_HDR_SZ : 0;
+
+					// Runs off the end, the rest is the carry of the next block
+					if (uiRec == 0 || ui + uiRec > b.end)
+					{
+						const BlkRef *n = (i + 1 < log.size()) ? &log[i + 1] : nullptr;
+						unsigned uiHave = b.end - ui;
+
+						if (n && n->seq == b.seq + 1 && uiHave + n->carry <= MAX_LOGICAL_MSG_SIZE)
+						{
+							memcpy(ucaJoin, &p[ui], uiHave);
+							memcpy(&ucaJoin[uiHave], blk(n->block) + SD_BLK_HDR_SZ, n->carry);
+							uiRec = uiHave + n->carry;
+							if (uiRec >= MSG_IDX_PAYLD && ucaJoin[MSG_IDX_LEN] + NET_HDR_SZ == uiRec)
+							{
+								stats[t].joined++;
+								decodeMsg(ucaJoin, uiRec, b, cols[t], stats[t]);
+							}
+						}
+						break;
+					}
+
+					if (p[ui + MSG_IDX_LEN] == 0 || uiRec > MAX_LOGICAL_MSG_SIZE)
+						break;
+
+					decodeMsg(&p[ui], uiRec, b, cols[t], stats[t]);
+					ui += uiRec;
+				}
+			}
+		});
+
+		for (unsigned t = 0; t < m_uiThreads; t++)
+		{
+			out.append(cols[t]);
+			st.add(stats[t]);
+		}
+	}
+
+	const uint8_t *m_pImg;
+	uint64_t m_ullBlocks;
+	unsigned m_uiThreads;
+	unsigned long m_ulStart = 0;
+	unsigned m_uiVolume = 0;
+};
+
+void writeCSV(const Columns &c)
+{
+	std::string line;
+	char buf[128];
+
+	fputs("block,seq,src,msg_num,msg_flags,de_idx,de_id,de_len,de_version,de_proc,de_time,payload\n", stdout);
+	for (size_t i = 0; i < c.size(); i++)
+	{
+		snprintf(buf, sizeof(buf), "%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,", c.block[i], c.seq[i], c.src[i], c.msgNum[i],
+				c.msgFlags[i], c.deIdx[i], c.deId[i], c.deLen[i], c.deVer[i], c.deProc[i], c.deTime[i]);
+		line = buf;
+		for (uint32_t o = c.payOff[i]; o < c.payEnd(i); o++)
+		{
+			snprintf(buf, sizeof(buf), "%02X", c.payload[o]);
+			line += buf;
+		}
+		line += '\n';
+		fputs(line.c_str(), stdout);
+	}
+}
+
+template <typename T>
+bool writeColumn(const std::string &dir, const char *name, const std::vector<T> &v)
+{
+	std::string path = dir + "/" + name;
+	FILE *f = fopen(path.c_str(), "wb");
+
+	if (f == nullptr)
+	{
+		perror(path.c_str());
+		return false;
+	}
+	fwrite(v.data(), sizeof(T), v.size(), f);
+	fclose(f);
+	return true;
+}
+
+bool writeColumns(const std::string &dir, const Columns &c)
+{
+	return writeColumn(dir, "block.u32", c.block) && writeColumn(dir, "seq.u32", c.seq)
+			&& writeColumn(dir, "src.u16", c.src) && writeColumn(dir, "msg_num.u16", c.msgNum)
+			&& writeColumn(dir, "msg_flags.u8", c.msgFlags) && writeColumn(dir, "de_idx.u8", c.deIdx)
+			&& writeColumn(dir, "de_id.u8", c.deId) && writeColumn(dir, "de_len.u8", c.deLen)
+			&& writeColumn(dir, "de_version.u8", c.deVer) && writeColumn(dir, "de_proc.u8", c.deProc)
+			&& writeColumn(dir, "de_time.u32", c.deTime) && writeColumn(dir, "payload_off.u32", c.payOff)
+			&& writeColumn(dir, "payload.bin", c.payload);
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+	unsigned uiThreads = std::max(1u, std::thread::hardware_concurrency());
+	unsigned uiBench = 0;
+	const char *pcOutDir = nullptr;
+	const char *pcPath = nullptr;
+	struct stat sb;
+	int fd;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+			uiThreads = std::max(1, atoi(argv[++i]));
+		else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+			pcOutDir = argv[++i];
+		else if (strcmp(argv[i], "-B") == 0)
+			uiBench = (i + 1 < argc - 1 && atoi(argv[i + 1]) > 0) ? unsigned(atoi(argv[++i])) : 3;
+		else
+			pcPath = argv[i];
+	}
+	if (pcPath == nullptr)
+	{
+		fprintf(stderr, "usage: %s [-t THREADS] [-o DIR] [-B [ITERS]] card.img\n", argv[0]);
+		return 2;
+	}
+
+	fd = open(pcPath, O_RDONLY);
+	if (fd < 0 || fstat(fd, &sb) != 0)
+	{
+		perror(pcPath);
+		return 1;
+	}
+	if (sb.st_size < off_t(BLOCKLEN))
+	{
+		fprintf(stderr, "%s: image too small\n", pcPath);
+		return 1;
+	}
+
+	void *pMap = mmap(nullptr, size_t(sb.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+	if (pMap == MAP_FAILED)
+	{
+		perror("mmap");
+		return 1;
+	}
+	madvise(pMap, size_t(sb.st_size), MADV_SEQUENTIAL);
+
+	Decoder dec(static_cast<const uint8_t *>(pMap), uint64_t(sb.st_size) / BLOCKLEN, uiThreads);
+	if (!dec.readSuperblock())
+	{
+		fprintf(stderr, "%s: no indexed log superblock\n", pcPath);
+		return 1;
+	}
+
+	Columns cols;
+	Stats st;
+
+	if (uiBench)
+	{
+		double dBest = 1e30;
+
+		for (unsigned it = 0; it < uiBench; it++)
+		{
+			Columns tmp;
+			auto t0 = std::chrono::steady_clock::now();
+			st = dec.run(tmp);
+			double d = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+			dBest = std::min(dBest, d);
+		}
+		fprintf(stderr, "%.3f GB in %.3f s on %u threads: %.2f GB/s\n", double(sb.st_size) / 1e9, dBest, uiThreads,
+				double(sb.st_size) / 1e9 / dBest);
+	}
+	else
+	{
+		st = dec.run(cols);
+		if (pcOutDir != nullptr)
+		{
+			if (!writeColumns(pcOutDir, cols))
+				return 1;
+		}
+		else
+			writeCSV(cols);
+	}
+
+	fprintf(stderr, "volume %04X: %llu blocks, %llu data, %llu index, %llu bad CRC, %llu duplicate, "
+			"%llu messages (%llu joined), %llu DEs, %llu bad DEs\n", dec.volume(),
+			(unsigned long long) st.blocks, (unsigned long long) st.data, (unsigned long long) st.index,
+			(unsigned long long) st.badCRC, (unsigned long long) st.dupes, (unsigned long long) st.msgs,
+			(unsigned long long) st.joined, (unsigned long long) st.des, (unsigned long long) st.badDEs);
+
+	munmap(pMap, size_t(sb.st_size));
+	close(fd);
+	return 0;
+}
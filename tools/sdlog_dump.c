@@ -0,0 +1,387 @@
+///////////////////////////////////////////////////////////////////////////////
+//! \file sdlog_dump.c
+//! \brief Host tool that reads an SD card image written by the firmware
+//!
+//! Prints the messages of the data log (or the block headers) as CSV or
+//! JSON.  The newest block and the start of a time range are located by
+//! binary search over the block headers, so only the blocks that are
+//! printed are read in full.  The on-card layout is in drivers/SD_Log.h.
+//! Blocks are checked with the firmware CRC routines from comm_module/crc.c.
+//!
+//! Build (from the repository root):
+//!
+//!     cc -std=c99 -O2 -DCRC_HOST_BUILD -I. -Idrivers -o sdlog_dump tools/sdlog_dump.c comm_module/crc.c
+//!
+//! Usage:
+//!
+//!     sdlog_dump [-j] [-b] [-n] [-t FROM:TO] card.img
+//!
+//!     -j          JSON instead of CSV
+//!     -b          list the block headers instead of the messages
+//!     -n          only print the newest block
+//!     -t FROM:TO  only blocks that overlap the time range (system seconds)
+//!
+//! An image is taken with e.g. "dd if=/dev/sdX of=card.img bs=512".
+///////////////////////////////////////////////////////////////////////////////
+
+#define _POSIX_C_SOURCE 200809L
+#define _FILE_OFFSET_BITS 64
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include "SD_Log.h"
+
+// comm_module/crc.c
+unsigned int uiCRC16_ComputeBlockCRC(unsigned char *ucPointer, unsigned long ulLength);
+
+#define BLOCKLEN		512
+
+// Message framing, from comm.h
+#define NET_HDR_SZ		4
+#define MSG_IDX_ID		4
+#define MSG_IDX_FLG		5
+#define MSG_IDX_NUM_HI	6
+#define MSG_IDX_LEN		10
+#define MSG_IDX_PAYLD	11
+#define MAX_LOGICAL_MSG_SIZE	255
+
+typedef struct
+{
+	unsigned long ulBlock;
+	int iValid;
+	unsigned char ucType;
+	unsigned char ucCarry;
+	unsigned long ulSeq;
+	unsigned long ulFirst;
+	unsigned long ulLast;
+	unsigned int uiEnd;
+	unsigned char ucaData[BLOCKLEN];
+} S_Blk;
+
+static FILE *g_pImg;
+static unsigned long g_ulStart;			// First block of the log
+static unsigned long g_ulLastBlock;		// Last block of the image
+static unsigned int g_uiVolume;
+static int g_iJson;
+static int g_iFirstRec = 1;
+
+static unsigned int uiGet16(const unsigned char *p) { return ((unsigned int) p[0] << 8) | p[1]; }
+static unsigned long ulGet32(const unsigned char *p)
+{
+	return ((unsigned long) p[0] << 24) | ((unsigned long) p[1] << 16) | ((unsigned long) p[2] << 8) | p[3];
+}
+
+static int iReadRaw(unsigned long ulBlock, unsigned char *p)
+{
+	if (fseeko(g_pImg, (off_t) ulBlock * BLOCKLEN, SEEK_SET) != 0)
+		return 0;
+	return fread(p, 1, BLOCKLEN, g_pImg) == BLOCKLEN;
+}
+
+// Reads a block and decodes its header, iValid is set for intact blocks of the volume
+static void vReadBlk(unsigned long ulBlock, S_Blk *pB)
+{
+	unsigned char ucaTmp[BLOCKLEN];
+	unsigned int uiCRC;
+
+	memset(pB, 0, sizeof(*pB));
+	pB->ulBlock = ulBlock;
+	if (!iReadRaw(ulBlock, pB->ucaData))
+		return;
+	if (uiGet16(&pB->ucaData[SD_BLK_IDX_MAGIC]) != SD_BLK_MAGIC || uiGet16(&pB->ucaData[SD_BLK_IDX_VOLUME]) != g_uiVolume)
+		return;
+
+	memcpy(ucaTmp, pB->ucaData, BLOCKLEN);
+	uiCRC = uiGet16(&ucaTmp[SD_BLK_IDX_CRC]);
+	ucaTmp[SD_BLK_IDX_CRC] = ucaTmp[SD_BLK_IDX_CRC + 1] = 0;
+	if (uiCRC16_ComputeBlockCRC(ucaTmp, BLOCKLEN) != uiCRC)
+		return;
+
+	pB->iValid = 1;
+	pB->ucType = pB->ucaData[SD_BLK_IDX_TYPE];
+	pB->ucCarry = pB->ucaData[SD_BLK_IDX_CARRY];
+	pB->ulSeq = ulGet32(&pB->ucaData[SD_BLK_IDX_SEQ]);
+	pB->ulFirst = ulGet32(&pB->ucaData[SD_BLK_IDX_FIRST_TIME]);
+	pB->ulLast = ulGet32(&pB->ucaData[SD_BLK_IDX_LAST_TIME]);
+	pB->uiEnd = uiGet16(&pB->ucaData[SD_BLK_IDX_END]);
+	if (pB->uiEnd > BLOCKLEN)
+		pB->uiEnd = BLOCKLEN;
+}
+
+// Same search as ulSD_FindNewestBlock(), 0 if the log is empty
+static unsigned long ulFindNewest(void)
+{
+	static S_Blk B;
+	unsigned long ulFirstSeq, ulLo, ulHi, ulMid;
+
+	vReadBlk(g_ulStart, &B);
+	if (!B.iValid)
+		return 0;
+	ulFirstSeq = B.ulSeq;
+
+	ulLo = g_ulStart;
+	ulHi = g_ulLastBlock;
+	while (ulLo < ulHi)
+	{
+		ulMid = ulLo + ((ulHi - ulLo + 1) >> 1);
+		vReadBlk(ulMid, &B);
+		if (B.iValid && B.ulSeq >= ulFirstSeq)
+			ulLo = ulMid;
+		else
+			ulHi = ulMid - 1;
+	}
+	return ulLo;
+}
+
+// The log in write order: g_ulOldest up to the end of the image, then from the start to g_ulNewest
+static unsigned long g_ulOldest, g_ulNewest, g_ulCount;
+
+static unsigned long ulPosToBlock(unsigned long ulPos)
+{
+	if (g_ulOldest != g_ulStart)
+	{
+		if (ulPos <= g_ulLastBlock - g_ulOldest)
+			return g_ulOldest + ulPos;
+		ulPos -= g_ulLastBlock - g_ulOldest + 1;
+	}
+	return g_ulStart + ulPos;
+}
+
+// First position whose block ends at or after ulFrom
+static unsigned long ulFindTime(unsigned long ulFrom)
+{
+	static S_Blk B;
+	unsigned long ulLo = 0, ulHi = g_ulCount, ulMid;
+
+	while (ulLo < ulHi)
+	{
+		ulMid = ulLo + ((ulHi - ulLo) >> 1);
+		vReadBlk(ulPosToBlock(ulMid), &B);
+		if (B.iValid && B.ulLast >= ulFrom)
+			ulHi = ulMid;
+		else
+			ulLo = ulMid + 1;
+	}
+	return ulLo;
+}
+
+static void vRecBegin(void)
+{
+	if (g_iJson)
+		printf("%s\n  {", g_iFirstRec ? "[" : ",");
+	g_iFirstRec = 0;
+}
+
+static void vRecEnd(void)
+{
+	if (!g_iJson)
+		printf("\n");
+	else
+		printf("}");
+}
+
+static void vPrintBlock(const S_Blk *pB)
+{
+	vRecBegin();
+	if (g_iJson)
+		printf("\"block\":%lu,\"type\":\"%s\",\"seq\":%lu,\"first\":%lu,\"last\":%lu,\"carry\":%u,\"end\":%u",
+				pB->ulBlock, pB->ucType == SD_BLK_TYPE_INDEX ? "index" : "data", pB->ulSeq, pB->ulFirst,
+				pB->ulLast, pB->ucCarry, pB->uiEnd);
+	else
+		printf("%lu,%s,%lu,%lu,%lu,%u,%u", pB->ulBlock, pB->ucType == SD_BLK_TYPE_INDEX ? "index" : "data",
+				pB->ulSeq, pB->ulFirst, pB->ulLast, pB->ucCarry, pB->uiEnd);
+	vRecEnd();
+}
+
+static void vPrintMsg(const S_Blk *pB, const unsigned char *p, unsigned int uiLen)
+{
+	unsigned int ui;
+
+	vRecBegin();
+	if (g_iJson)
+		printf("\"block\":%lu,\"seq\":%lu,\"first\":%lu,\"last\":%lu,\"dest\":%u,\"src\":%u,\"id\":%u,\"flags\":%u,\"num\":%u,\"len\":%u,\"data\":\"",
+				pB->ulBlock, pB->ulSeq, pB->ulFirst, pB->ulLast, uiGet16(&p[0]), uiGet16(&p[2]), p[MSG_IDX_ID],
+				p[MSG_IDX_FLG], uiGet16(&p[MSG_IDX_NUM_HI]), uiLen);
+	else
+		printf("%lu,%lu,%lu,%lu,%u,%u,%u,%u,%u,%u,", pB->ulBlock, pB->ulSeq, pB->ulFirst, pB->ulLast, uiGet16(&p[0]),
+				uiGet16(&p[2]), p[MSG_IDX_ID], p[MSG_IDX_FLG], uiGet16(&p[MSG_IDX_NUM_HI]), uiLen);
+	for (ui = 0; ui < uiLen; ui++)
+		printf("%02X", p[ui]);
+	if (g_iJson)
+		printf("\"");
+	vRecEnd();
+}
+
+// The start of a message cut off at the end of the previous block
+static unsigned char g_ucaPend[MAX_LOGICAL_MSG_SIZE];
+static unsigned int g_uiPendHave;
+static unsigned long g_ulPendSeq;
+
+static void vParseBlock(const S_Blk *pB)
+{
+	unsigned int ui = SD_BLK_HDR_SZ + pB->ucCarry;
+	unsigned int uiRec;
+
+	// Finish the message carried over if this is the block right after it
+	if (g_uiPendHave && pB->ulSeq == g_ulPendSeq + 1 && g_uiPendHave + pB->ucCarry <= MAX_LOGICAL_MSG_SIZE)
+	{
+		memcpy(&g_ucaPend[g_uiPendHave], &pB->ucaData[SD_BLK_HDR_SZ], pB->ucCarry);
+		uiRec = g_uiPendHave + pB->ucCarry;
+		if (uiRec >= MSG_IDX_PAYLD && (unsigned int) g_ucaPend[MSG_IDX_LEN] + NET_HDR_SZ == uiRec)
+			vPrintMsg(pB, g_ucaPend, uiRec);
+	}
+	g_uiPendHave = 0;
+
+	while (ui < pB->uiEnd)
+	{
+		// Keep the start of a message that runs off the end of the block
+		if (ui + MSG_IDX_PAYLD > pB->uiEnd
+				|| ui + pB->ucaData[ui + MSG_IDX_LEN] + NET_HDR_SZ > pB->uiEnd)
+		{
+			g_uiPendHave = pB->uiEnd - ui;
+			if (g_uiPendHave > MAX_LOGICAL_MSG_SIZE)
+				g_uiPendHave = 0;
+			g_ulPendSeq = pB->ulSeq;
+			memcpy(g_ucaPend, &pB->ucaData[ui], g_uiPendHave);
+			return;
+		}
+
+		uiRec = pB->ucaData[ui + MSG_IDX_LEN] + NET_HDR_SZ;
+		if (pB->ucaData[ui + MSG_IDX_LEN] == 0 || uiRec > MAX_LOGICAL_MSG_SIZE)
+			return;
+
+		vPrintMsg(pB, &pB->ucaData[ui], uiRec);
+		ui += uiRec;
+	}
+}
+
+int main(int argc, char **argv)
+{
+	static S_Blk Cur, Prev;
+	unsigned char ucaSB[BLOCKLEN];
+	unsigned long ulFrom = 0, ulTo = 0xFFFFFFFFUL, ulPos, ulBlocks;
+	int iBlocks = 0, iNewest = 0, iHavePrev = 0, i;
+	const char *pcPath = NULL;
+
+	for (i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-j") == 0)
+			g_iJson = 1;
+		else if (strcmp(argv[i], "-b") == 0)
+			iBlocks = 1;
+		else if (strcmp(argv[i], "-n") == 0)
+			iNewest = 1;
+		else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+		{
+			if (sscanf(argv[++i], "%lu:%lu", &ulFrom, &ulTo) != 2)
+			{
+				fprintf(stderr, "bad time range %s\n", argv[i]);
+				return 2;
+			}
+		}
+		else
+			pcPath = argv[i];
+	}
+	if (pcPath == NULL)
+	{
+		fprintf(stderr, "usage: %s [-j] [-b] [-n] [-t FROM:TO] card.img\n", argv[0]);
+		return 2;
+	}
+
+	g_pImg = fopen(pcPath, "rb");
+	if (g_pImg == NULL)
+	{
+		perror(pcPath);
+		return 1;
+	}
+	fseeko(g_pImg, 0, SEEK_END);
+	ulBlocks = (unsigned long) (ftello(g_pImg) / BLOCKLEN);
+
+	// Superblock
+	if (!iReadRaw(SD_LOG_SUPERBLOCK, ucaSB) || memcmp(&ucaSB[SD_SB_IDX_MAGIC], "SEGA", 4) != 0)
+	{
+		fprintf(stderr, "%s: no superblock\n", pcPath);
+		return 1;
+	}
+	if (ucaSB[SD_SB_IDX_VERSION] < SD_LOG_MIN_VERSION || ucaSB[SD_SB_IDX_HDR_SZ] != SD_BLK_HDR_SZ
+			|| ucaSB[SD_SB_IDX_INDEX_INTERVAL] != SD_LOG_INDEX_INTERVAL)
+	{
+		fprintf(stderr, "%s: card version %u predates the indexed log\n", pcPath, ucaSB[SD_SB_IDX_VERSION]);
+		return 1;
+	}
+	g_ulStart = ucaSB[SD_SB_IDX_START_BLOCK];
+	g_uiVolume = uiGet16(&ucaSB[SD_SB_IDX_VOLUME]);
+	if (ulBlocks <= g_ulStart)
+	{
+		fprintf(stderr, "%s: image too small\n", pcPath);
+		return 1;
+	}
+	g_ulLastBlock = ulBlocks - 1;
+
+	g_ulNewest = ulFindNewest();
+	if (g_ulNewest == 0)
+	{
+		fprintf(stderr, "%s: log is empty\n", pcPath);
+		return 0;
+	}
+
+	// If the block after the newest is still in the volume the log has wrapped
+	g_ulOldest = g_ulStart;
+	if (g_ulNewest < g_ulLastBlock)
+	{
+		vReadBlk(g_ulNewest + 1, &Cur);
+		if (Cur.iValid)
+			g_ulOldest = g_ulNewest + 1;
+	}
+	g_ulCount = g_ulNewest - g_ulStart + 1;
+	if (g_ulOldest != g_ulStart)
+		g_ulCount += g_ulLastBlock - g_ulOldest + 1;
+
+	if (iNewest)
+	{
+		vReadBlk(g_ulNewest, &Cur);
+		vPrintBlock(&Cur);
+		if (g_iJson)
+			printf("\n]\n");
+		return 0;
+	}
+
+	if (!g_iJson)
+		printf(iBlocks ? "block,type,seq,first,last,carry,end\n" : "block,seq,first,last,dest,src,id,flags,num,len,data\n");
+
+	for (ulPos = (ulFrom != 0) ? ulFindTime(ulFrom) : 0; ulPos < g_ulCount; ulPos++)
+	{
+		vReadBlk(ulPosToBlock(ulPos), &Cur);
+		if (!Cur.iValid)
+		{
+			fprintf(stderr, "block %lu: bad header or CRC, skipped\n", Cur.ulBlock);
+			continue;
+		}
+		if (Cur.ulFirst > ulTo)
+			break;
+
+		if (iBlocks)
+		{
+			vPrintBlock(&Cur);
+			continue;
+		}
+		if (Cur.ucType != SD_BLK_TYPE_DATA)
+			continue;
+
+		// A page flushed early is written again once full, keep the later copy
+		if (iHavePrev && Prev.ulSeq != Cur.ulSeq)
+			vParseBlock(&Prev);
+		Prev = Cur;
+		iHavePrev = 1;
+	}
+	if (iHavePrev)
+		vParseBlock(&Prev);
+
+	if (g_iJson)
+		printf("%s]\n", g_iFirstRec ? "[" : "\n");
+
+	fclose(g_pImg);
+	return 0;
+}
@@ -0,0 +1,121 @@
+///////////////////////////////////////////////////////////////////////////////
+//! \file msp430.h
+//! \brief Host stand-in for the MSP430 register header, used by spidma_test
+//!
+//! Only the registers hal/spi.c touches are here.  They live in one fake
+//! register file, the USCI_B0 and DMA behaviour behind them is modelled in
+//! spidma_test.c.  The status, interrupt flag and receive buffer registers
+//! are read through a function so the model sees every access: the DMA
+//! triggers are edge sensitive, reading UCB0RXBUF clears UCRXIFG and the
+//! USCI keeps shifting while the CPU polls UCBUSY.  Entering a low
+//! power mode hands the CPU to the model until an interrupt wakes it.
+///////////////////////////////////////////////////////////////////////////////
+#ifndef SPIDMA_MSP430_H
+#define SPIDMA_MSP430_H
+
+/* FAKE REGISTER FILE */
+typedef struct
+{
+	unsigned int uiSR;
+
+	unsigned int uiDMACTL0;
+	unsigned int uiDMA0CTL;
+	unsigned long ulDMA0SA;
+	unsigned long ulDMA0DA;
+	unsigned int uiDMA0SZ;
+	unsigned int uiDMA1CTL;
+	unsigned long ulDMA1SA;
+	unsigned long ulDMA1DA;
+	unsigned int uiDMA1SZ;
+
+	unsigned char ucUCB0CTL0;
+	unsigned char ucUCB0CTL1;
+	unsigned int uiUCB0BRW;
+	unsigned char ucUCB0STAT;
+	unsigned char ucUCB0IFG;
+	unsigned char ucUCB0TXBUF;
+	unsigned char ucUCB0RXBUF;
+
+	unsigned char ucP3DIR;
+	unsigned char ucP3SEL;
+} S_FakeRegs;
+
+extern volatile S_FakeRegs g_sFakeRegs;
+
+volatile unsigned char *pucFAKE_UCB0STAT(void);
+volatile unsigned char *pucFAKE_UCB0IFG(void);
+volatile unsigned char *pucFAKE_UCB0RXBUF(void);
+void vFAKE_WriteAddr(unsigned short usReg, unsigned long ulAddr);
+void vFAKE_BisSR(unsigned int uiBits);
+
+#define DMACTL0			(g_sFakeRegs.uiDMACTL0)
+#define DMA0CTL			(g_sFakeRegs.uiDMA0CTL)
+#define DMA0SA			(g_sFakeRegs.ulDMA0SA)
+#define DMA0DA			(g_sFakeRegs.ulDMA0DA)
+#define DMA0SZ			(g_sFakeRegs.uiDMA0SZ)
+#define DMA1CTL			(g_sFakeRegs.uiDMA1CTL)
+#define DMA1SA			(g_sFakeRegs.ulDMA1SA)
+#define DMA1DA			(g_sFakeRegs.ulDMA1DA)
+#define DMA1SZ			(g_sFakeRegs.uiDMA1SZ)
+
+#define UCB0CTL0		(g_sFakeRegs.ucUCB0CTL0)
+#define UCB0CTL1		(g_sFakeRegs.ucUCB0CTL1)
+#define UCB0BRW			(g_sFakeRegs.uiUCB0BRW)
+#define UCB0STAT		(*pucFAKE_UCB0STAT())
+#define UCB0IFG			(*pucFAKE_UCB0IFG())
+#define UCB0TXBUF		(g_sFakeRegs.ucUCB0TXBUF)
+#define UCB0RXBUF		(*pucFAKE_UCB0RXBUF())
+
+#define P3DIR			(g_sFakeRegs.ucP3DIR)
+#define P3SEL			(g_sFakeRegs.ucP3SEL)
+
+/* INTRINSICS */
+// The firmware passes the register address cut to 16 bits like the real
+// intrinsic takes it, the model matches it against the low half of the
+// fake register addresses (the register file is far smaller than 64K)
+#define __data16_write_addr(a,b)	vFAKE_WriteAddr((a), (b))
+#define __get_SR_register()			(g_sFakeRegs.uiSR)
+#define __bis_SR_register(x)		vFAKE_BisSR(x)
+#define __disable_interrupt()		(g_sFakeRegs.uiSR &= ~GIE)
+#define __enable_interrupt()		(g_sFakeRegs.uiSR |= GIE)
+
+/* BITS */
+#define BIT0	0x0001
+#define BIT1	0x0002
+#define BIT2	0x0004
+#define BIT3	0x0008
+#define BIT4	0x0010
+#define BIT5	0x0020
+#define BIT6	0x0040
+#define BIT7	0x0080
+
+#define GIE				0x0008
+#define CPUOFF			0x0010
+#define LPM0_bits		(CPUOFF)
+
+/* USCI */
+#define UCSWRST			0x01
+#define UCSSEL_2		0x80
+#define UCSYNC			0x01
+#define UCRXIFG			0x01
+#define UCTXIFG			0x02
+#define UCBUSY			0x01
+#define UCOE			0x20
+
+/* DMA CHANNEL CONTROL */
+#define DMAREQ			0x0001
+#define DMAABORT		0x0002
+#define DMAIE			0x0004
+#define DMAIFG			0x0008
+#define DMAEN			0x0010
+#define DMALEVEL		0x0020
+#define DMASRCBYTE		0x0040
+#define DMADSTBYTE		0x0080
+#define DMASBDB			(DMASRCBYTE + DMADSTBYTE)
+#define DMASRCINCR_0	0x0000
+#define DMASRCINCR_3	0x0300
+#define DMADSTINCR_0	0x0000
+#define DMADSTINCR_3	0x0C00
+#define DMADT_0			0x0000
+
+#endif /* SPIDMA_MSP430_H */
@@ -0,0 +1,495 @@
+///////////////////////////////////////////////////////////////////////////////
+//! \file spidma_test.c
+//! \brief Host test of the SPI DMA transfers in hal/spi.c
+//!
+//! hal/spi.c is compiled for the host against the fake register file in
+//! host/msp430.h.  This file models what sits behind those registers:
+//!
+//!     USCI_B0     a write to UCB0TXBUF clears UCTXIFG, the byte moves to the
+//!                 shift register on the next step and UCTXIFG is set
+//!                 again, one step later the byte from the slave is in
+//!                 UCB0RXBUF and UCRXIFG is set (UCOE if it already was)
+//!     DMA         a channel is triggered by the rising edge of the flag
+//!                 its DMACTL0 trigger selects, only while DMAEN is set.
+//!                 Channel 0 wins over channel 1, one transfer per step.
+//!                 At DMAxSZ == 0 DMAEN is cleared and DMAIFG set.
+//!     DMA ISR     same as DMA_ISR() in hal/irupt.c, wakes the CPU from
+//!                 LPM0 when channel 0 is done
+//!
+//! The slave records every byte it is sent and answers with a known
+//! pattern.  If the CPU goes to sleep while nothing in the model can wake
+//! it the transfer would hang on the part, the test reports it and moves on.
+//!
+//! Build and run (from the repository root):
+//!
+//!     cc -std=gnu99 -O2 -Wall -Wextra -Wno-pointer-to-int-cast -Itools/spidma/host -I. -Ihal -o spidma_test tools/spidma/spidma_test.c hal/spi.c
+//!     ./spidma_test
+//!
+//! The exit status is 1 if a check failed.
+///////////////////////////////////////////////////////////////////////////////
+
+#include <setjmp.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "msp430.h"
+#include "config.h"
+
+//! \def FAKE_MAX_STEPS
+//! \brief Model steps one LPM0 sleep may take before it counts as a hang
+#define FAKE_MAX_STEPS		100000UL
+
+//! \def SLAVE_MAX
+//! \brief Bytes the slave records
+#define SLAVE_MAX			1024
+
+// hal/spi.c calls it when a polled byte times out
+void vSERIAL_sout(char *cStrPtr, unsigned int uiLength)
+{
+	fwrite(cStrPtr, 1, uiLength, stdout);
+}
+
+/* FAKE REGISTER FILE */
+volatile S_FakeRegs g_sFakeRegs;
+
+/* MODEL STATE */
+static unsigned char ucTXLow;			// UCTXIFG was seen low since its last edge
+static unsigned char ucRXLow;			// UCRXIFG was seen low since its last edge
+static unsigned char ucTXFull;			// UCB0TXBUF holds a byte to send
+static unsigned char ucShifting;		// A byte is in the shift register
+static unsigned char ucShiftByte;
+static unsigned char ucaPending[2];		// Triggered DMA channels
+static unsigned long ulDMATransfers;
+static jmp_buf S_Hang;
+
+/* SLAVE */
+static unsigned char ucaSlaveIn[SLAVE_MAX];
+static unsigned int uiSlaveInCount;
+static unsigned char ucSlaveSeed;
+
+static int iFailures;
+
+//! \def CHECK
+//! \brief Counts and reports a failed check, true if it failed
+#define CHECK(cond)		iCheck((cond), __LINE__, #cond)
+
+static int iCheck(int iOk, int iLine, const char *cpCond)
+{
+	if (!iOk)
+	{
+		printf("  FAIL %s:%d: %s\n", __FILE__, iLine, cpCond);
+		iFailures++;
+	}
+	return !iOk;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//! \brief Byte the slave answers with at position uiPos
+//////////////////////////////////////////////////////////////////////////////
+static unsigned char ucSlave_Pattern(unsigned int uiPos)
+{
+	return (unsigned char) (uiPos * 7 + ucSlaveSeed);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//! \brief The slave takes one byte and answers with the next pattern byte
+//////////////////////////////////////////////////////////////////////////////
+static unsigned char ucSlave_Exchange(unsigned char ucIn)
+{
+	unsigned char ucOut;
+
+	ucOut = ucSlave_Pattern(uiSlaveInCount);
+	if (uiSlaveInCount < SLAVE_MAX)
+		ucaSlaveIn[uiSlaveInCount] = ucIn;
+	uiSlaveInCount++;
+
+	return ucOut;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//! \brief Hands a trigger to every enabled channel that selects it
+//////////////////////////////////////////////////////////////////////////////
+static void vFAKE_Trigger(unsigned int uiTrig)
+{
+	if ((g_sFakeRegs.uiDMA0CTL & DMAEN) && (g_sFakeRegs.uiDMACTL0 & 0x1F) == uiTrig)
+		ucaPending[0] = 1;
+	if ((g_sFakeRegs.uiDMA1CTL & DMAEN) && ((g_sFakeRegs.uiDMACTL0 >> 8) & 0x1F) == uiTrig)
+		ucaPending[1] = 1;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//! \brief Looks at the USCI flags and triggers the DMA on rising edges
+//////////////////////////////////////////////////////////////////////////////
+static void vFAKE_Sample(void)
+{
+	if (!(g_sFakeRegs.ucUCB0IFG & UCTXIFG))
+		ucTXLow = 1;
+	else if (ucTXLow)
+	{
+		ucTXLow = 0;
+		vFAKE_Trigger(SPI_DMA_TX_TRIG);
+	}
+
+	if (!(g_sFakeRegs.ucUCB0IFG & UCRXIFG))
+		ucRXLow = 1;
+	else if (ucRXLow)
+	{
+		ucRXLow = 0;
+		vFAKE_Trigger(SPI_DMA_RX_TRIG);
+	}
+}
+
+volatile unsigned char *pucFAKE_UCB0IFG(void)
+{
+	vFAKE_Sample();
+	return &g_sFakeRegs.ucUCB0IFG;
+}
+
+volatile unsigned char *pucFAKE_UCB0RXBUF(void)
+{
+	vFAKE_Sample();
+	g_sFakeRegs.ucUCB0IFG &= ~UCRXIFG;
+	g_sFakeRegs.ucUCB0STAT &= ~UCOE;
+	return &g_sFakeRegs.ucUCB0RXBUF;
+}
+
+void vFAKE_WriteAddr(unsigned short usReg, unsigned long ulAddr)
+{
+	volatile unsigned long *p_ulaRegs[] = { &g_sFakeRegs.ulDMA0SA, &g_sFakeRegs.ulDMA0DA, &g_sFakeRegs.ulDMA1SA,
+			&g_sFakeRegs.ulDMA1DA };
+	unsigned int i;
+
+	for (i = 0; i < sizeof(p_ulaRegs) / sizeof(p_ulaRegs[0]); i++)
+	{
+		if ((unsigned short) (uintptr_t) p_ulaRegs[i] == usReg)
+		{
+			*p_ulaRegs[i] = ulAddr;
+			return;
+		}
+	}
+	printf("  FAIL: __data16_write_addr() to an unknown register\n");
+	iFailures++;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//! \brief One single transfer of a DMA channel
+//////////////////////////////////////////////////////////////////////////////
+static void vFAKE_DMATransfer(unsigned char ucCh)
+{
+	volatile unsigned int *p_uiCtl = ucCh ? &g_sFakeRegs.uiDMA1CTL : &g_sFakeRegs.uiDMA0CTL;
+	volatile unsigned long *p_ulSA = ucCh ? &g_sFakeRegs.ulDMA1SA : &g_sFakeRegs.ulDMA0SA;
+	volatile unsigned long *p_ulDA = ucCh ? &g_sFakeRegs.ulDMA1DA : &g_sFakeRegs.ulDMA0DA;
+	volatile unsigned int *p_uiSZ = ucCh ? &g_sFakeRegs.uiDMA1SZ : &g_sFakeRegs.uiDMA0SZ;
+	volatile unsigned char *p_ucSrc = (volatile unsigned char *) (uintptr_t) *p_ulSA;
+	volatile unsigned char *p_ucDst = (volatile unsigned char *) (uintptr_t) *p_ulDA;
+	unsigned char ucByte;
+
+	ucaPending[ucCh] = 0;
+	ulDMATransfers++;
+
+	// Byte to byte only, that is all the SPI needs
+	if ((*p_uiCtl & DMASBDB) != DMASBDB)
+	{
+		printf("  FAIL: channel %u is not byte to byte\n", ucCh);
+		iFailures++;
+	}
+
+	if (p_ucSrc == &g_sFakeRegs.ucUCB0RXBUF)
+		ucByte = *pucFAKE_UCB0RXBUF();
+	else
+		ucByte = *p_ucSrc;
+
+	*p_ucDst = ucByte;
+	if (p_ucDst == &g_sFakeRegs.ucUCB0TXBUF)
+	{
+		ucTXFull = 1;
+		g_sFakeRegs.ucUCB0IFG &= ~UCTXIFG;
+	}
+
+	if ((*p_uiCtl & DMASRCINCR_3) == DMASRCINCR_3)
+		(*p_ulSA)++;
+	if ((*p_uiCtl & DMADSTINCR_3) == DMADSTINCR_3)
+		(*p_ulDA)++;
+
+	if (--(*p_uiSZ) == 0)
+	{
+		*p_uiCtl &= ~DMAEN;
+		*p_uiCtl |= DMAIFG;
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//! \brief One step of USCI_B0 in SPI master mode
+//////////////////////////////////////////////////////////////////////////////
+static void vFAKE_USCIStep(void)
+{
+	if (ucShifting)
+	{
+		ucShifting = 0;
+		if (g_sFakeRegs.ucUCB0IFG & UCRXIFG)
+			g_sFakeRegs.ucUCB0STAT |= UCOE;
+		g_sFakeRegs.ucUCB0RXBUF = ucSlave_Exchange(ucShiftByte);
+		g_sFakeRegs.ucUCB0IFG |= UCRXIFG;
+	}
+	else if (ucTXFull)
+	{
+		ucShiftByte = g_sFakeRegs.ucUCB0TXBUF;
+		ucTXFull = 0;
+		ucShifting = 1;
+		g_sFakeRegs.ucUCB0IFG |= UCTXIFG;
+	}
+
+	if (ucShifting)
+		g_sFakeRegs.ucUCB0STAT |= UCBUSY;
+	else
+		g_sFakeRegs.ucUCB0STAT &= ~UCBUSY;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//! \brief DMA_ISR() of hal/irupt.c
+//////////////////////////////////////////////////////////////////////////////
+static void vFAKE_DMAISR(void)
+{
+	g_sFakeRegs.uiDMA0CTL &= ~DMAIFG;
+	g_ucSPI_DMADone = 1;
+	g_sFakeRegs.uiSR &= ~LPM0_bits;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//! \brief One step of the DMA and the USCI, false if there was nothing to do
+//////////////////////////////////////////////////////////////////////////////
+static int iFAKE_Step(void)
+{
+	vFAKE_Sample();
+	if (!ucShifting && !ucTXFull && !ucaPending[0] && !ucaPending[1])
+		return 0;
+
+	if (ucaPending[0])
+		vFAKE_DMATransfer(0);
+	else if (ucaPending[1])
+		vFAKE_DMATransfer(1);
+	vFAKE_Sample();
+
+	vFAKE_USCIStep();
+	vFAKE_Sample();
+
+	return 1;
+}
+
+volatile unsigned char *pucFAKE_UCB0STAT(void)
+{
+	// The hardware moves on while the CPU polls the busy flag
+	iFAKE_Step();
+	return &g_sFakeRegs.ucUCB0STAT;
+}
+
+void vFAKE_BisSR(unsigned int uiBits)
+{
+	unsigned long ulStep;
+
+	g_sFakeRegs.uiSR |= uiBits;
+	if (!(g_sFakeRegs.uiSR & CPUOFF))
+		return;
+
+	// The CPU is asleep, run the hardware until an interrupt wakes it
+	for (ulStep = 0; ulStep < FAKE_MAX_STEPS; ulStep++)
+	{
+		if ((g_sFakeRegs.uiSR & GIE) && (g_sFakeRegs.uiDMA0CTL & (DMAIE | DMAIFG)) == (DMAIE | DMAIFG))
+		{
+			vFAKE_DMAISR();
+			return;
+		}
+
+		if (!iFAKE_Step())
+			break;
+	}
+
+	printf("  FAIL: asleep in LPM0 with nothing left to wake the CPU\n");
+	iFailures++;
+	longjmp(S_Hang, 1);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//! \brief Puts the USCI and DMA in their reset state, SPI enabled
+//////////////////////////////////////////////////////////////////////////////
+static void vFAKE_Reset(unsigned int uiSR)
+{
+	g_sFakeRegs = (S_FakeRegs) {0};
+	g_sFakeRegs.uiSR = uiSR;
+	g_sFakeRegs.ucUCB0IFG = UCTXIFG;
+	ucTXLow = ucRXLow = 0;
+	ucTXFull = ucShifting = 0;
+	ucaPending[0] = ucaPending[1] = 0;
+	ulDMATransfers = 0;
+	uiSlaveInCount = 0;
+	ucSlaveSeed++;
+	g_ucSPI_DMADone = 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//! \brief Checks that hold after every DMA transfer
+//////////////////////////////////////////////////////////////////////////////
+static void vCheck_DMADone(unsigned int uiCount, unsigned int uiSR)
+{
+	CHECK(uiSlaveInCount == uiCount);
+	CHECK(ulDMATransfers == 2UL * uiCount);
+	CHECK(g_ucSPI_DMADone == 1);
+	CHECK(!(g_sFakeRegs.uiDMA0CTL & DMAEN));
+	CHECK(!(g_sFakeRegs.uiDMA1CTL & DMAEN));
+	CHECK(!(g_sFakeRegs.ucUCB0STAT & UCOE));
+	CHECK(!(g_sFakeRegs.ucUCB0STAT & UCBUSY));
+	CHECK(g_sFakeRegs.uiSR == uiSR);
+}
+
+static void vTest_TXBytes(unsigned int uiCount, unsigned int uiSR)
+{
+	unsigned char ucaData[SLAVE_MAX];
+	unsigned int i;
+
+	printf("TX %u bytes, GIE %s\n", uiCount, (uiSR & GIE) ? "on" : "off");
+	vFAKE_Reset(uiSR);
+	for (i = 0; i < uiCount; i++)
+		ucaData[i] = (unsigned char) (i * 13 + 5);
+
+	if (setjmp(S_Hang) == 0)
+		vSPI_TXBytes(ucaData, uiCount);
+
+	vCheck_DMADone(uiCount, uiSR);
+	for (i = 0; i < uiCount && i < uiSlaveInCount; i++)
+		if (CHECK(ucaSlaveIn[i] == (unsigned char) (i * 13 + 5)))
+			break;
+
+	// What came back went to the sink, not over the data
+	for (i = 0; i < uiCount; i++)
+		if (CHECK(ucaData[i] == (unsigned char) (i * 13 + 5)))
+			break;
+}
+
+static void vTest_RXBytes(unsigned int uiCount)
+{
+	unsigned char ucaData[SLAVE_MAX + 4];
+	unsigned int i;
+
+	printf("RX %u bytes\n", uiCount);
+	vFAKE_Reset(0);
+	for (i = 0; i < sizeof(ucaData); i++)
+		ucaData[i] = 0xA5;
+
+	if (setjmp(S_Hang) == 0)
+		vSPI_RX_Bytes(ucaData, uiCount);
+
+	vCheck_DMADone(uiCount, 0);
+	for (i = 0; i < uiCount; i++)
+		if (CHECK(ucaData[i] == ucSlave_Pattern(i)))
+			break;
+	for (i = 0; i < uiCount && i < uiSlaveInCount; i++)
+		if (CHECK(ucaSlaveIn[i] == 0xFF))
+			break;
+
+	// Nothing written past the end
+	for (i = uiCount; i < sizeof(ucaData); i++)
+		if (CHECK(ucaData[i] == 0xA5))
+			break;
+}
+
+static void vTest_FillBytes(unsigned char ucFill, unsigned int uiCount)
+{
+	unsigned int i;
+
+	printf("Fill %u bytes of 0x%02X\n", uiCount, ucFill);
+	vFAKE_Reset(0);
+
+	if (setjmp(S_Hang) == 0)
+		vSPI_FillBytes(ucFill, uiCount);
+
+	vCheck_DMADone(uiCount, 0);
+	for (i = 0; i < uiCount && i < uiSlaveInCount; i++)
+		if (CHECK(ucaSlaveIn[i] == ucFill))
+			break;
+}
+
+static void vTest_ShortRun(void)
+{
+	unsigned char ucaData[SPI_DMA_MIN_COUNT];
+	unsigned int i;
+
+	printf("Runs under %u bytes are polled\n", SPI_DMA_MIN_COUNT);
+	vFAKE_Reset(GIE);
+	for (i = 0; i < sizeof(ucaData); i++)
+		ucaData[i] = (unsigned char) i;
+
+	if (setjmp(S_Hang) == 0)
+	{
+		vSPI_TXBytes(ucaData, SPI_DMA_MIN_COUNT - 1);
+		vSPI_RX_Bytes(ucaData, SPI_DMA_MIN_COUNT - 1);
+		vSPI_FillBytes(0, SPI_DMA_MIN_COUNT - 1);
+	}
+
+	CHECK(ulDMATransfers == 0);
+	CHECK(!(g_sFakeRegs.uiDMA0CTL & DMAEN));
+	CHECK(!(g_sFakeRegs.uiDMA1CTL & DMAEN));
+	CHECK(g_sFakeRegs.uiSR == GIE);
+}
+
+static void vTest_BackToBack(void)
+{
+	unsigned char ucaData[64];
+	unsigned int i;
+
+	printf("Back to back transfers\n");
+	vFAKE_Reset(0);
+	for (i = 0; i < sizeof(ucaData); i++)
+		ucaData[i] = (unsigned char) ~i;
+
+	if (setjmp(S_Hang) == 0)
+	{
+		vSPI_TXBytes(ucaData, 32);
+		vSPI_RX_Bytes(ucaData, 48);
+		vSPI_TXBytes(ucaData, SPI_DMA_MIN_COUNT);
+	}
+
+	CHECK(uiSlaveInCount == 32 + 48 + SPI_DMA_MIN_COUNT);
+	CHECK(!(g_sFakeRegs.ucUCB0STAT & UCOE));
+	for (i = 0; i < 32 && i < uiSlaveInCount; i++)
+		if (CHECK(ucaSlaveIn[i] == (unsigned char) ~i))
+			break;
+	for (i = 0; i < 48; i++)
+		if (CHECK(ucaData[i] == ucSlave_Pattern(32 + i)))
+			break;
+}
+
+static void vTest_StaleRXFlag(void)
+{
+	unsigned char ucaData[32];
+	unsigned int i;
+
+	printf("RX with a byte left over in UCB0RXBUF\n");
+	vFAKE_Reset(0);
+	g_sFakeRegs.ucUCB0RXBUF = 0x55;
+	g_sFakeRegs.ucUCB0IFG |= UCRXIFG;
+
+	if (setjmp(S_Hang) == 0)
+		vSPI_RX_Bytes(ucaData, sizeof(ucaData));
+
+	vCheck_DMADone(sizeof(ucaData), 0);
+	for (i = 0; i < sizeof(ucaData); i++)
+		if (CHECK(ucaData[i] == ucSlave_Pattern(i)))
+			break;
+}
+
+int main(void)
+{
+	vTest_TXBytes(SPI_DMA_MIN_COUNT, 0);
+	vTest_TXBytes(512, 0);
+	vTest_TXBytes(512, GIE);
+	vTest_RXBytes(SPI_DMA_MIN_COUNT);
+	vTest_RXBytes(SLAVE_MAX);
+	vTest_FillBytes(0x00, 512);
+	vTest_FillBytes(0xFF, 100);
+	vTest_ShortRun();
+	vTest_BackToBack();
+	vTest_StaleRXFlag();
+
+	printf("%s, %d failed checks\n", iFailures ? "FAILED" : "ok", iFailures);
+	return iFailures ? 1 : 0;
+}
@@ -0,0 +1,554 @@
+///////////////////////////////////////////////////////////////////////////////
+//! \file tsb_jrnl_test.c
+//! \brief Host test of the task state block journal in mem_mod/L2fram.c
+//!
+//! mem_mod/L2fram.c is included below over a FRAM that is a byte array.
+//! Each write to it can be the last one before a reset: the write stops
+//! after a set number of bytes and the test jumps back to its main loop, as
+//! a power cut would.  Every run starts from a formatted table and plays
+//! random operations on it:
+//!
+//!     stuff       vL2FRAM_stuffTSB() on a block in the table
+//!     put         vL2FRAM_putTSBEntryVals() with 1 to 3 fields of a block
+//!     add         cL2FRAM_addTSB() with the fields of a random task
+//!     delete      vL2FRAM_deleteTSB(), the last block moves into the hole
+//!
+//! The expected table is kept beside it.  After an operation that finished
+//! the count and every field read through ulL2FRAM_getTSBEntryVal() must
+//! match it.  An operation is cut short at a random byte of its writes, or
+//! the node resets after it, and ucL2FRAM_replayTSBJrnl() runs as at boot,
+//! sometimes cut short itself and run again.  The table in FRAM must then
+//! be the table from before the operation or the one after it, never a
+//! mix.  The test also checks that cuts land in both places and that some
+//! replays find a torn record.
+//!
+//! Build and run (from the repository root):
+//!
+//!     cc -std=gnu99 -O2 -Wall -Wextra -DCRC_HOST_BUILD -Itools/commsim/host -I. -Ihal -Idrivers -Imem_mod -Icomm_module -ITasks -o tsb_jrnl_test tools/tsb_jrnl_test.c comm_module/crc.c
+//!     ./tsb_jrnl_test [seed]
+//!
+//! The exit status is 1 if a check failed.
+///////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include "L2fram.c"
+
+//! \def TEST_RUNS
+//! \def TEST_OPS
+//! \brief Runs from a formatted table and operations per run
+#define TEST_RUNS			400
+#define TEST_OPS			500
+
+//! \def TEST_CUT_CHANCE
+//! \def TEST_REBOOT_CHANCE
+//! \brief Chance in percent that an operation or a replay is cut short and
+//! that the node resets after an operation that finished
+#define TEST_CUT_CHANCE		30
+#define TEST_REBOOT_CHANCE	10
+
+//! \def TEST_MAX_CUT
+//! \brief Cuts land within this many bytes, past every write of an operation
+#define TEST_MAX_CUT		(2 * FRAM_TSB_JRNL_SIZE + 4 * FRAM_ST_BLK_SIZE)
+
+//! \def TEST_NO_CUT
+#define TEST_NO_CUT			(-1L)
+
+//! \struct S_TestTbl
+//! \brief The task state block table as it is in FRAM
+typedef struct
+{
+	uchar m_ucCount;
+	uchar m_ucaBlk[FRAM_MAX_TSB_COUNT][FRAM_ST_BLK_SIZE];
+} S_TestTbl;
+
+static uchar ucaTestFram[FRAM_MAX_ADDRESS + 1];
+static long lTest_WriteBudget;
+static jmp_buf jbTest_Reset;
+
+// The task cL2FRAM_addTSB() reads
+static ulong ulaTest_TaskField[3];
+static ulong ulaTest_TaskParam[4];
+
+static unsigned int uiFailCount;
+static unsigned int uiTornCount;
+static unsigned long ulRandState;
+
+static unsigned long ulTest_Random(void)
+{
+	ulRandState ^= ulRandState << 13;
+	ulRandState ^= ulRandState >> 17;
+	ulRandState ^= ulRandState << 5;
+	ulRandState &= 0xFFFFFFFFUL;
+	return ulRandState;
+}
+
+static void vTest_Check(int iOk, const char *cpWhat, unsigned int uiRun, unsigned int uiOp)
+{
+	if (iOk)
+		return;
+
+	if (uiFailCount < 10)
+		printf("FAIL %s run %u op %u\n", cpWhat, uiRun, uiOp);
+	uiFailCount++;
+}
+
+/*****************************  FRAM  ****************************************/
+
+// Every write goes through here, the write budget running out is a power cut
+static void vTest_FramWrite(uint uiAddr, const uchar *ucpData, uint uiCount, int iFill)
+{
+	uint uiii;
+
+	for (uiii = 0; uiii < uiCount; uiii++)
+	{
+		if (lTest_WriteBudget == 0)
+			longjmp(jbTest_Reset, 1);
+		if (lTest_WriteBudget > 0)
+			lTest_WriteBudget--;
+		ucaTestFram[uiAddr + uiii] = iFill ? ucpData[0] : ucpData[uiii];
+	}
+}
+
+uchar ucFRAM_read_B8(uint uiAddr, uchar *ucData)
+{
+	*ucData = ucaTestFram[uiAddr];
+	return 0;
+}
+
+uchar ucFRAM_write_B8(uint uiAddr, uchar ucData)
+{
+	vTest_FramWrite(uiAddr, &ucData, 1, 0);
+	return 0;
+}
+
+uchar ucFRAM_read_block(uint uiAddr, uchar *ucpData, uint uiCount)
+{
+	memcpy(ucpData, &ucaTestFram[uiAddr], uiCount);
+	return 0;
+}
+
+uchar ucFRAM_write_block(uint uiAddr, const uchar *ucpData, uint uiCount)
+{
+	vTest_FramWrite(uiAddr, ucpData, uiCount, 0);
+	return 0;
+}
+
+uchar ucFRAM_fill_block(uint uiAddr, uchar ucSetVal, uint uiCount)
+{
+	vTest_FramWrite(uiAddr, &ucSetVal, uiCount, 1);
+	return 0;
+}
+
+uchar ucFRAM_read_B16(uint uiAddr, uint *uiData)
+{
+	*uiData = ((uint) ucaTestFram[uiAddr] << 8) | ucaTestFram[uiAddr + 1];
+	return 0;
+}
+
+uchar ucFRAM_write_B16(uint uiAddr, uint uiData)
+{
+	uchar ucaVal[2];
+
+	ucaVal[0] = (uchar) (uiData >> 8);
+	ucaVal[1] = (uchar) uiData;
+	vTest_FramWrite(uiAddr, ucaVal, 2, 0);
+	return 0;
+}
+
+uchar ucFRAM_read_B32(uint uiAddr, ulong *ulData)
+{
+	*ulData = ((ulong) ucaTestFram[uiAddr] << 24) | ((ulong) ucaTestFram[uiAddr + 1] << 16)
+			| ((ulong) ucaTestFram[uiAddr + 2] << 8) | ucaTestFram[uiAddr + 3];
+	return 0;
+}
+
+uchar ucFRAM_write_B32(uint uiAddr, ulong ulData)
+{
+	uchar ucaVal[4];
+
+	ucaVal[0] = (uchar) (ulData >> 24);
+	ucaVal[1] = (uchar) (ulData >> 16);
+	ucaVal[2] = (uchar) (ulData >> 8);
+	ucaVal[3] = (uchar) ulData;
+	vTest_FramWrite(uiAddr, ucaVal, 4, 0);
+	return 0;
+}
+
+void vFRAM_fillFramBlk(uint uiStartAddr, uint uiCount, uchar ucSetVal)
+{
+	ucFRAM_fill_block(uiStartAddr, ucSetVal, uiCount);
+}
+
+void vFRAM_show_fram(uint uiStartAddr, uint uiCount)
+{
+	(void) uiStartAddr;
+	(void) uiCount;
+}
+
+void vFRAM_Security(uint uiStartAddr, uint uiEndAddress)
+{
+	(void) uiStartAddr;
+	(void) uiEndAddress;
+}
+
+void vFRAM_BeginTxn(void)
+{
+}
+
+void vFRAM_EndTxn(void)
+{
+}
+
+/*****************************  FIRMWARE STUBS  ******************************/
+
+uint uiMISC_buildUintFromBytes(uchar *ucpBytes, uchar ucIntFlag)
+{
+	(void) ucIntFlag;
+	return ((uint) ucpBytes[0] << 8) | ucpBytes[1];
+}
+
+ulong ulMISC_buildUlongFromBytes(uchar *ucpBytes, uchar ucIntFlag)
+{
+	(void) ucIntFlag;
+	return ((ulong) ucpBytes[0] << 24) | ((ulong) ucpBytes[1] << 16) | ((ulong) ucpBytes[2] << 8) | ucpBytes[3];
+}
+
+void vMISC_copyUintIntoBytes(uint uiVal, uchar *ucpToPtr, uchar ucIntFlag)
+{
+	(void) ucIntFlag;
+	ucpToPtr[0] = (uchar) (uiVal >> 8);
+	ucpToPtr[1] = (uchar) uiVal;
+}
+
+void vMISC_copyUlongIntoBytes(ulong ulVal, uchar *ucpToPtr, uchar ucIntFlag)
+{
+	(void) ucIntFlag;
+	ucpToPtr[0] = (uchar) (ulVal >> 24);
+	ucpToPtr[1] = (uchar) (ulVal >> 16);
+	ucpToPtr[2] = (uchar) (ulVal >> 8);
+	ucpToPtr[3] = (uchar) ulVal;
+}
+
+uchar ucTask_GetField(uchar ucTskIndex, uchar ucField, ulong *ulRetPtr)
+{
+	(void) ucTskIndex;
+	switch (ucField)
+	{
+		case TSK_ID:
+			*ulRetPtr = ulaTest_TaskField[0];
+		break;
+		case TSK_FLAGS:
+			*ulRetPtr = ulaTest_TaskField[1];
+		break;
+		case TSK_STATE:
+			*ulRetPtr = ulaTest_TaskField[2];
+		break;
+		default:
+			*ulRetPtr = 0;
+		break;
+	}
+	return TASKMNGR_OK;
+}
+
+uchar ucTask_GetParam(uchar ucTskIndex, uchar ucIndex, ulong *ulRetPtr)
+{
+	(void) ucTskIndex;
+	*ulRetPtr = ulaTest_TaskParam[ucIndex & 3];
+	return TASKMNGR_OK;
+}
+
+void vSERIAL_sout(char *cStrPtr, uint uiLength)
+{
+	// ucL2FRAM_replayTSBJrnl() found a record with a bad CRC
+	if (uiLength >= 17 && strncmp(cStrPtr, "L2FRM:TSBJrnlTorn", 17) == 0)
+		uiTornCount++;
+}
+
+long lTIME_getSysTimeAsLong(void) { return 0; }
+uchar ucMODOPT_getCurRole(void) { return 0; }
+uint uiROM_getRomConfigSnumAsUint(void) { return 0; }
+unsigned long ulSD_GetCapacity(void) { return 0; }
+usl uslRAND_getRolledFullSysSeed(void) { return 0; }
+void vMODOPT_copyAllFramOptionsToRamOptions(void) { }
+void vMODOPT_copyAllRomOptionsToFramOptions(uchar ucRomOptionTblNum) { (void) ucRomOptionTblNum; }
+void vMODOPT_showCurRole(void) { }
+void vSERIAL_HB16out(uint16 uiInt) { (void) uiInt; }
+void vSERIAL_HB8out(uchar ucByte) { (void) ucByte; }
+void vSERIAL_HBV32out(unsigned long ulLong) { (void) ulLong; }
+void vSERIAL_UI16out(uint16 uiInt) { (void) uiInt; }
+void vSERIAL_UI32out(unsigned long ulVal) { (void) ulVal; }
+void vSERIAL_UI8_2char_out(uchar ucVal, uchar ucLeadFillChar) { (void) ucVal; (void) ucLeadFillChar; }
+void vSERIAL_UIV16out(uint uiVal) { (void) uiVal; }
+void vSERIAL_UIV8out(uchar ucVal) { (void) ucVal; }
+void vSERIAL_bout(uchar ucChar) { (void) ucChar; }
+void vSERIAL_colTab(uchar ucColNum) { (void) ucColNum; }
+void vSERIAL_crlf(void) { }
+void vTask_showTaskName(uchar ucTaskIdx) { (void) ucTaskIdx; }
+
+/*****************************  TEST HARNESS  ********************************/
+
+//! \var ucaTest_Fields
+//! \brief Index and size of every field of a block
+static const uchar ucaTest_Fields[8][2] =
+{
+	{ FRAM_ST_BLK_TASK_IDX, 1 },
+	{ FRAM_ST_BLK_TASK_ID, 2 },
+	{ FRAM_ST_BLK_FLAGS, 2 },
+	{ FRAM_ST_BLK_TASK_STATE, 1 },
+	{ FRAM_ST_BLK_PARAM1, 4 },
+	{ FRAM_ST_BLK_PARAM2, 4 },
+	{ FRAM_ST_BLK_PARAM3, 4 },
+	{ FRAM_ST_BLK_PARAM4, 4 }
+};
+
+static ulong ulTest_FieldVal(uchar ucSize)
+{
+	if (ucSize == 1)
+		return ulTest_Random() & 0xFF;
+	if (ucSize == 2)
+		return ulTest_Random() & 0xFFFF;
+	return ulTest_Random();
+}
+
+// Big endian, as the FRAM driver stores it
+static void vTest_SetField(uchar *ucpBlk, uchar ucField, ulong ulVal)
+{
+	uchar ucIdx;
+	uchar ucSize;
+
+	ucIdx = ucaTest_Fields[ucField][0];
+	ucSize = ucaTest_Fields[ucField][1];
+	while (ucSize-- > 0)
+	{
+		ucpBlk[ucIdx + ucSize] = (uchar) ulVal;
+		ulVal >>= 8;
+	}
+}
+
+static ulong ulTest_GetField(const uchar *ucpBlk, uchar ucField)
+{
+	uchar ucIdx;
+	uchar ucii;
+	ulong ulVal;
+
+	ucIdx = ucaTest_Fields[ucField][0];
+	ulVal = 0;
+	for (ucii = 0; ucii < ucaTest_Fields[ucField][1]; ucii++)
+		ulVal = (ulVal << 8) | ucpBlk[ucIdx + ucii];
+	return ulVal;
+}
+
+static void vTest_ReadFramTbl(S_TestTbl *S_Tbl)
+{
+	S_Tbl->m_ucCount = ucaTestFram[FRAM_ST_BLK_COUNT_ADDR];
+	memcpy(S_Tbl->m_ucaBlk, &ucaTestFram[FRAM_ST_BLK_0_ADDR], sizeof(S_Tbl->m_ucaBlk));
+}
+
+static int iTest_TblEqual(const S_TestTbl *S_A, const S_TestTbl *S_B)
+{
+	return S_A->m_ucCount == S_B->m_ucCount && memcmp(S_A->m_ucaBlk, S_B->m_ucaBlk, sizeof(S_A->m_ucaBlk)) == 0;
+}
+
+// What the rest of the firmware reads, the journal record ahead of the table included
+static int iTest_ReadsMatch(const S_TestTbl *S_Tbl)
+{
+	uchar ucBlk;
+	uchar ucField;
+
+	if (ucL2FRAM_getTSBTblCount() != S_Tbl->m_ucCount)
+		return 0;
+
+	for (ucBlk = 0; ucBlk < S_Tbl->m_ucCount; ucBlk++)
+	{
+		for (ucField = 0; ucField < 8; ucField++)
+		{
+			if (ulL2FRAM_getTSBEntryVal(ucBlk, ucaTest_Fields[ucField][0]) != ulTest_GetField(S_Tbl->m_ucaBlk[ucBlk], ucField))
+				return 0;
+		}
+	}
+	return 1;
+}
+
+// A power up clears the RAM
+static void vTest_PowerUp(void)
+{
+	ucL2FRAM_TxnSection = 0;
+	ucL2FRAM_TxnDepth = 0;
+	uiL2FRAM_TSBJrnlSeq = 0;
+	ucL2FRAM_TSBJrnlLive = 0;
+	memset(ucaL2FRAM_TSBJrnlLive, 0, sizeof(ucaL2FRAM_TSBJrnlLive));
+}
+
+// Plays one operation on the firmware and on the expected table
+static void vTest_Op(S_TestTbl *S_After)
+{
+	uchar ucBlk;
+	uchar ucField;
+	uchar ucNumVals;
+	uchar ucaIdx[3];
+	ulong ulaVal[3];
+	ulong ulaBlk[8];
+	unsigned long ulDice;
+
+	ulDice = ulTest_Random() % 100;
+	if (S_After->m_ucCount == 0 || (ulDice < 25 && S_After->m_ucCount < FRAM_MAX_TSB_COUNT))
+	{
+		// Add, the task manager hands over the fields
+		if (S_After->m_ucCount >= FRAM_MAX_TSB_COUNT)
+			return;
+		ucBlk = S_After->m_ucCount;
+		ulaTest_TaskField[0] = ulTest_FieldVal(2);
+		ulaTest_TaskField[1] = ulTest_FieldVal(2);
+		ulaTest_TaskField[2] = ulTest_FieldVal(1);
+		for (ucField = 0; ucField < 4; ucField++)
+			ulaTest_TaskParam[ucField] = ulTest_FieldVal(4);
+
+		ulaBlk[0] = ulTest_FieldVal(1);
+		ulaBlk[1] = ulaTest_TaskField[0];
+		ulaBlk[2] = ulaTest_TaskField[1];
+		ulaBlk[3] = ulaTest_TaskField[2];
+		for (ucField = 0; ucField < 4; ucField++)
+			ulaBlk[4 + ucField] = ulaTest_TaskParam[ucField];
+		for (ucField = 0; ucField < 8; ucField++)
+			vTest_SetField(S_After->m_ucaBlk[ucBlk], ucField, ulaBlk[ucField]);
+		S_After->m_ucCount++;
+
+		cL2FRAM_addTSB((uchar) ulaBlk[0]);
+		return;
+	}
+
+	ucBlk = (uchar) (ulTest_Random() % S_After->m_ucCount);
+	if (ulDice < 45)
+	{
+		// Delete, the last block moves into the hole
+		S_After->m_ucCount--;
+		if (ucBlk != S_After->m_ucCount)
+			memcpy(S_After->m_ucaBlk[ucBlk], S_After->m_ucaBlk[S_After->m_ucCount], FRAM_ST_BLK_SIZE);
+		memset(S_After->m_ucaBlk[S_After->m_ucCount], 0, FRAM_ST_BLK_SIZE);
+
+		vL2FRAM_deleteTSB(ucBlk);
+	}
+	else if (ulDice < 65)
+	{
+		// Stuff the whole block
+		for (ucField = 0; ucField < 8; ucField++)
+		{
+			ulaBlk[ucField] = ulTest_FieldVal(ucaTest_Fields[ucField][1]);
+			vTest_SetField(S_After->m_ucaBlk[ucBlk], ucField, ulaBlk[ucField]);
+		}
+
+		vL2FRAM_stuffTSB(ucBlk, (uchar) ulaBlk[0], (uint) ulaBlk[1], (uint) ulaBlk[2], (uchar) ulaBlk[3],
+				ulaBlk[4], ulaBlk[5], ulaBlk[6], ulaBlk[7]);
+	}
+	else
+	{
+		// Put a few fields, the same one twice is allowed
+		ucNumVals = (uchar) (1 + ulTest_Random() % 3);
+		for (ucField = 0; ucField < ucNumVals; ucField++)
+		{
+			ulDice = ulTest_Random() % 8;
+			ucaIdx[ucField] = ucaTest_Fields[ulDice][0];
+			ulaVal[ucField] = ulTest_FieldVal(ucaTest_Fields[ulDice][1]);
+			vTest_SetField(S_After->m_ucaBlk[ucBlk], (uchar) ulDice, ulaVal[ucField]);
+		}
+
+		vL2FRAM_putTSBEntryVals(ucBlk, ucNumVals, ucaIdx, ulaVal);
+	}
+}
+
+static void vTest_Run(unsigned int uiRun, unsigned int *uipBefore, unsigned int *uipAfter)
+{
+	S_TestTbl S_Tbl;
+	S_TestTbl S_After;
+	S_TestTbl S_Fram;
+	unsigned int uiOp;
+	volatile int iCutReplay;
+
+	// A formatted part
+	memset(ucaTestFram, 0, sizeof(ucaTestFram));
+	memset(&S_Tbl, 0, sizeof(S_Tbl));
+	vTest_PowerUp();
+	lTest_WriteBudget = TEST_NO_CUT;
+	ucL2FRAM_replayTSBJrnl();
+
+	for (uiOp = 0; uiOp < TEST_OPS; uiOp++)
+	{
+		S_After = S_Tbl;
+		iCutReplay = 0;
+
+		lTest_WriteBudget = TEST_NO_CUT;
+		if ((ulTest_Random() % 100) < TEST_CUT_CHANCE)
+			lTest_WriteBudget = (long) (ulTest_Random() % TEST_MAX_CUT);
+
+		if (setjmp(jbTest_Reset) == 0)
+		{
+			vTest_Op(&S_After);
+			lTest_WriteBudget = TEST_NO_CUT;
+
+			vTest_Check(iTest_ReadsMatch(&S_After), "reads", uiRun, uiOp);
+			S_Tbl = S_After;
+			if ((ulTest_Random() % 100) >= TEST_REBOOT_CHANCE)
+				continue;
+		}
+
+		// Boot, the replay itself may be cut short and run again
+		if (setjmp(jbTest_Reset) == 0 && iCutReplay == 0)
+		{
+			iCutReplay = 1;
+			vTest_PowerUp();
+			lTest_WriteBudget = TEST_NO_CUT;
+			if ((ulTest_Random() % 100) < TEST_CUT_CHANCE)
+				lTest_WriteBudget = (long) (ulTest_Random() % (FRAM_TSB_JRNL_MAX_IMGS * FRAM_ST_BLK_SIZE + 2));
+			ucL2FRAM_replayTSBJrnl();
+		}
+		vTest_PowerUp();
+		lTest_WriteBudget = TEST_NO_CUT;
+		ucL2FRAM_replayTSBJrnl();
+
+		// Either all of the operation or none of it
+		vTest_ReadFramTbl(&S_Fram);
+		if (iTest_TblEqual(&S_Fram, &S_After))
+		{
+			(*uipAfter)++;
+			S_Tbl = S_After;
+		}
+		else
+		{
+			vTest_Check(iTest_TblEqual(&S_Fram, &S_Tbl), "table after reset", uiRun, uiOp);
+			(*uipBefore)++;
+		}
+		vTest_Check(iTest_ReadsMatch(&S_Tbl), "reads after reset", uiRun, uiOp);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int uiRun;
+	unsigned int uiBefore;
+	unsigned int uiAfter;
+
+	ulRandState = 0x2545F491UL;
+	if (argc > 1)
+		ulRandState = strtoul(argv[1], NULL, 0) | 1;
+
+	uiBefore = 0;
+	uiAfter = 0;
+	for (uiRun = 0; uiRun < TEST_RUNS; uiRun++)
+		vTest_Run(uiRun, &uiBefore, &uiAfter);
+
+	// The cuts must land before and after the record and hit records being written
+	vTest_Check(uiBefore != 0, "no reset rolled back", 0, 0);
+	vTest_Check(uiAfter != 0, "no reset rolled forward", 0, 0);
+	vTest_Check(uiTornCount != 0, "no torn record", 0, 0);
+
+	if (uiFailCount != 0) {
+		printf("%u checks failed\n", uiFailCount);
+		return 1;
+	}
+
+	printf("all checks passed\n");
+	return 0;
+}